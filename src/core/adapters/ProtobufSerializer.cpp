@@ -15,7 +15,9 @@
 namespace flykylin {
 namespace adapters {
 
-ProtobufSerializer::ProtobufSerializer() {
+ProtobufSerializer::ProtobufSerializer()
+    : m_discoveryScratch(std::make_unique<flykylin::protocol::DiscoveryMessage>())
+{
     // 初始化Protobuf库（如需要）
     GOOGLE_PROTOBUF_VERIFY_VERSION;
 }
@@ -94,6 +96,51 @@ std::optional<core::PeerNode> ProtobufSerializer::deserializePeerMessage(const s
     return peer;
 }
 
+ports::DecodeResult<core::PeerNode> ProtobufSerializer::decodePeerMessage(ports::ByteView data) {
+    using Result = ports::DecodeResult<core::PeerNode>;
+
+    if (data.empty()) {
+        return Result::failure(ports::DecodeError::Empty);
+    }
+
+    auto& msg = *m_discoveryScratch;
+    if (!msg.ParseFromArray(data.data, static_cast<int>(data.size))) {
+        return Result::failure(ports::DecodeError::Malformed);
+    }
+
+    if (!msg.has_peer()) {
+        return Result::failure(ports::DecodeError::MissingField);
+    }
+
+    core::PeerNode peer = convertFromProtobuf(msg.peer());
+    peer.setOnline(msg.type() != flykylin::protocol::DiscoveryType::GOODBYE);
+    return Result::success(std::move(peer));
+}
+
+bool ProtobufSerializer::serializePeerMessageInto(ports::DiscoveryKind kind,
+                                                  const core::PeerNode& peer,
+                                                  std::vector<uint8_t>& out) {
+    auto& msg = *m_discoveryScratch;
+    msg.Clear();
+
+    switch (kind) {
+    case ports::DiscoveryKind::Announce:
+        msg.set_type(flykylin::protocol::DiscoveryType::ANNOUNCE);
+        break;
+    case ports::DiscoveryKind::Heartbeat:
+        msg.set_type(flykylin::protocol::DiscoveryType::HEARTBEAT);
+        break;
+    case ports::DiscoveryKind::Goodbye:
+        msg.set_type(flykylin::protocol::DiscoveryType::GOODBYE);
+        break;
+    }
+    convertToProtobuf(peer, msg.mutable_peer());
+
+    const size_t size = msg.ByteSizeLong();
+    out.resize(size);
+    return msg.SerializeToArray(out.data(), static_cast<int>(size));
+}
+
 // ========== 文本消息 ==========
 
 std::vector<uint8_t> ProtobufSerializer::serializeTextMessage(const core::Message& message) {
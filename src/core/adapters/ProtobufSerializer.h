@@ -17,6 +17,7 @@
 namespace flykylin {
 namespace protocol {
 class PeerInfo;
+class DiscoveryMessage;
 }
 }
 
@@ -43,6 +44,10 @@ public:
     std::vector<uint8_t> serializePeerHeartbeat(const core::PeerNode& peer) override;
     std::vector<uint8_t> serializePeerGoodbye(const core::PeerNode& peer) override;
     std::optional<core::PeerNode> deserializePeerMessage(const std::vector<uint8_t>& data) override;
+    ports::DecodeResult<core::PeerNode> decodePeerMessage(ports::ByteView data) override;
+    bool serializePeerMessageInto(ports::DiscoveryKind kind,
+                                  const core::PeerNode& peer,
+                                  std::vector<uint8_t>& out) override;
 
     // ========== 文本消息 ==========
     
@@ -63,6 +68,9 @@ private:
     
     // 辅助方法：将protobuf PeerInfo转换为PeerNode
     core::PeerNode convertFromProtobuf(const protocol::PeerInfo& pbPeerInfo) const;
+
+    // 复用的发现消息对象：Clear() 保留字符串容量，热路径上避免反复分配
+    std::unique_ptr<protocol::DiscoveryMessage> m_discoveryScratch;
 };
 
 } // namespace adapters
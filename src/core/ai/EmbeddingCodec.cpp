@@ -0,0 +1,104 @@
+#include "EmbeddingCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace flykylin {
+namespace ai {
+namespace embedding_codec {
+
+bool normalize(std::vector<float>& v)
+{
+    double sum = 0.0;
+    for (float x : v) {
+        sum += static_cast<double>(x) * x;
+    }
+    if (sum <= 0.0 || !std::isfinite(sum)) {
+        return false;
+    }
+    const float inv = static_cast<float>(1.0 / std::sqrt(sum));
+    for (float& x : v) {
+        x *= inv;
+    }
+    return true;
+}
+
+std::vector<uint8_t> encode(const std::vector<float>& v)
+{
+    std::vector<float> unit = v;
+    if (!normalize(unit)) {
+        return {};
+    }
+
+    float maxAbs = 0.0f;
+    for (float x : unit) {
+        maxAbs = std::max(maxAbs, std::fabs(x));
+    }
+    const float scale = maxAbs / 127.0f;
+
+    std::vector<uint8_t> out(kHeaderBytes + unit.size());
+    std::memcpy(out.data(), &scale, sizeof(scale));
+    for (std::size_t i = 0; i < unit.size(); ++i) {
+        const long q = std::lround(unit[i] / scale);
+        const auto clamped = static_cast<int8_t>(std::clamp(q, -127L, 127L));
+        std::memcpy(&out[kHeaderBytes + i], &clamped, 1);
+    }
+    return out;
+}
+
+std::size_t dimensions(std::size_t size)
+{
+    return size > kHeaderBytes ? size - kHeaderBytes : 0;
+}
+
+std::vector<float> decode(const uint8_t* data, std::size_t size)
+{
+    const std::size_t dim = dimensions(size);
+    if (dim == 0) {
+        return {};
+    }
+    float scale = 0.0f;
+    std::memcpy(&scale, data, sizeof(scale));
+    const auto* q = reinterpret_cast<const int8_t*>(data + kHeaderBytes);
+    std::vector<float> out(dim);
+    for (std::size_t i = 0; i < dim; ++i) {
+        out[i] = static_cast<float>(q[i]) * scale;
+    }
+    return out;
+}
+
+float cosine(const std::vector<float>& unitQuery, const uint8_t* data, std::size_t size)
+{
+    const std::size_t dim = dimensions(size);
+    if (dim == 0 || dim != unitQuery.size()) {
+        return 0.0f;
+    }
+    float scale = 0.0f;
+    std::memcpy(&scale, data, sizeof(scale));
+    const auto* q = reinterpret_cast<const int8_t*>(data + kHeaderBytes);
+    const float* u = unitQuery.data();
+
+    // Independent partial sums let the compiler use SIMD lanes without
+    // -ffast-math; this loop is what every search spends its time in
+    constexpr std::size_t kLanes = 8;
+    float lanes[kLanes] = {};
+    std::size_t i = 0;
+    for (; i + kLanes <= dim; i += kLanes) {
+        for (std::size_t l = 0; l < kLanes; ++l) {
+            lanes[l] += u[i + l] * static_cast<float>(q[i + l]);
+        }
+    }
+    float dot = 0.0f;
+    for (; i < dim; ++i) {
+        dot += u[i] * static_cast<float>(q[i]);
+    }
+    for (float lane : lanes) {
+        dot += lane;
+    }
+    return dot * scale;
+}
+
+} // namespace embedding_codec
+} // namespace ai
+} // namespace flykylin
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace flykylin {
+namespace ai {
+
+/**
+ * @brief Compact stored form of an embedding: unit length, int8 per dimension
+ *
+ * Layout: float scale, then one int8 per dimension; component i of the
+ * unit vector is q[i] * scale. 512 dimensions take 516 bytes instead of
+ * 2 KB, and cosine similarity comes out within about 0.01 of the float
+ * result, well inside the gaps that matter for ranking search hits.
+ */
+namespace embedding_codec {
+
+constexpr std::size_t kHeaderBytes = sizeof(float);
+
+/**
+ * @brief Scale v to unit length in place
+ * @return false if v is empty or all zero (nothing to compare against)
+ */
+bool normalize(std::vector<float>& v);
+
+/**
+ * @return Encoded bytes; empty if v is empty or all zero
+ */
+std::vector<uint8_t> encode(const std::vector<float>& v);
+
+/**
+ * @return The unit vector; empty if the data is malformed
+ */
+std::vector<float> decode(const uint8_t* data, std::size_t size);
+
+/**
+ * @brief Number of dimensions of encoded data, 0 if malformed
+ */
+std::size_t dimensions(std::size_t size);
+
+/**
+ * @brief Cosine similarity of a unit-length query and encoded data
+ * @return 0 if the dimensions differ or the data is malformed
+ */
+float cosine(const std::vector<float>& unitQuery, const uint8_t* data, std::size_t size);
+
+} // namespace embedding_codec
+
+} // namespace ai
+} // namespace flykylin
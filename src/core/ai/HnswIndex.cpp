@@ -0,0 +1,859 @@
+#include "HnswIndex.h"
+
+#include "EmbeddingCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+namespace flykylin {
+namespace ai {
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'K', 'H', 'N', 'S', 'W', '\0', '\0'};
+constexpr uint32_t kFileVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+constexpr uint32_t kNoTag = std::numeric_limits<uint32_t>::max();
+constexpr int kMaxLevel = 16;
+// Vectors a layer-0 search compares per unit of ef (clustered 512-dim data)
+constexpr std::size_t kComparisonsPerEf = 32;
+
+constexpr uint8_t kRemoved = 0x1;
+constexpr uint8_t kNoVector = 0x2;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t dimensions;
+    uint32_t m;
+    uint32_t efConstruction;
+    uint32_t efSearch;
+    uint32_t exactScanLimit;
+    uint32_t count;
+    uint32_t entryPoint;
+    int32_t maxLevel;
+    uint64_t labelBytes;
+    uint64_t tagBytes;
+    uint64_t upperWords;
+};
+static_assert(sizeof(FileHeader) % 8 == 0, "sections after the header must stay 8-byte aligned");
+
+std::size_t padded(std::size_t size)
+{
+    return (size + 7) & ~static_cast<std::size_t>(7);
+}
+
+float scaleOf(const uint8_t* vector)
+{
+    float scale = 0.0f;
+    std::memcpy(&scale, vector, sizeof(scale));
+    return scale;
+}
+
+const int8_t* valuesOf(const uint8_t* vector)
+{
+    return reinterpret_cast<const int8_t*>(vector + embedding_codec::kHeaderBytes);
+}
+
+// A link list is its length, then that many node ids
+bool validLinks(const uint32_t* list, std::size_t capacity, std::size_t count)
+{
+    if (list[0] > capacity) {
+        return false;
+    }
+    for (uint32_t i = 1; i <= list[0]; ++i) {
+        if (list[i] >= count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t conversationKey(uint32_t owner, uint32_t peer)
+{
+    return (static_cast<uint64_t>(owner) << 32) | peer;
+}
+
+} // namespace
+
+struct HnswIndex::NodeMeta {
+    int64_t rowId;
+    int64_t timestamp;
+    uint32_t owner;
+    uint32_t peer;
+    uint8_t level;
+    uint8_t flags;
+    uint8_t reserved[6];
+};
+
+/**
+ * Fixed-size records: those loaded from a file stay where they are, added
+ * ones go to chunks so growing never moves (or doubles) what is there.
+ */
+struct HnswIndex::Block {
+    static constexpr std::size_t kChunkRecords = 4096;
+
+    explicit Block(std::size_t recordBytes)
+        : stride(recordBytes)
+    {
+    }
+
+    uint8_t* at(uint32_t i) const
+    {
+        if (i < baseCount) {
+            return base + static_cast<std::size_t>(i) * stride;
+        }
+        const std::size_t t = i - baseCount;
+        return chunks[t / kChunkRecords].get() + (t % kChunkRecords) * stride;
+    }
+
+    void append()
+    {
+        if (tailCount % kChunkRecords == 0) {
+            chunks.emplace_back(new uint8_t[kChunkRecords * stride]());
+        }
+        ++tailCount;
+    }
+
+    bool write(const Writer& writer) const
+    {
+        if (baseCount > 0 && !writer(base, baseCount * stride)) {
+            return false;
+        }
+        for (std::size_t c = 0; c < chunks.size(); ++c) {
+            const std::size_t records = std::min(kChunkRecords, tailCount - c * kChunkRecords);
+            if (!writer(chunks[c].get(), records * stride)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::size_t stride;
+    uint8_t* base{nullptr};
+    std::size_t baseCount{0};
+    std::size_t tailCount{0};
+    std::vector<std::unique_ptr<uint8_t[]>> chunks;
+};
+
+struct HnswIndex::Query {
+    bool anyOwner{true};
+    bool anyPeer{true};
+    uint32_t owner{kNoTag};
+    uint32_t peer{kNoTag};
+    int64_t fromMs{std::numeric_limits<int64_t>::min()};
+    int64_t toMs{std::numeric_limits<int64_t>::max()};
+
+    bool timeLimited() const
+    {
+        return fromMs != std::numeric_limits<int64_t>::min() || toMs != std::numeric_limits<int64_t>::max();
+    }
+
+    bool matches(const NodeMeta& meta) const
+    {
+        return (anyOwner || meta.owner == owner) && (anyPeer || meta.peer == peer) &&
+               meta.timestamp >= fromMs && meta.timestamp <= toMs;
+    }
+};
+
+class HnswIndex::Visited {
+public:
+    explicit Visited(std::size_t count)
+        : m_words((count + 63) / 64, 0)
+    {
+    }
+
+    bool insert(uint32_t i)
+    {
+        uint64_t& word = m_words[i >> 6];
+        const uint64_t bit = uint64_t{1} << (i & 63);
+        if (word & bit) {
+            return false;
+        }
+        word |= bit;
+        return true;
+    }
+
+private:
+    std::vector<uint64_t> m_words;
+};
+
+HnswIndex::HnswIndex(std::size_t dimensions)
+    : HnswIndex(dimensions, Options())
+{
+}
+
+HnswIndex::HnswIndex(std::size_t dimensions, const Options& options)
+    : m_dimensions(dimensions)
+    , m_options(options)
+    , m_vectorBytes(embedding_codec::kHeaderBytes + dimensions)
+{
+    static_assert(sizeof(NodeMeta) == 32, "NodeMeta is part of the file format");
+    m_options.m = std::max<uint32_t>(m_options.m, 2);
+    m_options.efConstruction = std::max(m_options.efConstruction, m_options.m);
+    m_options.efSearch = std::max<uint32_t>(m_options.efSearch, 1);
+    m_linkWords0 = 1 + 2 * static_cast<std::size_t>(m_options.m);
+    m_linkWordsUpper = 1 + static_cast<std::size_t>(m_options.m);
+    m_links0 = std::make_unique<Block>(m_linkWords0 * sizeof(uint32_t));
+    m_vectors = std::make_unique<Block>(m_vectorBytes);
+}
+
+HnswIndex::~HnswIndex() = default;
+
+uint32_t* HnswIndex::links(uint32_t node, int layer)
+{
+    if (layer == 0) {
+        return reinterpret_cast<uint32_t*>(m_links0->at(node));
+    }
+    return m_upperLinks.at(node).data() + static_cast<std::size_t>(layer - 1) * m_linkWordsUpper;
+}
+
+const uint32_t* HnswIndex::links(uint32_t node, int layer) const
+{
+    if (layer == 0) {
+        return reinterpret_cast<const uint32_t*>(m_links0->at(node));
+    }
+    return m_upperLinks.at(node).data() + static_cast<std::size_t>(layer - 1) * m_linkWordsUpper;
+}
+
+const uint8_t* HnswIndex::vector(uint32_t node) const
+{
+    return m_vectors->at(node);
+}
+
+uint32_t HnswIndex::tagId(const std::string& tag)
+{
+    const auto it = m_tagIds.find(tag);
+    if (it != m_tagIds.end()) {
+        return it->second;
+    }
+    const auto id = static_cast<uint32_t>(m_tags.size());
+    m_tags.push_back(tag);
+    m_tagIds.emplace(tag, id);
+    return id;
+}
+
+uint32_t HnswIndex::findTag(const std::string& tag) const
+{
+    const auto it = m_tagIds.find(tag);
+    return it != m_tagIds.end() ? it->second : kNoTag;
+}
+
+int HnswIndex::randomLevel()
+{
+    // Level l holds about m^-l of the entries
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    const double r = std::max(uniform(m_rng), 1e-12);
+    const double level = -std::log(r) / std::log(static_cast<double>(m_options.m));
+    return std::min(static_cast<int>(level), kMaxLevel);
+}
+
+float HnswIndex::similarity(uint32_t a, uint32_t b) const
+{
+    const uint8_t* va = vector(a);
+    const uint8_t* vb = vector(b);
+    const int8_t* qa = valuesOf(va);
+    const int8_t* qb = valuesOf(vb);
+    int32_t dot = 0;
+    for (std::size_t i = 0; i < m_dimensions; ++i) {
+        dot += static_cast<int32_t>(qa[i]) * static_cast<int32_t>(qb[i]);
+    }
+    return static_cast<float>(dot) * scaleOf(va) * scaleOf(vb);
+}
+
+template <typename Similarity, typename Accept>
+std::vector<std::pair<float, uint32_t>> HnswIndex::searchLayer(uint32_t entry,
+                                                               const Similarity& similarityTo,
+                                                               std::size_t ef,
+                                                               int layer,
+                                                               const Accept& accept,
+                                                               Visited& visited) const
+{
+    using Scored = std::pair<float, uint32_t>;
+    std::priority_queue<Scored> candidates;                                         // best on top
+    std::priority_queue<Scored, std::vector<Scored>, std::greater<Scored>> results; // worst on top
+
+    visited.insert(entry);
+    const float first = similarityTo(entry);
+    candidates.emplace(first, entry);
+    if (accept(entry)) {
+        results.emplace(first, entry);
+    }
+
+    while (!candidates.empty()) {
+        const Scored current = candidates.top();
+        if (results.size() >= ef && current.first < results.top().first) {
+            break;
+        }
+        candidates.pop();
+
+        const uint32_t* list = links(current.second, layer);
+        for (uint32_t i = 1; i <= list[0]; ++i) {
+            const uint32_t next = list[i];
+            if (!visited.insert(next)) {
+                continue;
+            }
+            const float score = similarityTo(next);
+            if (results.size() < ef || score > results.top().first) {
+                // Rejected entries still lead to accepted ones
+                candidates.emplace(score, next);
+                if (accept(next)) {
+                    results.emplace(score, next);
+                    if (results.size() > ef) {
+                        results.pop();
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<Scored> found(results.size());
+    for (auto it = found.rbegin(); it != found.rend(); ++it) {
+        *it = results.top();
+        results.pop();
+    }
+    return found;
+}
+
+template <typename Similarity>
+uint32_t HnswIndex::greedyDescend(uint32_t entry, int fromLayer, int toLayer, const Similarity& similarityTo) const
+{
+    uint32_t current = entry;
+    float best = similarityTo(entry);
+    for (int layer = fromLayer; layer > toLayer; --layer) {
+        bool improved = true;
+        while (improved) {
+            improved = false;
+            const uint32_t* list = links(current, layer);
+            for (uint32_t i = 1; i <= list[0]; ++i) {
+                const float score = similarityTo(list[i]);
+                if (score > best) {
+                    best = score;
+                    current = list[i];
+                    improved = true;
+                }
+            }
+        }
+    }
+    return current;
+}
+
+std::vector<uint32_t> HnswIndex::selectNeighbors(std::vector<std::pair<float, uint32_t>> candidates,
+                                                 std::size_t maxCount) const
+{
+    std::sort(candidates.begin(), candidates.end(), std::greater<>());
+
+    std::vector<uint32_t> selected;
+    selected.reserve(maxCount);
+    if (candidates.size() <= maxCount) {
+        for (const auto& candidate : candidates) {
+            selected.push_back(candidate.second);
+        }
+        return selected;
+    }
+
+    // Skip a candidate that is closer to an already selected neighbour than
+    // to base: links then spread in all directions instead of into one cluster
+    for (const auto& candidate : candidates) {
+        if (selected.size() >= maxCount) {
+            break;
+        }
+        bool diverse = true;
+        for (uint32_t kept : selected) {
+            if (similarity(candidate.second, kept) > candidate.first) {
+                diverse = false;
+                break;
+            }
+        }
+        if (diverse) {
+            selected.push_back(candidate.second);
+        }
+    }
+    return selected;
+}
+
+void HnswIndex::connect(uint32_t node, int layer, const std::vector<uint32_t>& neighbors)
+{
+    uint32_t* list = links(node, layer);
+    list[0] = static_cast<uint32_t>(neighbors.size());
+    std::copy(neighbors.begin(), neighbors.end(), list + 1);
+    for (uint32_t neighbor : neighbors) {
+        link(neighbor, node, layer);
+    }
+}
+
+void HnswIndex::link(uint32_t from, uint32_t to, int layer)
+{
+    const std::size_t capacity = layer == 0 ? 2 * static_cast<std::size_t>(m_options.m) : m_options.m;
+    uint32_t* list = links(from, layer);
+    if (list[0] < capacity) {
+        list[++list[0]] = to;
+        return;
+    }
+
+    std::vector<std::pair<float, uint32_t>> candidates;
+    candidates.reserve(capacity + 1);
+    candidates.emplace_back(similarity(from, to), to);
+    for (uint32_t i = 1; i <= list[0]; ++i) {
+        candidates.emplace_back(similarity(from, list[i]), list[i]);
+    }
+    const std::vector<uint32_t> kept = selectNeighbors(std::move(candidates), capacity);
+    list[0] = static_cast<uint32_t>(kept.size());
+    std::copy(kept.begin(), kept.end(), list + 1);
+}
+
+bool HnswIndex::add(int64_t rowId,
+                    const std::string& ownerId,
+                    const std::string& peerId,
+                    int64_t timestampMs,
+                    const uint8_t* vector,
+                    std::size_t size)
+{
+    const bool hasVector = size > 0;
+    if ((hasVector && size != m_vectorBytes) || m_nodeOf.count(rowId) != 0 || m_meta.size() >= kNoTag) {
+        return false;
+    }
+
+    const auto node = static_cast<uint32_t>(m_meta.size());
+    const int level = hasVector ? randomLevel() : 0;
+
+    NodeMeta meta{};
+    meta.rowId = rowId;
+    meta.timestamp = timestampMs;
+    meta.owner = tagId(ownerId);
+    meta.peer = tagId(peerId);
+    meta.level = static_cast<uint8_t>(level);
+    meta.flags = hasVector ? 0 : kNoVector;
+    m_meta.push_back(meta);
+    m_links0->append();
+    m_vectors->append();
+    if (level > 0) {
+        m_upperLinks[node].assign(static_cast<std::size_t>(level) * m_linkWordsUpper, 0);
+    }
+    m_nodeOf.emplace(rowId, node);
+    m_rowIdSum += static_cast<uint64_t>(rowId);
+
+    if (!hasVector) {
+        return true;
+    }
+    std::memcpy(m_vectors->at(node), vector, size);
+    ++m_searchable;
+    ++m_searchableByConversation[conversationKey(meta.owner, meta.peer)];
+
+    if (m_maxLevel < 0) {
+        m_entryPoint = node;
+        m_maxLevel = level;
+        return true;
+    }
+
+    const auto similarityTo = [this, node](uint32_t other) { return similarity(node, other); };
+    const auto acceptAll = [](uint32_t) { return true; };
+
+    uint32_t entry = greedyDescend(m_entryPoint, m_maxLevel, level, similarityTo);
+    for (int layer = std::min(level, m_maxLevel); layer >= 0; --layer) {
+        Visited visited(m_meta.size());
+        auto candidates = searchLayer(entry, similarityTo, m_options.efConstruction, layer, acceptAll, visited);
+        entry = candidates.front().second;
+        connect(node, layer, selectNeighbors(std::move(candidates), m_options.m));
+    }
+
+    if (level > m_maxLevel) {
+        m_maxLevel = level;
+        m_entryPoint = node;
+    }
+    return true;
+}
+
+void HnswIndex::forget(uint32_t node)
+{
+    NodeMeta& meta = m_meta[node];
+    meta.flags |= kRemoved;
+    m_nodeOf.erase(meta.rowId);
+    m_rowIdSum -= static_cast<uint64_t>(meta.rowId);
+    ++m_removed;
+
+    if (meta.flags & kNoVector) {
+        return;
+    }
+    --m_searchable;
+    const auto it = m_searchableByConversation.find(conversationKey(meta.owner, meta.peer));
+    if (it != m_searchableByConversation.end() && --it->second == 0) {
+        m_searchableByConversation.erase(it);
+    }
+}
+
+bool HnswIndex::remove(int64_t rowId)
+{
+    const auto it = m_nodeOf.find(rowId);
+    if (it == m_nodeOf.end()) {
+        return false;
+    }
+    forget(it->second);
+    return true;
+}
+
+std::size_t HnswIndex::removeConversation(const std::string& ownerId, const std::string& peerId)
+{
+    const uint32_t owner = findTag(ownerId);
+    const uint32_t peer = findTag(peerId);
+    if (owner == kNoTag || peer == kNoTag) {
+        return 0;
+    }
+
+    std::size_t removed = 0;
+    for (uint32_t node = 0; node < m_meta.size(); ++node) {
+        const NodeMeta& meta = m_meta[node];
+        if (!(meta.flags & kRemoved) && meta.owner == owner && meta.peer == peer) {
+            forget(node);
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+bool HnswIndex::resolveFilter(const Filter& filter, Query& query) const
+{
+    query.fromMs = filter.fromMs;
+    query.toMs = filter.toMs;
+    if (!filter.ownerId.empty()) {
+        query.anyOwner = false;
+        query.owner = findTag(filter.ownerId);
+    }
+    if (!filter.peerId.empty()) {
+        query.anyPeer = false;
+        query.peer = findTag(filter.peerId);
+    }
+    // An id never added cannot match anything
+    return (query.anyOwner || query.owner != kNoTag) && (query.anyPeer || query.peer != kNoTag) &&
+           filter.fromMs <= filter.toMs;
+}
+
+std::size_t HnswIndex::countMatches(const Query& query) const
+{
+    if (!query.timeLimited()) {
+        if (query.anyOwner && query.anyPeer) {
+            return m_searchable;
+        }
+        std::size_t count = 0;
+        for (const auto& conversation : m_searchableByConversation) {
+            const auto owner = static_cast<uint32_t>(conversation.first >> 32);
+            const auto peer = static_cast<uint32_t>(conversation.first);
+            if ((query.anyOwner || owner == query.owner) && (query.anyPeer || peer == query.peer)) {
+                count += conversation.second;
+            }
+        }
+        return count;
+    }
+
+    std::size_t count = 0;
+    for (const NodeMeta& meta : m_meta) {
+        if (meta.flags == 0 && query.matches(meta)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+std::vector<HnswIndex::Hit> HnswIndex::scan(const std::vector<float>& unitQuery,
+                                            std::size_t k,
+                                            const Query& query) const
+{
+    using Scored = std::pair<float, uint32_t>;
+    std::priority_queue<Scored, std::vector<Scored>, std::greater<Scored>> best;    // worst on top
+
+    for (uint32_t node = 0; node < m_meta.size(); ++node) {
+        const NodeMeta& meta = m_meta[node];
+        if (meta.flags != 0 || !query.matches(meta)) {
+            continue;
+        }
+        const float score = embedding_codec::cosine(unitQuery, vector(node), m_vectorBytes);
+        if (best.size() < k) {
+            best.emplace(score, node);
+        } else if (score > best.top().first) {
+            best.pop();
+            best.emplace(score, node);
+        }
+    }
+
+    std::vector<Hit> hits(best.size());
+    for (auto it = hits.rbegin(); it != hits.rend(); ++it) {
+        *it = Hit{m_meta[best.top().second].rowId, best.top().first};
+        best.pop();
+    }
+    return hits;
+}
+
+std::vector<HnswIndex::Hit> HnswIndex::exactSearch(const std::vector<float>& unitQuery,
+                                                   std::size_t k,
+                                                   const Filter& filter) const
+{
+    Query query;
+    if (k == 0 || unitQuery.size() != m_dimensions || !resolveFilter(filter, query)) {
+        return {};
+    }
+    return scan(unitQuery, k, query);
+}
+
+std::vector<HnswIndex::Hit> HnswIndex::search(const std::vector<float>& unitQuery,
+                                              std::size_t k,
+                                              const Filter& filter) const
+{
+    Query query;
+    if (k == 0 || unitQuery.size() != m_dimensions || m_maxLevel < 0 || !resolveFilter(filter, query)) {
+        return {};
+    }
+
+    const std::size_t matches = countMatches(query);
+    if (matches == 0) {
+        return {};
+    }
+
+    // Rejected entries are walked through but do not fill the beam, so the
+    // graph compares about ef * kComparisonsPerEf * searchable / matches
+    // vectors; scanning the matches is cheaper below that
+    const std::size_t ef = std::max<std::size_t>(m_options.efSearch, k);
+    if (m_options.exactScanLimit > 0 &&
+        (matches <= std::max<std::size_t>(m_options.exactScanLimit, k) ||
+         matches * matches <= ef * kComparisonsPerEf * m_searchable)) {
+        return scan(unitQuery, k, query);
+    }
+
+    const auto similarityTo = [this, &unitQuery](uint32_t node) {
+        return embedding_codec::cosine(unitQuery, vector(node), m_vectorBytes);
+    };
+    const auto accept = [this, &query](uint32_t node) {
+        const NodeMeta& meta = m_meta[node];
+        return meta.flags == 0 && query.matches(meta);
+    };
+
+    const uint32_t entry = greedyDescend(m_entryPoint, m_maxLevel, 0, similarityTo);
+    Visited visited(m_meta.size());
+    const auto found = searchLayer(entry, similarityTo, ef, 0, accept, visited);
+
+    std::vector<Hit> hits;
+    hits.reserve(std::min(k, found.size()));
+    for (std::size_t i = 0; i < found.size() && hits.size() < k; ++i) {
+        hits.push_back(Hit{m_meta[found[i].second].rowId, found[i].first});
+    }
+    return hits;
+}
+
+std::vector<int64_t> HnswIndex::rowIds() const
+{
+    std::vector<int64_t> ids;
+    ids.reserve(m_nodeOf.size());
+    for (const auto& entry : m_nodeOf) {
+        ids.push_back(entry.first);
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+std::unique_ptr<HnswIndex> HnswIndex::compacted() const
+{
+    auto index = std::make_unique<HnswIndex>(m_dimensions, m_options);
+    index->m_label = m_label;
+    for (uint32_t node = 0; node < m_meta.size(); ++node) {
+        const NodeMeta& meta = m_meta[node];
+        if (meta.flags & kRemoved) {
+            continue;
+        }
+        const bool hasVector = !(meta.flags & kNoVector);
+        index->add(meta.rowId, m_tags[meta.owner], m_tags[meta.peer], meta.timestamp,
+                   hasVector ? vector(node) : nullptr, hasVector ? m_vectorBytes : 0);
+    }
+    return index;
+}
+
+bool HnswIndex::save(const Writer& write) const
+{
+    std::string tags;
+    for (const std::string& tag : m_tags) {
+        const auto length = static_cast<uint32_t>(tag.size());
+        tags.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        tags.append(tag);
+    }
+
+    uint64_t upperWords = 0;
+    for (const NodeMeta& meta : m_meta) {
+        upperWords += static_cast<uint64_t>(meta.level) * m_linkWordsUpper;
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kFileVersion;
+    header.byteOrder = kByteOrderMark;
+    header.dimensions = static_cast<uint32_t>(m_dimensions);
+    header.m = m_options.m;
+    header.efConstruction = m_options.efConstruction;
+    header.efSearch = m_options.efSearch;
+    header.exactScanLimit = m_options.exactScanLimit;
+    header.count = static_cast<uint32_t>(m_meta.size());
+    header.entryPoint = m_entryPoint;
+    header.maxLevel = m_maxLevel;
+    header.labelBytes = m_label.size();
+    header.tagBytes = tags.size();
+    header.upperWords = upperWords;
+
+    static const uint8_t zeros[8] = {};
+    const auto pad = [&](std::size_t written) {
+        const std::size_t extra = padded(written) - written;
+        return extra == 0 || write(zeros, extra);
+    };
+
+    const std::size_t count = m_meta.size();
+    if (!write(&header, sizeof(header)) ||
+        !write(m_label.data(), m_label.size()) || !pad(m_label.size()) ||
+        !write(tags.data(), tags.size()) || !pad(tags.size()) ||
+        !write(m_meta.data(), count * sizeof(NodeMeta)) ||
+        !m_links0->write(write) || !pad(count * m_links0->stride) ||
+        !m_vectors->write(write) || !pad(count * m_vectors->stride)) {
+        return false;
+    }
+
+    for (uint32_t node = 0; node < count; ++node) {
+        if (m_meta[node].level == 0) {
+            continue;
+        }
+        const std::vector<uint32_t>& upper = m_upperLinks.at(node);
+        if (!write(upper.data(), upper.size() * sizeof(uint32_t))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::unique_ptr<HnswIndex> HnswIndex::load(uint8_t* data,
+                                           std::size_t size,
+                                           std::shared_ptr<void> storage,
+                                           std::string* error)
+{
+    const auto fail = [error](const char* reason) -> std::unique_ptr<HnswIndex> {
+        if (error) {
+            *error = reason;
+        }
+        return nullptr;
+    };
+
+    FileHeader header{};
+    if (size < sizeof(header)) {
+        return fail("truncated header");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        return fail("not an index file");
+    }
+    if (header.version != kFileVersion || header.byteOrder != kByteOrderMark) {
+        return fail("unsupported version or byte order");
+    }
+    if (header.dimensions == 0 || header.m < 2 || header.labelBytes > size || header.tagBytes > size ||
+        header.upperWords > size) {
+        return fail("bad header");
+    }
+
+    Options options;
+    options.m = header.m;
+    options.efConstruction = header.efConstruction;
+    options.efSearch = header.efSearch;
+    options.exactScanLimit = header.exactScanLimit;
+    auto index = std::make_unique<HnswIndex>(header.dimensions, options);
+    const std::size_t count = header.count;
+
+    std::size_t offset = sizeof(header);
+    const std::size_t labelOffset = offset;
+    offset += padded(header.labelBytes);
+    const std::size_t tagOffset = offset;
+    offset += padded(header.tagBytes);
+    const std::size_t metaOffset = offset;
+    offset += count * sizeof(NodeMeta);
+    const std::size_t links0Offset = offset;
+    offset += padded(count * index->m_links0->stride);
+    const std::size_t vectorOffset = offset;
+    offset += padded(count * index->m_vectors->stride);
+    const std::size_t upperOffset = offset;
+    offset += header.upperWords * sizeof(uint32_t);
+    if (offset > size) {
+        return fail("truncated");
+    }
+
+    index->m_label.assign(reinterpret_cast<const char*>(data + labelOffset), header.labelBytes);
+
+    const uint8_t* tag = data + tagOffset;
+    const uint8_t* tagEnd = tag + header.tagBytes;
+    while (tag < tagEnd) {
+        uint32_t length = 0;
+        if (tagEnd - tag < static_cast<std::ptrdiff_t>(sizeof(length))) {
+            return fail("bad tag table");
+        }
+        std::memcpy(&length, tag, sizeof(length));
+        tag += sizeof(length);
+        if (static_cast<std::size_t>(tagEnd - tag) < length) {
+            return fail("bad tag table");
+        }
+        index->tagId(std::string(reinterpret_cast<const char*>(tag), length));
+        tag += length;
+    }
+
+    index->m_meta.resize(count);
+    std::memcpy(index->m_meta.data(), data + metaOffset, count * sizeof(NodeMeta));
+
+    index->m_links0->base = data + links0Offset;
+    index->m_links0->baseCount = count;
+    index->m_vectors->base = data + vectorOffset;
+    index->m_vectors->baseCount = count;
+
+    const auto* upper = reinterpret_cast<const uint32_t*>(data + upperOffset);
+    uint64_t upperWords = 0;
+    index->m_nodeOf.reserve(count);
+    for (uint32_t node = 0; node < count; ++node) {
+        const NodeMeta& meta = index->m_meta[node];
+        if (meta.owner >= index->m_tags.size() || meta.peer >= index->m_tags.size() || meta.level > kMaxLevel) {
+            return fail("bad entry");
+        }
+        if (meta.level > 0) {
+            const std::size_t words = meta.level * index->m_linkWordsUpper;
+            if (upperWords + words > header.upperWords) {
+                return fail("bad upper layers");
+            }
+            index->m_upperLinks[node].assign(upper + upperWords, upper + upperWords + words);
+            upperWords += words;
+        }
+        // Searches follow links without bounds checks, also through removed entries
+        for (int layer = 0; layer <= meta.level; ++layer) {
+            const std::size_t capacity = (layer == 0 ? index->m_linkWords0 : index->m_linkWordsUpper) - 1;
+            if (!validLinks(index->links(node, layer), capacity, count)) {
+                return fail("bad links");
+            }
+        }
+
+        if (meta.flags & kRemoved) {
+            ++index->m_removed;
+            continue;
+        }
+        if (!index->m_nodeOf.emplace(meta.rowId, node).second) {
+            return fail("duplicate rowid");
+        }
+        index->m_rowIdSum += static_cast<uint64_t>(meta.rowId);
+        if (!(meta.flags & kNoVector)) {
+            ++index->m_searchable;
+            ++index->m_searchableByConversation[conversationKey(meta.owner, meta.peer)];
+        }
+    }
+
+    if (upperWords != header.upperWords || header.maxLevel > kMaxLevel ||
+        (header.maxLevel >= 0 && (header.entryPoint >= count ||
+                                  index->m_meta[header.entryPoint].level != header.maxLevel))) {
+        return fail("bad graph");
+    }
+    index->m_entryPoint = header.entryPoint;
+    index->m_maxLevel = header.maxLevel;
+    index->m_storage = std::move(storage);
+    return index;
+}
+
+} // namespace ai
+} // namespace flykylin
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace flykylin {
+namespace ai {
+
+/**
+ * @brief Approximate nearest-neighbour index (HNSW) over encoded embeddings
+ *
+ * Entries are vectors in the EmbeddingCodec form plus the message rowid,
+ * owner and peer ids and a timestamp, so a search can be limited to one
+ * conversation or a time range. When a filter leaves few entries, those are
+ * scanned exactly instead of walking the graph, which would visit mostly
+ * entries the filter rejects.
+ *
+ * remove() only marks an entry; it keeps routing searches but is never
+ * returned again. compacted() rebuilds the graph without removed entries.
+ * An entry added with an empty vector is counted (see rowIds()) but never
+ * searched, so callers can mirror a store that records failed embeddings.
+ *
+ * save() writes a flat, host-endian file whose links and vectors load() uses
+ * in place: a memory-mapped file is searchable without reading it first.
+ * Not thread-safe; callers serialize writers against readers.
+ */
+class HnswIndex {
+public:
+    struct Options {
+        uint32_t m = 16;                    ///< Links per node on upper layers, 2 * m on layer 0
+        uint32_t efConstruction = 100;
+        uint32_t efSearch = 64;
+        uint32_t exactScanLimit = 8192;     ///< Filters matching at most this many entries skip the graph; 0 never skips it
+    };
+
+    struct Filter {
+        std::string ownerId;                ///< Empty matches every owner
+        std::string peerId;                 ///< Empty matches every peer
+        int64_t fromMs = std::numeric_limits<int64_t>::min();
+        int64_t toMs = std::numeric_limits<int64_t>::max();
+    };
+
+    struct Hit {
+        int64_t rowId;
+        float score;                        ///< Cosine similarity
+    };
+
+    using Writer = std::function<bool(const void* data, std::size_t size)>;
+
+    explicit HnswIndex(std::size_t dimensions);
+    HnswIndex(std::size_t dimensions, const Options& options);
+    ~HnswIndex();
+
+    HnswIndex(const HnswIndex&) = delete;
+    HnswIndex& operator=(const HnswIndex&) = delete;
+
+    /**
+     * @brief Use a file written by save() in place
+     *
+     * Link lists of loaded entries are updated in place when entries are
+     * added, so data must be writable (a private, copy-on-write mapping
+     * is enough) and stay valid while storage is held.
+     * @return nullptr if the data is not a valid index; error says why
+     */
+    static std::unique_ptr<HnswIndex> load(uint8_t* data,
+                                           std::size_t size,
+                                           std::shared_ptr<void> storage,
+                                           std::string* error = nullptr);
+
+    bool save(const Writer& write) const;
+
+    /**
+     * @brief Index built again from the entries that were not removed
+     */
+    std::unique_ptr<HnswIndex> compacted() const;
+
+    /**
+     * @param vector EmbeddingCodec bytes of this index's dimensions, or empty
+     * @return false if rowId is already present or the vector has other dimensions
+     */
+    bool add(int64_t rowId,
+             const std::string& ownerId,
+             const std::string& peerId,
+             int64_t timestampMs,
+             const uint8_t* vector,
+             std::size_t size);
+
+    bool remove(int64_t rowId);
+
+    /**
+     * @return Number of entries removed
+     */
+    std::size_t removeConversation(const std::string& ownerId, const std::string& peerId);
+
+    /**
+     * @param unitQuery Unit-length query of this index's dimensions
+     * @return Up to k entries passing the filter, best first
+     */
+    std::vector<Hit> search(const std::vector<float>& unitQuery, std::size_t k, const Filter& filter) const;
+
+    /**
+     * @brief Exact top k by scanning every entry, for comparison with search()
+     */
+    std::vector<Hit> exactSearch(const std::vector<float>& unitQuery, std::size_t k, const Filter& filter) const;
+
+    std::size_t dimensions() const { return m_dimensions; }
+    const Options& options() const { return m_options; }
+
+    /**
+     * @brief Beam width of later searches: higher finds more true neighbours, slower
+     */
+    void setEfSearch(uint32_t ef) { m_options.efSearch = ef; }
+
+    std::size_t size() const { return m_nodeOf.size(); }         ///< Entries not removed
+    std::size_t removedCount() const { return m_removed; }
+    int64_t rowIdSum() const { return static_cast<int64_t>(m_rowIdSum); }
+
+    /**
+     * @brief Rowids of all entries not removed, ascending
+     */
+    std::vector<int64_t> rowIds() const;
+
+    /**
+     * @brief Caller-defined label saved with the index, e.g. the embedding model version
+     */
+    const std::string& label() const { return m_label; }
+    void setLabel(std::string label) { m_label = std::move(label); }
+
+private:
+    struct NodeMeta;
+    struct Block;
+    struct Query;
+    class Visited;
+
+    uint32_t* links(uint32_t node, int layer);             ///< Count, then that many node ids
+    const uint32_t* links(uint32_t node, int layer) const;
+    const uint8_t* vector(uint32_t node) const;
+
+    uint32_t tagId(const std::string& tag);
+    uint32_t findTag(const std::string& tag) const;
+    int randomLevel();
+
+    float similarity(uint32_t a, uint32_t b) const;
+
+    template <typename Similarity, typename Accept>
+    std::vector<std::pair<float, uint32_t>> searchLayer(uint32_t entry,
+                                                        const Similarity& similarityTo,
+                                                        std::size_t ef,
+                                                        int layer,
+                                                        const Accept& accept,
+                                                        Visited& visited) const;
+
+    template <typename Similarity>
+    uint32_t greedyDescend(uint32_t entry, int fromLayer, int toLayer, const Similarity& similarityTo) const;
+
+    std::vector<uint32_t> selectNeighbors(std::vector<std::pair<float, uint32_t>> candidates,
+                                          std::size_t maxCount) const;
+    void connect(uint32_t node, int layer, const std::vector<uint32_t>& neighbors);
+    void link(uint32_t from, uint32_t to, int layer);
+
+    bool resolveFilter(const Filter& filter, Query& query) const;
+    std::size_t countMatches(const Query& query) const;
+    std::vector<Hit> scan(const std::vector<float>& unitQuery, std::size_t k, const Query& query) const;
+    void forget(uint32_t node);
+
+    std::size_t m_dimensions;
+    Options m_options;
+    std::size_t m_vectorBytes;
+    std::size_t m_linkWords0;       ///< Count plus 2 * m ids
+    std::size_t m_linkWordsUpper;   ///< Count plus m ids
+
+    std::vector<NodeMeta> m_meta;
+    std::unique_ptr<Block> m_links0;
+    std::unique_ptr<Block> m_vectors;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_upperLinks;  ///< Layers 1.. of the few nodes that have them
+
+    std::vector<std::string> m_tags;
+    std::unordered_map<std::string, uint32_t> m_tagIds;
+
+    std::unordered_map<int64_t, uint32_t> m_nodeOf;     ///< Entries not removed
+    std::unordered_map<uint64_t, std::size_t> m_searchableByConversation;
+    std::size_t m_searchable{0};
+    std::size_t m_removed{0};
+    uint64_t m_rowIdSum{0};
+
+    uint32_t m_entryPoint{0};
+    int m_maxLevel{-1};
+    std::mt19937 m_rng{0x464b};
+    std::string m_label;
+    std::shared_ptr<void> m_storage;
+};
+
+} // namespace ai
+} // namespace flykylin
@@ -0,0 +1,46 @@
+#include "InferenceBackend.h"
+
+#include "ModelResidency.h"
+
+#include <QDebug>
+#include <QSettings>
+#include <QString>
+
+#include <mutex>
+
+namespace flykylin {
+namespace ai {
+
+BackendChoiceStore settingsChoiceStore()
+{
+    BackendChoiceStore store;
+    store.load = [](const std::string& key) {
+        QSettings settings("FlyKylin", "FlyKylin");
+        return settings.value(QStringLiteral("ai/backend/") + QString::fromStdString(key)).toString().toStdString();
+    };
+    store.save = [](const std::string& key, const std::string& value) {
+        QSettings settings("FlyKylin", "FlyKylin");
+        settings.setValue(QStringLiteral("ai/backend/") + QString::fromStdString(key), QString::fromStdString(value));
+    };
+    return store;
+}
+
+void applyResidencySettings()
+{
+    static std::once_flag applied;
+    std::call_once(applied, []() {
+        QSettings settings("FlyKylin", "FlyKylin");
+        ModelResidency::Options options;
+        options.idleUnload = std::chrono::seconds(settings.value("ai/residency/idleUnloadSeconds", 300).toInt());
+        options.minAvailableBytes =
+            static_cast<uint64_t>(settings.value("ai/residency/minAvailableMB", 150).toULongLong()) * 1024 * 1024;
+        options.psiSomeAvg10 = settings.value("ai/residency/psiSomeAvg10", 10.0).toDouble();
+        options.log = [](const std::string& message) {
+            qInfo().noquote() << "[ModelResidency]" << QString::fromStdString(message);
+        };
+        ModelResidency::instance().setOptions(options);
+    });
+}
+
+} // namespace ai
+} // namespace flykylin
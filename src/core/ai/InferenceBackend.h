@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace flykylin {
+namespace ai {
+
+/**
+ * @brief Ways a model can be run; which ones exist depends on the build
+ */
+enum class BackendKind {
+    Null,       ///< Nothing runs; the feature reports itself unavailable
+    OnnxCpu,
+    OnnxInt8,   ///< ONNX Runtime on an int8-quantized copy of the model
+    Rknn
+};
+
+/**
+ * @brief Whether a feature has a backend, as far as is known without waiting
+ *
+ * Picking the backend may load and benchmark every model, so engines do it
+ * on the residency thread and report Pending until it has finished.
+ */
+enum class BackendAvailability {
+    Pending,
+    Available,
+    Unavailable
+};
+
+inline const char* backendKindName(BackendKind kind)
+{
+    switch (kind) {
+    case BackendKind::OnnxCpu:
+        return "onnx-cpu";
+    case BackendKind::OnnxInt8:
+        return "onnx-int8";
+    case BackendKind::Rknn:
+        return "rknn";
+    case BackendKind::Null:
+        break;
+    }
+    return "null";
+}
+
+inline std::optional<BackendKind> backendKindFromName(const std::string& name)
+{
+    for (BackendKind kind : {BackendKind::Null, BackendKind::OnnxCpu, BackendKind::OnnxInt8, BackendKind::Rknn}) {
+        if (name == backendKindName(kind)) {
+            return kind;
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief Remembers each model's backend choice between launches
+ *
+ * Keys are "<model>/choice" and "<model>/candidates". An empty string from
+ * load means nothing stored.
+ */
+struct BackendChoiceStore {
+    std::function<std::string(const std::string& key)> load;
+    std::function<void(const std::string& key, const std::string& value)> save;
+};
+
+/**
+ * @brief Store in the application settings under ai/backend/
+ */
+BackendChoiceStore settingsChoiceStore();
+
+/**
+ * @brief Configure ModelResidency from the settings under ai/residency/ (once)
+ */
+void applyResidencySettings();
+
+/**
+ * @brief Backends one model supports, and the pick among them
+ *
+ * A model declares each backend it can run on with a factory that returns
+ * nullptr when the backend is unusable here (model file missing, runtime
+ * init failed). select() reuses the choice stored for the same candidate
+ * list; otherwise it warms every usable backend up, times a few runs and
+ * keeps the fastest. A "null" choice written into the store disables the
+ * model. Without any usable backend the result is Null.
+ */
+template <typename Backend>
+class BackendRegistry {
+public:
+    using Factory = std::function<std::unique_ptr<Backend>()>;
+    using Benchmark = std::function<bool(Backend& backend)>;   ///< One inference; false = failed
+
+    struct Timing {
+        BackendKind kind{BackendKind::Null};
+        double medianMs{0.0};
+    };
+
+    struct Selection {
+        BackendKind kind{BackendKind::Null};
+        std::unique_ptr<Backend> backend;   ///< nullptr for Null
+        bool fromStore{false};
+        std::vector<Timing> timings;        ///< Every backend that passed the warm-up
+    };
+
+    explicit BackendRegistry(std::string model)
+        : m_model(std::move(model))
+    {
+    }
+
+    /**
+     * @brief Declare a supported backend; earlier ones win ties
+     */
+    void add(BackendKind kind, Factory create)
+    {
+        m_candidates.push_back({kind, std::move(create)});
+    }
+
+    const std::string& model() const { return m_model; }
+
+    /**
+     * @brief A fresh instance of one declared backend, nullptr if unusable or undeclared
+     */
+    std::unique_ptr<Backend> create(BackendKind kind) const
+    {
+        for (const Candidate& candidate : m_candidates) {
+            if (candidate.kind == kind) {
+                return candidate.create();
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Declared backends as stored, e.g. "rknn,onnx-cpu"
+     */
+    std::string candidateList() const
+    {
+        std::string list;
+        for (const Candidate& candidate : m_candidates) {
+            if (!list.empty()) {
+                list += ',';
+            }
+            list += backendKindName(candidate.kind);
+        }
+        return list;
+    }
+
+    Selection select(const Benchmark& benchmark, const BackendChoiceStore& store) const
+    {
+        const std::string choiceKey = m_model + "/choice";
+        const std::string candidatesKey = m_model + "/candidates";
+
+        Selection selection;
+        if (store.load && store.load(candidatesKey) == candidateList()) {
+            const std::optional<BackendKind> stored = backendKindFromName(store.load(choiceKey));
+            if (stored == BackendKind::Null) {
+                selection.fromStore = true;
+                return selection;
+            }
+            for (const Candidate& candidate : m_candidates) {
+                if (stored == candidate.kind) {
+                    if (auto backend = candidate.create()) {
+                        selection.kind = candidate.kind;
+                        selection.backend = std::move(backend);
+                        selection.fromStore = true;
+                        return selection;
+                    }
+                    break;  // Gone since it was picked: measure again
+                }
+            }
+        }
+
+        double bestMs = 0.0;
+        for (const Candidate& candidate : m_candidates) {
+            std::unique_ptr<Backend> backend = candidate.create();
+            // The first run pays for lazy allocations and kernel selection
+            if (!backend || !benchmark(*backend)) {
+                continue;
+            }
+            const std::optional<double> ms = medianRunMs(*backend, benchmark);
+            if (!ms) {
+                continue;
+            }
+            selection.timings.push_back({candidate.kind, *ms});
+            if (!selection.backend || *ms < bestMs) {
+                bestMs = *ms;
+                selection.kind = candidate.kind;
+                selection.backend = std::move(backend);
+            }
+        }
+
+        // Nothing usable is not remembered: a model file added later gets used
+        if (store.save && selection.backend) {
+            store.save(choiceKey, backendKindName(selection.kind));
+            store.save(candidatesKey, candidateList());
+        }
+        return selection;
+    }
+
+    static constexpr int kTimedRuns = 3;
+
+private:
+    struct Candidate {
+        BackendKind kind;
+        Factory create;
+    };
+
+    static std::optional<double> medianRunMs(Backend& backend, const Benchmark& benchmark)
+    {
+        std::vector<double> runs;
+        for (int i = 0; i < kTimedRuns; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            if (!benchmark(backend)) {
+                return std::nullopt;
+            }
+            runs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(runs.begin(), runs.end());
+        return runs[runs.size() / 2];
+    }
+
+    std::string m_model;
+    std::vector<Candidate> m_candidates;
+};
+
+} // namespace ai
+} // namespace flykylin
@@ -0,0 +1,302 @@
+#include "InferenceQueue.h"
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+namespace flykylin {
+namespace ai {
+
+InferenceQueue::InferenceQueue(std::size_t capacity)
+    : m_capacity(std::max<std::size_t>(capacity, 1))
+{
+}
+
+InferenceQueue::~InferenceQueue()
+{
+    stop();
+}
+
+InferenceQueue::Ticket InferenceQueue::submit(const std::string& key, Work work, Callback callback)
+{
+    auto job = std::make_shared<Job>();
+    job->work = std::move(work);
+    return enqueue(key, std::move(job), std::move(callback));
+}
+
+InferenceQueue::Ticket InferenceQueue::submit(const std::string& key,
+                                              std::shared_ptr<BatchItem> item,
+                                              Callback callback)
+{
+    auto job = std::make_shared<Job>();
+    job->item = std::move(item);
+    return enqueue(key, std::move(job), std::move(callback));
+}
+
+void InferenceQueue::setBatchRunner(BatchRunner runner, std::size_t maxBatch,
+                                    std::chrono::milliseconds window)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_batchRunner = std::move(runner);
+    m_maxBatch = std::max<std::size_t>(maxBatch, 1);
+    m_batchWindow = window;
+}
+
+InferenceQueue::Ticket InferenceQueue::enqueue(const std::string& key, std::shared_ptr<Job> newJob,
+                                               Callback callback)
+{
+    Ticket ticket;
+    Waiter waiter;
+    waiter.callback = std::move(callback);
+    ticket.future = waiter.promise.get_future().share();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::shared_ptr<Job> job = key.empty() ? nullptr : findJob(key);
+    if (!job && (m_stopping || m_queue.size() >= m_capacity)) {
+        ++m_stats.rejected;
+        lock.unlock();
+        waiter.promise.set_value(std::nullopt);
+        return ticket;
+    }
+
+    waiter.id = m_nextId++;
+    ticket.id = waiter.id;
+    ++m_stats.submitted;
+    if (job) {
+        ++m_stats.coalesced;
+        job->waiters.push_back(std::move(waiter));
+        return ticket;
+    }
+
+    newJob->key = key;
+    newJob->waiters.push_back(std::move(waiter));
+    m_queue.push_back(std::move(newJob));
+    if (!m_thread.joinable()) {
+        m_thread = std::thread([this]() { run(); });
+    }
+    lock.unlock();
+    m_wake.notify_one();
+    return ticket;
+}
+
+bool InferenceQueue::cancel(uint64_t requestId)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    auto takeWaiter = [requestId](Job& job, Waiter* out) {
+        auto it = std::find_if(job.waiters.begin(), job.waiters.end(),
+                               [requestId](const Waiter& w) { return w.id == requestId; });
+        if (it == job.waiters.end()) {
+            return false;
+        }
+        *out = std::move(*it);
+        job.waiters.erase(it);
+        return true;
+    };
+
+    Waiter waiter;
+    bool found = false;
+    for (const auto& job : m_running) {
+        if (takeWaiter(*job, &waiter)) {
+            found = true;
+            break;
+        }
+    }
+    for (auto it = m_queue.begin(); !found && it != m_queue.end(); ++it) {
+        if (takeWaiter(**it, &waiter)) {
+            found = true;
+            if ((*it)->waiters.empty()) {
+                m_queue.erase(it);
+            }
+            break;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+    ++m_stats.cancelled;
+    lock.unlock();
+    waiter.promise.set_value(std::nullopt);
+    return true;
+}
+
+void InferenceQueue::stop()
+{
+    std::deque<std::shared_ptr<Job>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        dropped.swap(m_queue);
+        for (const auto& job : dropped) {
+            m_stats.cancelled += job->waiters.size();
+        }
+    }
+    m_wake.notify_all();
+
+    for (const auto& job : dropped) {
+        for (Waiter& waiter : job->waiters) {
+            waiter.promise.set_value(std::nullopt);
+        }
+    }
+    if (m_thread.joinable() && m_thread.get_id() != std::this_thread::get_id()) {
+        m_thread.join();
+    }
+}
+
+std::size_t InferenceQueue::queuedJobs() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size();
+}
+
+InferenceQueue::Stats InferenceQueue::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void InferenceQueue::run()
+{
+    for (;;) {
+        std::vector<std::shared_ptr<Job>> batch;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                return;
+            }
+            batch.push_back(m_queue.front());
+            m_queue.pop_front();
+            m_running = batch;
+
+            if (batch.front()->item && m_maxBatch > 1) {
+                collectBatch(batch);
+                // Only a burst already under way waits for stragglers
+                const auto deadline = std::chrono::steady_clock::now() + m_batchWindow;
+                while (batch.size() > 1 && batch.size() < m_maxBatch && !m_stopping) {
+                    const bool timedOut = m_wake.wait_until(lock, deadline) == std::cv_status::timeout;
+                    collectBatch(batch);
+                    if (timedOut) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (batch.front()->item) {
+            runBatch(batch);
+            continue;
+        }
+
+        Result result;
+        try {
+            result = batch.front()->work ? batch.front()->work() : std::nullopt;
+        } catch (const std::exception&) {
+            result = std::nullopt;
+        }
+        finish(batch.front(), result);
+    }
+}
+
+void InferenceQueue::collectBatch(std::vector<std::shared_ptr<Job>>& batch)
+{
+    for (auto it = m_queue.begin(); it != m_queue.end() && batch.size() < m_maxBatch;) {
+        if ((*it)->item) {
+            batch.push_back(*it);
+            m_running.push_back(*it);
+            it = m_queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void InferenceQueue::runBatch(const std::vector<std::shared_ptr<Job>>& batch)
+{
+    std::vector<std::shared_ptr<Job>> pending;
+    std::vector<BatchItem*> items;
+    for (const auto& job : batch) {
+        {
+            // Everyone cancelled while the batch was collected
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (job->waiters.empty()) {
+                m_running.erase(std::find(m_running.begin(), m_running.end(), job));
+                continue;
+            }
+        }
+
+        std::optional<Result> early;
+        try {
+            early = job->item->prepare();
+        } catch (const std::exception&) {
+            early = Result();
+        }
+        if (early) {
+            finish(job, *early);
+        } else {
+            pending.push_back(job);
+            items.push_back(job->item.get());
+        }
+    }
+    if (pending.empty()) {
+        return;
+    }
+
+    std::vector<Result> results;
+    try {
+        if (m_batchRunner) {
+            results = m_batchRunner(items);
+        }
+    } catch (const std::exception&) {
+        results.clear();
+    }
+    if (results.size() != pending.size()) {
+        results.assign(pending.size(), std::nullopt);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.batches;
+        m_stats.batchedJobs += pending.size();
+    }
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        finish(pending[i], results[i]);
+    }
+}
+
+void InferenceQueue::finish(const std::shared_ptr<Job>& job, const Result& result)
+{
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running.erase(std::find(m_running.begin(), m_running.end(), job));
+        waiters.swap(job->waiters);
+        ++m_stats.completed;
+    }
+    // Callback first: a ready future means the callback has run
+    for (Waiter& waiter : waiters) {
+        if (waiter.callback) {
+            waiter.callback(waiter.id, result);
+        }
+        waiter.promise.set_value(result);
+    }
+}
+
+std::shared_ptr<InferenceQueue::Job> InferenceQueue::findJob(const std::string& key) const
+{
+    for (const auto& job : m_running) {
+        if (job->key == key) {
+            return job;
+        }
+    }
+    for (const auto& job : m_queue) {
+        if (job->key == key) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace ai
+} // namespace flykylin
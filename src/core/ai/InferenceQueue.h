@@ -0,0 +1,158 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace flykylin {
+namespace ai {
+
+/**
+ * @brief One inference thread fed by a bounded job queue
+ *
+ * Backends are not re-entrant (an RKNN context runs one job at a time), so
+ * every inference goes through this thread, in submission order. Requests
+ * with the same non-empty key while a job for it is queued or running
+ * share that job's result instead of running the model again.
+ *
+ * At most capacity jobs wait; further submissions are rejected at once
+ * rather than letting latency grow without bound. A request can be
+ * cancelled until its job finishes: its future then holds std::nullopt
+ * and its callback is not called. A queued job nobody waits for any more
+ * is dropped.
+ *
+ * Jobs submitted as BatchItems can share one model run: when the thread
+ * takes one while others are already queued, it keeps collecting for up
+ * to the batch window (or until maxBatch) and hands all of them to the
+ * batch runner at once. A lone request runs without waiting.
+ *
+ * The thread starts on the first submission.
+ */
+class InferenceQueue {
+public:
+    using Result = std::optional<float>;
+    using Work = std::function<Result()>;
+    using Callback = std::function<void(uint64_t requestId, Result result)>;
+
+    /**
+     * @brief Input of one batchable job
+     */
+    class BatchItem {
+    public:
+        virtual ~BatchItem() = default;
+
+        /**
+         * @brief Runs per job on the inference thread before the batch run
+         * @return A value if the job is already answered (cache hit, unreadable
+         *         input); it then stays out of the batch
+         */
+        virtual std::optional<Result> prepare() = 0;
+    };
+
+    /**
+     * @brief Runs the model once for all prepared items, one result each
+     */
+    using BatchRunner = std::function<std::vector<Result>(const std::vector<BatchItem*>& items)>;
+
+    struct Ticket {
+        uint64_t id{0};     ///< 0 = rejected; the future already holds std::nullopt
+        std::shared_future<Result> future;
+    };
+
+    struct Stats {
+        uint64_t submitted{0};
+        uint64_t coalesced{0};  ///< Joined a queued or running job
+        uint64_t rejected{0};
+        uint64_t cancelled{0};
+        uint64_t completed{0};  ///< Jobs run
+        uint64_t batches{0};    ///< Batch runner calls
+        uint64_t batchedJobs{0};    ///< Jobs those calls covered
+    };
+
+    explicit InferenceQueue(std::size_t capacity = kDefaultCapacity);
+    ~InferenceQueue();
+
+    InferenceQueue(const InferenceQueue&) = delete;
+    InferenceQueue& operator=(const InferenceQueue&) = delete;
+
+    /**
+     * @param key Coalescing key (e.g. the image path), empty = never shared
+     * @param callback Called on the inference thread with the result, before the
+     *        future becomes ready; not called for cancelled requests
+     */
+    Ticket submit(const std::string& key, Work work, Callback callback = Callback());
+
+    /**
+     * @brief Same, for a job the batch runner can combine with others
+     */
+    Ticket submit(const std::string& key, std::shared_ptr<BatchItem> item, Callback callback = Callback());
+
+    /**
+     * @brief Set before the first submission
+     * @param maxBatch Most items per runner call (1 = no batching)
+     * @param window How long a burst may wait for more items
+     */
+    void setBatchRunner(BatchRunner runner, std::size_t maxBatch, std::chrono::milliseconds window);
+
+    /**
+     * @return false if the request already finished (or is unknown)
+     */
+    bool cancel(uint64_t requestId);
+
+    /**
+     * @brief Cancel everything queued and wait for the running ones
+     */
+    void stop();
+
+    std::size_t queuedJobs() const;
+    Stats stats() const;
+
+    static constexpr std::size_t kDefaultCapacity = 64;
+
+private:
+    struct Waiter {
+        uint64_t id{0};
+        std::promise<Result> promise;
+        Callback callback;
+    };
+
+    struct Job {
+        std::string key;
+        Work work;
+        std::shared_ptr<BatchItem> item;
+        std::vector<Waiter> waiters;
+    };
+
+    Ticket enqueue(const std::string& key, std::shared_ptr<Job> job, Callback callback);
+    void run();
+    void collectBatch(std::vector<std::shared_ptr<Job>>& batch);
+    void runBatch(const std::vector<std::shared_ptr<Job>>& batch);
+    void finish(const std::shared_ptr<Job>& job, const Result& result);
+    std::shared_ptr<Job> findJob(const std::string& key) const;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::shared_ptr<Job>> m_queue;
+    std::vector<std::shared_ptr<Job>> m_running;   ///< Taken by the thread, not finished yet
+    BatchRunner m_batchRunner;
+    std::size_t m_maxBatch{1};
+    std::chrono::milliseconds m_batchWindow{0};
+    std::thread m_thread;
+    bool m_stopping{false};
+    uint64_t m_nextId{1};
+    std::size_t m_capacity;
+    Stats m_stats;
+};
+
+} // namespace ai
+} // namespace flykylin
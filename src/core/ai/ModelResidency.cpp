@@ -0,0 +1,340 @@
+#include "ModelResidency.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace flykylin {
+namespace ai {
+
+namespace {
+
+std::string readFile(const char* path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        return std::string();
+    }
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// "Name:    1234567 kB" lines of /proc/meminfo and /proc/self/status
+std::optional<uint64_t> parseKbField(const std::string& text, const std::string& field)
+{
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.rfind(field, 0) != 0) {
+            continue;
+        }
+        std::istringstream fields(line.substr(field.size()));
+        uint64_t kb = 0;
+        if (fields >> kb) {
+            return kb * 1024;
+        }
+        return std::nullopt;
+    }
+    return std::nullopt;
+}
+
+std::string megabytes(uint64_t bytes)
+{
+    return std::to_string(bytes / (1024 * 1024)) + " MB";
+}
+
+} // namespace
+
+std::optional<uint64_t> parseMemAvailable(const std::string& meminfo)
+{
+    return parseKbField(meminfo, "MemAvailable:");
+}
+
+std::optional<uint64_t> parseVmHwm(const std::string& status)
+{
+    return parseKbField(status, "VmHWM:");
+}
+
+std::optional<double> parsePsiSomeAvg10(const std::string& pressure)
+{
+    // "some avg10=0.00 avg60=0.00 avg300=0.00 total=0"
+    std::istringstream in(pressure);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.rfind("some ", 0) != 0) {
+            continue;
+        }
+        const std::size_t pos = line.find("avg10=");
+        if (pos == std::string::npos) {
+            return std::nullopt;
+        }
+        const char* begin = line.c_str() + pos + 6;
+        char* end = nullptr;
+        const double value = std::strtod(begin, &end);
+        if (end == begin) {
+            return std::nullopt;
+        }
+        return value;
+    }
+    return std::nullopt;
+}
+
+MemoryStatus MemoryStatus::read()
+{
+    MemoryStatus status;
+    status.availableBytes = parseMemAvailable(readFile("/proc/meminfo"));
+    // Needs CONFIG_PSI; older Kylin kernels only have meminfo
+    status.psiSomeAvg10 = parsePsiSomeAvg10(readFile("/proc/pressure/memory"));
+    return status;
+}
+
+uint64_t currentRssBytes()
+{
+#if defined(__linux__)
+    // "size resident shared ..." in pages
+    std::istringstream in(readFile("/proc/self/statm"));
+    uint64_t size = 0;
+    uint64_t resident = 0;
+    if (in >> size >> resident) {
+        return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+#endif
+    return 0;
+}
+
+uint64_t peakRssBytes()
+{
+    return parseVmHwm(readFile("/proc/self/status")).value_or(0);
+}
+
+ResidentModelBase::ResidentModelBase(std::string name)
+    : m_name(std::move(name))
+{
+    ModelResidency::instance().add(this);
+}
+
+ResidentModelBase::~ResidentModelBase()
+{
+    detach();
+}
+
+void ResidentModelBase::detach()
+{
+    ModelResidency::instance().remove(this);
+}
+
+ResidentModelBase::Report ResidentModelBase::report(Clock::time_point now) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Report report;
+    report.name = m_name;
+    report.loaded = isLoaded();
+    report.inUse = isInUse();
+    report.residentBytes = report.loaded ? m_residentBytes : 0;
+    report.peakBytes = m_peakBytes;
+    report.idle = now - m_lastUsed;
+    return report;
+}
+
+bool ResidentModelBase::unloadIfUnused()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!isLoaded() || isInUse()) {
+        return false;
+    }
+    release();
+    return true;
+}
+
+ModelResidency& ModelResidency::instance()
+{
+    static ModelResidency residency;
+    return residency;
+}
+
+ModelResidency::~ModelResidency()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void ModelResidency::setOptions(Options options)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_options = std::move(options);
+    }
+    m_wake.notify_all();
+}
+
+bool ModelResidency::underPressure(const MemoryStatus& status) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (status.availableBytes && *status.availableBytes < m_options.minAvailableBytes) {
+        return true;
+    }
+    return status.psiSomeAvg10 && m_options.psiSomeAvg10 > 0.0 && *status.psiSomeAvg10 >= m_options.psiSomeAvg10;
+}
+
+std::vector<std::string> ModelResidency::sweep(ResidentModelBase::Clock::time_point now, const MemoryStatus& status)
+{
+    const bool pressure = underPressure(status);
+    std::chrono::seconds idleUnload;
+    std::chrono::seconds pressureGrace;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        idleUnload = m_options.idleUnload;
+        pressureGrace = m_options.pressureGrace;
+    }
+
+    std::vector<std::string> unloaded;
+    std::vector<ResidentModelBase::Report> freed;
+    for (ResidentModelBase* model : beginVisit()) {
+        const ResidentModelBase::Report report = model->report(now);
+        if (!report.loaded || report.inUse) {
+            continue;
+        }
+        const bool idle = idleUnload.count() > 0 && report.idle >= idleUnload;
+        const bool evict = pressure && report.idle >= pressureGrace;
+        if ((idle || evict) && model->unloadIfUnused()) {
+            unloaded.push_back(report.name);
+            freed.push_back(report);
+        }
+    }
+    endVisit();
+
+    for (const ResidentModelBase::Report& report : freed) {
+        const auto idleSeconds = std::chrono::duration_cast<std::chrono::seconds>(report.idle).count();
+        std::string message = "Unloaded " + report.name + " after " + std::to_string(idleSeconds) + " s idle, ~"
+                              + megabytes(report.residentBytes) + " freed";
+        if (pressure) {
+            message += " (memory pressure";
+            if (status.availableBytes) {
+                message += ", " + megabytes(*status.availableBytes) + " available";
+            }
+            if (status.psiSomeAvg10) {
+                message += ", psi some avg10 " + std::to_string(*status.psiSomeAvg10);
+            }
+            message += ")";
+        }
+        log(message);
+    }
+    return unloaded;
+}
+
+std::vector<ResidentModelBase::Report> ModelResidency::report() const
+{
+    const auto now = ResidentModelBase::Clock::now();
+    std::vector<ResidentModelBase::Report> reports;
+    for (const ResidentModelBase* model : beginVisit()) {
+        reports.push_back(model->report(now));
+    }
+    endVisit();
+    return reports;
+}
+
+void ModelResidency::prefetch(ResidentModelBase* model)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping || std::find(m_prefetch.begin(), m_prefetch.end(), model) != m_prefetch.end()) {
+            return;
+        }
+        m_prefetch.push_back(model);
+        startLocked();
+    }
+    m_wake.notify_all();
+}
+
+void ModelResidency::log(const std::string& message) const
+{
+    std::function<void(const std::string&)> sink;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sink = m_options.log;
+    }
+    if (sink) {
+        sink(message);
+    }
+}
+
+void ModelResidency::add(ResidentModelBase* model)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_models.push_back(model);
+    startLocked();
+}
+
+void ModelResidency::remove(ResidentModelBase* model)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_models.erase(std::remove(m_models.begin(), m_models.end(), model), m_models.end());
+    m_prefetch.erase(std::remove(m_prefetch.begin(), m_prefetch.end(), model), m_prefetch.end());
+    m_idle.wait(lock, [this, model]() { return m_visits == 0 && m_loading != model; });
+}
+
+std::vector<ResidentModelBase*> ModelResidency::beginVisit() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_visits;
+    return m_models;
+}
+
+void ModelResidency::endVisit() const
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_visits;
+    }
+    m_idle.notify_all();
+}
+
+void ModelResidency::startLocked()
+{
+    if (!m_thread.joinable() && !m_stopping) {
+        m_thread = std::thread([this]() { run(); });
+    }
+}
+
+void ModelResidency::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto nextSweep = ResidentModelBase::Clock::now() + m_options.sweepInterval;
+    while (!m_stopping) {
+        if (!m_prefetch.empty()) {
+            m_loading = m_prefetch.front();
+            m_prefetch.pop_front();
+            lock.unlock();
+            m_loading->preload();
+            lock.lock();
+            m_loading = nullptr;
+            m_idle.notify_all();
+            continue;
+        }
+
+        if (ResidentModelBase::Clock::now() >= nextSweep) {
+            lock.unlock();
+            const MemoryStatus status = MemoryStatus::read();
+            sweep(ResidentModelBase::Clock::now(), status);
+            lock.lock();
+            nextSweep = ResidentModelBase::Clock::now() + m_options.sweepInterval;
+            continue;
+        }
+
+        m_wake.wait_until(lock, nextSweep, [this]() { return m_stopping || !m_prefetch.empty(); });
+    }
+}
+
+} // namespace ai
+} // namespace flykylin
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace flykylin {
+namespace ai {
+
+/**
+ * @brief What /proc says about memory; fields missing on other systems stay empty
+ */
+struct MemoryStatus {
+    std::optional<uint64_t> availableBytes;     ///< MemAvailable from /proc/meminfo
+    std::optional<double> psiSomeAvg10;         ///< "some avg10" from /proc/pressure/memory, in %
+
+    static MemoryStatus read();
+};
+
+std::optional<uint64_t> parseMemAvailable(const std::string& meminfo);
+std::optional<double> parsePsiSomeAvg10(const std::string& pressure);
+
+/**
+ * @brief Resident set size of this process, 0 where /proc/self/statm is missing
+ */
+uint64_t currentRssBytes();
+
+/**
+ * @brief High-water mark of the resident set size (VmHWM), 0 where /proc is missing
+ */
+uint64_t peakRssBytes();
+std::optional<uint64_t> parseVmHwm(const std::string& status);
+
+class ModelResidency;
+
+/**
+ * @brief One model's slot as the residency manager sees it
+ */
+class ResidentModelBase {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Report {
+        std::string name;
+        bool loaded{false};
+        bool inUse{false};
+        uint64_t residentBytes{0};      ///< RSS growth while it loaded (approximate)
+        uint64_t peakBytes{0};          ///< Process peak RSS right after the load
+        Clock::duration idle{};
+    };
+
+    explicit ResidentModelBase(std::string name);
+    virtual ~ResidentModelBase();
+
+    ResidentModelBase(const ResidentModelBase&) = delete;
+    ResidentModelBase& operator=(const ResidentModelBase&) = delete;
+
+    const std::string& name() const { return m_name; }
+    Report report(Clock::time_point now) const;
+
+    /**
+     * @brief Drop the model unless a caller still holds it
+     * @return true if it was loaded and is now gone
+     */
+    bool unloadIfUnused();
+
+protected:
+    friend class ModelResidency;
+
+    virtual bool isLoaded() const = 0;     ///< Called with m_mutex held
+    virtual bool isInUse() const = 0;      ///< Called with m_mutex held
+    virtual void release() = 0;            ///< Called with m_mutex held
+    virtual void preload() = 0;            ///< Load now, on the residency thread
+
+    /**
+     * @brief Stop the manager from reaching this model; derived destructors call it first
+     */
+    void detach();
+
+    mutable std::mutex m_mutex;
+    Clock::time_point m_lastUsed{Clock::now()};
+    uint64_t m_residentBytes{0};
+    uint64_t m_peakBytes{0};
+
+private:
+    std::string m_name;
+};
+
+/**
+ * @brief A model that is loaded on first use and may be unloaded when idle
+ *
+ * acquire() hands out shared ownership: a model in use is never unloaded,
+ * and one unloaded meanwhile is simply loaded again by the next acquire().
+ */
+template <typename Backend>
+class ResidentModel : public ResidentModelBase {
+public:
+    using Loader = std::function<std::unique_ptr<Backend>()>;
+
+    explicit ResidentModel(std::string name)
+        : ResidentModelBase(std::move(name))
+    {
+    }
+
+    ~ResidentModel() override { detach(); }
+
+    /**
+     * @brief How to load the model; returning nullptr means it cannot be loaded
+     */
+    void setLoader(Loader loader)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loader = std::move(loader);
+    }
+
+    /**
+     * @return The model, loading it on this thread if needed; nullptr if that failed
+     */
+    std::shared_ptr<Backend> acquire();
+
+    /**
+     * @brief Load on the residency thread so the first real use does not wait
+     */
+    void prefetch();
+
+protected:
+    bool isLoaded() const override { return m_backend != nullptr; }
+    bool isInUse() const override { return m_backend && m_backend.use_count() > 1; }
+    void release() override { m_backend.reset(); }
+    void preload() override { acquire(); }
+
+private:
+    Loader m_loader;
+    std::shared_ptr<Backend> m_backend;
+};
+
+/**
+ * @brief Unloads idle models and reacts to memory pressure
+ *
+ * A background thread, started with the first model, loads prefetched
+ * models and sweeps every sweepInterval. A model nobody holds is
+ * unloaded once it has been idle for idleUnload, or after a short grace
+ * period while the system is under memory pressure: MemAvailable below
+ * minAvailableBytes or PSI "some avg10" at or above psiSomeAvg10.
+ */
+class ModelResidency {
+public:
+    struct Options {
+        std::chrono::seconds idleUnload{300};   ///< 0 = only under memory pressure
+        std::chrono::seconds pressureGrace{10};
+        std::chrono::seconds sweepInterval{15};
+        uint64_t minAvailableBytes{150ull * 1024 * 1024};
+        double psiSomeAvg10{10.0};
+        std::function<void(const std::string&)> log;
+    };
+
+    static ModelResidency& instance();
+
+    ~ModelResidency();
+
+    ModelResidency(const ModelResidency&) = delete;
+    ModelResidency& operator=(const ModelResidency&) = delete;
+
+    void setOptions(Options options);
+    bool underPressure(const MemoryStatus& status) const;
+
+    /**
+     * @brief One sweep; the thread calls this with MemoryStatus::read()
+     * @return Names of the models unloaded
+     */
+    std::vector<std::string> sweep(ResidentModelBase::Clock::time_point now, const MemoryStatus& status);
+
+    std::vector<ResidentModelBase::Report> report() const;
+
+    /**
+     * @brief Load a model on the residency thread
+     */
+    void prefetch(ResidentModelBase* model);
+
+    /**
+     * @brief Pass a line to Options::log; never call it with a model's lock held
+     */
+    void log(const std::string& message) const;
+
+private:
+    friend class ResidentModelBase;
+
+    ModelResidency() = default;
+
+    void add(ResidentModelBase* model);
+    void remove(ResidentModelBase* model);
+    std::vector<ResidentModelBase*> beginVisit() const;
+    void endVisit() const;
+    void startLocked();
+    void run();
+
+    // Models are visited without m_mutex so a slow load never stalls the
+    // manager; remove() waits for visits and loads to finish instead.
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    mutable std::condition_variable m_idle;
+    Options m_options;
+    std::vector<ResidentModelBase*> m_models;
+    std::deque<ResidentModelBase*> m_prefetch;
+    ResidentModelBase* m_loading{nullptr};
+    mutable int m_visits{0};
+    std::thread m_thread;
+    bool m_stopping{false};
+};
+
+template <typename Backend>
+std::shared_ptr<Backend> ResidentModel<Backend>::acquire()
+{
+    std::string loaded;
+    std::shared_ptr<Backend> backend;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_backend && m_loader) {
+            // Concurrent loads would both count in the RSS delta; it is an estimate
+            const uint64_t rssBefore = currentRssBytes();
+            const auto start = Clock::now();
+            m_backend = m_loader();
+            if (m_backend) {
+                const uint64_t rssAfter = currentRssBytes();
+                m_residentBytes = rssAfter > rssBefore ? rssAfter - rssBefore : 0;
+                m_peakBytes = peakRssBytes();
+                const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+                loaded = "Loaded " + name() + " in " + std::to_string(ms) + " ms, "
+                         + std::to_string(m_residentBytes / 1024) + " KB resident, process peak RSS "
+                         + std::to_string(m_peakBytes / 1024) + " KB";
+            }
+        }
+        m_lastUsed = Clock::now();
+        backend = m_backend;
+    }
+    if (!loaded.empty()) {
+        ModelResidency::instance().log(loaded);
+    }
+    return backend;
+}
+
+template <typename Backend>
+void ResidentModel<Backend>::prefetch()
+{
+    ModelResidency::instance().prefetch(this);
+}
+
+} // namespace ai
+} // namespace flykylin
@@ -1,26 +1,32 @@
 #include "NSFWDetector.h"
 
+#include "NsfwPreprocess.h"
+#include "OnnxRuntime.h"
+#include "core/database/DatabaseService.h"
+#include "core/services/ImageProcessor.h"
+
 #include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFileInfo>
 #include <QImage>
+#include <QPointer>
 #include <QStringList>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstring>
+#include <exception>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
-#if defined(FLYKYLIN_ENABLE_ONNXRUNTIME)
-#  if __has_include(<onnxruntime_cxx_api.h>)
-#    include <onnxruntime_cxx_api.h>
-#    define FLYKYLIN_ONNXRUNTIME_COMPILED 1
-#  else
-#    pragma message("onnxruntime_cxx_api.h not found, building NSFWDetector without ONNX backend")
-#  endif
-#endif
 
 #if defined(RK3566_PLATFORM) && defined(FLYKYLIN_ENABLE_RKNN)
 #  if __has_include(<rknn_api.h>)
@@ -34,89 +40,74 @@
 namespace flykylin {
 namespace ai {
 
-#ifdef FLYKYLIN_ONNXRUNTIME_COMPILED
-namespace {
-
-class OnnxNsfwContext {
+/**
+ * @brief One way of running the NSFW model; see nsfwBackends()
+ */
+class NsfwBackend {
 public:
-    OnnxNsfwContext()
-        : available(false)
-    {
-        QString appDir = QCoreApplication::applicationDirPath();
-        QDir dir(appDir);
-        QString modelPath = dir.filePath("models/open_nsfw.onnx");
-
-        if (modelPath.isEmpty()) {
-            return;
-        }
+    virtual ~NsfwBackend() = default;
 
-        try {
-            env = std::make_unique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "FlyKylinNSFW");
-            Ort::SessionOptions options;
-
-            const ORTCHAR_T* ortPath = nullptr;
-#ifdef _WIN32
-            std::wstring wpath = modelPath.toStdWString();
-            ortPath = wpath.c_str();
-#else
-            QByteArray utf8 = modelPath.toUtf8();
-            std::string path(utf8.constData(), static_cast<std::size_t>(utf8.size()));
-            if (path.empty()) {
-                return;
-            }
-            ortPath = path.c_str();
-#endif
+    /**
+     * @return One result per image, std::nullopt where inference failed
+     */
+    virtual std::vector<InferenceQueue::Result> infer(const std::vector<QImage>& images) = 0;
 
-            session = std::make_unique<Ort::Session>(*env, ortPath, options);
-
-            Ort::AllocatorWithDefaultOptions allocator;
+    QString modelFile;
+};
 
-            Ort::AllocatedStringPtr inputNamePtr = session->GetInputNameAllocated(0, allocator);
-            if (inputNamePtr) {
-                inputName = std::string(inputNamePtr.get());
-            }
+namespace {
 
-            Ort::AllocatedStringPtr outputNamePtr = session->GetOutputNameAllocated(0, allocator);
-            if (outputNamePtr) {
-                outputName = std::string(outputNamePtr.get());
-            }
+constexpr int kStoredVerdicts = 20000;
+constexpr auto kBatchWindow = std::chrono::milliseconds(10);
+constexpr int kInputSize = 224;
+constexpr std::size_t kTensorFloats = static_cast<std::size_t>(kInputSize) * kInputSize * 3;
+constexpr int kDecodeMinEdge = 256;     ///< Both models resize to at most 256x256
+constexpr uint64_t kVerdictStatsInterval = 100;
 
-            if (!inputName.empty() && !outputName.empty()) {
-                available = true;
-                qInfo() << "[NSFWDetector] ONNX backend initialized";
-            }
-        } catch (const Ort::Exception& ex) {
-            qWarning() << "[NSFWDetector] Failed to initialize ONNX backend:" << ex.what();
-            env.reset();
-            session.reset();
-            inputName.clear();
-            outputName.clear();
-            available = false;
-        }
+std::string hashFile(const QString& path)
+{
+    QFile file(path);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!file.open(QIODevice::ReadOnly) || !hash.addData(&file)) {
+        return std::string();
     }
+    return hash.result().toHex().toStdString();
+}
 
-    bool available;
-    std::unique_ptr<Ort::Env> env;
-    std::unique_ptr<Ort::Session> session;
-    std::string inputName;
-    std::string outputName;
-};
-
-OnnxNsfwContext& nsfwContext()
+void persistVerdict(const std::string& contentHash, const std::string& modelVersion, float probability)
 {
-    static OnnxNsfwContext ctx;
-    return ctx;
+    database::DatabaseService::NsfwVerdict verdict;
+    verdict.contentHash = QString::fromStdString(contentHash);
+    verdict.modelVersion = QString::fromStdString(modelVersion);
+    verdict.probability = probability;
+    verdict.lastUsed = QDateTime::currentMSecsSinceEpoch();
+
+    // The database connection belongs to the GUI thread
+    auto* db = database::DatabaseService::instance();
+    QMetaObject::invokeMethod(db, [db, verdict]() {
+        db->upsertNsfwVerdict(verdict);
+    }, Qt::QueuedConnection);
 }
 
-} // namespace
+#if defined(FLYKYLIN_RKNN_COMPILED) || defined(FLYKYLIN_ONNXRUNTIME_COMPILED)
+constexpr float kMeanBgr[3] = {104.0f, 117.0f, 123.0f};
+
+// Opaque images come out of scaled() as RGB32, which the kernel reads in place
+ImageView tensorView(QImage& image)
+{
+    if (image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_RGB888) {
+        // Alpha and other formats keep Qt's own RGB888 conversion
+        image = image.convertToFormat(QImage::Format_RGB888);
+    }
+    return {image.constBits(), static_cast<int>(image.bytesPerLine()),
+            image.format() == QImage::Format_RGB32 ? PixelLayout::Xrgb32 : PixelLayout::Rgb888};
+}
 #endif
 
 #ifdef FLYKYLIN_RKNN_COMPILED
-namespace {
-
-class RknnNsfwContext {
+class RknnNsfwBackend : public NsfwBackend {
 public:
-    RknnNsfwContext()
+    RknnNsfwBackend()
         : available(false)
         , ctx(0)
         , width(0)
@@ -151,18 +142,35 @@ public:
             return;
         }
 
-        QByteArray data = f.readAll();
-        if (data.isEmpty()) {
+        if (f.size() <= 0) {
             qWarning() << "[NSFWDetector] Empty RKNN model file" << modelPath;
             return;
         }
 
+        // rknn_init copies the weights into NPU memory, so reading them
+        // through a mapping avoids a second heap copy of the whole model
+        QElapsedTimer timer;
+        timer.start();
+        uchar* mapped = f.map(0, f.size());
+        QByteArray copy;    // Only where the file cannot be mapped
+        if (!mapped) {
+            copy = f.readAll();
+        }
+        void* model = mapped ? static_cast<void*>(mapped) : copy.data();
+        const auto modelSize = static_cast<uint32_t>(mapped ? f.size() : copy.size());
+
         rknn_context localCtx = 0;
-        int ret = rknn_init(&localCtx, data.data(), static_cast<uint32_t>(data.size()), 0, nullptr);
+        int ret = rknn_init(&localCtx, model, modelSize, 0, nullptr);
+        if (mapped) {
+            f.unmap(mapped);
+        }
+        copy = QByteArray();
+        f.close();
         if (ret != RKNN_SUCC || !localCtx) {
             qWarning() << "[NSFWDetector] rknn_init failed" << ret;
             return;
         }
+        qInfo() << "[NSFWDetector] rknn_init took" << timer.elapsed() << "ms for" << modelPath;
 
         rknn_input_output_num ioNum;
         std::memset(&ioNum, 0, sizeof(ioNum));
@@ -219,11 +227,12 @@ public:
 
         ctx = localCtx;
         available = true;
+        modelFile = modelPath;
         qInfo() << "[NSFWDetector] RKNN backend initialized, model =" << modelPath
                 << "input size =" << width << "x" << height;
     }
 
-    ~RknnNsfwContext()
+    ~RknnNsfwBackend() override
     {
         if (ctx) {
             rknn_destroy(ctx);
@@ -231,7 +240,101 @@ public:
         }
     }
 
+    std::vector<InferenceQueue::Result> infer(const std::vector<QImage>& images) override
+    {
+        std::vector<InferenceQueue::Result> results(images.size());
+        // The model is converted for batch 1 and the RK3566 NPU has a single
+        // core, so a batch runs back to back through the one context
+        for (std::size_t i = 0; i < images.size(); ++i) {
+            const QImage& image = images[i];
+            qInfo() << "[NSFWDetector] Image size:" << image.width() << "x" << image.height();
+
+            // Preprocessing for RKNN open_nsfw model:
+            // 1. Scale to 224x224
+            // 2. In one pass (preprocessBgr): convert RGB to BGR, subtract mean
+            //    [B=104, G=117, R=123] and rearrange from HWC to WCH (RKNN expects
+            //    NWCH layout for this model)
+            QImage resized = image.scaled(kInputSize, kInputSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            if (resized.isNull()) {
+                qWarning() << "[NSFWDetector] Failed to resize image";
+                continue;
+            }
+
+            const ImageView pixels = tensorView(resized);
+
+            // Prepare input data in NWCH format [1, W, C, H] = [1, 224, 3, 224]
+            // This is the correct layout discovered through debugging
+            std::vector<float>& inputData = inputBuffer;
+            inputData.resize(kTensorFloats);
+            preprocessBgr(pixels, 0, 0, kInputSize, kInputSize, kMeanBgr, TensorLayout::Wch, inputData.data());
+
+            rknn_input input;
+            std::memset(&input, 0, sizeof(input));
+            input.index = 0;
+            input.pass_through = 0;  // Let RKNN handle format conversion
+            input.type = RKNN_TENSOR_FLOAT32;
+            input.fmt = RKNN_TENSOR_NHWC;  // Data format flag
+            input.size = static_cast<uint32_t>(inputData.size() * sizeof(float));
+            input.buf = inputData.data();
+
+            int ret = rknn_inputs_set(ctx, 1, &input);
+            if (ret != RKNN_SUCC) {
+                qWarning() << "[NSFWDetector] rknn_inputs_set failed" << ret;
+                continue;
+            }
+
+            ret = rknn_run(ctx, nullptr);
+            if (ret != RKNN_SUCC) {
+                qWarning() << "[NSFWDetector] rknn_run failed" << ret;
+                continue;
+            }
+
+            rknn_output output;
+            std::memset(&output, 0, sizeof(output));
+            output.want_float = 1;
+            output.is_prealloc = 0;
+            output.index = 0;
+
+            ret = rknn_outputs_get(ctx, 1, &output, nullptr);
+            if (ret != RKNN_SUCC || !output.buf) {
+                qWarning() << "[NSFWDetector] rknn_outputs_get failed" << ret;
+                continue;
+            }
+
+            const float* outData = static_cast<const float*>(output.buf);
+            if (outputAttr.n_elems >= 2) {
+                float sfw = outData[0];
+                float nsfw = outData[1];
+                qInfo() << "[NSFWDetector] RKNN raw output: sfw=" << sfw << "nsfw=" << nsfw
+                        << "sum=" << (sfw + nsfw);
+
+                // The output should already be probabilities from softmax in the model
+                // But if sum != 1, we need to apply softmax
+                if (std::abs(sfw + nsfw - 1.0f) > 0.1f) {
+                    // Apply softmax: exp(x) / sum(exp(x))
+                    float maxVal = std::max(sfw, nsfw);
+                    float expSfw = std::exp(sfw - maxVal);
+                    float expNsfw = std::exp(nsfw - maxVal);
+                    float sumExp = expSfw + expNsfw;
+                    results[i] = expNsfw / sumExp;
+                    qInfo() << "[NSFWDetector] Applied softmax -> prob=" << *results[i];
+                } else {
+                    results[i] = nsfw;
+                }
+            } else if (outputAttr.n_elems >= 1) {
+                results[i] = outData[0];
+                qInfo() << "[NSFWDetector] Single output:" << *results[i];
+            } else {
+                qWarning() << "[NSFWDetector] RKNN output tensor has no elements";
+            }
+
+            rknn_outputs_release(ctx, 1, &output);
+        }
+        return results;
+    }
+
     bool available;
+    std::vector<float> inputBuffer;     ///< Reused by every inference
     rknn_context ctx;
     int width;
     int height;
@@ -240,280 +343,472 @@ public:
     rknn_tensor_attr outputAttr;
 };
 
-RknnNsfwContext& rknnContext()
+#endif
+
+#ifdef FLYKYLIN_ONNXRUNTIME_COMPILED
+class OnnxNsfwBackend : public NsfwBackend {
+public:
+    explicit OnnxNsfwBackend(const QString& modelPath)
+        : available(false)
+    {
+
+        try {
+            // Shared environment, thread pool and optimized-model cache
+            env = sharedOrtEnv();
+            session = createOnnxSession(modelPath);
+
+            Ort::AllocatorWithDefaultOptions allocator;
+
+            Ort::AllocatedStringPtr inputNamePtr = session->GetInputNameAllocated(0, allocator);
+            if (inputNamePtr) {
+                inputName = std::string(inputNamePtr.get());
+            }
+
+            Ort::AllocatedStringPtr outputNamePtr = session->GetOutputNameAllocated(0, allocator);
+            if (outputNamePtr) {
+                outputName = std::string(outputNamePtr.get());
+            }
+
+            // Exported with a symbolic batch dimension, one Run can score a whole batch
+            const std::vector<int64_t> inputShape =
+                session->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+            dynamicBatch = !inputShape.empty() && inputShape[0] < 0;
+
+            if (!inputName.empty() && !outputName.empty()) {
+                available = true;
+                modelFile = modelPath;
+                qInfo() << "[NSFWDetector] ONNX backend initialized, dynamic batch =" << dynamicBatch;
+            }
+        } catch (const Ort::Exception& ex) {
+            qWarning() << "[NSFWDetector] Failed to initialize ONNX backend:" << ex.what();
+            env.reset();
+            session.reset();
+            inputName.clear();
+            outputName.clear();
+            available = false;
+        }
+    }
+
+    std::vector<InferenceQueue::Result> infer(const std::vector<QImage>& images) override
+    {
+        std::vector<InferenceQueue::Result> results(images.size());
+        constexpr int kScaledSize = 256;
+
+        // Center crop, BGR, mean subtraction and NHWC layout in one pass, each
+        // image straight into its slot of the batch tensor
+        const int left = (kScaledSize - kInputSize) / 2;
+        const int top = (kScaledSize - kInputSize) / 2;
+        std::vector<float>& inputData = inputBuffer;
+        inputData.resize(kTensorFloats * images.size());
+        std::vector<std::size_t> slots;     // Image index of each prepared tensor
+        for (std::size_t i = 0; i < images.size(); ++i) {
+            QImage resized = images[i].scaled(kScaledSize, kScaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            if (resized.width() != kScaledSize || resized.height() != kScaledSize) {
+                qWarning() << "[NSFWDetector] Failed to resize image";
+                continue;
+            }
+            const ImageView pixels = tensorView(resized);
+            preprocessBgr(pixels, left, top, kInputSize, kInputSize, kMeanBgr, TensorLayout::Hwc,
+                          inputData.data() + kTensorFloats * slots.size());
+            slots.push_back(i);
+        }
+
+        try {
+            Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+            const char* inputNames[] = {inputName.c_str()};
+            const char* outputNames[] = {outputName.c_str()};
+
+            // A fixed batch dimension of 1 means one Run per tensor
+            const std::size_t perRun = dynamicBatch ? std::max<std::size_t>(slots.size(), 1) : 1;
+            for (std::size_t first = 0; first < slots.size(); first += perRun) {
+                const std::size_t count = std::min(perRun, slots.size() - first);
+                std::vector<int64_t> inputShape{static_cast<int64_t>(count), kInputSize, kInputSize, 3};
+                Ort::Value inputTensor = Ort::Value::CreateTensor<float>(memInfo,
+                                                                         inputData.data() + kTensorFloats * first,
+                                                                         kTensorFloats * count,
+                                                                         inputShape.data(),
+                                                                         inputShape.size());
+
+                std::vector<Ort::Value> outputs =
+                    session->Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames, 1);
+
+                if (outputs.empty() || !outputs[0].IsTensor()) {
+                    qWarning() << "[NSFWDetector] Empty or non-tensor output";
+                    continue;
+                }
+
+                const float* outData = outputs[0].GetTensorData<float>();
+                if (!outData || outputs[0].GetTensorTypeAndShapeInfo().GetElementCount() < count * 2) {
+                    qWarning() << "[NSFWDetector] Output tensor too small for batch of" << count;
+                    continue;
+                }
+
+                // [N, 2] = (sfw, nsfw) per image
+                for (std::size_t j = 0; j < count; ++j) {
+                    results[slots[first + j]] = outData[j * 2 + 1];
+                }
+            }
+        } catch (const Ort::Exception& ex) {
+            qWarning() << "[NSFWDetector] ONNX Run failed:" << ex.what();
+        } catch (const std::exception& ex) {
+            qWarning() << "[NSFWDetector] std::exception:" << ex.what();
+        } catch (...) {
+            qWarning() << "[NSFWDetector] Unknown exception during inference";
+        }
+        return results;
+    }
+
+    bool available;
+    bool dynamicBatch{false};
+    std::vector<float> inputBuffer;     ///< Reused by every inference, one tensor per batch item
+    std::shared_ptr<Ort::Env> env;     ///< Kept so it outlives the session
+    std::shared_ptr<Ort::Session> session;
+    std::string inputName;
+    std::string outputName;
+};
+
+BackendRegistry<NsfwBackend>::Factory onnxBackend(const char* relativePath)
 {
-    static RknnNsfwContext ctx;
-    return ctx;
+    return [relativePath]() -> std::unique_ptr<NsfwBackend> {
+        const QString modelPath = QDir(QCoreApplication::applicationDirPath()).filePath(QLatin1String(relativePath));
+        if (!QFile::exists(modelPath)) {
+            return nullptr;
+        }
+        auto backend = std::make_unique<OnnxNsfwBackend>(modelPath);
+        if (!backend->available) {
+            return nullptr;
+        }
+        return backend;
+    };
 }
+#endif
 
-} // namespace
+// Every way this build can run open_nsfw
+BackendRegistry<NsfwBackend> nsfwBackends()
+{
+    BackendRegistry<NsfwBackend> registry("nsfw");
+#ifdef FLYKYLIN_RKNN_COMPILED
+    registry.add(BackendKind::Rknn, []() -> std::unique_ptr<NsfwBackend> {
+        auto backend = std::make_unique<RknnNsfwBackend>();
+        if (!backend->available) {
+            return nullptr;
+        }
+        return backend;
+    });
 #endif
+#ifdef FLYKYLIN_ONNXRUNTIME_COMPILED
+    registry.add(BackendKind::OnnxCpu, onnxBackend("models/open_nsfw.onnx"));
+    registry.add(BackendKind::OnnxInt8, onnxBackend("models/open_nsfw_int8.onnx"));
+#endif
+    return registry;
+}
 
-NSFWDetector* NSFWDetector::instance()
+bool benchmarkNsfw(NsfwBackend& backend)
 {
-    static NSFWDetector s_instance;
-    return &s_instance;
+    QImage probe(kDecodeMinEdge, kDecodeMinEdge, QImage::Format_RGB32);
+    probe.fill(Qt::gray);
+    return backend.infer({probe}).front().has_value();
 }
 
-NSFWDetector::NSFWDetector() = default;
+} // namespace
 
-bool NSFWDetector::isAvailable() const
+NSFWDetector* NSFWDetector::instance()
 {
-#if defined(FLYKYLIN_RKNN_COMPILED)
-    return rknnContext().available;
-#elif defined(FLYKYLIN_ONNXRUNTIME_COMPILED)
-    return nsfwContext().available;
-#else
-    return false;
-#endif
+    static NSFWDetector s_instance;
+    return &s_instance;
 }
 
-std::optional<float> NSFWDetector::predictNsfwProbability(const QString& imagePath) const
-{
-#if defined(FLYKYLIN_RKNN_COMPILED)
-    qInfo() << "[NSFWDetector] predictNsfwProbability called for" << imagePath;
-    
-    RknnNsfwContext& ctx = rknnContext();
-    if (!ctx.available || !ctx.ctx) {
-        qWarning() << "[NSFWDetector] RKNN context not available, available=" << ctx.available << "ctx=" << ctx.ctx;
-        Q_UNUSED(imagePath);
-        return std::nullopt;
+/**
+ * @brief One image file: cache lookup and decode before the batched model run
+ */
+class NSFWDetector::ImageJob : public InferenceQueue::BatchItem {
+public:
+    ImageJob(const NSFWDetector* detector, const QString& imagePath)
+        : m_detector(detector)
+        , m_imagePath(imagePath)
+    {
     }
 
-    QImage image(imagePath);
-    if (image.isNull()) {
-        qWarning() << "[NSFWDetector] Failed to load image" << imagePath;
-        return std::nullopt;
-    }
-    
-    qInfo() << "[NSFWDetector] Image loaded, size:" << image.width() << "x" << image.height();
-
-    // Preprocessing for RKNN open_nsfw model:
-    // 1. Scale to 224x224
-    // 2. Convert RGB to BGR
-    // 3. Subtract mean [B=104, G=117, R=123]
-    // 4. Rearrange from HWC to WCH (RKNN expects NWCH layout for this model)
-    
-    constexpr int kInputSize = 224;
-    constexpr float kMeanB = 104.0f;
-    constexpr float kMeanG = 117.0f;
-    constexpr float kMeanR = 123.0f;
-    
-    QImage resized = image.scaled(kInputSize, kInputSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-    if (resized.isNull()) {
-        qWarning() << "[NSFWDetector] Failed to resize image" << imagePath;
-        return std::nullopt;
-    }
+    std::optional<InferenceQueue::Result> prepare() override;
+
+    const QImage& image() const { return m_image; }
+    const std::string& contentHash() const { return m_contentHash; }
+    const std::string& version() const { return m_version; }
+
+private:
+    const NSFWDetector* m_detector;
+    QString m_imagePath;
+    QImage m_image;
+    std::string m_contentHash;
+    std::string m_version;
+};
 
-    if (resized.format() != QImage::Format_RGB888) {
-        resized = resized.convertToFormat(QImage::Format_RGB888);
+std::optional<InferenceQueue::Result> NSFWDetector::ImageJob::prepare()
+{
+    if (!m_detector->waitForBackend()) {
+        return InferenceQueue::Result();
     }
 
-    const int width = resized.width();
-    const int height = resized.height();
-
-    // Prepare input data in NWCH format [1, W, C, H] = [1, 224, 3, 224]
-    // This is the correct layout discovered through debugging
-    std::vector<float> inputData(static_cast<std::size_t>(width * height * 3));
-
-    // Convert from HWC (QImage scanline order) to WCH
-    // Original: data[h][w][c] -> Target: data[w][c][h]
-    for (int h = 0; h < height; ++h) {
-        const uchar* line = resized.constScanLine(h);
-        for (int w = 0; w < width; ++w) {
-            // Read RGB from QImage
-            const uchar r = line[w * 3 + 0];
-            const uchar g = line[w * 3 + 1];
-            const uchar b = line[w * 3 + 2];
-            
-            // Convert to BGR and subtract mean
-            const float bVal = static_cast<float>(b) - kMeanB;
-            const float gVal = static_cast<float>(g) - kMeanG;
-            const float rVal = static_cast<float>(r) - kMeanR;
-            
-            // Store in WCH order: index = w * (C * H) + c * H + h
-            // For BGR: c=0 is B, c=1 is G, c=2 is R
-            const std::size_t baseIdx = static_cast<std::size_t>(w * 3 * height);
-            inputData[baseIdx + static_cast<std::size_t>(0 * height + h)] = bVal;  // B channel
-            inputData[baseIdx + static_cast<std::size_t>(1 * height + h)] = gVal;  // G channel
-            inputData[baseIdx + static_cast<std::size_t>(2 * height + h)] = rVal;  // R channel
+    // Same bytes, same model: same verdict (stickers, relayed and resent images)
+    m_contentHash = hashFile(m_imagePath);
+    m_version = m_detector->modelVersion();
+    if (!m_contentHash.empty()) {
+        const auto cached = m_detector->m_verdicts.find(m_contentHash, m_version);
+        const NsfwVerdictCache::Stats stats = m_detector->m_verdicts.stats();
+        const uint64_t lookups = stats.hits + stats.misses;
+        if (lookups % kVerdictStatsInterval == 0) {
+            qInfo() << "[NSFWDetector] Verdict cache hit rate" << stats.hitRate() * 100.0 << "% ("
+                    << stats.hits << "/" << lookups << "lookups," << stats.entries << "entries)";
+        }
+        if (cached.has_value()) {
+            persistVerdict(m_contentHash, m_version, *cached);  // Refreshes last_used
+            return InferenceQueue::Result(*cached);
         }
     }
 
-    qInfo() << "[NSFWDetector] Preparing RKNN input, data size:" << inputData.size();
-    
-    rknn_input input;
-    std::memset(&input, 0, sizeof(input));
-    input.index = 0;
-    input.pass_through = 0;  // Let RKNN handle format conversion
-    input.type = RKNN_TENSOR_FLOAT32;
-    input.fmt = RKNN_TENSOR_NHWC;  // Data format flag
-    input.size = static_cast<uint32_t>(inputData.size() * sizeof(float));
-    input.buf = inputData.data();
-
-    qInfo() << "[NSFWDetector] Calling rknn_inputs_set...";
-    int ret = rknn_inputs_set(ctx.ctx, 1, &input);
-    if (ret != RKNN_SUCC) {
-        qWarning() << "[NSFWDetector] rknn_inputs_set failed" << ret;
-        return std::nullopt;
+    // A 12 MP photo decoded at 1/8 is a fraction of the memory and time
+    m_image = services::ImageProcessor::loadScaled(m_imagePath, QSize(kDecodeMinEdge, kDecodeMinEdge));
+    if (m_image.isNull()) {
+        return InferenceQueue::Result();
     }
-    qInfo() << "[NSFWDetector] rknn_inputs_set OK";
+    return std::nullopt;
+}
 
-    qInfo() << "[NSFWDetector] Calling rknn_run...";
-    ret = rknn_run(ctx.ctx, nullptr);
-    if (ret != RKNN_SUCC) {
-        qWarning() << "[NSFWDetector] rknn_run failed" << ret;
-        return std::nullopt;
-    }
+NSFWDetector::NSFWDetector()
+{
+    applyResidencySettings();
+    m_model.setLoader([this]() { return loadBackend(); });
+    m_queue.setBatchRunner([this](const std::vector<InferenceQueue::BatchItem*>& items) {
+        return runBatch(items);
+    }, kMaxBatch, kBatchWindow);
+}
 
-    rknn_output output;
-    std::memset(&output, 0, sizeof(output));
-    output.want_float = 1;
-    output.is_prealloc = 0;
-    output.index = 0;
+NSFWDetector::~NSFWDetector()
+{
+    m_queue.stop();
+}
 
-    ret = rknn_outputs_get(ctx.ctx, 1, &output, nullptr);
-    if (ret != RKNN_SUCC || !output.buf) {
-        qWarning() << "[NSFWDetector] rknn_outputs_get failed" << ret;
-        return std::nullopt;
-    }
+bool NSFWDetector::initialize()
+{
+    return waitForBackend();
+}
 
-    float nsfwProb = 0.0f;
-    float* outData = static_cast<float*>(output.buf);
-    if (!outData) {
-        qWarning() << "[NSFWDetector] RKNN output data pointer is null";
-        rknn_outputs_release(ctx.ctx, 1, &output);
-        return std::nullopt;
-    }
+std::string NSFWDetector::getAcceleratorName() const
+{
+    return backendName();
+}
 
-    // Debug: print raw output values
-    if (ctx.outputAttr.n_elems >= 2) {
-        float sfw = outData[0];
-        float nsfw = outData[1];
-        qInfo() << "[NSFWDetector] RKNN raw output: sfw=" << sfw << "nsfw=" << nsfw 
-                << "sum=" << (sfw + nsfw);
-        
-        // The output should already be probabilities from softmax in the model
-        // But if sum != 1, we need to apply softmax
-        if (std::abs(sfw + nsfw - 1.0f) > 0.1f) {
-            // Apply softmax: exp(x) / sum(exp(x))
-            float maxVal = std::max(sfw, nsfw);
-            float expSfw = std::exp(sfw - maxVal);
-            float expNsfw = std::exp(nsfw - maxVal);
-            float sumExp = expSfw + expNsfw;
-            nsfwProb = expNsfw / sumExp;
-            qInfo() << "[NSFWDetector] Applied softmax -> prob=" << nsfwProb;
-        } else {
-            nsfwProb = nsfw;
+BackendAvailability NSFWDetector::availability() const
+{
+    if (!m_backendResolved.load(std::memory_order_acquire)) {
+        if (!m_selectionStarted.exchange(true)) {
+            m_model.prefetch();
         }
-    } else if (ctx.outputAttr.n_elems >= 1) {
-        nsfwProb = outData[0];
-        qInfo() << "[NSFWDetector] Single output:" << nsfwProb;
-    } else {
-        qWarning() << "[NSFWDetector] RKNN output tensor has no elements";
-        rknn_outputs_release(ctx.ctx, 1, &output);
-        return std::nullopt;
+        return BackendAvailability::Pending;
     }
+    return m_backendKind.load() != BackendKind::Null ? BackendAvailability::Available
+                                                     : BackendAvailability::Unavailable;
+}
 
-    rknn_outputs_release(ctx.ctx, 1, &output);
-    return nsfwProb;
-#elif defined(FLYKYLIN_ONNXRUNTIME_COMPILED)
-    OnnxNsfwContext& ctx = nsfwContext();
-    if (!ctx.available || !ctx.session || !ctx.env) {
-        Q_UNUSED(imagePath);
-        return std::nullopt;
-    }
+bool NSFWDetector::isAvailable() const
+{
+    return availability() == BackendAvailability::Available;
+}
 
-    QImage image(imagePath);
-    if (image.isNull()) {
-        qWarning() << "[NSFWDetector] Failed to load image" << imagePath;
-        return std::nullopt;
-    }
+bool NSFWDetector::waitForBackend() const
+{
+    selectBackend();
+    return m_backendKind.load() != BackendKind::Null;
+}
 
-    QImage resized = image.scaled(256, 256, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-    const int cropSize = 224;
-    const int left = (256 - cropSize) / 2;
-    const int top = (256 - cropSize) / 2;
-    QImage cropped = resized.copy(left, top, cropSize, cropSize);
-    if (cropped.isNull()) {
-        qWarning() << "[NSFWDetector] Failed to crop image" << imagePath;
-        return std::nullopt;
-    }
+const char* NSFWDetector::backendName() const
+{
+    return backendKindName(m_backendResolved.load(std::memory_order_acquire) ? m_backendKind.load()
+                                                                            : BackendKind::Null);
+}
 
-    if (cropped.format() != QImage::Format_RGB888) {
-        cropped = cropped.convertToFormat(QImage::Format_RGB888);
-    }
+std::optional<float> NSFWDetector::predictNsfwProbability(const QString& imagePath) const
+{
+    return predictAsync(imagePath).future.get();
+}
+
+InferenceQueue::Ticket NSFWDetector::predictAsync(const QString& imagePath) const
+{
+    loadVerdicts();
+    return m_queue.submit(imagePath.toStdString(), std::make_shared<ImageJob>(this, imagePath));
+}
 
-    const int width = cropped.width();
-    const int height = cropped.height();
-    if (width != cropSize || height != cropSize) {
-        qWarning() << "[NSFWDetector] Unexpected cropped size" << width << height;
-        return std::nullopt;
+quint64 NSFWDetector::predictAsync(const QString& imagePath,
+                                   QObject* context,
+                                   std::function<void(std::optional<float>)> callback) const
+{
+    loadVerdicts();
+    QPointer<QObject> receiver(context);
+    const InferenceQueue::Ticket ticket = m_queue.submit(
+        imagePath.toStdString(),
+        std::make_shared<ImageJob>(this, imagePath),
+        [receiver, callback](uint64_t, InferenceQueue::Result result) {
+            if (receiver) {
+                QMetaObject::invokeMethod(receiver.data(), [callback, result]() {
+                    callback(result);
+                }, Qt::QueuedConnection);
+            }
+        });
+    if (ticket.id == 0) {
+        qWarning() << "[NSFWDetector] Inference queue full, not checking" << imagePath;
     }
+    return ticket.id;
+}
 
-    constexpr float kMeanB = 104.0f;
-    constexpr float kMeanG = 117.0f;
-    constexpr float kMeanR = 123.0f;
+std::future<float> NSFWDetector::runInferenceAsync(const std::vector<uint8_t>& imageData, int width, int height)
+{
+    auto promise = std::make_shared<std::promise<float>>();
+    std::future<float> future = promise->get_future();
+
+    // Packed RGB888 rows; the copy outlives the caller's buffer
+    if (width <= 0 || height <= 0
+        || imageData.size() < static_cast<std::size_t>(width) * static_cast<std::size_t>(height) * 3) {
+        promise->set_exception(std::make_exception_ptr(std::invalid_argument("NSFW input is not RGB888")));
+        return future;
+    }
+    const QImage image = QImage(imageData.data(), width, height, width * 3, QImage::Format_RGB888).copy();
+
+    const InferenceQueue::Ticket ticket = m_queue.submit(
+        std::string(),
+        [this, image]() { return predictImage(image); },
+        [promise](uint64_t, InferenceQueue::Result result) {
+            if (result.has_value()) {
+                promise->set_value(*result);
+            } else {
+                promise->set_exception(std::make_exception_ptr(std::runtime_error("NSFW inference failed")));
+            }
+        });
+    if (ticket.id == 0) {
+        promise->set_exception(std::make_exception_ptr(std::runtime_error("NSFW inference queue is full")));
+    }
+    return future;
+}
 
-    std::vector<float> inputData(static_cast<std::size_t>(width * height * 3));
+void NSFWDetector::cancel(quint64 requestId) const
+{
+    m_queue.cancel(requestId);
+}
 
-    for (int y = 0; y < height; ++y) {
-        const uchar* line = cropped.constScanLine(y);
-        for (int x = 0; x < width; ++x) {
-            const int idx = (y * width + x) * 3;
-            const uchar r = line[3 * x + 0];
-            const uchar g = line[3 * x + 1];
-            const uchar b = line[3 * x + 2];
+std::vector<InferenceQueue::Result> NSFWDetector::runBatch(const std::vector<InferenceQueue::BatchItem*>& items) const
+{
+    std::vector<QImage> images;
+    images.reserve(items.size());
+    for (InferenceQueue::BatchItem* item : items) {
+        images.push_back(static_cast<ImageJob*>(item)->image());
+    }
 
-            inputData[static_cast<std::size_t>(idx + 0)] = static_cast<float>(b) - kMeanB;
-            inputData[static_cast<std::size_t>(idx + 1)] = static_cast<float>(g) - kMeanG;
-            inputData[static_cast<std::size_t>(idx + 2)] = static_cast<float>(r) - kMeanR;
+    QElapsedTimer timer;
+    timer.start();
+    const std::vector<InferenceQueue::Result> results = inferImages(images);
+    const double ms = static_cast<double>(timer.nsecsElapsed()) / 1e6;
+
+    BatchThroughput& throughput = m_batchThroughput[std::min(items.size(), kMaxBatch)];
+    throughput.images += items.size();
+    throughput.ms += ms;
+    qInfo() << "[NSFWDetector] Batch of" << items.size() << "in" << ms << "ms,"
+            << items.size() * 1000.0 / std::max(ms, 0.001) << "images/s (average at this size"
+            << throughput.images * 1000.0 / std::max(throughput.ms, 0.001) << "images/s)";
+
+    for (std::size_t i = 0; i < items.size() && i < results.size(); ++i) {
+        const auto* job = static_cast<const ImageJob*>(items[i]);
+        if (results[i].has_value() && !job->contentHash().empty()) {
+            m_verdicts.insert(job->contentHash(), job->version(), *results[i]);
+            persistVerdict(job->contentHash(), job->version(), *results[i]);
         }
     }
+    return results;
+}
 
-    std::vector<int64_t> inputShape{1, height, width, 3};
+NsfwVerdictCache::Stats NSFWDetector::verdictCacheStats() const
+{
+    return m_verdicts.stats();
+}
 
-    try {
-        Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
-        Ort::Value inputTensor = Ort::Value::CreateTensor<float>(memInfo,
-                                                                 inputData.data(),
-                                                                 inputData.size(),
-                                                                 inputShape.data(),
-                                                                 inputShape.size());
+std::string NSFWDetector::modelVersion() const
+{
+    // The model file's identity: replacing it invalidates cached verdicts
+    static const std::string version = [this]() {
+        selectBackend();
+        const QFileInfo info(m_modelFile);
+        return QStringLiteral("%1:%2:%3:%4")
+            .arg(QString::fromLatin1(backendName()), info.fileName())
+            .arg(info.size())
+            .arg(info.lastModified().toMSecsSinceEpoch())
+            .toStdString();
+    }();
+    return version;
+}
 
-        const char* inputNames[] = {ctx.inputName.c_str()};
-        const char* outputNames[] = {ctx.outputName.c_str()};
+void NSFWDetector::loadVerdicts() const
+{
+    // Called from the GUI thread, which owns the database connection. Needs
+    // the model version, so it waits for a later call rather than for the
+    // backend selection.
+    if (m_verdictsLoaded.load() || !isAvailable() || m_verdictsLoaded.exchange(true)) {
+        return;
+    }
 
-        std::vector<Ort::Value> outputs =
-            ctx.session->Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames, 1);
+    const QString version = QString::fromStdString(modelVersion());
+    auto* db = database::DatabaseService::instance();
+    db->pruneNsfwVerdicts(version, kStoredVerdicts);
+    const auto verdicts = db->loadRecentNsfwVerdicts(version, static_cast<int>(NsfwVerdictCache::kDefaultCapacity));
+    // Oldest first, so the most recently used end up at the front
+    for (auto it = verdicts.crbegin(); it != verdicts.crend(); ++it) {
+        m_verdicts.insert(it->contentHash.toStdString(), version.toStdString(), it->probability);
+    }
+    qInfo() << "[NSFWDetector] Loaded" << verdicts.size() << "cached verdicts for model" << version;
+}
 
-        if (outputs.empty() || !outputs[0].IsTensor()) {
-            qWarning() << "[NSFWDetector] Empty or non-tensor output";
-            return std::nullopt;
-        }
+std::optional<float> NSFWDetector::predictImage(const QImage& image) const
+{
+    return inferImages({image}).front();
+}
 
-        float* outData = outputs[0].GetTensorMutableData<float>();
-        if (!outData) {
-            qWarning() << "[NSFWDetector] Output data pointer is null";
-            return std::nullopt;
-        }
+std::vector<InferenceQueue::Result> NSFWDetector::inferImages(const std::vector<QImage>& images) const
+{
+    const std::shared_ptr<NsfwBackend> backend = m_model.acquire();
+    if (!backend) {
+        return std::vector<InferenceQueue::Result>(images.size());
+    }
+    return backend->infer(images);
+}
 
-        const float nsfwProb = outData[1];
-        return nsfwProb;
-    } catch (const Ort::Exception& ex) {
-        qWarning() << "[NSFWDetector] ONNX Run failed:" << ex.what();
-        return std::nullopt;
-    } catch (const std::exception& ex) {
-        qWarning() << "[NSFWDetector] std::exception:" << ex.what();
-        return std::nullopt;
-    } catch (...) {
-        qWarning() << "[NSFWDetector] Unknown exception during predictNsfwProbability";
-        return std::nullopt;
+void NSFWDetector::selectBackend() const
+{
+    if (m_backendResolved.load(std::memory_order_acquire)) {
+        return;
     }
-#else
-    Q_UNUSED(imagePath);
-    return std::nullopt;
-#endif
+    // Waits for a selection already running on the residency thread
+    std::call_once(m_backendSelected, [this]() { m_model.acquire(); });
+}
+
+std::unique_ptr<NsfwBackend> NSFWDetector::loadBackend() const
+{
+    // Runs under the residency slot's lock. Reloads after an idle unload
+    // reuse the kind picked by the first load.
+    if (m_backendChosen) {
+        return nsfwBackends().create(m_backendKind);
+    }
+    m_backendChosen = true;
+
+    // The first launch also benchmarks every backend
+    auto selection = nsfwBackends().select(benchmarkNsfw, settingsChoiceStore());
+    for (const auto& timing : selection.timings) {
+        qInfo() << "[NSFWDetector] Warm-up" << backendKindName(timing.kind) << timing.medianMs << "ms per image";
+    }
+    m_backendKind = selection.kind;
+    if (selection.backend) {
+        m_modelFile = selection.backend->modelFile;
+    }
+    m_backendResolved.store(true, std::memory_order_release);
+    qInfo() << "[NSFWDetector] Using backend" << backendKindName(m_backendKind)
+            << (selection.fromStore ? "(stored choice)" : "(benchmarked)");
+    return std::move(selection.backend);
 }
 
 } // namespace ai
@@ -1,21 +1,135 @@
 #pragma once
 
+#include "core/ai/InferenceBackend.h"
+#include "core/ai/InferenceQueue.h"
+#include "core/ai/ModelResidency.h"
+#include "core/ai/NsfwVerdictCache.h"
+#include "core/interfaces/I_Accelerator.h"
+
 #include <QString>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <vector>
+
+class QImage;
+class QObject;
 
 namespace flykylin {
 namespace ai {
 
-class NSFWDetector {
+class NsfwBackend;
+
+/**
+ * @brief NSFW classifier on the fastest backend this build and device offer
+ *
+ * The backend (RKNN, ONNX Runtime on the float or int8 model) is picked by
+ * BackendRegistry on the residency thread the first time anyone asks, and
+ * remembered in the settings. The loaded
+ * model is a ResidentModel: unloaded when idle or under memory pressure and
+ * loaded again on the next request.
+ *
+ * All inference runs on one dedicated thread (see InferenceQueue). The async
+ * calls never block; the synchronous one waits for its turn on that thread.
+ * Files queued together (a burst of received images) are scored in batches
+ * of up to kMaxBatch per model run.
+ * Image files are scored at most once per model: verdicts are cached by
+ * content hash in memory and in DatabaseService.
+ */
+class NSFWDetector : public core::interfaces::I_Accelerator {
 public:
     static NSFWDetector* instance();
 
+    /**
+     * @brief Never blocks; the first call starts picking the backend in the background
+     *
+     * Requests submitted while Pending wait for it on the inference thread.
+     */
+    BackendAvailability availability() const;
+
+    /**
+     * @brief availability() == Available
+     */
     bool isAvailable() const;
 
+    /**
+     * @brief Pick the backend on this thread if that has not happened yet (not the GUI thread)
+     */
+    bool waitForBackend() const;
+
+    /**
+     * @brief Blocking variant of predictAsync()
+     */
     std::optional<float> predictNsfwProbability(const QString& imagePath) const;
 
+    /**
+     * @brief Score an image file on the inference thread
+     *
+     * Concurrent requests for the same path share one run. The future holds
+     * std::nullopt if detection failed, was cancelled or the queue was full.
+     */
+    InferenceQueue::Ticket predictAsync(const QString& imagePath) const;
+
+    /**
+     * @brief Score an image file and call back on context's thread
+     * @return Request id for cancel(), 0 if the queue was full (no callback then)
+     */
+    quint64 predictAsync(const QString& imagePath,
+                         QObject* context,
+                         std::function<void(std::optional<float>)> callback) const;
+
+    void cancel(quint64 requestId) const;
+
+    /**
+     * @brief backendKindName() of the selected backend, "null" without one or while Pending
+     */
+    const char* backendName() const;
+
+    NsfwVerdictCache::Stats verdictCacheStats() const;
+
+    // I_Accelerator
+    bool initialize() override;
+    std::future<float> runInferenceAsync(const std::vector<uint8_t>& imageData, int width, int height) override;
+    std::string getAcceleratorName() const override;
+
+    static constexpr std::size_t kMaxBatch = 8;
+
 private:
+    class ImageJob;
+
+    /**
+     * @brief images/s for one batch size, averaged over every run of that size
+     */
+    struct BatchThroughput {
+        uint64_t images{0};
+        double ms{0.0};
+    };
+
     NSFWDetector();
+    ~NSFWDetector() override;
+
+    std::vector<InferenceQueue::Result> runBatch(const std::vector<InferenceQueue::BatchItem*>& items) const;
+    std::optional<float> predictImage(const QImage& image) const;
+    std::vector<InferenceQueue::Result> inferImages(const std::vector<QImage>& images) const;
+    void selectBackend() const;
+    std::unique_ptr<NsfwBackend> loadBackend() const;
+    std::string modelVersion() const;
+    void loadVerdicts() const;
+
+    mutable std::once_flag m_backendSelected;
+    mutable std::atomic<bool> m_selectionStarted{false};
+    mutable std::atomic<bool> m_backendResolved{false};    ///< Set by loadBackend() once the kind is picked
+    mutable bool m_backendChosen{false};    ///< Only touched by loadBackend()
+    mutable std::atomic<BackendKind> m_backendKind{BackendKind::Null};
+    mutable QString m_modelFile;            ///< Written before m_backendResolved
+    mutable ResidentModel<NsfwBackend> m_model{"nsfw"};
+    mutable NsfwVerdictCache m_verdicts;
+    mutable std::atomic<bool> m_verdictsLoaded{false};
+    mutable std::array<BatchThroughput, kMaxBatch + 1> m_batchThroughput;  ///< Inference thread only
+    mutable InferenceQueue m_queue;
 };
 
 } // namespace ai
@@ -0,0 +1,274 @@
+#include "NsfwPreprocess.h"
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define FLYKYLIN_PREPROCESS_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define FLYKYLIN_PREPROCESS_SSE2 1
+#endif
+
+namespace flykylin {
+namespace ai {
+
+namespace {
+
+template <PixelLayout Pixels>
+inline void loadBgr(const uint8_t* line, int px, unsigned bgr[3])
+{
+    if (Pixels == PixelLayout::Xrgb32) {
+        uint32_t value;
+        std::memcpy(&value, line + static_cast<std::ptrdiff_t>(px) * 4, sizeof(value));
+        bgr[0] = value & 0xffu;
+        bgr[1] = (value >> 8) & 0xffu;
+        bgr[2] = (value >> 16) & 0xffu;
+    } else {
+        const uint8_t* pixel = line + static_cast<std::ptrdiff_t>(px) * 3;
+        bgr[0] = pixel[2];
+        bgr[1] = pixel[1];
+        bgr[2] = pixel[0];
+    }
+}
+
+// Tensor rows [row0, row1) x columns [col0, col1), one pixel at a time
+template <PixelLayout Pixels, TensorLayout Layout>
+void preprocessRegion(const ImageView& image, int x, int y, int width, int height,
+                      const float meanBgr[3], float* out,
+                      int row0, int row1, int col0, int col1)
+{
+    const std::size_t w = static_cast<std::size_t>(width);
+    const std::size_t h = static_cast<std::size_t>(height);
+    for (int row = row0; row < row1; ++row) {
+        const uint8_t* line = image.pixels + static_cast<std::ptrdiff_t>(y + row) * image.bytesPerLine;
+        const std::size_t r = static_cast<std::size_t>(row);
+        for (int col = col0; col < col1; ++col) {
+            unsigned bgr[3];
+            loadBgr<Pixels>(line, x + col, bgr);
+            const std::size_t k = static_cast<std::size_t>(col);
+            if (Layout == TensorLayout::Hwc) {
+                float* pixel = out + (r * w + k) * 3;
+                pixel[0] = static_cast<float>(bgr[0]) - meanBgr[0];
+                pixel[1] = static_cast<float>(bgr[1]) - meanBgr[1];
+                pixel[2] = static_cast<float>(bgr[2]) - meanBgr[2];
+            } else {
+                float* column = out + k * 3 * h + r;
+                column[0] = static_cast<float>(bgr[0]) - meanBgr[0];
+                column[h] = static_cast<float>(bgr[1]) - meanBgr[1];
+                column[2 * h] = static_cast<float>(bgr[2]) - meanBgr[2];
+            }
+        }
+    }
+}
+
+void preprocessRegion(const ImageView& image, int x, int y, int width, int height,
+                      const float meanBgr[3], TensorLayout layout, float* out,
+                      int row0, int row1, int col0, int col1)
+{
+    if (image.layout == PixelLayout::Xrgb32) {
+        if (layout == TensorLayout::Hwc) {
+            preprocessRegion<PixelLayout::Xrgb32, TensorLayout::Hwc>(image, x, y, width, height, meanBgr, out,
+                                                                     row0, row1, col0, col1);
+        } else {
+            preprocessRegion<PixelLayout::Xrgb32, TensorLayout::Wch>(image, x, y, width, height, meanBgr, out,
+                                                                     row0, row1, col0, col1);
+        }
+    } else if (layout == TensorLayout::Hwc) {
+        preprocessRegion<PixelLayout::Rgb888, TensorLayout::Hwc>(image, x, y, width, height, meanBgr, out,
+                                                                 row0, row1, col0, col1);
+    } else {
+        preprocessRegion<PixelLayout::Rgb888, TensorLayout::Wch>(image, x, y, width, height, meanBgr, out,
+                                                                 row0, row1, col0, col1);
+    }
+}
+
+inline const uint8_t* xrgbAt(const ImageView& image, int px, int py)
+{
+    return image.pixels + static_cast<std::ptrdiff_t>(py) * image.bytesPerLine
+            + static_cast<std::ptrdiff_t>(px) * 4;
+}
+
+#if defined(FLYKYLIN_PREPROCESS_NEON)
+
+inline void transpose4(float32x4_t& a, float32x4_t& b, float32x4_t& c, float32x4_t& d)
+{
+    const float32x4x2_t ab = vtrnq_f32(a, b);
+    const float32x4x2_t cd = vtrnq_f32(c, d);
+    a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+    b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+    c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+    d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+
+inline void widen(uint8x16_t bytes, float32x4_t out[4])
+{
+    const uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+    const uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+    out[0] = vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo)));
+    out[1] = vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo)));
+    out[2] = vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi)));
+    out[3] = vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi)));
+}
+
+// 16 pixels of one row: de-interleave on load, re-interleave BGR floats on store
+int preprocessHwcSimd(const ImageView& image, int x, int y, int width, int height,
+                      const float meanBgr[3], float* out)
+{
+    const int simdWidth = width & ~15;
+    const float32x4_t meanB = vdupq_n_f32(meanBgr[0]);
+    const float32x4_t meanG = vdupq_n_f32(meanBgr[1]);
+    const float32x4_t meanR = vdupq_n_f32(meanBgr[2]);
+    for (int row = 0; row < height; ++row) {
+        float* dst = out + static_cast<std::size_t>(row) * static_cast<std::size_t>(width) * 3;
+        for (int col = 0; col < simdWidth; col += 16) {
+            const uint8x16x4_t pixels = vld4q_u8(xrgbAt(image, x + col, y + row));
+            float32x4_t b[4], g[4], r[4];
+            widen(pixels.val[0], b);
+            widen(pixels.val[1], g);
+            widen(pixels.val[2], r);
+            for (int k = 0; k < 4; ++k) {
+                float32x4x3_t bgr;
+                bgr.val[0] = vsubq_f32(b[k], meanB);
+                bgr.val[1] = vsubq_f32(g[k], meanG);
+                bgr.val[2] = vsubq_f32(r[k], meanR);
+                vst3q_f32(dst + static_cast<std::size_t>(col + 4 * k) * 3, bgr);
+            }
+        }
+    }
+    return simdWidth;
+}
+
+// 4x4 pixel blocks: channels split per row, then transposed so rows become contiguous
+void preprocessWchBlock(const ImageView& image, int px, int py, int height,
+                        const float meanBgr[3], float* out)
+{
+    const uint32x4_t mask = vdupq_n_u32(0xffu);
+    float32x4_t b[4], g[4], r[4];
+    for (int k = 0; k < 4; ++k) {
+        const uint32x4_t p = vreinterpretq_u32_u8(vld1q_u8(xrgbAt(image, px, py + k)));
+        b[k] = vcvtq_f32_u32(vandq_u32(p, mask));
+        g[k] = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(p, 8), mask));
+        r[k] = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(p, 16), mask));
+    }
+    transpose4(b[0], b[1], b[2], b[3]);
+    transpose4(g[0], g[1], g[2], g[3]);
+    transpose4(r[0], r[1], r[2], r[3]);
+
+    const std::size_t h = static_cast<std::size_t>(height);
+    const float32x4_t meanB = vdupq_n_f32(meanBgr[0]);
+    const float32x4_t meanG = vdupq_n_f32(meanBgr[1]);
+    const float32x4_t meanR = vdupq_n_f32(meanBgr[2]);
+    for (int k = 0; k < 4; ++k) {
+        float* column = out + static_cast<std::size_t>(k) * 3 * h;
+        vst1q_f32(column, vsubq_f32(b[k], meanB));
+        vst1q_f32(column + h, vsubq_f32(g[k], meanG));
+        vst1q_f32(column + 2 * h, vsubq_f32(r[k], meanR));
+    }
+}
+
+#elif defined(FLYKYLIN_PREPROCESS_SSE2)
+
+// 4 pixels of one row: widen BGRA bytes, then shuffle the alpha lanes out
+int preprocessHwcSimd(const ImageView& image, int x, int y, int width, int height,
+                      const float meanBgr[3], float* out)
+{
+    const int simdWidth = width & ~3;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 mean = _mm_setr_ps(meanBgr[0], meanBgr[1], meanBgr[2], 0.0f);
+    for (int row = 0; row < height; ++row) {
+        float* dst = out + static_cast<std::size_t>(row) * static_cast<std::size_t>(width) * 3;
+        for (int col = 0; col < simdWidth; col += 4) {
+            const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xrgbAt(image, x + col, y + row)));
+            const __m128i lo = _mm_unpacklo_epi8(p, zero);
+            const __m128i hi = _mm_unpackhi_epi8(p, zero);
+            const __m128 f0 = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), mean);
+            const __m128 f1 = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), mean);
+            const __m128 f2 = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), mean);
+            const __m128 f3 = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), mean);
+
+            // [B0 G0 R0 B1] [G1 R1 B2 G2] [R2 B3 G3 R3]
+            const __m128 t0 = _mm_shuffle_ps(f0, f1, _MM_SHUFFLE(0, 0, 2, 2));
+            const __m128 v0 = _mm_shuffle_ps(f0, t0, _MM_SHUFFLE(2, 0, 1, 0));
+            const __m128 v1 = _mm_shuffle_ps(f1, f2, _MM_SHUFFLE(1, 0, 2, 1));
+            const __m128 t2 = _mm_shuffle_ps(f2, f3, _MM_SHUFFLE(0, 0, 2, 2));
+            const __m128 v2 = _mm_shuffle_ps(t2, f3, _MM_SHUFFLE(2, 1, 2, 0));
+
+            float* pixel = dst + static_cast<std::size_t>(col) * 3;
+            _mm_storeu_ps(pixel, v0);
+            _mm_storeu_ps(pixel + 4, v1);
+            _mm_storeu_ps(pixel + 8, v2);
+        }
+    }
+    return simdWidth;
+}
+
+// 4x4 pixel blocks: channels split per row, then transposed so rows become contiguous
+void preprocessWchBlock(const ImageView& image, int px, int py, int height,
+                        const float meanBgr[3], float* out)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    __m128 b[4], g[4], r[4];
+    for (int k = 0; k < 4; ++k) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xrgbAt(image, px, py + k)));
+        b[k] = _mm_cvtepi32_ps(_mm_and_si128(p, mask));
+        g[k] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 8), mask));
+        r[k] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 16), mask));
+    }
+    _MM_TRANSPOSE4_PS(b[0], b[1], b[2], b[3]);
+    _MM_TRANSPOSE4_PS(g[0], g[1], g[2], g[3]);
+    _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+
+    const std::size_t h = static_cast<std::size_t>(height);
+    const __m128 meanB = _mm_set1_ps(meanBgr[0]);
+    const __m128 meanG = _mm_set1_ps(meanBgr[1]);
+    const __m128 meanR = _mm_set1_ps(meanBgr[2]);
+    for (int k = 0; k < 4; ++k) {
+        float* column = out + static_cast<std::size_t>(k) * 3 * h;
+        _mm_storeu_ps(column, _mm_sub_ps(b[k], meanB));
+        _mm_storeu_ps(column + h, _mm_sub_ps(g[k], meanG));
+        _mm_storeu_ps(column + 2 * h, _mm_sub_ps(r[k], meanR));
+    }
+}
+
+#endif
+
+} // namespace
+
+void preprocessBgrScalar(const ImageView& image, int x, int y, int width, int height,
+                         const float meanBgr[3], TensorLayout layout, float* out)
+{
+    preprocessRegion(image, x, y, width, height, meanBgr, layout, out, 0, height, 0, width);
+}
+
+void preprocessBgr(const ImageView& image, int x, int y, int width, int height,
+                   const float meanBgr[3], TensorLayout layout, float* out)
+{
+#if defined(FLYKYLIN_PREPROCESS_NEON) || defined(FLYKYLIN_PREPROCESS_SSE2)
+    if (image.layout == PixelLayout::Xrgb32) {
+        if (layout == TensorLayout::Hwc) {
+            const int done = preprocessHwcSimd(image, x, y, width, height, meanBgr, out);
+            preprocessRegion(image, x, y, width, height, meanBgr, layout, out, 0, height, done, width);
+            return;
+        }
+
+        const int blockRows = height & ~3;
+        const int blockCols = width & ~3;
+        const std::size_t h = static_cast<std::size_t>(height);
+        for (int row = 0; row < blockRows; row += 4) {
+            for (int col = 0; col < blockCols; col += 4) {
+                preprocessWchBlock(image, x + col, y + row, height, meanBgr,
+                                   out + static_cast<std::size_t>(col) * 3 * h + static_cast<std::size_t>(row));
+            }
+        }
+        preprocessRegion(image, x, y, width, height, meanBgr, layout, out, 0, blockRows, blockCols, width);
+        preprocessRegion(image, x, y, width, height, meanBgr, layout, out, blockRows, height, 0, width);
+        return;
+    }
+#endif
+    preprocessBgrScalar(image, x, y, width, height, meanBgr, layout, out);
+}
+
+} // namespace ai
+} // namespace flykylin
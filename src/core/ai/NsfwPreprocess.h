@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+namespace flykylin {
+namespace ai {
+
+/**
+ * @brief Pixel formats the NSFW tensor kernel reads directly
+ */
+enum class PixelLayout {
+    Xrgb32,     ///< QImage::Format_RGB32: one 0xffRRGGBB word per pixel (alpha ignored)
+    Rgb888      ///< QImage::Format_RGB888: R, G, B bytes
+};
+
+/**
+ * @brief Float tensor layouts of the open_nsfw models
+ */
+enum class TensorLayout {
+    Hwc,        ///< [H][W][BGR] (ONNX, NHWC)
+    Wch         ///< [W][BGR][H] (RKNN conversion of the same model)
+};
+
+struct ImageView {
+    const uint8_t* pixels{nullptr};
+    int bytesPerLine{0};
+    PixelLayout layout{PixelLayout::Xrgb32};
+};
+
+/**
+ * @brief Crop, swap to BGR, subtract the channel means and lay out a float tensor in one pass
+ *
+ * Reads the width x height window at (x, y) of an already resized image and
+ * writes width * height * 3 floats to out. Uses NEON or SSE2 where available;
+ * every path produces exactly preprocessBgrScalar()'s output.
+ */
+void preprocessBgr(const ImageView& image, int x, int y, int width, int height,
+                   const float meanBgr[3], TensorLayout layout, float* out);
+
+/**
+ * @brief Portable reference for preprocessBgr()
+ */
+void preprocessBgrScalar(const ImageView& image, int x, int y, int width, int height,
+                         const float meanBgr[3], TensorLayout layout, float* out);
+
+} // namespace ai
+} // namespace flykylin
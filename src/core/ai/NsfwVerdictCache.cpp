@@ -0,0 +1,62 @@
+#include "NsfwVerdictCache.h"
+
+#include <algorithm>
+
+namespace flykylin {
+namespace ai {
+
+NsfwVerdictCache::NsfwVerdictCache(std::size_t capacity)
+    : m_capacity(std::max<std::size_t>(capacity, 1))
+{
+}
+
+std::optional<float> NsfwVerdictCache::find(const std::string& contentHash, const std::string& modelVersion)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(makeKey(contentHash, modelVersion));
+    if (it == m_index.end()) {
+        ++m_misses;
+        return std::nullopt;
+    }
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->second;
+}
+
+void NsfwVerdictCache::insert(const std::string& contentHash, const std::string& modelVersion, float probability)
+{
+    std::string key = makeKey(contentHash, modelVersion);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        it->second->second = probability;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return;
+    }
+
+    m_entries.emplace_front(std::move(key), probability);
+    m_index.emplace(m_entries.front().first, m_entries.begin());
+    if (m_entries.size() > m_capacity) {
+        m_index.erase(m_entries.back().first);
+        m_entries.pop_back();
+    }
+}
+
+NsfwVerdictCache::Stats NsfwVerdictCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.entries = m_entries.size();
+    return stats;
+}
+
+std::string NsfwVerdictCache::makeKey(const std::string& contentHash, const std::string& modelVersion)
+{
+    // Hashes are hex, so the separator cannot occur inside one
+    return contentHash + '/' + modelVersion;
+}
+
+} // namespace ai
+} // namespace flykylin
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace flykylin {
+namespace ai {
+
+/**
+ * @brief In-memory LRU of NSFW probabilities keyed by content hash + model version
+ *
+ * The same sticker or relayed image is scored once per model; a new model
+ * version never sees the old one's verdicts. Thread-safe: looked up on the
+ * inference thread, filled from the database on the GUI thread.
+ */
+class NsfwVerdictCache {
+public:
+    struct Stats {
+        uint64_t hits{0};
+        uint64_t misses{0};
+        std::size_t entries{0};
+
+        double hitRate() const
+        {
+            const uint64_t lookups = hits + misses;
+            return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+        }
+    };
+
+    explicit NsfwVerdictCache(std::size_t capacity = kDefaultCapacity);
+
+    /**
+     * @brief Look up a verdict (counts towards the hit rate)
+     */
+    std::optional<float> find(const std::string& contentHash, const std::string& modelVersion);
+
+    /**
+     * @brief Add or refresh a verdict as the most recently used
+     */
+    void insert(const std::string& contentHash, const std::string& modelVersion, float probability);
+
+    Stats stats() const;
+
+    static constexpr std::size_t kDefaultCapacity = 4096;
+
+private:
+    using Entry = std::pair<std::string, float>;
+
+    static std::string makeKey(const std::string& contentHash, const std::string& modelVersion);
+
+    mutable std::mutex m_mutex;
+    std::list<Entry> m_entries;     ///< Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+    std::size_t m_capacity;
+    uint64_t m_hits{0};
+    uint64_t m_misses{0};
+};
+
+} // namespace ai
+} // namespace flykylin
@@ -0,0 +1,229 @@
+#include "OnnxRuntime.h"
+
+#ifdef FLYKYLIN_ONNXRUNTIME_COMPILED
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QThread>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace flykylin {
+namespace ai {
+
+namespace {
+
+GraphOptimizationLevel optimizationFromName(const QString& name)
+{
+    if (name == QLatin1String("disable")) {
+        return ORT_DISABLE_ALL;
+    }
+    if (name == QLatin1String("basic")) {
+        return ORT_ENABLE_BASIC;
+    }
+    if (name == QLatin1String("extended")) {
+        return ORT_ENABLE_EXTENDED;
+    }
+    return ORT_ENABLE_ALL;
+}
+
+QString optimizationName(GraphOptimizationLevel level)
+{
+    switch (level) {
+    case ORT_DISABLE_ALL:
+        return QStringLiteral("disable");
+    case ORT_ENABLE_BASIC:
+        return QStringLiteral("basic");
+    case ORT_ENABLE_EXTENDED:
+        return QStringLiteral("extended");
+    default:
+        return QStringLiteral("all");
+    }
+}
+
+std::basic_string<ORTCHAR_T> ortPath(const QString& path)
+{
+#ifdef _WIN32
+    return path.toStdWString();
+#else
+    return path.toUtf8().toStdString();
+#endif
+}
+
+const OnnxOptions& currentOptions()
+{
+    static const OnnxOptions options = OnnxOptions::fromSettings();
+    return options;
+}
+
+// Anything that changes the optimized graph is part of the name
+QString optimizedModelPath(const QString& modelPath, const OnnxOptions& options)
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/onnx");
+    if (!QDir().mkpath(dir)) {
+        return QString();
+    }
+    const QFileInfo info(modelPath);
+    return QStringLiteral("%1/%2-%3-%4-%5-ort%6.onnx")
+        .arg(dir, info.completeBaseName())
+        .arg(info.size())
+        .arg(info.lastModified().toMSecsSinceEpoch())
+        .arg(optimizationName(options.optimization), QString::fromStdString(Ort::GetVersionString()));
+}
+
+Ort::SessionOptions baseSessionOptions(const OnnxOptions& options)
+{
+    Ort::SessionOptions session;
+    session.DisablePerSessionThreads();     // Run on the environment's global pool
+    session.SetExecutionMode(ORT_SEQUENTIAL);
+    if (options.cpuMemArena) {
+        session.EnableCpuMemArena();
+    } else {
+        session.DisableCpuMemArena();
+    }
+    if (options.memPattern) {
+        session.EnableMemPattern();
+    } else {
+        session.DisableMemPattern();
+    }
+    return session;
+}
+
+/**
+ * @brief A session plus the mapped external-data files its initializers point into
+ */
+struct MappedSession {
+    std::vector<std::unique_ptr<QFile>> weights;
+    Ort::Session session{nullptr};  // Declared last, destroyed first
+};
+
+// Sidecar names the exporters use; the location stored in the model is the bare file name
+void mapExternalData(const QString& modelPath, Ort::SessionOptions& sessionOptions, MappedSession& loaded)
+{
+    const QFileInfo info(modelPath);
+    const QStringList sidecars = {info.fileName() + QStringLiteral(".data"),
+                                  info.completeBaseName() + QStringLiteral(".data"),
+                                  info.completeBaseName() + QStringLiteral(".onnx_data")};
+    std::vector<std::basic_string<ORTCHAR_T>> names;
+    std::vector<char*> buffers;
+    std::vector<size_t> lengths;
+    for (const QString& name : sidecars) {
+        auto file = std::make_unique<QFile>(info.dir().filePath(name));
+        if (!file->exists() || !file->open(QIODevice::ReadOnly) || file->size() <= 0) {
+            continue;
+        }
+        uchar* bytes = file->map(0, file->size());
+        if (!bytes) {
+            continue;   // ONNX Runtime reads it from disk itself
+        }
+        names.push_back(ortPath(name));
+        buffers.push_back(reinterpret_cast<char*>(bytes));
+        lengths.push_back(static_cast<size_t>(file->size()));
+        loaded.weights.push_back(std::move(file));
+    }
+    if (!names.empty()) {
+        sessionOptions.AddExternalInitializersFromFilesInMemory(names, buffers, lengths);
+    }
+}
+
+std::shared_ptr<Ort::Session> openSession(const Ort::Env& env, const QString& path, Ort::SessionOptions& sessionOptions)
+{
+    auto loaded = std::make_shared<MappedSession>();
+    mapExternalData(path, sessionOptions, *loaded);
+
+    QFile model(path);
+    uchar* bytes = model.open(QIODevice::ReadOnly) ? model.map(0, model.size()) : nullptr;
+    if (bytes) {
+        // Parsed into the session's own graph; the mapping closes with the file below
+        loaded->session = Ort::Session(env, bytes, static_cast<size_t>(model.size()), sessionOptions);
+    } else {
+        loaded->session = Ort::Session(env, ortPath(path).c_str(), sessionOptions);
+    }
+    return std::shared_ptr<Ort::Session>(loaded, &loaded->session);
+}
+
+} // namespace
+
+OnnxOptions OnnxOptions::fromSettings()
+{
+    QSettings settings("FlyKylin", "FlyKylin");
+    OnnxOptions options;
+    options.intraOpThreads = settings.value("ai/onnx/intraOpThreads", 0).toInt();
+    if (options.intraOpThreads <= 0) {
+        // Leave the other half to the UI and whatever else the user runs
+        options.intraOpThreads = std::max(1, QThread::idealThreadCount() / 2);
+    }
+    options.interOpThreads = std::max(1, settings.value("ai/onnx/interOpThreads", 1).toInt());
+    options.optimization = optimizationFromName(settings.value("ai/onnx/graphOptimization", "all").toString());
+    options.cacheOptimizedModel = settings.value("ai/onnx/cacheOptimizedModel", true).toBool();
+    options.cpuMemArena = settings.value("ai/onnx/cpuMemArena", true).toBool();
+    options.memPattern = settings.value("ai/onnx/memPattern", true).toBool();
+    return options;
+}
+
+std::shared_ptr<Ort::Env> sharedOrtEnv()
+{
+    static const std::shared_ptr<Ort::Env> env = []() {
+        const OnnxOptions& options = currentOptions();
+        Ort::ThreadingOptions threading;
+        threading.SetGlobalIntraOpNumThreads(options.intraOpThreads);
+        threading.SetGlobalInterOpNumThreads(options.interOpThreads);
+        threading.SetGlobalSpinControl(0);  // Idle workers sleep instead of burning a core
+        auto created = std::make_shared<Ort::Env>(threading, ORT_LOGGING_LEVEL_WARNING, "FlyKylin");
+        qInfo() << "[OnnxRuntime] Environment created, intra-op threads =" << options.intraOpThreads
+                << "inter-op threads =" << options.interOpThreads
+                << "optimization =" << optimizationName(options.optimization);
+        return created;
+    }();
+    return env;
+}
+
+std::shared_ptr<Ort::Session> createOnnxSession(const QString& modelPath)
+{
+    const std::shared_ptr<Ort::Env> env = sharedOrtEnv();
+    const OnnxOptions& options = currentOptions();
+    QElapsedTimer timer;
+    timer.start();
+
+    QString cachePath;
+    if (options.cacheOptimizedModel && options.optimization != ORT_DISABLE_ALL) {
+        cachePath = optimizedModelPath(modelPath, options);
+    }
+    if (!cachePath.isEmpty() && QFile::exists(cachePath)) {
+        try {
+            Ort::SessionOptions sessionOptions = baseSessionOptions(options);
+            sessionOptions.SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+            auto session = openSession(*env, cachePath, sessionOptions);
+            qInfo() << "[OnnxRuntime] Loaded optimized" << QFileInfo(modelPath).fileName() << "from cache in"
+                    << timer.elapsed() << "ms";
+            return session;
+        } catch (const Ort::Exception& ex) {
+            qWarning() << "[OnnxRuntime] Dropping unusable optimized model" << cachePath << ex.what();
+            QFile::remove(cachePath);
+        }
+    }
+
+    Ort::SessionOptions sessionOptions = baseSessionOptions(options);
+    sessionOptions.SetGraphOptimizationLevel(options.optimization);
+    if (!cachePath.isEmpty()) {
+        sessionOptions.SetOptimizedModelFilePath(ortPath(cachePath).c_str());
+    }
+    auto session = openSession(*env, modelPath, sessionOptions);
+    qInfo() << "[OnnxRuntime] Loaded" << QFileInfo(modelPath).fileName() << "in" << timer.elapsed() << "ms"
+            << (cachePath.isEmpty() ? "" : "(optimized copy cached)");
+    return session;
+}
+
+} // namespace ai
+} // namespace flykylin
+
+#endif // FLYKYLIN_ONNXRUNTIME_COMPILED
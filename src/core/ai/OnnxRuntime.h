@@ -0,0 +1,66 @@
+#pragma once
+
+#if defined(FLYKYLIN_ENABLE_ONNXRUNTIME)
+#  if __has_include(<onnxruntime_cxx_api.h>)
+#    include <onnxruntime_cxx_api.h>
+#    define FLYKYLIN_ONNXRUNTIME_COMPILED 1
+#  else
+#    pragma message("onnxruntime_cxx_api.h not found, building without ONNX backends")
+#  endif
+#endif
+
+#ifdef FLYKYLIN_ONNXRUNTIME_COMPILED
+
+#include <QString>
+#include <memory>
+
+namespace flykylin {
+namespace ai {
+
+/**
+ * @brief ONNX Runtime settings shared by every model (QSettings ai/onnx/...)
+ */
+struct OnnxOptions {
+    int intraOpThreads{0};      ///< ai/onnx/intraOpThreads, 0 = half the cores
+    int interOpThreads{1};      ///< ai/onnx/interOpThreads
+    GraphOptimizationLevel optimization{ORT_ENABLE_ALL};   ///< ai/onnx/graphOptimization: disable/basic/extended/all
+    bool cacheOptimizedModel{true};     ///< ai/onnx/cacheOptimizedModel
+    bool cpuMemArena{true};     ///< ai/onnx/cpuMemArena
+    bool memPattern{true};      ///< ai/onnx/memPattern
+
+    static OnnxOptions fromSettings();
+};
+
+/**
+ * @brief The process-wide Ort::Env with one global intra/inter-op thread pool
+ *
+ * Created on first use from OnnxOptions::fromSettings(). Sessions keep the
+ * pointer so the environment outlives them whatever the static
+ * destruction order.
+ */
+std::shared_ptr<Ort::Env> sharedOrtEnv();
+
+/**
+ * @brief Session on the shared environment and thread pool
+ *
+ * The model is read through a memory mapping handed to ONNX Runtime as a
+ * byte array, so it is never copied into a heap buffer; the mapping is
+ * dropped as soon as the session is built. External-data files next to the
+ * model (model.onnx.data, model.data, model.onnx_data) are mapped too and
+ * stay mapped for the session's lifetime, its initializers reading from
+ * them directly.
+ *
+ * With cacheOptimizedModel the graph-optimized model is saved in the cache
+ * directory on the first load; later loads read it with optimization off.
+ * The cache entry is keyed by the model file's name, size and mtime, the
+ * optimization level and the runtime version, and is dropped if it fails
+ * to load.
+ *
+ * @throws Ort::Exception if the model cannot be loaded
+ */
+std::shared_ptr<Ort::Session> createOnnxSession(const QString& modelPath);
+
+} // namespace ai
+} // namespace flykylin
+
+#endif // FLYKYLIN_ONNXRUNTIME_COMPILED
@@ -1,23 +1,21 @@
 #include "TextEmbeddingEngine.h"
 
+#include "OnnxRuntime.h"
+
 #include <QCoreApplication>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QStringList>
 #include <QTextStream>
 
-#if defined(FLYKYLIN_ENABLE_ONNXRUNTIME)
-#  if __has_include(<onnxruntime_cxx_api.h>)
-#    include <onnxruntime_cxx_api.h>
-#    include <memory>
-#    include <string>
-#    include <unordered_map>
-#    include <vector>
-#    define FLYKYLIN_ONNXRUNTIME_COMPILED 1
-#  else
-#    pragma message("onnxruntime_cxx_api.h not found, building without ONNX backend")
-#  endif
-#endif
+#include <memory>
+#include <string>
+#include <vector>
+
 
 #if defined(RK3566_PLATFORM) && defined(FLYKYLIN_ENABLE_RKNN)
 #  if __has_include(<rknn_api.h>)
@@ -32,9 +30,26 @@
 namespace flykylin {
 namespace ai {
 
+/**
+ * @brief One way of running the embedding model; see embeddingBackends()
+ */
+class EmbeddingBackend {
+public:
+    virtual ~EmbeddingBackend() = default;
+
+    /**
+     * @return Empty on failure
+     */
+    virtual std::vector<float> embed(const QString& text) = 0;
+
+    int dim{0};
+    QString modelFile;
+};
+
 namespace {
 
-#ifdef FLYKYLIN_ONNXRUNTIME_COMPILED
+#if defined(FLYKYLIN_ONNXRUNTIME_COMPILED) || defined(FLYKYLIN_RKNN_EMBEDDING_COMPILED)
+// Character-level BGE tokenizer shared by every backend
 class BgeTokenizer {
 public:
     BgeTokenizer()
@@ -46,11 +61,29 @@ public:
     {
         QString appDir = QCoreApplication::applicationDirPath();
         QDir dir(appDir);
-        QString vocabPath = dir.filePath("models/text-embedding-vocab.txt");
+        
+        // Try multiple vocab file locations
+        QStringList vocabCandidates;
+        vocabCandidates << dir.filePath("models/text-embedding-vocab.txt")
+                        << dir.filePath("models/vocab.txt")
+                        << QStringLiteral("/home/kylin/FlyKylinApp/bin/models/vocab.txt");
+        
+        QString vocabPath;
+        for (const QString& candidate : vocabCandidates) {
+            if (QFile::exists(candidate)) {
+                vocabPath = candidate;
+                break;
+            }
+        }
+        
+        if (vocabPath.isEmpty()) {
+            qWarning() << "[TextEmbeddingEngine] BGE vocab not found";
+            return;
+        }
 
         QFile file(vocabPath);
         if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            qWarning() << "[TextEmbeddingEngine] BGE vocab not found at" << vocabPath;
+            qWarning() << "[TextEmbeddingEngine] Failed to open vocab file" << vocabPath;
             return;
         }
 
@@ -77,17 +110,16 @@ public:
         }
 
         if (m_clsId < 0 || m_sepId < 0 || m_padId < 0 || m_unkId < 0) {
-            qWarning() << "[TextEmbeddingEngine] BGE vocab missing required special tokens";
+            qWarning() << "[TextEmbeddingEngine] BGE vocab missing special tokens";
             return;
         }
 
         m_loaded = true;
+        qInfo() << "[TextEmbeddingEngine] BGE tokenizer loaded from" << vocabPath
+                << "vocab size:" << m_tokenToId.size();
     }
 
-    bool isLoaded() const
-    {
-        return m_loaded;
-    }
+    bool isLoaded() const { return m_loaded; }
 
     void encode(const QString& text,
                 std::vector<int64_t>& inputIds,
@@ -103,7 +135,6 @@ public:
 
         std::vector<int64_t> tokens;
         tokens.reserve(static_cast<std::size_t>(maxLength));
-
         tokens.push_back(m_clsId);
 
         const int textLen = text.size();
@@ -134,10 +165,8 @@ public:
         attentionMask.assign(inputIds.size(), 1);
 
         if (static_cast<int>(inputIds.size()) < maxLength) {
-            const int padStart = static_cast<int>(inputIds.size());
             inputIds.resize(static_cast<std::size_t>(maxLength), m_padId);
             attentionMask.resize(static_cast<std::size_t>(maxLength), 0);
-            Q_UNUSED(padStart);
         }
     }
 
@@ -156,40 +185,19 @@ BgeTokenizer& bgeTokenizer()
     return tokenizer;
 }
 
-class OnnxEmbeddingContext {
+#endif
+
+#ifdef FLYKYLIN_ONNXRUNTIME_COMPILED
+class OnnxEmbeddingBackend : public EmbeddingBackend {
 public:
-    OnnxEmbeddingContext()
+    explicit OnnxEmbeddingBackend(const QString& modelPath)
         : available(false)
-        , dim(0)
         , inputSize(0)
     {
-        QString appDir = QCoreApplication::applicationDirPath();
-        QDir dir(appDir);
-        QString modelPath = dir.filePath("models/text-embedding.onnx");
-
-        if (modelPath.isEmpty()) {
-            return;
-        }
-
         try {
-            env = std::make_unique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "FlyKylinTextEmbed");
-            Ort::SessionOptions options;
-
-            const ORTCHAR_T* ortPath = nullptr;
-#ifdef _WIN32
-            std::wstring wpath = modelPath.toStdWString();
-            ortPath = wpath.c_str();
-#else
-            QByteArray utf8 = modelPath.toUtf8();
-            std::string path =
-                std::string(utf8.constData(), static_cast<std::size_t>(utf8.size()));
-            if (path.empty()) {
-                return;
-            }
-            ortPath = path.c_str();
-#endif
-
-            session = std::make_unique<Ort::Session>(*env, ortPath, options);
+            // Shared environment, thread pool and optimized-model cache
+            env = sharedOrtEnv();
+            session = createOnnxSession(modelPath);
 
             Ort::AllocatorWithDefaultOptions allocator;
 
@@ -249,168 +257,202 @@ public:
         }
     }
 
-    bool available;
-    int dim;
-    std::size_t inputSize;
-    std::unique_ptr<Ort::Env> env;
-    std::unique_ptr<Ort::Session> session;
-    std::string inputName;
-    std::string outputName;
-};
+    std::vector<float> embed(const QString& text) override
+    {
+        if (text.isEmpty()) {
+            return {};
+        }
 
-OnnxEmbeddingContext& onnxContext()
-{
-    static OnnxEmbeddingContext ctx;
-    return ctx;
-}
-#endif
+        try {
+            Ort::TypeInfo inputTypeInfo = session->GetInputTypeInfo(0);
+            auto inputTensorInfo = inputTypeInfo.GetTensorTypeAndShapeInfo();
+            ONNXTensorElementDataType elementType = inputTensorInfo.GetElementType();
+
+            if (elementType == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+                std::vector<float> inputData(inputSize, 0.0f);
+                QByteArray utf8 = text.toUtf8();
+                int len = utf8.size();
+                int maxLen = static_cast<int>(inputSize);
+                int copyLen = len < maxLen ? len : maxLen;
+                for (int i = 0; i < copyLen; ++i) {
+                    unsigned char ch = static_cast<unsigned char>(utf8.at(i));
+                    inputData[static_cast<std::size_t>(i)] = static_cast<float>(ch) / 255.0f;
+                }
 
-// ============================================================================
-// RKNN Backend for RK3566 Platform
-// ============================================================================
-#ifdef FLYKYLIN_RKNN_EMBEDDING_COMPILED
+                std::vector<int64_t> inputShape{1, static_cast<int64_t>(inputSize)};
 
-class RknnBgeTokenizer {
-public:
-    RknnBgeTokenizer()
-        : m_loaded(false)
-        , m_clsId(-1)
-        , m_sepId(-1)
-        , m_padId(-1)
-        , m_unkId(-1)
-    {
-        QString appDir = QCoreApplication::applicationDirPath();
-        QDir dir(appDir);
-        
-        // Try multiple vocab file locations
-        QStringList vocabCandidates;
-        vocabCandidates << dir.filePath("models/text-embedding-vocab.txt")
-                        << dir.filePath("models/vocab.txt")
-                        << QStringLiteral("/home/kylin/FlyKylinApp/bin/models/vocab.txt");
-        
-        QString vocabPath;
-        for (const QString& candidate : vocabCandidates) {
-            if (QFile::exists(candidate)) {
-                vocabPath = candidate;
-                break;
-            }
-        }
-        
-        if (vocabPath.isEmpty()) {
-            qWarning() << "[TextEmbeddingEngine] RKNN BGE vocab not found";
-            return;
-        }
+                Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+                Ort::Value inputTensor = Ort::Value::CreateTensor<float>(memInfo,
+                                                                         inputData.data(),
+                                                                         inputData.size(),
+                                                                         inputShape.data(),
+                                                                         inputShape.size());
 
-        QFile file(vocabPath);
-        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            qWarning() << "[TextEmbeddingEngine] Failed to open vocab file" << vocabPath;
-            return;
-        }
+                const char* inputNames[] = {inputName.c_str()};
+                const char* outputNames[] = {outputName.c_str()};
 
-        QTextStream in(&file);
-        int index = 0;
-        while (!in.atEnd()) {
-            const QString line = in.readLine().trimmed();
-            if (line.isEmpty()) {
-                continue;
-            }
+                std::vector<Ort::Value> outputs =
+                    session->Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames, 1);
 
-            m_tokenToId.insert(line, index);
-            if (line == QLatin1String("[CLS]")) {
-                m_clsId = index;
-            } else if (line == QLatin1String("[SEP]")) {
-                m_sepId = index;
-            } else if (line == QLatin1String("[PAD]")) {
-                m_padId = index;
-            } else if (line == QLatin1String("[UNK]")) {
-                m_unkId = index;
+                if (outputs.empty() || !outputs[0].IsTensor()) {
+                    return {};
+                }
+
+                float* outData = outputs[0].GetTensorMutableData<float>();
+                std::size_t outCount = static_cast<std::size_t>(dim);
+                std::vector<float> result(outCount);
+                for (std::size_t i = 0; i < outCount; ++i) {
+                    result[i] = outData[i];
+                }
+
+                return result;
             }
 
-            ++index;
-        }
+            if (elementType == ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64) {
+                BgeTokenizer& tokenizer = bgeTokenizer();
+                if (!tokenizer.isLoaded()) {
+                    qWarning() << "[TextEmbeddingEngine] BGE tokenizer not loaded; semantic embeddings disabled";
+                    return {};
+                }
 
-        if (m_clsId < 0 || m_sepId < 0 || m_padId < 0 || m_unkId < 0) {
-            qWarning() << "[TextEmbeddingEngine] RKNN BGE vocab missing special tokens";
-            return;
-        }
+                int maxLen = 128;
+                std::vector<int64_t> inputShape = inputTensorInfo.GetShape();
+                if (!inputShape.empty()) {
+                    if (inputShape.size() >= 2 && inputShape[1] > 0 && inputShape[1] <= 4096) {
+                        maxLen = static_cast<int>(inputShape[1]);
+                    } else if (inputShape[0] > 0 && inputShape[0] <= 4096) {
+                        maxLen = static_cast<int>(inputShape[0]);
+                    }
+                }
 
-        m_loaded = true;
-        qInfo() << "[TextEmbeddingEngine] RKNN BGE tokenizer loaded from" << vocabPath
-                << "vocab size:" << m_tokenToId.size();
-    }
+                std::vector<int64_t> inputIds;
+                std::vector<int64_t> attentionMask;
+                tokenizer.encode(text, inputIds, attentionMask, maxLen);
+                if (inputIds.empty() || attentionMask.empty()) {
+                    return {};
+                }
 
-    bool isLoaded() const { return m_loaded; }
+                std::vector<int64_t> tokenTypeIds(inputIds.size(), 0);
 
-    void encode(const QString& text,
-                std::vector<int64_t>& inputIds,
-                std::vector<int64_t>& attentionMask,
-                int maxLength) const
-    {
-        inputIds.clear();
-        attentionMask.clear();
+                std::vector<int64_t> tensorShape{1, static_cast<int64_t>(inputIds.size())};
 
-        if (!m_loaded || maxLength <= 0) {
-            return;
-        }
+                Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
 
-        std::vector<int64_t> tokens;
-        tokens.reserve(static_cast<std::size_t>(maxLength));
-        tokens.push_back(m_clsId);
+                Ort::Value idsTensor = Ort::Value::CreateTensor<int64_t>(memInfo,
+                                                                          inputIds.data(),
+                                                                          inputIds.size(),
+                                                                          tensorShape.data(),
+                                                                          tensorShape.size());
+                Ort::Value maskTensor = Ort::Value::CreateTensor<int64_t>(memInfo,
+                                                                           attentionMask.data(),
+                                                                           attentionMask.size(),
+                                                                           tensorShape.data(),
+                                                                           tensorShape.size());
+                Ort::Value typeIdsTensor = Ort::Value::CreateTensor<int64_t>(memInfo,
+                                                                              tokenTypeIds.data(),
+                                                                              tokenTypeIds.size(),
+                                                                              tensorShape.data(),
+                                                                              tensorShape.size());
+
+                size_t inputCount = session->GetInputCount();
+                std::vector<std::string> inputNameStorage(inputCount);
+                std::vector<const char*> inputNames(inputCount);
+                std::vector<Ort::Value> inputTensors(inputCount);
+
+                Ort::AllocatorWithDefaultOptions allocator;
+                for (size_t i = 0; i < inputCount; ++i) {
+                    Ort::AllocatedStringPtr namePtr = session->GetInputNameAllocated(i, allocator);
+                    if (namePtr) {
+                        inputNameStorage[i] = std::string(namePtr.get());
+                    }
+                }
 
-        const int textLen = text.size();
-        for (int i = 0; i < textLen; ++i) {
-            const QChar ch = text.at(i);
-            if (ch.isSpace()) {
-                continue;
-            }
+                for (size_t i = 0; i < inputCount; ++i) {
+                    inputNames[i] = inputNameStorage[i].c_str();
+                    const std::string& name = inputNameStorage[i];
+
+                    if (name.find("input_ids") != std::string::npos) {
+                        inputTensors[i] = std::move(idsTensor);
+                    } else if (name.find("attention_mask") != std::string::npos) {
+                        inputTensors[i] = std::move(maskTensor);
+                    } else if (name.find("token_type_ids") != std::string::npos) {
+                        inputTensors[i] = std::move(typeIdsTensor);
+                    }
+                }
 
-            const QString tokenStr(ch);
-            const int id = m_tokenToId.value(tokenStr, m_unkId);
-            tokens.push_back(id);
+                const char* outputNames[] = {outputName.c_str()};
 
-            if (static_cast<int>(tokens.size()) >= maxLength - 1) {
-                break;
-            }
-        }
+                std::vector<Ort::Value> outputs = session->Run(Ort::RunOptions{nullptr},
+                                                                    inputNames.data(),
+                                                                    inputTensors.data(),
+                                                                    inputCount,
+                                                                    outputNames,
+                                                                    1);
 
-        if (static_cast<int>(tokens.size()) < maxLength) {
-            tokens.push_back(m_sepId);
-        }
+                if (outputs.empty() || !outputs[0].IsTensor()) {
+                    return {};
+                }
 
-        if (static_cast<int>(tokens.size()) > maxLength) {
-            tokens.resize(static_cast<std::size_t>(maxLength));
-        }
+                float* outData = outputs[0].GetTensorMutableData<float>();
+                std::size_t outCount = static_cast<std::size_t>(dim);
+                std::vector<float> result(outCount);
+                for (std::size_t i = 0; i < outCount; ++i) {
+                    result[i] = outData[i];
+                }
 
-        inputIds.assign(tokens.begin(), tokens.end());
-        attentionMask.assign(inputIds.size(), 1);
+                return result;
+            }
 
-        if (static_cast<int>(inputIds.size()) < maxLength) {
-            inputIds.resize(static_cast<std::size_t>(maxLength), m_padId);
-            attentionMask.resize(static_cast<std::size_t>(maxLength), 0);
+            qWarning() << "[TextEmbeddingEngine] Unsupported ONNX input element type" << static_cast<int>(elementType);
+            return {};
+        } catch (const Ort::Exception& ex) {
+            qWarning() << "[TextEmbeddingEngine] ONNX Run failed:" << ex.what();
+            return {};
+        } catch (const std::exception& ex) {
+            qWarning() << "[TextEmbeddingEngine] ONNX backend std::exception:" << ex.what();
+            return {};
+        } catch (...) {
+            qWarning() << "[TextEmbeddingEngine] ONNX backend unknown exception during computeEmbedding";
+            return {};
         }
     }
 
-private:
-    bool m_loaded;
-    int m_clsId;
-    int m_sepId;
-    int m_padId;
-    int m_unkId;
-    QHash<QString, int> m_tokenToId;
+    bool available;
+    std::size_t inputSize;
+    std::shared_ptr<Ort::Env> env;     ///< Kept so it outlives the session
+    std::shared_ptr<Ort::Session> session;
+    std::string inputName;
+    std::string outputName;
 };
 
-RknnBgeTokenizer& rknnBgeTokenizer()
+BackendRegistry<EmbeddingBackend>::Factory onnxBackend(const char* relativePath)
 {
-    static RknnBgeTokenizer tokenizer;
-    return tokenizer;
+    return [relativePath]() -> std::unique_ptr<EmbeddingBackend> {
+        const QString modelPath = QDir(QCoreApplication::applicationDirPath()).filePath(QLatin1String(relativePath));
+        if (!QFile::exists(modelPath)) {
+            return nullptr;
+        }
+        auto backend = std::make_unique<OnnxEmbeddingBackend>(modelPath);
+        if (!backend->available) {
+            return nullptr;
+        }
+        backend->modelFile = modelPath;
+        return backend;
+    };
 }
+#endif
 
-class RknnEmbeddingContext {
+// ============================================================================
+// RKNN Backend for RK3566 Platform
+// ============================================================================
+#ifdef FLYKYLIN_RKNN_EMBEDDING_COMPILED
+
+class RknnEmbeddingBackend : public EmbeddingBackend {
 public:
     static constexpr int kMaxSeqLen = 128;
     static constexpr int kEmbeddingDim = 512;
 
-    RknnEmbeddingContext()
+    RknnEmbeddingBackend()
         : available(false)
         , ctx(0)
     {
@@ -441,18 +483,35 @@ public:
             return;
         }
 
-        QByteArray data = f.readAll();
-        if (data.isEmpty()) {
+        if (f.size() <= 0) {
             qWarning() << "[TextEmbeddingEngine] Empty RKNN model file";
             return;
         }
 
+        // rknn_init copies the weights into NPU memory, so reading them
+        // through a mapping avoids a second heap copy of the whole model
+        QElapsedTimer timer;
+        timer.start();
+        uchar* mapped = f.map(0, f.size());
+        QByteArray copy;    // Only where the file cannot be mapped
+        if (!mapped) {
+            copy = f.readAll();
+        }
+        void* model = mapped ? static_cast<void*>(mapped) : copy.data();
+        const auto modelSize = static_cast<uint32_t>(mapped ? f.size() : copy.size());
+
         rknn_context localCtx = 0;
-        int ret = rknn_init(&localCtx, data.data(), static_cast<uint32_t>(data.size()), 0, nullptr);
+        int ret = rknn_init(&localCtx, model, modelSize, 0, nullptr);
+        if (mapped) {
+            f.unmap(mapped);
+        }
+        copy = QByteArray();
+        f.close();
         if (ret != RKNN_SUCC || !localCtx) {
             qWarning() << "[TextEmbeddingEngine] rknn_init failed" << ret;
             return;
         }
+        qInfo() << "[TextEmbeddingEngine] rknn_init took" << timer.elapsed() << "ms for" << modelPath;
 
         rknn_input_output_num ioNum;
         std::memset(&ioNum, 0, sizeof(ioNum));
@@ -491,10 +550,12 @@ public:
 
         ctx = localCtx;
         available = true;
+        dim = kEmbeddingDim;
+        modelFile = modelPath;
         qInfo() << "[TextEmbeddingEngine] RKNN backend initialized, model=" << modelPath;
     }
 
-    ~RknnEmbeddingContext()
+    ~RknnEmbeddingBackend() override
     {
         if (ctx) {
             rknn_destroy(ctx);
@@ -502,17 +563,143 @@ public:
         }
     }
 
+    std::vector<float> embed(const QString& text) override
+    {
+        if (text.isEmpty()) {
+            return {};
+        }
+
+        BgeTokenizer& tokenizer = bgeTokenizer();
+        if (!tokenizer.isLoaded()) {
+            qWarning() << "[TextEmbeddingEngine] BGE tokenizer not loaded";
+            return {};
+        }
+
+        // Tokenize input text
+        std::vector<int64_t> inputIds;
+        std::vector<int64_t> attentionMask;
+        tokenizer.encode(text, inputIds, attentionMask, kMaxSeqLen);
+        if (inputIds.empty()) {
+            return {};
+        }
+
+        std::vector<int64_t> tokenTypeIds(inputIds.size(), 0);
+
+        // Prepare RKNN inputs (3 inputs: input_ids, attention_mask, token_type_ids)
+        rknn_input inputs[3];
+        std::memset(inputs, 0, sizeof(inputs));
+
+        inputs[0].index = 0;
+        inputs[0].pass_through = 0;
+        inputs[0].type = RKNN_TENSOR_INT64;
+        inputs[0].fmt = RKNN_TENSOR_UNDEFINED;
+        inputs[0].size = static_cast<uint32_t>(inputIds.size() * sizeof(int64_t));
+        inputs[0].buf = inputIds.data();
+
+        inputs[1].index = 1;
+        inputs[1].pass_through = 0;
+        inputs[1].type = RKNN_TENSOR_INT64;
+        inputs[1].fmt = RKNN_TENSOR_UNDEFINED;
+        inputs[1].size = static_cast<uint32_t>(attentionMask.size() * sizeof(int64_t));
+        inputs[1].buf = attentionMask.data();
+
+        inputs[2].index = 2;
+        inputs[2].pass_through = 0;
+        inputs[2].type = RKNN_TENSOR_INT64;
+        inputs[2].fmt = RKNN_TENSOR_UNDEFINED;
+        inputs[2].size = static_cast<uint32_t>(tokenTypeIds.size() * sizeof(int64_t));
+        inputs[2].buf = tokenTypeIds.data();
+
+        int ret = rknn_inputs_set(ctx, 3, inputs);
+        if (ret != RKNN_SUCC) {
+            qWarning() << "[TextEmbeddingEngine] rknn_inputs_set failed" << ret;
+            return {};
+        }
+
+        ret = rknn_run(ctx, nullptr);
+        if (ret != RKNN_SUCC) {
+            qWarning() << "[TextEmbeddingEngine] rknn_run failed" << ret;
+            return {};
+        }
+
+        // Get output - BGE model has two outputs:
+        // Output 0 (tanh/pooler_output): [1, 512] - sentence embedding
+        // Output 1 (last_hidden_state): [1, 128, 512] - all token hidden states
+        // We want output 0 (pooler_output) for sentence embedding
+        rknn_output outputs[2];
+        std::memset(outputs, 0, sizeof(outputs));
+        outputs[0].want_float = 1;
+        outputs[0].is_prealloc = 0;
+        outputs[0].index = 0;  // pooler_output (tanh)
+        outputs[1].want_float = 1;
+        outputs[1].is_prealloc = 0;
+        outputs[1].index = 1;  // last_hidden_state
+
+        ret = rknn_outputs_get(ctx, 2, outputs, nullptr);
+        if (ret != RKNN_SUCC) {
+            qWarning() << "[TextEmbeddingEngine] rknn_outputs_get failed" << ret;
+            return {};
+        }
+
+        // Try to use pooler_output (output 0) first
+        float* outData = nullptr;
+        int outputIdx = 0;
+    
+        if (outputs[0].buf && outputs[0].size >= kEmbeddingDim * sizeof(float)) {
+            // Use pooler_output [1, 512]
+            outData = static_cast<float*>(outputs[0].buf);
+            outputIdx = 0;
+        } else if (outputs[1].buf) {
+            // Fallback: use first token (CLS) from last_hidden_state [1, 128, 512]
+            // The CLS token embedding is at position 0
+            outData = static_cast<float*>(outputs[1].buf);
+            outputIdx = 1;
+            qInfo() << "[TextEmbeddingEngine] Using CLS token from last_hidden_state";
+        } else {
+            qWarning() << "[TextEmbeddingEngine] No valid output buffer";
+            rknn_outputs_release(ctx, 2, outputs);
+            return {};
+        }
+
+        std::vector<float> result(kEmbeddingDim);
+        for (int i = 0; i < kEmbeddingDim; ++i) {
+            result[static_cast<std::size_t>(i)] = outData[i];
+        }
+
+        rknn_outputs_release(ctx, 2, outputs);
+        return result;
+    }
+
     bool available;
     rknn_context ctx;
 };
 
-RknnEmbeddingContext& rknnEmbeddingContext()
+#endif // FLYKYLIN_RKNN_EMBEDDING_COMPILED
+
+// Every way this build can run the BGE model
+BackendRegistry<EmbeddingBackend> embeddingBackends()
 {
-    static RknnEmbeddingContext ctx;
-    return ctx;
+    BackendRegistry<EmbeddingBackend> registry("text-embedding");
+#ifdef FLYKYLIN_RKNN_EMBEDDING_COMPILED
+    registry.add(BackendKind::Rknn, []() -> std::unique_ptr<EmbeddingBackend> {
+        auto backend = std::make_unique<RknnEmbeddingBackend>();
+        if (!backend->available) {
+            return nullptr;
+        }
+        return backend;
+    });
+#endif
+#ifdef FLYKYLIN_ONNXRUNTIME_COMPILED
+    registry.add(BackendKind::OnnxCpu, onnxBackend("models/text-embedding.onnx"));
+    registry.add(BackendKind::OnnxInt8, onnxBackend("models/text-embedding-int8.onnx"));
+#endif
+    return registry;
 }
 
-#endif // FLYKYLIN_RKNN_EMBEDDING_COMPILED
+bool benchmarkEmbedding(EmbeddingBackend& backend)
+{
+    return !backend.embed(QStringLiteral("明天下午三点在二楼会议室讨论发布计划")).empty();
+}
 
 } // namespace
 
@@ -524,334 +711,115 @@ TextEmbeddingEngine* TextEmbeddingEngine::instance()
 
 TextEmbeddingEngine::TextEmbeddingEngine()
 {
-#if defined(FLYKYLIN_RKNN_EMBEDDING_COMPILED)
-    RknnEmbeddingContext& ctx = rknnEmbeddingContext();
-    if (!ctx.available) {
-        qInfo() << "[TextEmbeddingEngine] RKNN backend not available, semantic search disabled";
-    }
-#elif defined(FLYKYLIN_ONNXRUNTIME_COMPILED)
-    OnnxEmbeddingContext& ctx = onnxContext();
-    if (!ctx.available) {
-        qInfo() << "[TextEmbeddingEngine] ONNX backend not available, semantic search disabled";
+    applyResidencySettings();
+    m_model.setLoader([this]() { return loadBackend(); });
+}
+
+TextEmbeddingEngine::~TextEmbeddingEngine() = default;
+
+BackendAvailability TextEmbeddingEngine::availability() const
+{
+    if (!m_backendResolved.load(std::memory_order_acquire)) {
+        if (!m_selectionStarted.exchange(true)) {
+            m_model.prefetch();
+        }
+        return BackendAvailability::Pending;
     }
-#else
-    qInfo() << "[TextEmbeddingEngine] Initialized skeleton (no backend configured)";
-#endif
+    return m_backendKind.load() != BackendKind::Null ? BackendAvailability::Available
+                                                     : BackendAvailability::Unavailable;
 }
 
 bool TextEmbeddingEngine::isAvailable() const
 {
-#if defined(FLYKYLIN_RKNN_EMBEDDING_COMPILED)
-    return rknnEmbeddingContext().available;
-#elif defined(FLYKYLIN_ONNXRUNTIME_COMPILED)
-    return onnxContext().available;
-#else
-    return false;
-#endif
+    return availability() == BackendAvailability::Available;
 }
 
-std::vector<float> TextEmbeddingEngine::computeEmbedding(const QString& text) const
+bool TextEmbeddingEngine::waitForBackend() const
 {
-#if defined(FLYKYLIN_RKNN_EMBEDDING_COMPILED)
-    RknnEmbeddingContext& ctx = rknnEmbeddingContext();
-    if (!ctx.available || !ctx.ctx) {
-        Q_UNUSED(text);
-        return {};
-    }
+    selectBackend();
+    return m_backendKind.load() != BackendKind::Null;
+}
 
+std::vector<float> TextEmbeddingEngine::computeEmbedding(const QString& text) const
+{
     if (text.isEmpty()) {
         return {};
     }
-
-    RknnBgeTokenizer& tokenizer = rknnBgeTokenizer();
-    if (!tokenizer.isLoaded()) {
-        qWarning() << "[TextEmbeddingEngine] RKNN BGE tokenizer not loaded";
-        return {};
-    }
-
-    // Tokenize input text
-    std::vector<int64_t> inputIds;
-    std::vector<int64_t> attentionMask;
-    tokenizer.encode(text, inputIds, attentionMask, RknnEmbeddingContext::kMaxSeqLen);
-    if (inputIds.empty()) {
+    const std::shared_ptr<EmbeddingBackend> backend = m_model.acquire();
+    if (!backend) {
         return {};
     }
+    std::lock_guard<std::mutex> lock(m_inferMutex);
+    return backend->embed(text);
+}
 
-    std::vector<int64_t> tokenTypeIds(inputIds.size(), 0);
-
-    // Prepare RKNN inputs (3 inputs: input_ids, attention_mask, token_type_ids)
-    rknn_input inputs[3];
-    std::memset(inputs, 0, sizeof(inputs));
-
-    inputs[0].index = 0;
-    inputs[0].pass_through = 0;
-    inputs[0].type = RKNN_TENSOR_INT64;
-    inputs[0].fmt = RKNN_TENSOR_UNDEFINED;
-    inputs[0].size = static_cast<uint32_t>(inputIds.size() * sizeof(int64_t));
-    inputs[0].buf = inputIds.data();
-
-    inputs[1].index = 1;
-    inputs[1].pass_through = 0;
-    inputs[1].type = RKNN_TENSOR_INT64;
-    inputs[1].fmt = RKNN_TENSOR_UNDEFINED;
-    inputs[1].size = static_cast<uint32_t>(attentionMask.size() * sizeof(int64_t));
-    inputs[1].buf = attentionMask.data();
-
-    inputs[2].index = 2;
-    inputs[2].pass_through = 0;
-    inputs[2].type = RKNN_TENSOR_INT64;
-    inputs[2].fmt = RKNN_TENSOR_UNDEFINED;
-    inputs[2].size = static_cast<uint32_t>(tokenTypeIds.size() * sizeof(int64_t));
-    inputs[2].buf = tokenTypeIds.data();
-
-    int ret = rknn_inputs_set(ctx.ctx, 3, inputs);
-    if (ret != RKNN_SUCC) {
-        qWarning() << "[TextEmbeddingEngine] rknn_inputs_set failed" << ret;
-        return {};
-    }
+int TextEmbeddingEngine::embeddingDim() const
+{
+    selectBackend();
+    return m_dim;
+}
 
-    ret = rknn_run(ctx.ctx, nullptr);
-    if (ret != RKNN_SUCC) {
-        qWarning() << "[TextEmbeddingEngine] rknn_run failed" << ret;
-        return {};
-    }
+QString TextEmbeddingEngine::backendName() const
+{
+    selectBackend();
+    return QString::fromLatin1(backendKindName(m_backendKind));
+}
 
-    // Get output - BGE model has two outputs:
-    // Output 0 (tanh/pooler_output): [1, 512] - sentence embedding
-    // Output 1 (last_hidden_state): [1, 128, 512] - all token hidden states
-    // We want output 0 (pooler_output) for sentence embedding
-    rknn_output outputs[2];
-    std::memset(outputs, 0, sizeof(outputs));
-    outputs[0].want_float = 1;
-    outputs[0].is_prealloc = 0;
-    outputs[0].index = 0;  // pooler_output (tanh)
-    outputs[1].want_float = 1;
-    outputs[1].is_prealloc = 0;
-    outputs[1].index = 1;  // last_hidden_state
-
-    ret = rknn_outputs_get(ctx.ctx, 2, outputs, nullptr);
-    if (ret != RKNN_SUCC) {
-        qWarning() << "[TextEmbeddingEngine] rknn_outputs_get failed" << ret;
-        return {};
-    }
+QString TextEmbeddingEngine::modelVersion() const
+{
+    selectBackend();
+    return m_modelVersion;
+}
 
-    // Try to use pooler_output (output 0) first
-    float* outData = nullptr;
-    int outputIdx = 0;
-    
-    if (outputs[0].buf && outputs[0].size >= RknnEmbeddingContext::kEmbeddingDim * sizeof(float)) {
-        // Use pooler_output [1, 512]
-        outData = static_cast<float*>(outputs[0].buf);
-        outputIdx = 0;
-    } else if (outputs[1].buf) {
-        // Fallback: use first token (CLS) from last_hidden_state [1, 128, 512]
-        // The CLS token embedding is at position 0
-        outData = static_cast<float*>(outputs[1].buf);
-        outputIdx = 1;
-        qInfo() << "[TextEmbeddingEngine] Using CLS token from last_hidden_state";
-    } else {
-        qWarning() << "[TextEmbeddingEngine] No valid output buffer";
-        rknn_outputs_release(ctx.ctx, 2, outputs);
-        return {};
-    }
+void TextEmbeddingEngine::prefetch()
+{
+    m_selectionStarted = true;
+    m_model.prefetch();
+}
 
-    std::vector<float> result(RknnEmbeddingContext::kEmbeddingDim);
-    for (int i = 0; i < RknnEmbeddingContext::kEmbeddingDim; ++i) {
-        result[static_cast<std::size_t>(i)] = outData[i];
+void TextEmbeddingEngine::selectBackend() const
+{
+    if (m_backendResolved.load(std::memory_order_acquire)) {
+        return;
     }
+    // Waits for a selection already running on the residency thread
+    std::call_once(m_backendSelected, [this]() { m_model.acquire(); });
+}
 
-    rknn_outputs_release(ctx.ctx, 2, outputs);
-    return result;
-
-#elif defined(FLYKYLIN_ONNXRUNTIME_COMPILED)
-    OnnxEmbeddingContext& ctx = onnxContext();
-    if (!ctx.available || !ctx.session || !ctx.env) {
-        Q_UNUSED(text);
-        return {};
+std::unique_ptr<EmbeddingBackend> TextEmbeddingEngine::loadBackend() const
+{
+    // Runs under the residency slot's lock. Reloads after an idle unload
+    // reuse the kind picked by the first load.
+    if (m_backendChosen) {
+        return embeddingBackends().create(m_backendKind);
     }
+    m_backendChosen = true;
 
-    if (text.isEmpty()) {
-        return {};
+    // The first launch also benchmarks every backend
+    auto selection = embeddingBackends().select(benchmarkEmbedding, settingsChoiceStore());
+    for (const auto& timing : selection.timings) {
+        qInfo() << "[TextEmbeddingEngine] Warm-up" << backendKindName(timing.kind) << timing.medianMs
+                << "ms per sentence";
     }
-
-    try {
-        Ort::TypeInfo inputTypeInfo = ctx.session->GetInputTypeInfo(0);
-        auto inputTensorInfo = inputTypeInfo.GetTensorTypeAndShapeInfo();
-        ONNXTensorElementDataType elementType = inputTensorInfo.GetElementType();
-
-        if (elementType == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
-            std::vector<float> inputData(ctx.inputSize, 0.0f);
-            QByteArray utf8 = text.toUtf8();
-            int len = utf8.size();
-            int maxLen = static_cast<int>(ctx.inputSize);
-            int copyLen = len < maxLen ? len : maxLen;
-            for (int i = 0; i < copyLen; ++i) {
-                unsigned char ch = static_cast<unsigned char>(utf8.at(i));
-                inputData[static_cast<std::size_t>(i)] = static_cast<float>(ch) / 255.0f;
-            }
-
-            std::vector<int64_t> inputShape{1, static_cast<int64_t>(ctx.inputSize)};
-
-            Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
-            Ort::Value inputTensor = Ort::Value::CreateTensor<float>(memInfo,
-                                                                     inputData.data(),
-                                                                     inputData.size(),
-                                                                     inputShape.data(),
-                                                                     inputShape.size());
-
-            const char* inputNames[] = {ctx.inputName.c_str()};
-            const char* outputNames[] = {ctx.outputName.c_str()};
-
-            std::vector<Ort::Value> outputs =
-                ctx.session->Run(Ort::RunOptions{nullptr}, inputNames, &inputTensor, 1, outputNames, 1);
-
-            if (outputs.empty() || !outputs[0].IsTensor()) {
-                return {};
-            }
-
-            float* outData = outputs[0].GetTensorMutableData<float>();
-            std::size_t outCount = static_cast<std::size_t>(ctx.dim);
-            std::vector<float> result(outCount);
-            for (std::size_t i = 0; i < outCount; ++i) {
-                result[i] = outData[i];
-            }
-
-            return result;
-        }
-
-        if (elementType == ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64) {
-            BgeTokenizer& tokenizer = bgeTokenizer();
-            if (!tokenizer.isLoaded()) {
-                qWarning() << "[TextEmbeddingEngine] BGE tokenizer not loaded; semantic embeddings disabled";
-                return {};
-            }
-
-            int maxLen = 128;
-            std::vector<int64_t> inputShape = inputTensorInfo.GetShape();
-            if (!inputShape.empty()) {
-                if (inputShape.size() >= 2 && inputShape[1] > 0 && inputShape[1] <= 4096) {
-                    maxLen = static_cast<int>(inputShape[1]);
-                } else if (inputShape[0] > 0 && inputShape[0] <= 4096) {
-                    maxLen = static_cast<int>(inputShape[0]);
-                }
-            }
-
-            std::vector<int64_t> inputIds;
-            std::vector<int64_t> attentionMask;
-            tokenizer.encode(text, inputIds, attentionMask, maxLen);
-            if (inputIds.empty() || attentionMask.empty()) {
-                return {};
-            }
-
-            std::vector<int64_t> tokenTypeIds(inputIds.size(), 0);
-
-            std::vector<int64_t> tensorShape{1, static_cast<int64_t>(inputIds.size())};
-
-            Ort::MemoryInfo memInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
-
-            Ort::Value idsTensor = Ort::Value::CreateTensor<int64_t>(memInfo,
-                                                                      inputIds.data(),
-                                                                      inputIds.size(),
-                                                                      tensorShape.data(),
-                                                                      tensorShape.size());
-            Ort::Value maskTensor = Ort::Value::CreateTensor<int64_t>(memInfo,
-                                                                       attentionMask.data(),
-                                                                       attentionMask.size(),
-                                                                       tensorShape.data(),
-                                                                       tensorShape.size());
-            Ort::Value typeIdsTensor = Ort::Value::CreateTensor<int64_t>(memInfo,
-                                                                          tokenTypeIds.data(),
-                                                                          tokenTypeIds.size(),
-                                                                          tensorShape.data(),
-                                                                          tensorShape.size());
-
-            size_t inputCount = ctx.session->GetInputCount();
-            std::vector<std::string> inputNameStorage(inputCount);
-            std::vector<const char*> inputNames(inputCount);
-            std::vector<Ort::Value> inputTensors(inputCount);
-
-            Ort::AllocatorWithDefaultOptions allocator;
-            for (size_t i = 0; i < inputCount; ++i) {
-                Ort::AllocatedStringPtr namePtr = ctx.session->GetInputNameAllocated(i, allocator);
-                if (namePtr) {
-                    inputNameStorage[i] = std::string(namePtr.get());
-                }
-            }
-
-            for (size_t i = 0; i < inputCount; ++i) {
-                inputNames[i] = inputNameStorage[i].c_str();
-                const std::string& name = inputNameStorage[i];
-
-                if (name.find("input_ids") != std::string::npos) {
-                    inputTensors[i] = std::move(idsTensor);
-                } else if (name.find("attention_mask") != std::string::npos) {
-                    inputTensors[i] = std::move(maskTensor);
-                } else if (name.find("token_type_ids") != std::string::npos) {
-                    inputTensors[i] = std::move(typeIdsTensor);
-                }
-            }
-
-            const char* outputNames[] = {ctx.outputName.c_str()};
-
-            std::vector<Ort::Value> outputs = ctx.session->Run(Ort::RunOptions{nullptr},
-                                                                inputNames.data(),
-                                                                inputTensors.data(),
-                                                                inputCount,
-                                                                outputNames,
-                                                                1);
-
-            if (outputs.empty() || !outputs[0].IsTensor()) {
-                return {};
-            }
-
-            float* outData = outputs[0].GetTensorMutableData<float>();
-            std::size_t outCount = static_cast<std::size_t>(ctx.dim);
-            std::vector<float> result(outCount);
-            for (std::size_t i = 0; i < outCount; ++i) {
-                result[i] = outData[i];
-            }
-
-            return result;
-        }
-
-        qWarning() << "[TextEmbeddingEngine] Unsupported ONNX input element type" << static_cast<int>(elementType);
-        return {};
-    } catch (const Ort::Exception& ex) {
-        qWarning() << "[TextEmbeddingEngine] ONNX Run failed:" << ex.what();
-        return {};
-    } catch (const std::exception& ex) {
-        qWarning() << "[TextEmbeddingEngine] ONNX backend std::exception:" << ex.what();
-        return {};
-    } catch (...) {
-        qWarning() << "[TextEmbeddingEngine] ONNX backend unknown exception during computeEmbedding";
-        return {};
+    m_backendKind = selection.kind;
+    if (selection.backend) {
+        m_dim = selection.backend->dim;
+        // The model file's identity: replacing it invalidates stored vectors
+        const QFileInfo info(selection.backend->modelFile);
+        m_modelVersion = QStringLiteral("%1:%2:%3:%4:%5")
+                             .arg(QString::fromLatin1(backendKindName(m_backendKind)))
+                             .arg(m_dim)
+                             .arg(info.fileName())
+                             .arg(info.size())
+                             .arg(info.lastModified().toMSecsSinceEpoch());
+        qInfo() << "[TextEmbeddingEngine] Using backend" << backendKindName(m_backendKind)
+                << (selection.fromStore ? "(stored choice)" : "(benchmarked)") << "dim=" << m_dim;
+    } else {
+        m_modelVersion = QString::fromLatin1(backendKindName(m_backendKind));
+        qInfo() << "[TextEmbeddingEngine] No embedding backend available, semantic search disabled";
     }
-#else
-    Q_UNUSED(text);
-    return {};
-#endif
-}
-
-int TextEmbeddingEngine::embeddingDim() const
-{
-#if defined(FLYKYLIN_RKNN_EMBEDDING_COMPILED)
-    return RknnEmbeddingContext::kEmbeddingDim;
-#elif defined(FLYKYLIN_ONNXRUNTIME_COMPILED)
-    return onnxContext().dim;
-#else
-    return 0;
-#endif
-}
-
-QString TextEmbeddingEngine::backendName() const
-{
-#if defined(FLYKYLIN_RKNN_EMBEDDING_COMPILED)
-    return QStringLiteral("rknn");
-#elif defined(FLYKYLIN_ONNXRUNTIME_COMPILED)
-    return QStringLiteral("onnxruntime");
-#else
-    return QStringLiteral("unavailable");
-#endif
+    m_backendResolved.store(true, std::memory_order_release);
+    return std::move(selection.backend);
 }
 
 } // namespace ai
@@ -1,46 +1,99 @@
 #pragma once
 
+#include "core/ai/InferenceBackend.h"
+#include "core/ai/ModelResidency.h"
+
 #include <QString>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace flykylin {
 namespace ai {
 
+class EmbeddingBackend;
+
 /**
- * @brief Skeleton for text embedding engine used by semantic chat search.
+ * @brief Text embedding engine used by semantic chat search.
  *
- * Current implementation is a stub and always reports unavailable. It is
- * designed so that future ONNX / RKNN based backends can be plugged in
- * transparently without changing callers.
+ * Runs the BGE model on the fastest backend this build and device offer
+ * (RKNN, ONNX Runtime on the float or int8 model). The backend is picked by
+ * BackendRegistry on the residency thread the first time anyone asks, and
+ * remembered in the settings; without one the engine reports itself
+ * unavailable. The model is a ResidentModel: it
+ * is unloaded when idle or under memory pressure and loaded again on demand.
  */
 class TextEmbeddingEngine {
 public:
     static TextEmbeddingEngine* instance();
 
     /**
-     * @brief Whether a concrete embedding backend is available.
+     * @brief Never blocks; the first call starts picking the backend in the background.
+     */
+    BackendAvailability availability() const;
+
+    /**
+     * @brief Whether a concrete embedding backend is available (availability() == Available).
      */
     bool isAvailable() const;
 
+    /**
+     * @brief Pick the backend on this thread if that has not happened yet (not the GUI thread).
+     */
+    bool waitForBackend() const;
+
     /**
      * @brief Compute embedding vector for the given text.
      *
-     * When no backend is configured, this returns an empty vector.
+     * Safe to call from any thread; calls run one at a time because the
+     * backends are not re-entrant. When no backend is configured, this
+     * returns an empty vector.
      */
     std::vector<float> computeEmbedding(const QString& text) const;
 
     /**
      * @brief Dimension of the embedding vectors.
+     *
+     * This and the two below pick the backend if needed: call them on a
+     * worker or once isAvailable() is true.
      */
     int embeddingDim() const;
 
     /**
-     * @brief Human readable backend name (e.g. "ONNX-DirectML", "RKNN", "unavailable").
+     * @brief backendKindName() of the selected backend (e.g. "rknn", "onnx-int8", "null").
      */
     QString backendName() const;
 
+    /**
+     * @brief Identifies which vectors are comparable; stored vectors carry it.
+     *
+     * Backend, dimension and the model file's name, size and mtime, e.g.
+     * "rknn:512:bge-small-zh-v1.5.rknn:24117248:1716800000000".
+     */
+    QString modelVersion() const;
+
+    /**
+     * @brief Load the model in the background so the first search does not wait for it.
+     */
+    void prefetch();
+
 private:
     TextEmbeddingEngine();
+    ~TextEmbeddingEngine();
+
+    void selectBackend() const;
+    std::unique_ptr<EmbeddingBackend> loadBackend() const;
+
+    mutable std::once_flag m_backendSelected;
+    mutable std::atomic<bool> m_selectionStarted{false};
+    mutable std::atomic<bool> m_backendResolved{false};    ///< Set by loadBackend() once the kind is picked
+    mutable bool m_backendChosen{false};    ///< Only touched by loadBackend()
+    mutable std::atomic<BackendKind> m_backendKind{BackendKind::Null};
+    mutable int m_dim{0};                   ///< Written before m_backendResolved
+    mutable QString m_modelVersion;         ///< Written before m_backendResolved
+    mutable std::mutex m_inferMutex;
+    mutable ResidentModel<EmbeddingBackend> m_model{"text-embedding"};
 };
 
 } // namespace ai
@@ -0,0 +1,503 @@
+/**
+ * @file BulkChannel.cpp
+ * @brief Zero-copy file transfer over a dedicated TCP socket (Linux sendfile/splice)
+ * @author FlyKylin Development Team
+ * @date 2024-12-04
+ */
+
+#include "BulkChannel.h"
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <csignal>
+#include <ctime>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FLYKYLIN_BULK_LINUX 1
+#endif
+
+namespace flykylin {
+namespace communication {
+
+#if defined(FLYKYLIN_BULK_LINUX)
+
+namespace {
+
+constexpr int kPollSliceMs = 200;
+constexpr int kPipeSize = 1024 * 1024;
+
+void putU64(uint8_t* out, uint64_t value)
+{
+    for (int i = 7; i >= 0; --i) {
+        out[i] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+}
+
+uint64_t getU64(const uint8_t* in)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+bool writeAll(int fd, const uint8_t* data, std::size_t size, int flags)
+{
+    while (size > 0) {
+        const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL | flags);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+/// @return bytes read: size, or less only at EOF; -1 on error
+ssize_t readAll(int fd, uint8_t* data, std::size_t size)
+{
+    std::size_t done = 0;
+    while (done < size) {
+        const ssize_t n = ::recv(fd, data + done, size - done, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return static_cast<ssize_t>(done);
+}
+
+int listenOn(int family, uint16_t* port)
+{
+    const int fd = ::socket(family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    sockaddr_storage addr{};
+    socklen_t addrLen = 0;
+    if (family == AF_INET6) {
+        const int off = 0;
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        auto* a6 = reinterpret_cast<sockaddr_in6*>(&addr);
+        a6->sin6_family = AF_INET6;
+        a6->sin6_addr = in6addr_any;
+        addrLen = sizeof(sockaddr_in6);
+    } else {
+        auto* a4 = reinterpret_cast<sockaddr_in*>(&addr);
+        a4->sin_family = AF_INET;
+        a4->sin_addr.s_addr = htonl(INADDR_ANY);
+        addrLen = sizeof(sockaddr_in);
+    }
+
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), addrLen) != 0 || ::listen(fd, 1) != 0
+        || ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    *port = ntohs(family == AF_INET6 ? reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port
+                                     : reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+    return fd;
+}
+
+std::string addressToString(const sockaddr_storage& addr)
+{
+    char text[INET6_ADDRSTRLEN] = {};
+    if (addr.ss_family == AF_INET6) {
+        const auto* a6 = reinterpret_cast<const sockaddr_in6*>(&addr);
+        if (IN6_IS_ADDR_V4MAPPED(&a6->sin6_addr)) {
+            // Report the plain IPv4 form so it compares with the control connection
+            ::inet_ntop(AF_INET, &a6->sin6_addr.s6_addr[12], text, sizeof(text));
+        } else {
+            ::inet_ntop(AF_INET6, &a6->sin6_addr, text, sizeof(text));
+        }
+    } else {
+        ::inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&addr)->sin_addr,
+                    text, sizeof(text));
+    }
+    return text;
+}
+
+/**
+ * @brief Blocks SIGPIPE on this thread while alive
+ *
+ * sendfile() has no MSG_NOSIGNAL: a receiver that hangs up would kill the
+ * process. A pending SIGPIPE raised meanwhile is consumed before unblocking.
+ */
+class SigpipeGuard {
+public:
+    SigpipeGuard()
+    {
+        sigemptyset(&m_pipe);
+        sigaddset(&m_pipe, SIGPIPE);
+        m_wasPending = isPending();
+        m_wasBlocked = pthread_sigmask(SIG_BLOCK, &m_pipe, &m_old) == 0 && sigismember(&m_old, SIGPIPE);
+    }
+
+    ~SigpipeGuard()
+    {
+        if (!m_wasPending && isPending()) {
+            const timespec zero{0, 0};
+            while (sigtimedwait(&m_pipe, nullptr, &zero) < 0 && errno == EINTR) {
+            }
+        }
+        if (!m_wasBlocked) {
+            pthread_sigmask(SIG_SETMASK, &m_old, nullptr);
+        }
+    }
+
+private:
+    bool isPending() const
+    {
+        sigset_t pending;
+        return sigpending(&pending) == 0 && sigismember(&pending, SIGPIPE);
+    }
+
+    sigset_t m_pipe;
+    sigset_t m_old;
+    bool m_wasPending{false};
+    bool m_wasBlocked{false};
+};
+
+bool setBlocking(int fd)
+{
+    const int flags = ::fcntl(fd, F_GETFL);
+    return flags >= 0 && ::fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == 0;
+}
+
+} // namespace
+
+bool BulkChannel::isSupported()
+{
+    return true;
+}
+
+int BulkChannel::listen(uint16_t* port)
+{
+    const int fd = listenOn(AF_INET6, port);
+    return fd >= 0 ? fd : listenOn(AF_INET, port);
+}
+
+int BulkChannel::accept(int listenFd, int timeoutMs, const std::atomic<bool>& cancel,
+                        std::string* peerIp)
+{
+    for (int waited = 0; waited < timeoutMs && !cancel.load(); waited += kPollSliceMs) {
+        pollfd pfd{listenFd, POLLIN, 0};
+        const int ready = ::poll(&pfd, 1, kPollSliceMs);
+        if (ready < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        sockaddr_storage addr{};
+        socklen_t addrLen = sizeof(addr);
+        const int fd = ::accept4(listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLen,
+                                 SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED) {
+                continue;
+            }
+            return -1;
+        }
+        if (peerIp) {
+            *peerIp = addressToString(addr);
+        }
+        return fd;
+    }
+    return -1;
+}
+
+int BulkChannel::connect(const std::string& host, uint16_t port, int timeoutMs)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    addrinfo* result = nullptr;
+    if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo* ai = result; ai && fd < 0; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            pollfd pfd{fd, POLLOUT, 0};
+            int error = errno;
+            socklen_t errorLen = sizeof(error);
+            if (error != EINPROGRESS || ::poll(&pfd, 1, timeoutMs) != 1
+                || ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) != 0 || error != 0) {
+                ::close(fd);
+                fd = -1;
+                continue;
+            }
+        }
+        if (!setBlocking(fd)) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    ::freeaddrinfo(result);
+    return fd;
+}
+
+int BulkChannel::openSource(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    return fd;
+}
+
+int BulkChannel::openTarget(const std::string& path, uint64_t fileSize)
+{
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0
+        || (static_cast<uint64_t>(st.st_size) != fileSize
+            && ::ftruncate(fd, static_cast<off_t>(fileSize)) != 0)) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool BulkChannel::syncTarget(int fileFd)
+{
+    return ::fdatasync(fileFd) == 0;
+}
+
+bool BulkChannel::sendRanges(int socketFd, int fileFd, uint64_t token,
+                             const std::vector<BulkRange>& ranges,
+                             const std::atomic<bool>& cancel,
+                             const RangeCallback& onRange)
+{
+    SigpipeGuard sigpipeGuard;
+
+    uint8_t hello[8];
+    putU64(hello, token);
+    if (!writeAll(socketFd, hello, sizeof(hello), MSG_MORE)) {
+        return false;
+    }
+
+    for (const BulkRange& range : ranges) {
+        uint64_t offset = range.offset;
+        uint64_t remaining = range.length;
+        while (remaining > 0) {
+            if (cancel.load()) {
+                return false;
+            }
+
+            BulkRange piece{offset, remaining < kMaxRangeBytes ? remaining : kMaxRangeBytes};
+            uint8_t header[kRangeHeaderSize];
+            putU64(header, piece.offset);
+            putU64(header + 8, piece.length);
+            if (!writeAll(socketFd, header, sizeof(header), MSG_MORE)) {
+                return false;
+            }
+
+            off_t fileOffset = static_cast<off_t>(piece.offset);
+            uint64_t left = piece.length;
+            while (left > 0) {
+                const ssize_t n = ::sendfile(socketFd, fileFd, &fileOffset, static_cast<std::size_t>(left));
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                if (n == 0) {
+                    return false;   // file shrank under us
+                }
+                left -= static_cast<uint64_t>(n);
+            }
+
+            offset += piece.length;
+            remaining -= piece.length;
+            if (onRange) {
+                onRange(piece);
+            }
+        }
+    }
+    return true;
+}
+
+bool BulkChannel::receiveRanges(int socketFd, int fileFd, uint64_t fileSize, uint64_t token,
+                                const std::atomic<bool>& cancel,
+                                const RangeCallback& onRange)
+{
+    uint8_t hello[8];
+    if (readAll(socketFd, hello, sizeof(hello)) != static_cast<ssize_t>(sizeof(hello))
+        || getU64(hello) != token) {
+        return false;
+    }
+
+    int pipeFds[2];
+    if (::pipe2(pipeFds, O_CLOEXEC) != 0) {
+        return false;
+    }
+    ::fcntl(pipeFds[1], F_SETPIPE_SZ, kPipeSize);
+
+    bool ok = true;
+    while (ok && !cancel.load()) {
+        uint8_t header[kRangeHeaderSize];
+        const ssize_t headerBytes = readAll(socketFd, header, sizeof(header));
+        if (headerBytes == 0) {
+            break;   // sender is done
+        }
+        if (headerBytes != static_cast<ssize_t>(sizeof(header))) {
+            ok = false;
+            break;
+        }
+
+        const BulkRange range{getU64(header), getU64(header + 8)};
+        if (range.length == 0 || range.length > kMaxRangeBytes || range.offset > fileSize
+            || range.length > fileSize - range.offset) {
+            ok = false;
+            break;
+        }
+
+        // socket -> pipe -> file: the data stays in kernel pages
+        loff_t fileOffset = static_cast<loff_t>(range.offset);
+        uint64_t left = range.length;
+        while (ok && left > 0) {
+            const std::size_t want = left < static_cast<uint64_t>(kPipeSize)
+                    ? static_cast<std::size_t>(left) : static_cast<std::size_t>(kPipeSize);
+            ssize_t inPipe = ::splice(socketFd, nullptr, pipeFds[1], nullptr, want,
+                                      SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (inPipe < 0 && errno == EINTR) {
+                continue;
+            }
+            if (inPipe <= 0) {
+                ok = false;   // error or EOF inside a range
+                break;
+            }
+            left -= static_cast<uint64_t>(inPipe);
+            while (inPipe > 0) {
+                const ssize_t n = ::splice(pipeFds[0], nullptr, fileFd, &fileOffset,
+                                           static_cast<std::size_t>(inPipe), SPLICE_F_MOVE);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    ok = false;
+                    break;
+                }
+                inPipe -= n;
+            }
+        }
+
+        if (ok && onRange) {
+            onRange(range);
+        }
+    }
+
+    ::close(pipeFds[0]);
+    ::close(pipeFds[1]);
+    return ok && !cancel.load();
+}
+
+void BulkChannel::interrupt(int fd)
+{
+    if (fd >= 0) {
+        ::shutdown(fd, SHUT_RDWR);
+    }
+}
+
+void BulkChannel::close(int fd)
+{
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+#else
+
+bool BulkChannel::isSupported()
+{
+    return false;
+}
+
+int BulkChannel::listen(uint16_t*)
+{
+    return -1;
+}
+
+int BulkChannel::accept(int, int, const std::atomic<bool>&, std::string*)
+{
+    return -1;
+}
+
+int BulkChannel::connect(const std::string&, uint16_t, int)
+{
+    return -1;
+}
+
+int BulkChannel::openSource(const std::string&)
+{
+    return -1;
+}
+
+int BulkChannel::openTarget(const std::string&, uint64_t)
+{
+    return -1;
+}
+
+bool BulkChannel::syncTarget(int)
+{
+    return false;
+}
+
+bool BulkChannel::sendRanges(int, int, uint64_t, const std::vector<BulkRange>&,
+                             const std::atomic<bool>&, const RangeCallback&)
+{
+    return false;
+}
+
+bool BulkChannel::receiveRanges(int, int, uint64_t, uint64_t, const std::atomic<bool>&,
+                                const RangeCallback&)
+{
+    return false;
+}
+
+void BulkChannel::interrupt(int)
+{
+}
+
+void BulkChannel::close(int)
+{
+}
+
+#endif
+
+} // namespace communication
+} // namespace flykylin
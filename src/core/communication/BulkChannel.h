@@ -0,0 +1,120 @@
+/**
+ * @file BulkChannel.h
+ * @brief Zero-copy file transfer over a dedicated TCP socket (Linux sendfile/splice)
+ * @author FlyKylin Development Team
+ * @date 2024-12-04
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace flykylin {
+namespace communication {
+
+/**
+ * @brief File byte range carried by a bulk channel
+ */
+struct BulkRange {
+    uint64_t offset{0};
+    uint64_t length{0};
+};
+
+/**
+ * @brief Kernel-side bulk file transfer (Linux only)
+ *
+ * The receiver listens on an ephemeral port announced in
+ * FileTransferResponse.port; the sender connects and streams the missing
+ * ranges straight from the page cache with sendfile(), the receiver moves
+ * them from the socket into the file with splice(). File data never enters
+ * user space on either side, so there is no per-chunk CRC: integrity rests
+ * on TCP's checksum and the SHA-256 the receiver computes afterwards.
+ *
+ * Wire format (all integers big-endian):
+ *
+ *   [u64 token]                      once, from FileTransferResponse.bulk_token
+ *   [u64 offset][u64 length][data]   per range, ranges at most kMaxRangeBytes
+ *
+ * The sender closes the socket after the last range. All calls block;
+ * interrupt() from another thread makes a blocked call return false.
+ * On other platforms isSupported() is false and every call fails.
+ */
+class BulkChannel {
+public:
+    using RangeCallback = std::function<void(const BulkRange&)>;
+
+    static constexpr uint64_t kMaxRangeBytes = 8ull * 1024ull * 1024ull;
+    static constexpr std::size_t kRangeHeaderSize = 16;
+
+    static bool isSupported();
+
+    /**
+     * @brief Listen on an ephemeral port on all interfaces (IPv6 dual-stack if available)
+     * @return Listening socket, -1 on error
+     */
+    static int listen(uint16_t* port);
+
+    /**
+     * @brief Accept one connection, polling cancel every few hundred ms
+     * @param peerIp Remote address of the accepted connection
+     * @return Connected socket, -1 on timeout, cancel or error
+     */
+    static int accept(int listenFd, int timeoutMs, const std::atomic<bool>& cancel,
+                      std::string* peerIp);
+
+    /**
+     * @brief Connect to host:port
+     * @return Connected (blocking) socket, -1 on error or timeout
+     */
+    static int connect(const std::string& host, uint16_t port, int timeoutMs);
+
+    /**
+     * @brief Open a file for sending (sequential read-ahead hint)
+     */
+    static int openSource(const std::string& path);
+
+    /**
+     * @brief Open (create) a file for receiving, sized to fileSize; existing data is kept
+     */
+    static int openTarget(const std::string& path, uint64_t fileSize);
+
+    /**
+     * @brief fdatasync() a target so the ranges reported so far survive a crash
+     */
+    static bool syncTarget(int fileFd);
+
+    /**
+     * @brief Send token and ranges of fileFd with sendfile()
+     *
+     * Ranges longer than kMaxRangeBytes go out as several ranges, so
+     * onRange (called on this thread) reports progress at that granularity.
+     */
+    static bool sendRanges(int socketFd, int fileFd, uint64_t token,
+                           const std::vector<BulkRange>& ranges,
+                           const std::atomic<bool>& cancel,
+                           const RangeCallback& onRange);
+
+    /**
+     * @brief Check the token, then splice() ranges into fileFd until the sender closes
+     *
+     * Fails on a wrong token or a range outside [0, fileSize). onRange
+     * (called on this thread) reports every range that fully landed.
+     */
+    static bool receiveRanges(int socketFd, int fileFd, uint64_t fileSize, uint64_t token,
+                              const std::atomic<bool>& cancel,
+                              const RangeCallback& onRange);
+
+    /**
+     * @brief Wake a thread blocked on fd (shutdown; the owner still closes it)
+     */
+    static void interrupt(int fd);
+
+    static void close(int fd);
+};
+
+} // namespace communication
+} // namespace flykylin
@@ -0,0 +1,237 @@
+/**
+ * @file Crc32c.cpp
+ * @brief CRC32C with hardware acceleration and a portable fallback
+ * @author FlyKylin Development Team
+ * @date 2024-12-03
+ */
+
+#include "Crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define FLYKYLIN_CRC32C_X86 1
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#define FLYKYLIN_CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__linux__) \
+    && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 10))
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#define FLYKYLIN_CRC32C_ARM64 1
+#endif
+
+namespace flykylin {
+namespace communication {
+
+namespace {
+
+constexpr uint32_t kPolynomial = 0x82F63B78u;   // Castagnoli, reflected
+
+struct Tables {
+    uint32_t t[8][256];
+
+    Tables()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? (c >> 1) ^ kPolynomial : (c >> 1);
+            }
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int s = 1; s < 8; ++s) {
+                t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+const Tables& tables()
+{
+    static const Tables instance;
+    return instance;
+}
+
+uint32_t crc32cSoftware(uint32_t c, const uint8_t* p, std::size_t n)
+{
+    const Tables& tb = tables();
+    while (n >= 8) {
+        uint32_t lo;
+        uint32_t hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= c;
+        c = tb.t[7][lo & 0xFF] ^ tb.t[6][(lo >> 8) & 0xFF]
+          ^ tb.t[5][(lo >> 16) & 0xFF] ^ tb.t[4][lo >> 24]
+          ^ tb.t[3][hi & 0xFF] ^ tb.t[2][(hi >> 8) & 0xFF]
+          ^ tb.t[1][(hi >> 16) & 0xFF] ^ tb.t[0][hi >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) {
+        c = (c >> 8) ^ tb.t[0][(c ^ *p++) & 0xFF];
+    }
+    return c;
+}
+
+#if defined(FLYKYLIN_CRC32C_X86)
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("sse4.2")))
+#endif
+uint32_t crc32cHardware(uint32_t c, const uint8_t* p, std::size_t n)
+{
+    while (n >= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        c = static_cast<uint32_t>(_mm_crc32_u64(c, v));
+        p += 8;
+        n -= 8;
+    }
+    while (n--) {
+        c = _mm_crc32_u8(c, *p++);
+    }
+    return c;
+}
+
+bool detectHardware()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#elif defined(FLYKYLIN_CRC32C_ARM64)
+
+__attribute__((target("+crc")))
+uint32_t crc32cHardware(uint32_t c, const uint8_t* p, std::size_t n)
+{
+    while (n >= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        c = __crc32cd(c, v);
+        p += 8;
+        n -= 8;
+    }
+    while (n--) {
+        c = __crc32cb(c, *p++);
+    }
+    return c;
+}
+
+bool detectHardware()
+{
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+#endif
+
+bool useHardware()
+{
+#if defined(FLYKYLIN_CRC32C_X86) || defined(FLYKYLIN_CRC32C_ARM64)
+    static const bool available = detectHardware();
+    return available;
+#else
+    return false;
+#endif
+}
+
+// GF(2) matrix helpers for crc32cCombine (same approach as zlib's crc32_combine)
+uint32_t gf2MatrixTimes(const uint32_t* mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) {
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        ++mat;
+    }
+    return sum;
+}
+
+void gf2MatrixSquare(uint32_t* square, const uint32_t* mat)
+{
+    for (int n = 0; n < 32; ++n) {
+        square[n] = gf2MatrixTimes(mat, mat[n]);
+    }
+}
+
+} // namespace
+
+uint32_t crc32c(const void* data, std::size_t size, uint32_t crc)
+{
+    const auto* p = static_cast<const uint8_t*>(data);
+    uint32_t c = ~crc;
+#if defined(FLYKYLIN_CRC32C_X86) || defined(FLYKYLIN_CRC32C_ARM64)
+    if (useHardware()) {
+        return ~crc32cHardware(c, p, size);
+    }
+#endif
+    return ~crc32cSoftware(c, p, size);
+}
+
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t lengthB)
+{
+    if (lengthB == 0) {
+        return crcA;
+    }
+
+    uint32_t even[32];
+    uint32_t odd[32];
+
+    // Operator for one zero bit
+    odd[0] = kPolynomial;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; ++n) {
+        odd[n] = row;
+        row <<= 1;
+    }
+
+    gf2MatrixSquare(even, odd);    // two zero bits
+    gf2MatrixSquare(odd, even);    // four zero bits
+
+    // Apply lengthB zero bytes to crcA
+    do {
+        gf2MatrixSquare(even, odd);
+        if (lengthB & 1) {
+            crcA = gf2MatrixTimes(even, crcA);
+        }
+        lengthB >>= 1;
+        if (lengthB == 0) {
+            break;
+        }
+
+        gf2MatrixSquare(odd, even);
+        if (lengthB & 1) {
+            crcA = gf2MatrixTimes(odd, crcA);
+        }
+        lengthB >>= 1;
+    } while (lengthB != 0);
+
+    return crcA ^ crcB;
+}
+
+bool crc32cHardwareAccelerated()
+{
+    return useHardware();
+}
+
+} // namespace communication
+} // namespace flykylin
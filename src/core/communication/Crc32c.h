@@ -0,0 +1,43 @@
+/**
+ * @file Crc32c.h
+ * @brief CRC32C (Castagnoli) for per-chunk file transfer integrity
+ * @author FlyKylin Development Team
+ * @date 2024-12-03
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace flykylin {
+namespace communication {
+
+/**
+ * @brief Extend a CRC32C with more data
+ *
+ * Same convention as zlib's crc32(): pass 0 to start, pass the previous
+ * result to continue. Uses the SSE4.2 / ARMv8 CRC instructions when the CPU
+ * has them, slicing-by-8 tables otherwise.
+ *
+ * @param data Input bytes
+ * @param size Input size
+ * @param crc  CRC of the preceding data (0 for none)
+ */
+uint32_t crc32c(const void* data, std::size_t size, uint32_t crc = 0);
+
+/**
+ * @brief CRC32C of A||B from crc32c(A), crc32c(B) and B's length
+ *
+ * Lets the receiver derive the whole-file checksum from verified chunk
+ * checksums without reading the file back.
+ */
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t lengthB);
+
+/**
+ * @brief Whether the hardware path is in use (for logging/benchmarks)
+ */
+bool crc32cHardwareAccelerated();
+
+} // namespace communication
+} // namespace flykylin
@@ -0,0 +1,74 @@
+/**
+ * @file FileDataFrame.cpp
+ * @brief Raw binary file-data frame encoding/decoding
+ * @author FlyKylin Development Team
+ * @date 2024-12-02
+ */
+
+#include "FileDataFrame.h"
+
+namespace flykylin {
+namespace communication {
+
+namespace {
+
+inline void putU32(uint8_t* p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+inline void putU64(uint8_t* p, uint64_t v)
+{
+    putU32(p, static_cast<uint32_t>(v >> 32));
+    putU32(p + 4, static_cast<uint32_t>(v));
+}
+
+inline uint32_t getU32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+         | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+inline uint64_t getU64(const uint8_t* p)
+{
+    return (static_cast<uint64_t>(getU32(p)) << 32) | getU32(p + 4);
+}
+
+} // namespace
+
+void encodeFileDataPrefix(const FileDataHeader& header, uint8_t* out)
+{
+    const uint32_t bodySize = static_cast<uint32_t>(kFileDataHeaderSize) + header.length;
+    putU32(out, kFileDataFrameMarker | bodySize);
+
+    uint8_t* h = out + 4;
+    h[0] = kFileDataFrameVersion;
+    h[1] = header.flags;
+    h[2] = 0;
+    h[3] = 0;
+    putU32(h + 4, header.transferIndex);
+    putU64(h + 8, header.offset);
+    putU32(h + 16, header.length);
+    putU32(h + 20, header.checksum);
+}
+
+bool decodeFileDataHeader(const uint8_t* body, std::size_t bodySize, FileDataHeader& out)
+{
+    if (bodySize < kFileDataHeaderSize || body[0] != kFileDataFrameVersion) {
+        return false;
+    }
+
+    out.flags = body[1];
+    out.transferIndex = getU32(body + 4);
+    out.offset = getU64(body + 8);
+    out.length = getU32(body + 16);
+    out.checksum = getU32(body + 20);
+
+    return static_cast<std::size_t>(out.length) == bodySize - kFileDataHeaderSize;
+}
+
+} // namespace communication
+} // namespace flykylin
@@ -0,0 +1,82 @@
+/**
+ * @file FileDataFrame.h
+ * @brief Raw binary frame for bulk file data (bypasses protobuf)
+ * @author FlyKylin Development Team
+ * @date 2024-12-02
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace flykylin {
+namespace communication {
+
+/**
+ * @brief Raw file-data frame layout
+ *
+ * Shares the regular TCP framing ([4-byte BE length][payload]) but sets the
+ * top bit of the length word so the receiver can tell it apart from a
+ * protobuf TcpMessage without parsing:
+ *
+ *   [u32 BE: kFileDataFrameMarker | (header + payload length)]
+ *   [u8 version][u8 flags][u16 reserved]
+ *   [u32 BE transferIndex][u64 BE offset][u32 BE length][u32 BE checksum]
+ *   [length bytes of raw file data]
+ *
+ * transferIndex refers to FileTransferRequest.transfer_index announced
+ * earlier on the same peer, so the per-chunk header stays fixed-size.
+ * Only sent to peers advertising PeerCapability::CapabilityFileDataFrame.
+ */
+constexpr uint32_t kFileDataFrameMarker = 0x80000000u;
+constexpr std::size_t kFileDataHeaderSize = 24;
+constexpr std::size_t kFileDataPrefixSize = 4 + kFileDataHeaderSize;
+constexpr uint8_t kFileDataFrameVersion = 1;
+
+/**
+ * @brief Per-frame flags
+ */
+enum FileDataFlag : uint8_t {
+    FileDataLast = 0x01     ///< Last chunk of the transfer
+};
+
+/**
+ * @brief Decoded fixed header of a file-data frame
+ */
+struct FileDataHeader {
+    uint8_t flags{0};
+    uint32_t transferIndex{0};
+    uint64_t offset{0};
+    uint32_t length{0};
+    uint32_t checksum{0};   ///< CRC32C of the payload for resumable transfers, else 0
+
+    bool isLast() const { return (flags & FileDataLast) != 0; }
+};
+
+/**
+ * @brief Check whether a frame length word announces a file-data frame
+ */
+inline bool isFileDataFrame(uint32_t lengthWord)
+{
+    return (lengthWord & kFileDataFrameMarker) != 0;
+}
+
+/**
+ * @brief Write length word + fixed header (kFileDataPrefixSize bytes)
+ * @param header Header; header.length must be the payload size
+ * @param out Destination, at least kFileDataPrefixSize bytes
+ */
+void encodeFileDataPrefix(const FileDataHeader& header, uint8_t* out);
+
+/**
+ * @brief Decode the fixed header of a frame body (after the length word)
+ * @param body Frame body (header + payload)
+ * @param bodySize Body size taken from the length word
+ * @param out Decoded header
+ * @return false if the version is unknown or the length is inconsistent
+ */
+bool decodeFileDataHeader(const uint8_t* body, std::size_t bodySize, FileDataHeader& out);
+
+} // namespace communication
+} // namespace flykylin
@@ -10,7 +10,6 @@
 #include "../database/DatabaseService.h"
 #include <QHostAddress>
 #include <QHostInfo>
-#include <QNetworkDatagram>
 #include <QNetworkInterface>
 #include <QDebug>
 
@@ -145,9 +144,19 @@ void PeerDiscovery::onTimeoutCheckTimer()
 void PeerDiscovery::onDatagramReceived()
 {
     while (m_socket->hasPendingDatagrams()) {
-        QNetworkDatagram datagram = m_socket->receiveDatagram();
-        QHostAddress senderAddress = datagram.senderAddress();
-        QByteArray data = datagram.data();
+        const qint64 pendingSize = m_socket->pendingDatagramSize();
+        if (pendingSize < 0) {
+            break;
+        }
+
+        // 读入复用缓冲区，避免每个数据报分配一次QByteArray
+        m_receiveBuffer.resize(static_cast<std::size_t>(pendingSize));
+        QHostAddress senderAddress;
+        const qint64 readSize = m_socket->readDatagram(
+            reinterpret_cast<char*>(m_receiveBuffer.data()), pendingSize, &senderAddress);
+        if (readSize < 0) {
+            continue;
+        }
 
         // 忽略自己发送的消息（使用缓存优化性能）
         // 过滤本地地址（除非启用回环模式）
@@ -156,7 +165,8 @@ void PeerDiscovery::onDatagramReceived()
         }
 
         // 处理接收到的消息
-        processReceivedMessage(data, senderAddress);
+        processReceivedMessage(m_receiveBuffer.data(), static_cast<std::size_t>(readSize),
+                               senderAddress);
     }
 }
 
@@ -185,31 +195,31 @@ void PeerDiscovery::sendBroadcast(int messageType)
     selfNode.setLastSeen(QDateTime::currentDateTime());
     selfNode.setOnline(true);
 
-    // 使用Protobuf序列化
-    std::vector<uint8_t> data;
-    
+    // 使用Protobuf序列化到复用缓冲区
+    flykylin::ports::DiscoveryKind kind;
     switch (messageType) {
         case 1: // MSG_ONLINE
-            data = m_serializer->serializePeerAnnounce(selfNode);
+            kind = flykylin::ports::DiscoveryKind::Announce;
             break;
         case 2: // MSG_OFFLINE
-            data = m_serializer->serializePeerGoodbye(selfNode);
+            kind = flykylin::ports::DiscoveryKind::Goodbye;
             break;
         case 3: // MSG_HEARTBEAT
-            data = m_serializer->serializePeerHeartbeat(selfNode);
+            kind = flykylin::ports::DiscoveryKind::Heartbeat;
             break;
         default:
             qWarning() << "[PeerDiscovery] Unknown message type:" << messageType;
             return;
     }
 
-    if (data.empty()) {
+    if (!m_serializer->serializePeerMessageInto(kind, selfNode, m_sendBuffer)
+        || m_sendBuffer.empty()) {
         qWarning() << "[PeerDiscovery] Failed to serialize message";
         return;
     }
 
-    // 转换为QByteArray并发送
-    QByteArray message(reinterpret_cast<const char*>(data.data()), data.size());
+    const char* message = reinterpret_cast<const char*>(m_sendBuffer.data());
+    const qint64 messageSize = static_cast<qint64>(m_sendBuffer.size());
     
     // 发送到所有网络接口的广播地址（子网广播更可靠）
     // 为每个接口创建绑定到该接口IP的socket，确保广播从正确的接口发出
@@ -243,7 +253,7 @@ void PeerDiscovery::sendBroadcast(int messageType)
             }
             
             // 发送广播（QUdpSocket默认支持广播，无需额外设置）
-            qint64 sent = tempSocket.writeDatagram(message, broadcast, m_udpPort);
+            qint64 sent = tempSocket.writeDatagram(message, messageSize, broadcast, m_udpPort);
             if (sent > 0) {
                 totalSent += sent;
                 qDebug() << "[PeerDiscovery] Sent broadcast to" << broadcast.toString() 
@@ -258,7 +268,7 @@ void PeerDiscovery::sendBroadcast(int messageType)
     }
     
     // 同时使用主socket发送到全局广播地址作为备用
-    qint64 globalSent = m_socket->writeDatagram(message, QHostAddress::Broadcast, m_udpPort);
+    qint64 globalSent = m_socket->writeDatagram(message, messageSize, QHostAddress::Broadcast, m_udpPort);
     if (globalSent > 0) {
         totalSent += globalSent;
         qDebug() << "[PeerDiscovery] Sent global broadcast (255.255.255.255)";
@@ -270,7 +280,7 @@ void PeerDiscovery::sendBroadcast(int messageType)
         const PeerNode& peer = it.value();
         QHostAddress peerAddr(peer.ipAddress().toString());
         if (!peerAddr.isNull() && !m_networkCache->isLocalAddress(peerAddr)) {
-            qint64 directSent = m_socket->writeDatagram(message, peerAddr, m_udpPort);
+            qint64 directSent = m_socket->writeDatagram(message, messageSize, peerAddr, m_udpPort);
             if (directSent > 0) {
                 totalSent += directSent;
                 qDebug() << "[PeerDiscovery] Sent direct to known peer" << peerAddr.toString();
@@ -286,26 +296,18 @@ void PeerDiscovery::sendBroadcast(int messageType)
     }
 }
 
-void PeerDiscovery::processReceivedMessage(const QByteArray& datagram, 
+void PeerDiscovery::processReceivedMessage(const uint8_t* data, std::size_t size,
                                           const QHostAddress& senderAddress)
 {
-    // 转换为std::vector<uint8_t>
-    std::vector<uint8_t> data(datagram.begin(), datagram.end());
-
-    // 验证消息格式
-    if (!m_serializer->isValidMessage(data)) {
-        qWarning() << "[PeerDiscovery] Invalid Protobuf message from" << senderAddress;
-        return;
-    }
-
-    // 反序列化节点信息
-    std::optional<PeerNode> nodeOpt = m_serializer->deserializePeerMessage(data);
-    if (!nodeOpt.has_value()) {
-        qWarning() << "[PeerDiscovery] Failed to deserialize message from" << senderAddress;
+    // 单次解析：格式校验与反序列化合并，直接在接收缓冲区上解码
+    auto result = m_serializer->decodePeerMessage(flykylin::ports::ByteView(data, size));
+    if (!result.ok()) {
+        qWarning() << "[PeerDiscovery] Invalid Protobuf message from" << senderAddress
+                   << "error=" << static_cast<int>(result.error) << "size=" << size;
         return;
     }
 
-    PeerNode node = nodeOpt.value();
+    PeerNode node = std::move(*result.value);
 
     // 使用广播中携带的userId作为全局唯一标识（来自对端UserProfile UUID 或实例ID）
     QString userId = node.userId();
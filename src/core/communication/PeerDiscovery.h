@@ -15,6 +15,8 @@
 #include <QMap>
 #include <QDateTime>
 #include <memory>
+#include <vector>
+#include <cstdint>
 #include "../models/PeerNode.h"
 
 // 前向声明
@@ -129,10 +131,12 @@ private:
 
     /**
      * @brief 处理接收到的UDP消息
-     * @param datagram 数据报内容
+     * @param data 数据报内容（直接指向接收缓冲区，不拷贝）
+     * @param size 数据报长度
      * @param senderAddress 发送者地址
      */
-    void processReceivedMessage(const QByteArray& datagram, const QHostAddress& senderAddress);
+    void processReceivedMessage(const uint8_t* data, std::size_t size,
+                                const QHostAddress& senderAddress);
 
     /**
      * @brief 检查并移除超时节点
@@ -153,6 +157,8 @@ private:
     QMap<QString, QDateTime> m_lastSeen;        ///< userId -> 最后心跳时间
     
     std::unique_ptr<flykylin::ports::I_MessageSerializer> m_serializer;  ///< Protobuf序列化器
+    std::vector<uint8_t> m_receiveBuffer;       ///< 复用的UDP接收缓冲区
+    std::vector<uint8_t> m_sendBuffer;          ///< 复用的广播序列化缓冲区
     flykylin::communication::NetworkInterfaceCache* m_networkCache;         ///< 网络接口缓存（性能优化）
     
     static constexpr int kBroadcastInterval = 5000;     ///< 广播间隔（毫秒）
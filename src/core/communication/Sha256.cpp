@@ -0,0 +1,379 @@
+/**
+ * @file Sha256.cpp
+ * @brief Streaming SHA-256 with SHA-NI / ARMv8 acceleration
+ * @author FlyKylin Development Team
+ * @date 2024-12-04
+ */
+
+#include "Sha256.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define FLYKYLIN_SHA256_X86 1
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <immintrin.h>
+#include <intrin.h>
+#define FLYKYLIN_SHA256_X86 1
+#elif defined(__aarch64__) && defined(__linux__) \
+    && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 10))
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#define FLYKYLIN_SHA256_ARM64 1
+#endif
+
+namespace flykylin {
+namespace communication {
+
+namespace {
+
+alignas(16) constexpr uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+constexpr uint32_t kInitialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+inline uint32_t rotr(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t loadBigEndian32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void blocksPortable(uint32_t state[8], const uint8_t* data, std::size_t blocks)
+{
+    uint32_t w[64];
+    while (blocks--) {
+        for (int i = 0; i < 16; ++i) {
+            w[i] = loadBigEndian32(data + 4 * i);
+        }
+        for (int i = 16; i < 64; ++i) {
+            const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            const uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            const uint32_t ch = (e & f) ^ (~e & g);
+            const uint32_t t1 = h + s1 + ch + kRoundConstants[i] + w[i];
+            const uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            const uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += 64;
+    }
+}
+
+#if defined(FLYKYLIN_SHA256_X86)
+
+// Same structure as Intel's reference code: the state lives in ABEF/CDGH
+// order, each sha256rnds2 does two rounds, and the message schedule is
+// rolled through four registers with sha256msg1/msg2.
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("sha,sse4.1")))
+#endif
+void blocksShaNi(uint32_t state[8], const uint8_t* data, std::size_t blocks)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);            // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);      // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);   // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);        // CDGH
+
+    while (blocks--) {
+        const __m128i abefSave = state0;
+        const __m128i cdghSave = state1;
+
+        __m128i msg[4];
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), byteSwap);
+        }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC unroll 16
+#endif
+        for (int g = 0; g < 16; ++g) {
+            __m128i& current = msg[g & 3];
+            if (g >= 4) {
+                // W[4g..4g+3] from the previous sixteen words
+                const __m128i w9to12 = _mm_alignr_epi8(msg[(g - 1) & 3], msg[(g - 2) & 3], 4);
+                __m128i next = _mm_sha256msg1_epu32(current, msg[(g - 3) & 3]);
+                next = _mm_add_epi32(next, w9to12);
+                current = _mm_sha256msg2_epu32(next, msg[(g - 1) & 3]);
+            }
+            __m128i wk = _mm_add_epi32(
+                current, _mm_load_si128(reinterpret_cast<const __m128i*>(&kRoundConstants[4 * g])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            wk = _mm_shuffle_epi32(wk, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+        }
+
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);         // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);      // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);   // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);      // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+bool detectHardware()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, 7, 0);
+    const bool sha = (info[1] & (1 << 29)) != 0;
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    return sha && sse41;
+#else
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & (1u << 29))) {
+        return false;
+    }
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+#elif defined(FLYKYLIN_SHA256_ARM64)
+
+__attribute__((target("+crypto")))
+void blocksArmV8(uint32_t state[8], const uint8_t* data, std::size_t blocks)
+{
+    uint32x4_t state0 = vld1q_u32(&state[0]);   // ABCD
+    uint32x4_t state1 = vld1q_u32(&state[4]);   // EFGH
+
+    while (blocks--) {
+        const uint32x4_t abcdSave = state0;
+        const uint32x4_t efghSave = state1;
+
+        uint32x4_t msg[4];
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+        }
+
+        for (int g = 0; g < 16; ++g) {
+            uint32x4_t& current = msg[g & 3];
+            const uint32x4_t wk = vaddq_u32(current, vld1q_u32(&kRoundConstants[4 * g]));
+            if (g < 12) {
+                // W[4g+16..4g+19] for a later group
+                current = vsha256su1q_u32(vsha256su0q_u32(current, msg[(g + 1) & 3]),
+                                          msg[(g + 2) & 3], msg[(g + 3) & 3]);
+            }
+            const uint32x4_t abcd = state0;
+            state0 = vsha256hq_u32(state0, state1, wk);
+            state1 = vsha256h2q_u32(state1, abcd, wk);
+        }
+
+        state0 = vaddq_u32(state0, abcdSave);
+        state1 = vaddq_u32(state1, efghSave);
+        data += 64;
+    }
+
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+bool detectHardware()
+{
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+}
+
+#endif
+
+bool hardwareAvailable()
+{
+#if defined(FLYKYLIN_SHA256_X86) || defined(FLYKYLIN_SHA256_ARM64)
+    static const bool available = detectHardware();
+    return available;
+#else
+    return false;
+#endif
+}
+
+} // namespace
+
+Sha256::Sha256(Implementation impl)
+    : m_impl(impl)
+    , m_blocks(&blocksPortable)
+{
+    if (m_impl == Implementation::Auto) {
+#if defined(FLYKYLIN_SHA256_X86)
+        m_impl = hardwareAvailable() ? Implementation::ShaNi : Implementation::Portable;
+#elif defined(FLYKYLIN_SHA256_ARM64)
+        m_impl = hardwareAvailable() ? Implementation::ArmV8 : Implementation::Portable;
+#else
+        m_impl = Implementation::Portable;
+#endif
+    }
+    if (!isSupported(m_impl)) {
+        m_impl = Implementation::Portable;
+    }
+
+#if defined(FLYKYLIN_SHA256_X86)
+    if (m_impl == Implementation::ShaNi) {
+        m_blocks = &blocksShaNi;
+    }
+#elif defined(FLYKYLIN_SHA256_ARM64)
+    if (m_impl == Implementation::ArmV8) {
+        m_blocks = &blocksArmV8;
+    }
+#endif
+    reset();
+}
+
+void Sha256::reset()
+{
+    std::memcpy(m_state, kInitialState, sizeof(m_state));
+    m_bufferSize = 0;
+    m_totalBytes = 0;
+}
+
+void Sha256::update(const void* data, std::size_t size)
+{
+    const auto* p = static_cast<const uint8_t*>(data);
+    m_totalBytes += size;
+
+    if (m_bufferSize > 0) {
+        const std::size_t take = std::min(size, sizeof(m_buffer) - m_bufferSize);
+        std::memcpy(m_buffer + m_bufferSize, p, take);
+        m_bufferSize += take;
+        p += take;
+        size -= take;
+        if (m_bufferSize < sizeof(m_buffer)) {
+            return;
+        }
+        m_blocks(m_state, m_buffer, 1);
+        m_bufferSize = 0;
+    }
+
+    // Whole blocks straight from the caller's buffer
+    const std::size_t blocks = size / 64;
+    if (blocks > 0) {
+        m_blocks(m_state, p, blocks);
+        p += blocks * 64;
+        size -= blocks * 64;
+    }
+
+    if (size > 0) {
+        std::memcpy(m_buffer, p, size);
+        m_bufferSize = size;
+    }
+}
+
+Sha256::Digest Sha256::finish()
+{
+    const uint64_t bitLength = m_totalBytes * 8;
+
+    m_buffer[m_bufferSize++] = 0x80;
+    if (m_bufferSize > 56) {
+        std::memset(m_buffer + m_bufferSize, 0, sizeof(m_buffer) - m_bufferSize);
+        m_blocks(m_state, m_buffer, 1);
+        m_bufferSize = 0;
+    }
+    std::memset(m_buffer + m_bufferSize, 0, 56 - m_bufferSize);
+    for (int i = 0; i < 8; ++i) {
+        m_buffer[56 + i] = static_cast<uint8_t>(bitLength >> (56 - 8 * i));
+    }
+    m_blocks(m_state, m_buffer, 1);
+    m_bufferSize = 0;
+
+    Digest digest;
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i] = static_cast<uint8_t>(m_state[i] >> 24);
+        digest[4 * i + 1] = static_cast<uint8_t>(m_state[i] >> 16);
+        digest[4 * i + 2] = static_cast<uint8_t>(m_state[i] >> 8);
+        digest[4 * i + 3] = static_cast<uint8_t>(m_state[i]);
+    }
+    return digest;
+}
+
+bool Sha256::isSupported(Implementation impl)
+{
+    switch (impl) {
+    case Implementation::Auto:
+    case Implementation::Portable:
+        return true;
+    case Implementation::ShaNi:
+#if defined(FLYKYLIN_SHA256_X86)
+        return hardwareAvailable();
+#else
+        return false;
+#endif
+    case Implementation::ArmV8:
+#if defined(FLYKYLIN_SHA256_ARM64)
+        return hardwareAvailable();
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char* Sha256::implementationName(Implementation impl)
+{
+    switch (impl) {
+    case Implementation::Auto:
+        return "auto";
+    case Implementation::Portable:
+        return "portable";
+    case Implementation::ShaNi:
+        return "sha-ni";
+    case Implementation::ArmV8:
+        return "armv8-sha2";
+    }
+    return "unknown";
+}
+
+std::string Sha256::toHex(const Digest& digest)
+{
+    static const char kHexDigits[] = "0123456789abcdef";
+    std::string hex(kDigestSize * 2, '0');
+    for (std::size_t i = 0; i < kDigestSize; ++i) {
+        hex[2 * i] = kHexDigits[digest[i] >> 4];
+        hex[2 * i + 1] = kHexDigits[digest[i] & 0x0F];
+    }
+    return hex;
+}
+
+} // namespace communication
+} // namespace flykylin
@@ -0,0 +1,70 @@
+/**
+ * @file Sha256.h
+ * @brief Streaming SHA-256 with SHA-NI / ARMv8 acceleration
+ * @author FlyKylin Development Team
+ * @date 2024-12-04
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace flykylin {
+namespace communication {
+
+/**
+ * @brief Incremental SHA-256 (FileTransferRequest.file_hash)
+ *
+ * Feed data with update() in any split, then finish(). The block function
+ * is picked once per object: x86 SHA extensions or the ARMv8 SHA2
+ * instructions when the CPU has them, a portable implementation otherwise.
+ */
+class Sha256 {
+public:
+    enum class Implementation {
+        Auto,       ///< Fastest supported
+        Portable,
+        ShaNi,      ///< x86 SHA extensions
+        ArmV8       ///< ARMv8 SHA2 instructions
+    };
+
+    static constexpr std::size_t kDigestSize = 32;
+    using Digest = std::array<uint8_t, kDigestSize>;
+
+    explicit Sha256(Implementation impl = Implementation::Auto);
+
+    void update(const void* data, std::size_t size);
+
+    /**
+     * @brief Pad and return the digest; call reset() before reusing the object
+     */
+    Digest finish();
+
+    void reset();
+
+    Implementation implementation() const { return m_impl; }
+
+    static bool isSupported(Implementation impl);
+    static const char* implementationName(Implementation impl);
+
+    /**
+     * @brief Lower-case hex form used on the wire
+     */
+    static std::string toHex(const Digest& digest);
+
+private:
+    using BlockFunction = void (*)(uint32_t state[8], const uint8_t* data, std::size_t blocks);
+
+    Implementation m_impl;
+    BlockFunction m_blocks;
+    uint32_t m_state[8];
+    uint8_t m_buffer[64];
+    std::size_t m_bufferSize{0};
+    uint64_t m_totalBytes{0};
+};
+
+} // namespace communication
+} // namespace flykylin
@@ -12,12 +12,24 @@
 #include <QHostAddress>
 #include <QDebug>
 #include <QNetworkProxy>
+#include <QtEndian>
 #include <string>
 #include "messages.pb.h"
 
 namespace flykylin {
 namespace communication {
 
+namespace {
+// Features this build understands; advertised in both handshake directions.
+constexpr quint32 kLocalCapabilities =
+    CapabilityFileDataFrame | CapabilityResumableTransfer | CapabilityStripedTransfer
+    | CapabilityContentStore | CapabilityImagePreview
+#ifdef Q_OS_LINUX
+    | CapabilityBulkTransfer
+#endif
+    ;
+}
+
 TcpConnection::TcpConnection(const QString& peerId, 
                              const QString& peerIp, 
                              quint16 peerPort, 
@@ -45,6 +57,7 @@ TcpConnection::TcpConnection(const QString& peerId,
     connect(m_socket, &QTcpSocket::connected, this, &TcpConnection::onConnected);
     connect(m_socket, &QTcpSocket::disconnected, this, &TcpConnection::onDisconnected);
     connect(m_socket, &QTcpSocket::readyRead, this, &TcpConnection::onReadyRead);
+    connect(m_socket, &QTcpSocket::bytesWritten, this, &TcpConnection::bytesWritten);
 #if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
     connect(m_socket, &QTcpSocket::errorOccurred, this, &TcpConnection::onSocketError);
 #else
@@ -98,6 +111,7 @@ TcpConnection::TcpConnection(const QString& peerId,
         connect(m_socket, &QTcpSocket::connected, this, &TcpConnection::onConnected);
         connect(m_socket, &QTcpSocket::disconnected, this, &TcpConnection::onDisconnected);
         connect(m_socket, &QTcpSocket::readyRead, this, &TcpConnection::onReadyRead);
+        connect(m_socket, &QTcpSocket::bytesWritten, this, &TcpConnection::bytesWritten);
 #if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
         connect(m_socket, &QTcpSocket::errorOccurred, this, &TcpConnection::onSocketError);
 #else
@@ -180,30 +194,46 @@ void TcpConnection::sendMessage(const QByteArray& data) {
         return;
     }
     
-    // Message frame: [4-byte length][protobuf payload]
-    QByteArray frame;
-    QDataStream stream(&frame, QIODevice::WriteOnly);
-    stream.setByteOrder(QDataStream::BigEndian);
+    // Message frame: [4-byte length][protobuf payload]. The length prefix and
+    // payload are written separately so the payload is not copied into a frame.
+    uchar prefix[4];
+    qToBigEndian<quint32>(static_cast<quint32>(data.size()), prefix);
+    if (!writeFrame(reinterpret_cast<const char*>(prefix), sizeof(prefix),
+                    data.constData(), data.size())) {
+        return;
+    }
     
-    quint32 length = static_cast<quint32>(data.size());
-    stream << length;
-    frame.append(data);
+    quint64 messageId = m_nextSequence++;
+    emit messageSent(messageId);
     
-    qint64 written = m_socket->write(frame);
-    if (written == -1) {
+    qDebug() << "[TcpConnection]" << m_peerId << "message sent, id=" << messageId << "size=" << data.size();
+}
+
+bool TcpConnection::sendFileData(const FileDataHeader& header, const char* data) {
+    if (m_state != ConnectionState::Connected || m_handshakeState != HandshakeState::Completed) {
+        qWarning() << "[TcpConnection]" << m_peerId << "Cannot send file data: connection not ready";
+        return false;
+    }
+
+    uint8_t prefix[kFileDataPrefixSize];
+    encodeFileDataPrefix(header, prefix);
+    return writeFrame(reinterpret_cast<const char*>(prefix), sizeof(prefix),
+                      data, static_cast<qint64>(header.length));
+}
+
+bool TcpConnection::writeFrame(const char* prefix, qint64 prefixSize,
+                               const char* data, qint64 size) {
+    if (m_socket->write(prefix, prefixSize) != prefixSize
+        || (size > 0 && m_socket->write(data, size) != size)) {
         QString error = QString("Write failed: %1").arg(m_socket->errorString());
         qCritical() << "[TcpConnection]" << m_peerId << error;
         emit messageFailed(m_nextSequence, error);
-        return;
+        return false;
     }
-    
+
     m_socket->flush();
     m_lastActivity = QDateTime::currentDateTime();
-    
-    quint64 messageId = m_nextSequence++;
-    emit messageSent(messageId);
-    
-    qDebug() << "[TcpConnection]" << m_peerId << "message sent, id=" << messageId << "size=" << data.size();
+    return true;
 }
 
 void TcpConnection::setState(ConnectionState newState, const QString& reason) {
@@ -228,7 +258,9 @@ void TcpConnection::onConnected() {
     m_retryCount = 0;
     m_lastActivity = QDateTime::currentDateTime();
 
-    // Start protobuf-based handshake
+    // Start protobuf-based handshake; drop any partial frame from a previous session
+    m_receiveBuffer.clear();
+    m_peerCapabilities = 0;
     m_handshakeState = HandshakeState::NotStarted;
     startHandshake();
 }
@@ -242,6 +274,12 @@ void TcpConnection::onDisconnected() {
     if (m_state == ConnectionState::Disconnected) {
         return;  // User-initiated disconnect
     }
+
+    // Data lanes are opened on demand; the sender dials a new one if needed
+    if (m_dataLane != 0) {
+        setState(ConnectionState::Disconnected, "Data lane closed");
+        return;
+    }
     
     // Unexpected disconnect - attempt reconnect
     if (m_state == ConnectionState::Connected || m_state == ConnectionState::Connecting) {
@@ -250,8 +288,33 @@ void TcpConnection::onDisconnected() {
     }
 }
 
+void TcpConnection::setReadsPaused(bool paused) {
+    if (m_readsPaused == paused) {
+        return;
+    }
+    m_readsPaused = paused;
+    qDebug() << "[TcpConnection]" << m_peerId << (paused ? "reads paused" : "reads resumed");
+
+    // A bounded read buffer makes QTcpSocket stop draining the kernel buffer
+    m_socket->setReadBufferSize(paused ? kPausedReadBufferSize : 0);
+    if (!paused) {
+        QMetaObject::invokeMethod(this, &TcpConnection::onReadyRead, Qt::QueuedConnection);
+    }
+}
+
 void TcpConnection::onReadyRead() {
-    m_receiveBuffer.append(m_socket->readAll());
+    if (m_readsPaused) {
+        return;   // picked up again by setReadsPaused(false)
+    }
+
+    // Read straight into the tail of the receive buffer (no readAll() temporary)
+    const qint64 available = m_socket->bytesAvailable();
+    if (available > 0) {
+        const int oldSize = m_receiveBuffer.size();
+        m_receiveBuffer.resize(oldSize + static_cast<int>(available));
+        const qint64 readBytes = m_socket->read(m_receiveBuffer.data() + oldSize, available);
+        m_receiveBuffer.resize(oldSize + static_cast<int>(qMax<qint64>(readBytes, 0)));
+    }
     m_lastActivity = QDateTime::currentDateTime();
     
     processIncomingData();
@@ -264,7 +327,9 @@ void TcpConnection::onSocketError(QAbstractSocket::SocketError error) {
     emit errorOccurred(errorString);
     
     // Handle connection errors
-    if (m_state == ConnectionState::Connecting) {
+    if (m_state == ConnectionState::Connecting && m_dataLane != 0) {
+        setState(ConnectionState::Failed, QString("Data lane failed: %1").arg(errorString));
+    } else if (m_state == ConnectionState::Connecting) {
         setState(ConnectionState::Reconnecting, QString("Connection failed: %1").arg(errorString));
         scheduleReconnect();
     }
@@ -273,9 +338,13 @@ void TcpConnection::onSocketError(QAbstractSocket::SocketError error) {
 void TcpConnection::onHeartbeatTimeout() {
     qint64 elapsed = m_lastActivity.msecsTo(QDateTime::currentDateTime());
     
-    if (elapsed > kTimeoutThreshold) {
+    // The peer's heartbeats sit unread while reads are paused
+    if (elapsed > kTimeoutThreshold && !m_readsPaused) {
         qWarning() << "[TcpConnection]" << m_peerId << "heartbeat timeout, disconnecting";
         disconnectFromHost();
+        if (m_dataLane != 0) {
+            return;
+        }
         setState(ConnectionState::Reconnecting, "Heartbeat timeout");
         scheduleReconnect();
     } else {
@@ -337,42 +406,72 @@ void TcpConnection::attemptReconnect() {
 }
 
 void TcpConnection::processIncomingData() {
-    while (m_receiveBuffer.size() >= 4) {
-        quint32 messageLength = readMessageLength();
-        
+    // Walk complete frames with a read offset and compact once at the end,
+    // instead of remove()-ing from the front of the buffer for every frame.
+    // The local reference keeps the bytes alive if a handler resets the buffer.
+    QByteArray buffer = m_receiveBuffer;
+    const char* base = buffer.constData();
+    const qint64 available = buffer.size();
+    qint64 offset = 0;
+
+    while (available - offset >= 4) {
+        const quint32 lengthWord = qFromBigEndian<quint32>(base + offset);
+        const bool isFileData = isFileDataFrame(lengthWord);
+        const quint32 messageLength = lengthWord & ~kFileDataFrameMarker;
+
         // Check if full message is available
-        if (m_receiveBuffer.size() < static_cast<int>(4 + messageLength)) {
+        if (available - offset < 4 + static_cast<qint64>(messageLength)) {
             break;  // Wait for more data
         }
-        
-        // Remove length header
-        m_receiveBuffer.remove(0, 4);
-        
+
+        const char* body = base + offset + 4;
+        offset += 4 + static_cast<qint64>(messageLength);
+
         // Handle heartbeat (zero-length message)
         if (messageLength == 0) {
             qDebug() << "[TcpConnection]" << m_peerId << "heartbeat received";
             m_lastActivity = QDateTime::currentDateTime();
             continue;
         }
-        
-        // Extract message payload
-        QByteArray messageData = m_receiveBuffer.left(messageLength);
-        m_receiveBuffer.remove(0, messageLength);
-        
+
+        if (isFileData) {
+            processFileDataFrame(body, messageLength);
+            continue;
+        }
+
+        // Protobuf messages may be retained by upper layers, so copy them out
+        QByteArray messageData(body, static_cast<int>(messageLength));
+
         qDebug() << "[TcpConnection]" << m_peerId << "message received, size=" << messageData.size();
-        
+
         // Process TcpMessage
         processTcpMessage(messageData);
     }
+
+    const bool unchanged = (m_receiveBuffer.constData() == base);
+    buffer = QByteArray();  // drop our reference so remove() does not detach
+    if (unchanged && offset > 0) {
+        m_receiveBuffer.remove(0, static_cast<int>(offset));
+    }
 }
 
-quint32 TcpConnection::readMessageLength() {
-    QDataStream stream(m_receiveBuffer);
-    stream.setByteOrder(QDataStream::BigEndian);
-    
-    quint32 length = 0;
-    stream >> length;
-    return length;
+void TcpConnection::processFileDataFrame(const char* body, quint32 size) {
+    if (m_handshakeState != HandshakeState::Completed) {
+        qWarning() << "[TcpConnection]" << m_peerId
+                   << "Received file data before handshake completed, dropping";
+        return;
+    }
+
+    FileDataHeader header;
+    if (!decodeFileDataHeader(reinterpret_cast<const uint8_t*>(body), size, header)) {
+        qWarning() << "[TcpConnection]" << m_peerId << "Malformed file-data frame, size=" << size;
+        return;
+    }
+
+    // Zero-copy view over the receive buffer; valid only during delivery
+    const QByteArray payload = QByteArray::fromRawData(body + kFileDataHeaderSize,
+                                                       static_cast<int>(header.length));
+    emit fileDataReceived(header, payload);
 }
 
 void TcpConnection::processTcpMessage(const QByteArray& messageData) {
@@ -433,9 +532,11 @@ void TcpConnection::sendHandshakeRequest() {
 
     flykylin::protocol::HandshakeRequest request;
     request.set_protocol_version("1.0");
-    request.set_user_id(profile.userId().toStdString());
+    request.set_user_id((m_localUserId.isEmpty() ? profile.userId() : m_localUserId).toStdString());
     request.set_user_name(profile.userName().toStdString());
     request.set_timestamp(QDateTime::currentMSecsSinceEpoch());
+    request.set_capabilities(kLocalCapabilities);
+    request.set_data_lane(m_dataLane);
 
     std::string payload;
     if (!request.SerializeToString(&payload)) {
@@ -496,10 +597,11 @@ void TcpConnection::sendHandshakeResponse(bool accepted, const QString& errorMsg
 
     flykylin::protocol::HandshakeResponse response;
     response.set_accepted(accepted);
-    response.set_user_id(profile.userId().toStdString());
+    response.set_user_id((m_localUserId.isEmpty() ? profile.userId() : m_localUserId).toStdString());
     response.set_user_name(profile.userName().toStdString());
     response.set_error_message(errorMsg.toStdString());
     response.set_timestamp(QDateTime::currentMSecsSinceEpoch());
+    response.set_capabilities(kLocalCapabilities);
 
     std::string payload;
     if (!response.SerializeToString(&payload)) {
@@ -558,11 +660,16 @@ void TcpConnection::handleHandshakeRequest(const QByteArray& payload) {
     // assigned by TcpServer; after handshake we prefer the stable userId.
     QString remoteUserId = QString::fromStdString(request.user_id());
     QString remotePeerName = QString::fromStdString(request.user_name());
+
+    // Set before peerIdUpdated so the manager can tell a data lane from a
+    // duplicate main connection
+    m_dataLane = request.data_lane();
     
     qInfo() << "[TcpConnection]" << m_peerId
             << "Received handshake request: user_id=" << remoteUserId
             << "user_name=" << remotePeerName
-            << "protocol=" << QString::fromStdString(request.protocol_version());
+            << "protocol=" << QString::fromStdString(request.protocol_version())
+            << "lane=" << request.data_lane();
     
     if (!remoteUserId.isEmpty()) {
         QString oldPeerId = m_peerId;
@@ -577,6 +684,7 @@ void TcpConnection::handleHandshakeRequest(const QByteArray& payload) {
     }
 
     m_peerName = remotePeerName;
+    m_peerCapabilities = request.capabilities();
 
     // For now we always accept; policy checks can be added here later.
     sendHandshakeResponse(true, QString());
@@ -598,6 +706,7 @@ void TcpConnection::handleHandshakeResponse(const QByteArray& payload) {
 
     m_handshakeTimer->stop();
     m_peerName = QString::fromStdString(response.user_name());
+    m_peerCapabilities = response.capabilities();
 
     if (!response.accepted()) {
         QString error = QString::fromStdString(response.error_message());
@@ -619,6 +728,20 @@ void TcpConnection::handleHandshakeResponse(const QByteArray& payload) {
         return;
     }
 
+    // We dialed a remembered address: whoever answers there now may be
+    // someone else (DHCP reuse, another instance on the same host)
+    const QString remoteUserId = QString::fromStdString(response.user_id());
+    if (remoteUserId != m_peerId) {
+        const QString error = QStringLiteral("Peer identity mismatch: expected %1, got %2")
+                                  .arg(m_peerId, remoteUserId);
+        qWarning() << "[TcpConnection]" << m_peerId << error;
+
+        m_handshakeState = HandshakeState::Failed;
+        emit handshakeFailed(error);
+        disconnectFromHost();
+        return;
+    }
+
     m_handshakeState = HandshakeState::Completed;
 
     qInfo() << "[TcpConnection]" << m_peerId
@@ -12,10 +12,25 @@
 #include <QTimer>
 #include <QDateTime>
 #include <QByteArray>
+#include <QMetaType>
+
+#include "FileDataFrame.h"
 
 namespace flykylin {
 namespace communication {
 
+/**
+ * @brief Optional protocol features advertised in the handshake (bit flags)
+ */
+enum PeerCapability : quint32 {
+    CapabilityFileDataFrame = 0x1,      ///< Understands raw file-data frames (FileDataFrame.h)
+    CapabilityResumableTransfer = 0x2,  ///< FILE_RESPONSE missing ranges, CRC32C chunks, FILE_COMPLETE
+    CapabilityStripedTransfer = 0x4,    ///< Accepts extra data-lane connections (HandshakeRequest.data_lane)
+    CapabilityContentStore = 0x8,       ///< Skips files it already has by FileTransferRequest.file_hash
+    CapabilityBulkTransfer = 0x10,      ///< Receives sendfile/splice data on FileTransferResponse.port (Linux)
+    CapabilityImagePreview = 0x20       ///< Renders FILE_PREVIEW thumbnails ahead of the full image
+};
+
 /**
  * @brief TCP connection state enum
  */
@@ -96,6 +111,29 @@ public:
      * @param data Serialized Protobuf message
      */
     void sendMessage(const QByteArray& data);
+
+    /**
+     * @brief Send a raw file-data frame
+     * @param header Frame header; header.length bytes are read from data
+     * @param data File bytes (written straight to the socket, no intermediate frame)
+     * @return false if not connected / handshake incomplete / write failed
+     */
+    bool sendFileData(const FileDataHeader& header, const char* data);
+
+    /**
+     * @brief Stop or restart reading from the socket
+     *
+     * While paused only a small socket buffer is filled, so the TCP window
+     * closes and the peer's writes back up instead of piling up in memory.
+     * Used when the receiver's disk cannot keep up.
+     */
+    void setReadsPaused(bool paused);
+    bool readsPaused() const { return m_readsPaused; }
+
+    /**
+     * @brief Bytes queued in the socket but not yet written to the network
+     */
+    qint64 bytesToWrite() const { return m_socket ? m_socket->bytesToWrite() : 0; }
     
     // State query
     /**
@@ -108,15 +146,53 @@ public:
      */
     QString peerId() const { return m_peerId; }
 
+    /**
+     * @brief Get remote IP address
+     */
+    QString peerIp() const { return m_peerIp; }
+
     /**
      * @brief Check if application-level handshake has completed
      */
     bool isHandshakeCompleted() const { return m_handshakeState == HandshakeState::Completed; }
+
+    /**
+     * @brief Capabilities advertised by the peer during handshake (PeerCapability bits)
+     */
+    quint32 peerCapabilities() const { return m_peerCapabilities; }
     
     /**
      * @brief Get last activity time
      */
     QDateTime lastActivity() const { return m_lastActivity; }
+
+    /**
+     * @brief Mark an outbound connection as a file data lane (call before connectToHost)
+     *
+     * Data lanes are extra connections to an already connected peer that
+     * only carry file-data frames. The lane number is sent in the handshake
+     * so the accepting side does not treat it as a duplicate connection.
+     * Lanes are not reconnected: a lost lane is simply closed.
+     */
+    void setDataLane(quint32 lane) { m_dataLane = lane; }
+
+    /**
+     * @brief Data lane number (0 for the peer's main connection)
+     */
+    quint32 dataLane() const { return m_dataLane; }
+    bool isDataLane() const { return m_dataLane != 0; }
+
+    /**
+     * @brief True if this connection was accepted by TcpServer
+     */
+    bool isIncoming() const { return m_isIncoming; }
+
+    /**
+     * @brief User ID announced in our handshake (default: UserProfile)
+     *
+     * Lets a test stand in for another user in the same process.
+     */
+    void setLocalUserId(const QString& userId) { m_localUserId = userId; }
     
 signals:
     /**
@@ -131,7 +207,22 @@ signals:
      * @param data Received message data
      */
     void messageReceived(const QByteArray& data);
+
+    /**
+     * @brief Raw file-data frame received
+     * @param header Decoded frame header
+     * @param data Payload view into the receive buffer, only valid during
+     *             the (direct) signal delivery - copy it to keep it
+     */
+    void fileDataReceived(const flykylin::communication::FileDataHeader& header,
+                          const QByteArray& data);
     
+    /**
+     * @brief Socket flushed bytes to the network (used for send backpressure)
+     * @param bytes Number of bytes written
+     */
+    void bytesWritten(qint64 bytes);
+
     /**
      * @brief Message sent successfully
      * @param messageId Message sequence ID
@@ -204,7 +295,8 @@ private:
     // Data processing
     void processIncomingData();
     void processTcpMessage(const QByteArray& messageData);
-    quint32 readMessageLength();
+    void processFileDataFrame(const char* body, quint32 size);
+    bool writeFrame(const char* prefix, qint64 prefixSize, const char* data, qint64 size);
     
     // Member variables
     QString m_peerId;              ///< Peer user ID
@@ -228,12 +320,19 @@ private:
     quint64 m_nextSequence;        ///< Next message sequence number
     
     bool m_isIncoming;             ///< True if this connection was accepted by TcpServer
+    quint32 m_peerCapabilities{0}; ///< PeerCapability bits from handshake
+    quint32 m_dataLane{0};         ///< Data lane number, 0 = main connection
+    bool m_readsPaused{false};     ///< See setReadsPaused()
+    QString m_localUserId;         ///< Overrides UserProfile in the handshake if set
     
     // Constants
     static constexpr int kHeartbeatInterval = 30000;  ///< 30 seconds
     static constexpr int kTimeoutThreshold = 60000;   ///< 60 seconds timeout
     static constexpr int kHandshakeTimeout = 5000;    ///< 5 seconds handshake timeout
+    static constexpr qint64 kPausedReadBufferSize = 64 * 1024;  ///< Socket buffer while reads are paused
 };
 
 } // namespace communication
 } // namespace flykylin
+
+Q_DECLARE_METATYPE(flykylin::communication::FileDataHeader)
@@ -9,8 +9,11 @@
 #include "../models/PeerNode.h"
 #include "../communication/PeerDiscovery.h"
 #include "../config/UserProfile.h"
+#include "../database/DatabaseService.h"
 #include <QDebug>
+#include <QDateTime>
 #include <QMetaObject>
+#include <QPointer>
 
 namespace flykylin {
 namespace communication {
@@ -51,16 +54,7 @@ void TcpConnectionManager::addIncomingConnection(const QString& peerId, QTcpSock
     TcpConnection* conn = new TcpConnection(peerId, socket, this);
 
     // Connect signals
-    connect(conn, &TcpConnection::stateChanged,
-            this, &TcpConnectionManager::onConnectionStateChanged);
-    connect(conn, &TcpConnection::messageReceived,
-            this, &TcpConnectionManager::onMessageReceived);
-    connect(conn, &TcpConnection::messageSent,
-            this, &TcpConnectionManager::onMessageSent);
-    connect(conn, &TcpConnection::messageFailed,
-            this, &TcpConnectionManager::onMessageFailed);
-    connect(conn, &TcpConnection::peerIdUpdated,
-            this, &TcpConnectionManager::onPeerIdUpdated);
+    connectConnectionSignals(conn);
 
     m_connections[peerId] = conn;
 
@@ -82,6 +76,10 @@ TcpConnectionManager::TcpConnectionManager(QObject* parent)
 }
 
 TcpConnectionManager::~TcpConnectionManager() {
+    for (const QString& peerId : m_dataLanes.keys()) {
+        dropDataLanes(peerId, false);
+    }
+
     // Disconnect all connections
     for (auto* conn : m_connections) {
         conn->disconnectFromHost();
@@ -127,6 +125,94 @@ void TcpConnectionManager::setupPeerDiscovery(QObject* peerDiscovery) {
     }
 }
 
+void TcpConnectionManager::warmStartFromDatabase() {
+    const QString localUserId = flykylin::core::UserProfile::instance().userId();
+    const qint64 since = QDateTime::currentMSecsSinceEpoch() - kWarmStartMaxAge;
+
+    const QList<database::DatabaseService::PeerInfo> peers =
+        database::DatabaseService::instance()->loadRecentPeers(since, kMaxConnections);
+
+    m_warmStartPending.clear();
+    for (const auto& peer : peers) {
+        if (peer.userId.isEmpty() || peer.userId == localUserId) {
+            continue;
+        }
+        // Same deterministic dialing rule as onPeerDiscovered: the larger userId
+        // waits for our incoming connection instead of dialing.
+        rememberPeerEndpoint(peer.userId, peer.ipAddress, peer.tcpPort);
+        if (localUserId >= peer.userId || m_connections.contains(peer.userId)) {
+            continue;
+        }
+        m_warmStartPending.append({peer.userId, peer.ipAddress, peer.tcpPort});
+    }
+
+    qInfo() << "[TcpConnectionManager] Warm-start: loaded" << peers.size()
+            << "recent peers," << m_warmStartPending.size() << "to probe";
+
+    if (m_warmStartPending.isEmpty()) {
+        return;
+    }
+
+    m_warmStartFirstConnected = false;
+    m_warmStartTimer.start();
+    launchWarmStartProbes();
+}
+
+void TcpConnectionManager::launchWarmStartProbes() {
+    while (m_warmStartInFlight.size() < kMaxWarmStartProbes && !m_warmStartPending.isEmpty()) {
+        const WarmStartTarget target = m_warmStartPending.takeFirst();
+
+        // Discovery (or an incoming connection) may have beaten us to it.
+        if (m_connections.contains(target.peerId)) {
+            continue;
+        }
+
+        qInfo() << "[TcpConnectionManager] Warm-start probe" << target.peerId << "at"
+                << target.ip << ":" << target.port;
+
+        m_warmStartInFlight.insert(target.peerId);
+        connectToPeer(target.peerId, target.ip, target.port);
+
+        const QString peerId = target.peerId;
+        QTimer::singleShot(kWarmStartProbeTimeout, this, [this, peerId]() {
+            if (m_warmStartInFlight.contains(peerId)) {
+                finishWarmStartProbe(peerId, false);
+            }
+        });
+    }
+}
+
+void TcpConnectionManager::finishWarmStartProbe(const QString& peerId, bool connected) {
+    if (!m_warmStartInFlight.remove(peerId)) {
+        return;
+    }
+
+    if (connected) {
+        if (!m_warmStartFirstConnected) {
+            m_warmStartFirstConnected = true;
+            qInfo() << "[TcpConnectionManager] Warm-start: first peer connected" << peerId
+                    << "time_to_first_connected_ms=" << m_warmStartTimer.elapsed();
+        }
+    } else {
+        qInfo() << "[TcpConnectionManager] Warm-start probe failed for" << peerId
+                << "- leaving it to discovery";
+        // Drop the connection asynchronously: we may be inside its own signal emission.
+        QMetaObject::invokeMethod(this, [this, peerId]() {
+            TcpConnection* conn = m_connections.value(peerId, nullptr);
+            if (conn && conn->state() != ConnectionState::Connected) {
+                disconnectFromPeer(peerId);
+            }
+        }, Qt::QueuedConnection);
+    }
+
+    launchWarmStartProbes();
+
+    if (m_warmStartInFlight.isEmpty() && m_warmStartPending.isEmpty()) {
+        qInfo() << "[TcpConnectionManager] Warm-start finished in" << m_warmStartTimer.elapsed()
+                << "ms, active=" << activeConnectionCount();
+    }
+}
+
 void TcpConnectionManager::onPeerDiscovered(const flykylin::core::PeerNode& node) {
     const QString peerId = node.userId();
     const QString ip = node.ipAddress().toString();
@@ -144,6 +230,9 @@ void TcpConnectionManager::onPeerDiscovered(const flykylin::core::PeerNode& node
         return;
     }
 
+    // Either side may dial data lanes, so keep the address even if we do not dial
+    rememberPeerEndpoint(peerId, ip, port);
+
     // Deterministic dialing rule: to avoid duplicate cross-connections and
     // handshake loops, only the peer whose userId is lexicographically
     // smaller initiates the outbound TCP connection. The other side relies on
@@ -178,12 +267,15 @@ void TcpConnectionManager::connectToPeer(const QString& peerId, const QString& i
         return;
     }
     
+    rememberPeerEndpoint(peerId, ip, port);
     TcpConnection* conn = getOrCreateConnection(peerId, ip, port);
     conn->connectToHost();
 }
 
 void TcpConnectionManager::disconnectFromPeer(const QString& peerId) {
     qInfo() << "[TcpConnectionManager] Disconnect from peer" << peerId;
+
+    dropDataLanes(peerId, false);
     
     if (!m_connections.contains(peerId)) {
         qWarning() << "[TcpConnectionManager] No connection for peer" << peerId;
@@ -237,6 +329,160 @@ void TcpConnectionManager::sendMessage(const QString& peerId,
     }
 }
 
+bool TcpConnectionManager::sendFileData(const QString& peerId,
+                                        const FileDataHeader& header,
+                                        const char* data,
+                                        int stripes) {
+    TcpConnection* conn = leastBackloggedConnection(peerId, stripes);
+    if (!conn) {
+        return false;
+    }
+    return conn->sendFileData(header, data);
+}
+
+TcpConnection* TcpConnectionManager::leastBackloggedConnection(const QString& peerId,
+                                                               int stripes) const {
+    TcpConnection* best = m_connections.value(peerId, nullptr);
+    if (!best || best->state() != ConnectionState::Connected || !best->isHandshakeCompleted()) {
+        return nullptr;
+    }
+
+    const auto lanes = m_dataLanes.constFind(peerId);
+    if (stripes <= 1 || lanes == m_dataLanes.constEnd()) {
+        return best;
+    }
+
+    int used = 1;
+    for (TcpConnection* lane : lanes.value()) {
+        if (used >= stripes) {
+            break;
+        }
+        if (lane->state() != ConnectionState::Connected || !lane->isHandshakeCompleted()) {
+            continue;
+        }
+        ++used;
+        if (lane->bytesToWrite() < best->bytesToWrite()) {
+            best = lane;
+        }
+    }
+    return best;
+}
+
+int TcpConnectionManager::openDataLanes(const QString& peerId, int lanes) {
+    lanes = qBound(0, lanes, kMaxDataLanes);
+    if (!isPeerReady(peerId) || !(peerCapabilities(peerId) & CapabilityStripedTransfer)) {
+        return 0;
+    }
+
+    const auto endpoint = m_peerEndpoints.constFind(peerId);
+    const int existing = m_dataLanes.value(peerId).size();
+    if (existing >= lanes || endpoint == m_peerEndpoints.constEnd()) {
+        return readyDataLaneCount(peerId);
+    }
+
+    QList<TcpConnection*> dialed;
+    for (int lane = existing + 1; lane <= lanes; ++lane) {
+        auto* conn = new TcpConnection(peerId, endpoint->ip, endpoint->port, this);
+        conn->setDataLane(static_cast<quint32>(lane));
+        connectDataLaneSignals(conn);
+        m_dataLanes[peerId].append(conn);
+        dialed.append(conn);
+    }
+
+    qInfo() << "[TcpConnectionManager] Opening" << dialed.size() << "data lanes to" << peerId
+            << "at" << endpoint->ip << ":" << endpoint->port;
+    for (TcpConnection* conn : dialed) {
+        conn->connectToHost();
+    }
+    return readyDataLaneCount(peerId);
+}
+
+void TcpConnectionManager::closeDataLanes(const QString& peerId) {
+    // Lanes the peer dialed belong to its own transfers; leave them to it
+    dropDataLanes(peerId, true);
+}
+
+void TcpConnectionManager::dropDataLanes(const QString& peerId, bool dialedOnly) {
+    auto it = m_dataLanes.find(peerId);
+    if (it == m_dataLanes.end()) {
+        return;
+    }
+
+    QList<TcpConnection*> closing;
+    for (auto laneIt = it->begin(); laneIt != it->end();) {
+        if (dialedOnly && (*laneIt)->isIncoming()) {
+            ++laneIt;
+            continue;
+        }
+        closing.append(*laneIt);
+        laneIt = it->erase(laneIt);
+    }
+    if (it->isEmpty()) {
+        m_dataLanes.erase(it);
+    }
+
+    if (!closing.isEmpty()) {
+        qInfo() << "[TcpConnectionManager] Closing" << closing.size() << "data lanes to" << peerId;
+    }
+    for (TcpConnection* conn : closing) {
+        disconnect(conn, nullptr, this, nullptr);
+        conn->disconnectFromHost();
+        conn->deleteLater();
+    }
+}
+
+int TcpConnectionManager::readyDataLaneCount(const QString& peerId) const {
+    int count = 0;
+    for (const TcpConnection* lane : m_dataLanes.value(peerId)) {
+        if (lane->state() == ConnectionState::Connected && lane->isHandshakeCompleted()) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void TcpConnectionManager::setPeerReadsPaused(const QString& peerId, bool paused) {
+    if (TcpConnection* conn = m_connections.value(peerId, nullptr)) {
+        conn->setReadsPaused(paused);
+    }
+    for (TcpConnection* lane : m_dataLanes.value(peerId)) {
+        lane->setReadsPaused(paused);
+    }
+}
+
+void TcpConnectionManager::rememberPeerEndpoint(const QString& peerId,
+                                                const QString& ip,
+                                                quint16 port) {
+    if (peerId.isEmpty() || ip.isEmpty() || port == 0) {
+        return;
+    }
+    PeerEndpoint& endpoint = m_peerEndpoints[peerId];
+    endpoint.ip = ip;
+    endpoint.port = port;
+}
+
+bool TcpConnectionManager::isPeerReady(const QString& peerId) const {
+    const TcpConnection* conn = m_connections.value(peerId, nullptr);
+    return conn && conn->state() == ConnectionState::Connected && conn->isHandshakeCompleted();
+}
+
+quint32 TcpConnectionManager::peerCapabilities(const QString& peerId) const {
+    const TcpConnection* conn = m_connections.value(peerId, nullptr);
+    return conn ? conn->peerCapabilities() : 0;
+}
+
+QString TcpConnectionManager::peerAddress(const QString& peerId) const {
+    const TcpConnection* conn = m_connections.value(peerId, nullptr);
+    return conn ? conn->peerIp() : QString();
+}
+
+qint64 TcpConnectionManager::pendingWriteBytes(const QString& peerId, int stripes) const {
+    const TcpConnection* conn = stripes > 1
+            ? leastBackloggedConnection(peerId, stripes)
+            : m_connections.value(peerId, nullptr);
+    return conn ? conn->bytesToWrite() : 0;
+}
+
 ConnectionState TcpConnectionManager::getConnectionState(const QString& peerId) const {
     if (!m_connections.contains(peerId)) {
         return ConnectionState::Disconnected;
@@ -270,6 +516,14 @@ void TcpConnectionManager::onConnectionStateChanged(ConnectionState state, QStri
     if (state == ConnectionState::Connected) {
         processMessageQueue(peerId);
     }
+
+    if (m_warmStartInFlight.contains(peerId)) {
+        if (state == ConnectionState::Connected) {
+            finishWarmStartProbe(peerId, true);
+        } else if (state == ConnectionState::Reconnecting || state == ConnectionState::Failed) {
+            finishWarmStartProbe(peerId, false);
+        }
+    }
 }
 
 void TcpConnectionManager::onMessageReceived(const QByteArray& data) {
@@ -285,6 +539,16 @@ void TcpConnectionManager::onMessageReceived(const QByteArray& data) {
     emit messageReceived(peerId, data);
 }
 
+void TcpConnectionManager::onFileDataReceived(const FileDataHeader& header,
+                                              const QByteArray& data) {
+    TcpConnection* conn = qobject_cast<TcpConnection*>(sender());
+    if (!conn) {
+        return;
+    }
+
+    emit fileDataReceived(conn->peerId(), header, data);
+}
+
 void TcpConnectionManager::onMessageSent(quint64 messageId) {
     TcpConnection* conn = qobject_cast<TcpConnection*>(sender());
     if (!conn) {
@@ -316,6 +580,12 @@ void TcpConnectionManager::onPeerIdUpdated(const QString& oldPeerId, const QStri
         return;
     }
 
+    TcpConnection* laneConn = m_connections.value(oldPeerId, nullptr);
+    if (laneConn && laneConn->isDataLane()) {
+        adoptDataLane(oldPeerId, newPeerId, laneConn);
+        return;
+    }
+
     if (!m_connections.contains(oldPeerId)) {
         qWarning() << "[TcpConnectionManager] peerIdUpdated: old peerId not found" << oldPeerId
                    << "->" << newPeerId << "current connections:" << m_connections.keys();
@@ -423,6 +693,51 @@ void TcpConnectionManager::onPeerIdUpdated(const QString& oldPeerId, const QStri
                                 QStringLiteral("Peer ID updated after handshake"));
 }
 
+void TcpConnectionManager::adoptDataLane(const QString& oldPeerId,
+                                         const QString& peerId,
+                                         TcpConnection* conn) {
+    // An incoming data lane is not a second main connection: move it out of
+    // m_connections before the duplicate-connection logic sees it
+    m_connections.remove(oldPeerId);
+    disconnect(conn, nullptr, this, nullptr);
+
+    if (!m_connections.contains(peerId)
+        || m_dataLanes.value(peerId).size() >= 2 * kMaxDataLanes) {
+        qWarning() << "[TcpConnectionManager] Rejecting data lane" << conn->dataLane()
+                   << "from" << peerId << "(no main connection or too many lanes)";
+        conn->disconnectFromHost();
+        conn->deleteLater();
+        return;
+    }
+
+    connectDataLaneSignals(conn);
+    m_dataLanes[peerId].append(conn);
+    qInfo() << "[TcpConnectionManager] Accepted data lane" << conn->dataLane() << "from" << peerId
+            << "lanes=" << m_dataLanes[peerId].size();
+}
+
+void TcpConnectionManager::onDataLaneStateChanged(ConnectionState state, QString reason) {
+    TcpConnection* conn = qobject_cast<TcpConnection*>(sender());
+    if (!conn || state == ConnectionState::Connected || state == ConnectionState::Connecting) {
+        return;
+    }
+
+    // Not reported through connectionStateChanged: the peer itself is still connected
+    const QString peerId = conn->peerId();
+    auto it = m_dataLanes.find(peerId);
+    if (it != m_dataLanes.end()) {
+        it->removeAll(conn);
+        if (it->isEmpty()) {
+            m_dataLanes.erase(it);
+        }
+    }
+
+    qInfo() << "[TcpConnectionManager] Data lane" << conn->dataLane() << "to" << peerId
+            << "closed:" << reason;
+    disconnect(conn, nullptr, this, nullptr);
+    conn->deleteLater();
+}
+
 void TcpConnectionManager::cleanupIdleConnections() {
     QDateTime now = QDateTime::currentDateTime();
     QList<QString> toRemove;
@@ -486,24 +801,67 @@ TcpConnection* TcpConnectionManager::getOrCreateConnection(const QString& peerId
     TcpConnection* conn = new TcpConnection(peerId, ip, port, this);
 
     // Connect signals
+    connectConnectionSignals(conn);
+
+    m_connections[peerId] = conn;
+
+    return conn;
+}
+
+void TcpConnectionManager::connectConnectionSignals(TcpConnection* conn) {
     connect(conn, &TcpConnection::stateChanged,
             this, &TcpConnectionManager::onConnectionStateChanged);
     connect(conn, &TcpConnection::messageReceived,
             this, &TcpConnectionManager::onMessageReceived);
+    connect(conn, &TcpConnection::fileDataReceived,
+            this, &TcpConnectionManager::onFileDataReceived, Qt::DirectConnection);
     connect(conn, &TcpConnection::messageSent,
             this, &TcpConnectionManager::onMessageSent);
     connect(conn, &TcpConnection::messageFailed,
             this, &TcpConnectionManager::onMessageFailed);
     connect(conn, &TcpConnection::peerIdUpdated,
             this, &TcpConnectionManager::onPeerIdUpdated);
+    connect(conn, &TcpConnection::bytesWritten,
+            this, [this, conn](qint64 bytes) { emit peerBytesWritten(conn->peerId(), bytes); });
 
-    // When handshake completes, ensure any queued messages are flushed.
+    // When handshake completes, ensure any queued messages are flushed. The
+    // peer ID is read at emit time because inbound connections are re-keyed
+    // from IP:port to the remote userId during the handshake.
     connect(conn, &TcpConnection::handshakeCompleted,
-            this, [this, peerId]() { processMessageQueue(peerId); });
-
-    m_connections[peerId] = conn;
+            this, [this, conn]() {
+                const QString peerId = conn->peerId();
+                processMessageQueue(peerId);
+                emit peerReady(peerId);
+            });
+
+    // A refused handshake (or someone else answering at a stale address) is
+    // not worth reconnecting: drop it so discovery dials the current address.
+    // Asynchronously, as we are inside the connection's own signal.
+    connect(conn, &TcpConnection::handshakeFailed,
+            this, [this, conn](const QString& error) {
+                const QString peerId = conn->peerId();
+                qWarning() << "[TcpConnectionManager] Handshake with" << peerId << "failed:" << error
+                           << "- dropping the connection";
+                QPointer<TcpConnection> failed(conn);
+                QMetaObject::invokeMethod(this, [this, failed, peerId]() {
+                    if (failed && m_connections.value(peerId, nullptr) == failed) {
+                        disconnectFromPeer(peerId);
+                    }
+                }, Qt::QueuedConnection);
+            });
+}
 
-    return conn;
+void TcpConnectionManager::connectDataLaneSignals(TcpConnection* conn) {
+    connect(conn, &TcpConnection::stateChanged,
+            this, &TcpConnectionManager::onDataLaneStateChanged);
+    connect(conn, &TcpConnection::messageReceived,
+            this, &TcpConnectionManager::onMessageReceived);
+    connect(conn, &TcpConnection::fileDataReceived,
+            this, &TcpConnectionManager::onFileDataReceived, Qt::DirectConnection);
+    connect(conn, &TcpConnection::bytesWritten,
+            this, [this, conn](qint64 bytes) { emit peerBytesWritten(conn->peerId(), bytes); });
+    connect(conn, &TcpConnection::handshakeCompleted,
+            this, [this, conn]() { emit dataLaneReady(conn->peerId()); });
 }
 
 } // namespace communication
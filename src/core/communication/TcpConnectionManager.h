@@ -11,7 +11,10 @@
 #include "MessageQueue.h"
 #include <QObject>
 #include <QMap>
+#include <QSet>
+#include <QList>
 #include <QTimer>
+#include <QElapsedTimer>
 
 namespace flykylin {
 namespace core {
@@ -26,6 +29,7 @@ namespace communication {
  * - Manage up to 20 concurrent TCP connections
  * - Auto-cleanup idle connections (5 minutes timeout)
  * - Per-connection message queue
+ * - Extra per-peer data lanes for striped file transfers
  * - Thread-safe via Qt signal/slot mechanism
  */
 class TcpConnectionManager : public QObject {
@@ -69,6 +73,69 @@ public:
                      const QByteArray& data, 
                      MessageQueue::Priority priority = MessageQueue::Priority::High);
     
+    /**
+     * @brief Send a raw file-data frame directly (never queued)
+     * @param peerId Peer user ID
+     * @param header Frame header; header.length bytes are read from data
+     * @param data File bytes
+     * @param stripes Connections to spread over: the main connection plus up
+     *                to stripes-1 ready data lanes; the least backlogged one
+     *                carries the frame
+     * @return false if the peer is not ready (see isPeerReady)
+     */
+    bool sendFileData(const QString& peerId,
+                      const FileDataHeader& header,
+                      const char* data,
+                      int stripes = 1);
+
+    /**
+     * @brief Dial extra data-lane connections to a ready peer
+     *
+     * Only for peers advertising CapabilityStripedTransfer whose address is
+     * known from discovery. Lanes that are already open or connecting count
+     * towards lanes; at most kMaxDataLanes are kept per peer.
+     * @return Number of data lanes that have completed their handshake
+     */
+    int openDataLanes(const QString& peerId, int lanes);
+
+    /**
+     * @brief Close all data lanes to a peer (the main connection stays)
+     */
+    void closeDataLanes(const QString& peerId);
+
+    /**
+     * @brief Data lanes to the peer that can carry file data
+     */
+    int readyDataLaneCount(const QString& peerId) const;
+
+    /**
+     * @brief Pause or resume reading from the peer's main connection and data lanes
+     * @see TcpConnection::setReadsPaused
+     */
+    void setPeerReadsPaused(const QString& peerId, bool paused);
+
+    /**
+     * @brief True if connected and the application handshake has completed
+     */
+    bool isPeerReady(const QString& peerId) const;
+
+    /**
+     * @brief PeerCapability bits advertised by the peer (0 if not connected)
+     */
+    quint32 peerCapabilities(const QString& peerId) const;
+
+    /**
+     * @brief Remote IP address of the peer's main connection (empty if not connected)
+     */
+    QString peerAddress(const QString& peerId) const;
+
+    /**
+     * @brief Bytes buffered in the peer's socket but not yet on the wire
+     * @param stripes As for sendFileData: report the least backlogged of the
+     *                connections the next striped frame could use
+     */
+    qint64 pendingWriteBytes(const QString& peerId, int stripes = 1) const;
+
     /**
      * @brief Get connection state
      * @param peerId Peer user ID
@@ -88,6 +155,18 @@ public:
      */
     void addIncomingConnection(const QString& peerId, QTcpSocket* socket);
 
+    /**
+     * @brief Warm-start outbound connections from the persisted peers table
+     *
+     * Loads peers seen within kWarmStartMaxAge from DatabaseService and probes
+     * them in parallel (at most kMaxWarmStartProbes in flight), so connections
+     * are being established while UDP discovery catches up. The usual dialing
+     * rule applies: only peers with a larger userId are dialed. Probes that do
+     * not connect within kWarmStartProbeTimeout are dropped instead of
+     * retrying a possibly stale address; discovery reconnects them later.
+     */
+    void warmStartFromDatabase();
+
 signals:
     /**
      * @brief Connection state changed
@@ -98,7 +177,32 @@ signals:
      * @brief Message received from peer
      */
     void messageReceived(QString peerId, QByteArray data);
+
+    /**
+     * @brief Raw file-data frame received from peer
+     *
+     * data is a view into the connection's receive buffer and is only valid
+     * during delivery; connect with Qt::DirectConnection and copy if needed.
+     */
+    void fileDataReceived(const QString& peerId,
+                          const flykylin::communication::FileDataHeader& header,
+                          const QByteArray& data);
     
+    /**
+     * @brief Connection to peer finished its handshake and can carry data
+     */
+    void peerReady(QString peerId);
+
+    /**
+     * @brief Peer socket drained some bytes (see pendingWriteBytes)
+     */
+    void peerBytesWritten(QString peerId, qint64 bytes);
+
+    /**
+     * @brief A data lane to the peer finished its handshake
+     */
+    void dataLaneReady(QString peerId);
+
     /**
      * @brief Message sent successfully
      */
@@ -118,6 +222,8 @@ private:
 private slots:
     void onConnectionStateChanged(ConnectionState state, QString reason);
     void onMessageReceived(const QByteArray& data);
+    void onFileDataReceived(const flykylin::communication::FileDataHeader& header,
+                            const QByteArray& data);
     void onMessageSent(quint64 messageId);
     void onMessageFailed(quint64 messageId, QString error);
     void cleanupIdleConnections();
@@ -125,20 +231,52 @@ private slots:
     void onPeerDiscovered(const flykylin::core::PeerNode& node);
     void onPeerOffline(const QString& userId);
     void onPeerIdUpdated(const QString& oldPeerId, const QString& newPeerId);
+    void onDataLaneStateChanged(ConnectionState state, QString reason);
 
 private:
     TcpConnection* getOrCreateConnection(const QString& peerId, 
                                         const QString& ip, 
                                         quint16 port);
+    void connectConnectionSignals(TcpConnection* conn);
+    void connectDataLaneSignals(TcpConnection* conn);
+    void adoptDataLane(const QString& oldPeerId, const QString& peerId, TcpConnection* conn);
+    void dropDataLanes(const QString& peerId, bool dialedOnly);
+    TcpConnection* leastBackloggedConnection(const QString& peerId, int stripes) const;
+    void rememberPeerEndpoint(const QString& peerId, const QString& ip, quint16 port);
+
+    // Warm-start probing
+    struct WarmStartTarget {
+        QString peerId;
+        QString ip;
+        quint16 port{0};
+    };
+    void launchWarmStartProbes();
+    void finishWarmStartProbe(const QString& peerId, bool connected);
     
     QMap<QString, TcpConnection*> m_connections;  ///< peerId -> Connection
     QMap<QString, MessageQueue*> m_messageQueues; ///< peerId -> Queue
+    QMap<QString, QList<TcpConnection*>> m_dataLanes;  ///< peerId -> extra file data connections
+
+    struct PeerEndpoint {
+        QString ip;
+        quint16 port{0};
+    };
+    QMap<QString, PeerEndpoint> m_peerEndpoints;  ///< Listening address from discovery (for dialing lanes)
     
     QTimer* m_cleanupTimer;  ///< Cleanup timer (every minute)
+
+    QList<WarmStartTarget> m_warmStartPending;  ///< Peers waiting for a probe slot
+    QSet<QString> m_warmStartInFlight;          ///< Peers currently being probed
+    QElapsedTimer m_warmStartTimer;             ///< Started when warm-start begins
+    bool m_warmStartFirstConnected{false};      ///< Time-to-first-connected logged
     
     static constexpr int kMaxConnections = 20;        ///< Max 20 connections
     static constexpr int kIdleTimeout = 300000;       ///< 5 minutes idle timeout (milliseconds)
     static constexpr int kCleanupInterval = 60000;    ///< 1 minute cleanup interval
+    static constexpr int kMaxWarmStartProbes = 4;     ///< Concurrent warm-start probes
+    static constexpr int kMaxDataLanes = 3;           ///< Data lanes per peer (besides the main connection)
+    static constexpr int kWarmStartProbeTimeout = 3000;  ///< Per-probe connect timeout (ms)
+    static constexpr qint64 kWarmStartMaxAge = 7LL * 24 * 3600 * 1000;  ///< Only peers seen in 7 days
 };
 
 } // namespace communication
@@ -0,0 +1,168 @@
+/**
+ * @file XxHash64.cpp
+ * @brief Streaming xxHash64
+ * @author FlyKylin Development Team
+ * @date 2024-12-04
+ */
+
+#include "XxHash64.h"
+
+#include <cstring>
+
+namespace flykylin {
+namespace communication {
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+inline uint64_t read64(const uint8_t* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+inline uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input)
+{
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t value)
+{
+    acc ^= round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+} // namespace
+
+XxHash64::XxHash64(uint64_t seed)
+{
+    reset(seed);
+}
+
+void XxHash64::reset(uint64_t seed)
+{
+    m_seed = seed;
+    m_acc[0] = seed + kPrime1 + kPrime2;
+    m_acc[1] = seed + kPrime2;
+    m_acc[2] = seed;
+    m_acc[3] = seed - kPrime1;
+    m_bufferSize = 0;
+    m_totalBytes = 0;
+}
+
+void XxHash64::update(const void* data, std::size_t size)
+{
+    const auto* p = static_cast<const uint8_t*>(data);
+    m_totalBytes += size;
+
+    if (m_bufferSize + size < sizeof(m_buffer)) {
+        std::memcpy(m_buffer + m_bufferSize, p, size);
+        m_bufferSize += size;
+        return;
+    }
+
+    if (m_bufferSize > 0) {
+        const std::size_t take = sizeof(m_buffer) - m_bufferSize;
+        std::memcpy(m_buffer + m_bufferSize, p, take);
+        for (int i = 0; i < 4; ++i) {
+            m_acc[i] = round(m_acc[i], read64(m_buffer + 8 * i));
+        }
+        p += take;
+        size -= take;
+        m_bufferSize = 0;
+    }
+
+    uint64_t v1 = m_acc[0], v2 = m_acc[1], v3 = m_acc[2], v4 = m_acc[3];
+    while (size >= 32) {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        p += 32;
+        size -= 32;
+    }
+    m_acc[0] = v1; m_acc[1] = v2; m_acc[2] = v3; m_acc[3] = v4;
+
+    if (size > 0) {
+        std::memcpy(m_buffer, p, size);
+        m_bufferSize = size;
+    }
+}
+
+uint64_t XxHash64::digest() const
+{
+    uint64_t h;
+    if (m_totalBytes >= 32) {
+        h = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) + rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            h = mergeRound(h, m_acc[i]);
+        }
+    } else {
+        h = m_seed + kPrime5;
+    }
+    h += m_totalBytes;
+
+    const uint8_t* p = m_buffer;
+    std::size_t size = m_bufferSize;
+    while (size >= 8) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+        size -= 8;
+    }
+    if (size >= 4) {
+        h ^= static_cast<uint64_t>(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+        size -= 4;
+    }
+    while (size > 0) {
+        h ^= static_cast<uint64_t>(*p) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+        ++p;
+        --size;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t XxHash64::hash(const void* data, std::size_t size, uint64_t seed)
+{
+    XxHash64 state(seed);
+    state.update(data, size);
+    return state.digest();
+}
+
+} // namespace communication
+} // namespace flykylin
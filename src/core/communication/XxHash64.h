@@ -0,0 +1,41 @@
+/**
+ * @file XxHash64.h
+ * @brief Streaming xxHash64 (fast non-cryptographic file fingerprint)
+ * @author FlyKylin Development Team
+ * @date 2024-12-04
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace flykylin {
+namespace communication {
+
+/**
+ * @brief Incremental XXH64, bit-compatible with the reference implementation
+ *
+ * Several GB/s on one core; used as a cheap fingerprint next to SHA-256
+ * (e.g. to key caches) where collision resistance is not needed.
+ */
+class XxHash64 {
+public:
+    explicit XxHash64(uint64_t seed = 0);
+
+    void update(const void* data, std::size_t size);
+    uint64_t digest() const;
+    void reset(uint64_t seed = 0);
+
+    static uint64_t hash(const void* data, std::size_t size, uint64_t seed = 0);
+
+private:
+    uint64_t m_seed;
+    uint64_t m_acc[4];
+    uint8_t m_buffer[32];
+    std::size_t m_bufferSize{0};
+    uint64_t m_totalBytes{0};
+};
+
+} // namespace communication
+} // namespace flykylin
@@ -3,9 +3,11 @@
 #include <QDateTime>
 #include <QDebug>
 #include <QDir>
+#include <QHash>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QStandardPaths>
+#include <QStringList>
 
 namespace flykylin {
 namespace database {
@@ -31,6 +33,11 @@ DatabaseService::~DatabaseService() {
     }
 }
 
+QString DatabaseService::databasePath() const {
+    ensureInitialized();
+    return m_dbPath;
+}
+
 bool DatabaseService::ensureInitialized() const {
     if (m_initialized) {
         return true;
@@ -237,6 +244,102 @@ bool DatabaseService::init() {
         return false;
     }
 
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS partial_transfers ("
+            "transfer_id TEXT PRIMARY KEY,"
+            "from_user_id TEXT NOT NULL,"
+            "file_name TEXT NOT NULL,"
+            "file_size INTEGER NOT NULL,"
+            "local_path TEXT NOT NULL,"
+            "received_ranges TEXT,"
+            "mime_type TEXT,"
+            "is_group INTEGER NOT NULL DEFAULT 0,"
+            "group_id TEXT,"
+            "updated_at INTEGER"
+            ")")) {
+        qWarning() << "[DatabaseService] Failed to create partial_transfers table:"
+                   << query.lastError().text();
+    }
+
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS attachments ("
+            "sha256 TEXT PRIMARY KEY,"
+            "file_size INTEGER NOT NULL,"
+            "store_path TEXT NOT NULL,"
+            "modified_at INTEGER,"
+            "created_at INTEGER"
+            ")")) {
+        qWarning() << "[DatabaseService] Failed to create attachments table:"
+                   << query.lastError().text();
+    }
+
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS attachment_refs ("
+            "sha256 TEXT NOT NULL,"
+            "message_id TEXT NOT NULL,"
+            "local_user_id TEXT NOT NULL,"
+            "created_at INTEGER,"
+            "PRIMARY KEY(sha256, message_id, local_user_id)"
+            ")")) {
+        qWarning() << "[DatabaseService] Failed to create attachment_refs table:"
+                   << query.lastError().text();
+    }
+
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS nsfw_verdicts ("
+            "content_hash TEXT NOT NULL,"
+            "model_version TEXT NOT NULL,"
+            "probability REAL NOT NULL,"
+            "last_used INTEGER,"
+            "PRIMARY KEY(content_hash, model_version)"
+            ")")) {
+        qWarning() << "[DatabaseService] Failed to create nsfw_verdicts table:"
+                   << query.lastError().text();
+    }
+
+    // 语义检索向量表；local_user_id/peer_id/timestamp 冗余保存，检索时无需回表过滤
+    if (!query.exec(
+            "CREATE TABLE IF NOT EXISTS message_embeddings ("
+            "message_rowid INTEGER PRIMARY KEY,"
+            "local_user_id TEXT NOT NULL,"
+            "peer_id TEXT NOT NULL,"
+            "timestamp INTEGER NOT NULL,"
+            "model_version TEXT NOT NULL,"
+            "vector BLOB"
+            ")")) {
+        qWarning() << "[DatabaseService] Failed to create message_embeddings table:"
+                   << query.lastError().text();
+    }
+
+    if (!query.exec(
+            "CREATE INDEX IF NOT EXISTS idx_message_embeddings_peer "
+            "ON message_embeddings(local_user_id, peer_id)")) {
+        qWarning() << "[DatabaseService] Failed to create idx_message_embeddings_peer:"
+                   << query.lastError().text();
+    }
+
+    // 覆盖索引：核对向量索引时只读索引页，不读向量本身
+    if (!query.exec(
+            "CREATE INDEX IF NOT EXISTS idx_message_embeddings_model "
+            "ON message_embeddings(model_version)")) {
+        qWarning() << "[DatabaseService] Failed to create idx_message_embeddings_model:"
+                   << query.lastError().text();
+    }
+
+    // 删除消息（清空聊天记录、INSERT OR REPLACE 覆盖）时同步删除其向量；
+    // REPLACE 产生的删除只有打开 recursive_triggers 才会触发
+    if (!query.exec("PRAGMA recursive_triggers = ON")) {
+        qWarning() << "[DatabaseService] Failed to enable recursive triggers:" << query.lastError().text();
+    }
+    if (!query.exec(
+            "CREATE TRIGGER IF NOT EXISTS trg_messages_delete_embedding "
+            "AFTER DELETE ON messages BEGIN "
+            "DELETE FROM message_embeddings WHERE message_rowid = old.rowid; "
+            "END")) {
+        qWarning() << "[DatabaseService] Failed to create message embedding trigger:"
+                   << query.lastError().text();
+    }
+
     qInfo() << "[DatabaseService] Initialized chat history database at" << m_dbPath;
 
     return true;
@@ -705,7 +808,9 @@ QList<core::Message> DatabaseService::loadMessagesForSearch(const QString& local
 QList<core::Message> DatabaseService::searchMessagesByKeyword(const QString& localUserId,
                                                               const QString& keyword,
                                                               const QString& peerId,
-                                                              int limit) const {
+                                                              int limit,
+                                                              qint64 fromMs,
+                                                              qint64 toMs) const {
     QList<core::Message> result;
 
     if (!ensureInitialized()) {
@@ -728,6 +833,12 @@ QList<core::Message> DatabaseService::searchMessagesByKeyword(const QString& loc
     if (!peerId.isEmpty()) {
         sql += "AND peer_id = :peer_id ";
     }
+    if (fromMs > 0) {
+        sql += "AND timestamp >= :from_ms ";
+    }
+    if (toMs > 0) {
+        sql += "AND timestamp <= :to_ms ";
+    }
 
     sql += "ORDER BY timestamp DESC, rowid DESC LIMIT :limit";
 
@@ -737,6 +848,12 @@ QList<core::Message> DatabaseService::searchMessagesByKeyword(const QString& loc
     if (!peerId.isEmpty()) {
         query.bindValue(":peer_id", peerId);
     }
+    if (fromMs > 0) {
+        query.bindValue(":from_ms", fromMs);
+    }
+    if (toMs > 0) {
+        query.bindValue(":to_ms", toMs);
+    }
     const int effectiveLimit = (limit > 0) ? limit : 200;
     query.bindValue(":limit", effectiveLimit);
 
@@ -830,7 +947,10 @@ void DatabaseService::appendMessage(const core::Message& message, const QString&
     if (!query.exec()) {
         qWarning() << "[DatabaseService] Failed to append message" << message.id()
                    << ":" << query.lastError().text();
+        return;
     }
+
+    emit messageAppended(query.lastInsertId().toLongLong());
 }
 
 QList<QPair<QString, qint64>> DatabaseService::loadSessions(const QString& localUserId) const {
@@ -901,6 +1021,8 @@ void DatabaseService::clearHistory(const QString& localUserId, const QString& pe
     if (!query.exec()) {
         qWarning() << "[DatabaseService] Failed to clear history for" << localUserId << peerId
                    << ":" << query.lastError().text();
+    } else {
+        emit historyCleared(localUserId, peerId);
     }
 
     // Also remove the session entry so that the conversation disappears from the session list
@@ -976,5 +1098,658 @@ bool DatabaseService::loadPeer(const QString& userId, PeerInfo& outInfo) const {
     return true;
 }
 
+QList<DatabaseService::PeerInfo> DatabaseService::loadRecentPeers(qint64 sinceTimestamp,
+                                                                 int limit) const {
+    QList<PeerInfo> result;
+    if (!ensureInitialized()) {
+        return result;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "SELECT user_id, user_name, host_name, ip_address, tcp_port, last_seen "
+        "FROM peers WHERE last_seen >= :since AND tcp_port > 0 AND ip_address <> '' "
+        "ORDER BY last_seen DESC LIMIT :limit");
+    query.bindValue(":since", sinceTimestamp);
+    query.bindValue(":limit", limit);
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to load recent peers:"
+                   << query.lastError().text();
+        return result;
+    }
+
+    while (query.next()) {
+        PeerInfo info;
+        info.userId = query.value(0).toString();
+        info.userName = query.value(1).toString();
+        info.hostName = query.value(2).toString();
+        info.ipAddress = query.value(3).toString();
+        info.tcpPort = static_cast<quint16>(query.value(4).toInt());
+        info.lastSeen = query.value(5).toLongLong();
+        result.append(info);
+    }
+
+    return result;
+}
+
+namespace {
+
+void readPartialTransfer(const QSqlQuery& query, DatabaseService::PartialTransfer& outInfo) {
+    outInfo.transferId = query.value(0).toString();
+    outInfo.fromUserId = query.value(1).toString();
+    outInfo.fileName = query.value(2).toString();
+    outInfo.fileSize = query.value(3).toULongLong();
+    outInfo.localFilePath = query.value(4).toString();
+    outInfo.receivedRanges = query.value(5).toString();
+    outInfo.mimeType = query.value(6).toString();
+    outInfo.isGroup = query.value(7).toInt() != 0;
+    outInfo.groupId = query.value(8).toString();
+    outInfo.updatedAt = query.value(9).toLongLong();
+}
+
+const char* const kPartialTransferColumns =
+    "SELECT transfer_id, from_user_id, file_name, file_size, local_path, received_ranges, "
+    "mime_type, is_group, group_id, updated_at FROM partial_transfers ";
+
+} // namespace
+
+void DatabaseService::upsertPartialTransfer(const PartialTransfer& info) {
+    if (!ensureInitialized()) {
+        return;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "INSERT OR REPLACE INTO partial_transfers (transfer_id, from_user_id, file_name, file_size, "
+        "local_path, received_ranges, mime_type, is_group, group_id, updated_at) "
+        "VALUES (:transfer_id, :from_user_id, :file_name, :file_size, :local_path, "
+        ":received_ranges, :mime_type, :is_group, :group_id, :updated_at)");
+
+    query.bindValue(":transfer_id", info.transferId);
+    query.bindValue(":from_user_id", info.fromUserId);
+    query.bindValue(":file_name", info.fileName);
+    query.bindValue(":file_size", static_cast<qint64>(info.fileSize));
+    query.bindValue(":local_path", info.localFilePath);
+    query.bindValue(":received_ranges", info.receivedRanges);
+    query.bindValue(":mime_type", info.mimeType);
+    query.bindValue(":is_group", info.isGroup ? 1 : 0);
+    query.bindValue(":group_id", info.groupId);
+    query.bindValue(":updated_at", QDateTime::currentMSecsSinceEpoch());
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to upsert partial transfer" << info.transferId
+                   << ":" << query.lastError().text();
+    }
+}
+
+bool DatabaseService::loadPartialTransfer(const QString& transferId, PartialTransfer& outInfo) const {
+    if (!ensureInitialized()) {
+        return false;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(QString::fromLatin1(kPartialTransferColumns)
+                  + QStringLiteral("WHERE transfer_id = :transfer_id"));
+    query.bindValue(":transfer_id", transferId);
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to load partial transfer" << transferId
+                   << ":" << query.lastError().text();
+        return false;
+    }
+
+    if (!query.next()) {
+        return false;
+    }
+
+    readPartialTransfer(query, outInfo);
+    return true;
+}
+
+bool DatabaseService::findPartialTransfer(const QString& fromUserId,
+                                          const QString& fileName,
+                                          quint64 fileSize,
+                                          PartialTransfer& outInfo) const {
+    if (!ensureInitialized()) {
+        return false;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(QString::fromLatin1(kPartialTransferColumns)
+                  + QStringLiteral("WHERE from_user_id = :from_user_id AND file_name = :file_name "
+                                   "AND file_size = :file_size ORDER BY updated_at DESC LIMIT 1"));
+    query.bindValue(":from_user_id", fromUserId);
+    query.bindValue(":file_name", fileName);
+    query.bindValue(":file_size", static_cast<qint64>(fileSize));
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to find partial transfer for" << fileName
+                   << ":" << query.lastError().text();
+        return false;
+    }
+
+    if (!query.next()) {
+        return false;
+    }
+
+    readPartialTransfer(query, outInfo);
+    return true;
+}
+
+void DatabaseService::removePartialTransfer(const QString& transferId) {
+    if (!ensureInitialized()) {
+        return;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare("DELETE FROM partial_transfers WHERE transfer_id = :transfer_id");
+    query.bindValue(":transfer_id", transferId);
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to remove partial transfer" << transferId
+                   << ":" << query.lastError().text();
+    }
+}
+
+void DatabaseService::upsertStoredAttachment(const StoredAttachment& info) {
+    if (!ensureInitialized()) {
+        return;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "INSERT OR REPLACE INTO attachments (sha256, file_size, store_path, modified_at, created_at) "
+        "VALUES (:sha256, :file_size, :store_path, :modified_at, :created_at)");
+    query.bindValue(":sha256", info.sha256);
+    query.bindValue(":file_size", static_cast<qint64>(info.fileSize));
+    query.bindValue(":store_path", info.storePath);
+    query.bindValue(":modified_at", info.modifiedAt);
+    query.bindValue(":created_at", info.createdAt > 0 ? info.createdAt
+                                                      : QDateTime::currentMSecsSinceEpoch());
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to upsert attachment" << info.sha256
+                   << ":" << query.lastError().text();
+    }
+}
+
+bool DatabaseService::loadStoredAttachment(const QString& sha256, StoredAttachment& outInfo) const {
+    if (!ensureInitialized()) {
+        return false;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "SELECT sha256, file_size, store_path, modified_at, created_at FROM attachments "
+        "WHERE sha256 = :sha256");
+    query.bindValue(":sha256", sha256);
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to load attachment" << sha256
+                   << ":" << query.lastError().text();
+        return false;
+    }
+
+    if (!query.next()) {
+        return false;
+    }
+
+    outInfo.sha256 = query.value(0).toString();
+    outInfo.fileSize = static_cast<quint64>(query.value(1).toLongLong());
+    outInfo.storePath = query.value(2).toString();
+    outInfo.modifiedAt = query.value(3).toLongLong();
+    outInfo.createdAt = query.value(4).toLongLong();
+    return true;
+}
+
+void DatabaseService::removeStoredAttachment(const QString& sha256) {
+    if (!ensureInitialized()) {
+        return;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare("DELETE FROM attachments WHERE sha256 = :sha256");
+    query.bindValue(":sha256", sha256);
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to remove attachment" << sha256
+                   << ":" << query.lastError().text();
+    }
+
+    QSqlQuery refsQuery(m_db);
+    refsQuery.prepare("DELETE FROM attachment_refs WHERE sha256 = :sha256");
+    refsQuery.bindValue(":sha256", sha256);
+    if (!refsQuery.exec()) {
+        qWarning() << "[DatabaseService] Failed to remove attachment refs" << sha256
+                   << ":" << refsQuery.lastError().text();
+    }
+}
+
+void DatabaseService::addAttachmentRef(const QString& sha256,
+                                       const QString& messageId,
+                                       const QString& localUserId,
+                                       qint64 createdAt) {
+    if (!ensureInitialized()) {
+        return;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "INSERT OR REPLACE INTO attachment_refs (sha256, message_id, local_user_id, created_at) "
+        "VALUES (:sha256, :message_id, :local_user_id, :created_at)");
+    query.bindValue(":sha256", sha256);
+    query.bindValue(":message_id", messageId);
+    query.bindValue(":local_user_id", localUserId);
+    query.bindValue(":created_at", createdAt > 0 ? createdAt : QDateTime::currentMSecsSinceEpoch());
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to add attachment ref" << sha256 << messageId
+                   << ":" << query.lastError().text();
+    }
+}
+
+QList<DatabaseService::StoredAttachment> DatabaseService::collectUnreferencedAttachments(qint64 olderThan) {
+    QList<StoredAttachment> result;
+    if (!ensureInitialized()) {
+        return result;
+    }
+
+    // Refs are written when the file lands, the message row just after;
+    // only refs older than the cutoff count as orphaned
+    QSqlQuery pruneQuery(m_db);
+    pruneQuery.prepare(
+        "DELETE FROM attachment_refs WHERE created_at < :cutoff AND NOT EXISTS ("
+        "SELECT 1 FROM messages m WHERE m.id = attachment_refs.message_id "
+        "AND m.local_user_id = attachment_refs.local_user_id)");
+    pruneQuery.bindValue(":cutoff", olderThan);
+    if (!pruneQuery.exec()) {
+        qWarning() << "[DatabaseService] Failed to prune attachment refs:"
+                   << pruneQuery.lastError().text();
+        return result;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "SELECT sha256, file_size, store_path, modified_at, created_at FROM attachments a "
+        "WHERE a.created_at < :cutoff AND NOT EXISTS ("
+        "SELECT 1 FROM attachment_refs r WHERE r.sha256 = a.sha256)");
+    query.bindValue(":cutoff", olderThan);
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to list unreferenced attachments:"
+                   << query.lastError().text();
+        return result;
+    }
+
+    while (query.next()) {
+        StoredAttachment info;
+        info.sha256 = query.value(0).toString();
+        info.fileSize = static_cast<quint64>(query.value(1).toLongLong());
+        info.storePath = query.value(2).toString();
+        info.modifiedAt = query.value(3).toLongLong();
+        info.createdAt = query.value(4).toLongLong();
+        result.append(info);
+    }
+    return result;
+}
+
+void DatabaseService::upsertNsfwVerdict(const NsfwVerdict& verdict) {
+    if (!ensureInitialized()) {
+        return;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "INSERT OR REPLACE INTO nsfw_verdicts (content_hash, model_version, probability, last_used) "
+        "VALUES (:content_hash, :model_version, :probability, :last_used)");
+    query.bindValue(":content_hash", verdict.contentHash);
+    query.bindValue(":model_version", verdict.modelVersion);
+    query.bindValue(":probability", static_cast<double>(verdict.probability));
+    query.bindValue(":last_used", verdict.lastUsed > 0 ? verdict.lastUsed
+                                                      : QDateTime::currentMSecsSinceEpoch());
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to upsert NSFW verdict" << verdict.contentHash
+                   << ":" << query.lastError().text();
+    }
+}
+
+QList<DatabaseService::NsfwVerdict> DatabaseService::loadRecentNsfwVerdicts(const QString& modelVersion,
+                                                                           int limit) const {
+    QList<NsfwVerdict> result;
+
+    if (!ensureInitialized()) {
+        return result;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "SELECT content_hash, model_version, probability, last_used FROM nsfw_verdicts "
+        "WHERE model_version = :model_version "
+        "ORDER BY last_used DESC LIMIT :limit");
+    query.bindValue(":model_version", modelVersion);
+    query.bindValue(":limit", limit);
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to load NSFW verdicts:" << query.lastError().text();
+        return result;
+    }
+
+    while (query.next()) {
+        NsfwVerdict verdict;
+        verdict.contentHash = query.value(0).toString();
+        verdict.modelVersion = query.value(1).toString();
+        verdict.probability = static_cast<float>(query.value(2).toDouble());
+        verdict.lastUsed = query.value(3).toLongLong();
+        result.append(verdict);
+    }
+    return result;
+}
+
+void DatabaseService::pruneNsfwVerdicts(const QString& modelVersion, int keep) {
+    if (!ensureInitialized()) {
+        return;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "DELETE FROM nsfw_verdicts WHERE model_version <> :model_version "
+        "OR rowid NOT IN (SELECT rowid FROM nsfw_verdicts WHERE model_version = :kept_version "
+        "ORDER BY last_used DESC LIMIT :keep)");
+    query.bindValue(":model_version", modelVersion);
+    query.bindValue(":kept_version", modelVersion);
+    query.bindValue(":keep", keep);
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to prune NSFW verdicts:" << query.lastError().text();
+    }
+}
+
+QList<DatabaseService::PendingEmbedding> DatabaseService::loadMessagesWithoutEmbedding(const QString& modelVersion,
+                                                                                    int limit) const {
+    QList<PendingEmbedding> result;
+
+    if (!ensureInitialized()) {
+        return result;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "SELECT m.rowid, m.local_user_id, m.peer_id, m.timestamp, m.content FROM messages m "
+        "LEFT JOIN message_embeddings e "
+        "ON e.message_rowid = m.rowid AND e.model_version = :model_version "
+        "WHERE e.message_rowid IS NULL AND m.kind = :kind AND m.content <> '' "
+        "ORDER BY m.rowid DESC LIMIT :limit");
+    query.bindValue(":model_version", modelVersion);
+    query.bindValue(":kind", static_cast<int>(core::MessageKind::Text));
+    query.bindValue(":limit", limit);
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to load messages without embedding:"
+                   << query.lastError().text();
+        return result;
+    }
+
+    while (query.next()) {
+        PendingEmbedding pending;
+        pending.rowId = query.value(0).toLongLong();
+        pending.localUserId = query.value(1).toString();
+        pending.peerId = query.value(2).toString();
+        pending.timestamp = query.value(3).toLongLong();
+        pending.content = query.value(4).toString();
+        result.append(pending);
+    }
+    return result;
+}
+
+void DatabaseService::storeMessageEmbeddings(const QString& modelVersion,
+                                             const QList<MessageEmbedding>& embeddings) {
+    if (!ensureInitialized() || embeddings.isEmpty()) {
+        return;
+    }
+
+    const bool inTransaction = m_db.transaction();
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "INSERT OR REPLACE INTO message_embeddings "
+        "(message_rowid, local_user_id, peer_id, timestamp, model_version, vector) "
+        "SELECT rowid, local_user_id, peer_id, timestamp, :model_version, :vector "
+        "FROM messages WHERE rowid = :rowid");
+
+    for (const MessageEmbedding& embedding : embeddings) {
+        query.bindValue(":model_version", modelVersion);
+        query.bindValue(":vector", embedding.vector);
+        query.bindValue(":rowid", embedding.rowId);
+        if (!query.exec()) {
+            qWarning() << "[DatabaseService] Failed to store embedding for message rowid" << embedding.rowId
+                       << ":" << query.lastError().text();
+        }
+    }
+
+    if (inTransaction && !m_db.commit()) {
+        qWarning() << "[DatabaseService] Failed to commit message embeddings:" << m_db.lastError().text();
+    }
+}
+
+void DatabaseService::forEachMessageEmbedding(
+    const QString& localUserId,
+    const QString& peerId,
+    qint64 fromMs,
+    qint64 toMs,
+    const QString& modelVersion,
+    const std::function<void(qint64 rowId, const QByteArray& vector)>& visit) const {
+    if (!ensureInitialized()) {
+        return;
+    }
+
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+
+    QString sql =
+        "SELECT message_rowid, vector FROM message_embeddings "
+        "WHERE local_user_id = :local_user_id AND model_version = :model_version "
+        "AND length(vector) > 0 ";
+    if (!peerId.isEmpty()) {
+        sql += "AND peer_id = :peer_id ";
+    }
+    if (fromMs > 0) {
+        sql += "AND timestamp >= :from_ms ";
+    }
+    if (toMs > 0) {
+        sql += "AND timestamp <= :to_ms ";
+    }
+
+    query.prepare(sql);
+    query.bindValue(":local_user_id", localUserId);
+    query.bindValue(":model_version", modelVersion);
+    if (!peerId.isEmpty()) {
+        query.bindValue(":peer_id", peerId);
+    }
+    if (fromMs > 0) {
+        query.bindValue(":from_ms", fromMs);
+    }
+    if (toMs > 0) {
+        query.bindValue(":to_ms", toMs);
+    }
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to scan message embeddings:" << query.lastError().text();
+        return;
+    }
+
+    while (query.next()) {
+        visit(query.value(0).toLongLong(), query.value(1).toByteArray());
+    }
+}
+
+QPair<qint64, qint64> DatabaseService::messageEmbeddingChecksum(const QString& modelVersion) const {
+    if (!ensureInitialized()) {
+        return qMakePair(qint64(0), qint64(0));
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "SELECT COUNT(*), IFNULL(SUM(message_rowid), 0) FROM message_embeddings "
+        "WHERE model_version = :model_version");
+    query.bindValue(":model_version", modelVersion);
+
+    if (!query.exec() || !query.next()) {
+        qWarning() << "[DatabaseService] Failed to count message embeddings:" << query.lastError().text();
+        return qMakePair(qint64(0), qint64(0));
+    }
+    return qMakePair(query.value(0).toLongLong(), query.value(1).toLongLong());
+}
+
+QList<qint64> DatabaseService::loadMessageEmbeddingRowIds(const QString& modelVersion) const {
+    QList<qint64> result;
+
+    if (!ensureInitialized()) {
+        return result;
+    }
+
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    query.prepare(
+        "SELECT message_rowid FROM message_embeddings "
+        "WHERE model_version = :model_version ORDER BY message_rowid");
+    query.bindValue(":model_version", modelVersion);
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to load message embedding rowids:" << query.lastError().text();
+        return result;
+    }
+
+    while (query.next()) {
+        result.append(query.value(0).toLongLong());
+    }
+    return result;
+}
+
+QList<DatabaseService::MessageEmbedding> DatabaseService::loadMessageEmbeddings(const QList<qint64>& rowIds) const {
+    QList<MessageEmbedding> result;
+
+    if (!ensureInitialized() || rowIds.isEmpty()) {
+        return result;
+    }
+
+    QStringList placeholders;
+    for (int i = 0; i < rowIds.size(); ++i) {
+        placeholders << QStringLiteral(":r%1").arg(i);
+    }
+
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    query.prepare(
+        "SELECT message_rowid, local_user_id, peer_id, timestamp, vector FROM message_embeddings "
+        "WHERE message_rowid IN (" + placeholders.join(',') + ")");
+    for (int i = 0; i < rowIds.size(); ++i) {
+        query.bindValue(placeholders.at(i), rowIds.at(i));
+    }
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to load message embeddings:" << query.lastError().text();
+        return result;
+    }
+
+    while (query.next()) {
+        MessageEmbedding embedding;
+        embedding.rowId = query.value(0).toLongLong();
+        embedding.localUserId = query.value(1).toString();
+        embedding.peerId = query.value(2).toString();
+        embedding.timestamp = query.value(3).toLongLong();
+        embedding.vector = query.value(4).toByteArray();
+        result.append(embedding);
+    }
+    return result;
+}
+
+QList<core::Message> DatabaseService::loadMessagesByRowIds(const QList<qint64>& rowIds) const {
+    QList<core::Message> result;
+
+    if (!ensureInitialized() || rowIds.isEmpty()) {
+        return result;
+    }
+
+    QStringList placeholders;
+    for (int i = 0; i < rowIds.size(); ++i) {
+        placeholders << QStringLiteral(":r%1").arg(i);
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "SELECT rowid, id, from_id, to_id, content, timestamp, status, kind, is_read, "
+        "attachment_path, attachment_name, attachment_size, mime_type, is_group, group_id "
+        "FROM messages WHERE rowid IN (" + placeholders.join(',') + ")");
+    for (int i = 0; i < rowIds.size(); ++i) {
+        query.bindValue(placeholders.at(i), rowIds.at(i));
+    }
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to load messages by rowid:" << query.lastError().text();
+        return result;
+    }
+
+    QHash<qint64, core::Message> byRowId;
+    while (query.next()) {
+        core::Message message;
+        message.setId(query.value(1).toString());
+        message.setFromUserId(query.value(2).toString());
+        message.setToUserId(query.value(3).toString());
+        message.setContent(query.value(4).toString());
+        message.setTimestamp(QDateTime::fromMSecsSinceEpoch(query.value(5).toLongLong()));
+
+        const int statusValue = query.value(6).toInt();
+        if (statusValue >= static_cast<int>(core::MessageStatus::Sending) &&
+            statusValue <= static_cast<int>(core::MessageStatus::Failed)) {
+            message.setStatus(static_cast<core::MessageStatus>(statusValue));
+        }
+
+        const int kindValue = query.value(7).toInt();
+        if (kindValue >= static_cast<int>(core::MessageKind::Text) &&
+            kindValue <= static_cast<int>(core::MessageKind::File)) {
+            message.setKind(static_cast<core::MessageKind>(kindValue));
+        }
+
+        message.setRead(query.value(8).toInt() != 0);
+        message.setAttachmentLocalPath(query.value(9).toString());
+        message.setAttachmentName(query.value(10).toString());
+        message.setAttachmentSize(query.value(11).toULongLong());
+        message.setMimeType(query.value(12).toString());
+        message.setIsGroup(query.value(13).toInt() != 0);
+        message.setGroupId(query.value(14).toString());
+
+        byRowId.insert(query.value(0).toLongLong(), message);
+    }
+
+    for (qint64 rowId : rowIds) {
+        const auto it = byRowId.constFind(rowId);
+        if (it != byRowId.constEnd()) {
+            result.append(it.value());
+        }
+    }
+    return result;
+}
+
+void DatabaseService::pruneMessageEmbeddings(const QString& modelVersion) {
+    if (!ensureInitialized()) {
+        return;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare(
+        "DELETE FROM message_embeddings WHERE model_version <> :model_version "
+        "OR length(vector) = 0 OR message_rowid NOT IN (SELECT rowid FROM messages)");
+    query.bindValue(":model_version", modelVersion);
+
+    if (!query.exec()) {
+        qWarning() << "[DatabaseService] Failed to prune message embeddings:" << query.lastError().text();
+        return;
+    }
+
+    if (query.numRowsAffected() > 0) {
+        qInfo() << "[DatabaseService] Pruned" << query.numRowsAffected() << "stale message embeddings";
+    }
+}
+
 } // namespace database
 } // namespace flykylin
@@ -5,6 +5,9 @@
 #include <QString>
 #include <QSqlDatabase>
 #include <QPair>
+#include <QByteArray>
+
+#include <functional>
 
 #include "core/models/Message.h"
 
@@ -26,6 +29,57 @@ public:
         qint64 lastSeen{0};
     };
 
+    // 可续传的接收中文件：连接断开或重启后按已校验区间继续接收
+    struct PartialTransfer {
+        QString transferId;
+        QString fromUserId;
+        QString fileName;
+        quint64 fileSize{0};
+        QString localFilePath;      // 最终路径，数据写在 localFilePath + ".part"
+        QString receivedRanges;     // TransferRanges::serialize()
+        QString mimeType;
+        bool isGroup{false};
+        QString groupId;
+        qint64 updatedAt{0};
+    };
+
+    // 内容寻址附件库（AttachmentStore）：按 SHA-256 记录一份已校验的内容，
+    // 被哪些消息引用记在 attachment_refs，清空聊天记录后回收无引用的内容
+    struct StoredAttachment {
+        QString sha256;
+        quint64 fileSize{0};
+        QString storePath;
+        qint64 modifiedAt{0};       // 入库时文件的修改时间，变化说明内容被改过
+        qint64 createdAt{0};
+    };
+
+    // NSFW 判定缓存：按图片内容 SHA-256 + 模型版本记录概率，换模型后旧判定不再使用
+    struct NsfwVerdict {
+        QString contentHash;
+        QString modelVersion;
+        float probability{0.0f};
+        qint64 lastUsed{0};
+    };
+
+    // 语义检索向量：按 messages 表的 rowid 记录消息的 embedding（ai::embedding_codec 编码），
+    // 空向量表示该消息无法向量化，不再重试。会话与时间随向量读出，写入时取自 messages 表
+    struct MessageEmbedding {
+        qint64 rowId{0};
+        QString localUserId;
+        QString peerId;
+        qint64 timestamp{0};
+        QByteArray vector;
+    };
+
+    // 尚未向量化的文本消息
+    struct PendingEmbedding {
+        qint64 rowId{0};
+        QString localUserId;
+        QString peerId;
+        qint64 timestamp{0};
+        QString content;
+    };
+
     QList<core::Message> loadMessages(const QString& localUserId, const QString& peerId) const;
     void appendMessage(const core::Message& message, const QString& localUserId);
     void clearHistory(const QString& localUserId, const QString& peerId);
@@ -52,10 +106,13 @@ public:
     // Simple keyword-based search over message content for a given local user.
     // If peerId is empty, search across all peers. Results are ordered by
     // timestamp DESC and limited by the provided limit (default 200).
+    // fromMs/toMs bound the timestamp; 0 leaves that end open.
     QList<core::Message> searchMessagesByKeyword(const QString& localUserId,
                                                  const QString& keyword,
                                                  const QString& peerId = QString(),
-                                                 int limit = 200) const;
+                                                 int limit = 200,
+                                                 qint64 fromMs = 0,
+                                                 qint64 toMs = 0) const;
 
     // 会话列表：按本地用户维度记录与哪些peer有过对话，以及最近时间戳
     QList<QPair<QString, qint64>> loadSessions(const QString& localUserId) const;
@@ -64,6 +121,64 @@ public:
     void upsertPeer(const PeerInfo& info);
     bool loadPeer(const QString& userId, PeerInfo& outInfo) const;
 
+    // 启动预热：按 last_seen 倒序加载最近出现过的节点（last_seen >= sinceTimestamp）
+    QList<PeerInfo> loadRecentPeers(qint64 sinceTimestamp, int limit) const;
+
+    void upsertPartialTransfer(const PartialTransfer& info);
+    bool loadPartialTransfer(const QString& transferId, PartialTransfer& outInfo) const;
+    // 发送端重启后会生成新的 transferId，此时按 (发送者, 文件名, 大小) 匹配
+    bool findPartialTransfer(const QString& fromUserId,
+                             const QString& fileName,
+                             quint64 fileSize,
+                             PartialTransfer& outInfo) const;
+    void removePartialTransfer(const QString& transferId);
+
+    void upsertStoredAttachment(const StoredAttachment& info);
+    bool loadStoredAttachment(const QString& sha256, StoredAttachment& outInfo) const;
+    void removeStoredAttachment(const QString& sha256);
+    // createdAt 为 0 时取当前时间
+    void addAttachmentRef(const QString& sha256, const QString& messageId, const QString& localUserId,
+                          qint64 createdAt = 0);
+    // 删除消息已不存在的引用（早于 olderThan 创建的），返回不再被引用的附件
+    QList<StoredAttachment> collectUnreferencedAttachments(qint64 olderThan);
+
+    void upsertNsfwVerdict(const NsfwVerdict& verdict);
+    // 按 last_used 倒序加载该模型版本最近用过的 limit 条判定
+    QList<NsfwVerdict> loadRecentNsfwVerdicts(const QString& modelVersion, int limit) const;
+    // 删除其他模型版本的判定，本版本只保留最近用过的 keep 条
+    void pruneNsfwVerdicts(const QString& modelVersion, int keep);
+
+    // 按 rowid 倒序（新消息优先）取出当前模型版本还没有向量的文本消息
+    QList<PendingEmbedding> loadMessagesWithoutEmbedding(const QString& modelVersion, int limit) const;
+    // 一个事务写入一批向量；写入前已被删除的消息直接跳过
+    void storeMessageEmbeddings(const QString& modelVersion, const QList<MessageEmbedding>& embeddings);
+    // 逐条遍历本地用户（peerId 为空则全部会话）在该模型版本下的非空向量，不整体载入内存；
+    // fromMs/toMs 为 0 表示不限时间
+    void forEachMessageEmbedding(const QString& localUserId,
+                                 const QString& peerId,
+                                 qint64 fromMs,
+                                 qint64 toMs,
+                                 const QString& modelVersion,
+                                 const std::function<void(qint64 rowId, const QByteArray& vector)>& visit) const;
+    // 该模型版本的向量条数与 rowid 之和（含空向量），用于快速判断向量索引是否与数据库一致
+    QPair<qint64, qint64> messageEmbeddingChecksum(const QString& modelVersion) const;
+    // 该模型版本所有向量的 rowid，升序（含空向量）
+    QList<qint64> loadMessageEmbeddingRowIds(const QString& modelVersion) const;
+    // 按 rowid 读出向量及其会话、时间，已不存在的跳过
+    QList<MessageEmbedding> loadMessageEmbeddings(const QList<qint64>& rowIds) const;
+    // 按给定 rowid 顺序加载消息，已不存在的跳过
+    QList<core::Message> loadMessagesByRowIds(const QList<qint64>& rowIds) const;
+    // 删除其他模型版本的向量、嵌入失败时旧版本存下的空向量，以及消息已不存在的向量
+    void pruneMessageEmbeddings(const QString& modelVersion);
+
+    QString databasePath() const;
+
+signals:
+    // appendMessage 写入成功后发出，rowId 为该消息在 messages 表中的 rowid
+    void messageAppended(qint64 rowId);
+    // clearHistory 删除该会话的消息后发出
+    void historyCleared(const QString& localUserId, const QString& peerId);
+
 private:
     explicit DatabaseService(QObject* parent = nullptr);
     ~DatabaseService() override;
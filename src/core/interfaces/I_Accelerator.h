@@ -24,7 +24,7 @@ public:
 
     /**
      * @brief Run inference on an image (e.g., for NSFW detection)
-     * @param imageData Raw image data
+     * @param imageData Packed RGB888 pixels, width * 3 bytes per row
      * @param width Image width
      * @param height Image height
      * @return Probability score (0.0 - 1.0) or error
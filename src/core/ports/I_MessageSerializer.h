@@ -8,6 +8,7 @@
 #ifndef I_MESSAGESERIALIZER_H
 #define I_MESSAGESERIALIZER_H
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <memory>
@@ -27,6 +28,59 @@ namespace core {
 
 namespace ports {
 
+/**
+ * @brief 只读字节视图（指针+长度）
+ *
+ * 用于零拷贝解码：调用方直接传入 QByteArray/UDP 数据报的内存，
+ * 无需先拷贝到 std::vector。视图不拥有内存，生命周期由调用方保证。
+ */
+struct ByteView {
+    const uint8_t* data{nullptr};
+    std::size_t size{0};
+
+    ByteView() = default;
+    ByteView(const uint8_t* d, std::size_t n) : data(d), size(n) {}
+    ByteView(const char* d, std::size_t n)
+        : data(reinterpret_cast<const uint8_t*>(d)), size(n) {}
+    ByteView(const std::vector<uint8_t>& v) : data(v.data()), size(v.size()) {}
+
+    bool empty() const { return size == 0; }
+};
+
+/**
+ * @brief 节点发现消息类型
+ */
+enum class DiscoveryKind {
+    Announce,   ///< 上线公告
+    Heartbeat,  ///< 心跳
+    Goodbye     ///< 下线
+};
+
+/**
+ * @brief 解码错误码
+ */
+enum class DecodeError {
+    None,           ///< 成功
+    Empty,          ///< 空数据
+    Malformed,      ///< 无法解析
+    MissingField    ///< 缺少必需字段（如 peer）
+};
+
+/**
+ * @brief 解码结果（值或错误码）
+ */
+template <typename T>
+struct DecodeResult {
+    std::optional<T> value;
+    DecodeError error{DecodeError::None};
+
+    bool ok() const { return error == DecodeError::None && value.has_value(); }
+    explicit operator bool() const { return ok(); }
+
+    static DecodeResult success(T v) { return DecodeResult{std::move(v), DecodeError::None}; }
+    static DecodeResult failure(DecodeError e) { return DecodeResult{std::nullopt, e}; }
+};
+
 /**
  * @class I_MessageSerializer
  * @brief 消息序列化器接口
@@ -74,6 +128,24 @@ public:
      */
     virtual std::optional<core::PeerNode> deserializePeerMessage(const std::vector<uint8_t>& data) = 0;
 
+    /**
+     * @brief 单次解码节点发现消息（视图接口，不拷贝输入）
+     * @param data 字节视图
+     * @return 节点信息或错误码；合法性校验与解码在同一次解析内完成
+     */
+    virtual DecodeResult<core::PeerNode> decodePeerMessage(ByteView data) = 0;
+
+    /**
+     * @brief 将节点发现消息序列化到调用方提供的缓冲区
+     * @param kind 消息类型
+     * @param peer 节点信息
+     * @param out 输出缓冲区（按需 resize，复用已有容量，稳定后不再分配）
+     * @return 成功返回true
+     */
+    virtual bool serializePeerMessageInto(DiscoveryKind kind,
+                                          const core::PeerNode& peer,
+                                          std::vector<uint8_t>& out) = 0;
+
     // ========== 文本消息 ==========
     
     /**
@@ -0,0 +1,187 @@
+#include "AttachmentStore.h"
+
+#include "../database/DatabaseService.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace flykylin {
+namespace services {
+
+namespace {
+
+bool sameFile(const QString& a, const QString& b)
+{
+#ifdef Q_OS_WIN
+    return QFileInfo(a).canonicalFilePath().compare(QFileInfo(b).canonicalFilePath(),
+                                                    Qt::CaseInsensitive) == 0;
+#else
+    struct stat sa;
+    struct stat sb;
+    return ::stat(QFile::encodeName(a).constData(), &sa) == 0
+        && ::stat(QFile::encodeName(b).constData(), &sb) == 0
+        && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+#endif
+}
+
+} // namespace
+
+AttachmentStore* AttachmentStore::instance()
+{
+    static AttachmentStore store;
+    return &store;
+}
+
+QString AttachmentStore::storeDirectory() const
+{
+    const QString baseDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    return QDir(baseDir).filePath(QStringLiteral("FlyKylin/attachments"));
+}
+
+QString AttachmentStore::blobPath(const QString& sha256) const
+{
+    return storeDirectory() + QLatin1Char('/') + sha256.left(2) + QLatin1Char('/') + sha256;
+}
+
+bool AttachmentStore::isValidHash(const QString& sha256)
+{
+    if (sha256.size() != 64) {
+        return false;
+    }
+    for (const QChar c : sha256) {
+        if (!c.isDigit() && (c < QLatin1Char('a') || c > QLatin1Char('f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QString AttachmentStore::find(const QString& sha256, quint64 size) const
+{
+    if (!isValidHash(sha256)) {
+        return QString();
+    }
+
+    auto* db = database::DatabaseService::instance();
+    database::DatabaseService::StoredAttachment entry;
+    if (!db->loadStoredAttachment(sha256, entry) || entry.fileSize != size) {
+        return QString();
+    }
+
+    const QFileInfo info(entry.storePath);
+    if (!info.isFile() || static_cast<quint64>(info.size()) != entry.fileSize
+        || info.lastModified().toMSecsSinceEpoch() != entry.modifiedAt) {
+        // Removed or edited in place (which a hard link shares)
+        qInfo() << "[AttachmentStore] Dropping stale entry" << sha256;
+        db->removeStoredAttachment(sha256);
+        if (entry.storePath == blobPath(sha256)) {
+            QFile::remove(entry.storePath);
+        }
+        return QString();
+    }
+    return entry.storePath;
+}
+
+bool AttachmentStore::adopt(const QString& sha256, const QString& filePath)
+{
+    const QFileInfo info(filePath);
+    if (!isValidHash(sha256) || !info.isFile()) {
+        return false;
+    }
+    if (!find(sha256, static_cast<quint64>(info.size())).isEmpty()) {
+        return true;
+    }
+
+    // Keep our own link so the entry survives the user moving or deleting
+    // the download; fall back to pointing at the download itself
+    const QString blob = blobPath(sha256);
+    QString storePath = filePath;
+    if (QDir().mkpath(QFileInfo(blob).absolutePath())) {
+        QFile::remove(blob);
+        if (linkFile(filePath, blob)) {
+            storePath = blob;
+        }
+    }
+
+    database::DatabaseService::StoredAttachment entry;
+    entry.sha256 = sha256;
+    entry.fileSize = static_cast<quint64>(info.size());
+    entry.storePath = storePath;
+    entry.modifiedAt = QFileInfo(storePath).lastModified().toMSecsSinceEpoch();
+    database::DatabaseService::instance()->upsertStoredAttachment(entry);
+    return true;
+}
+
+bool AttachmentStore::materialize(const QString& sha256, quint64 size, const QString& targetPath)
+{
+    const QString source = find(sha256, size);
+    if (source.isEmpty()) {
+        return false;
+    }
+    if (QFileInfo::exists(targetPath)) {
+        if (sameFile(source, targetPath)) {
+            return true;
+        }
+        if (!QFile::remove(targetPath)) {
+            return false;
+        }
+    }
+    QDir().mkpath(QFileInfo(targetPath).absolutePath());
+    if (linkFile(source, targetPath)) {
+        return true;
+    }
+    return QFile::copy(source, targetPath);
+}
+
+void AttachmentStore::addReference(const QString& sha256,
+                                   const QString& messageId,
+                                   const QString& localUserId)
+{
+    if (!isValidHash(sha256) || messageId.isEmpty()) {
+        return;
+    }
+    database::DatabaseService::instance()->addAttachmentRef(sha256, messageId, localUserId);
+}
+
+int AttachmentStore::collectGarbage()
+{
+    auto* db = database::DatabaseService::instance();
+    const qint64 cutoff = QDateTime::currentMSecsSinceEpoch() - kGcGraceMs;
+    const auto unreferenced = db->collectUnreferencedAttachments(cutoff);
+    for (const auto& entry : unreferenced) {
+        // Only our own link is removed; downloads elsewhere keep the content
+        if (entry.storePath == blobPath(entry.sha256)) {
+            QFile::remove(entry.storePath);
+        }
+        db->removeStoredAttachment(entry.sha256);
+    }
+    if (!unreferenced.isEmpty()) {
+        qInfo() << "[AttachmentStore] Collected" << unreferenced.size() << "unreferenced attachments";
+    }
+    return static_cast<int>(unreferenced.size());
+}
+
+bool AttachmentStore::linkFile(const QString& from, const QString& to)
+{
+#ifdef Q_OS_WIN
+    return CreateHardLinkW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(to).utf16()),
+                           reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(from).utf16()),
+                           nullptr) != 0;
+#else
+    return ::link(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#endif
+}
+
+} // namespace services
+} // namespace flykylin
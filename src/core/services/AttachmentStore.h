@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QString>
+
+namespace flykylin {
+namespace services {
+
+/**
+ * @brief Content-addressed store of received attachments (keyed by SHA-256)
+ *
+ * Every received file whose hash has been verified is hard-linked into
+ * <AppData>/FlyKylin/attachments/<aa>/<sha256>; the index and the messages
+ * referring to each entry live in DatabaseService. When the same content
+ * arrives again the receiver answers FILE_REQUEST with "deduplicated" and
+ * materializes the download as another hard link, so neither the network
+ * nor the disk sees a second copy. Where linking is not possible (other
+ * volume, no filesystem support) the entry points at the received file
+ * itself and materializing falls back to a copy.
+ *
+ * Hard links share the inode, so an edit to any copy would change them
+ * all: entries remember size and mtime and are dropped when either changes.
+ *
+ * collectGarbage() runs after a chat history is cleared and drops entries
+ * no remaining message refers to.
+ */
+class AttachmentStore {
+public:
+    static AttachmentStore* instance();
+
+    QString storeDirectory() const;
+
+    /**
+     * @brief Path holding the content, empty if unknown or changed since stored
+     */
+    QString find(const QString& sha256, quint64 size) const;
+
+    /**
+     * @brief Record a received file whose SHA-256 was verified locally
+     */
+    bool adopt(const QString& sha256, const QString& filePath);
+
+    /**
+     * @brief Create targetPath with the stored content (replaces an existing file)
+     */
+    bool materialize(const QString& sha256, quint64 size, const QString& targetPath);
+
+    void addReference(const QString& sha256, const QString& messageId, const QString& localUserId);
+
+    /**
+     * @brief Drop entries no message refers to any more
+     * @return Number of entries removed
+     */
+    int collectGarbage();
+
+    /**
+     * @brief Hard-link from -> to (to must not exist)
+     */
+    static bool linkFile(const QString& from, const QString& to);
+
+private:
+    AttachmentStore() = default;
+
+    QString blobPath(const QString& sha256) const;
+    static bool isValidHash(const QString& sha256);
+
+    static constexpr qint64 kGcGraceMs = 10 * 60 * 1000;
+};
+
+} // namespace services
+} // namespace flykylin
@@ -1,11 +1,13 @@
 #include "ChatSearchService.h"
 
+#include "MessageVectorIndex.h"
+#include "../ai/EmbeddingCodec.h"
 #include "../ai/TextEmbeddingEngine.h"
 #include "../database/DatabaseService.h"
 #include <QDebug>
 #include <QElapsedTimer>
+#include <QSet>
 #include <algorithm>
-#include <cmath>
 #include <vector>
 
 namespace flykylin {
@@ -14,30 +16,8 @@ namespace services {
 using database::DatabaseService;
 
 namespace {
-// 语义重排的最大候选数量 - 限制RKNN推理次数以保证响应速度
-// 在RK3566上，每次BGE推理约需100-200ms，10条约需1-2秒
-constexpr int kMaxSemanticCandidates = 10;
-
-// 计算余弦相似度
-float cosineSimilarity(const std::vector<float>& a, const std::vector<float>& b)
-{
-    if (a.size() != b.size() || a.empty()) {
-        return 0.0f;
-    }
-
-    float dot = 0.0f;
-    float normA = 0.0f;
-    float normB = 0.0f;
-
-    for (std::size_t i = 0; i < a.size(); ++i) {
-        dot += a[i] * b[i];
-        normA += a[i] * a[i];
-        normB += b[i] * b[i];
-    }
-
-    const float denom = std::sqrt(normA) * std::sqrt(normB);
-    return (denom > 0.0f) ? (dot / denom) : 0.0f;
-}
+// 语义命中的最低相似度，低于此值的向量视为不相关
+constexpr float kMinSemanticScore = 0.5f;
 } // namespace
 
 QList<core::Message> ChatSearchService::search(const QString& localUserId,
@@ -62,21 +42,18 @@ QList<core::Message> ChatSearchService::search(const QString& localUserId,
         return {};
     }
 
+    // 不阻塞：后端仍在选择（加载/首次基准测试）时本次只做关键字搜索
     const bool engineAvailable = ai::TextEmbeddingEngine::instance()->isAvailable();
     const bool semanticAvailable = useSemantic && engineAvailable;
 
-    // 优化策略：
-    // 1. 始终先用关键字过滤，减少候选数量
-    // 2. 语义搜索只对关键字匹配的前N条进行重排
-    // 3. 如果关键字匹配结果太少，再扩大搜索范围
-
-    QList<core::Message> keywordMatches =
-        db->searchMessagesByKeyword(localUserId, trimmed, peerId, limit * 2);
+    // 关键字匹配始终执行：语义结果不足时用它补齐，引擎不可用时直接返回；
+    // 多取一倍，语义命中去重后仍能补满
+    QList<core::Message> keywordMatches = db->searchMessagesByKeyword(
+        localUserId, trimmed, peerId, limit * 2, filter.fromMs, filter.toMs);
 
     qInfo() << "[ChatSearchService] Keyword search for" << trimmed << "found"
             << keywordMatches.size() << "matches in" << timer.elapsed() << "ms";
 
-    // 如果不使用语义搜索，或者引擎不可用，直接返回关键字结果
     if (!semanticAvailable) {
         if (keywordMatches.size() > limit) {
             keywordMatches = keywordMatches.mid(0, limit);
@@ -86,17 +63,15 @@ QList<core::Message> ChatSearchService::search(const QString& localUserId,
         return keywordMatches;
     }
 
-    // 语义搜索：对关键字匹配结果进行语义重排
+    // 语义搜索：只计算查询的embedding，消息向量由MessageEmbeddingIndexer预先写入数据库和向量索引
     auto* engine = ai::TextEmbeddingEngine::instance();
 
-    // 计算查询的embedding
     QElapsedTimer embedTimer;
     embedTimer.start();
-    const std::vector<float> queryEmbedding = engine->computeEmbedding(trimmed);
+    std::vector<float> queryEmbedding = engine->computeEmbedding(trimmed);
     qInfo() << "[ChatSearchService] Query embedding computed in" << embedTimer.elapsed() << "ms";
 
-    if (queryEmbedding.empty()) {
-        // embedding计算失败，回退到关键字结果
+    if (!ai::embedding_codec::normalize(queryEmbedding)) {
         if (keywordMatches.size() > limit) {
             keywordMatches = keywordMatches.mid(0, limit);
         }
@@ -105,73 +80,82 @@ QList<core::Message> ChatSearchService::search(const QString& localUserId,
         return keywordMatches;
     }
 
-    // 限制语义重排的候选数量，避免过长的处理时间
-    const int semanticCandidateCount =
-        std::min(static_cast<int>(keywordMatches.size()), kMaxSemanticCandidates);
-
-    if (semanticCandidateCount == 0) {
-        qInfo() << "[ChatSearchService] No candidates for semantic ranking";
-        return keywordMatches;
-    }
-
-    qInfo() << "[ChatSearchService] Computing embeddings for" << semanticCandidateCount
-            << "candidates...";
-
-    struct ScoredMessage {
-        core::Message message;
-        float score;
-    };
-
-    std::vector<ScoredMessage> scored;
-    scored.reserve(static_cast<std::size_t>(semanticCandidateCount));
-
+    QList<qint64> rowIds;
     embedTimer.restart();
-    for (int i = 0; i < semanticCandidateCount; ++i) {
-        const auto& msg = keywordMatches.at(i);
-        const std::vector<float> msgEmbedding = engine->computeEmbedding(msg.content());
-
-        if (msgEmbedding.empty()) {
-            // embedding失败，给一个较低的默认分数
-            scored.push_back(ScoredMessage{msg, 0.0f});
-            continue;
+    if (MessageVectorIndex::instance()->isReady(engine->modelVersion())) {
+        // HNSW索引：只访问图中的一小部分向量
+        const std::vector<MessageVectorIndex::Hit> hits = MessageVectorIndex::instance()->search(
+            queryEmbedding, limit, localUserId, peerId, filter.fromMs, filter.toMs);
+        for (const auto& hit : hits) {
+            if (hit.score < kMinSemanticScore) {
+                break;
+            }
+            rowIds.append(hit.rowId);
         }
-
-        const float score = cosineSimilarity(queryEmbedding, msgEmbedding);
-        scored.push_back(ScoredMessage{msg, score});
-    }
-
-    qInfo() << "[ChatSearchService] Computed" << scored.size() << "embeddings in"
-            << embedTimer.elapsed() << "ms";
-
-    // 按相似度排序
-    std::sort(scored.begin(), scored.end(), [](const ScoredMessage& a, const ScoredMessage& b) {
-        if (std::abs(a.score - b.score) > 0.001f) {
-            return a.score > b.score;
+        qInfo() << "[ChatSearchService] Vector index returned" << rowIds.size() << "hits in"
+                << embedTimer.elapsed() << "ms";
+    } else {
+        // 索引尚未与数据库同步：逐条扫描已存储的向量
+        struct ScoredRow {
+            qint64 rowId;
+            float score;
+        };
+        const auto byScore = [](const ScoredRow& a, const ScoredRow& b) { return a.score > b.score; };
+
+        // 保留得分最高的limit条：按分数排列的最小堆，堆顶是当前最差的命中
+        std::vector<ScoredRow> best;
+        best.reserve(static_cast<std::size_t>(limit) + 1);
+        int scanned = 0;
+
+        db->forEachMessageEmbedding(localUserId, peerId, filter.fromMs, filter.toMs, engine->modelVersion(),
+                                    [&](qint64 rowId, const QByteArray& vector) {
+            ++scanned;
+            const float score = ai::embedding_codec::cosine(
+                queryEmbedding, reinterpret_cast<const uint8_t*>(vector.constData()),
+                static_cast<std::size_t>(vector.size()));
+            if (score < kMinSemanticScore) {
+                return;
+            }
+            if (static_cast<int>(best.size()) < limit) {
+                best.push_back(ScoredRow{rowId, score});
+                std::push_heap(best.begin(), best.end(), byScore);
+            } else if (score > best.front().score) {
+                std::pop_heap(best.begin(), best.end(), byScore);
+                best.back() = ScoredRow{rowId, score};
+                std::push_heap(best.begin(), best.end(), byScore);
+            }
+        });
+        std::sort_heap(best.begin(), best.end(), byScore);
+
+        qInfo() << "[ChatSearchService] Scanned" << scanned << "stored embeddings in"
+                << embedTimer.elapsed() << "ms";
+
+        rowIds.reserve(static_cast<int>(best.size()));
+        for (const ScoredRow& row : best) {
+            rowIds.append(row.rowId);
         }
-        // 相似度相近时，按时间降序
-        return a.message.timestamp() > b.message.timestamp();
-    });
+    }
 
-    // 构建结果：语义排序的结果 + 剩余的关键字匹配结果
-    QList<core::Message> result;
-    result.reserve(limit);
+    // 构建结果：按相似度排序的语义命中 + 未包含的关键字匹配结果
+    QList<core::Message> result = db->loadMessagesByRowIds(rowIds);
+    const int semanticCount = result.size();
 
-    // 添加语义排序的结果
-    for (const auto& sm : scored) {
+    QSet<QString> included;
+    for (const auto& msg : result) {
+        included.insert(msg.id());
+    }
+    for (const auto& msg : keywordMatches) {
         if (result.size() >= limit) {
             break;
         }
-        result.append(sm.message);
-    }
-
-    // 如果结果不够，添加剩余的关键字匹配结果
-    for (int i = semanticCandidateCount; i < keywordMatches.size() && result.size() < limit; ++i) {
-        result.append(keywordMatches.at(i));
+        if (!included.contains(msg.id())) {
+            result.append(msg);
+        }
     }
 
     qInfo() << "[ChatSearchService] Semantic search complete: query=" << trimmed
             << "keyword_matches=" << keywordMatches.size()
-            << "semantic_ranked=" << scored.size() << "returned=" << result.size()
+            << "semantic_hits=" << semanticCount << "returned=" << result.size()
             << "total_time=" << timer.elapsed() << "ms";
 
     return result;
@@ -9,15 +9,20 @@ namespace services {
 
 struct SearchFilter {
     QString peerId;   ///< Optional peer id filter; empty means search all peers
+    qint64 fromMs{0}; ///< Optional lower time bound (ms since epoch); 0 means unbounded
+    qint64 toMs{0};   ///< Optional upper time bound (ms since epoch); 0 means unbounded
     int limit{200};   ///< Max number of messages to return
 };
 
 /**
  * @brief Chat search service entry point.
  *
- * Currently only performs keyword-based search via DatabaseService. The
- * interface is pre-designed so that a future semantic search path using
- * TextEmbeddingEngine can be added without changing callers.
+ * Keyword search runs via DatabaseService. With useSemantic and an
+ * available TextEmbeddingEngine, only the query is embedded and looked up
+ * in MessageVectorIndex; until that index has caught up with the database
+ * the stored vectors are scanned instead. The best semantic hits come
+ * first, followed by keyword matches not already included. Messages not
+ * yet indexed are still found by keyword.
  */
 class ChatSearchService {
 public:
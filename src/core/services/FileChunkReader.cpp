@@ -0,0 +1,115 @@
+#include "FileChunkReader.h"
+
+#include "core/communication/Crc32c.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QMutexLocker>
+
+namespace flykylin {
+namespace services {
+
+FileChunkReader::FileChunkReader(QObject* parent)
+    : QObject(parent)
+{
+}
+
+FileChunkReader::~FileChunkReader()
+{
+    qDeleteAll(m_files);
+    m_files.clear();
+}
+
+void FileChunkReader::recycle(QByteArray buffer)
+{
+    // Only keep buffers nobody else references, otherwise writing into
+    // them later would detach (copy) anyway.
+    if (buffer.isDetached() && buffer.capacity() > 0) {
+        QMutexLocker locker(&m_poolMutex);
+        if (m_pool.size() < kMaxPooledBuffers) {
+            m_pool.append(std::move(buffer));
+        }
+    }
+}
+
+QByteArray FileChunkReader::takeBuffer(qint64 size)
+{
+    QByteArray buffer;
+    {
+        QMutexLocker locker(&m_poolMutex);
+        if (!m_pool.isEmpty()) {
+            buffer = m_pool.takeLast();
+        }
+    }
+    buffer.resize(static_cast<int>(size));
+    return buffer;
+}
+
+void FileChunkReader::readChunk(const QString& transferId,
+                                const QString& filePath,
+                                quint64 offset,
+                                qint64 size)
+{
+    QFile* file = m_files.value(transferId, nullptr);
+    if (!file) {
+        file = new QFile(filePath);
+        if (!file->open(QIODevice::ReadOnly)) {
+            qWarning() << "[FileChunkReader] Failed to open" << filePath << file->errorString();
+            delete file;
+            emit chunkRead(transferId, offset, QByteArray(), 0, false);
+            return;
+        }
+        m_files.insert(transferId, file);
+    }
+
+    if (file->pos() != static_cast<qint64>(offset) && !file->seek(static_cast<qint64>(offset))) {
+        emit chunkRead(transferId, offset, QByteArray(), 0, false);
+        return;
+    }
+
+    QByteArray buffer = takeBuffer(size);
+    const qint64 readBytes = size > 0 ? file->read(buffer.data(), size) : 0;
+    if (readBytes < 0) {
+        qWarning() << "[FileChunkReader] Failed to read" << filePath << file->errorString();
+        emit chunkRead(transferId, offset, QByteArray(), 0, false);
+        return;
+    }
+
+    buffer.resize(static_cast<int>(readBytes));
+    const quint32 crc = communication::crc32c(buffer.constData(), static_cast<std::size_t>(readBytes));
+    emit chunkRead(transferId, offset, buffer, crc, true);
+}
+
+void FileChunkReader::closeTransfer(const QString& transferId)
+{
+    delete m_files.take(transferId);
+}
+
+void FileChunkReader::computeDigest(const QString& transferId, const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit digestReady(transferId, 0, false);
+        return;
+    }
+
+    QByteArray buffer = takeBuffer(kDigestBlockSize);
+    quint32 crc = 0;
+    while (true) {
+        const qint64 readBytes = file.read(buffer.data(), kDigestBlockSize);
+        if (readBytes < 0) {
+            recycle(std::move(buffer));
+            emit digestReady(transferId, 0, false);
+            return;
+        }
+        if (readBytes == 0) {
+            break;
+        }
+        crc = communication::crc32c(buffer.constData(), static_cast<std::size_t>(readBytes), crc);
+    }
+    recycle(std::move(buffer));
+    emit digestReady(transferId, crc, true);
+}
+
+} // namespace services
+} // namespace flykylin
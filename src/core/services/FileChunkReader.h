@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+class QFile;
+
+namespace flykylin {
+namespace services {
+
+/**
+ * @brief Reads file chunks for outgoing transfers on a worker thread
+ *
+ * Lives on FileTransferService's I/O thread. Requests arrive as queued
+ * invocations of readChunk(); results come back through chunkRead() on the
+ * requester's thread. Chunk buffers are pooled: the sender hands them back
+ * with recycle() once the socket has copied them, so a steady-state
+ * transfer allocates nothing per chunk.
+ */
+class FileChunkReader : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FileChunkReader(QObject* parent = nullptr);
+    ~FileChunkReader() override;
+
+    /**
+     * @brief Return a chunk buffer to the pool (thread-safe)
+     */
+    void recycle(QByteArray buffer);
+
+public slots:
+    void readChunk(const QString& transferId,
+                   const QString& filePath,
+                   quint64 offset,
+                   qint64 size);
+    void closeTransfer(const QString& transferId);
+    /**
+     * @brief CRC32C of the whole file (read sequentially, result via digestReady)
+     */
+    void computeDigest(const QString& transferId, const QString& filePath);
+
+signals:
+    /**
+     * @param data Chunk bytes (empty with ok=false on error)
+     * @param crc CRC32C of data
+     * @param ok False if the file could not be opened or read
+     */
+    void chunkRead(const QString& transferId,
+                   quint64 offset,
+                   const QByteArray& data,
+                   quint32 crc,
+                   bool ok);
+    void digestReady(const QString& transferId, quint32 crc, bool ok);
+
+private:
+    QByteArray takeBuffer(qint64 size);
+
+    QHash<QString, QFile*> m_files;   ///< transferId -> open handle (worker thread only)
+
+    QMutex m_poolMutex;
+    QList<QByteArray> m_pool;
+
+    static constexpr int kMaxPooledBuffers = 16;
+    static constexpr qint64 kDigestBlockSize = 1024 * 1024;
+};
+
+} // namespace services
+} // namespace flykylin
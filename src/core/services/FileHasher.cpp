@@ -0,0 +1,129 @@
+#include "FileHasher.h"
+
+#include "core/communication/Sha256.h"
+#include "core/communication/XxHash64.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+namespace flykylin {
+namespace services {
+
+namespace {
+
+QString cacheKey(const QFileInfo& info)
+{
+    const QString canonical = info.canonicalFilePath();
+    return canonical.isEmpty() ? info.absoluteFilePath() : canonical;
+}
+
+} // namespace
+
+FileHasher::FileHasher(QObject* parent)
+    : QObject(parent)
+{
+}
+
+bool FileHasher::cachedHash(const QString& filePath, Result* result) const
+{
+    const QFileInfo info(filePath);
+    if (!info.isFile()) {
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_cache.constFind(cacheKey(info));
+    if (it == m_cache.constEnd()
+        || it->size != static_cast<quint64>(info.size())
+        || it->modifiedMs != info.lastModified().toMSecsSinceEpoch()) {
+        return false;
+    }
+    if (result) {
+        *result = it.value();
+    }
+    return true;
+}
+
+void FileHasher::cancel(const QString& requestId)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cancelled.insert(requestId);
+}
+
+bool FileHasher::takeCancelled(const QString& requestId)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cancelled.remove(requestId);
+}
+
+void FileHasher::hashFile(const QString& requestId, const QString& filePath)
+{
+    Result cached;
+    if (cachedHash(filePath, &cached)) {
+        takeCancelled(requestId);
+        emit fileHashed(requestId, cached.sha256, cached.xxh64, true);
+        return;
+    }
+
+    QFile file(filePath);
+    const QFileInfo info(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "[FileHasher] Failed to open" << filePath << file.errorString();
+        takeCancelled(requestId);
+        emit fileHashed(requestId, QString(), 0, false);
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    communication::Sha256 sha;
+    communication::XxHash64 xxh;
+    QByteArray buffer(static_cast<int>(kBlockSize), Qt::Uninitialized);
+    quint64 total = 0;
+    while (true) {
+        if (takeCancelled(requestId)) {
+            emit fileHashed(requestId, QString(), 0, false);
+            return;
+        }
+        const qint64 readBytes = file.read(buffer.data(), kBlockSize);
+        if (readBytes < 0) {
+            qWarning() << "[FileHasher] Failed to read" << filePath << file.errorString();
+            emit fileHashed(requestId, QString(), 0, false);
+            return;
+        }
+        if (readBytes == 0) {
+            break;
+        }
+        sha.update(buffer.constData(), static_cast<std::size_t>(readBytes));
+        xxh.update(buffer.constData(), static_cast<std::size_t>(readBytes));
+        total += static_cast<quint64>(readBytes);
+    }
+
+    Result result;
+    result.sha256 = QString::fromStdString(communication::Sha256::toHex(sha.finish()));
+    result.xxh64 = xxh.digest();
+    result.size = total;
+    result.modifiedMs = info.lastModified().toMSecsSinceEpoch();
+
+    const qint64 elapsedMs = timer.elapsed();
+    qInfo() << "[FileHasher] Hashed" << total << "bytes of" << filePath << "in" << elapsedMs << "ms using"
+            << communication::Sha256::implementationName(sha.implementation());
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_cache.size() >= kMaxCacheEntries) {
+            m_cache.erase(m_cache.begin());
+        }
+        m_cache.insert(cacheKey(info), result);
+        m_cancelled.remove(requestId);
+    }
+    emit fileHashed(requestId, result.sha256, result.xxh64, true);
+}
+
+} // namespace services
+} // namespace flykylin
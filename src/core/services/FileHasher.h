@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+
+namespace flykylin {
+namespace services {
+
+/**
+ * @brief Computes whole-file SHA-256 and XXH64 on a worker thread
+ *
+ * Lives on FileTransferService's hash thread, next to (not inside) the
+ * chunk reader, so hashing a large file runs alongside the send
+ * pipeline instead of delaying it. The hasher reads sequentially ahead of
+ * the chunk reader, which then mostly hits the page cache.
+ *
+ * Results are cached by path, size and modification time, so sending the
+ * same file again (or to another peer) knows the hash up front.
+ */
+class FileHasher : public QObject {
+    Q_OBJECT
+
+public:
+    struct Result {
+        QString sha256;     ///< Lower-case hex
+        quint64 xxh64{0};
+        quint64 size{0};
+        qint64 modifiedMs{0};
+    };
+
+    explicit FileHasher(QObject* parent = nullptr);
+
+    /**
+     * @brief Cached hash if the file is unchanged since it was hashed (thread-safe)
+     */
+    bool cachedHash(const QString& filePath, Result* result) const;
+
+    /**
+     * @brief Stop a queued or running hashFile() early (thread-safe)
+     *
+     * The request still finishes with fileHashed(ok=false).
+     */
+    void cancel(const QString& requestId);
+
+public slots:
+    void hashFile(const QString& requestId, const QString& filePath);
+
+signals:
+    void fileHashed(const QString& requestId, const QString& sha256, quint64 xxh64, bool ok);
+
+private:
+    bool takeCancelled(const QString& requestId);
+
+    mutable QMutex m_mutex;
+    QHash<QString, Result> m_cache;     ///< Canonical path -> result
+    QSet<QString> m_cancelled;
+
+    static constexpr qint64 kBlockSize = 1024 * 1024;
+    static constexpr int kMaxCacheEntries = 256;
+};
+
+} // namespace services
+} // namespace flykylin
@@ -0,0 +1,416 @@
+#include "FileTransferService.h"
+#include "FileTransferSettings.h"
+
+#include "../communication/BulkChannel.h"
+#include <QDebug>
+#include <QFile>
+#include <QHostAddress>
+#include <QRandomGenerator>
+#include <QSettings>
+#include <QThread>
+#include <string>
+
+namespace {
+bool bulkTransferEnabled()
+{
+    QSettings settings("FlyKylin", "FlyKylin");
+    return settings.value("transfer/bulkMode", true).toBool();
+}
+}
+
+namespace flykylin {
+namespace services {
+
+using namespace file_transfer;
+
+void FileTransferService::updateStripes(OutgoingTransfer& transfer, quint64 sentBytes)
+{
+    const qint64 nowMs = transfer.elapsed.elapsed();
+    const int before = transfer.stripeController.stripes();
+    const int after = transfer.stripeController.addSample(sentBytes, nowMs - transfer.stripeSampleMs);
+    transfer.stripeSampleMs = nowMs;
+    if (after == before) {
+        return;
+    }
+
+    qInfo() << "[FileTransferService]" << transfer.transferId << "stripes" << before << "->"
+            << after << "at" << transfer.stripeController.rate() / (1024.0 * 1024.0) << "MB/s";
+    m_connectionManager->openDataLanes(transfer.peerId, after - 1);
+}
+
+void FileTransferService::releaseDataLanes(const QString& peerId)
+{
+    for (const OutgoingTransfer& transfer : m_outgoingTransfers) {
+        if (transfer.striped && transfer.peerId == peerId) {
+            return;
+        }
+    }
+    m_connectionManager->closeDataLanes(peerId);
+}
+
+bool FileTransferService::canSendBulk(const QString& peerId) const
+{
+    const quint32 capabilities = m_connectionManager->peerCapabilities(peerId);
+    return communication::BulkChannel::isSupported()
+        && (capabilities & communication::CapabilityResumableTransfer)
+        && (capabilities & communication::CapabilityBulkTransfer)
+        && bulkTransferEnabled();
+}
+
+void FileTransferService::startBulkSend(OutgoingTransfer& transfer, quint16 port, quint64 token)
+{
+    // Under a bandwidth limit the worker paces itself after each range, so
+    // keep ranges to ~100ms of traffic instead of kMaxRangeBytes bursts
+    const quint64 paceBytesPerSecond = m_scheduler.paceBytesPerSecond();
+    const quint64 maxRange = paceBytesPerSecond == 0
+            ? communication::BulkChannel::kMaxRangeBytes
+            : qBound<quint64>(TransferScheduler::kMinBurstBytes, paceBytesPerSecond / 10,
+                              communication::BulkChannel::kMaxRangeBytes);
+    std::vector<communication::BulkRange> ranges;
+    for (const ByteRange& range : transfer.readQueue) {
+        for (quint64 offset = 0; offset < range.length; offset += maxRange) {
+            ranges.push_back(communication::BulkRange{range.offset + offset,
+                                                      qMin(maxRange, range.length - offset)});
+        }
+    }
+    transfer.readQueue.clear();
+    transfer.phase = SendPhase::Streaming;
+    if (transfer.paused) {
+        // resumeTransfer() starts a new session
+        return;
+    }
+
+    const QString peerAddress = m_connectionManager->peerAddress(transfer.peerId);
+    qInfo() << "[FileTransferService] Sending" << transfer.fileSize - transfer.sentBytes
+            << "bytes of" << transfer.transferId << "with sendfile() to" << peerAddress << ":" << port;
+
+    BulkJob job;
+    job.state = std::make_shared<BulkJobState>();
+    job.serial = m_nextBulkSerial++;
+
+    const std::shared_ptr<BulkJobState> state = job.state;
+    const quint64 serial = job.serial;
+    const QString transferId = transfer.transferId;
+    const std::string host = peerAddress.toStdString();
+    const std::string filePath = QFile::encodeName(transfer.filePath).toStdString();
+    startBulkJob(QStringLiteral("send:") + transferId, job,
+                 [this, state, serial, transferId, host, port, token, filePath, ranges,
+                  paceBytesPerSecond]() {
+        // sendfile() bypasses the chunk scheduler: hold the bandwidth limit
+        // here; the bytes are charged to the shared buckets in onBulkSent()
+        TokenBucket pacer;
+        pacer.configure(paceBytesPerSecond, TransferScheduler::burstFor(paceBytesPerSecond), 0);
+        QElapsedTimer clock;
+        clock.start();
+
+        const int socketFd = communication::BulkChannel::connect(host, port, kBulkConnectTimeoutMs);
+        state->setSocket(socketFd);
+        const int fileFd = communication::BulkChannel::openSource(filePath);
+        const bool ok = socketFd >= 0 && fileFd >= 0
+            && communication::BulkChannel::sendRanges(
+                   socketFd, fileFd, token, ranges, state->cancel,
+                   [this, serial, transferId, state, &pacer, &clock](const communication::BulkRange& range) {
+                       const quint64 length = range.length;
+                       QMetaObject::invokeMethod(this, [this, transferId, serial, length]() {
+                           onBulkSent(transferId, serial, length);
+                       }, Qt::QueuedConnection);
+
+                       pacer.consume(length, clock.elapsed());
+                       qint64 waitMs = 0;
+                       while (!state->cancel.load() && (waitMs = pacer.waitMs(clock.elapsed())) > 0) {
+                           QThread::msleep(static_cast<unsigned long>(qMin<qint64>(waitMs, 100)));
+                       }
+                   });
+        communication::BulkChannel::close(fileFd);
+        state->setSocket(-1);
+        communication::BulkChannel::close(socketFd);
+        QMetaObject::invokeMethod(this, [this, transferId, serial, ok]() {
+            onBulkSendFinished(transferId, serial, ok);
+        }, Qt::QueuedConnection);
+    });
+}
+
+quint16 FileTransferService::ensureBulkReceiver(TransferContext& ctx)
+{
+    const QString key = QStringLiteral("recv:") + ctx.transferId;
+    auto existing = m_bulkJobs.constFind(key);
+    if (existing != m_bulkJobs.constEnd() && !existing->state->connected.load()
+        && !existing->state->cancel.load()) {
+        return existing->port;   // the sender has not connected yet
+    }
+    if (ctx.writerOpened) {
+        // Chunks already queued to the temp file: stay on chunks for this transfer
+        ctx.bulk = false;
+        return 0;
+    }
+
+    quint16 port = 0;
+    const int listenFd = communication::BulkChannel::listen(&port);
+    if (listenFd < 0) {
+        qWarning() << "[FileTransferService] Could not open a bulk socket for" << ctx.transferId;
+        ctx.bulk = false;
+        return 0;
+    }
+
+    ctx.bulkToken = QRandomGenerator::global()->generate64();
+    BulkJob job;
+    job.state = std::make_shared<BulkJobState>();
+    job.serial = m_nextBulkSerial++;
+    job.port = port;
+
+    const std::shared_ptr<BulkJobState> state = job.state;
+    const quint64 serial = job.serial;
+    const QString transferId = ctx.transferId;
+    const QString expectedPeer = m_connectionManager->peerAddress(ctx.peerId);
+    const std::string partPath =
+        QFile::encodeName(incomingFilePath(ctx) + QLatin1String(kPartialFileSuffix)).toStdString();
+    const quint64 fileSize = ctx.fileSize;
+    const quint64 token = ctx.bulkToken;
+    startBulkJob(key, job,
+                 [this, state, serial, transferId, expectedPeer, listenFd, partPath, fileSize, token]() {
+        std::string peerIp;
+        int socketFd = communication::BulkChannel::accept(listenFd, kBulkAcceptTimeoutMs,
+                                                          state->cancel, &peerIp);
+        communication::BulkChannel::close(listenFd);
+        if (socketFd >= 0 && !expectedPeer.isEmpty()
+            && !QHostAddress(QString::fromStdString(peerIp))
+                    .isEqual(QHostAddress(expectedPeer), QHostAddress::TolerantConversion)) {
+            qWarning() << "[FileTransferService] Bulk connection for" << transferId
+                       << "from unexpected address" << QString::fromStdString(peerIp);
+            communication::BulkChannel::close(socketFd);
+            socketFd = -1;
+        }
+        state->connected = socketFd >= 0;
+        state->setSocket(socketFd);
+
+        const int fileFd = socketFd >= 0
+                ? communication::BulkChannel::openTarget(partPath, fileSize)
+                : -1;
+        // Ranges reported as synced (and everything before them) are on
+        // disk, so the receiver may persist them
+        quint64 unsynced = 0;
+        bool firstRange = true;
+        const bool ok = fileFd >= 0
+            && communication::BulkChannel::receiveRanges(
+                   socketFd, fileFd, fileSize, token, state->cancel,
+                   [this, serial, transferId, fileFd, &unsynced, &firstRange](
+                           const communication::BulkRange& range) {
+                       const quint64 offset = range.offset;
+                       const quint64 length = range.length;
+                       unsynced += length;
+                       bool synced = false;
+                       if (firstRange || unsynced >= kPartialSaveIntervalBytes) {
+                           synced = communication::BulkChannel::syncTarget(fileFd);
+                           firstRange = false;
+                           unsynced = synced ? 0 : unsynced;
+                       }
+                       QMetaObject::invokeMethod(this, [this, transferId, serial, offset, length, synced]() {
+                           onBulkReceived(transferId, serial, offset, length, synced);
+                       }, Qt::QueuedConnection);
+                   });
+        const bool synced = fileFd >= 0 && communication::BulkChannel::syncTarget(fileFd);
+        communication::BulkChannel::close(fileFd);
+        state->setSocket(-1);
+        communication::BulkChannel::close(socketFd);
+        QMetaObject::invokeMethod(this, [this, transferId, serial, ok, synced]() {
+            onBulkReceiveFinished(transferId, serial, ok, synced);
+        }, Qt::QueuedConnection);
+    });
+
+    qInfo() << "[FileTransferService] Waiting for bulk data of" << ctx.transferId << "on port" << port;
+    return port;
+}
+
+void FileTransferService::startBulkJob(const QString& key,
+                                       const BulkJob& job,
+                                       std::function<void()> body)
+{
+    stopBulkJob(key);
+
+    BulkJob started = job;
+    started.thread = QThread::create(std::move(body));
+    started.thread->setObjectName(QStringLiteral("FileTransferBulk"));
+    QThread* thread = started.thread;
+    connect(thread, &QThread::finished, this, [this, thread]() {
+        m_bulkThreads.removeOne(thread);
+        thread->deleteLater();
+    });
+    m_bulkThreads.append(thread);
+    m_bulkJobs.insert(key, started);
+    thread->start();
+}
+
+void FileTransferService::stopBulkJob(const QString& key)
+{
+    auto it = m_bulkJobs.find(key);
+    if (it == m_bulkJobs.end()) {
+        return;
+    }
+
+    // The thread winds down on its own; its late results are ignored
+    it->state->cancel = true;
+    it->state->interrupt();
+    m_bulkJobs.erase(it);
+}
+
+void FileTransferService::interruptBulkJob(const QString& key)
+{
+    auto it = m_bulkJobs.find(key);
+    if (it == m_bulkJobs.end()) {
+        return;
+    }
+
+    // Unlike stopBulkJob() the job stays current, so its finish callback
+    // still reports (and persists) what reached the disk
+    it->state->cancel = true;
+    it->state->interrupt();
+}
+
+bool FileTransferService::isCurrentBulkJob(const QString& key, quint64 serial) const
+{
+    auto it = m_bulkJobs.constFind(key);
+    return it != m_bulkJobs.constEnd() && it->serial == serial;
+}
+
+void FileTransferService::onBulkSent(const QString& transferId, quint64 serial, quint64 length)
+{
+    if (!isCurrentBulkJob(QStringLiteral("send:") + transferId, serial)) {
+        return;
+    }
+    auto it = m_outgoingTransfers.find(transferId);
+    if (it == m_outgoingTransfers.end()) {
+        return;
+    }
+    it->sentBytes += length;
+    m_scheduler.charge(transferId.toStdString(), length, m_schedulerClock.elapsed());
+    emitTransferProgress(it.value(), false);
+}
+
+void FileTransferService::onBulkSendFinished(const QString& transferId, quint64 serial, bool ok)
+{
+    const QString key = QStringLiteral("send:") + transferId;
+    if (!isCurrentBulkJob(key, serial)) {
+        return;
+    }
+    m_bulkJobs.remove(key);
+
+    auto it = m_outgoingTransfers.find(transferId);
+    if (it == m_outgoingTransfers.end() || it->phase != SendPhase::Streaming) {
+        return;
+    }
+
+    OutgoingTransfer& transfer = it.value();
+    if (ok) {
+        emitTransferProgress(transfer, true);
+        sendFileComplete(transfer);
+        return;
+    }
+
+    // Ask the receiver what it still needs; chunks after kMaxBulkFailures
+    ++transfer.bulkFailures;
+    qWarning() << "[FileTransferService] Bulk send of" << transferId << "failed after"
+               << transfer.sentBytes << "bytes (" << transfer.bulkFailures << "of" << kMaxBulkFailures << ")";
+    resetOutgoingSession(transfer);
+    if (m_connectionManager->isPeerReady(transfer.peerId)) {
+        startOutgoingSession(transfer);
+    }
+}
+
+void FileTransferService::onBulkReceived(const QString& transferId,
+                                         quint64 serial,
+                                         quint64 offset,
+                                         quint64 length,
+                                         bool synced)
+{
+    if (!isCurrentBulkJob(QStringLiteral("recv:") + transferId, serial)) {
+        return;
+    }
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end()) {
+        return;
+    }
+
+    TransferContext& ctx = it.value();
+    if (offset > ctx.fileSize || length > ctx.fileSize - offset) {
+        return;   // receiveRanges() already refuses these
+    }
+    const bool added = ctx.received.add(offset, length, 0);
+    if (added) {
+        ctx.bulkReceived = true;
+        ctx.resumeExisting = true;   // the temp file holds data the writer must keep
+        ctx.receivedBytes += length;
+    }
+    if (synced) {
+        // The receiving thread flushed the file: every range so far is on disk
+        ctx.durable = ctx.received;
+        persistPartialTransfer(ctx);
+    }
+    if (!added) {
+        return;
+    }
+    if (ctx.completePending && ctx.received.isComplete(ctx.fileSize)) {
+        verifyIncomingTransfer(transferId);
+    }
+}
+
+void FileTransferService::onBulkReceiveFinished(const QString& transferId,
+                                                quint64 serial,
+                                                bool ok,
+                                                bool synced)
+{
+    const QString key = QStringLiteral("recv:") + transferId;
+    if (!isCurrentBulkJob(key, serial)) {
+        return;
+    }
+    m_bulkJobs.remove(key);
+
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end()) {
+        return;
+    }
+
+    if (!ok) {
+        qWarning() << "[FileTransferService] Bulk receive of" << transferId << "ended at"
+                   << it->receivedBytes << "/" << it->fileSize << "bytes";
+    }
+    if (it->bulkReceived && synced) {
+        it->durable = it->received;
+        persistPartialTransfer(it.value());
+    }
+    if (it->completePending) {
+        verifyIncomingTransfer(transferId);
+    }
+}
+
+void FileTransferService::onWriterDrained(const QString& transferId)
+{
+    const QString peerId = m_writerBacklog.take(transferId);
+    if (peerId.isEmpty()) {
+        return;
+    }
+    // Other transfers from the same peer may still be backlogged
+    for (auto it = m_writerBacklog.constBegin(); it != m_writerBacklog.constEnd(); ++it) {
+        if (it.value() == peerId) {
+            return;
+        }
+    }
+    m_connectionManager->setPeerReadsPaused(peerId, false);
+}
+
+void FileTransferService::BulkJobState::setSocket(int fd)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    socketFd = fd;
+    if (cancel.load()) {
+        communication::BulkChannel::interrupt(fd);
+    }
+}
+
+void FileTransferService::BulkJobState::interrupt()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    communication::BulkChannel::interrupt(socketFd);
+}
+
+} // namespace services
+} // namespace flykylin
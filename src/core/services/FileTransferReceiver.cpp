@@ -0,0 +1,1003 @@
+#include "FileTransferService.h"
+#include "AttachmentStore.h"
+#include "FileHasher.h"
+#include "FileTransferSettings.h"
+#include "FileWriteBehind.h"
+
+#include "../ai/NSFWDetector.h"
+#include "../communication/Crc32c.h"
+#include "../database/DatabaseService.h"
+#include <QByteArray>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QSettings>
+#include <QStorageInfo>
+#include <QTimer>
+#include <string>
+#include "messages.pb.h"
+
+namespace {
+bool nsfwBlockIncoming()
+{
+    QSettings settings("FlyKylin", "FlyKylin");
+    return settings.value("nsfw/blockIncoming", false).toBool();
+}
+}
+
+namespace flykylin {
+namespace services {
+
+using namespace file_transfer;
+
+void FileTransferService::handleFileRequest(const QString& peerId, const std::string& payload)
+{
+    flykylin::protocol::FileTransferRequest req;
+    if (!req.ParseFromString(payload)) {
+        return;
+    }
+
+    QString transferId = QString::fromStdString(req.transfer_id());
+
+    if (req.resumable()) {
+        // Same transfer again after a reconnect: re-key the frame index and
+        // report what is still missing
+        auto existing = m_incomingTransfers.find(transferId);
+        if (existing != m_incomingTransfers.end() && existing->resumable) {
+            // Only the original sender may pick the transfer up again
+            const QString peerAddress = m_connectionManager->peerAddress(peerId);
+            const bool samePeer = existing->peerId == peerId
+                || (!peerAddress.isEmpty()
+                    && QHostAddress(peerAddress).isEqual(QHostAddress(existing->peerAddress),
+                                                         QHostAddress::TolerantConversion));
+            if (!samePeer || QString::fromStdString(req.from_user_id()) != existing->fromUserId) {
+                qWarning() << "[FileTransferService] Resume of" << transferId << "from" << peerId
+                           << "does not match the original sender - rejecting";
+                refuseFileRequest(peerId, transferId, QStringLiteral("Transfer id in use"));
+                return;
+            }
+            if (existing->transferIndex != 0) {
+                m_transferIndexes.remove(qMakePair(existing->peerId, existing->transferIndex));
+            }
+            existing->peerId = peerId;
+            if (!req.file_hash().empty()) {
+                existing->fileHash = QString::fromStdString(req.file_hash());
+            }
+            existing->transferIndex = req.transfer_index();
+            if (existing->transferIndex != 0) {
+                m_transferIndexes.insert(qMakePair(peerId, existing->transferIndex), transferId);
+            }
+            existing->bulk = req.bulk();
+            if (!existing->bulk && existing->bulkReceived) {
+                // Back to chunks: the bulk ranges have no CRCs to build the digest from
+                qInfo() << "[FileTransferService]" << transferId
+                        << "left bulk mode - refetching with checksummed chunks";
+                existing->received.clear();
+                existing->durable.clear();
+                existing->receivedBytes = 0;
+                existing->bulkReceived = false;
+            }
+            if (existing->accepted) {
+                sendFileResponse(existing.value(), true, QString(), false);
+            }
+            return;
+        }
+    }
+
+    removeIncomingTransfer(transferId);
+
+    TransferContext ctx;
+    ctx.transferId = transferId;
+    ctx.peerId = peerId;
+    ctx.peerAddress = m_connectionManager->peerAddress(peerId);
+    ctx.fromUserId = QString::fromStdString(req.from_user_id());
+    ctx.fileName = QString::fromStdString(req.file_name());
+    ctx.fileSize = req.file_size();
+    ctx.fileHash = QString::fromStdString(req.file_hash());
+    ctx.resumable = req.resumable();
+    ctx.bulk = ctx.resumable && req.bulk();
+
+    const QString mimeType = QString::fromStdString(req.mime_type());
+    ctx.mimeType = mimeType;
+    ctx.isImage = mimeType.startsWith(QStringLiteral("image/"));
+    ctx.accepted = ctx.isImage ? m_autoAcceptImages : m_autoAcceptFiles;
+    ctx.isGroup = req.is_group();
+    if (ctx.isGroup) {
+        ctx.groupId = QString::fromStdString(req.group_id());
+    }
+
+    core::Message message;
+    message.setId(transferId);
+    message.setFromUserId(ctx.fromUserId);
+    message.setToUserId(QString::fromStdString(req.to_user_id()));
+    message.setTimestamp(QDateTime::fromMSecsSinceEpoch(req.timestamp()));
+    message.setStatus(core::MessageStatus::Sending);
+    message.setKind(ctx.isImage ? core::MessageKind::Image : core::MessageKind::File);
+    message.setAttachmentName(ctx.fileName);
+    message.setAttachmentSize(ctx.fileSize);
+    message.setMimeType(mimeType);
+    message.setContent(ctx.fileName);
+    if (ctx.isGroup && !ctx.groupId.isEmpty()) {
+        message.setIsGroup(true);
+        message.setGroupId(ctx.groupId);
+    }
+
+    ctx.message = message;
+    if (ctx.resumable && restorePartialTransfer(ctx)) {
+        // Accepted in an earlier session (possibly before a restart)
+        ctx.accepted = true;
+    }
+
+    // Refused before anything is allocated: the size decides how much
+    // disk the writer reserves
+    const QString refusal = checkIncomingSize(ctx);
+    if (!refusal.isEmpty()) {
+        qWarning() << "[FileTransferService] Refusing" << transferId << "from" << peerId << ":" << refusal
+                   << "(" << ctx.fileSize << "bytes)";
+        refuseFileRequest(peerId, transferId, refusal);
+        return;
+    }
+
+    ctx.transferIndex = req.transfer_index();
+    if (ctx.transferIndex != 0) {
+        m_transferIndexes.insert(qMakePair(peerId, ctx.transferIndex), transferId);
+    }
+    m_incomingTransfers.insert(transferId, ctx);
+    if (m_blockedPreviews.remove(transferId)) {
+        rejectTransfer(transferId, QStringLiteral("NSFW policy blocked incoming image"));
+        return;
+    }
+    emit incomingTransferRequested(transferId, peerId, message);
+
+    auto it = m_incomingTransfers.find(transferId);
+    if (it != m_incomingTransfers.end() && it->resumable && it->accepted
+        && !completeFromStore(transferId)) {
+        sendFileResponse(it.value(), true, QString(), false);
+    }
+}
+
+QString FileTransferService::checkIncomingSize(const TransferContext& ctx) const
+{
+    // Only the bulk channel may go past the chunked limit (as on the sending side)
+    if (ctx.fileSize > kMaxFileSizeBytes && !ctx.bulk) {
+        return QStringLiteral("File too large");
+    }
+
+    const quint64 have = ctx.received.coveredBytes();
+    const quint64 needed = ctx.fileSize > have ? ctx.fileSize - have : 0;
+    const QString directory = ctx.downloadDirectoryOverride.isEmpty()
+            ? ensureDownloadDirectory(ctx.isImage)
+            : ctx.downloadDirectoryOverride;
+    const QStorageInfo storage(directory);
+    if (storage.isValid() && static_cast<quint64>(qMax<qint64>(storage.bytesAvailable(), 0)) < needed) {
+        return QStringLiteral("Not enough disk space");
+    }
+    return QString();
+}
+
+void FileTransferService::refuseFileRequest(const QString& peerId,
+                                            const QString& transferId,
+                                            const QString& reason)
+{
+    flykylin::protocol::FileTransferResponse resp;
+    resp.set_transfer_id(transferId.toStdString());
+    resp.set_accepted(false);
+    resp.set_reason(reason.toStdString());
+    sendControlMessage(peerId, flykylin::protocol::TcpMessage::FILE_RESPONSE, resp.SerializeAsString());
+}
+
+bool FileTransferService::restorePartialTransfer(TransferContext& ctx)
+{
+    auto* db = database::DatabaseService::instance();
+    database::DatabaseService::PartialTransfer partial;
+    if (!db->loadPartialTransfer(ctx.transferId, partial)
+        && !db->findPartialTransfer(ctx.fromUserId, ctx.fileName, ctx.fileSize, partial)) {
+        return false;
+    }
+
+    if (partial.fromUserId != ctx.fromUserId) {
+        return false;   // same id from someone else: not theirs to resume
+    }
+    if (partial.fileSize != ctx.fileSize
+        || !QFileInfo::exists(partial.localFilePath + QLatin1String(kPartialFileSuffix))
+        || !TransferRanges::deserialize(partial.receivedRanges.toStdString(), ctx.received)) {
+        db->removePartialTransfer(partial.transferId);
+        ctx.received.clear();
+        return false;
+    }
+
+    if (partial.transferId != ctx.transferId) {
+        // Sender restarted and re-sent the file under a new id
+        db->removePartialTransfer(partial.transferId);
+    }
+
+    ctx.localFilePath = partial.localFilePath;
+    ctx.message.setAttachmentLocalPath(ctx.localFilePath);
+    ctx.durable = ctx.received;
+    ctx.receivedBytes = ctx.received.coveredBytes();
+    ctx.resumeExisting = true;
+    persistPartialTransfer(ctx);
+
+    qInfo() << "[FileTransferService] Resuming incoming" << ctx.fileName << "at"
+            << ctx.receivedBytes << "/" << ctx.fileSize << "bytes";
+    return true;
+}
+
+void FileTransferService::savePartialTransfer(TransferContext& ctx)
+{
+    ctx.unsavedBytes = 0;
+    if (!ctx.writerOpened) {
+        persistPartialTransfer(ctx);
+        return;
+    }
+
+    // Only ranges the writer has flushed to disk get persisted: after a
+    // crash the row must never claim bytes the temp file does not hold
+    if (ctx.syncSerial != 0) {
+        ctx.syncAgain = true;
+        return;
+    }
+    ctx.syncSerial = m_nextSyncSerial++;
+    ctx.syncing = ctx.received;
+    m_writer->sync(ctx.transferId, ctx.syncSerial);
+}
+
+void FileTransferService::onWriterSynced(const QString& transferId, quint64 serial, bool ok)
+{
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end() || it->syncSerial != serial) {
+        return;
+    }
+
+    TransferContext& ctx = it.value();
+    ctx.syncSerial = 0;
+    if (ctx.finishPending) {
+        return;     // the finish syncs everything itself
+    }
+    if (!ok) {
+        emit transferFailed(transferId, QStringLiteral("Failed to write output file"));
+        removeIncomingTransfer(transferId);
+        return;
+    }
+
+    ctx.durable = ctx.syncing;
+    persistPartialTransfer(ctx);
+    if (ctx.syncAgain) {
+        ctx.syncAgain = false;
+        savePartialTransfer(ctx);
+    }
+}
+
+void FileTransferService::persistPartialTransfer(TransferContext& ctx)
+{
+    database::DatabaseService::PartialTransfer partial;
+    partial.transferId = ctx.transferId;
+    partial.fromUserId = ctx.fromUserId;
+    partial.fileName = ctx.fileName;
+    partial.fileSize = ctx.fileSize;
+    partial.localFilePath = ctx.localFilePath;
+    partial.receivedRanges = QString::fromStdString(ctx.durable.serialize());
+    partial.mimeType = ctx.mimeType;
+    partial.isGroup = ctx.isGroup;
+    partial.groupId = ctx.groupId;
+    database::DatabaseService::instance()->upsertPartialTransfer(partial);
+}
+
+void FileTransferService::sendFileResponse(TransferContext& ctx,
+                                           bool accepted,
+                                           const QString& reason,
+                                           bool completed)
+{
+    flykylin::protocol::FileTransferResponse resp;
+    resp.set_transfer_id(ctx.transferId.toStdString());
+    resp.set_accepted(accepted);
+    if (!reason.isEmpty()) {
+        resp.set_reason(reason.toStdString());
+    }
+    resp.set_completed(completed);
+    resp.set_deduplicated(completed && ctx.deduplicated);
+    if (accepted && !completed) {
+        const std::vector<ByteRange> missingRanges = ctx.received.missing(ctx.fileSize);
+        for (const ByteRange& range : missingRanges) {
+            auto* missing = resp.add_missing_ranges();
+            missing->set_offset(range.offset);
+            missing->set_length(range.length);
+        }
+        if (ctx.bulk && !missingRanges.empty()) {
+            // Port 0 tells the sender to stream chunks instead
+            resp.set_port(ensureBulkReceiver(ctx));
+            resp.set_bulk_token(ctx.bulkToken);
+        }
+    }
+
+    std::string payload;
+    if (!resp.SerializeToString(&payload)) {
+        return;
+    }
+    sendControlMessage(ctx.peerId, flykylin::protocol::TcpMessage::FILE_RESPONSE, payload);
+}
+
+void FileTransferService::onFileDataReceived(const QString& peerId,
+                                             const communication::FileDataHeader& header,
+                                             const QByteArray& data)
+{
+    const QString transferId =
+        m_transferIndexes.value(qMakePair(peerId, header.transferIndex));
+    if (transferId.isEmpty()) {
+        qWarning() << "[FileTransferService] File data for unknown transfer index"
+                   << header.transferIndex << "from" << peerId;
+        return;
+    }
+
+    // data is a view into the connection's receive buffer: consume it synchronously
+    handleIncomingChunk(transferId, header.offset, data.constData(), data.size(),
+                        header.isLast(), header.checksum);
+}
+
+QString FileTransferService::incomingFilePath(TransferContext& ctx) const
+{
+    if (ctx.localFilePath.isEmpty()) {
+        QString baseDir = ctx.downloadDirectoryOverride.isEmpty()
+                ? ensureDownloadDirectory(ctx.isImage)
+                : ctx.downloadDirectoryOverride;
+        ctx.localFilePath = baseDir + QDir::separator() + ctx.fileName;
+        ctx.message.setAttachmentLocalPath(ctx.localFilePath);
+    }
+    return ctx.localFilePath;
+}
+
+void FileTransferService::openIncomingWriter(TransferContext& ctx)
+{
+    if (ctx.writerOpened) {
+        return;
+    }
+
+    incomingFilePath(ctx);
+
+    if (!m_writer) {
+        m_writer = std::make_unique<FileWriteBehind>();
+        m_writer->setDrainedCallback([this](const QString& transferId) {
+            QMetaObject::invokeMethod(this, [this, transferId]() {
+                onWriterDrained(transferId);
+            }, Qt::QueuedConnection);
+        });
+        m_writer->setSyncedCallback([this](const QString& transferId, quint64 serial, bool ok) {
+            QMetaObject::invokeMethod(this, [this, transferId, serial, ok]() {
+                onWriterSynced(transferId, serial, ok);
+            }, Qt::QueuedConnection);
+        });
+        m_writer->setFinishedCallback([this](const QString& transferId, const QString& finalPath, bool ok) {
+            QMetaObject::invokeMethod(this, [this, transferId, finalPath, ok]() {
+                onWriterFinished(transferId, finalPath, ok);
+            }, Qt::QueuedConnection);
+        });
+    }
+    m_writer->open(ctx.transferId, ctx.localFilePath + QLatin1String(kPartialFileSuffix),
+                   ctx.fileSize, ctx.resumeExisting);
+    ctx.writerOpened = true;
+}
+
+void FileTransferService::handleIncomingChunk(const QString& transferId,
+                                              quint64 offset,
+                                              const char* data,
+                                              qint64 size,
+                                              bool isLast,
+                                              quint32 crc)
+{
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end()) {
+        return;
+    }
+
+    TransferContext& ctx = it.value();
+
+    if (ctx.rejected) {
+        removeIncomingTransfer(transferId);
+        return;
+    }
+
+    if (!ctx.accepted || ctx.finishPending) {
+        return;
+    }
+
+    // Nothing lands outside the announced size: the writer would extend the file
+    if (size < 0 || offset > ctx.fileSize || static_cast<quint64>(size) > ctx.fileSize - offset) {
+        qWarning() << "[FileTransferService] Chunk of" << transferId << "at" << offset << "+" << size
+                   << "is outside the file (" << ctx.fileSize << "bytes) - failing the transfer";
+        const QString reason = QStringLiteral("Chunk outside the file");
+        sendFileResponse(ctx, false, reason, false);
+        removeIncomingTransfer(transferId);
+        emit transferFailed(transferId, reason);
+        return;
+    }
+
+    if (ctx.resumable) {
+        // A corrupted chunk is simply not recorded; it shows up as missing
+        // when the sender asks for confirmation and gets resent
+        if (communication::crc32c(data, static_cast<std::size_t>(size)) != crc) {
+            qWarning() << "[FileTransferService] Checksum mismatch for" << transferId
+                       << "at offset" << offset << "- dropping chunk";
+            return;
+        }
+        if (!ctx.received.add(offset, static_cast<quint64>(size), crc)) {
+            return;   // already have these bytes
+        }
+    }
+
+    const bool firstChunk = !ctx.writerOpened;
+    openIncomingWriter(ctx);
+
+    if (!m_writer->write(transferId, offset, data, size)) {
+        emit transferFailed(transferId, QStringLiteral("Failed to write output file"));
+        removeIncomingTransfer(transferId);
+        return;
+    }
+    if (m_writer->isBacklogged(transferId) && !m_writerBacklog.contains(transferId)) {
+        // The disk is behind: let the socket back up until the queue drains
+        qInfo() << "[FileTransferService] Write queue of" << transferId << "is full ("
+                << m_writer->queuedBytes(transferId) << "bytes), pausing reads from" << ctx.peerId;
+        m_writerBacklog.insert(transferId, ctx.peerId);
+        m_connectionManager->setPeerReadsPaused(ctx.peerId, true);
+    }
+
+    ctx.receivedBytes += static_cast<quint64>(size);
+
+    if (ctx.resumable) {
+        // Completion is driven by FILE_COMPLETE, not by the last-chunk flag
+        ctx.unsavedBytes += static_cast<quint64>(size);
+        if (firstChunk || ctx.unsavedBytes >= kPartialSaveIntervalBytes) {
+            savePartialTransfer(ctx);
+        }
+        if (ctx.completePending && ctx.received.isComplete(ctx.fileSize)) {
+            verifyIncomingTransfer(transferId);
+        }
+        return;
+    }
+
+    if (isLast) {
+        completeIncomingTransfer(transferId);
+    }
+}
+
+void FileTransferService::handleFileComplete(const QString& peerId, const std::string& payload)
+{
+    flykylin::protocol::FileTransferComplete complete;
+    if (!complete.ParseFromString(payload)) {
+        return;
+    }
+
+    const QString transferId = QString::fromStdString(complete.transfer_id());
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end() || it->peerId != peerId || !it->resumable) {
+        return;
+    }
+
+    TransferContext& ctx = it.value();
+    if (!ctx.accepted) {
+        return;
+    }
+
+    ctx.completeCrc = complete.crc32c();
+    if (!complete.sha256().empty()) {
+        ctx.fileHash = QString::fromStdString(complete.sha256());
+    }
+    if (!ctx.received.isComplete(ctx.fileSize)
+        && m_bulkJobs.contains(QStringLiteral("recv:") + transferId)) {
+        // Bulk data may still be in the socket; the bulk thread finishing
+        // (or the last range landing) comes back to verify
+        ctx.completePending = true;
+        return;
+    }
+    if (!ctx.received.isComplete(ctx.fileSize)
+        && m_connectionManager->readyDataLaneCount(peerId) > 0) {
+        // Striped: chunks still on the data lanes may arrive after this
+        // message. Wait for them before asking for the gaps again.
+        ctx.completePending = true;
+        const quint32 generation = ++ctx.completeGeneration;
+        QTimer::singleShot(kStripedCompleteGraceMs, this, [this, transferId, generation]() {
+            auto pending = m_incomingTransfers.find(transferId);
+            if (pending != m_incomingTransfers.end() && pending->completePending
+                && pending->completeGeneration == generation) {
+                verifyIncomingTransfer(transferId);
+            }
+        });
+        return;
+    }
+
+    verifyIncomingTransfer(transferId);
+}
+
+void FileTransferService::handleSenderCancel(const QString& peerId,
+                                             const QString& transferId,
+                                             const QString& reason)
+{
+    // A refusal for a transfer we did not send: the sender gave up on one it offered us
+    auto incoming = m_incomingTransfers.constFind(transferId);
+    const bool offered = incoming != m_incomingTransfers.constEnd()
+            ? incoming->peerId == peerId
+            : QFile::exists(previewFilePath(transferId));
+    if (!offered) {
+        return;
+    }
+
+    qInfo() << "[FileTransferService]" << peerId << "cancelled incoming transfer" << transferId;
+    removeIncomingTransfer(transferId);
+    QFile::remove(previewFilePath(transferId));
+    emit transferFailed(transferId, reason.isEmpty() ? QStringLiteral("Cancelled by sender") : reason);
+}
+
+void FileTransferService::handleFilePreview(const QString& peerId, const std::string& payload)
+{
+    flykylin::protocol::FilePreview preview;
+    if (!preview.ParseFromString(payload) || preview.data().empty()
+        || !QString::fromStdString(preview.mime_type()).startsWith(QStringLiteral("image/"))) {
+        return;
+    }
+
+    // Usually arrives between FILE_REQUEST and the last chunk, but may overtake FILE_REQUEST
+    const QString transferId = QString::fromStdString(preview.transfer_id());
+    auto existing = m_incomingTransfers.constFind(transferId);
+    const bool known = existing != m_incomingTransfers.constEnd();
+    if (known && existing->rejected) {
+        return;
+    }
+
+    const QString path = previewFilePath(transferId);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    const qint64 size = static_cast<qint64>(preview.data().size());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || file.write(preview.data().data(), size) != size) {
+        qWarning() << "[FileTransferService] Failed to save preview" << path << file.errorString();
+        return;
+    }
+    file.close();
+
+    const bool isGroup = preview.is_group() && !preview.group_id().empty();
+    const QString groupId = isGroup ? QString::fromStdString(preview.group_id()) : QString();
+
+    core::Message message;
+    message.setId(transferId);
+    message.setFromUserId(QString::fromStdString(preview.from_user_id()));
+    message.setToUserId(QString::fromStdString(preview.to_user_id()));
+    message.setTimestamp(QDateTime::fromMSecsSinceEpoch(static_cast<qint64>(preview.timestamp())));
+    message.setStatus(core::MessageStatus::Sending);
+    message.setKind(core::MessageKind::Image);
+    message.setAttachmentLocalPath(path);
+    message.setAttachmentName(QString::fromStdString(preview.file_name()));
+    message.setAttachmentSize(preview.file_size());
+    message.setMimeType(QString::fromStdString(preview.preview_mime_type()));
+    message.setContent(message.attachmentName());
+    if (isGroup) {
+        message.setIsGroup(true);
+        message.setGroupId(groupId);
+    }
+
+    qInfo() << "[FileTransferService] Preview for" << transferId << "from" << peerId << ":"
+            << size << "bytes," << preview.width() << "x" << preview.height();
+
+    // Early verdict from the thumbnail; the full image is still checked when it lands
+    if (nsfwBlockIncoming()) {
+        auto* detector = ai::NSFWDetector::instance();
+        if (detector && detector->availability() != ai::BackendAvailability::Unavailable
+            && detector->predictAsync(path, this, [this, peerId, message](std::optional<float> prob) {
+                   finishIncomingPreview(peerId, message, prob);
+               }) != 0) {
+            return;
+        }
+    }
+    finishIncomingPreview(peerId, message, std::nullopt);
+}
+
+void FileTransferService::finishIncomingPreview(const QString& peerId,
+                                                const core::Message& message,
+                                                std::optional<float> nsfwProb)
+{
+    // Gone if the full image landed (or was refused) while the thumbnail was checked
+    const QString path = message.attachmentLocalPath();
+    if (!QFile::exists(path)) {
+        return;
+    }
+
+    const QString transferId = message.id();
+    auto existing = m_incomingTransfers.constFind(transferId);
+    const bool known = existing != m_incomingTransfers.constEnd();
+    if (known && existing->rejected) {
+        QFile::remove(path);
+        return;
+    }
+
+    const double threshold = nsfwThreshold();
+    if (nsfwProb.has_value() && *nsfwProb >= static_cast<float>(threshold)) {
+        QString infoText =
+            QStringLiteral("[NSFW] 接收来自 %1 的图片预览检测: 阻断 (p=%2, 阈值=%3)")
+                .arg(peerId)
+                .arg(static_cast<double>(*nsfwProb), 0, 'f', 3)
+                .arg(threshold, 0, 'f', 2);
+
+        core::Message infoMessage;
+        infoMessage.setId(core::Message::generateMessageId());
+        infoMessage.setFromUserId(m_localUserId);
+        infoMessage.setToUserId(peerId);
+        infoMessage.setTimestamp(QDateTime::currentDateTime());
+        infoMessage.setStatus(core::MessageStatus::Delivered);
+        infoMessage.setKind(core::MessageKind::Text);
+        infoMessage.setContent(infoText);
+        if (message.isGroup()) {
+            infoMessage.setIsGroup(true);
+            infoMessage.setGroupId(message.groupId());
+        }
+
+        emit messageCreated(infoMessage);
+
+        QFile::remove(path);
+        if (known) {
+            rejectTransfer(transferId, QStringLiteral("NSFW policy blocked incoming image"));
+        } else {
+            m_blockedPreviews.insert(transferId);
+        }
+        return;
+    }
+
+    emit imagePreviewReceived(message);
+}
+
+void FileTransferService::verifyIncomingTransfer(const QString& transferId)
+{
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end()) {
+        return;
+    }
+
+    TransferContext& ctx = it.value();
+    ctx.completePending = false;
+    if (ctx.finishPending) {
+        return;
+    }
+
+    if (!ctx.received.isComplete(ctx.fileSize)) {
+        savePartialTransfer(ctx);
+        sendFileResponse(ctx, true, QString(), false);
+        return;
+    }
+
+    if (ctx.bulkReceived) {
+        // No chunk CRCs: hash what landed and compare with the sender's SHA-256
+        if (!ctx.verifyPending) {
+            ctx.verifyPending = true;
+            ensureHasher();
+            FileHasher* hasher = m_hasher;
+            const QString requestId = QLatin1String(kVerifyRequestPrefix) + transferId;
+            const QString partPath = ctx.localFilePath + QLatin1String(kPartialFileSuffix);
+            QMetaObject::invokeMethod(hasher, [hasher, requestId, partPath]() {
+                hasher->hashFile(requestId, partPath);
+            }, Qt::QueuedConnection);
+        }
+        return;
+    }
+
+    quint32 crc = 0;
+    if (ctx.received.wholeCrc(ctx.fileSize, crc) && crc == ctx.completeCrc) {
+        completeIncomingTransfer(transferId);
+        return;
+    }
+
+    refetchOrFail(ctx, "checksum");
+}
+
+void FileTransferService::refetchOrFail(TransferContext& ctx, const char* what)
+{
+    // Every range landed but the file as a whole does not match: the
+    // source changed between sessions or the partial data is stale
+    const QString transferId = ctx.transferId;
+    if (ctx.digestRetries++ < kMaxDigestRetries) {
+        qWarning() << "[FileTransferService] Whole-file" << what << "mismatch for" << transferId
+                   << "- refetching";
+        ctx.received.clear();
+        ctx.durable.clear();
+        ctx.syncSerial = 0;     // a sync in flight would confirm the discarded ranges
+        ctx.syncAgain = false;
+        ctx.receivedBytes = 0;
+        ctx.bulkReceived = false;
+        persistPartialTransfer(ctx);
+        sendFileResponse(ctx, true, QString(), false);
+        return;
+    }
+
+    const QString reason = QStringLiteral("Checksum mismatch");
+    sendFileResponse(ctx, false, reason, false);
+    removeIncomingTransfer(transferId);
+    emit transferFailed(transferId, reason);
+}
+
+void FileTransferService::completeIncomingTransfer(const QString& transferId)
+{
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end()) {
+        return;
+    }
+
+    TransferContext& ctx = it.value();
+    if (ctx.nsfwRequestId != 0 || ctx.finishPending) {
+        return;     // Already complete, waiting for the rename or the NSFW verdict
+    }
+    stopBulkJob(QStringLiteral("recv:") + transferId);
+    QFile::remove(previewFilePath(transferId));
+    if (ctx.deduplicated) {
+        finishIncomingTransfer(transferId);
+        return;
+    }
+
+    // Bulk data is already in the temp file (resumeExisting keeps it)
+    openIncomingWriter(ctx);
+
+    // The writer drains this transfer's queue first, then renames into place
+    ctx.finishPending = true;
+    m_writer->finish(transferId, ctx.localFilePath);
+}
+
+void FileTransferService::onWriterFinished(const QString& transferId, const QString& finalPath, bool ok)
+{
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end() || !it->finishPending) {
+        // Cancelled while the rename was queued: nothing will show this file
+        if (ok) {
+            QFile::remove(finalPath);
+        }
+        return;
+    }
+
+    TransferContext& ctx = it.value();
+    ctx.finishPending = false;
+    ctx.writerOpened = false;
+    ctx.resumeExisting = false;
+    if (!ok) {
+        emit transferFailed(transferId, QStringLiteral("Failed to write output file"));
+        removeIncomingTransfer(transferId);
+        return;
+    }
+    finishIncomingTransfer(transferId);
+}
+
+void FileTransferService::finishIncomingTransfer(const QString& transferId)
+{
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end()) {
+        return;
+    }
+
+    TransferContext& ctx = it.value();
+    if (ctx.resumable) {
+        // Only now is the file under its real name: until then a restart resumes it
+        sendFileResponse(ctx, true, QString(), true);
+        database::DatabaseService::instance()->removePartialTransfer(transferId);
+        ctx.resumable = false;
+    }
+
+    ctx.message.setStatus(core::MessageStatus::Delivered);
+    ctx.message.setAttachmentSize(ctx.receivedBytes);
+
+    if (ctx.isImage) {
+        auto* detector = ai::NSFWDetector::instance();
+        if (detector && detector->availability() != ai::BackendAvailability::Unavailable) {
+            // Delivered once the inference thread has a verdict
+            ctx.nsfwRequestId = detector->predictAsync(
+                ctx.localFilePath, this, [this, transferId](std::optional<float> prob) {
+                    auto waiting = m_incomingTransfers.constFind(transferId);
+                    if (waiting != m_incomingTransfers.constEnd() && waiting->nsfwRequestId != 0) {
+                        deliverIncomingTransfer(transferId, prob);
+                    }
+                });
+            if (ctx.nsfwRequestId != 0) {
+                return;
+            }
+            qWarning() << "[FileTransferService] NSFW detection failed for received image"
+                       << ctx.localFilePath;
+        }
+    }
+    deliverIncomingTransfer(transferId, std::nullopt);
+}
+
+void FileTransferService::deliverIncomingTransfer(const QString& transferId, std::optional<float> nsfwProb)
+{
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end()) {
+        return;
+    }
+
+    TransferContext& ctx = it.value();
+    ctx.nsfwRequestId = 0;
+
+    float nsfwProbIncoming = 0.0f;
+    bool nsfwProbIncomingValid = false;
+    bool nsfwCheckedIncoming = false;
+    bool nsfwPassedIncoming = false;
+
+    if (ctx.isImage && nsfwProb.has_value()) {
+        nsfwProbIncoming = *nsfwProb;
+        nsfwProbIncomingValid = true;
+        qInfo() << "[FileTransferService] NSFW probability for received image"
+                << ctx.localFilePath << "=" << nsfwProbIncoming;
+    }
+
+    if (ctx.isImage && nsfwProbIncomingValid && nsfwBlockIncoming()) {
+        const double threshold = nsfwThreshold();
+        const bool blocked = nsfwProbIncoming >= static_cast<float>(threshold);
+
+        if (blocked) {
+            QString infoText =
+                QStringLiteral("[NSFW] 接收来自 %1 的图片检测: 阻断 (p=%2, 阈值=%3)")
+                    .arg(ctx.peerId)
+                    .arg(static_cast<double>(nsfwProbIncoming), 0, 'f', 3)
+                    .arg(threshold, 0, 'f', 2);
+
+            core::Message infoMessage;
+            infoMessage.setId(core::Message::generateMessageId());
+            infoMessage.setFromUserId(m_localUserId);
+            infoMessage.setToUserId(ctx.peerId);
+            infoMessage.setTimestamp(QDateTime::currentDateTime());
+            infoMessage.setStatus(core::MessageStatus::Delivered);
+            infoMessage.setKind(core::MessageKind::Text);
+            infoMessage.setContent(infoText);
+            if (ctx.isGroup && !ctx.groupId.isEmpty()) {
+                infoMessage.setIsGroup(true);
+                infoMessage.setGroupId(ctx.groupId);
+            }
+
+            emit messageCreated(infoMessage);
+
+            QFile::remove(ctx.localFilePath);
+            removeIncomingTransfer(transferId);
+            emit transferFailed(transferId,
+                                QStringLiteral("NSFW policy blocked incoming image"));
+            return;
+        } else {
+            nsfwCheckedIncoming = true;
+            nsfwPassedIncoming = true;
+        }
+    }
+
+    core::Message completedMessage = ctx.message;
+    if (ctx.isImage && nsfwCheckedIncoming) {
+        completedMessage.setNsfwChecked(true);
+        completedMessage.setNsfwPassed(nsfwPassedIncoming);
+    }
+    if (!ctx.fileHash.isEmpty()) {
+        qInfo() << "[FileTransferService] Received" << ctx.receivedBytes << "bytes for" << transferId
+                << "sha256" << ctx.fileHash << (ctx.deduplicated ? "(deduplicated)" : "");
+    }
+    storeReceivedFile(ctx);
+    removeIncomingTransfer(transferId);
+
+    emit messageCreated(completedMessage);
+    emit transferCompleted(transferId, completedMessage);
+}
+
+bool FileTransferService::completeFromStore(const QString& transferId)
+{
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end() || it->fileHash.isEmpty()) {
+        return false;
+    }
+
+    TransferContext& ctx = it.value();
+    AttachmentStore* store = AttachmentStore::instance();
+    if (store->find(ctx.fileHash, ctx.fileSize).isEmpty()
+        || !store->materialize(ctx.fileHash, ctx.fileSize, incomingFilePath(ctx))) {
+        return false;
+    }
+
+    qInfo() << "[FileTransferService] Already have" << ctx.fileName << "(" << ctx.fileHash
+            << ") - linked instead of transferring";
+    if (ctx.writerOpened) {
+        m_writer->abort(transferId);
+        ctx.writerOpened = false;
+    } else if (ctx.resumeExisting) {
+        QFile::remove(ctx.localFilePath + QLatin1String(kPartialFileSuffix));
+    }
+    ctx.resumeExisting = false;
+    ctx.deduplicated = true;
+    ctx.receivedBytes = ctx.fileSize;
+    completeIncomingTransfer(transferId);
+    return true;
+}
+
+void FileTransferService::storeReceivedFile(const TransferContext& ctx)
+{
+    if (ctx.deduplicated) {
+        AttachmentStore::instance()->addReference(ctx.fileHash, ctx.message.id(), m_localUserId);
+        return;
+    }
+    if (!ctx.verifiedHash.isEmpty()) {
+        // Already hashed to verify bulk data
+        if (AttachmentStore::instance()->adopt(ctx.verifiedHash, ctx.localFilePath)) {
+            AttachmentStore::instance()->addReference(ctx.verifiedHash, ctx.message.id(), m_localUserId);
+        }
+        return;
+    }
+
+    // The sender's hash is not trusted: hash what actually landed on disk
+    ensureHasher();
+    const QString requestId = QStringLiteral("store:") + ctx.transferId;
+    m_pendingStores.insert(requestId, qMakePair(ctx.localFilePath, ctx.message.id()));
+    FileHasher* hasher = m_hasher;
+    const QString filePath = ctx.localFilePath;
+    QMetaObject::invokeMethod(hasher, [hasher, requestId, filePath]() {
+        hasher->hashFile(requestId, filePath);
+    }, Qt::QueuedConnection);
+}
+
+void FileTransferService::removeIncomingTransfer(const QString& transferId)
+{
+    auto it = m_incomingTransfers.find(transferId);
+    if (it == m_incomingTransfers.end()) {
+        return;
+    }
+
+    if (it->transferIndex != 0) {
+        m_transferIndexes.remove(qMakePair(it->peerId, it->transferIndex));
+    }
+    stopBulkJob(QStringLiteral("recv:") + transferId);
+    if (it->nsfwRequestId != 0) {
+        ai::NSFWDetector::instance()->cancel(it->nsfwRequestId);
+    }
+    if (it->writerOpened) {
+        m_writer->abort(transferId);
+        onWriterDrained(transferId);
+    } else if (it->resumeExisting) {
+        QFile::remove(it->localFilePath + QLatin1String(kPartialFileSuffix));
+    }
+    if (it->resumable) {
+        database::DatabaseService::instance()->removePartialTransfer(transferId);
+    }
+    m_incomingTransfers.erase(it);
+}
+
+void FileTransferService::acceptTransfer(const QString& transferId, const QString& targetDirectory)
+{
+    if (!m_incomingTransfers.contains(transferId)) {
+        emit transferFailed(transferId, QStringLiteral("Unknown transfer"));
+        return;
+    }
+
+    TransferContext& ctx = m_incomingTransfers[transferId];
+    const bool wasAccepted = ctx.accepted;
+    ctx.accepted = true;
+    if (!targetDirectory.isEmpty()) {
+        ctx.downloadDirectoryOverride = targetDirectory;
+        const QString refusal = checkIncomingSize(ctx);
+        if (!refusal.isEmpty()) {
+            rejectTransfer(transferId, refusal);
+            return;
+        }
+    }
+
+    if (ctx.resumable && !wasAccepted && !completeFromStore(transferId)) {
+        sendFileResponse(m_incomingTransfers[transferId], true, QString(), false);
+    }
+}
+
+void FileTransferService::rejectTransfer(const QString& transferId, const QString& reason)
+{
+    if (!m_incomingTransfers.contains(transferId)) {
+        emit transferFailed(transferId, QStringLiteral("Unknown transfer"));
+        return;
+    }
+
+    TransferContext& ctx = m_incomingTransfers[transferId];
+    ctx.rejected = true;
+
+    QString finalReason = reason.isEmpty() ? QStringLiteral("Rejected by receiver") : reason;
+    sendFileResponse(ctx, false, finalReason, false);
+    if (ctx.resumable) {
+        // The sender stops on the response, so no chunk will clean this up
+        removeIncomingTransfer(transferId);
+    }
+    emit transferFailed(transferId, finalReason);
+}
+
+} // namespace services
+} // namespace flykylin
@@ -0,0 +1,1334 @@
+#include "FileTransferService.h"
+#include "AttachmentStore.h"
+#include "FileChunkReader.h"
+#include "FileHasher.h"
+#include "FileTransferSettings.h"
+#include "ImageProcessor.h"
+
+#include "../ai/NSFWDetector.h"
+#include "../communication/Crc32c.h"
+#include <QByteArray>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStringList>
+#include <QTimer>
+#include <string>
+#include "messages.pb.h"
+
+namespace {
+constexpr qint64 kChunkSizeBytes = 1024 * 1024; // 1MB
+
+bool nsfwBlockOutgoing()
+{
+    QSettings settings("FlyKylin", "FlyKylin");
+    return settings.value("nsfw/blockOutgoing", false).toBool();
+}
+
+quint64 stripeThresholdBytes()
+{
+    QSettings settings("FlyKylin", "FlyKylin");
+    const qint64 mb = settings.value("transfer/stripeThresholdMB", 32).toLongLong();
+    return static_cast<quint64>(qMax<qint64>(mb, 1)) * 1024ull * 1024ull;
+}
+
+bool imageTranscodeEnabled()
+{
+    QSettings settings("FlyKylin", "FlyKylin");
+    return settings.value("transfer/transcodeImages", true).toBool();
+}
+
+flykylin::services::ImageProcessor::TranscodeOptions transcodeOptions()
+{
+    QSettings settings("FlyKylin", "FlyKylin");
+    flykylin::services::ImageProcessor::TranscodeOptions options;
+    options.maxDimension = qMax(settings.value("transfer/transcodeMaxDimension", 2560).toInt(), 0);
+    options.quality = qBound(1, settings.value("transfer/transcodeQuality", 85).toInt(), 100);
+    return options;
+}
+
+int maxStripes()
+{
+    QSettings settings("FlyKylin", "FlyKylin");
+    return qBound(1, settings.value("transfer/maxStripes", 4).toInt(), 4);
+}
+}
+
+namespace flykylin {
+namespace services {
+
+using namespace file_transfer;
+
+void FileTransferService::sendImage(const QString& peerId, const QString& filePath)
+{
+    sendFileInternal(QStringList{peerId},
+                     filePath,
+                     true,   // asImage
+                     false,  // isGroup
+                     QString(),
+                     QString());
+}
+
+void FileTransferService::sendFile(const QString& peerId, const QString& filePath)
+{
+    sendFileInternal(QStringList{peerId},
+                     filePath,
+                     false,  // asImage
+                     false,  // isGroup
+                     QString(),
+                     QString());
+}
+
+void FileTransferService::sendImage(const QString& peerId,
+                                    const QString& filePath,
+                                    bool isGroup,
+                                    const QString& groupId,
+                                    const QString& logicalMessageId)
+{
+    sendFileInternal(QStringList{peerId},
+                     filePath,
+                     true,  // asImage
+                     isGroup,
+                     groupId,
+                     logicalMessageId);
+}
+
+void FileTransferService::sendFile(const QString& peerId,
+                                   const QString& filePath,
+                                   bool isGroup,
+                                   const QString& groupId,
+                                   const QString& logicalMessageId)
+{
+    sendFileInternal(QStringList{peerId},
+                     filePath,
+                     false,  // asImage
+                     isGroup,
+                     groupId,
+                     logicalMessageId);
+}
+
+void FileTransferService::sendGroupImage(const QStringList& peerIds,
+                                         const QString& filePath,
+                                         const QString& groupId,
+                                         const QString& logicalMessageId)
+{
+    sendFileInternal(peerIds,
+                     filePath,
+                     true,  // asImage
+                     true,  // isGroup
+                     groupId,
+                     logicalMessageId);
+}
+
+void FileTransferService::sendGroupFile(const QStringList& peerIds,
+                                        const QString& filePath,
+                                        const QString& groupId,
+                                        const QString& logicalMessageId)
+{
+    sendFileInternal(peerIds,
+                     filePath,
+                     false,  // asImage
+                     true,   // isGroup
+                     groupId,
+                     logicalMessageId);
+}
+
+void FileTransferService::sendFileInternal(const QStringList& peerIds,
+                                           const QString& filePath,
+                                           bool asImage,
+                                           bool isGroup,
+                                           const QString& groupId,
+                                           const QString& logicalMessageId,
+                                           const QString& sourcePath)
+{
+    QFileInfo info(filePath);
+    if (!info.exists() || !info.isFile()) {
+        emit transferFailed(QString(), QStringLiteral("File not found"));
+        return;
+    }
+
+    const QString transferId = logicalMessageId.isEmpty()
+            ? core::Message::generateMessageId()
+            : logicalMessageId;
+    if (m_pendingImageSends.contains(transferId)) {
+        qWarning() << "[FileTransferService] Image" << transferId << "is already being prepared";
+        return;
+    }
+
+    quint64 fileSize = static_cast<quint64>(info.size());
+    if (asImage && sourcePath.isEmpty() && fileSize >= kTranscodeMinBytes && imageTranscodeEnabled()) {
+        // Continues in onImageTranscoded with a smaller copy or the original
+        m_pendingImageSends.insert(transferId,
+                                   PendingImageSend{peerIds, filePath, QString(), isGroup, groupId});
+
+        ensureImageProcessor();
+        const QString outputBasePath = transcodeBasePath(transferId);
+        QDir().mkpath(QFileInfo(outputBasePath).absolutePath());
+        ImageProcessor* processor = m_imageProcessor;
+        const ImageProcessor::TranscodeOptions options = transcodeOptions();
+        QMetaObject::invokeMethod(processor, [processor, transferId, filePath, outputBasePath, options]() {
+            processor->transcodeImage(transferId, filePath, outputBasePath, options);
+        }, Qt::QueuedConnection);
+        return;
+    }
+    if (fileSize > kMaxFileSizeBytes) {
+        // Only bulk mode streams without touching the data, so only it may go past the limit
+        bool bulkCapable = !asImage;
+        for (const QString& peerId : peerIds) {
+            bulkCapable = bulkCapable && canSendBulk(peerId);
+        }
+        if (!bulkCapable) {
+            emit transferFailed(QString(), QStringLiteral("File is too large (max 200MB)"));
+            return;
+        }
+    }
+
+    float nsfwProb = 0.0f;
+    bool nsfwProbValid = false;
+    bool nsfwChecked = false;
+    bool nsfwPassedFlag = false;
+
+    if (asImage) {
+        auto verdict = m_nsfwVerdicts.find(transferId);
+        if (verdict == m_nsfwVerdicts.end()) {
+            const PendingImageSend send{peerIds, filePath, sourcePath.isEmpty() ? filePath : sourcePath,
+                                        isGroup, groupId};
+            if (requestOutgoingNsfwCheck(transferId, send)) {
+                // Continues in onOutgoingNsfwVerdict
+                return;
+            }
+        } else {
+            if (verdict->has_value()) {
+                nsfwProb = **verdict;
+                nsfwProbValid = true;
+                qInfo() << "[FileTransferService] NSFW probability for outgoing image" << filePath
+                        << "=" << nsfwProb;
+            } else {
+                qWarning() << "[FileTransferService] NSFW detection failed for outgoing image"
+                           << filePath;
+            }
+            m_nsfwVerdicts.erase(verdict);
+        }
+    }
+
+    if (asImage && nsfwProbValid && nsfwBlockOutgoing()) {
+        const double threshold = nsfwThreshold();
+        const bool blocked = nsfwProb >= static_cast<float>(threshold);
+
+        if (blocked) {
+            QString infoText =
+                QStringLiteral("[NSFW] 发送图片检测: 阻断 (p=%1, 阈值=%2)")
+                    .arg(static_cast<double>(nsfwProb), 0, 'f', 3)
+                    .arg(threshold, 0, 'f', 2);
+
+            core::Message infoMessage;
+            infoMessage.setId(core::Message::generateMessageId());
+            infoMessage.setFromUserId(m_localUserId);
+            infoMessage.setToUserId(peerIds.value(0));
+            infoMessage.setTimestamp(QDateTime::currentDateTime());
+            infoMessage.setStatus(core::MessageStatus::Delivered);
+            infoMessage.setKind(core::MessageKind::Text);
+            infoMessage.setContent(infoText);
+            if (isGroup && !groupId.isEmpty()) {
+                infoMessage.setIsGroup(true);
+                infoMessage.setGroupId(groupId);
+            }
+
+            emit messageCreated(infoMessage);
+
+            emit transferFailed(QString(),
+                                QStringLiteral("NSFW policy blocked outgoing image"));
+            return;
+        } else {
+            nsfwChecked = true;
+            nsfwPassedFlag = true;
+        }
+    }
+
+    QString mimeType = detectMimeType(filePath, asImage);
+
+    // A transcoded copy goes out under the user's name with its own
+    // format's suffix; the local message shows the original file
+    const bool transcoded = !sourcePath.isEmpty() && sourcePath != filePath;
+    const QFileInfo localInfo = transcoded ? QFileInfo(sourcePath) : info;
+    const QString fileName = transcoded
+            ? localInfo.completeBaseName() + QLatin1Char('.') + info.suffix()
+            : info.fileName();
+
+    core::Message message;
+    message.setId(transferId);
+    message.setFromUserId(m_localUserId);
+    message.setTimestamp(QDateTime::currentDateTime());
+    message.setStatus(core::MessageStatus::Sending);
+    message.setKind(asImage ? core::MessageKind::Image : core::MessageKind::File);
+    message.setAttachmentLocalPath(localInfo.filePath());
+    message.setAttachmentName(localInfo.fileName());
+    message.setAttachmentSize(static_cast<quint64>(localInfo.size()));
+    message.setMimeType(transcoded ? detectMimeType(sourcePath, asImage) : mimeType);
+    message.setContent(localInfo.fileName());
+    if (isGroup && !groupId.isEmpty()) {
+        message.setIsGroup(true);
+        message.setGroupId(groupId);
+    }
+
+    if (asImage && nsfwChecked) {
+        message.setNsfwChecked(true);
+        message.setNsfwPassed(nsfwPassedFlag);
+    }
+
+    // Several recipients read the file once through a shared fan-out
+    const bool fanOut = peerIds.size() > 1;
+    QString fanOutId;
+    if (fanOut) {
+        fanOutId = core::Message::generateMessageId();
+        FanOut shared;
+        shared.filePath = filePath;
+        shared.fileSize = fileSize;
+        shared.created.start();
+        m_fanOuts.insert(fanOutId, shared);
+        QTimer::singleShot(kFanOutJoinGraceMs, this, [this, fanOutId]() {
+            pumpFanOutMembers(fanOutId);
+        });
+    }
+
+    ensureReader();
+    m_scheduler.setLimits(schedulerLimits(), m_schedulerClock.elapsed());
+    for (const QString& peerId : peerIds) {
+        const communication::ConnectionState peerState = m_connectionManager->getConnectionState(peerId);
+        if (peerState == communication::ConnectionState::Disconnected
+            || peerState == communication::ConnectionState::Failed) {
+            emit transferFailed(transferId, QStringLiteral("Peer not connected"));
+            continue;
+        }
+
+        // FILE_REQUEST goes out once the scheduler admits the transfer and the
+        // handshake is done (peer capabilities decide the mode); file data is
+        // then streamed from the I/O thread and completion is reported from
+        // pumpOutgoingTransfer()/handleFileResponse().
+        OutgoingTransfer transfer;
+        transfer.transferId = fanOut ? transferId + QLatin1Char('/') + peerId : transferId;
+        transfer.wireId = transferId;
+        transfer.peerId = peerId;
+        transfer.filePath = filePath;
+        transfer.fileSize = fileSize;
+        transfer.fileName = fileName;
+        transfer.mimeType = mimeType;
+        transfer.message = message;
+        transfer.message.setToUserId(peerId);
+        transfer.stripeController = StripeController(maxStripes());
+        transfer.fanOutId = fanOutId;
+        transfer.elapsed.start();
+        const QString key = transfer.transferId;
+        m_outgoingTransfers.insert(key, transfer);
+
+        // Group members share a slot so they start together and share reads
+        m_scheduler.add(key.toStdString(), peerId.toStdString(),
+                        asImage ? TransferPriority::High : TransferPriority::Normal,
+                        fanOutId.toStdString());
+        requestFileHash(m_outgoingTransfers[key]);
+    }
+
+    if (fanOut) {
+        dropFanOutIfUnused(fanOutId);
+    }
+
+    // The chat shows the message while it is queued and streaming;
+    // finishOutgoingTransfer() reports Sent or Failed for the same id
+    const QStringList keys = outgoingKeys(transferId);
+    if (!keys.isEmpty()) {
+        emit messageCreated(m_outgoingTransfers.value(keys.first()).message);
+    }
+
+    // One thumbnail for all recipients; small images are their own preview
+    if (asImage && fileSize >= kPreviewMinBytes && !keys.isEmpty()) {
+        ensureImageProcessor();
+        ImageProcessor* processor = m_imageProcessor;
+        QMetaObject::invokeMethod(processor, [processor, transferId, filePath]() {
+            processor->createPreview(transferId, filePath);
+        }, Qt::QueuedConnection);
+    }
+    admitQueuedTransfers();
+}
+
+void FileTransferService::onImagePreviewReady(const QString& transferId,
+                                              const QByteArray& data,
+                                              const QSize& originalSize,
+                                              bool ok)
+{
+    const QStringList keys = outgoingKeys(transferId);
+    if (!ok || keys.isEmpty()) {
+        return;
+    }
+
+    // Queued members get it now too; the rest send it with their FILE_REQUEST
+    m_imagePreviews.insert(transferId, ImagePreview{data, originalSize});
+    for (const QString& key : keys) {
+        sendImagePreview(m_outgoingTransfers[key]);
+    }
+}
+
+void FileTransferService::onImageTranscoded(const QString& transferId,
+                                            const QString& outputPath,
+                                            qint64 originalBytes,
+                                            qint64 outputBytes,
+                                            qint64 encodeMs,
+                                            bool ok)
+{
+    auto it = m_pendingImageSends.find(transferId);
+    if (it == m_pendingImageSends.end()) {
+        if (ok) {
+            QFile::remove(outputPath);
+        }
+        return;
+    }
+    const PendingImageSend pending = it.value();
+    m_pendingImageSends.erase(it);
+
+    if (ok) {
+        qInfo() << "[FileTransferService] Transcoded" << pending.filePath << originalBytes << "->"
+                << outputBytes << "bytes, saved" << (originalBytes - outputBytes) << "bytes in"
+                << encodeMs << "ms";
+        emit imageTranscoded(transferId, static_cast<quint64>(originalBytes),
+                             static_cast<quint64>(outputBytes), encodeMs);
+        m_transcodedFiles.insert(transferId, outputPath);
+    }
+
+    sendFileInternal(pending.peerIds,
+                     ok ? outputPath : pending.filePath,
+                     true,  // asImage
+                     pending.isGroup,
+                     pending.groupId,
+                     transferId,
+                     pending.filePath);
+    releaseTranscodedFile(transferId);
+}
+
+bool FileTransferService::requestOutgoingNsfwCheck(const QString& transferId, const PendingImageSend& send)
+{
+    // A check submitted while the backend is still being picked waits for it on the inference thread
+    auto* detector = ai::NSFWDetector::instance();
+    if (!detector || detector->availability() == ai::BackendAvailability::Unavailable) {
+        return false;
+    }
+
+    const quint64 requestId = detector->predictAsync(
+        send.filePath, this, [this, transferId](std::optional<float> prob) {
+            onOutgoingNsfwVerdict(transferId, prob);
+        });
+    if (requestId == 0) {
+        return false;
+    }
+    m_pendingImageSends.insert(transferId, send);
+    return true;
+}
+
+void FileTransferService::onOutgoingNsfwVerdict(const QString& transferId, std::optional<float> nsfwProb)
+{
+    auto it = m_pendingImageSends.find(transferId);
+    if (it == m_pendingImageSends.end()) {
+        return;
+    }
+    const PendingImageSend pending = it.value();
+    m_pendingImageSends.erase(it);
+
+    m_nsfwVerdicts.insert(transferId, nsfwProb);
+    sendFileInternal(pending.peerIds,
+                     pending.filePath,
+                     true,  // asImage
+                     pending.isGroup,
+                     pending.groupId,
+                     transferId,
+                     pending.sourcePath);
+    m_nsfwVerdicts.remove(transferId);
+    releaseTranscodedFile(transferId);
+}
+
+void FileTransferService::releaseTranscodedFile(const QString& transferId)
+{
+    // Still needed while the send waits for a verdict or has data to send
+    if (m_pendingImageSends.contains(transferId) || !outgoingKeys(transferId).isEmpty()) {
+        return;
+    }
+    const QString transcodedPath = m_transcodedFiles.take(transferId);
+    if (!transcodedPath.isEmpty()) {
+        QFile::remove(transcodedPath);
+    }
+}
+
+void FileTransferService::sendImagePreview(OutgoingTransfer& transfer)
+{
+    auto preview = m_imagePreviews.constFind(transfer.wireId);
+    if (transfer.previewSent || preview == m_imagePreviews.constEnd()
+        || !m_connectionManager->isPeerReady(transfer.peerId)
+        || !(m_connectionManager->peerCapabilities(transfer.peerId)
+             & communication::CapabilityImagePreview)) {
+        return;
+    }
+    // Behind the last chunk it would only arrive after the image itself
+    if (transfer.phase == SendPhase::AwaitingDigest || transfer.phase == SendPhase::AwaitingConfirm
+        || (transfer.phase == SendPhase::Streaming && transfer.sentBytes >= transfer.fileSize)) {
+        return;
+    }
+
+    const core::Message& message = transfer.message;
+    flykylin::protocol::FilePreview msg;
+    msg.set_transfer_id(transfer.wireId.toStdString());
+    msg.set_from_user_id(m_localUserId.toStdString());
+    msg.set_to_user_id(transfer.peerId.toStdString());
+    msg.set_file_name(transfer.fileName.toStdString());
+    msg.set_file_size(transfer.fileSize);
+    msg.set_mime_type(transfer.mimeType.toStdString());
+    msg.set_is_group(message.isGroup());
+    if (message.isGroup() && !message.groupId().isEmpty()) {
+        msg.set_group_id(message.groupId().toStdString());
+    }
+    msg.set_timestamp(message.timestamp().toMSecsSinceEpoch());
+    msg.set_data(preview->data.constData(), static_cast<size_t>(preview->data.size()));
+    msg.set_preview_mime_type("image/jpeg");
+    msg.set_width(static_cast<quint32>(qMax(preview->originalSize.width(), 0)));
+    msg.set_height(static_cast<quint32>(qMax(preview->originalSize.height(), 0)));
+
+    std::string payload;
+    if (msg.SerializeToString(&payload)
+        && sendControlMessage(transfer.peerId, flykylin::protocol::TcpMessage::FILE_PREVIEW, payload,
+                              communication::MessageQueue::Priority::High)) {
+        transfer.previewSent = true;
+    }
+}
+
+void FileTransferService::requestFileHash(OutgoingTransfer& transfer)
+{
+    ensureHasher();
+
+    FileHasher::Result cached;
+    if (m_hasher->cachedHash(transfer.filePath, &cached)) {
+        transfer.fileHash = cached.sha256;
+        return;
+    }
+
+    // Runs alongside the handshake and the chunk reads; FILE_COMPLETE waits for it
+    transfer.hashPending = true;
+    FileHasher* hasher = m_hasher;
+    const QString transferId = transfer.transferId;
+    const QString filePath = transfer.filePath;
+    QMetaObject::invokeMethod(hasher, [hasher, transferId, filePath]() {
+        hasher->hashFile(transferId, filePath);
+    }, Qt::QueuedConnection);
+}
+
+void FileTransferService::startOutgoingSession(OutgoingTransfer& transfer)
+{
+    resetOutgoingSession(transfer);
+
+    const quint32 capabilities = m_connectionManager->peerCapabilities(transfer.peerId);
+    transfer.resumable = (capabilities & communication::CapabilityResumableTransfer) != 0;
+    sendImagePreview(transfer);
+
+    // The receiver can only skip content it already has if it knows the hash
+    if (transfer.resumable && transfer.hashPending
+        && (capabilities & communication::CapabilityContentStore)) {
+        transfer.phase = SendPhase::AwaitingHash;
+        return;
+    }
+
+    // Raw file-data frames only for peers that understand them; otherwise
+    // protobuf FileChunk messages
+    transfer.transferIndex = 0;
+    if (capabilities & communication::CapabilityFileDataFrame) {
+        transfer.transferIndex = m_nextTransferIndex++;
+        if (m_nextTransferIndex == 0) {
+            m_nextTransferIndex = 1;
+        }
+    }
+
+    // Bulk mode: plain files go from the page cache to a socket of their own
+    transfer.bulk = transfer.bulkFailures < kMaxBulkFailures
+        && transfer.message.kind() == core::MessageKind::File
+        && canSendBulk(transfer.peerId);
+    if (transfer.fileSize > kMaxFileSizeBytes && !transfer.bulk) {
+        finishOutgoingTransfer(transfer.transferId, QStringLiteral("File is too large (max 200MB)"));
+        return;
+    }
+
+    // Striping needs raw frames (per-chunk offsets on any connection) and the
+    // resumable completion handshake (FILE_COMPLETE may overtake lane data)
+    transfer.striped = transfer.resumable && !transfer.bulk && transfer.transferIndex != 0
+        && (capabilities & communication::CapabilityStripedTransfer)
+        && transfer.fileSize >= stripeThresholdBytes()
+        && transfer.stripeController.maxStripes() > 1;
+    if (transfer.striped) {
+        m_connectionManager->openDataLanes(transfer.peerId, transfer.stripes() - 1);
+    }
+
+    const core::Message& message = transfer.message;
+    flykylin::protocol::FileTransferRequest req;
+    req.set_transfer_id(transfer.wireId.toStdString());
+    req.set_from_user_id(m_localUserId.toStdString());
+    req.set_to_user_id(transfer.peerId.toStdString());
+    req.set_file_name(transfer.fileName.toStdString());
+    req.set_file_size(transfer.fileSize);
+    req.set_file_hash(transfer.fileHash.toStdString());
+    req.set_timestamp(QDateTime::currentMSecsSinceEpoch());
+    req.set_mime_type(transfer.mimeType.toStdString());
+    req.set_is_group(message.isGroup());
+    if (message.isGroup() && !message.groupId().isEmpty()) {
+        req.set_group_id(message.groupId().toStdString());
+    }
+    req.set_transfer_index(transfer.transferIndex);
+    req.set_resumable(transfer.resumable);
+    req.set_bulk(transfer.bulk);
+
+    std::string payload;
+    if (!req.SerializeToString(&payload)
+        || !sendControlMessage(transfer.peerId, flykylin::protocol::TcpMessage::FILE_REQUEST, payload)) {
+        finishOutgoingTransfer(transfer.transferId,
+                               QStringLiteral("Failed to serialize FileTransferRequest"));
+        return;
+    }
+
+    if (transfer.resumable) {
+        // Ranges come from the receiver's FILE_RESPONSE
+        transfer.phase = SendPhase::AwaitingResponse;
+        return;
+    }
+
+    if (!joinFanOut(transfer)) {
+        transfer.readQueue.append(ByteRange{0, transfer.fileSize});
+    }
+    transfer.sentBytes = 0;
+    transfer.stripeSampleMs = transfer.elapsed.elapsed();
+    transfer.phase = SendPhase::Streaming;
+    pumpOutgoingTransfer(transfer.transferId);
+}
+
+void FileTransferService::resetOutgoingSession(OutgoingTransfer& transfer)
+{
+    stopBulkJob(QStringLiteral("send:") + transfer.transferId);
+    if (transfer.fanOutJoined) {
+        // A later session resumes from the receiver's ranges with its own reads
+        leaveFanOut(transfer, false);
+    }
+    for (auto it = transfer.readyChunks.begin(); it != transfer.readyChunks.end(); ++it) {
+        m_reader->recycle(std::move(it->data));
+    }
+    transfer.readyChunks.clear();
+    transfer.readQueue.clear();
+    transfer.sendOrder.clear();
+    // The reader answers in issue order, so their results arrive before any
+    // read of the next session at the same offset and are dropped in onChunkRead
+    for (auto it = transfer.inFlightReads.constBegin(); it != transfer.inFlightReads.constEnd(); ++it) {
+        ++transfer.staleReads[it.key()];
+    }
+    transfer.inFlightReads.clear();
+    transfer.phase = SendPhase::Idle;
+}
+
+void FileTransferService::pumpOutgoingTransfer(const QString& transferId)
+{
+    auto it = m_outgoingTransfers.find(transferId);
+    if (it == m_outgoingTransfers.end() || it->phase != SendPhase::Streaming) {
+        return;
+    }
+
+    OutgoingTransfer& transfer = it.value();
+    const QString fanOutId = transfer.fanOutJoined ? transfer.fanOutId : QString();
+    auto fanOut = m_fanOuts.find(fanOutId);
+    const FanOut* shared = fanOut != m_fanOuts.end() ? &fanOut.value() : nullptr;
+    bool progressed = false;
+
+    // 1. Hand chunks to the socket in issue order while it is ready, not
+    //    backed up and the scheduler has tokens. Fan-out members take the
+    //    next shared chunk instead.
+    while (!transfer.paused
+           && (shared ? shared->chunks.contains(transfer.fanOutOffset)
+                      : !transfer.sendOrder.isEmpty()
+                            && transfer.readyChunks.contains(transfer.sendOrder.head()))
+           && m_connectionManager->isPeerReady(transfer.peerId)
+           && m_connectionManager->pendingWriteBytes(transfer.peerId, transfer.stripes())
+                  < kMaxSocketBacklogBytes) {
+        const auto next = shared ? shared->chunks.constFind(transfer.fanOutOffset)
+                                 : transfer.readyChunks.constFind(transfer.sendOrder.head());
+        const qint64 waitMs = m_scheduler.acquire(transferId.toStdString(),
+                                                  static_cast<quint64>(next->data.size()),
+                                                  m_schedulerClock.elapsed());
+        if (waitMs > 0) {
+            scheduleThrottleWake(waitMs);
+            break;
+        }
+
+        quint64 offset = 0;
+        OutgoingTransfer::ReadyChunk chunk;
+        bool isLast = false;
+        if (shared) {
+            offset = transfer.fanOutOffset;
+            chunk = shared->chunks.value(offset);
+            transfer.fanOutOffset += static_cast<quint64>(chunk.data.size());
+            isLast = transfer.fanOutOffset >= transfer.fileSize;
+        } else {
+            offset = transfer.sendOrder.dequeue();
+            chunk = transfer.readyChunks.take(offset);
+            isLast = transfer.sendOrder.isEmpty() && transfer.readQueue.isEmpty();
+        }
+
+        if (!sendOutgoingChunk(transfer, offset, chunk, isLast)) {
+            finishOutgoingTransfer(transferId, QStringLiteral("Failed to send file data"));
+            return;
+        }
+
+        const quint64 size = static_cast<quint64>(chunk.data.size());
+        transfer.sentBytes += size;
+        transfer.sentRanges.add(offset, size, chunk.crc);
+        if (!shared) {
+            m_reader->recycle(std::move(chunk.data));
+        }
+        if (transfer.striped) {
+            updateStripes(transfer, size);
+        }
+
+        if (isLast) {
+            if (shared) {
+                leaveFanOut(transfer, false);
+            }
+            emitTransferProgress(transfer, true);
+            if (transfer.resumable) {
+                sendFileComplete(transfer);
+            } else {
+                finishOutgoingTransfer(transferId, QString());
+            }
+            if (shared) {
+                pumpFanOutMembers(fanOutId);
+            }
+            return;
+        }
+        progressed = true;
+    }
+
+    // 2. Keep the read-ahead window full (shared window: drop what every
+    //    member has sent, read further ahead)
+    if (shared) {
+        pumpFanOut(fanOutId);
+    }
+    FileChunkReader* reader = m_reader;
+    const int window = kSendWindowChunks * transfer.stripes();
+    while (!transfer.readQueue.isEmpty()
+           && transfer.inFlightReads.size() + transfer.readyChunks.size() < window) {
+        ByteRange& range = transfer.readQueue.first();
+        const quint64 offset = range.offset;
+        const qint64 size = static_cast<qint64>(
+            qMin<quint64>(static_cast<quint64>(kChunkSizeBytes), range.length));
+        const QString filePath = transfer.filePath;
+
+        range.offset += static_cast<quint64>(size);
+        range.length -= static_cast<quint64>(size);
+        if (range.length == 0) {
+            transfer.readQueue.removeFirst();
+        }
+
+        transfer.inFlightReads.insert(offset, size);
+        transfer.sendOrder.enqueue(offset);
+
+        QMetaObject::invokeMethod(reader, [reader, transferId, filePath, offset, size]() {
+            reader->readChunk(transferId, filePath, offset, size);
+        }, Qt::QueuedConnection);
+    }
+
+    // Last: a slot connected to transferProgress may cancel the transfer
+    if (progressed) {
+        emitTransferProgress(transfer, false);
+    }
+}
+
+bool FileTransferService::sendOutgoingChunk(OutgoingTransfer& transfer,
+                                            quint64 offset,
+                                            const OutgoingTransfer::ReadyChunk& chunk,
+                                            bool isLast)
+{
+    const QByteArray& data = chunk.data;
+
+    if (transfer.transferIndex != 0) {
+        communication::FileDataHeader header;
+        header.transferIndex = transfer.transferIndex;
+        header.offset = offset;
+        header.length = static_cast<quint32>(data.size());
+        header.flags = isLast ? communication::FileDataLast : 0;
+        header.checksum = chunk.crc;
+        return m_connectionManager->sendFileData(transfer.peerId, header, data.constData(),
+                                                 transfer.stripes());
+    }
+
+    flykylin::protocol::FileChunk fileChunk;
+    fileChunk.set_transfer_id(transfer.wireId.toStdString());
+    fileChunk.set_offset(offset);
+    fileChunk.set_data(data.constData(), static_cast<size_t>(data.size()));
+    fileChunk.set_chunk_size(static_cast<quint32>(data.size()));
+    fileChunk.set_is_last(isLast);
+    if (transfer.resumable) {
+        fileChunk.set_checksum(chunk.crc);
+    }
+
+    std::string chunkPayload;
+    if (!fileChunk.SerializeToString(&chunkPayload)) {
+        return false;
+    }
+    return sendControlMessage(transfer.peerId, flykylin::protocol::TcpMessage::FILE_CHUNK, chunkPayload);
+}
+
+void FileTransferService::sendFileComplete(OutgoingTransfer& transfer)
+{
+    // Bulk data never passed through us: the receiver checks the SHA-256 instead
+    if (!transfer.digestValid && !transfer.bulk) {
+        // Sent the whole file this session: the chunk CRCs already give the digest
+        if (transfer.sentRanges.wholeCrc(transfer.fileSize, transfer.digest)) {
+            transfer.digestValid = true;
+        } else {
+            transfer.phase = SendPhase::AwaitingDigest;
+            if (!transfer.digestRequested) {
+                transfer.digestRequested = true;
+                FileChunkReader* reader = m_reader;
+                const QString transferId = transfer.transferId;
+                const QString filePath = transfer.filePath;
+                QMetaObject::invokeMethod(reader, [reader, transferId, filePath]() {
+                    reader->computeDigest(transferId, filePath);
+                }, Qt::QueuedConnection);
+            }
+            return;
+        }
+    }
+
+    if (transfer.hashPending) {
+        // onFileHashed() comes back here
+        transfer.phase = SendPhase::AwaitingDigest;
+        return;
+    }
+
+    flykylin::protocol::FileTransferComplete complete;
+    complete.set_transfer_id(transfer.wireId.toStdString());
+    complete.set_crc32c(transfer.digest);
+    complete.set_sha256(transfer.fileHash.toStdString());
+
+    std::string payload;
+    if (!complete.SerializeToString(&payload)
+        || !sendControlMessage(transfer.peerId, flykylin::protocol::TcpMessage::FILE_COMPLETE, payload)) {
+        finishOutgoingTransfer(transfer.transferId,
+                               QStringLiteral("Failed to serialize FileTransferComplete"));
+        return;
+    }
+    transfer.phase = SendPhase::AwaitingConfirm;
+}
+
+bool FileTransferService::joinFanOut(OutgoingTransfer& transfer)
+{
+    if (transfer.fanOutId.isEmpty()) {
+        return false;
+    }
+
+    auto fanOut = m_fanOuts.find(transfer.fanOutId);
+    if (fanOut == m_fanOuts.end() || fanOut->released) {
+        // Too late to share: the first chunks are gone
+        transfer.fanOutId.clear();
+        return false;
+    }
+
+    fanOut->members.append(transfer.transferId);
+    transfer.fanOutJoined = true;
+    transfer.fanOutOffset = 0;
+    return true;
+}
+
+void FileTransferService::leaveFanOut(OutgoingTransfer& transfer, bool readRemaining)
+{
+    const QString fanOutId = transfer.fanOutId;
+    auto fanOut = m_fanOuts.find(fanOutId);
+    if (fanOut != m_fanOuts.end()) {
+        fanOut->members.removeAll(transfer.transferId);
+    }
+
+    if (readRemaining && transfer.fanOutOffset < transfer.fileSize) {
+        transfer.readQueue.append(ByteRange{transfer.fanOutOffset,
+                                            transfer.fileSize - transfer.fanOutOffset});
+    }
+    transfer.fanOutJoined = false;
+    transfer.fanOutId.clear();
+    dropFanOutIfUnused(fanOutId);
+}
+
+void FileTransferService::pumpFanOut(const QString& fanOutId)
+{
+    auto fanOut = m_fanOuts.find(fanOutId);
+    if (fanOut == m_fanOuts.end() || fanOut->members.isEmpty()) {
+        return;
+    }
+
+    const int window = kFanOutWindowChunks;
+    while (true) {
+        quint64 slowest = fanOut->fileSize;
+        quint64 fastest = 0;
+        QString laggard;
+        for (const QString& key : fanOut->members) {
+            const quint64 offset = m_outgoingTransfers.constFind(key)->fanOutOffset;
+            if (offset < slowest) {
+                slowest = offset;
+                laggard = key;
+            }
+            fastest = qMax(fastest, offset);
+        }
+
+        // Drop what every member has sent, unless others may still join
+        bool waitingForJoins = false;
+        if (fanOut->created.elapsed() < kFanOutJoinGraceMs) {
+            for (const OutgoingTransfer& transfer : m_outgoingTransfers) {
+                if (transfer.fanOutId == fanOutId && !transfer.fanOutJoined) {
+                    waitingForJoins = true;
+                    break;
+                }
+            }
+        }
+        while (!waitingForJoins && !fanOut->chunks.isEmpty()
+               && fanOut->chunks.firstKey() + static_cast<quint64>(fanOut->chunks.first().data.size())
+                      <= slowest) {
+            m_reader->recycle(fanOut->chunks.take(fanOut->chunks.firstKey()).data);
+            fanOut->released = true;
+        }
+
+        FileChunkReader* reader = m_reader;
+        const QString filePath = fanOut->filePath;
+        while (fanOut->readOffset < fanOut->fileSize
+               && fanOut->inFlightReads.size() + fanOut->chunks.size() < window) {
+            const quint64 offset = fanOut->readOffset;
+            const qint64 size = static_cast<qint64>(
+                qMin<quint64>(static_cast<quint64>(kChunkSizeBytes), fanOut->fileSize - offset));
+            fanOut->readOffset += static_cast<quint64>(size);
+            fanOut->inFlightReads.insert(offset, size);
+            QMetaObject::invokeMethod(reader, [reader, fanOutId, filePath, offset, size]() {
+                reader->readChunk(fanOutId, filePath, offset, size);
+            }, Qt::QueuedConnection);
+        }
+
+        // Window full and one member far behind the leader: let it read on
+        // its own instead of holding everyone else back
+        const bool windowFull = fanOut->readOffset < fanOut->fileSize
+            && fanOut->inFlightReads.size() + fanOut->chunks.size() >= window;
+        if (!windowFull || waitingForJoins || fanOut->members.size() < 2
+            || fastest - slowest < static_cast<quint64>(kFanOutLagChunks) * kChunkSizeBytes) {
+            return;
+        }
+
+        auto lagging = m_outgoingTransfers.find(laggard);
+        qInfo() << "[FileTransferService]" << laggard << "fell"
+                << (fastest - slowest) / kChunkSizeBytes << "chunks behind; reading separately";
+        leaveFanOut(lagging.value(), true);
+        QMetaObject::invokeMethod(this, [this, laggard]() {
+            pumpOutgoingTransfer(laggard);
+        }, Qt::QueuedConnection);
+
+        fanOut = m_fanOuts.find(fanOutId);
+        if (fanOut == m_fanOuts.end() || fanOut->members.isEmpty()) {
+            return;
+        }
+    }
+}
+
+void FileTransferService::pumpFanOutMembers(const QString& fanOutId)
+{
+    auto fanOut = m_fanOuts.find(fanOutId);
+    if (fanOut == m_fanOuts.end()) {
+        return;
+    }
+
+    const QStringList members = fanOut->members;
+    for (const QString& key : members) {
+        pumpOutgoingTransfer(key);
+    }
+    pumpFanOut(fanOutId);
+}
+
+void FileTransferService::failFanOut(const QString& fanOutId, const QString& error)
+{
+    const QStringList keys = m_outgoingTransfers.keys();
+    for (const QString& key : keys) {
+        auto it = m_outgoingTransfers.find(key);
+        if (it != m_outgoingTransfers.end() && it->fanOutId == fanOutId) {
+            finishOutgoingTransfer(key, error);
+        }
+    }
+    dropFanOutIfUnused(fanOutId);
+}
+
+void FileTransferService::dropFanOutIfUnused(const QString& fanOutId)
+{
+    auto fanOut = m_fanOuts.find(fanOutId);
+    if (fanOut == m_fanOuts.end()) {
+        return;
+    }
+    for (const OutgoingTransfer& transfer : m_outgoingTransfers) {
+        if (transfer.fanOutId == fanOutId) {
+            return;
+        }
+    }
+
+    for (auto it = fanOut->chunks.begin(); it != fanOut->chunks.end(); ++it) {
+        m_reader->recycle(std::move(it->data));
+    }
+    m_fanOuts.erase(fanOut);   // reads still in flight are dropped in onChunkRead
+
+    FileChunkReader* reader = m_reader;
+    QMetaObject::invokeMethod(reader, [reader, fanOutId]() {
+        reader->closeTransfer(fanOutId);
+    }, Qt::QueuedConnection);
+}
+
+void FileTransferService::emitTransferProgress(OutgoingTransfer& transfer, bool force)
+{
+    const qint64 elapsedMs = transfer.elapsed.elapsed();
+    if (!force && transfer.lastProgressMs >= 0
+        && elapsedMs - transfer.lastProgressMs < kProgressIntervalMs) {
+        return;
+    }
+    transfer.lastProgressMs = elapsedMs;
+
+    // A group send reports each member and the sum over all of them
+    quint64 sentBytes = transfer.sentBytes;
+    quint64 totalBytes = transfer.fileSize;
+    if (transfer.transferId != transfer.wireId) {
+        emit memberTransferProgress(transfer.wireId, transfer.peerId,
+                                    transfer.sentBytes, transfer.fileSize);
+        sentBytes = 0;
+        totalBytes = 0;
+        for (const OutgoingTransfer& member : m_outgoingTransfers) {
+            if (member.wireId == transfer.wireId) {
+                sentBytes += member.sentBytes;
+                totalBytes += member.fileSize;
+            }
+        }
+    }
+
+    const double bytesPerSecond = elapsedMs > 0
+            ? static_cast<double>(sentBytes) * 1000.0 / static_cast<double>(elapsedMs)
+            : 0.0;
+    const qint64 etaMs = bytesPerSecond > 0.0
+            ? static_cast<qint64>(static_cast<double>(totalBytes - sentBytes)
+                                  * 1000.0 / bytesPerSecond)
+            : -1;
+
+    emit transferProgress(transfer.wireId, sentBytes, totalBytes, bytesPerSecond, etaMs);
+}
+
+void FileTransferService::finishOutgoingTransfer(const QString& transferId, const QString& error)
+{
+    auto it = m_outgoingTransfers.find(transferId);
+    if (it == m_outgoingTransfers.end()) {
+        return;
+    }
+
+    resetOutgoingSession(it.value());
+    OutgoingTransfer transfer = it.value();
+    m_outgoingTransfers.erase(it);
+    if (!transfer.fanOutId.isEmpty()) {
+        dropFanOutIfUnused(transfer.fanOutId);
+    }
+    const bool lastMember = outgoingKeys(transfer.wireId).isEmpty();
+    bool delivered = false;
+    if (lastMember) {
+        delivered = m_deliveredSends.remove(transfer.wireId);
+        m_imagePreviews.remove(transfer.wireId);
+        const QString transcodedPath = m_transcodedFiles.take(transfer.wireId);
+        if (!transcodedPath.isEmpty()) {
+            QFile::remove(transcodedPath);
+        }
+    }
+
+    // The freed slot goes to the next queued transfer once this one is reported
+    m_scheduler.remove(transferId.toStdString());
+    if (transfer.queuePosition != 0) {
+        emit transferQueued(transfer.wireId, 0);
+    }
+    QMetaObject::invokeMethod(this, [this]() {
+        admitQueuedTransfers();
+    }, Qt::QueuedConnection);
+
+    FileChunkReader* reader = m_reader;
+    QMetaObject::invokeMethod(reader, [reader, transferId]() {
+        reader->closeTransfer(transferId);
+    }, Qt::QueuedConnection);
+
+    if (transfer.striped) {
+        releaseDataLanes(transfer.peerId);
+    }
+    if (transfer.hashPending) {
+        m_hasher->cancel(transferId);
+    }
+
+    if (!error.isEmpty()) {
+        qWarning() << "[FileTransferService] Outgoing transfer" << transferId
+                   << "failed after" << transfer.sentBytes << "bytes:" << error;
+        emit transferFailed(transfer.wireId, error);
+        if (lastMember && !delivered) {
+            // No member got it: the Sending row becomes Failed
+            transfer.message.setStatus(core::MessageStatus::Failed);
+            emit messageFailed(transfer.message, error);
+        }
+        return;
+    }
+
+    if (!lastMember) {
+        m_deliveredSends.insert(transfer.wireId);
+    }
+    qInfo() << "[FileTransferService] Sent" << transfer.fileSize << "bytes for" << transferId
+            << "in" << transfer.elapsed.elapsed() << "ms";
+    transfer.message.setStatus(core::MessageStatus::Sent);
+    emit messageCreated(transfer.message);
+    emit transferCompleted(transfer.wireId, transfer.message);
+}
+
+void FileTransferService::onChunkRead(const QString& transferId,
+                                      quint64 offset,
+                                      const QByteArray& data,
+                                      quint32 crc,
+                                      bool ok)
+{
+    auto fanOut = m_fanOuts.find(transferId);
+    if (fanOut != m_fanOuts.end()) {
+        const qint64 expected = fanOut->inFlightReads.value(offset, -1);
+        if (!fanOut->inFlightReads.remove(offset)) {
+            m_reader->recycle(data);
+            return;
+        }
+        if (!ok) {
+            failFanOut(transferId, QStringLiteral("Failed to read from file"));
+            return;
+        }
+        if (data.size() != expected) {
+            m_reader->recycle(data);
+            failFanOut(transferId, QStringLiteral("File changed while sending"));
+            return;
+        }
+        OutgoingTransfer::ReadyChunk chunk;
+        chunk.data = data;
+        chunk.crc = crc;
+        fanOut->chunks.insert(offset, chunk);
+        pumpFanOutMembers(transferId);
+        return;
+    }
+
+    auto it = m_outgoingTransfers.find(transferId);
+    if (it == m_outgoingTransfers.end()) {
+        // Cancelled or failed while the read was in flight
+        m_reader->recycle(data);
+        return;
+    }
+
+    auto stale = it->staleReads.find(offset);
+    if (stale != it->staleReads.end()) {
+        // Issued before a reconnect reset the session
+        if (--stale.value() == 0) {
+            it->staleReads.erase(stale);
+        }
+        m_reader->recycle(data);
+        return;
+    }
+
+    auto readIt = it->inFlightReads.find(offset);
+    if (readIt == it->inFlightReads.end()) {
+        m_reader->recycle(data);
+        return;
+    }
+
+    const qint64 expected = readIt.value();
+    it->inFlightReads.erase(readIt);
+    if (!ok) {
+        finishOutgoingTransfer(transferId, QStringLiteral("Failed to read from file"));
+        return;
+    }
+    if (data.size() != expected) {
+        // The file shrank while it was being sent
+        m_reader->recycle(data);
+        finishOutgoingTransfer(transferId, QStringLiteral("File changed while sending"));
+        return;
+    }
+
+    OutgoingTransfer::ReadyChunk chunk;
+    chunk.data = data;
+    chunk.crc = crc;
+    it->readyChunks.insert(offset, chunk);
+    pumpOutgoingTransfer(transferId);
+}
+
+void FileTransferService::onDigestReady(const QString& transferId, quint32 crc, bool ok)
+{
+    auto it = m_outgoingTransfers.find(transferId);
+    if (it == m_outgoingTransfers.end()) {
+        return;
+    }
+
+    if (!ok) {
+        finishOutgoingTransfer(transferId, QStringLiteral("Failed to read from file"));
+        return;
+    }
+
+    it->digest = crc;
+    it->digestValid = true;
+    if (it->phase == SendPhase::AwaitingDigest) {
+        sendFileComplete(it.value());
+    }
+}
+
+void FileTransferService::onFileHashed(const QString& transferId,
+                                       const QString& sha256,
+                                       quint64 xxh64,
+                                       bool ok)
+{
+    Q_UNUSED(xxh64);
+
+    // Bulk-received file checked against the sender's SHA-256
+    if (transferId.startsWith(QLatin1String(kVerifyRequestPrefix))) {
+        const QString incomingId = transferId.mid(static_cast<int>(qstrlen(kVerifyRequestPrefix)));
+        auto incoming = m_incomingTransfers.find(incomingId);
+        if (incoming == m_incomingTransfers.end() || !incoming->verifyPending) {
+            return;
+        }
+        TransferContext& ctx = incoming.value();
+        ctx.verifyPending = false;
+        if (!ok) {
+            emit transferFailed(incomingId, QStringLiteral("Failed to read received file"));
+            removeIncomingTransfer(incomingId);
+            return;
+        }
+        if (!ctx.fileHash.isEmpty() && sha256 != ctx.fileHash) {
+            refetchOrFail(ctx, "SHA-256");
+            return;
+        }
+        ctx.verifiedHash = sha256;
+        completeIncomingTransfer(incomingId);
+        return;
+    }
+
+    // Verification of a received file before it enters the content store
+    auto stored = m_pendingStores.find(transferId);
+    if (stored != m_pendingStores.end()) {
+        const QString filePath = stored->first;
+        const QString messageId = stored->second;
+        m_pendingStores.erase(stored);
+        if (ok && AttachmentStore::instance()->adopt(sha256, filePath)) {
+            AttachmentStore::instance()->addReference(sha256, messageId, m_localUserId);
+        }
+        return;
+    }
+
+    auto it = m_outgoingTransfers.find(transferId);
+    if (it == m_outgoingTransfers.end() || !it->hashPending) {
+        return;
+    }
+
+    // The hash is informational (integrity is the CRC32C's job), so a
+    // failure only means the receiver does not get one
+    it->hashPending = false;
+    if (ok) {
+        it->fileHash = sha256;
+    } else {
+        qWarning() << "[FileTransferService] Could not hash" << it->filePath << "for" << transferId;
+    }
+
+    if (it->phase == SendPhase::AwaitingDigest) {
+        sendFileComplete(it.value());
+    } else if (it->phase == SendPhase::AwaitingHash) {
+        it->phase = SendPhase::Idle;
+        if (m_connectionManager->isPeerReady(it->peerId)) {
+            startOutgoingSession(it.value());
+        }
+    }
+}
+
+void FileTransferService::handleFileResponse(const QString& peerId, const std::string& payload)
+{
+    flykylin::protocol::FileTransferResponse resp;
+    if (!resp.ParseFromString(payload)) {
+        return;
+    }
+
+    auto it = findOutgoing(QString::fromStdString(resp.transfer_id()), peerId);
+    if (it == m_outgoingTransfers.end()) {
+        if (!resp.accepted()) {
+            handleSenderCancel(peerId, QString::fromStdString(resp.transfer_id()),
+                               QString::fromStdString(resp.reason()));
+        }
+        return;
+    }
+
+    const QString transferId = it.key();
+    OutgoingTransfer& transfer = it.value();
+    if (!resp.accepted()) {
+        const QString reason = resp.reason().empty()
+                ? QStringLiteral("Rejected by receiver")
+                : QString::fromStdString(resp.reason());
+        finishOutgoingTransfer(transferId, reason);
+        return;
+    }
+
+    if (resp.completed()) {
+        if (resp.deduplicated()) {
+            qInfo() << "[FileTransferService]" << peerId << "already has the content of"
+                    << transferId << "- nothing to send";
+        }
+        transfer.sentBytes = transfer.fileSize;
+        emitTransferProgress(transfer, true);
+        finishOutgoingTransfer(transferId, QString());
+        return;
+    }
+
+    if (!transfer.resumable || transfer.phase == SendPhase::Idle) {
+        return;
+    }
+
+    // Send exactly what the receiver is missing (all of it for a new transfer)
+    resetOutgoingSession(transfer);
+    quint64 missingBytes = 0;
+    for (const auto& range : resp.missing_ranges()) {
+        if (range.offset() >= transfer.fileSize || range.length() == 0) {
+            continue;
+        }
+        const quint64 length = qMin<quint64>(range.length(), transfer.fileSize - range.offset());
+        transfer.readQueue.append(ByteRange{range.offset(), length});
+        missingBytes += length;
+    }
+    transfer.sentBytes = transfer.fileSize - missingBytes;
+
+    if (transfer.bulk) {
+        if (resp.port() != 0 && resp.port() <= 0xffff && !transfer.readQueue.isEmpty()) {
+            startBulkSend(transfer, static_cast<quint16>(resp.port()), resp.bulk_token());
+            return;
+        }
+        // Nothing left to send, or the receiver could not open a bulk
+        // socket: chunks (and their whole-file CRC) as usual
+        transfer.bulk = false;
+        if (transfer.fileSize > kMaxFileSizeBytes && !transfer.readQueue.isEmpty()) {
+            finishOutgoingTransfer(transferId, QStringLiteral("File is too large (max 200MB)"));
+            return;
+        }
+    }
+
+    // A fresh transfer wants everything: group members take the shared reads
+    if (missingBytes == transfer.fileSize && transfer.readQueue.size() == 1
+        && joinFanOut(transfer)) {
+        transfer.readQueue.clear();
+    }
+
+    if (transfer.readQueue.isEmpty() && !transfer.fanOutJoined) {
+        sendFileComplete(transfer);
+        return;
+    }
+
+    if (missingBytes < transfer.fileSize) {
+        qInfo() << "[FileTransferService] Resuming" << transferId << "-"
+                << missingBytes << "of" << transfer.fileSize << "bytes missing in"
+                << transfer.readQueue.size() << "ranges";
+    }
+    transfer.stripeSampleMs = transfer.elapsed.elapsed();
+    transfer.phase = SendPhase::Streaming;
+    pumpOutgoingTransfer(transferId);
+}
+
+} // namespace services
+} // namespace flykylin
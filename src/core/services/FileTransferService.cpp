@@ -1,32 +1,50 @@
 #include "FileTransferService.h"
+#include "FileChunkReader.h"
+#include "FileHasher.h"
+#include "FileTransferSettings.h"
+#include "FileWriteBehind.h"
+#include "ImageProcessor.h"
 
 #include "../config/UserProfile.h"
-#include "../ai/NSFWDetector.h"
 #include <QByteArray>
+#include <QCryptographicHash>
 #include <QDateTime>
 #include <QDebug>
 #include <QDir>
-#include <QFile>
 #include <QFileInfo>
+#include <QSet>
 #include <QSettings>
 #include <QStandardPaths>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
 #include <string>
 #include "messages.pb.h"
 
 namespace {
-constexpr quint64 kMaxFileSizeBytes = 200ull * 1024ull * 1024ull;
-constexpr qint64 kChunkSizeBytes = 1024 * 1024; // 1MB
-
-bool nsfwBlockOutgoing()
+// Ids may come from peers (previews, relays): hash them rather than trust them in a path
+QString idFileName(const QString& id)
 {
-    QSettings settings("FlyKylin", "FlyKylin");
-    return settings.value("nsfw/blockOutgoing", false).toBool();
+    return QString::fromLatin1(
+        QCryptographicHash::hash(id.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
 }
 
-bool nsfwBlockIncoming()
+namespace flykylin {
+namespace services {
+
+namespace file_transfer {
+
+TransferScheduler::Limits schedulerLimits()
 {
     QSettings settings("FlyKylin", "FlyKylin");
-    return settings.value("nsfw/blockIncoming", false).toBool();
+    TransferScheduler::Limits limits;
+    limits.globalBytesPerSecond = static_cast<quint64>(
+        qMax<qint64>(settings.value("transfer/uploadLimitKBps", 0).toLongLong(), 0)) * 1024ull;
+    limits.peerBytesPerSecond = static_cast<quint64>(
+        qMax<qint64>(settings.value("transfer/peerUploadLimitKBps", 0).toLongLong(), 0)) * 1024ull;
+    limits.maxActive = qMax(settings.value("transfer/maxConcurrent", 3).toInt(), 0);
+    return limits;
 }
 
 double nsfwThreshold()
@@ -40,10 +58,10 @@ double nsfwThreshold()
     }
     return value;
 }
-}
 
-namespace flykylin {
-namespace services {
+} // namespace file_transfer
+
+using namespace file_transfer;
 
 FileTransferService::FileTransferService(QObject* parent)
     : QObject(parent)
@@ -53,56 +71,75 @@ FileTransferService::FileTransferService(QObject* parent)
 
     connect(m_connectionManager, &communication::TcpConnectionManager::messageReceived,
             this, &FileTransferService::onTcpMessageReceived);
+    // File data arrives as a view into the socket buffer, so it must be handled in place
+    connect(m_connectionManager, &communication::TcpConnectionManager::fileDataReceived,
+            this, &FileTransferService::onFileDataReceived, Qt::DirectConnection);
+    connect(m_connectionManager, &communication::TcpConnectionManager::peerBytesWritten,
+            this, [this](const QString& peerId, qint64) { onPeerWritable(peerId); });
+    connect(m_connectionManager, &communication::TcpConnectionManager::peerReady,
+            this, &FileTransferService::onPeerWritable);
+    connect(m_connectionManager, &communication::TcpConnectionManager::dataLaneReady,
+            this, &FileTransferService::onPeerWritable);
+    connect(m_connectionManager, &communication::TcpConnectionManager::connectionStateChanged,
+            this, &FileTransferService::onConnectionStateChanged);
+
+    m_schedulerClock.start();
+    m_throttleTimer.setSingleShot(true);
+    m_throttleTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_throttleTimer, &QTimer::timeout, this, &FileTransferService::onThrottleWake);
+    m_rateTimer.setInterval(kRateIntervalMs);
+    connect(&m_rateTimer, &QTimer::timeout, this, &FileTransferService::emitTransferRates);
 }
 
-FileTransferService::~FileTransferService() = default;
-
-void FileTransferService::sendImage(const QString& peerId, const QString& filePath)
+FileTransferService::~FileTransferService()
 {
-    sendFileInternal(peerId,
-                     filePath,
-                     true,   // asImage
-                     false,  // isGroup
-                     QString(),
-                     QString());
-}
-
-void FileTransferService::sendFile(const QString& peerId, const QString& filePath)
-{
-    sendFileInternal(peerId,
-                     filePath,
-                     false,  // asImage
-                     false,  // isGroup
-                     QString(),
-                     QString());
-}
+    const QStringList bulkKeys = m_bulkJobs.keys();
+    for (const QString& key : bulkKeys) {
+        stopBulkJob(key);
+    }
+    for (QThread* thread : m_bulkThreads) {
+        thread->wait();
+        delete thread;
+    }
+    m_bulkThreads.clear();
 
-void FileTransferService::sendImage(const QString& peerId,
-                                    const QString& filePath,
-                                    bool isGroup,
-                                    const QString& groupId,
-                                    const QString& logicalMessageId)
-{
-    sendFileInternal(peerId,
-                     filePath,
-                     true,  // asImage
-                     isGroup,
-                     groupId,
-                     logicalMessageId);
-}
+    // Resumable transfers pick up their temp file in the next session
+    if (m_writer) {
+        for (auto it = m_incomingTransfers.cbegin(); it != m_incomingTransfers.cend(); ++it) {
+            if (!it->writerOpened) {
+                continue;
+            }
+            if (it->resumable) {
+                m_writer->close(it.key());
+            } else {
+                m_writer->abort(it.key());
+            }
+        }
+    }
 
-void FileTransferService::sendFile(const QString& peerId,
-                                   const QString& filePath,
-                                   bool isGroup,
-                                   const QString& groupId,
-                                   const QString& logicalMessageId)
-{
-    sendFileInternal(peerId,
-                     filePath,
-                     false,  // asImage
-                     isGroup,
-                     groupId,
-                     logicalMessageId);
+    if (m_hashThread) {
+        for (auto it = m_outgoingTransfers.cbegin(); it != m_outgoingTransfers.cend(); ++it) {
+            if (it->hashPending) {
+                m_hasher->cancel(it.key());
+            }
+        }
+        m_hashThread->quit();
+        m_hashThread->wait();
+        delete m_hasher;
+        m_hasher = nullptr;
+    }
+    if (m_imageThread) {
+        m_imageThread->quit();
+        m_imageThread->wait();
+        delete m_imageProcessor;
+        m_imageProcessor = nullptr;
+    }
+    if (m_ioThread) {
+        m_ioThread->quit();
+        m_ioThread->wait();
+        delete m_reader;
+        m_reader = nullptr;
+    }
 }
 
 void FileTransferService::setDownloadDirectory(const QString& path)
@@ -119,200 +156,332 @@ QString FileTransferService::downloadDirectory() const
     return m_downloadDirectory;
 }
 
-void FileTransferService::sendFileInternal(const QString& peerId,
-                                           const QString& filePath,
-                                           bool asImage,
-                                           bool isGroup,
-                                           const QString& groupId,
-                                           const QString& logicalMessageId)
+bool FileTransferService::sendControlMessage(const QString& peerId,
+                                             int type,
+                                             const std::string& payload,
+                                             communication::MessageQueue::Priority priority)
 {
-    QFileInfo info(filePath);
-    if (!info.exists() || !info.isFile()) {
-        emit transferFailed(QString(), QStringLiteral("File not found"));
+    flykylin::protocol::TcpMessage tcpMsg;
+    tcpMsg.set_protocol_version(1);
+    tcpMsg.set_type(static_cast<flykylin::protocol::TcpMessage::MessageType>(type));
+    tcpMsg.set_sequence(0);
+    tcpMsg.set_payload(payload);
+    tcpMsg.set_timestamp(QDateTime::currentMSecsSinceEpoch());
+
+    QByteArray data(static_cast<int>(tcpMsg.ByteSizeLong()), Qt::Uninitialized);
+    if (!tcpMsg.SerializeToArray(data.data(), data.size())) {
+        return false;
+    }
+
+    m_connectionManager->sendMessage(peerId, data, priority);
+    return true;
+}
+
+void FileTransferService::ensureReader()
+{
+    if (m_reader) {
         return;
     }
 
-    quint64 fileSize = static_cast<quint64>(info.size());
-    if (fileSize > kMaxFileSizeBytes) {
-        emit transferFailed(QString(), QStringLiteral("File is too large (max 200MB)"));
+    m_ioThread = new QThread(this);
+    m_ioThread->setObjectName(QStringLiteral("FileTransferIO"));
+
+    m_reader = new FileChunkReader();
+    m_reader->moveToThread(m_ioThread);
+    connect(m_reader, &FileChunkReader::chunkRead,
+            this, &FileTransferService::onChunkRead, Qt::QueuedConnection);
+    connect(m_reader, &FileChunkReader::digestReady,
+            this, &FileTransferService::onDigestReady, Qt::QueuedConnection);
+
+    m_ioThread->start();
+    qInfo() << "[FileTransferService] File I/O thread started";
+}
+
+void FileTransferService::ensureHasher()
+{
+    if (m_hasher) {
         return;
     }
 
-    float nsfwProb = 0.0f;
-    bool nsfwProbValid = false;
-    bool nsfwChecked = false;
-    bool nsfwPassedFlag = false;
+    m_hashThread = new QThread(this);
+    m_hashThread->setObjectName(QStringLiteral("FileTransferHash"));
 
-    if (asImage) {
-        auto* detector = ai::NSFWDetector::instance();
-        if (detector && detector->isAvailable()) {
-            const auto prob = detector->predictNsfwProbability(filePath);
-            if (prob.has_value()) {
-                nsfwProb = *prob;
-                nsfwProbValid = true;
-                qInfo() << "[FileTransferService] NSFW probability for outgoing image" << filePath
-                        << "=" << nsfwProb;
-            } else {
-                qWarning() << "[FileTransferService] NSFW detection failed for outgoing image"
-                           << filePath;
-            }
-        }
+    m_hasher = new FileHasher();
+    m_hasher->moveToThread(m_hashThread);
+    connect(m_hasher, &FileHasher::fileHashed,
+            this, &FileTransferService::onFileHashed, Qt::QueuedConnection);
+
+    m_hashThread->start();
+    qInfo() << "[FileTransferService] File hash thread started";
+}
+
+void FileTransferService::ensureImageProcessor()
+{
+    if (m_imageProcessor) {
+        return;
     }
 
-    if (asImage && nsfwProbValid && nsfwBlockOutgoing()) {
-        const double threshold = nsfwThreshold();
-        const bool blocked = nsfwProb >= static_cast<float>(threshold);
-
-        if (blocked) {
-            QString infoText =
-                QStringLiteral("[NSFW] 发送图片检测: 阻断 (p=%1, 阈值=%2)")
-                    .arg(static_cast<double>(nsfwProb), 0, 'f', 3)
-                    .arg(threshold, 0, 'f', 2);
-
-            core::Message infoMessage;
-            infoMessage.setId(core::Message::generateMessageId());
-            infoMessage.setFromUserId(m_localUserId);
-            infoMessage.setToUserId(peerId);
-            infoMessage.setTimestamp(QDateTime::currentDateTime());
-            infoMessage.setStatus(core::MessageStatus::Delivered);
-            infoMessage.setKind(core::MessageKind::Text);
-            infoMessage.setContent(infoText);
-            if (isGroup && !groupId.isEmpty()) {
-                infoMessage.setIsGroup(true);
-                infoMessage.setGroupId(groupId);
+    m_imageThread = new QThread(this);
+    m_imageThread->setObjectName(QStringLiteral("FileTransferImage"));
+
+    m_imageProcessor = new ImageProcessor();
+    m_imageProcessor->moveToThread(m_imageThread);
+    connect(m_imageProcessor, &ImageProcessor::previewReady,
+            this, &FileTransferService::onImagePreviewReady, Qt::QueuedConnection);
+    connect(m_imageProcessor, &ImageProcessor::imageTranscoded,
+            this, &FileTransferService::onImageTranscoded, Qt::QueuedConnection);
+
+    m_imageThread->start();
+    qInfo() << "[FileTransferService] Image thread started";
+}
+
+void FileTransferService::admitQueuedTransfers()
+{
+    // Group members share a wire id and a queue position: report each once
+    QSet<QString> reported;
+    QSet<QString> startedFanOuts;
+    for (const std::string& key : m_scheduler.admit()) {
+        auto it = m_outgoingTransfers.find(QString::fromStdString(key));
+        if (it == m_outgoingTransfers.end()) {
+            continue;
+        }
+
+        OutgoingTransfer& transfer = it.value();
+        const bool wasQueued = transfer.queuePosition != 0;
+        if (wasQueued) {
+            transfer.queuePosition = 0;
+            transfer.elapsed.restart();   // rates and ETA count from the start, not the queueing
+            if (!reported.contains(transfer.wireId)) {
+                reported.insert(transfer.wireId);
+                emit transferQueued(transfer.wireId, 0);
             }
+        }
 
-            emit messageCreated(infoMessage);
+        // A group that waited in the queue gets its join grace from now
+        const QString fanOutId = transfer.fanOutId;
+        auto fanOut = m_fanOuts.find(fanOutId);
+        if (wasQueued && fanOut != m_fanOuts.end() && !startedFanOuts.contains(fanOutId)) {
+            startedFanOuts.insert(fanOutId);
+            if (fanOut->members.isEmpty() && !fanOut->released) {
+                fanOut->created.restart();
+                QTimer::singleShot(kFanOutJoinGraceMs, this, [this, fanOutId]() {
+                    pumpFanOutMembers(fanOutId);
+                });
+            }
+        }
 
-            emit transferFailed(QString(),
-                                QStringLiteral("NSFW policy blocked outgoing image"));
-            return;
-        } else {
-            nsfwChecked = true;
-            nsfwPassedFlag = true;
+        if (transfer.phase == SendPhase::Idle && m_connectionManager->isPeerReady(transfer.peerId)) {
+            startOutgoingSession(transfer);
         }
     }
 
-    QString mimeType = detectMimeType(filePath, asImage);
-    QString transferId = logicalMessageId.isEmpty()
-            ? core::Message::generateMessageId()
-            : logicalMessageId;
-
-    flykylin::protocol::FileTransferRequest req;
-    req.set_transfer_id(transferId.toStdString());
-    req.set_from_user_id(m_localUserId.toStdString());
-    req.set_to_user_id(peerId.toStdString());
-    req.set_file_name(info.fileName().toStdString());
-    req.set_file_size(fileSize);
-    req.set_file_hash(std::string());
-    req.set_timestamp(QDateTime::currentMSecsSinceEpoch());
-    req.set_mime_type(mimeType.toStdString());
-    req.set_is_group(isGroup);
-    if (isGroup && !groupId.isEmpty()) {
-        req.set_group_id(groupId.toStdString());
-    }
-
-    std::string payload;
-    if (!req.SerializeToString(&payload)) {
-        emit transferFailed(transferId, QStringLiteral("Failed to serialize FileTransferRequest"));
-        return;
+    for (const std::string& key : m_scheduler.queued()) {
+        auto it = m_outgoingTransfers.find(QString::fromStdString(key));
+        if (it == m_outgoingTransfers.end()) {
+            continue;
+        }
+        const int position = m_scheduler.queuePosition(key);
+        if (it->queuePosition != position) {
+            it->queuePosition = position;
+            if (!reported.contains(it->wireId)) {
+                reported.insert(it->wireId);
+                emit transferQueued(it->wireId, position);
+            }
+        }
     }
 
-    flykylin::protocol::TcpMessage tcpReq;
-    tcpReq.set_protocol_version(1);
-    tcpReq.set_type(flykylin::protocol::TcpMessage::FILE_REQUEST);
-    tcpReq.set_sequence(0);
-    tcpReq.set_payload(payload);
-    tcpReq.set_timestamp(QDateTime::currentMSecsSinceEpoch());
+    if (!m_outgoingTransfers.isEmpty() && !m_rateTimer.isActive()) {
+        m_rateTimer.start();
+    }
+}
 
-    QByteArray reqData(tcpReq.ByteSizeLong(), Qt::Uninitialized);
-    if (!tcpReq.SerializeToArray(reqData.data(), reqData.size())) {
-        emit transferFailed(transferId, QStringLiteral("Failed to serialize TcpMessage (FILE_REQUEST)"));
+void FileTransferService::scheduleThrottleWake(qint64 waitMs)
+{
+    if (m_throttleTimer.isActive() && m_throttleTimer.remainingTime() <= waitMs) {
         return;
     }
+    m_throttleTimer.start(static_cast<int>(qMin<qint64>(waitMs, kRateIntervalMs)));
+}
+
+void FileTransferService::onThrottleWake()
+{
+    // Images first, so they get the refilled tokens
+    QStringList images;
+    QStringList files;
+    for (auto it = m_outgoingTransfers.cbegin(); it != m_outgoingTransfers.cend(); ++it) {
+        if (it->phase == SendPhase::Streaming) {
+            (it->message.kind() == core::MessageKind::Image ? images : files).append(it.key());
+        }
+    }
+    for (const QString& key : images + files) {
+        pumpOutgoingTransfer(key);
+    }
+}
 
-    m_connectionManager->sendMessage(peerId, reqData,
-                                     communication::MessageQueue::Priority::Normal);
+void FileTransferService::emitTransferRates()
+{
+    const qint64 nowMs = m_schedulerClock.elapsed();
+    // Settings changes apply within a second
+    const int previousMaxActive = m_scheduler.limits().maxActive;
+    m_scheduler.setLimits(schedulerLimits(), nowMs);
+    if (m_scheduler.limits().maxActive != previousMaxActive) {
+        admitQueuedTransfers();
+    }
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        emit transferFailed(transferId, QStringLiteral("Failed to open file"));
-        return;
+    QVariantMap rates;
+    for (auto it = m_outgoingTransfers.cbegin(); it != m_outgoingTransfers.cend(); ++it) {
+        const std::string key = it.key().toStdString();
+        if (m_scheduler.isActive(key)) {
+            rates[it->wireId] = rates.value(it->wireId).toDouble() + m_scheduler.rate(key, nowMs);
+        }
     }
+    emit transferRatesUpdated(m_scheduler.totalRate(nowMs), rates);
 
-    quint64 offset = 0;
+    // One last (empty) report after the last transfer is gone
+    if (m_outgoingTransfers.isEmpty()) {
+        m_rateTimer.stop();
+    }
+}
 
-    while (true) {
-        QByteArray fileData = file.read(kChunkSizeBytes);
-        if (fileData.isEmpty()) {
-            if (file.error() != QFile::NoError) {
-                emit transferFailed(transferId, QStringLiteral("Failed to read from file"));
-                file.close();
-                return;
+void FileTransferService::onPeerWritable(const QString& peerId)
+{
+    const QStringList ids = m_outgoingTransfers.keys();
+    for (const QString& transferId : ids) {
+        auto it = m_outgoingTransfers.find(transferId);
+        if (it == m_outgoingTransfers.end() || it->peerId != peerId) {
+            continue;
+        }
+        if (it->phase == SendPhase::Idle) {
+            if (m_scheduler.isActive(transferId.toStdString())
+                && m_connectionManager->isPeerReady(peerId)) {
+                startOutgoingSession(it.value());
             }
-            break;
+        } else {
+            pumpOutgoingTransfer(transferId);
         }
+    }
+}
 
-        flykylin::protocol::FileChunk chunk;
-        chunk.set_transfer_id(transferId.toStdString());
-        chunk.set_offset(static_cast<quint64>(offset));
-        chunk.set_data(fileData.constData(), static_cast<int>(fileData.size()));
-        chunk.set_chunk_size(static_cast<quint32>(fileData.size()));
-        chunk.set_is_last(file.atEnd());
-
-        std::string chunkPayload;
-        if (!chunk.SerializeToString(&chunkPayload)) {
-            emit transferFailed(transferId, QStringLiteral("Failed to serialize FileChunk"));
-            file.close();
-            return;
+void FileTransferService::onConnectionStateChanged(const QString& peerId,
+                                                   communication::ConnectionState state,
+                                                   const QString& reason)
+{
+    if (state == communication::ConnectionState::Connected
+        || state == communication::ConnectionState::Connecting) {
+        return;
+    }
+
+    // Receiver: make sure the verified ranges survive if the sender never
+    // comes back. Bulk receivers would otherwise sit in accept()/splice()
+    // until the sender's socket times out; they save theirs when the job
+    // winds down.
+    for (auto it = m_incomingTransfers.begin(); it != m_incomingTransfers.end(); ++it) {
+        if (it->peerId != peerId) {
+            continue;
+        }
+        interruptBulkJob(QStringLiteral("recv:") + it->transferId);
+        if (it->resumable && it->writerOpened) {
+            savePartialTransfer(it.value());
         }
+    }
 
-        flykylin::protocol::TcpMessage tcpChunk;
-        tcpChunk.set_protocol_version(1);
-        tcpChunk.set_type(flykylin::protocol::TcpMessage::FILE_CHUNK);
-        tcpChunk.set_sequence(0);
-        tcpChunk.set_payload(chunkPayload);
-        tcpChunk.set_timestamp(QDateTime::currentMSecsSinceEpoch());
-
-        QByteArray chunkData(tcpChunk.ByteSizeLong(), Qt::Uninitialized);
-        if (!tcpChunk.SerializeToArray(chunkData.data(), chunkData.size())) {
-            emit transferFailed(transferId, QStringLiteral("Failed to serialize TcpMessage (FILE_CHUNK)"));
-            file.close();
-            return;
+    // Sender: resumable transfers wait for the peer and continue where the
+    // receiver left off; others only survive if they had not started yet.
+    const bool gaveUp = state == communication::ConnectionState::Failed;
+    const QString error = reason.isEmpty() ? QStringLiteral("Connection lost") : reason;
+    const QStringList ids = m_outgoingTransfers.keys();
+    for (const QString& transferId : ids) {
+        auto it = m_outgoingTransfers.find(transferId);
+        if (it == m_outgoingTransfers.end() || it->peerId != peerId) {
+            continue;
+        }
+        if (gaveUp || (!it->resumable && it->sentBytes > 0)) {
+            finishOutgoingTransfer(transferId, error);
+            continue;
+        }
+        if (it->phase == SendPhase::Idle) {
+            continue;
         }
 
-        m_connectionManager->sendMessage(peerId, chunkData,
-                                         communication::MessageQueue::Priority::Normal);
+        qInfo() << "[FileTransferService] Connection to" << peerId << "lost; transfer"
+                << transferId << "will resume after reconnect";
+        resetOutgoingSession(it.value());
+    }
+}
 
-        offset += static_cast<quint64>(fileData.size());
+void FileTransferService::pauseTransfer(const QString& transferId)
+{
+    for (const QString& key : outgoingKeys(transferId)) {
+        auto it = m_outgoingTransfers.find(key);
+        it->paused = true;
+        if (it->bulk && it->phase == SendPhase::Streaming) {
+            // sendfile() cannot be held mid-range: drop the socket, resume asks again
+            stopBulkJob(QStringLiteral("send:") + key);
+        }
+        qInfo() << "[FileTransferService] Paused transfer" << key << "at" << it->sentBytes;
     }
+}
 
-    file.close();
+void FileTransferService::resumeTransfer(const QString& transferId)
+{
+    for (const QString& key : outgoingKeys(transferId)) {
+        auto it = m_outgoingTransfers.find(key);
+        if (it == m_outgoingTransfers.end() || !it->paused) {
+            continue;
+        }
+        it->paused = false;
+        it->stripeSampleMs = it->elapsed.elapsed();   // a pause is not a throughput sample
+        qInfo() << "[FileTransferService] Resumed transfer" << key << "at" << it->sentBytes;
+        if (it->bulk && it->phase == SendPhase::Streaming
+            && !m_bulkJobs.contains(QStringLiteral("send:") + key)) {
+            if (m_connectionManager->isPeerReady(it->peerId)) {
+                startOutgoingSession(it.value());
+            }
+            continue;
+        }
+        pumpOutgoingTransfer(key);
+    }
+}
 
-    core::Message message;
-    message.setId(transferId);
-    message.setFromUserId(m_localUserId);
-    message.setToUserId(peerId);
-    message.setTimestamp(QDateTime::currentDateTime());
-    message.setStatus(core::MessageStatus::Sent);
-    message.setKind(asImage ? core::MessageKind::Image : core::MessageKind::File);
-    message.setAttachmentLocalPath(filePath);
-    message.setAttachmentName(info.fileName());
-    message.setAttachmentSize(static_cast<quint64>(info.size()));
-    message.setMimeType(mimeType);
-    message.setContent(info.fileName());
-    if (isGroup && !groupId.isEmpty()) {
-        message.setIsGroup(true);
-        message.setGroupId(groupId);
+void FileTransferService::cancelTransfer(const QString& transferId)
+{
+    for (const QString& key : outgoingKeys(transferId)) {
+        auto it = m_outgoingTransfers.constFind(key);
+        if (it->phase != SendPhase::Idle || it->previewSent) {
+            // The receiver drops the transfer and any preview placeholder
+            flykylin::protocol::FileTransferResponse cancel;
+            cancel.set_transfer_id(it->wireId.toStdString());
+            cancel.set_accepted(false);
+            cancel.set_reason("Cancelled by sender");
+            sendControlMessage(it->peerId, flykylin::protocol::TcpMessage::FILE_RESPONSE,
+                               cancel.SerializeAsString());
+        }
+        finishOutgoingTransfer(key, QStringLiteral("Cancelled"));
     }
+}
 
-    if (asImage && nsfwChecked) {
-        message.setNsfwChecked(true);
-        message.setNsfwPassed(nsfwPassedFlag);
+QStringList FileTransferService::outgoingKeys(const QString& transferId) const
+{
+    if (m_outgoingTransfers.contains(transferId)) {
+        return QStringList{transferId};
     }
+    QStringList keys;
+    for (auto it = m_outgoingTransfers.cbegin(); it != m_outgoingTransfers.cend(); ++it) {
+        if (it->wireId == transferId) {
+            keys.append(it.key());
+        }
+    }
+    return keys;
+}
 
-    emit messageCreated(message);
-    emit transferCompleted(transferId, message);
+QMap<QString, FileTransferService::OutgoingTransfer>::iterator
+FileTransferService::findOutgoing(const QString& wireId, const QString& peerId)
+{
+    auto it = m_outgoingTransfers.find(wireId);
+    if (it != m_outgoingTransfers.end() && it->peerId == peerId) {
+        return it;
+    }
+    return m_outgoingTransfers.find(wireId + QLatin1Char('/') + peerId);
 }
 
 QString FileTransferService::ensureDownloadDirectory(bool isImage) const
@@ -366,6 +535,7 @@ QString FileTransferService::detectMimeType(const QString& filePath, bool asImag
     return QStringLiteral("application/octet-stream");
 }
 
+
 void FileTransferService::onTcpMessageReceived(QString peerId, QByteArray data)
 {
     handleIncomingTcpData(peerId, data);
@@ -378,212 +548,64 @@ void FileTransferService::handleIncomingTcpData(const QString& peerId, const QBy
         return;
     }
 
-    using MessageType = flykylin::protocol::TcpMessage::MessageType;
-    MessageType type = tcpMsg.type();
-
-    if (type != flykylin::protocol::TcpMessage::FILE_REQUEST &&
-        type != flykylin::protocol::TcpMessage::FILE_CHUNK) {
+    switch (tcpMsg.type()) {
+    case flykylin::protocol::TcpMessage::FILE_REQUEST:
+        handleFileRequest(peerId, tcpMsg.payload());
         return;
-    }
 
-    if (type == flykylin::protocol::TcpMessage::FILE_REQUEST) {
-        flykylin::protocol::FileTransferRequest req;
-        if (!req.ParseFromString(tcpMsg.payload())) {
-            return;
-        }
-
-        QString transferId = QString::fromStdString(req.transfer_id());
-
-        TransferContext ctx;
-        ctx.transferId = transferId;
-        ctx.peerId = peerId;
-        ctx.fileName = QString::fromStdString(req.file_name());
-        ctx.fileSize = req.file_size();
-
-        const QString mimeType = QString::fromStdString(req.mime_type());
-        ctx.isImage = mimeType.startsWith(QStringLiteral("image/"));
-        ctx.accepted = ctx.isImage ? m_autoAcceptImages : m_autoAcceptFiles;
-        ctx.isGroup = req.is_group();
-        if (ctx.isGroup) {
-            ctx.groupId = QString::fromStdString(req.group_id());
-        }
+    case flykylin::protocol::TcpMessage::FILE_RESPONSE:
+        handleFileResponse(peerId, tcpMsg.payload());
+        return;
 
-        core::Message message;
-        message.setId(transferId);
-        message.setFromUserId(QString::fromStdString(req.from_user_id()));
-        message.setToUserId(QString::fromStdString(req.to_user_id()));
-        message.setTimestamp(QDateTime::fromMSecsSinceEpoch(req.timestamp()));
-        message.setStatus(core::MessageStatus::Sending);
-        message.setKind(ctx.isImage ? core::MessageKind::Image : core::MessageKind::File);
-        message.setAttachmentName(ctx.fileName);
-        message.setAttachmentSize(ctx.fileSize);
-        message.setMimeType(mimeType);
-        message.setContent(ctx.fileName);
-        if (ctx.isGroup && !ctx.groupId.isEmpty()) {
-            message.setIsGroup(true);
-            message.setGroupId(ctx.groupId);
-        }
+    case flykylin::protocol::TcpMessage::FILE_COMPLETE:
+        handleFileComplete(peerId, tcpMsg.payload());
+        return;
 
-        ctx.message = message;
-        m_incomingTransfers.insert(transferId, ctx);
-        emit incomingTransferRequested(transferId, peerId, message);
+    case flykylin::protocol::TcpMessage::FILE_PREVIEW:
+        handleFilePreview(peerId, tcpMsg.payload());
         return;
-    }
 
-    if (type == flykylin::protocol::TcpMessage::FILE_CHUNK) {
+    case flykylin::protocol::TcpMessage::FILE_CHUNK: {
         flykylin::protocol::FileChunk chunk;
         if (!chunk.ParseFromString(tcpMsg.payload())) {
             return;
         }
 
-        QString transferId = QString::fromStdString(chunk.transfer_id());
-        auto it = m_incomingTransfers.find(transferId);
-        if (it == m_incomingTransfers.end()) {
-            return;
-        }
-
-        TransferContext& ctx = it.value();
-
-        if (ctx.rejected) {
-            m_incomingTransfers.remove(transferId);
-            return;
-        }
-
-        if (!ctx.accepted) {
-            return;
-        }
-
-        QString baseDir = ctx.downloadDirectoryOverride.isEmpty()
-                ? ensureDownloadDirectory(ctx.isImage)
-                : ctx.downloadDirectoryOverride;
-        QString filePath = baseDir + QDir::separator() + ctx.fileName;
-
-        QFile outFile(filePath);
-        QIODevice::OpenMode openMode = QIODevice::WriteOnly;
-        if (ctx.receivedBytes > 0) {
-            openMode |= QIODevice::Append;
-        }
-
-        if (!outFile.open(openMode)) {
-            emit transferFailed(transferId, QStringLiteral("Failed to open output file"));
-            m_incomingTransfers.remove(transferId);
+        // Chunks only count from the peer that owns the transfer (raw
+        // frames are already keyed by peer through the transfer index)
+        const QString transferId = QString::fromStdString(chunk.transfer_id());
+        auto owner = m_incomingTransfers.constFind(transferId);
+        if (owner != m_incomingTransfers.constEnd() && owner->peerId != peerId) {
+            qWarning() << "[FileTransferService] Dropping chunk of" << transferId
+                       << "from" << peerId << "- not the sender";
             return;
         }
 
         const std::string& dataRef = chunk.data();
-        qint64 written = outFile.write(dataRef.data(), static_cast<qint64>(dataRef.size()));
-        outFile.close();
-        if (written != static_cast<qint64>(dataRef.size())) {
-            emit transferFailed(transferId, QStringLiteral("Failed to write output file"));
-            m_incomingTransfers.remove(transferId);
-            return;
-        }
-
-        ctx.localFilePath = filePath;
-        ctx.receivedBytes += static_cast<quint64>(dataRef.size());
-        ctx.message.setAttachmentLocalPath(filePath);
-
-        if (chunk.is_last()) {
-            ctx.message.setStatus(core::MessageStatus::Delivered);
-            ctx.message.setAttachmentSize(ctx.receivedBytes);
-
-            float nsfwProbIncoming = 0.0f;
-            bool nsfwProbIncomingValid = false;
-            bool nsfwCheckedIncoming = false;
-            bool nsfwPassedIncoming = false;
-
-            if (ctx.isImage) {
-                auto* detector = ai::NSFWDetector::instance();
-                if (detector && detector->isAvailable()) {
-                    const auto prob = detector->predictNsfwProbability(ctx.localFilePath);
-                    if (prob.has_value()) {
-                        nsfwProbIncoming = *prob;
-                        nsfwProbIncomingValid = true;
-                        qInfo() << "[FileTransferService] NSFW probability for received image"
-                                << ctx.localFilePath << "=" << nsfwProbIncoming;
-                    } else {
-                        qWarning() << "[FileTransferService] NSFW detection failed for received image"
-                                   << ctx.localFilePath;
-                    }
-                }
-            }
-
-            if (ctx.isImage && nsfwProbIncomingValid && nsfwBlockIncoming()) {
-                const double threshold = nsfwThreshold();
-                const bool blocked = nsfwProbIncoming >= static_cast<float>(threshold);
-
-                if (blocked) {
-                    QString infoText =
-                        QStringLiteral("[NSFW] 接收来自 %1 的图片检测: 阻断 (p=%2, 阈值=%3)")
-                            .arg(ctx.peerId)
-                            .arg(static_cast<double>(nsfwProbIncoming), 0, 'f', 3)
-                            .arg(threshold, 0, 'f', 2);
-
-                    core::Message infoMessage;
-                    infoMessage.setId(core::Message::generateMessageId());
-                    infoMessage.setFromUserId(m_localUserId);
-                    infoMessage.setToUserId(ctx.peerId);
-                    infoMessage.setTimestamp(QDateTime::currentDateTime());
-                    infoMessage.setStatus(core::MessageStatus::Delivered);
-                    infoMessage.setKind(core::MessageKind::Text);
-                    infoMessage.setContent(infoText);
-                    if (ctx.isGroup && !ctx.groupId.isEmpty()) {
-                        infoMessage.setIsGroup(true);
-                        infoMessage.setGroupId(ctx.groupId);
-                    }
-
-                    emit messageCreated(infoMessage);
-
-                    QFile::remove(ctx.localFilePath);
-                    m_incomingTransfers.remove(transferId);
-                    emit transferFailed(transferId,
-                                        QStringLiteral("NSFW policy blocked incoming image"));
-                    return;
-                } else {
-                    nsfwCheckedIncoming = true;
-                    nsfwPassedIncoming = true;
-                }
-            }
-
-            core::Message completedMessage = ctx.message;
-            if (ctx.isImage && nsfwCheckedIncoming) {
-                completedMessage.setNsfwChecked(true);
-                completedMessage.setNsfwPassed(nsfwPassedIncoming);
-            }
-            m_incomingTransfers.remove(transferId);
-
-            emit messageCreated(completedMessage);
-            emit transferCompleted(transferId, completedMessage);
-        }
-    }
-}
-
-void FileTransferService::acceptTransfer(const QString& transferId, const QString& targetDirectory)
-{
-    if (!m_incomingTransfers.contains(transferId)) {
-        emit transferFailed(transferId, QStringLiteral("Unknown transfer"));
+        handleIncomingChunk(transferId,
+                            chunk.offset(),
+                            dataRef.data(),
+                            static_cast<qint64>(dataRef.size()),
+                            chunk.is_last(),
+                            chunk.checksum());
         return;
     }
 
-    TransferContext& ctx = m_incomingTransfers[transferId];
-    ctx.accepted = true;
-    if (!targetDirectory.isEmpty()) {
-        ctx.downloadDirectoryOverride = targetDirectory;
+    default:
+        return;
     }
 }
 
-void FileTransferService::rejectTransfer(const QString& transferId, const QString& reason)
+QString FileTransferService::previewFilePath(const QString& transferId) const
 {
-    if (!m_incomingTransfers.contains(transferId)) {
-        emit transferFailed(transferId, QStringLiteral("Unknown transfer"));
-        return;
-    }
-
-    TransferContext& ctx = m_incomingTransfers[transferId];
-    ctx.rejected = true;
+    const QString baseDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    return QDir(baseDir).filePath(QStringLiteral("FlyKylin/previews/%1.jpg").arg(idFileName(transferId)));
+}
 
-    QString finalReason = reason.isEmpty() ? QStringLiteral("Rejected by receiver") : reason;
-    emit transferFailed(transferId, finalReason);
+QString FileTransferService::transcodeBasePath(const QString& transferId) const
+{
+    const QString baseDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    return QDir(baseDir).filePath(QStringLiteral("FlyKylin/transcoded/%1").arg(idFileName(transferId)));
 }
 
 } // namespace services
@@ -2,14 +2,42 @@
 
 #include <QObject>
 #include <QMap>
+#include <QPair>
 #include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QQueue>
+#include <QSet>
+#include <QSize>
+#include <QTimer>
+#include <QVariantMap>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
 
 #include "core/models/Message.h"
 #include "core/communication/TcpConnectionManager.h"
+#include "StripeController.h"
+#include "TransferRanges.h"
+#include "TransferScheduler.h"
+
+class QThread;
 
 namespace flykylin {
 namespace services {
 
+class FileChunkReader;
+class FileHasher;
+class FileWriteBehind;
+class ImageProcessor;
+
 class FileTransferService : public QObject {
     Q_OBJECT
 
@@ -30,6 +58,22 @@ public:
                   const QString& groupId,
                   const QString& logicalMessageId);
 
+    /**
+     * @brief Send one image/file to several group members, reading it once
+     *
+     * Members streaming the whole file share each chunk read (and its
+     * CRC); every member keeps its own connection, progress and
+     * backpressure. The NSFW check runs once for all of them.
+     */
+    void sendGroupImage(const QStringList& peerIds,
+                        const QString& filePath,
+                        const QString& groupId,
+                        const QString& logicalMessageId);
+    void sendGroupFile(const QStringList& peerIds,
+                       const QString& filePath,
+                       const QString& groupId,
+                       const QString& logicalMessageId);
+
     void handleIncomingTcpData(const QString& peerId, const QByteArray& data);
     void acceptTransfer(const QString& transferId, const QString& targetDirectory = QString());
     void rejectTransfer(const QString& transferId, const QString& reason = QString());
@@ -40,23 +84,121 @@ public:
     void setDownloadDirectory(const QString& path);
     QString downloadDirectory() const;
 
+    /**
+     * @brief Pause/resume/cancel an outgoing transfer
+     *
+     * Pausing stops handing chunks to the socket; reads already in flight
+     * finish into the window. Cancel emits transferFailed("Cancelled").
+     * For a group send these apply to every member. A paused transfer keeps
+     * its scheduler slot.
+     */
+    void pauseTransfer(const QString& transferId);
+    void resumeTransfer(const QString& transferId);
+    void cancelTransfer(const QString& transferId);
+
 signals:
+    /**
+     * @brief A message to store and show, or a new status for one already shown
+     *
+     * Outgoing images/files are emitted with status Sending once their
+     * transfer is created and again with status Sent when it completes.
+     */
     void messageCreated(const flykylin::core::Message& message);
+    /**
+     * @brief An outgoing image/file shown as Sending reached none of its recipients
+     * @param message The message with status Failed
+     */
+    void messageFailed(const flykylin::core::Message& message, QString error);
     void transferFailed(QString transferId, QString error);
     void transferCompleted(QString transferId, const flykylin::core::Message& message);
     void incomingTransferRequested(QString transferId,
                                    QString peerId,
                                    const flykylin::core::Message& message);
+    /**
+     * @brief Thumbnail of an incoming image that is still being received
+     *
+     * message has the transfer's id and status Sending, and its attachment
+     * path points at the preview; messageCreated with the same id follows
+     * once the full image has landed, transferFailed if it never does.
+     */
+    void imagePreviewReceived(const flykylin::core::Message& message);
+    /**
+     * @brief An outgoing image was replaced by a smaller re-encoded copy before sending
+     * @param encodeMs Decode, scale and encode time on the image thread
+     */
+    void imageTranscoded(QString transferId, quint64 originalBytes, quint64 sentBytes, qint64 encodeMs);
+    /**
+     * @brief Outgoing transfer progress (throttled)
+     * @param bytesPerSecond Average rate since the transfer started
+     * @param etaMs Estimated time remaining, -1 if unknown
+     */
+    void transferProgress(QString transferId,
+                          quint64 bytesSent,
+                          quint64 totalBytes,
+                          double bytesPerSecond,
+                          qint64 etaMs);
+    /**
+     * @brief Progress of one member of a group send (transferProgress sums all members)
+     */
+    void memberTransferProgress(QString transferId,
+                                QString peerId,
+                                quint64 bytesSent,
+                                quint64 totalBytes);
+    /**
+     * @brief An outgoing transfer waits for a free slot (transfer/maxConcurrent)
+     * @param position 1 = starts next; 0 = has started (or was dropped from the queue)
+     */
+    void transferQueued(QString transferId, int position);
+    /**
+     * @brief Live outgoing rates, every kRateIntervalMs while anything is being sent
+     * @param rates transferId -> bytes/s over the last seconds (group sends summed)
+     */
+    void transferRatesUpdated(double totalBytesPerSecond, const QVariantMap& rates);
 
 private slots:
     void onTcpMessageReceived(QString peerId, QByteArray data);
+    void onChunkRead(const QString& transferId,
+                     quint64 offset,
+                     const QByteArray& data,
+                     quint32 crc,
+                     bool ok);
+    void onDigestReady(const QString& transferId, quint32 crc, bool ok);
+    void onFileHashed(const QString& transferId, const QString& sha256, quint64 xxh64, bool ok);
+    void onImagePreviewReady(const QString& transferId,
+                             const QByteArray& data,
+                             const QSize& originalSize,
+                             bool ok);
+    void onImageTranscoded(const QString& transferId,
+                           const QString& outputPath,
+                           qint64 originalBytes,
+                           qint64 outputBytes,
+                           qint64 encodeMs,
+                           bool ok);
+    void onBulkSent(const QString& transferId, quint64 serial, quint64 length);
+    void onBulkSendFinished(const QString& transferId, quint64 serial, bool ok);
+    void onBulkReceived(const QString& transferId, quint64 serial, quint64 offset, quint64 length,
+                        bool synced);
+    void onBulkReceiveFinished(const QString& transferId, quint64 serial, bool ok, bool synced);
+    void onWriterDrained(const QString& transferId);
+    void onWriterSynced(const QString& transferId, quint64 serial, bool ok);
+    void onWriterFinished(const QString& transferId, const QString& finalPath, bool ok);
+    void onPeerWritable(const QString& peerId);
+    void onConnectionStateChanged(const QString& peerId,
+                                  flykylin::communication::ConnectionState state,
+                                  const QString& reason);
+    void onFileDataReceived(const QString& peerId,
+                            const flykylin::communication::FileDataHeader& header,
+                            const QByteArray& data);
 
 private:
     struct TransferContext {
         QString transferId;
         QString peerId;
+        QString peerAddress;        ///< Sender's IP when the request arrived (resume check)
+        QString fromUserId;
         QString localFilePath;
         QString fileName;
+        QString mimeType;
         quint64 fileSize{0};
         quint64 receivedBytes{0};
         bool isImage{false};
@@ -65,15 +207,240 @@ private:
         bool accepted{false};
         bool rejected{false};
         QString downloadDirectoryOverride;
+        quint32 transferIndex{0};   ///< Raw file-data frame index (0 = FileChunk only)
+        bool writerOpened{false};   ///< Temp file handed to m_writer
+        bool resumable{false};      ///< Sender negotiates ranges and sends FILE_COMPLETE
+        bool resumeExisting{false}; ///< Temp file holds data from an earlier session
+        TransferRanges received;    ///< Verified ranges (resumable only)
+        TransferRanges durable;     ///< Ranges confirmed on disk; the only ones persisted
+        TransferRanges syncing;     ///< received as of the sync in flight
+        quint64 syncSerial{0};      ///< Writer sync in flight (0 = none)
+        bool syncAgain{false};      ///< More ranges arrived while syncing
+        quint64 unsavedBytes{0};    ///< Received since the last persist
+        int digestRetries{0};
+        bool completePending{false};    ///< FILE_COMPLETE waiting for data still on other lanes
+        quint32 completeCrc{0};         ///< Whole-file CRC32C from FILE_COMPLETE
+        quint32 completeGeneration{0};  ///< Invalidates stale grace timers
+        QString fileHash;               ///< Sender's SHA-256 (hex), empty if not sent
+        bool deduplicated{false};       ///< Materialized from AttachmentStore, no data sent
+        bool bulk{false};               ///< This session's data arrives on a splice() socket
+        bool bulkReceived{false};       ///< Some ranges landed via the bulk socket (no chunk CRCs)
+        quint64 bulkToken{0};
+        bool verifyPending{false};      ///< Bulk data complete, SHA-256 being computed
+        QString verifiedHash;           ///< SHA-256 of the landed file, if computed
+        bool finishPending{false};      ///< Complete, temp file being synced and renamed
+        quint64 nsfwRequestId{0};       ///< Complete, waiting for the NSFW verdict
         flykylin::core::Message message;
     };
 
-    void sendFileInternal(const QString& peerId,
+    /**
+     * @brief Sender-side phase of a transfer; a dropped connection goes back to Idle
+     */
+    enum class SendPhase {
+        Idle,               ///< Waiting for a ready connection
+        AwaitingHash,       ///< Peer dedupes by content: FILE_REQUEST waits for the SHA-256
+        AwaitingResponse,   ///< FILE_REQUEST sent
+        Streaming,
+        AwaitingDigest,     ///< All ranges sent, whole-file CRC or SHA-256 still being computed
+        AwaitingConfirm     ///< FILE_COMPLETE sent
+    };
+
+    /**
+     * @brief Sender-side state of one transfer to one peer
+     *
+     * Reads run up to kSendWindowChunks (times the stripe count) ahead of
+     * the socket; every chunk first takes tokens from m_scheduler.
+     */
+    struct OutgoingTransfer {
+        struct ReadyChunk {
+            QByteArray data;
+            quint32 crc{0};
+        };
+
+        QString transferId;         ///< Local key; "<wireId>/<peerId>" for group members
+        QString wireId;             ///< transfer_id on the wire (the message id)
+        QString peerId;
+        QString filePath;           ///< File sent (a transcoded copy for large images)
+        quint64 fileSize{0};
+        QString fileName;           ///< On the wire; a transcoded copy's differs from message's
+        QString mimeType;
+        SendPhase phase{SendPhase::Idle};
+        bool resumable{false};      ///< Ranges negotiated by FILE_RESPONSE, confirmed after FILE_COMPLETE
+        quint32 transferIndex{0};   ///< Raw file-data frame index (0 = FileChunk messages)
+        QList<ByteRange> readQueue;             ///< Ranges still to be read this session
+        QQueue<quint64> sendOrder;              ///< Offsets of issued reads, in send order
+        QHash<quint64, qint64> inFlightReads;   ///< offset -> size
+        QHash<quint64, int> staleReads;         ///< offset -> reads issued before a session reset
+        QMap<quint64, ReadyChunk> readyChunks;  ///< offset -> chunk, read but not yet sent
+        TransferRanges sentRanges;              ///< For the whole-file CRC without a re-read
+        quint64 sentBytes{0};
+        bool digestRequested{false};
+        bool digestValid{false};
+        quint32 digest{0};          ///< Whole-file CRC32C for FILE_COMPLETE
+        QString fileHash;           ///< SHA-256 (hex) from m_hasher, empty until known
+        bool hashPending{false};
+        bool paused{false};
+        QElapsedTimer elapsed;
+        qint64 lastProgressMs{-1};
+        bool striped{false};        ///< Chunks spread over the main connection and its data lanes
+        StripeController stripeController;
+        qint64 stripeSampleMs{0};   ///< elapsed() at the last stripe sample
+        QString fanOutId;           ///< Group send this member may read from (empty = own reads)
+        bool fanOutJoined{false};
+        quint64 fanOutOffset{0};    ///< Next shared chunk to send
+        bool bulk{false};           ///< This session sends with sendfile() on a bulk socket (no chunk CRCs)
+        int bulkFailures{0};        ///< Broken bulk sessions; chunks after kMaxBulkFailures
+        int queuePosition{0};       ///< Last reported by transferQueued, 0 = not queued
+        bool previewSent{false};    ///< FILE_PREVIEW thumbnail sent (images of kPreviewMinBytes or more)
+        flykylin::core::Message message;
+
+        int stripes() const { return striped ? stripeController.stripes() : 1; }
+    };
+
+    /**
+     * @brief Shared reads of a group send: each chunk is read once for all joined members
+     *
+     * Reading stays at most kFanOutWindowChunks ahead of the slowest member;
+     * members kFanOutLagChunks behind are detached and read the rest themselves.
+     */
+    struct FanOut {
+        QString filePath;
+        quint64 fileSize{0};
+        QStringList members;                    ///< Joined member keys
+        quint64 readOffset{0};                  ///< Next offset to read
+        bool released{false};                   ///< Chunk 0 is gone; too late to join
+        QHash<quint64, qint64> inFlightReads;   ///< offset -> size
+        QMap<quint64, OutgoingTransfer::ReadyChunk> chunks;
+        QElapsedTimer created;
+    };
+
+    /**
+     * @brief Blocking sendfile()/splice() worker of one bulk session
+     *
+     * The worker thread publishes its socket so stopBulkJob() can shut it
+     * down; results come back as queued calls tagged with serial, so a
+     * replaced job's late results are ignored.
+     */
+    struct BulkJobState {
+        std::atomic<bool> cancel{false};
+        std::atomic<bool> connected{false};
+        std::mutex mutex;
+        int socketFd{-1};
+
+        void setSocket(int fd);
+        void interrupt();
+    };
+
+    struct ImagePreview {
+        QByteArray data;
+        QSize originalSize;
+    };
+
+    /**
+     * @brief Image send waiting for its transcode result or NSFW verdict
+     */
+    struct PendingImageSend {
+        QStringList peerIds;
+        QString filePath;
+        QString sourcePath;
+        bool isGroup{false};
+        QString groupId;
+    };
+
+    struct BulkJob {
+        QThread* thread{nullptr};
+        std::shared_ptr<BulkJobState> state;
+        quint64 serial{0};
+        quint16 port{0};    ///< Receiver: listening port
+    };
+
+    /**
+     * @param sourcePath Set once the transcode stage is done: the user's file,
+     *        which filePath (the file sent) replaces if it is a smaller copy
+     */
+    void sendFileInternal(const QStringList& peerIds,
                           const QString& filePath,
                           bool asImage,
                           bool isGroup,
                           const QString& groupId,
-                          const QString& logicalMessageId);
+                          const QString& logicalMessageId,
+                          const QString& sourcePath = QString());
+    void handleIncomingChunk(const QString& transferId,
+                             quint64 offset,
+                             const char* data,
+                             qint64 size,
+                             bool isLast,
+                             quint32 crc);
+    void handleFileRequest(const QString& peerId, const std::string& payload);
+    void handleFileResponse(const QString& peerId, const std::string& payload);
+    void handleFileComplete(const QString& peerId, const std::string& payload);
+    bool requestOutgoingNsfwCheck(const QString& transferId, const PendingImageSend& send);
+    void onOutgoingNsfwVerdict(const QString& transferId, std::optional<float> nsfwProb);
+    void releaseTranscodedFile(const QString& transferId);
+    void handleSenderCancel(const QString& peerId, const QString& transferId, const QString& reason);
+    void handleFilePreview(const QString& peerId, const std::string& payload);
+    void finishIncomingPreview(const QString& peerId,
+                               const flykylin::core::Message& message,
+                               std::optional<float> nsfwProb);
+    QString previewFilePath(const QString& transferId) const;
+    QString transcodeBasePath(const QString& transferId) const;
+    QString checkIncomingSize(const TransferContext& ctx) const;
+    void refuseFileRequest(const QString& peerId, const QString& transferId, const QString& reason);
+    bool restorePartialTransfer(TransferContext& ctx);
+    void savePartialTransfer(TransferContext& ctx);
+    void persistPartialTransfer(TransferContext& ctx);
+    void openIncomingWriter(TransferContext& ctx);
+    void sendFileResponse(TransferContext& ctx, bool accepted, const QString& reason, bool completed);
+    void verifyIncomingTransfer(const QString& transferId);
+    void refetchOrFail(TransferContext& ctx, const char* what);
+    void completeIncomingTransfer(const QString& transferId);
+    void finishIncomingTransfer(const QString& transferId);
+    void deliverIncomingTransfer(const QString& transferId, std::optional<float> nsfwProb);
+    bool completeFromStore(const QString& transferId);
+    void storeReceivedFile(const TransferContext& ctx);
+    QString incomingFilePath(TransferContext& ctx) const;
+    bool canSendBulk(const QString& peerId) const;
+    void startBulkSend(OutgoingTransfer& transfer, quint16 port, quint64 token);
+    quint16 ensureBulkReceiver(TransferContext& ctx);
+    void startBulkJob(const QString& key, const BulkJob& job, std::function<void()> body);
+    void stopBulkJob(const QString& key);
+    void interruptBulkJob(const QString& key);
+    bool isCurrentBulkJob(const QString& key, quint64 serial) const;
+    void removeIncomingTransfer(const QString& transferId);
+    bool sendControlMessage(const QString& peerId,
+                            int type,
+                            const std::string& payload,
+                            communication::MessageQueue::Priority priority
+                                = communication::MessageQueue::Priority::Normal);
+    void ensureReader();
+    void ensureHasher();
+    void requestFileHash(OutgoingTransfer& transfer);
+    void ensureImageProcessor();
+    void sendImagePreview(OutgoingTransfer& transfer);
+    void startOutgoingSession(OutgoingTransfer& transfer);
+    void resetOutgoingSession(OutgoingTransfer& transfer);
+    void pumpOutgoingTransfer(const QString& transferId);
+    bool sendOutgoingChunk(OutgoingTransfer& transfer,
+                           quint64 offset,
+                           const OutgoingTransfer::ReadyChunk& chunk,
+                           bool isLast);
+    void sendFileComplete(OutgoingTransfer& transfer);
+    void updateStripes(OutgoingTransfer& transfer, quint64 sentBytes);
+    void releaseDataLanes(const QString& peerId);
+    bool joinFanOut(OutgoingTransfer& transfer);
+    void leaveFanOut(OutgoingTransfer& transfer, bool readRemaining);
+    void pumpFanOut(const QString& fanOutId);
+    void pumpFanOutMembers(const QString& fanOutId);
+    void failFanOut(const QString& fanOutId, const QString& error);
+    void dropFanOutIfUnused(const QString& fanOutId);
+    QStringList outgoingKeys(const QString& transferId) const;
+    QMap<QString, OutgoingTransfer>::iterator findOutgoing(const QString& wireId, const QString& peerId);
+    void emitTransferProgress(OutgoingTransfer& transfer, bool force);
+    void admitQueuedTransfers();
+    void scheduleThrottleWake(qint64 waitMs);
+    void onThrottleWake();
+    void emitTransferRates();
+    void finishOutgoingTransfer(const QString& transferId, const QString& error);
     QString ensureDownloadDirectory(bool isImage) const;
     QString detectMimeType(const QString& filePath, bool asImage) const;
 
@@ -81,8 +448,51 @@ private:
     QString m_localUserId;
     QString m_downloadDirectory;
     QMap<QString, TransferContext> m_incomingTransfers;
+    QMap<QPair<QString, quint32>, QString> m_transferIndexes;  ///< (peerId, index) -> transferId
+    quint32 m_nextTransferIndex{1};
+    QMap<QString, OutgoingTransfer> m_outgoingTransfers;
+    QMap<QString, FanOut> m_fanOuts;
+    QSet<QString> m_deliveredSends;     ///< Group wireIds some member completed, until the last finishes
+    QHash<QString, QPair<QString, QString>> m_pendingStores;   ///< Hash request -> (path, message id)
+    QHash<QString, BulkJob> m_bulkJobs;     ///< "send:<key>" / "recv:<transferId>" -> running job
+    QList<QThread*> m_bulkThreads;          ///< All bulk threads still running (incl. stopped jobs)
+    quint64 m_nextBulkSerial{1};
+    TransferScheduler m_scheduler;          ///< Keyed by outgoing transfer key
+    QElapsedTimer m_schedulerClock;
+    QTimer m_throttleTimer;                 ///< Wakes transfers held back by the token buckets
+    QTimer m_rateTimer;
+    QThread* m_ioThread{nullptr};
+    FileChunkReader* m_reader{nullptr};     ///< Lives on m_ioThread
+    QThread* m_hashThread{nullptr};
+    FileHasher* m_hasher{nullptr};          ///< Lives on m_hashThread
+    QThread* m_imageThread{nullptr};
+    ImageProcessor* m_imageProcessor{nullptr};  ///< Lives on m_imageThread
+    QHash<QString, ImagePreview> m_imagePreviews;   ///< Outgoing wireId -> thumbnail
+    QSet<QString> m_blockedPreviews;        ///< Incoming previews the NSFW check rejected before FILE_REQUEST
+    QHash<QString, PendingImageSend> m_pendingImageSends;   ///< Message id -> send to continue
+    QHash<QString, std::optional<float>> m_nsfwVerdicts;    ///< Message id -> outgoing image verdict
+    QHash<QString, QString> m_transcodedFiles;  ///< Outgoing wireId -> smaller copy, deleted when sent
+    std::unique_ptr<FileWriteBehind> m_writer;  ///< Created on first incoming chunk
+    QHash<QString, QString> m_writerBacklog;    ///< Backlogged transferId -> peer whose reads are paused
+    quint64 m_nextSyncSerial{1};
     bool m_autoAcceptImages{true};
     bool m_autoAcceptFiles{true};
+
+    static constexpr int kSendWindowChunks = 4;
+    static constexpr qint64 kMaxSocketBacklogBytes = 4 * 1024 * 1024;
+    static constexpr qint64 kProgressIntervalMs = 250;
+    static constexpr quint64 kPartialSaveIntervalBytes = 8 * 1024 * 1024;
+    static constexpr int kMaxDigestRetries = 1;
+    static constexpr int kStripedCompleteGraceMs = 2000;
+    static constexpr int kFanOutWindowChunks = 16;
+    static constexpr int kFanOutLagChunks = 12;
+    static constexpr int kFanOutJoinGraceMs = 1000;
+    static constexpr int kBulkConnectTimeoutMs = 3000;
+    static constexpr int kBulkAcceptTimeoutMs = 15000;
+    static constexpr int kMaxBulkFailures = 2;
+    static constexpr int kRateIntervalMs = 1000;
+    static constexpr quint64 kPreviewMinBytes = 256 * 1024;
+    static constexpr quint64 kTranscodeMinBytes = 200 * 1024;
 };
 
 } // namespace services
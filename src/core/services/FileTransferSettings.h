@@ -0,0 +1,36 @@
+#pragma once
+
+#include "TransferScheduler.h"
+
+#include <QtGlobal>
+
+namespace flykylin {
+namespace services {
+
+/**
+ * @brief Limits and settings shared by the FileTransferService sources
+ *
+ * FileTransferService.cpp holds the service state, scheduling and control
+ * messages; FileTransferSender.cpp, FileTransferReceiver.cpp and
+ * FileTransferBulk.cpp hold the two transfer directions and the bulk path.
+ */
+namespace file_transfer {
+
+constexpr quint64 kMaxFileSizeBytes = 200ull * 1024ull * 1024ull;
+constexpr char kPartialFileSuffix[] = ".part";
+constexpr char kVerifyRequestPrefix[] = "verify:";
+
+/**
+ * @brief Upload limits from the transfer/* settings
+ */
+TransferScheduler::Limits schedulerLimits();
+
+/**
+ * @brief nsfw/threshold, clamped to [0, 1]
+ */
+double nsfwThreshold();
+
+} // namespace file_transfer
+
+} // namespace services
+} // namespace flykylin
@@ -0,0 +1,459 @@
+#include "FileWriteBehind.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtGlobal>
+
+#include <cstdio>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <io.h>
+#endif
+
+namespace flykylin {
+namespace services {
+
+namespace {
+
+bool replaceFile(const QString& from, const QString& to)
+{
+#ifdef Q_OS_UNIX
+    // rename(2) atomically replaces an existing target
+    return std::rename(QFile::encodeName(from).constData(),
+                       QFile::encodeName(to).constData()) == 0;
+#else
+    if (QFile::exists(to) && !QFile::remove(to)) {
+        return false;
+    }
+    return QFile::rename(from, to);
+#endif
+}
+
+bool syncFile(QFile* file)
+{
+    // Unbuffered QFile: everything written is already in the kernel
+#if defined(Q_OS_LINUX)
+    return ::fdatasync(file->handle()) == 0;
+#elif defined(Q_OS_UNIX)
+    return ::fsync(file->handle()) == 0;
+#elif defined(Q_OS_WIN)
+    return ::_commit(file->handle()) == 0;
+#else
+    return file->flush();
+#endif
+}
+
+} // namespace
+
+FileWriteBehind::FileWriteBehind(qint64 maxQueuedBytes)
+    : m_maxQueuedBytes(maxQueuedBytes)
+{
+    m_thread = QThread::create([this]() { run(); });
+    m_thread->setObjectName(QStringLiteral("FileWriteBehind"));
+    m_thread->start();
+}
+
+FileWriteBehind::~FileWriteBehind()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_workAvailable.wakeAll();
+    }
+    m_thread->wait();
+    delete m_thread;
+
+    // Anything still open never finished: don't leave temp files behind
+    const auto ids = m_files.keys();
+    for (const QString& transferId : ids) {
+        closeFile(transferId, true);
+    }
+}
+
+void FileWriteBehind::open(const QString& transferId,
+                           const QString& tempPath,
+                           quint64 preallocateSize,
+                           bool keepExisting)
+{
+    Op op;
+    op.type = OpType::Open;
+    op.transferId = transferId;
+    op.path = tempPath;
+    op.offset = preallocateSize;
+    op.keepExisting = keepExisting;
+    enqueue(std::move(op));
+}
+
+bool FileWriteBehind::write(const QString& transferId, quint64 offset, const char* data, qint64 size)
+{
+    if (size <= 0) {
+        QMutexLocker locker(&m_mutex);
+        return !m_failed.contains(transferId);
+    }
+
+    Op op;
+    op.type = OpType::Write;
+    op.transferId = transferId;
+    op.offset = offset;
+    op.data = QByteArray(data, static_cast<int>(size));
+
+    QMutexLocker locker(&m_mutex);
+    if (m_failed.contains(transferId)) {
+        return false;
+    }
+    m_queuedBytes += size;
+    qint64& pending = m_transferBytes[transferId];
+    pending += size;
+    if (pending > m_maxQueuedBytes) {
+        m_backlogged.insert(transferId);
+    }
+    enqueueLocked(std::move(op));
+    return true;
+}
+
+void FileWriteBehind::sync(const QString& transferId, quint64 serial)
+{
+    Op op;
+    op.type = OpType::Sync;
+    op.transferId = transferId;
+    op.offset = serial;
+    enqueue(std::move(op));
+}
+
+void FileWriteBehind::finish(const QString& transferId, const QString& finalPath)
+{
+    Op op;
+    op.type = OpType::Finish;
+    op.transferId = transferId;
+    op.path = finalPath;
+
+    QMutexLocker locker(&m_mutex);
+    m_finishing.insert(transferId);
+    enqueueLocked(std::move(op));
+}
+
+void FileWriteBehind::abort(const QString& transferId)
+{
+    Op op;
+    op.type = OpType::Abort;
+    op.transferId = transferId;
+
+    QMutexLocker locker(&m_mutex);
+    // Chunks of an aborted transfer are never written
+    auto it = m_queues.find(transferId);
+    if (it != m_queues.end()) {
+        QQueue<Op> kept;
+        for (Op& queued : *it) {
+            if (queued.type == OpType::Write) {
+                m_queuedBytes -= queued.data.size();
+            } else {
+                kept.enqueue(std::move(queued));
+            }
+        }
+        if (kept.isEmpty()) {
+            m_queues.erase(it);
+            m_ready.removeOne(transferId);
+        } else {
+            *it = std::move(kept);
+        }
+    }
+    m_transferBytes.remove(transferId);
+    m_backlogged.remove(transferId);
+    enqueueLocked(std::move(op));
+}
+
+void FileWriteBehind::close(const QString& transferId)
+{
+    Op op;
+    op.type = OpType::Close;
+    op.transferId = transferId;
+    enqueue(std::move(op));
+}
+
+bool FileWriteBehind::isBacklogged(const QString& transferId) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_backlogged.contains(transferId);
+}
+
+void FileWriteBehind::setDrainedCallback(std::function<void(const QString& transferId)> callback)
+{
+    QMutexLocker locker(&m_mutex);
+    m_drained = std::move(callback);
+}
+
+void FileWriteBehind::setSyncedCallback(std::function<void(const QString& transferId, quint64 serial, bool ok)> callback)
+{
+    QMutexLocker locker(&m_mutex);
+    m_synced = std::move(callback);
+}
+
+void FileWriteBehind::setFinishedCallback(
+    std::function<void(const QString& transferId, const QString& finalPath, bool ok)> callback)
+{
+    QMutexLocker locker(&m_mutex);
+    m_finished = std::move(callback);
+}
+
+qint64 FileWriteBehind::queuedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_queuedBytes;
+}
+
+qint64 FileWriteBehind::queuedBytes(const QString& transferId) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_transferBytes.value(transferId);
+}
+
+void FileWriteBehind::enqueue(Op op)
+{
+    QMutexLocker locker(&m_mutex);
+    enqueueLocked(std::move(op));
+}
+
+void FileWriteBehind::enqueueLocked(Op op)
+{
+    QQueue<Op>& queue = m_queues[op.transferId];
+    if (queue.isEmpty()) {
+        m_ready.enqueue(op.transferId);
+    }
+    queue.enqueue(std::move(op));
+    m_workAvailable.wakeOne();
+}
+
+bool FileWriteBehind::takeNext(Op& op)
+{
+    if (m_ready.isEmpty()) {
+        return false;
+    }
+
+    // A transfer someone is waiting to finish goes ahead of the rotation
+    int index = 0;
+    if (!m_finishing.isEmpty()) {
+        for (int i = 0; i < m_ready.size(); ++i) {
+            if (m_finishing.contains(m_ready.at(i))) {
+                index = i;
+                break;
+            }
+        }
+    }
+
+    const QString transferId = m_ready.takeAt(index);
+    auto it = m_queues.find(transferId);
+    op = it->dequeue();
+    if (it->isEmpty()) {
+        m_queues.erase(it);
+    } else {
+        m_ready.enqueue(transferId);
+    }
+    return true;
+}
+
+bool FileWriteBehind::release(const QString& transferId, qint64 bytes)
+{
+    m_queuedBytes -= bytes;
+    auto it = m_transferBytes.find(transferId);
+    if (it == m_transferBytes.end()) {
+        return false;   // aborted while the chunk was being written
+    }
+    *it -= bytes;
+    const qint64 pending = *it;
+    if (pending <= 0) {
+        m_transferBytes.erase(it);
+    }
+    return pending <= m_maxQueuedBytes / 2 && m_backlogged.remove(transferId);
+}
+
+void FileWriteBehind::run()
+{
+    while (true) {
+        Op op;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_ready.isEmpty() && !m_stopping) {
+                m_workAvailable.wait(&m_mutex);
+            }
+            if (!takeNext(op)) {
+                return;
+            }
+        }
+
+        execute(op);
+
+        if (op.type == OpType::Write) {
+            std::function<void(const QString&)> drained;
+            {
+                QMutexLocker locker(&m_mutex);
+                if (release(op.transferId, op.data.size())) {
+                    drained = m_drained;
+                }
+            }
+            if (drained) {
+                drained(op.transferId);
+            }
+        }
+    }
+}
+
+void FileWriteBehind::execute(Op& op)
+{
+    switch (op.type) {
+    case OpType::Open: {
+        closeFile(op.transferId, !op.keepExisting);
+
+        auto* file = new QFile(op.path);
+        QIODevice::OpenMode mode = QIODevice::ReadWrite | QIODevice::Unbuffered;
+        if (!op.keepExisting) {
+            mode |= QIODevice::Truncate;
+        }
+        if (!file->open(mode)) {
+            qWarning() << "[FileWriteBehind] Failed to open" << op.path << file->errorString();
+            delete file;
+            QMutexLocker locker(&m_mutex);
+            m_failed.insert(op.transferId);
+            return;
+        }
+
+#ifdef Q_OS_LINUX
+        // Reserve the whole file up front: fewer extents, and ENOSPC shows up
+        // now rather than halfway through the transfer
+        if (op.offset > 0) {
+            const int rc = posix_fallocate(file->handle(), 0, static_cast<off_t>(op.offset));
+            if (rc != 0) {
+                qDebug() << "[FileWriteBehind] posix_fallocate failed for" << op.path << "rc=" << rc;
+            }
+        }
+#endif
+
+        OpenFile entry;
+        entry.file = file;
+        entry.tempPath = op.path;
+        if (op.keepExisting) {
+            // Resumed data counts towards the final size; finish() truncates to extent
+            entry.extent = qMin<quint64>(static_cast<quint64>(file->size()), op.offset);
+        }
+        m_files.insert(op.transferId, entry);
+        return;
+    }
+
+    case OpType::Write: {
+        auto it = m_files.find(op.transferId);
+        bool ok = it != m_files.end();
+        if (ok) {
+            QFile* file = it->file;
+            const qint64 offset = static_cast<qint64>(op.offset);
+            ok = (file->pos() == offset || file->seek(offset))
+                 && file->write(op.data.constData(), op.data.size()) == op.data.size();
+            if (ok) {
+                it->extent = qMax<quint64>(it->extent, op.offset + static_cast<quint64>(op.data.size()));
+            } else {
+                qWarning() << "[FileWriteBehind] Write failed for" << it->tempPath
+                           << "at" << op.offset << file->errorString();
+            }
+        }
+        if (!ok) {
+            QMutexLocker locker(&m_mutex);
+            m_failed.insert(op.transferId);
+        }
+        return;
+    }
+
+    case OpType::Sync: {
+        bool ok = false;
+        std::function<void(const QString&, quint64, bool)> synced;
+        {
+            QMutexLocker locker(&m_mutex);
+            ok = !m_failed.contains(op.transferId);
+            synced = m_synced;
+        }
+        auto it = m_files.find(op.transferId);
+        ok = ok && it != m_files.end();
+        if (ok && !syncFile(it->file)) {
+            qWarning() << "[FileWriteBehind] Sync failed for" << it->tempPath;
+            ok = false;
+        }
+        if (synced) {
+            synced(op.transferId, op.offset, ok);
+        }
+        return;
+    }
+
+    case OpType::Finish: {
+        bool failed = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            failed = m_failed.contains(op.transferId);
+        }
+
+        bool ok = false;
+        auto it = m_files.find(op.transferId);
+        if (failed) {
+            closeFile(op.transferId, true);
+        } else if (it != m_files.end()) {
+            QFile* file = it->file;
+            // Drop the preallocated tail if fewer bytes arrived than announced
+            ok = file->size() == static_cast<qint64>(it->extent)
+                 || file->resize(static_cast<qint64>(it->extent));
+            // The data must be on disk before the name is: a crash after the
+            // rename would otherwise leave a complete-looking file of holes
+            if (ok && !syncFile(file)) {
+                qWarning() << "[FileWriteBehind] Sync failed for" << it->tempPath;
+                ok = false;
+            }
+            const QString tempPath = it->tempPath;
+            closeFile(op.transferId, false);
+            ok = ok && replaceFile(tempPath, op.path);
+            if (!ok) {
+                QFile::remove(tempPath);
+            }
+        }
+
+        std::function<void(const QString&, const QString&, bool)> finished;
+        {
+            QMutexLocker locker(&m_mutex);
+            m_failed.remove(op.transferId);
+            m_finishing.remove(op.transferId);
+            finished = m_finished;
+        }
+        if (finished) {
+            finished(op.transferId, op.path, ok);
+        }
+        return;
+    }
+
+    case OpType::Close:
+    case OpType::Abort: {
+        closeFile(op.transferId, op.type == OpType::Abort);
+        QMutexLocker locker(&m_mutex);
+        m_failed.remove(op.transferId);
+        return;
+    }
+    }
+}
+
+void FileWriteBehind::closeFile(const QString& transferId, bool removeTemp)
+{
+    auto it = m_files.find(transferId);
+    if (it == m_files.end()) {
+        return;
+    }
+
+    it->file->close();
+    if (removeTemp) {
+        QFile::remove(it->tempPath);
+    }
+    delete it->file;
+    m_files.erase(it);
+}
+
+} // namespace services
+} // namespace flykylin
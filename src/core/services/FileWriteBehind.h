@@ -0,0 +1,163 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QQueue>
+#include <QSet>
+#include <QString>
+#include <QWaitCondition>
+
+#include <functional>
+
+class QFile;
+class QThread;
+
+namespace flykylin {
+namespace services {
+
+/**
+ * @brief Write-behind sink for incoming file transfers
+ *
+ * Keeps one open handle per transfer and writes chunks at their offset on a
+ * worker thread, so the receiving (GUI) thread only copies bytes into a
+ * queue. Each transfer has its own queue and the worker serves them round
+ * robin, so one slow or large transfer does not delay the others.
+ *
+ * write() never blocks. A transfer with more than maxQueuedBytes pending is
+ * reported as backlogged; the caller is expected to stop reading from that
+ * transfer's socket until the drained callback fires, which pushes back on
+ * the sender instead of buffering a whole file in memory.
+ *
+ * Data goes to a temp file that is preallocated to the announced size and
+ * renamed over the final path by finish(), so a partially received file
+ * never shows up under its real name. finish() is queued like everything
+ * else and reports through the finished callback.
+ */
+class FileWriteBehind {
+public:
+    explicit FileWriteBehind(qint64 maxQueuedBytes = kDefaultMaxQueuedBytes);
+    ~FileWriteBehind();
+
+    FileWriteBehind(const FileWriteBehind&) = delete;
+    FileWriteBehind& operator=(const FileWriteBehind&) = delete;
+
+    /**
+     * @brief Start a transfer
+     * @param tempPath File written while the transfer is in progress
+     * @param preallocateSize Announced file size (0 = no preallocation)
+     * @param keepExisting Resume into an existing temp file instead of truncating it
+     */
+    void open(const QString& transferId,
+              const QString& tempPath,
+              quint64 preallocateSize,
+              bool keepExisting = false);
+
+    /**
+     * @brief Queue a chunk (copied) for writing at offset; never blocks
+     * @return false if an earlier operation of this transfer failed
+     */
+    bool write(const QString& transferId, quint64 offset, const char* data, qint64 size);
+
+    /**
+     * @brief Queue an fdatasync() of the transfer's temp file
+     *
+     * Runs after every chunk queued before it. The synced callback reports
+     * serial and whether all of those chunks are now on disk; a failed
+     * earlier write reports false.
+     */
+    void sync(const QString& transferId, quint64 serial);
+
+    /**
+     * @brief Queue writing the rest, fdatasync(), close and rename the temp file to finalPath
+     *
+     * Never blocks; the worker serves a finishing transfer ahead of the
+     * others. The finished callback reports false if any write, the
+     * truncate, the sync or the rename failed (the temp file is then gone).
+     */
+    void finish(const QString& transferId, const QString& finalPath);
+
+    /**
+     * @brief Drop queued chunks, close and delete the temp file
+     */
+    void abort(const QString& transferId);
+
+    /**
+     * @brief Write queued chunks and close, keeping the temp file for a later resume
+     */
+    void close(const QString& transferId);
+
+    /**
+     * @brief True while the transfer has more than maxQueuedBytes pending
+     */
+    bool isBacklogged(const QString& transferId) const;
+
+    /**
+     * @brief Called on the worker thread when a backlogged transfer has
+     *        drained to half of maxQueuedBytes (not after abort())
+     */
+    void setDrainedCallback(std::function<void(const QString& transferId)> callback);
+
+    /**
+     * @brief Called on the worker thread when a sync() has run
+     */
+    void setSyncedCallback(std::function<void(const QString& transferId, quint64 serial, bool ok)> callback);
+
+    /**
+     * @brief Called on the worker thread when a finish() has run
+     */
+    void setFinishedCallback(std::function<void(const QString& transferId, const QString& finalPath, bool ok)> callback);
+
+    qint64 queuedBytes() const;
+    qint64 queuedBytes(const QString& transferId) const;
+
+    static constexpr qint64 kDefaultMaxQueuedBytes = 8 * 1024 * 1024;
+
+private:
+    enum class OpType { Open, Write, Sync, Finish, Abort, Close };
+
+    struct Op {
+        OpType type{OpType::Write};
+        QString transferId;
+        QString path;           ///< Open: temp path, Finish: final path
+        quint64 offset{0};      ///< Write: file offset, Open: preallocation size, Sync: serial
+        QByteArray data;
+        bool keepExisting{false};
+    };
+
+    struct OpenFile {
+        QFile* file{nullptr};
+        QString tempPath;
+        quint64 extent{0};      ///< Highest offset written (final file size)
+    };
+
+    void enqueue(Op op);
+    void enqueueLocked(Op op);
+    bool takeNext(Op& op);
+    bool release(const QString& transferId, qint64 bytes);
+    void run();
+    void execute(Op& op);
+    void closeFile(const QString& transferId, bool removeTemp);
+
+    const qint64 m_maxQueuedBytes;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_workAvailable;
+    QHash<QString, QQueue<Op>> m_queues;    ///< Pending ops per transfer
+    QQueue<QString> m_ready;                ///< Transfers with pending ops, round robin
+    QSet<QString> m_finishing;              ///< Served first: a finish() is queued
+    QHash<QString, qint64> m_transferBytes; ///< Queued write bytes per transfer
+    QSet<QString> m_backlogged;
+    qint64 m_queuedBytes{0};
+    std::function<void(const QString&)> m_drained;
+    std::function<void(const QString&, quint64, bool)> m_synced;
+    std::function<void(const QString&, const QString&, bool)> m_finished;
+    QSet<QString> m_failed;             ///< Transfers with a failed write
+    bool m_stopping{false};
+
+    QHash<QString, OpenFile> m_files;   ///< Worker thread only
+    QThread* m_thread{nullptr};
+};
+
+} // namespace services
+} // namespace flykylin
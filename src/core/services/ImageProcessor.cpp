@@ -0,0 +1,222 @@
+#include "ImageProcessor.h"
+
+#include <QBuffer>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QPainter>
+
+namespace flykylin {
+namespace services {
+
+namespace {
+
+bool hasTransparentPixels(const QImage& image)
+{
+    if (!image.hasAlphaChannel()) {
+        return false;
+    }
+    // Screenshots are often ARGB with every pixel opaque
+    const QImage argb = image.convertToFormat(QImage::Format_ARGB32);
+    for (int y = 0; y < argb.height(); ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(argb.constScanLine(y));
+        for (int x = 0; x < argb.width(); ++x) {
+            if (qAlpha(line[x]) != 255) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+ImageProcessor::ImageProcessor(QObject* parent)
+    : QObject(parent)
+{
+}
+
+bool ImageProcessor::makePreview(const QString& filePath, Preview* preview)
+{
+    QImageReader reader(filePath);
+    reader.setAutoTransform(true);
+
+    // Scaled decode: the reader sizes before any EXIF rotation
+    const QSize storedSize = reader.size();
+    if (storedSize.isValid()
+        && (storedSize.width() > kPreviewMaxEdge || storedSize.height() > kPreviewMaxEdge)) {
+        reader.setScaledSize(storedSize.scaled(kPreviewMaxEdge, kPreviewMaxEdge, Qt::KeepAspectRatio));
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "[ImageProcessor] Failed to decode" << filePath << reader.errorString();
+        return false;
+    }
+    if (image.width() > kPreviewMaxEdge || image.height() > kPreviewMaxEdge) {
+        // Formats without scaled decode (and unknown sizes) are read in full
+        image = image.scaled(kPreviewMaxEdge, kPreviewMaxEdge,
+                             Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    QSize originalSize = storedSize.isValid() ? storedSize : image.size();
+    if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+        originalSize.transpose();
+    }
+
+    if (image.hasAlphaChannel()) {
+        // JPEG has no alpha: flatten onto white like the chat background
+        QImage flattened(image.size(), QImage::Format_RGB32);
+        flattened.fill(Qt::white);
+        QPainter painter(&flattened);
+        painter.drawImage(0, 0, image);
+        painter.end();
+        image = flattened;
+    }
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, "jpeg");
+    writer.setQuality(kPreviewQuality);
+    if (!writer.write(image)) {
+        qWarning() << "[ImageProcessor] Failed to encode preview of" << filePath << writer.errorString();
+        return false;
+    }
+
+    if (preview) {
+        preview->data = data;
+        preview->originalSize = originalSize;
+    }
+    return true;
+}
+
+QImage ImageProcessor::loadScaled(const QString& filePath, const QSize& minSize, QSize* originalSize)
+{
+    QImageReader reader(filePath);
+    const QSize storedSize = reader.size();
+    if (originalSize) {
+        *originalSize = storedSize;
+    }
+
+    if (storedSize.isValid()) {
+        int reduction = 1;
+        while (reduction < kMaxDecodeReduction
+               && storedSize.width() / (reduction * 2) >= minSize.width()
+               && storedSize.height() / (reduction * 2) >= minSize.height()) {
+            reduction *= 2;
+        }
+        if (reduction > 1) {
+            // Rounded up like libjpeg does, so JPEG needs no extra resampling
+            reader.setScaledSize(QSize((storedSize.width() + reduction - 1) / reduction,
+                                       (storedSize.height() + reduction - 1) / reduction));
+        }
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "[ImageProcessor] Failed to decode" << filePath << reader.errorString();
+    } else if (originalSize && !storedSize.isValid()) {
+        *originalSize = image.size();
+    }
+    return image;
+}
+
+bool ImageProcessor::transcode(const QString& filePath,
+                               const QString& outputBasePath,
+                               const TranscodeOptions& options,
+                               Transcoded* result)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QImageReader reader(filePath);
+    reader.setAutoTransform(true);
+    const QByteArray format = reader.format();
+    if (format != "png" && format != "jpeg" && format != "bmp") {
+        // GIF/WebP may be animated; anything else is left alone too
+        return false;
+    }
+
+    const QSize storedSize = reader.size();
+    const int maxEdge = options.maxDimension;
+    if (maxEdge > 0 && storedSize.isValid()
+        && (storedSize.width() > maxEdge || storedSize.height() > maxEdge)) {
+        reader.setScaledSize(storedSize.scaled(maxEdge, maxEdge, Qt::KeepAspectRatio));
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "[ImageProcessor] Failed to decode" << filePath << reader.errorString();
+        return false;
+    }
+    if (maxEdge > 0 && (image.width() > maxEdge || image.height() > maxEdge)) {
+        image = image.scaled(maxEdge, maxEdge, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    // Transparency needs PNG; everything else is smallest as JPEG
+    const bool keepAlpha = hasTransparentPixels(image);
+    const QString outputPath = outputBasePath + (keepAlpha ? QStringLiteral(".png")
+                                                           : QStringLiteral(".jpg"));
+    QImageWriter writer(outputPath, keepAlpha ? "png" : "jpeg");
+    if (keepAlpha) {
+        writer.setQuality(0);   // PNG: zlib level 9
+    } else {
+        writer.setQuality(options.quality);
+        writer.setOptimizedWrite(true);
+        writer.setProgressiveScanWrite(true);
+    }
+    if (!writer.write(keepAlpha ? image : image.convertToFormat(QImage::Format_RGB32))) {
+        qWarning() << "[ImageProcessor] Failed to encode" << outputPath << writer.errorString();
+        QFile::remove(outputPath);
+        return false;
+    }
+
+    const qint64 originalBytes = QFileInfo(filePath).size();
+    const qint64 outputBytes = QFileInfo(outputPath).size();
+    if (outputBytes <= 0 || outputBytes * 100 > originalBytes * (100 - kMinSavingsPercent)) {
+        QFile::remove(outputPath);
+        return false;
+    }
+
+    if (result) {
+        result->outputPath = outputPath;
+        result->originalBytes = originalBytes;
+        result->outputBytes = outputBytes;
+        result->encodeMs = timer.elapsed();
+    }
+    return true;
+}
+
+void ImageProcessor::createPreview(const QString& requestId, const QString& filePath)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Preview preview;
+    const bool ok = makePreview(filePath, &preview);
+    if (ok) {
+        qInfo() << "[ImageProcessor] Preview of" << filePath << preview.originalSize
+                << "->" << preview.data.size() << "bytes in" << timer.elapsed() << "ms";
+    }
+    emit previewReady(requestId, preview.data, preview.originalSize, ok);
+}
+
+void ImageProcessor::transcodeImage(const QString& requestId,
+                                    const QString& filePath,
+                                    const QString& outputBasePath,
+                                    const TranscodeOptions& options)
+{
+    Transcoded result;
+    const bool ok = transcode(filePath, outputBasePath, options, &result);
+    emit imageTranscoded(requestId, result.outputPath, result.originalBytes, result.outputBytes,
+                         result.encodeMs, ok);
+}
+
+} // namespace services
+} // namespace flykylin
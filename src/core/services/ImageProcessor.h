@@ -0,0 +1,106 @@
+#pragma once
+
+#include <QByteArray>
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QString>
+
+namespace flykylin {
+namespace services {
+
+/**
+ * @brief Decodes and re-encodes outgoing images on a worker thread
+ *
+ * Lives on FileTransferService's image thread, so decoding a large photo
+ * never stalls the event loop that drives the sockets.
+ *
+ * Previews are decoded straight at their target size (QImageReader's
+ * scaled decode, which JPEG does in the DCT), so a 12 MP photo costs a
+ * fraction of a full decode. loadScaled() offers the same to other
+ * consumers that shrink images anyway (NSFW input, chat bubbles).
+ *
+ * Transcoding shrinks an image before it is sent: down to maxDimension on
+ * its long edge, then re-encoded as JPEG, or as maximally compressed PNG
+ * if it has transparent pixels. The result is kept only if it saves at
+ * least kMinSavingsPercent; animated formats are never touched.
+ */
+class ImageProcessor : public QObject {
+    Q_OBJECT
+
+public:
+    struct Preview {
+        QByteArray data;        ///< JPEG, a few KB
+        QSize originalSize;     ///< Full image, after EXIF rotation
+    };
+
+    struct TranscodeOptions {
+        int maxDimension{2560};     ///< Long edge in pixels, 0 = keep size
+        int quality{85};            ///< JPEG quality
+    };
+
+    struct Transcoded {
+        QString outputPath;         ///< outputBasePath plus ".jpg" or ".png"
+        qint64 originalBytes{0};
+        qint64 outputBytes{0};
+        qint64 encodeMs{0};         ///< Decode, scale and encode
+    };
+
+    explicit ImageProcessor(QObject* parent = nullptr);
+
+    /**
+     * @brief Thumbnail of at most kPreviewMaxEdge pixels on its long edge (any thread)
+     */
+    static bool makePreview(const QString& filePath, Preview* preview);
+
+    /**
+     * @brief Decode filePath no larger than needed to cover minSize (any thread)
+     *
+     * Picks the largest power-of-two reduction, up to the 1/8 JPEG decodes
+     * natively, that keeps both dimensions at least minSize (0 = any); the
+     * caller still does the final resize. Aspect ratio is kept.
+     *
+     * @param originalSize Receives the stored size, if not null
+     */
+    static QImage loadScaled(const QString& filePath, const QSize& minSize, QSize* originalSize = nullptr);
+
+    /**
+     * @brief Write a smaller copy of filePath to outputBasePath + suffix (any thread)
+     * @return false if the image is unsupported or the copy would not be smaller
+     *         (nothing is left on disk then)
+     */
+    static bool transcode(const QString& filePath,
+                          const QString& outputBasePath,
+                          const TranscodeOptions& options,
+                          Transcoded* result);
+
+    static constexpr int kPreviewMaxEdge = 160;
+    static constexpr int kPreviewQuality = 60;
+    static constexpr int kMinSavingsPercent = 10;
+    static constexpr int kMaxDecodeReduction = 8;
+
+public slots:
+    void createPreview(const QString& requestId, const QString& filePath);
+    void transcodeImage(const QString& requestId,
+                        const QString& filePath,
+                        const QString& outputBasePath,
+                        const flykylin::services::ImageProcessor::TranscodeOptions& options);
+
+signals:
+    void previewReady(const QString& requestId,
+                      const QByteArray& data,
+                      const QSize& originalSize,
+                      bool ok);
+    /**
+     * @brief ok = false: send the original (outputPath is empty)
+     */
+    void imageTranscoded(const QString& requestId,
+                         const QString& outputPath,
+                         qint64 originalBytes,
+                         qint64 outputBytes,
+                         qint64 encodeMs,
+                         bool ok);
+};
+
+} // namespace services
+} // namespace flykylin
@@ -0,0 +1,293 @@
+#include "MessageEmbeddingIndexer.h"
+
+#include "MessageVectorIndex.h"
+#include "../ai/EmbeddingCodec.h"
+#include "../ai/TextEmbeddingEngine.h"
+#include "../database/DatabaseService.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSettings>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+
+namespace flykylin {
+namespace services {
+
+using database::DatabaseService;
+
+namespace {
+
+std::atomic<bool> s_stopping{false};
+
+bool semanticSearchEnabled()
+{
+    QSettings settings("FlyKylin", "FlyKylin");
+    return settings.value("search/semanticSearchEnabled", false).toBool();
+}
+
+} // namespace
+
+MessageEmbeddingIndexer* MessageEmbeddingIndexer::instance()
+{
+    static MessageEmbeddingIndexer* s_instance = new MessageEmbeddingIndexer();
+    return s_instance;
+}
+
+MessageEmbeddingIndexer::MessageEmbeddingIndexer(QObject* parent)
+    : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &MessageEmbeddingIndexer::runBatch);
+}
+
+MessageEmbeddingIndexer::~MessageEmbeddingIndexer()
+{
+    stop();
+}
+
+void MessageEmbeddingIndexer::start()
+{
+    if (!m_started) {
+        m_started = true;
+        connect(DatabaseService::instance(), &DatabaseService::messageAppended, this, [this]() {
+            schedule(kAppendDelayMs);
+        });
+        connect(DatabaseService::instance(), &DatabaseService::historyCleared, this,
+                [](const QString& localUserId, const QString& peerId) {
+                    MessageVectorIndex::instance()->removeConversation(localUserId, peerId);
+                });
+        if (auto* app = QCoreApplication::instance()) {
+            connect(app, &QCoreApplication::aboutToQuit, this, &MessageEmbeddingIndexer::stop);
+        }
+    }
+    schedule(kAppendDelayMs);
+}
+
+void MessageEmbeddingIndexer::setEmbedder(const QString& modelVersion, int dimensions, Embedder embed)
+{
+    m_embedder = std::move(embed);
+    m_embedderVersion = modelVersion;
+    m_embedderDimensions = dimensions;
+    m_modelVersion.clear();
+    m_failed.clear();
+    m_unavailable = false;
+}
+
+void MessageEmbeddingIndexer::stop()
+{
+    m_timer.stop();
+    if (!m_thread) {
+        return;
+    }
+    // The worker checks this between two messages rather than finishing its batch
+    s_stopping = true;
+    m_thread->quit();
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+    m_worker = nullptr;
+}
+
+void MessageEmbeddingIndexer::schedule(int delayMs)
+{
+    // A pending run already covers anything appended meanwhile, unless it
+    // is the later retry of failed messages
+    if (!m_unavailable && (!m_timer.isActive() || m_timer.remainingTime() > delayMs)) {
+        m_timer.start(delayMs);
+    }
+}
+
+void MessageEmbeddingIndexer::ensureWorker()
+{
+    if (m_thread) {
+        return;
+    }
+    m_thread = new QThread();
+    m_thread->setObjectName(QStringLiteral("MessageEmbedding"));
+    m_worker = new QObject();
+    m_worker->moveToThread(m_thread);
+    connect(m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    // SCHED_IDLE on Linux: only runs when nothing else wants the CPU
+    m_thread->start(QThread::IdlePriority);
+}
+
+void MessageEmbeddingIndexer::resolveModel()
+{
+    ensureWorker();
+    m_busy = true;
+    // Selecting the backend may load and benchmark models: not on the GUI thread
+    QMetaObject::invokeMethod(m_worker, [this, version = m_embedderVersion, dimensions = m_embedderDimensions]() mutable {
+        if (version.isEmpty()) {
+            auto* engine = ai::TextEmbeddingEngine::instance();
+            const bool available = engine->waitForBackend();
+            version = available ? engine->modelVersion() : QString();
+            dimensions = available ? engine->embeddingDim() : 0;
+        }
+        QMetaObject::invokeMethod(this, [this, version, dimensions]() {
+            if (version.isEmpty()) {
+                m_busy = false;
+                m_unavailable = true;
+                qInfo() << "[MessageEmbeddingIndexer] No embedding backend, messages are not indexed";
+                return;
+            }
+            m_modelVersion = version;
+            auto* db = DatabaseService::instance();
+            db->pruneMessageEmbeddings(m_modelVersion);
+            qInfo() << "[MessageEmbeddingIndexer] Indexing messages with model" << m_modelVersion;
+
+            const QString path =
+                QFileInfo(db->databasePath()).absoluteDir().filePath(QStringLiteral("message_vectors.hnsw"));
+            QMetaObject::invokeMethod(m_worker, [this, path, version, dimensions]() {
+                MessageVectorIndex::instance()->open(path, version, dimensions);
+                QMetaObject::invokeMethod(this, &MessageEmbeddingIndexer::syncIndex, Qt::QueuedConnection);
+            }, Qt::QueuedConnection);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void MessageEmbeddingIndexer::syncIndex()
+{
+    auto* db = DatabaseService::instance();
+    auto* index = MessageVectorIndex::instance();
+
+    // Count and rowid sum come from a covering index: cheap enough to run on every start
+    if (db->messageEmbeddingChecksum(m_modelVersion) != index->checksum()) {
+        const QList<qint64> stored = db->loadMessageEmbeddingRowIds(m_modelVersion);
+        const std::vector<int64_t> indexed = index->rowIds();
+
+        QList<qint64> stale;
+        std::set_difference(indexed.begin(), indexed.end(), stored.begin(), stored.end(),
+                            std::back_inserter(stale));
+        index->remove(stale);
+
+        m_missing.clear();
+        std::set_difference(stored.begin(), stored.end(), indexed.begin(), indexed.end(),
+                            std::back_inserter(m_missing));
+        qInfo() << "[MessageEmbeddingIndexer] Vector index lacks" << m_missing.size() << "and has"
+                << stale.size() << "stale of" << stored.size() << "stored vectors";
+    }
+    syncNext();
+}
+
+void MessageEmbeddingIndexer::syncNext()
+{
+    if (s_stopping) {
+        return;
+    }
+
+    if (m_missing.isEmpty()) {
+        MessageVectorIndex::instance()->setReady();
+        QMetaObject::invokeMethod(m_worker, []() {
+            MessageVectorIndex::instance()->saveIfNeeded();
+        }, Qt::QueuedConnection);
+        m_busy = false;
+        runBatch();
+        return;
+    }
+
+    const QList<qint64> chunk = m_missing.mid(0, kSyncChunk);
+    m_missing = m_missing.mid(chunk.size());
+    const QList<DatabaseService::MessageEmbedding> embeddings =
+        DatabaseService::instance()->loadMessageEmbeddings(chunk);
+    QMetaObject::invokeMethod(m_worker, [this, embeddings]() {
+        MessageVectorIndex::instance()->add(embeddings);
+        QMetaObject::invokeMethod(this, &MessageEmbeddingIndexer::syncNext, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void MessageEmbeddingIndexer::runBatch()
+{
+    if (m_busy || m_unavailable || s_stopping || !semanticSearchEnabled()) {
+        return;
+    }
+    if (m_modelVersion.isEmpty()) {
+        resolveModel();
+        return;
+    }
+
+    // Failed messages stay without a vector; skip them so they do not hold back older ones
+    QList<DatabaseService::PendingEmbedding> pending =
+        DatabaseService::instance()->loadMessagesWithoutEmbedding(m_modelVersion, kBatchSize + m_failed.size());
+    pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                 [this](const DatabaseService::PendingEmbedding& message) {
+                                     return m_failed.contains(message.rowId);
+                                 }),
+                  pending.end());
+    pending = pending.mid(0, kBatchSize);
+    if (pending.isEmpty()) {
+        if (!m_failed.isEmpty()) {
+            qInfo() << "[MessageEmbeddingIndexer] Retrying" << m_failed.size() << "failed messages in"
+                    << kRetryDelayMs / 1000 << "s";
+            m_failed.clear();
+            schedule(kRetryDelayMs);
+        }
+        return;
+    }
+
+    ensureWorker();
+    m_busy = true;
+    const QString version = m_modelVersion;
+    Embedder embed = m_embedder;
+    if (!embed) {
+        embed = [](const QString& text) { return ai::TextEmbeddingEngine::instance()->computeEmbedding(text); };
+    }
+    QMetaObject::invokeMethod(m_worker, [this, pending, version, embed]() {
+        QElapsedTimer timer;
+        timer.start();
+        QList<DatabaseService::MessageEmbedding> embeddings;
+        QList<qint64> failed;
+        embeddings.reserve(pending.size());
+        for (const DatabaseService::PendingEmbedding& message : pending) {
+            if (s_stopping) {
+                return;
+            }
+            // Each call takes the engine on its own, so a search typed meanwhile
+            // waits for one message at most
+            const std::vector<uint8_t> encoded = ai::embedding_codec::encode(embed(message.content));
+            if (encoded.empty()) {
+                failed.append(message.rowId);
+                continue;
+            }
+            DatabaseService::MessageEmbedding embedding;
+            embedding.rowId = message.rowId;
+            embedding.localUserId = message.localUserId;
+            embedding.peerId = message.peerId;
+            embedding.timestamp = message.timestamp;
+            embedding.vector = QByteArray(reinterpret_cast<const char*>(encoded.data()),
+                                          static_cast<int>(encoded.size()));
+            embeddings.append(embedding);
+        }
+        const qint64 elapsedMs = timer.elapsed();
+
+        // Searchable right away; the database write below is what the index
+        // is checked against on the next start
+        MessageVectorIndex::instance()->add(embeddings);
+        MessageVectorIndex::instance()->saveIfNeeded();
+
+        const bool fullBatch = pending.size() == kBatchSize;
+        QMetaObject::invokeMethod(this, [this, embeddings, failed, version, elapsedMs, fullBatch]() {
+            m_busy = false;
+            DatabaseService::instance()->storeMessageEmbeddings(version, embeddings);
+            qInfo() << "[MessageEmbeddingIndexer] Embedded" << embeddings.size() << "messages in" << elapsedMs
+                    << "ms";
+            if (!failed.isEmpty() && version == m_modelVersion) {
+                qWarning() << "[MessageEmbeddingIndexer]" << failed.size() << "messages failed to embed";
+                for (qint64 rowId : failed) {
+                    m_failed.insert(rowId);
+                }
+            }
+            // Also picks up messages appended while this batch ran
+            schedule(fullBatch ? kBackfillDelayMs : kAppendDelayMs);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+} // namespace services
+} // namespace flykylin
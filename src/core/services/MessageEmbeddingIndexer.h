@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+#include <functional>
+#include <vector>
+
+class QThread;
+
+namespace flykylin {
+namespace services {
+
+/**
+ * @brief Embeds stored text messages in the background for semantic search
+ *
+ * After DatabaseService::appendMessage (debounced, so a burst of messages is
+ * one batch) the indexer takes up to kBatchSize text messages that have no
+ * vector for the current embedding model, newest first, embeds them on an
+ * idle-priority thread and stores the vectors in one transaction. Full
+ * batches are followed by the next one, which also works through history
+ * stored before the indexer existed.
+ *
+ * Runs only while semantic search is enabled (search/semanticSearchEnabled)
+ * and an embedding backend is available. Vectors from another model version
+ * and of deleted messages are pruned when the indexer first runs. A message
+ * whose embedding fails stores nothing: it is skipped until the rest is done
+ * and tried again kRetryDelayMs later.
+ *
+ * Every vector also goes into MessageVectorIndex. When the indexer first
+ * runs it opens the saved index and adds whatever the database has and the
+ * index lacks (in chunks, between which the GUI thread stays responsive);
+ * only then does the index answer searches.
+ */
+class MessageEmbeddingIndexer : public QObject {
+    Q_OBJECT
+public:
+    static MessageEmbeddingIndexer* instance();
+
+    /**
+     * @brief Follow appended messages and catch up on history; call again after enabling semantic search
+     */
+    void start();
+
+    /// Empty result = failed
+    using Embedder = std::function<std::vector<float>(const QString& text)>;
+
+    /**
+     * @brief Embed with this function as modelVersion instead of TextEmbeddingEngine (tests)
+     *
+     * The model is resolved again on the next run, as after a model change.
+     */
+    void setEmbedder(const QString& modelVersion, int dimensions, Embedder embed);
+
+    static constexpr int kBatchSize = 32;
+    static constexpr int kAppendDelayMs = 2000;     ///< Debounce after appendMessage
+    static constexpr int kBackfillDelayMs = 200;    ///< Pause between full batches
+    static constexpr int kSyncChunk = 256;          ///< Vectors read per step when catching up the index
+    static constexpr int kRetryDelayMs = 60000;     ///< Before failed messages are tried again
+
+private:
+    explicit MessageEmbeddingIndexer(QObject* parent = nullptr);
+    ~MessageEmbeddingIndexer() override;
+
+    void stop();
+    void schedule(int delayMs);
+    void runBatch();
+    void resolveModel();
+    void syncIndex();
+    void syncNext();
+    void ensureWorker();
+
+    QTimer m_timer;
+    QThread* m_thread{nullptr};
+    QObject* m_worker{nullptr};     ///< Lives on m_thread; embedding runs there
+    QString m_modelVersion;         ///< Empty until the engine was checked
+    QList<qint64> m_missing;        ///< Stored vectors the index still lacks
+    QSet<qint64> m_failed;          ///< Failed since the last retry, skipped meanwhile
+    Embedder m_embedder;            ///< Replaces the engine if set
+    QString m_embedderVersion;
+    int m_embedderDimensions{0};
+    bool m_started{false};
+    bool m_busy{false};
+    bool m_unavailable{false};      ///< No embedding backend: stop trying
+};
+
+} // namespace services
+} // namespace flykylin
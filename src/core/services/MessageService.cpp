@@ -6,6 +6,7 @@
  */
 
 #include "MessageService.h"
+#include "AttachmentStore.h"
 #include "../config/UserProfile.h"
 #include "../database/DatabaseService.h"
 #include <QDebug>
@@ -52,6 +53,23 @@ MessageService::MessageService(QObject* parent)
                     emit messageReceived(message);
                 }
             });
+    connect(m_fileTransferService, &FileTransferService::messageFailed,
+            this, [this](const core::Message& message, const QString& error) {
+                storeMessage(message);
+                emit messageFailed(message, error);
+            });
+    connect(m_fileTransferService, &FileTransferService::transferQueued,
+            this, &MessageService::transferQueued);
+    connect(m_fileTransferService, &FileTransferService::transferRatesUpdated,
+            this, &MessageService::transferRatesUpdated);
+    connect(m_fileTransferService, &FileTransferService::transferProgress,
+            this, &MessageService::transferProgress);
+    connect(m_fileTransferService, &FileTransferService::memberTransferProgress,
+            this, &MessageService::memberTransferProgress);
+    connect(m_fileTransferService, &FileTransferService::imagePreviewReceived,
+            this, &MessageService::imagePreviewReceived);
+    connect(m_fileTransferService, &FileTransferService::transferFailed,
+            this, &MessageService::transferFailed);
     
     qInfo() << "[MessageService] Initialized for user" << m_localUserId 
             << "with Echo Bot support";
@@ -226,27 +244,30 @@ void MessageService::sendGroupImageMessage(const QString& groupId,
         return;
     }
 
-    const QString groupMessageId = core::Message::generateMessageId();
+    if (!m_fileTransferService) {
+        qWarning() << "[MessageService] FileTransferService is null";
+        return;
+    }
 
+    QStringList targets;
     for (const QString& peerId : memberIds) {
         if (peerId.isEmpty() || peerId == LocalEchoService::getEchoBotId()) {
             continue;
         }
+        targets.append(peerId);
+    }
+    if (targets.isEmpty()) {
+        return;
+    }
 
-        qInfo() << "[MessageService] Sending group image to" << peerId << "group" << groupId
-                << "path=" << filePath;
-
-        if (!m_fileTransferService) {
-            qWarning() << "[MessageService] FileTransferService is null";
-            return;
-        }
+    qInfo() << "[MessageService] Sending group image to" << targets.size() << "members of group"
+            << groupId << "path=" << filePath;
 
-        m_fileTransferService->sendImage(peerId,
-                                         filePath,
-                                         true,   // isGroup
-                                         groupId,
-                                         groupMessageId);
-    }
+    // One read of the file shared by all members
+    m_fileTransferService->sendGroupImage(targets,
+                                          filePath,
+                                          groupId,
+                                          core::Message::generateMessageId());
 }
 
 void MessageService::sendGroupFileMessage(const QString& groupId,
@@ -268,27 +289,29 @@ void MessageService::sendGroupFileMessage(const QString& groupId,
         return;
     }
 
-    const QString groupMessageId = core::Message::generateMessageId();
+    if (!m_fileTransferService) {
+        qWarning() << "[MessageService] FileTransferService is null";
+        return;
+    }
 
+    QStringList targets;
     for (const QString& peerId : memberIds) {
         if (peerId.isEmpty() || peerId == LocalEchoService::getEchoBotId()) {
             continue;
         }
+        targets.append(peerId);
+    }
+    if (targets.isEmpty()) {
+        return;
+    }
 
-        qInfo() << "[MessageService] Sending group file to" << peerId << "group" << groupId
-                << "path=" << filePath;
-
-        if (!m_fileTransferService) {
-            qWarning() << "[MessageService] FileTransferService is null";
-            return;
-        }
+    qInfo() << "[MessageService] Sending group file to" << targets.size() << "members of group"
+            << groupId << "path=" << filePath;
 
-        m_fileTransferService->sendFile(peerId,
-                                        filePath,
-                                        true,   // isGroup
-                                        groupId,
-                                        groupMessageId);
-    }
+    m_fileTransferService->sendGroupFile(targets,
+                                         filePath,
+                                         groupId,
+                                         core::Message::generateMessageId());
 }
 
 void MessageService::relayGroupFileMessage(const core::Message& originalMessage,
@@ -319,27 +342,24 @@ void MessageService::relayGroupFileMessage(const core::Message& originalMessage,
     const QString logicalId = originalMessage.id();
     const bool asImage = (originalMessage.kind() == core::MessageKind::Image);
 
+    QStringList targets;
     for (const QString& peerId : relayTargets) {
         if (peerId.isEmpty() || peerId == LocalEchoService::getEchoBotId()) {
             continue;
         }
+        targets.append(peerId);
+    }
+    if (targets.isEmpty()) {
+        return;
+    }
 
-        qInfo() << "[MessageService] Relaying group" << (asImage ? "image" : "file")
-                << logicalId << "for group" << groupId << "to" << peerId;
-
-        if (asImage) {
-            m_fileTransferService->sendImage(peerId,
-                                             filePath,
-                                             true,   // isGroup
-                                             groupId,
-                                             logicalId);
-        } else {
-            m_fileTransferService->sendFile(peerId,
-                                            filePath,
-                                            true,   // isGroup
-                                            groupId,
-                                            logicalId);
-        }
+    qInfo() << "[MessageService] Relaying group" << (asImage ? "image" : "file")
+            << logicalId << "for group" << groupId << "to" << targets;
+
+    if (asImage) {
+        m_fileTransferService->sendGroupImage(targets, filePath, groupId, logicalId);
+    } else {
+        m_fileTransferService->sendGroupFile(targets, filePath, groupId, logicalId);
     }
 }
 
@@ -373,6 +393,19 @@ void MessageService::sendFileMessage(const QString& peerId, const QString& fileP
     m_fileTransferService->sendFile(peerId, filePath);
 }
 
+void MessageService::pauseTransfer(const QString& messageId) {
+    m_fileTransferService->pauseTransfer(messageId);
+}
+
+void MessageService::resumeTransfer(const QString& messageId) {
+    m_fileTransferService->resumeTransfer(messageId);
+}
+
+void MessageService::cancelTransfer(const QString& messageId) {
+    qInfo() << "[MessageService] Cancelling transfer" << messageId;
+    m_fileTransferService->cancelTransfer(messageId);
+}
+
 QList<core::Message> MessageService::getMessageHistory(const QString& peerId) const {
     // Prefer persistent history from database; fall back to in-memory cache
     QList<core::Message> fromDb = DatabaseService::instance()->loadMessages(m_localUserId, peerId);
@@ -434,6 +467,8 @@ QList<core::Message> MessageService::getGroupMessagesBefore(const QString& group
 void MessageService::clearHistory(const QString& peerId) {
     m_messageHistory.remove(peerId);
     DatabaseService::instance()->clearHistory(m_localUserId, peerId);
+    // Attachments only those messages referred to leave the content store
+    AttachmentStore::instance()->collectGarbage();
     qInfo() << "[MessageService] Cleared history for" << peerId;
 }
 
@@ -60,6 +60,14 @@ public:
     void relayGroupFileMessage(const core::Message& originalMessage,
                                const QStringList& relayTargets);
     
+    /**
+     * @brief Pause/resume/cancel the outgoing transfer of an image/file message
+     * @param messageId Message ID (all members for a group message)
+     */
+    void pauseTransfer(const QString& messageId);
+    void resumeTransfer(const QString& messageId);
+    void cancelTransfer(const QString& messageId);
+    
     /**
      * @brief Get message history with a peer
      * @param peerId Peer ID
@@ -101,6 +109,52 @@ signals:
      */
     void messageFailed(const flykylin::core::Message& message, const QString& error);
     
+    /**
+     * @brief Outgoing image/file waits for a transfer slot (0 = started)
+     * @param messageId Message ID of the image/file message
+     * @param position Place in the queue, 1 = next
+     */
+    void transferQueued(const QString& messageId, int position);
+    
+    /**
+     * @brief Live upload rates (about once a second while sending)
+     * @param totalBytesPerSecond All outgoing transfers together
+     * @param rates Message ID -> bytes/s
+     */
+    void transferRatesUpdated(double totalBytesPerSecond, const QVariantMap& rates);
+    
+    /**
+     * @brief Outgoing image/file progress (a few times a second)
+     * @param messageId Message ID; group messages sum all members
+     * @param etaMs Estimated time remaining, -1 if unknown
+     */
+    void transferProgress(const QString& messageId,
+                          quint64 bytesSent,
+                          quint64 totalBytes,
+                          double bytesPerSecond,
+                          qint64 etaMs);
+    
+    /**
+     * @brief Progress of one member of a group image/file message
+     */
+    void memberTransferProgress(const QString& messageId,
+                                const QString& peerId,
+                                quint64 bytesSent,
+                                quint64 totalBytes);
+    
+    /**
+     * @brief Thumbnail of an incoming image still in transit (not stored)
+     * @param message Status Sending, attachment = preview; messageReceived with the same ID follows
+     *        (or transferFailed if the full image fails, is rejected or cancelled)
+     */
+    void imagePreviewReceived(const flykylin::core::Message& message);
+    
+    /**
+     * @brief An image/file transfer ended without delivering the file
+     * @param messageId Message ID (for incoming transfers, the ID of its preview, if any)
+     */
+    void transferFailed(const QString& messageId, const QString& error);
+    
 private slots:
     void onTcpMessageReceived(QString peerId, QByteArray data);
     void onTcpMessageSent(QString peerId, quint64 messageId);
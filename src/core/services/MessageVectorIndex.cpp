@@ -0,0 +1,256 @@
+#include "MessageVectorIndex.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <mutex>
+
+namespace flykylin {
+namespace services {
+
+namespace {
+
+// The whole file is rewritten each time, so wait for at least this many
+// changes and a tenth of the index
+constexpr qint64 kMinChangesToSave = 500;
+constexpr qint64 kSaveFraction = 10;
+
+} // namespace
+
+MessageVectorIndex* MessageVectorIndex::instance()
+{
+    static MessageVectorIndex s_instance;
+    return &s_instance;
+}
+
+std::unique_ptr<ai::HnswIndex> MessageVectorIndex::load(const QString& path)
+{
+    auto file = std::make_shared<QFile>(path);
+    if (!file->exists()) {
+        return nullptr;
+    }
+    if (!file->open(QIODevice::ReadOnly)) {
+        qWarning() << "[MessageVectorIndex] Failed to open" << path << ":" << file->errorString();
+        return nullptr;
+    }
+    const auto size = static_cast<std::size_t>(file->size());
+
+#ifdef Q_OS_WIN
+    // A mapped file cannot be replaced on Windows, and saving replaces it
+    auto bytes = std::make_shared<std::vector<uint8_t>>(size);
+    if (file->read(reinterpret_cast<char*>(bytes->data()), file->size()) != file->size()) {
+        qWarning() << "[MessageVectorIndex] Failed to read" << path << ":" << file->errorString();
+        return nullptr;
+    }
+    uint8_t* data = bytes->data();
+    std::shared_ptr<void> storage = bytes;
+#else
+    // Private mapping: adding entries rewrites link lists of loaded entries
+    // in memory only, the file changes when it is saved
+    uint8_t* data = file->map(0, file->size(), QFileDevice::MapPrivateOption);
+    if (!data) {
+        qWarning() << "[MessageVectorIndex] Failed to map" << path << ":" << file->errorString();
+        return nullptr;
+    }
+    std::shared_ptr<void> storage = file;
+#endif
+
+    std::string error;
+    std::unique_ptr<ai::HnswIndex> index = ai::HnswIndex::load(data, size, storage, &error);
+    if (!index) {
+        qWarning() << "[MessageVectorIndex] Ignoring" << path << ":" << QString::fromStdString(error);
+    }
+    return index;
+}
+
+void MessageVectorIndex::open(const QString& path, const QString& modelVersion, int dimensions)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    std::unique_ptr<ai::HnswIndex> index = load(path);
+    if (index && (index->label() != modelVersion.toStdString() ||
+                  index->dimensions() != static_cast<std::size_t>(dimensions))) {
+        qInfo() << "[MessageVectorIndex] Saved index is for model" << QString::fromStdString(index->label())
+                << ", starting over";
+        index.reset();
+    }
+
+    qint64 unsavedChanges = 0;
+    if (index && index->removedCount() > index->size()) {
+        // Searches would mostly pass through removed entries
+        qInfo() << "[MessageVectorIndex] Compacting," << index->removedCount() << "removed and"
+                << index->size() << "remaining entries";
+        index = index->compacted();
+        unsavedChanges = static_cast<qint64>(index->size());
+    }
+
+    if (index) {
+        qInfo() << "[MessageVectorIndex] Loaded" << index->size() << "entries from" << path << "in"
+                << timer.elapsed() << "ms";
+    } else {
+        index = std::make_unique<ai::HnswIndex>(static_cast<std::size_t>(dimensions));
+        index->setLabel(modelVersion.toStdString());
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_index = std::move(index);
+    m_path = path;
+    m_modelVersion = modelVersion;
+    m_ready = false;
+    m_unsavedChanges = unsavedChanges;
+}
+
+bool MessageVectorIndex::isReady(const QString& modelVersion) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_ready && m_index && m_modelVersion == modelVersion;
+}
+
+void MessageVectorIndex::setReady()
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_ready = m_index != nullptr;
+}
+
+QPair<qint64, qint64> MessageVectorIndex::checksum() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (!m_index) {
+        return qMakePair(qint64(0), qint64(0));
+    }
+    return qMakePair(static_cast<qint64>(m_index->size()), static_cast<qint64>(m_index->rowIdSum()));
+}
+
+std::vector<int64_t> MessageVectorIndex::rowIds() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_index ? m_index->rowIds() : std::vector<int64_t>();
+}
+
+void MessageVectorIndex::add(const QList<database::DatabaseService::MessageEmbedding>& embeddings)
+{
+    for (const auto& embedding : embeddings) {
+        // One entry at a time, so a search typed meanwhile waits for one insert at most
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (!m_index) {
+            return;
+        }
+        const bool added = m_index->add(embedding.rowId,
+                                        embedding.localUserId.toStdString(),
+                                        embedding.peerId.toStdString(),
+                                        embedding.timestamp,
+                                        reinterpret_cast<const uint8_t*>(embedding.vector.constData()),
+                                        static_cast<std::size_t>(embedding.vector.size()));
+        if (added) {
+            ++m_unsavedChanges;
+        }
+    }
+}
+
+void MessageVectorIndex::remove(const QList<qint64>& rowIds)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (!m_index) {
+        return;
+    }
+    for (qint64 rowId : rowIds) {
+        if (m_index->remove(rowId)) {
+            ++m_unsavedChanges;
+        }
+    }
+}
+
+void MessageVectorIndex::removeConversation(const QString& localUserId, const QString& peerId)
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (!m_index) {
+        return;
+    }
+    const std::size_t removed = m_index->removeConversation(localUserId.toStdString(), peerId.toStdString());
+    m_unsavedChanges += static_cast<qint64>(removed);
+    if (removed > 0) {
+        qInfo() << "[MessageVectorIndex] Removed" << removed << "entries of" << peerId;
+    }
+}
+
+std::vector<MessageVectorIndex::Hit> MessageVectorIndex::search(const std::vector<float>& unitQuery,
+                                                                int limit,
+                                                                const QString& localUserId,
+                                                                const QString& peerId,
+                                                                qint64 fromMs,
+                                                                qint64 toMs) const
+{
+    ai::HnswIndex::Filter filter;
+    filter.ownerId = localUserId.toStdString();
+    filter.peerId = peerId.toStdString();
+    if (fromMs > 0) {
+        filter.fromMs = fromMs;
+    }
+    if (toMs > 0) {
+        filter.toMs = toMs;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (!m_index || limit <= 0) {
+        return {};
+    }
+    return m_index->search(unitQuery, static_cast<std::size_t>(limit), filter);
+}
+
+void MessageVectorIndex::saveIfNeeded()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QString path;
+    qint64 savedChanges = 0;
+    QByteArray snapshot;
+    {
+        // Copy out under the shared lock only; removeConversation() waits
+        // for it on the GUI thread, so the disk write happens without it
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        if (!m_index || m_path.isEmpty() ||
+            m_unsavedChanges < std::max(kMinChangesToSave, static_cast<qint64>(m_index->size()) / kSaveFraction)) {
+            return;
+        }
+        const bool copied = m_index->save([&snapshot](const void* data, std::size_t size) {
+            snapshot.append(static_cast<const char*>(data), static_cast<int>(size));
+            return true;
+        });
+        if (!copied) {
+            qWarning() << "[MessageVectorIndex] Failed to serialise the index";
+            return;
+        }
+        path = m_path;
+        savedChanges = m_unsavedChanges;
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(snapshot) != snapshot.size() || !file.commit()) {
+        qWarning() << "[MessageVectorIndex] Failed to save" << path << ":" << file.errorString();
+        return;
+    }
+    snapshot.clear();
+
+    // Search the file just written: its pages are clean and the kernel can
+    // drop them under memory pressure, unlike entries added in memory
+    std::unique_ptr<ai::HnswIndex> saved = load(path);
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (saved && m_path == path && m_unsavedChanges == savedChanges) {
+        m_index = std::move(saved);
+        m_unsavedChanges = 0;
+    } else {
+        m_unsavedChanges = std::max<qint64>(0, m_unsavedChanges - savedChanges);
+    }
+    qInfo() << "[MessageVectorIndex] Saved" << m_index->size() << "entries to" << path << "in"
+            << timer.elapsed() << "ms";
+}
+
+} // namespace services
+} // namespace flykylin
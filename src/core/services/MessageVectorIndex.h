@@ -0,0 +1,91 @@
+#pragma once
+
+#include "core/ai/HnswIndex.h"
+#include "core/database/DatabaseService.h"
+
+#include <QList>
+#include <QPair>
+#include <QString>
+
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+namespace flykylin {
+namespace services {
+
+/**
+ * @brief HNSW index over the message vectors, memory-mapped from disk
+ *
+ * Mirrors message_embeddings so a semantic search only walks a small part
+ * of the graph instead of scanning every stored vector. MessageEmbeddingIndexer
+ * opens it, brings it in line with the database and adds what it embeds;
+ * ChatSearchService uses it once isReady() says so, and scans the database
+ * before that.
+ *
+ * The file (message_vectors.hnsw next to the chat database) is mapped
+ * copy-on-write and searched in place. It is rewritten only after many
+ * changes: whatever is missing at the next start is re-added from the
+ * database, which is cheaper than writing the whole file often.
+ *
+ * Safe to use from any thread: searches share a lock, changes take it alone.
+ */
+class MessageVectorIndex {
+public:
+    using Hit = ai::HnswIndex::Hit;
+
+    static MessageVectorIndex* instance();
+
+    /**
+     * @brief Map the saved index for modelVersion, or start empty if there is none
+     *
+     * May take long (compaction after many removals); not on the GUI thread.
+     */
+    void open(const QString& path, const QString& modelVersion, int dimensions);
+
+    /**
+     * @brief The index holds every vector of modelVersion and can be searched
+     */
+    bool isReady(const QString& modelVersion) const;
+    void setReady();
+
+    /**
+     * @brief Entry count and rowid sum, compared with DatabaseService::messageEmbeddingChecksum
+     */
+    QPair<qint64, qint64> checksum() const;
+    std::vector<int64_t> rowIds() const;
+
+    void add(const QList<database::DatabaseService::MessageEmbedding>& embeddings);
+    void remove(const QList<qint64>& rowIds);
+    void removeConversation(const QString& localUserId, const QString& peerId);
+
+    /**
+     * @param fromMs,toMs Time range; 0 leaves that end open
+     */
+    std::vector<Hit> search(const std::vector<float>& unitQuery,
+                            int limit,
+                            const QString& localUserId,
+                            const QString& peerId,
+                            qint64 fromMs,
+                            qint64 toMs) const;
+
+    /**
+     * @brief Rewrite the file once enough has changed since it was written
+     */
+    void saveIfNeeded();
+
+private:
+    MessageVectorIndex() = default;
+
+    static std::unique_ptr<ai::HnswIndex> load(const QString& path);
+
+    mutable std::shared_mutex m_mutex;
+    std::unique_ptr<ai::HnswIndex> m_index;     ///< Null until opened
+    QString m_path;
+    QString m_modelVersion;
+    bool m_ready{false};
+    qint64 m_unsavedChanges{0};
+};
+
+} // namespace services
+} // namespace flykylin
@@ -0,0 +1,71 @@
+#include "StripeController.h"
+
+#include <algorithm>
+
+namespace flykylin {
+namespace services {
+
+StripeController::StripeController(int maxStripes, int initialStripes)
+    : m_maxStripes(std::max(1, maxStripes))
+    , m_stripes(std::clamp(initialStripes, 1, m_maxStripes))
+    , m_baseStripes(m_stripes)
+{
+}
+
+int StripeController::addSample(uint64_t bytes, int64_t elapsedMs)
+{
+    m_sampleBytes += bytes;
+    m_sampleMs += std::max<int64_t>(elapsedMs, 0);
+    if (m_sampleMs < kSampleMs) {
+        return m_stripes;
+    }
+
+    const double rate = static_cast<double>(m_sampleBytes) * 1000.0
+                      / static_cast<double>(m_sampleMs);
+    m_sampleBytes = 0;
+    m_sampleMs = 0;
+    evaluate(rate);
+    return m_stripes;
+}
+
+void StripeController::evaluate(double rate)
+{
+    if (m_probing) {
+        m_probing = false;
+        if (rate >= m_baseRate * (1.0 + kMinGain)) {
+            // The extra stripe paid off: keep it and try the next one
+            m_baseRate = rate;
+            startProbe();
+        } else {
+            m_stripes = m_baseStripes;
+            m_stableSamples = 0;
+        }
+        return;
+    }
+
+    if (m_baseRate <= 0.0) {
+        m_baseRate = rate;
+        startProbe();
+        return;
+    }
+
+    // Smooth so one noisy window does not decide the next probe
+    m_baseRate = 0.5 * m_baseRate + 0.5 * rate;
+    if (++m_stableSamples >= kReprobeSamples) {
+        m_stableSamples = 0;
+        startProbe();
+    }
+}
+
+void StripeController::startProbe()
+{
+    if (m_stripes >= m_maxStripes) {
+        return;
+    }
+    m_baseStripes = m_stripes;
+    ++m_stripes;
+    m_probing = true;
+}
+
+} // namespace services
+} // namespace flykylin
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+namespace flykylin {
+namespace services {
+
+/**
+ * @brief Picks the number of parallel connections for a striped transfer
+ *
+ * Hill climbing on measured throughput: after each sample window the
+ * controller tries one more stripe and keeps it only if throughput grew by
+ * at least kMinGain; otherwise it goes back and stays there, trying again
+ * every kReprobeSamples windows in case conditions changed. On a fast LAN
+ * this settles at one or two stripes; with latency or loss, where a single
+ * TCP stream is window-bound, it climbs towards maxStripes.
+ */
+class StripeController {
+public:
+    explicit StripeController(int maxStripes = 4, int initialStripes = 2);
+
+    /**
+     * @brief Account bytes handed to the connections
+     * @param bytes Bytes sent since the previous call
+     * @param elapsedMs Time since the previous call
+     * @return Stripe count to use from now on
+     */
+    int addSample(uint64_t bytes, int64_t elapsedMs);
+
+    int stripes() const { return m_stripes; }
+    int maxStripes() const { return m_maxStripes; }
+
+    /**
+     * @brief Throughput (bytes/s) at the current stripe count, 0 until measured
+     */
+    double rate() const { return m_baseRate; }
+
+    static constexpr int64_t kSampleMs = 500;
+    static constexpr double kMinGain = 0.10;
+    static constexpr int kReprobeSamples = 8;
+
+private:
+    void evaluate(double rate);
+    void startProbe();
+
+    int m_maxStripes;
+    int m_stripes;
+    int m_baseStripes;          ///< Stripe count before the current probe
+    double m_baseRate{0.0};     ///< Throughput at m_baseStripes
+    bool m_probing{false};
+    int m_stableSamples{0};
+    uint64_t m_sampleBytes{0};
+    int64_t m_sampleMs{0};
+};
+
+} // namespace services
+} // namespace flykylin
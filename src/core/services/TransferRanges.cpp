@@ -0,0 +1,146 @@
+#include "TransferRanges.h"
+
+#include "core/communication/Crc32c.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <iterator>
+
+namespace flykylin {
+namespace services {
+
+bool TransferRanges::add(uint64_t offset, uint64_t length, uint32_t crc)
+{
+    if (length == 0) {
+        return true;
+    }
+
+    const uint64_t end = offset + length;
+    auto next = m_spans.lower_bound(offset);
+    if (next != m_spans.end() && next->first < end) {
+        return false;
+    }
+    if (next != m_spans.begin()) {
+        auto prev = std::prev(next);
+        if (prev->second.end > offset) {
+            return false;
+        }
+        if (prev->second.end == offset) {
+            prev->second.crc = communication::crc32cCombine(prev->second.crc, crc, length);
+            prev->second.end = end;
+            if (next != m_spans.end() && next->first == end) {
+                prev->second.crc = communication::crc32cCombine(
+                    prev->second.crc, next->second.crc, next->second.end - next->first);
+                prev->second.end = next->second.end;
+                m_spans.erase(next);
+            }
+            return true;
+        }
+    }
+
+    Span span;
+    span.end = end;
+    span.crc = crc;
+    if (next != m_spans.end() && next->first == end) {
+        span.crc = communication::crc32cCombine(crc, next->second.crc,
+                                                next->second.end - next->first);
+        span.end = next->second.end;
+        m_spans.erase(next);
+    }
+    m_spans.emplace(offset, span);
+    return true;
+}
+
+std::vector<ByteRange> TransferRanges::missing(uint64_t totalSize) const
+{
+    std::vector<ByteRange> gaps;
+    uint64_t cursor = 0;
+    for (const auto& entry : m_spans) {
+        if (entry.first >= totalSize) {
+            break;
+        }
+        if (entry.first > cursor) {
+            gaps.push_back(ByteRange{cursor, entry.first - cursor});
+        }
+        if (entry.second.end > cursor) {
+            cursor = entry.second.end;
+        }
+    }
+    if (cursor < totalSize) {
+        gaps.push_back(ByteRange{cursor, totalSize - cursor});
+    }
+    return gaps;
+}
+
+uint64_t TransferRanges::coveredBytes() const
+{
+    uint64_t total = 0;
+    for (const auto& entry : m_spans) {
+        total += entry.second.end - entry.first;
+    }
+    return total;
+}
+
+bool TransferRanges::isComplete(uint64_t totalSize) const
+{
+    if (totalSize == 0) {
+        return true;
+    }
+    return m_spans.size() == 1 && m_spans.begin()->first == 0
+        && m_spans.begin()->second.end >= totalSize;
+}
+
+bool TransferRanges::wholeCrc(uint64_t totalSize, uint32_t& crc) const
+{
+    if (totalSize == 0) {
+        crc = 0;
+        return true;
+    }
+    if (!isComplete(totalSize) || m_spans.begin()->second.end != totalSize) {
+        return false;
+    }
+    crc = m_spans.begin()->second.crc;
+    return true;
+}
+
+std::string TransferRanges::serialize() const
+{
+    std::string text;
+    char buf[64];
+    for (const auto& entry : m_spans) {
+        std::snprintf(buf, sizeof(buf), "%" PRIu64 "-%" PRIu64 "-%08" PRIx32,
+                      entry.first, entry.second.end, entry.second.crc);
+        if (!text.empty()) {
+            text += ',';
+        }
+        text += buf;
+    }
+    return text;
+}
+
+bool TransferRanges::deserialize(const std::string& text, TransferRanges& out)
+{
+    out.clear();
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        std::size_t comma = text.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = text.size();
+        }
+        const std::string item = text.substr(pos, comma - pos);
+
+        uint64_t start = 0;
+        uint64_t end = 0;
+        uint32_t crc = 0;
+        if (std::sscanf(item.c_str(), "%" SCNu64 "-%" SCNu64 "-%" SCNx32, &start, &end, &crc) != 3
+            || end <= start || !out.add(start, end - start, crc)) {
+            out.clear();
+            return false;
+        }
+        pos = comma + 1;
+    }
+    return true;
+}
+
+} // namespace services
+} // namespace flykylin
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace flykylin {
+namespace services {
+
+struct ByteRange {
+    uint64_t offset{0};
+    uint64_t length{0};
+};
+
+/**
+ * @brief Byte ranges of a file that have been received (or sent) and verified
+ *
+ * Adjacent ranges are merged and their CRC32C values combined, so once the
+ * whole file is covered the whole-file CRC32C is available without reading
+ * the file back. Serializable for persisting partial transfers.
+ */
+class TransferRanges {
+public:
+    /**
+     * @brief Record [offset, offset+length) with the CRC32C of its bytes
+     * @return false if the range overlaps recorded data (nothing recorded)
+     */
+    bool add(uint64_t offset, uint64_t length, uint32_t crc);
+
+    /**
+     * @brief Gaps in [0, totalSize), in offset order
+     */
+    std::vector<ByteRange> missing(uint64_t totalSize) const;
+
+    uint64_t coveredBytes() const;
+    bool isComplete(uint64_t totalSize) const;
+
+    /**
+     * @brief CRC32C of the whole file, if [0, totalSize) is covered
+     */
+    bool wholeCrc(uint64_t totalSize, uint32_t& crc) const;
+
+    void clear() { m_spans.clear(); }
+    bool isEmpty() const { return m_spans.empty(); }
+
+    /**
+     * @brief Text form "start-end-crc,..." (hex crc) for the database
+     */
+    std::string serialize() const;
+    static bool deserialize(const std::string& text, TransferRanges& out);
+
+private:
+    struct Span {
+        uint64_t end{0};
+        uint32_t crc{0};
+    };
+
+    std::map<uint64_t, Span> m_spans;   ///< start -> span
+};
+
+} // namespace services
+} // namespace flykylin
@@ -0,0 +1,299 @@
+#include "TransferScheduler.h"
+
+#include <algorithm>
+#include <set>
+
+namespace flykylin {
+namespace services {
+
+void TokenBucket::configure(uint64_t bytesPerSecond, uint64_t burstBytes, int64_t nowMs)
+{
+    const bool wasLimited = limited();
+    refill(nowMs);
+
+    m_rate = static_cast<double>(bytesPerSecond) / 1000.0;
+    m_burst = static_cast<double>(burstBytes);
+    m_lastMs = nowMs;
+    // A new limit starts with a full bucket; a changed one keeps its debt
+    m_tokens = wasLimited ? std::min(m_tokens, m_burst) : m_burst;
+}
+
+int64_t TokenBucket::waitMs(int64_t nowMs)
+{
+    if (!limited()) {
+        return 0;
+    }
+    refill(nowMs);
+    if (m_tokens > 0.0) {
+        return 0;
+    }
+    return static_cast<int64_t>(-m_tokens / m_rate) + 1;
+}
+
+void TokenBucket::consume(uint64_t bytes, int64_t nowMs)
+{
+    if (!limited()) {
+        return;
+    }
+    refill(nowMs);
+    m_tokens -= static_cast<double>(bytes);
+}
+
+void TokenBucket::refill(int64_t nowMs)
+{
+    if (!limited()) {
+        return;
+    }
+    const int64_t elapsedMs = std::max<int64_t>(nowMs - m_lastMs, 0);
+    m_tokens = std::min(m_burst, m_tokens + static_cast<double>(elapsedMs) * m_rate);
+    m_lastMs = nowMs;
+}
+
+void RateMeter::add(uint64_t bytes, int64_t nowMs)
+{
+    roll(nowMs);
+    m_windowBytes += bytes;
+}
+
+double RateMeter::rate(int64_t nowMs)
+{
+    roll(nowMs);
+    if (m_rate == 0.0 && nowMs > m_windowStartMs) {
+        // First window still open: estimate from what we have
+        return static_cast<double>(m_windowBytes) * 1000.0
+             / static_cast<double>(nowMs - m_windowStartMs);
+    }
+    return m_rate;
+}
+
+void RateMeter::roll(int64_t nowMs)
+{
+    if (!m_started) {
+        m_started = true;
+        m_windowStartMs = nowMs;
+        return;
+    }
+
+    const int64_t elapsedMs = nowMs - m_windowStartMs;
+    if (elapsedMs < kWindowMs) {
+        return;
+    }
+
+    const double windowRate = static_cast<double>(m_windowBytes) * 1000.0
+                            / static_cast<double>(elapsedMs);
+    // Smooth over adjacent windows; after a long idle gap the old rate is meaningless
+    m_rate = (m_rate == 0.0 || elapsedMs >= 3 * kWindowMs) ? windowRate
+                                                           : 0.5 * m_rate + 0.5 * windowRate;
+    m_windowStartMs = nowMs;
+    m_windowBytes = 0;
+}
+
+void TransferScheduler::setLimits(const Limits& limits, int64_t nowMs)
+{
+    m_limits = limits;
+    m_globalBucket.configure(limits.globalBytesPerSecond, burstFor(limits.globalBytesPerSecond), nowMs);
+    for (auto& peer : m_peerBuckets) {
+        peer.second.configure(limits.peerBytesPerSecond, burstFor(limits.peerBytesPerSecond), nowMs);
+    }
+}
+
+void TransferScheduler::add(const std::string& key,
+                            const std::string& peer,
+                            TransferPriority priority,
+                            const std::string& slot)
+{
+    if (contains(key)) {
+        return;
+    }
+
+    Entry entry;
+    entry.peer = peer;
+    entry.slot = slot;
+    entry.priority = priority;
+    entry.sequence = m_nextSequence++;
+    m_entries.emplace(key, entry);
+}
+
+void TransferScheduler::remove(const std::string& key)
+{
+    m_entries.erase(key);
+}
+
+std::vector<std::string> TransferScheduler::admit()
+{
+    std::vector<std::string> started;
+    for (const std::string& key : queued()) {
+        Entry& entry = m_entries.at(key);
+        const std::string slot = slotOf(key, entry);
+        if (slotActive(slot) || m_limits.maxActive <= 0
+            || activeSlots(entry.priority) < m_limits.maxActive) {
+            entry.active = true;
+            started.push_back(key);
+        }
+    }
+    return started;
+}
+
+bool TransferScheduler::isActive(const std::string& key) const
+{
+    auto it = m_entries.find(key);
+    return it != m_entries.end() && it->second.active;
+}
+
+int TransferScheduler::queuePosition(const std::string& key) const
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end() || it->second.active) {
+        return 0;
+    }
+
+    const std::string slot = slotOf(key, it->second);
+    std::vector<std::string> slotsAhead;
+    for (const std::string& queuedKey : queued()) {
+        const Entry& queuedEntry = m_entries.at(queuedKey);
+        if (queuedEntry.priority != it->second.priority) {
+            continue;
+        }
+        const std::string queuedSlot = slotOf(queuedKey, queuedEntry);
+        if (std::find(slotsAhead.begin(), slotsAhead.end(), queuedSlot) == slotsAhead.end()) {
+            slotsAhead.push_back(queuedSlot);
+        }
+        if (queuedSlot == slot) {
+            break;
+        }
+    }
+    return static_cast<int>(slotsAhead.size());
+}
+
+std::vector<std::string> TransferScheduler::queued() const
+{
+    std::vector<std::pair<std::pair<int, uint64_t>, std::string>> order;
+    for (const auto& item : m_entries) {
+        if (!item.second.active) {
+            order.push_back({{static_cast<int>(item.second.priority), item.second.sequence}, item.first});
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<std::string> keys;
+    keys.reserve(order.size());
+    for (const auto& item : order) {
+        keys.push_back(item.second);
+    }
+    return keys;
+}
+
+int64_t TransferScheduler::acquire(const std::string& key, uint64_t bytes, int64_t nowMs)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        return 0;
+    }
+
+    Entry& entry = it->second;
+    const int64_t globalWait = m_globalBucket.waitMs(nowMs);
+    const int64_t peerWait = peerBucket(entry.peer, nowMs).waitMs(nowMs);
+    int64_t wait = std::max(globalWait, peerWait);
+
+    if (entry.priority == TransferPriority::High) {
+        entry.heldUntilMs = wait > 0 ? nowMs + wait : -1;
+        entry.heldByPeer = wait > 0 && globalWait == 0;
+    } else {
+        wait = std::max(wait, highPriorityHold(entry.peer, nowMs));
+    }
+    if (wait > 0) {
+        return wait;
+    }
+
+    charge(key, bytes, nowMs);
+    return 0;
+}
+
+void TransferScheduler::charge(const std::string& key, uint64_t bytes, int64_t nowMs)
+{
+    m_globalBucket.consume(bytes, nowMs);
+    m_totalRate.add(bytes, nowMs);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        peerBucket(it->second.peer, nowMs).consume(bytes, nowMs);
+        it->second.meter.add(bytes, nowMs);
+    }
+}
+
+uint64_t TransferScheduler::paceBytesPerSecond() const
+{
+    const uint64_t global = m_limits.globalBytesPerSecond;
+    const uint64_t peer = m_limits.peerBytesPerSecond;
+    if (global == 0 || peer == 0) {
+        return std::max(global, peer);
+    }
+    return std::min(global, peer);
+}
+
+double TransferScheduler::rate(const std::string& key, int64_t nowMs)
+{
+    auto it = m_entries.find(key);
+    return it != m_entries.end() ? it->second.meter.rate(nowMs) : 0.0;
+}
+
+uint64_t TransferScheduler::burstFor(uint64_t bytesPerSecond)
+{
+    return std::max(bytesPerSecond, kMinBurstBytes);
+}
+
+std::string TransferScheduler::slotOf(const std::string& key, const Entry& entry) const
+{
+    return entry.slot.empty() ? key : entry.slot;
+}
+
+bool TransferScheduler::slotActive(const std::string& slot) const
+{
+    for (const auto& item : m_entries) {
+        if (item.second.active && slotOf(item.first, item.second) == slot) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int TransferScheduler::activeSlots(TransferPriority priority) const
+{
+    std::set<std::string> slots;
+    for (const auto& item : m_entries) {
+        if (item.second.active && item.second.priority == priority) {
+            slots.insert(slotOf(item.first, item.second));
+        }
+    }
+    return static_cast<int>(slots.size());
+}
+
+TokenBucket& TransferScheduler::peerBucket(const std::string& peer, int64_t nowMs)
+{
+    auto it = m_peerBuckets.find(peer);
+    if (it == m_peerBuckets.end()) {
+        it = m_peerBuckets.emplace(peer, TokenBucket()).first;
+        it->second.configure(m_limits.peerBytesPerSecond, burstFor(m_limits.peerBytesPerSecond), nowMs);
+    }
+    return it->second;
+}
+
+int64_t TransferScheduler::highPriorityHold(const std::string& peer, int64_t nowMs) const
+{
+    // A held image only blocks others competing for the same bucket; a
+    // paused one stops counting kHighPriorityHoldMs after its retry time
+    int64_t hold = 0;
+    for (const auto& item : m_entries) {
+        const Entry& entry = item.second;
+        if (entry.priority != TransferPriority::High || !entry.active || entry.heldUntilMs < 0
+            || nowMs > entry.heldUntilMs + kHighPriorityHoldMs
+            || (entry.heldByPeer && entry.peer != peer)) {
+            continue;
+        }
+        hold = std::max(hold, std::max<int64_t>(entry.heldUntilMs - nowMs, 1));
+    }
+    return hold;
+}
+
+} // namespace services
+} // namespace flykylin
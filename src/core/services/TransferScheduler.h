@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace flykylin {
+namespace services {
+
+/**
+ * @brief Byte budget refilled at a fixed rate
+ *
+ * The bucket may go into debt: a send is allowed whenever the balance is
+ * positive and the whole chunk is then taken, so chunks larger than the
+ * burst still go out and the long-term rate is exact. A rate of 0 means
+ * unlimited.
+ */
+class TokenBucket {
+public:
+    void configure(uint64_t bytesPerSecond, uint64_t burstBytes, int64_t nowMs);
+
+    bool limited() const { return m_rate > 0.0; }
+
+    /**
+     * @brief Time until the balance is positive again, 0 if it is now
+     */
+    int64_t waitMs(int64_t nowMs);
+
+    void consume(uint64_t bytes, int64_t nowMs);
+
+private:
+    void refill(int64_t nowMs);
+
+    double m_rate{0.0};     ///< Bytes per ms
+    double m_burst{0.0};
+    double m_tokens{0.0};
+    int64_t m_lastMs{0};
+};
+
+/**
+ * @brief Recent throughput, smoothed over windows of kWindowMs
+ */
+class RateMeter {
+public:
+    void add(uint64_t bytes, int64_t nowMs);
+
+    /**
+     * @brief Bytes per second, decaying to 0 once nothing is added
+     */
+    double rate(int64_t nowMs);
+
+    static constexpr int64_t kWindowMs = 1000;
+
+private:
+    void roll(int64_t nowMs);
+
+    bool m_started{false};
+    int64_t m_windowStartMs{0};
+    uint64_t m_windowBytes{0};
+    double m_rate{0.0};
+};
+
+enum class TransferPriority {
+    High,       ///< Images and previews: admitted and served first
+    Normal      ///< Files
+};
+
+/**
+ * @brief Admission and bandwidth policy for outgoing transfers
+ *
+ * Transfers wait in a queue until one of maxActive slots of their priority
+ * class is free, in arrival order; each class has its own slots, so images
+ * never wait behind long file transfers. Members of one group send share a
+ * slot and start together, so they can still share their reads.
+ *
+ * Every chunk handed to a socket first takes tokens from the global bucket
+ * and from its peer's bucket. While a high-priority transfer is held back
+ * by an empty bucket, normal ones sharing that bucket are held too, so
+ * refilled tokens go to the images first.
+ *
+ * All times are caller-supplied milliseconds from a monotonic clock.
+ */
+class TransferScheduler {
+public:
+    struct Limits {
+        uint64_t globalBytesPerSecond{0};   ///< 0 = unlimited
+        uint64_t peerBytesPerSecond{0};     ///< Per peer, 0 = unlimited
+        int maxActive{0};                   ///< Slots per priority class, 0 = unlimited
+    };
+
+    void setLimits(const Limits& limits, int64_t nowMs);
+    const Limits& limits() const { return m_limits; }
+
+    /**
+     * @brief Queue a transfer
+     * @param slot Transfers sharing a non-empty slot start together (group send)
+     */
+    void add(const std::string& key,
+             const std::string& peer,
+             TransferPriority priority,
+             const std::string& slot = std::string());
+    void remove(const std::string& key);
+
+    /**
+     * @brief Start queued transfers while slots are free
+     * @return Keys that became active, in start order
+     */
+    std::vector<std::string> admit();
+
+    bool contains(const std::string& key) const { return m_entries.count(key) != 0; }
+    bool isActive(const std::string& key) const;
+
+    /**
+     * @brief 1-based place in its class's queue (counting slots), 0 if active or unknown
+     */
+    int queuePosition(const std::string& key) const;
+
+    /**
+     * @brief Queued keys in start order
+     */
+    std::vector<std::string> queued() const;
+
+    /**
+     * @brief Take tokens for a chunk of key
+     * @return 0 if the chunk may go now (tokens taken), else ms to wait before retrying
+     */
+    int64_t acquire(const std::string& key, uint64_t bytes, int64_t nowMs);
+
+    /**
+     * @brief Account bytes that were sent without acquire() (paced elsewhere)
+     */
+    void charge(const std::string& key, uint64_t bytes, int64_t nowMs);
+
+    /**
+     * @brief Rate a sender outside this thread should pace itself to, 0 = unlimited
+     */
+    uint64_t paceBytesPerSecond() const;
+
+    double rate(const std::string& key, int64_t nowMs);
+    double totalRate(int64_t nowMs) { return m_totalRate.rate(nowMs); }
+
+    /**
+     * @brief Idle credit a bucket may build up: one second of traffic, at least kMinBurstBytes
+     */
+    static uint64_t burstFor(uint64_t bytesPerSecond);
+
+    static constexpr uint64_t kMinBurstBytes = 64 * 1024;
+    static constexpr int64_t kHighPriorityHoldMs = 100;   ///< Slack after a held image's retry time
+
+private:
+    struct Entry {
+        std::string peer;
+        std::string slot;
+        TransferPriority priority{TransferPriority::Normal};
+        uint64_t sequence{0};
+        bool active{false};
+        int64_t heldUntilMs{-1};    ///< High priority: retry time after being held back
+        bool heldByPeer{false};     ///< ...by its peer's bucket only
+        RateMeter meter;
+    };
+
+    std::string slotOf(const std::string& key, const Entry& entry) const;
+    bool slotActive(const std::string& slot) const;
+    int activeSlots(TransferPriority priority) const;
+    TokenBucket& peerBucket(const std::string& peer, int64_t nowMs);
+    int64_t highPriorityHold(const std::string& peer, int64_t nowMs) const;
+
+    Limits m_limits;
+    TokenBucket m_globalBucket;
+    std::map<std::string, TokenBucket> m_peerBuckets;
+    std::map<std::string, Entry> m_entries;
+    RateMeter m_totalRate;
+    uint64_t m_nextSequence{0};
+};
+
+} // namespace services
+} // namespace flykylin
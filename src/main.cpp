@@ -19,6 +19,7 @@
 #include "core/communication/TcpServer.h"
 #include "core/communication/TcpConnectionManager.h"
 #include "core/config/UserProfile.h"
+#include "core/services/MessageEmbeddingIndexer.h"
 
 // Uncomment to switch to QML UI
 #define USE_QML_UI
@@ -87,6 +88,12 @@ int main(int argc, char *argv[]) {
     bool discoveryStarted = peerDiscovery->start(kUdpPort, effectiveTcpPort);
     Q_UNUSED(discoveryStarted);
 
+    // 预热：重启后不等UDP广播，先并行探测数据库里最近出现过的节点
+    flykylin::communication::TcpConnectionManager::instance()->warmStartFromDatabase();
+
+    // 后台为新消息和历史消息建立语义检索向量（仅在开启语义搜索时运行）
+    flykylin::services::MessageEmbeddingIndexer::instance()->start();
+
     // Instantiate ViewModels
     flykylin::ui::PeerListViewModel peerListViewModel;
     flykylin::ui::ChatViewModel chatViewModel;
@@ -234,10 +234,15 @@ Item {
     function addCustomEmoji(fileUrl) {
         if (!fileUrl || fileUrl === "")
             return
-        if (viewModel && viewModel.isImageNsfw(fileUrl)) {
-            console.log("[Emoji] NSFW image detected, skipping custom emoji:", fileUrl)
+        if (!viewModel) {
+            appendCustomEmoji(fileUrl)
             return
         }
+        // Added in onImageNsfwChecked once the detector has answered
+        viewModel.checkImageNsfw(fileUrl)
+    }
+
+    function appendCustomEmoji(fileUrl) {
         customEmojiModel.append({ url: fileUrl })
         saveCustomEmojis()
     }
@@ -272,6 +277,13 @@ Item {
 
     Connections {
         target: viewModel
+        function onImageNsfwChecked(fileUrl, nsfw) {
+            if (nsfw) {
+                console.log("[Emoji] NSFW image detected, skipping custom emoji:", fileUrl)
+                return
+            }
+            appendCustomEmoji(fileUrl)
+        }
         function onMessagesUpdated() {
             if (!pendingScrollMessageId || pendingScrollMessageId === "")
                 return
@@ -480,6 +492,11 @@ Item {
                             bottomPadding: 0
                             background: null
                             selectByMouse: true
+                            onActiveFocusChanged: {
+                                if (activeFocus && globalSearchViewModel
+                                        && settingsViewModel && settingsViewModel.semanticSearchEnabled)
+                                    globalSearchViewModel.prepareSemanticSearch()
+                            }
                             onAccepted: {
                                 if (!globalSearchViewModel)
                                     return
@@ -673,7 +690,8 @@ Item {
                         property real imageWidth: msgImage.visible && msgImage.status === Image.Ready ? Math.min(msgImage.paintedWidth, maxBubbleWidth - 24) : 0
                         property real fileWidth: fileRow.visible ? fileRow.implicitWidth : 0
                         property real nsfwWidth: nsfwBlockedPlaceholder.visible ? 180 : 0
-                        property real actualContentWidth: Math.max(senderWidth, textWidth, imageWidth, fileWidth, nsfwWidth)
+                        property real transferWidth: transferRow.visible ? transferRow.implicitWidth : 0
+                        property real actualContentWidth: Math.max(senderWidth, textWidth, imageWidth, fileWidth, nsfwWidth, transferWidth)
                         
                         // Width adapts to content with min/max constraints
                         // 图片消息使用图片实际宽度，其他消息使用内容宽度
@@ -865,6 +883,59 @@ Item {
                                 sourceSize.height: PlatformConfig.imageSourceHeight
                                 width: Math.min(PlatformConfig.imageDisplayMaxWidth, msgContent.maxBubbleWidth - 24)
                             }
+
+                            // 发送中的图片/文件：进度 + 暂停/继续/取消
+                            Row {
+                                id: transferRow
+                                property var progress: viewModel && viewModel.transferProgress
+                                                       ? viewModel.transferProgress[model.messageId]
+                                                       : undefined
+                                property bool paused: viewModel && viewModel.pausedTransfers
+                                                      ? viewModel.pausedTransfers.indexOf(model.messageId) !== -1
+                                                      : false
+                                visible: model.isMine && (msgContent.isImage || msgContent.isFile)
+                                         && progress !== undefined
+                                spacing: 10
+
+                                Label {
+                                    text: transferRow.paused
+                                          ? qsTr("已暂停 %1%").arg(Math.floor((transferRow.progress || 0) * 100))
+                                          : qsTr("发送中 %1%").arg(Math.floor((transferRow.progress || 0) * 100))
+                                    font: Style.fontCaption
+                                    color: Style.textOnPrimary
+                                }
+
+                                Label {
+                                    text: transferRow.paused ? qsTr("继续") : qsTr("暂停")
+                                    font: Style.fontCaption
+                                    color: Style.textOnPrimary
+                                    opacity: 0.85
+
+                                    MouseArea {
+                                        anchors.fill: parent
+                                        cursorShape: Qt.PointingHandCursor
+                                        onClicked: {
+                                            if (transferRow.paused)
+                                                viewModel.resumeTransfer(model.messageId)
+                                            else
+                                                viewModel.pauseTransfer(model.messageId)
+                                        }
+                                    }
+                                }
+
+                                Label {
+                                    text: qsTr("取消")
+                                    font: Style.fontCaption
+                                    color: Style.textOnPrimary
+                                    opacity: 0.85
+
+                                    MouseArea {
+                                        anchors.fill: parent
+                                        cursorShape: Qt.PointingHandCursor
+                                        onClicked: viewModel.cancelTransfer(model.messageId)
+                                    }
+                                }
+                            }
                         }
 
                         // Shadow for received messages only（Qt5 版本暂时不启用阴影特效）
@@ -27,6 +27,33 @@
 namespace flykylin {
 namespace ui {
 
+namespace {
+
+QString localImagePath(const QString& filePath)
+{
+    if (filePath.startsWith("file:")) {
+        const QString local = QUrl(filePath).toLocalFile();
+        if (!local.isEmpty()) {
+            return local;
+        }
+    }
+    return filePath;
+}
+
+double nsfwThreshold()
+{
+    QSettings settings("FlyKylin", "FlyKylin");
+    double threshold = settings.value("nsfw/threshold", 0.8).toDouble();
+    if (threshold < 0.0) {
+        threshold = 0.0;
+    } else if (threshold > 1.0) {
+        threshold = 1.0;
+    }
+    return threshold;
+}
+
+} // namespace
+
 ChatViewModel::ChatViewModel(QObject* parent)
     : QObject(parent)
     , m_messageService(new services::MessageService(this))
@@ -53,6 +80,44 @@ ChatViewModel::ChatViewModel(QObject* parent)
             this, &ChatViewModel::onMessageSent);
     connect(m_messageService, &services::MessageService::messageFailed,
             this, &ChatViewModel::onMessageFailed);
+    connect(m_messageService, &services::MessageService::imagePreviewReceived,
+            this, &ChatViewModel::onImagePreviewReceived);
+    connect(m_messageService, &services::MessageService::transferFailed,
+            this, &ChatViewModel::onTransferFailed);
+    connect(m_messageService, &services::MessageService::transferQueued,
+            this, [this](const QString& messageId, int position) {
+                if (position > 0) {
+                    m_transferQueue.insert(messageId, position);
+                } else {
+                    m_transferQueue.remove(messageId);
+                }
+                emit transferStatusChanged();
+            });
+    connect(m_messageService, &services::MessageService::transferRatesUpdated,
+            this, [this](double totalBytesPerSecond, const QVariantMap& rates) {
+                m_uploadRate = totalBytesPerSecond;
+                m_transferRates = rates;
+                emit transferStatusChanged();
+            });
+    connect(m_messageService, &services::MessageService::transferProgress,
+            this, [this](const QString& messageId, quint64 bytesSent, quint64 totalBytes,
+                         double, qint64) {
+                if (totalBytes == 0) {
+                    return;
+                }
+                m_transferProgress.insert(messageId,
+                                          static_cast<double>(bytesSent) / static_cast<double>(totalBytes));
+                emit transferStatusChanged();
+            });
+    connect(m_messageService, &services::MessageService::memberTransferProgress,
+            this, [this](const QString& messageId, const QString& peerId,
+                         quint64 bytesSent, quint64 totalBytes) {
+                if (totalBytes == 0) {
+                    return;
+                }
+                m_memberProgress[messageId].insert(peerId,
+                                                   static_cast<double>(bytesSent) / static_cast<double>(totalBytes));
+            });
     
     qInfo() << "[ChatViewModel] Created";
 }
@@ -686,7 +751,13 @@ void ChatViewModel::onMessageReceived(const flykylin::core::Message& message) {
         qInfo() << "[ChatViewModel] Group message received from" << peerId
                 << "for group" << m_currentGroupId;
 
-        m_messages.append(message);
+        // A full image replaces its preview placeholder
+        const int row = findMessageRow(message.id());
+        if (row >= 0) {
+            m_messages[row] = message;
+        } else {
+            m_messages.append(message);
+        }
         std::sort(m_messages.begin(), m_messages.end(),
                   [](const core::Message& a, const core::Message& b) {
                       return a.timestamp() < b.timestamp();
@@ -707,18 +778,102 @@ void ChatViewModel::onMessageReceived(const flykylin::core::Message& message) {
 
         qInfo() << "[ChatViewModel] Message received from" << peerId;
 
-        m_messages.append(message);
-        // 增量添加消息，避免重建整个模型导致闪烁
-        appendMessageToModel(message);
+        const int row = findMessageRow(message.id());
+        if (row >= 0) {
+            // 完整图片替换预览占位
+            m_messages[row] = message;
+            rebuildMessageModel();
+        } else {
+            m_messages.append(message);
+            // 增量添加消息，避免重建整个模型导致闪烁
+            appendMessageToModel(message);
+        }
         emit messageReceived(message);
         emit messagesUpdated();
     }
     // Note: Group messages are handled earlier in this function and return early
 }
 
+void ChatViewModel::onImagePreviewReceived(const flykylin::core::Message& message) {
+    // Placeholder only: no relay, no storage; the full message replaces it
+    if (findMessageRow(message.id()) >= 0) {
+        return;
+    }
+
+    if (message.isGroup()) {
+        if (!m_isGroupChat || message.groupId() != m_currentGroupId) {
+            return;
+        }
+        m_messages.append(message);
+        std::sort(m_messages.begin(), m_messages.end(),
+                  [](const core::Message& a, const core::Message& b) {
+                      return a.timestamp() < b.timestamp();
+                  });
+        rebuildMessageModel();
+    } else {
+        if (m_isGroupChat || message.fromUserId() != m_currentPeerId) {
+            return;
+        }
+        m_messages.append(message);
+        appendMessageToModel(message);
+    }
+
+    qInfo() << "[ChatViewModel] Image preview for" << message.id() << "from" << message.fromUserId();
+    emit messagesUpdated();
+}
+
+void ChatViewModel::onTransferFailed(const QString& messageId, const QString& error) {
+    // Only preview placeholders: outgoing rows fail through messageFailed
+    const int row = findMessageRow(messageId);
+    if (row < 0) {
+        return;
+    }
+    const core::Message& placeholder = m_messages.at(row);
+    if (placeholder.status() != core::MessageStatus::Sending
+        || placeholder.fromUserId() == core::UserProfile::instance().userId()) {
+        return;
+    }
+
+    // Never stored, so it goes away instead of lingering as Sending
+    qInfo() << "[ChatViewModel] Dropping image preview" << messageId << ":" << error;
+    m_messages.removeAt(row);
+    rebuildMessageModel();
+    emit messagesUpdated();
+}
+
+void ChatViewModel::clearTransferStatus(const QString& messageId) {
+    bool changed = m_transferProgress.remove(messageId) > 0;
+    changed = m_pausedTransfers.remove(messageId) || changed;
+    m_memberProgress.remove(messageId);
+    if (changed) {
+        emit transferStatusChanged();
+    }
+}
+
+void ChatViewModel::pauseTransfer(const QString& messageId) {
+    m_messageService->pauseTransfer(messageId);
+    m_pausedTransfers.insert(messageId);
+    emit transferStatusChanged();
+}
+
+void ChatViewModel::resumeTransfer(const QString& messageId) {
+    m_messageService->resumeTransfer(messageId);
+    m_pausedTransfers.remove(messageId);
+    emit transferStatusChanged();
+}
+
+void ChatViewModel::cancelTransfer(const QString& messageId) {
+    // messageFailed("Cancelled") follows and clears the transfer status
+    m_messageService->cancelTransfer(messageId);
+}
+
 void ChatViewModel::onMessageSent(const flykylin::core::Message& message) {
     QString peerId = message.toUserId();
 
+    if (message.status() != core::MessageStatus::Sending) {
+        clearTransferStatus(message.id());
+    }
+
     if (!m_isGroupChat) {
         if (peerId != m_currentPeerId) {
             return;
@@ -784,6 +939,7 @@ void ChatViewModel::onMessageSent(const flykylin::core::Message& message) {
 
 void ChatViewModel::onMessageFailed(const flykylin::core::Message& message, const QString& error) {
     QString peerId = message.toUserId();
+    clearTransferStatus(message.id());
 
     if (!m_isGroupChat) {
         if (peerId != m_currentPeerId) {
@@ -937,18 +1093,12 @@ int ChatViewModel::findMessageRow(const QString& messageId) const {
 
 bool ChatViewModel::isImageNsfw(const QString& filePath) const
 {
-    QString normalizedPath = filePath;
-    if (filePath.startsWith("file:")) {
-        const QUrl url(filePath);
-        const QString local = url.toLocalFile();
-        if (!local.isEmpty()) {
-            normalizedPath = local;
-        }
-    }
+    const QString normalizedPath = localImagePath(filePath);
 
+    // Blocks for the inference, but never for picking the backend
     ai::NSFWDetector* detector = ai::NSFWDetector::instance();
     if (!detector || !detector->isAvailable()) {
-        qInfo() << "[ChatViewModel] NSFWDetector not available, skipping check for" << normalizedPath;
+        qInfo() << "[ChatViewModel] NSFWDetector not available (yet), skipping check for" << normalizedPath;
         return false;
     }
 
@@ -958,18 +1108,40 @@ bool ChatViewModel::isImageNsfw(const QString& filePath) const
         return false;
     }
 
-    QSettings settings("FlyKylin", "FlyKylin");
-    double threshold = settings.value("nsfw/threshold", 0.8).toDouble();
-    if (threshold < 0.0) {
-        threshold = 0.0;
-    } else if (threshold > 1.0) {
-        threshold = 1.0;
-    }
-
+    const double threshold = nsfwThreshold();
     qInfo() << "[ChatViewModel] NSFW probability for emoji" << normalizedPath << "=" << *prob
             << "threshold=" << threshold;
     return *prob >= static_cast<float>(threshold);
 }
 
+void ChatViewModel::checkImageNsfw(const QString& filePath)
+{
+    const QString normalizedPath = localImagePath(filePath);
+
+    ai::NSFWDetector* detector = ai::NSFWDetector::instance();
+    if (!detector || detector->availability() == ai::BackendAvailability::Unavailable) {
+        qInfo() << "[ChatViewModel] NSFWDetector not available, skipping check for" << normalizedPath;
+        emit imageNsfwChecked(filePath, false);
+        return;
+    }
+
+    const quint64 requestId = detector->predictAsync(
+        normalizedPath, this, [this, filePath, normalizedPath](std::optional<float> prob) {
+            if (!prob.has_value()) {
+                qWarning() << "[ChatViewModel] NSFW detection failed for emoji" << normalizedPath;
+                emit imageNsfwChecked(filePath, false);
+                return;
+            }
+
+            const double threshold = nsfwThreshold();
+            qInfo() << "[ChatViewModel] NSFW probability for emoji" << normalizedPath << "=" << *prob
+                    << "threshold=" << threshold;
+            emit imageNsfwChecked(filePath, *prob >= static_cast<float>(threshold));
+        });
+    if (requestId == 0) {
+        emit imageNsfwChecked(filePath, false);
+    }
+}
+
 } // namespace ui
 } // namespace flykylin
@@ -13,6 +13,8 @@
 #include <QStringList>
 #include <QList>
 #include <QHash>
+#include <QSet>
+#include <QVariantMap>
 #include "core/models/Message.h"
 #include "core/services/MessageService.h"
 
@@ -36,6 +38,9 @@ class ChatViewModel : public QObject {
     Q_PROPERTY(QStandardItemModel* messageModel READ messageModel CONSTANT)
     Q_PROPERTY(QString currentPeerName READ getCurrentPeerName NOTIFY peerChanged)
     Q_PROPERTY(bool hasMoreHistory READ hasMoreHistory NOTIFY messagesUpdated)
+    Q_PROPERTY(double uploadRate READ uploadRate NOTIFY transferStatusChanged)
+    Q_PROPERTY(QVariantMap transferProgress READ transferProgress NOTIFY transferStatusChanged)
+    Q_PROPERTY(QStringList pausedTransfers READ pausedTransfers NOTIFY transferStatusChanged)
     
 public:
     explicit ChatViewModel(QObject* parent = nullptr);
@@ -99,6 +104,49 @@ public:
 
     Q_INVOKABLE bool isImageNsfw(const QString& filePath) const;
 
+    /**
+     * @brief Non-blocking isImageNsfw(), answered by imageNsfwChecked
+     */
+    Q_INVOKABLE void checkImageNsfw(const QString& filePath);
+
+    /**
+     * @brief Outgoing transfer status (updated with transferStatusChanged)
+     *
+     * Queue position 0 means the transfer is running or unknown; rates are
+     * bytes/s over the last seconds.
+     */
+    Q_INVOKABLE int transferQueuePosition(const QString& messageId) const {
+        return m_transferQueue.value(messageId, 0);
+    }
+    Q_INVOKABLE double transferRate(const QString& messageId) const {
+        return m_transferRates.value(messageId).toDouble();
+    }
+    double uploadRate() const { return m_uploadRate; }
+
+    /**
+     * @brief Outgoing transfers in progress: message ID -> fraction sent (0..1)
+     *
+     * Entries go away once the message is Sent or Failed.
+     */
+    QVariantMap transferProgress() const { return m_transferProgress; }
+    QStringList pausedTransfers() const { return m_pausedTransfers.values(); }
+
+    /**
+     * @brief Per-member progress of a group image/file: peer ID -> fraction sent
+     */
+    Q_INVOKABLE QVariantMap memberTransferProgress(const QString& messageId) const {
+        return m_memberProgress.value(messageId);
+    }
+
+    /**
+     * @brief Pause/resume/cancel the transfer of an outgoing image/file message
+     *
+     * A cancelled message is marked Failed.
+     */
+    Q_INVOKABLE void pauseTransfer(const QString& messageId);
+    Q_INVOKABLE void resumeTransfer(const QString& messageId);
+    Q_INVOKABLE void cancelTransfer(const QString& messageId);
+
     Q_INVOKABLE void resetConversation();
     Q_INVOKABLE void loadMoreHistory();
     Q_INVOKABLE QString getOldestMessageId() const {
@@ -173,8 +221,20 @@ signals:
                                 const QString& fromUserId,
                                 const QString& toUserId);
     
+    /**
+     * @brief Upload rates or queue positions changed
+     */
+    void transferStatusChanged();
+
+    /**
+     * @brief Result of checkImageNsfw (false if the check could not run)
+     */
+    void imageNsfwChecked(const QString& filePath, bool nsfw);
+    
 private slots:
     void onMessageReceived(const flykylin::core::Message& message);
+    void onImagePreviewReceived(const flykylin::core::Message& message);
+    void onTransferFailed(const QString& messageId, const QString& error);
     void onMessageSent(const flykylin::core::Message& message);
     void onMessageFailed(const flykylin::core::Message& message, const QString& error);
     
@@ -182,6 +242,7 @@ private:
     void loadMessagesFromService();
     void rebuildMessageModel();
     void appendMessageToModel(const core::Message& msg);
+    void clearTransferStatus(const QString& messageId);
     
     services::MessageService* m_messageService;
     
@@ -193,6 +254,12 @@ private:
     QList<core::Message> m_messages;  ///< Message list for current peer or group
     QStandardItemModel* m_messageModel; ///< Model for QML
     bool m_hasMoreHistory{false};
+    QHash<QString, int> m_transferQueue;    ///< Message ID -> queue position
+    QVariantMap m_transferRates;            ///< Message ID -> bytes/s
+    double m_uploadRate{0.0};
+    QVariantMap m_transferProgress;         ///< Message ID -> fraction sent
+    QHash<QString, QVariantMap> m_memberProgress;   ///< Message ID -> (peer ID -> fraction sent)
+    QSet<QString> m_pausedTransfers;
 
     // GroupChatManager is used for group metadata (singleton accessed via instance())
     // No longer using internal GroupMeta struct
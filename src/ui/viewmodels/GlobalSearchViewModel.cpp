@@ -1,5 +1,6 @@
 #include "GlobalSearchViewModel.h"
 
+#include "../../core/ai/TextEmbeddingEngine.h"
 #include "../../core/config/UserProfile.h"
 #include <QDebug>
 
@@ -30,6 +31,11 @@ void GlobalSearchViewModel::clearResults()
     }
 }
 
+void GlobalSearchViewModel::prepareSemanticSearch()
+{
+    ai::TextEmbeddingEngine::instance()->prefetch();
+}
+
 void GlobalSearchViewModel::search(const QString& query,
                                    bool useSemantic,
                                    const QString& peerId)
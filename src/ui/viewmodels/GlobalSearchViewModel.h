@@ -29,6 +29,14 @@ public:
 
     Q_INVOKABLE void clearResults();
 
+    /**
+     * @brief Start loading the embedding model in the background.
+     *
+     * Called when the search field gets focus, so a semantic search typed
+     * right after does not wait for the model to load.
+     */
+    Q_INVOKABLE void prepareSemanticSearch();
+
     /**
      * @brief Run a search over chat history.
      * @param query Search text entered by user.
@@ -6,6 +6,7 @@
 #include "SettingsViewModel.h"
 
 #include "core/config/UserProfile.h"
+#include "core/services/MessageEmbeddingIndexer.h"
 
 // Version info (generated by CMake)
 #if __has_include("Version.h")
@@ -48,6 +49,12 @@ void SettingsViewModel::load()
     } else if (m_nsfwThreshold > 1.0) {
         m_nsfwThreshold = 1.0;
     }
+    m_uploadLimitKBps = qMax(settings.value("transfer/uploadLimitKBps", 0).toInt(), 0);
+    m_peerUploadLimitKBps = qMax(settings.value("transfer/peerUploadLimitKBps", 0).toInt(), 0);
+    m_maxConcurrentTransfers = qMax(settings.value("transfer/maxConcurrent", 3).toInt(), 0);
+    m_transcodeImages = settings.value("transfer/transcodeImages", true).toBool();
+    m_transcodeMaxDimension = qMax(settings.value("transfer/transcodeMaxDimension", 2560).toInt(), 0);
+    m_transcodeQuality = qBound(1, settings.value("transfer/transcodeQuality", 85).toInt(), 100);
 }
 
 void SettingsViewModel::setUserName(const QString& userName)
@@ -114,6 +121,11 @@ void SettingsViewModel::setSemanticSearchEnabled(bool enabled)
     settings.setValue("search/semanticSearchEnabled", m_semanticSearchEnabled);
     settings.sync();
 
+    if (m_semanticSearchEnabled) {
+        // 开启后立即补建历史消息的向量
+        flykylin::services::MessageEmbeddingIndexer::instance()->start();
+    }
+
     emit semanticSearchEnabledChanged();
 }
 
@@ -169,6 +181,101 @@ void SettingsViewModel::setNsfwThreshold(double threshold)
     emit nsfwThresholdChanged();
 }
 
+void SettingsViewModel::setUploadLimitKBps(int limit)
+{
+    const int clamped = qMax(limit, 0);
+    if (m_uploadLimitKBps == clamped) {
+        return;
+    }
+
+    m_uploadLimitKBps = clamped;
+
+    QSettings settings("FlyKylin", "FlyKylin");
+    settings.setValue("transfer/uploadLimitKBps", m_uploadLimitKBps);
+    settings.sync();
+
+    emit uploadLimitKBpsChanged();
+}
+
+void SettingsViewModel::setPeerUploadLimitKBps(int limit)
+{
+    const int clamped = qMax(limit, 0);
+    if (m_peerUploadLimitKBps == clamped) {
+        return;
+    }
+
+    m_peerUploadLimitKBps = clamped;
+
+    QSettings settings("FlyKylin", "FlyKylin");
+    settings.setValue("transfer/peerUploadLimitKBps", m_peerUploadLimitKBps);
+    settings.sync();
+
+    emit peerUploadLimitKBpsChanged();
+}
+
+void SettingsViewModel::setMaxConcurrentTransfers(int count)
+{
+    const int clamped = qMax(count, 0);
+    if (m_maxConcurrentTransfers == clamped) {
+        return;
+    }
+
+    m_maxConcurrentTransfers = clamped;
+
+    QSettings settings("FlyKylin", "FlyKylin");
+    settings.setValue("transfer/maxConcurrent", m_maxConcurrentTransfers);
+    settings.sync();
+
+    emit maxConcurrentTransfersChanged();
+}
+
+void SettingsViewModel::setTranscodeImages(bool enabled)
+{
+    if (m_transcodeImages == enabled) {
+        return;
+    }
+
+    m_transcodeImages = enabled;
+
+    QSettings settings("FlyKylin", "FlyKylin");
+    settings.setValue("transfer/transcodeImages", m_transcodeImages);
+    settings.sync();
+
+    emit transcodeImagesChanged();
+}
+
+void SettingsViewModel::setTranscodeMaxDimension(int pixels)
+{
+    const int clamped = qMax(pixels, 0);
+    if (m_transcodeMaxDimension == clamped) {
+        return;
+    }
+
+    m_transcodeMaxDimension = clamped;
+
+    QSettings settings("FlyKylin", "FlyKylin");
+    settings.setValue("transfer/transcodeMaxDimension", m_transcodeMaxDimension);
+    settings.sync();
+
+    emit transcodeMaxDimensionChanged();
+}
+
+void SettingsViewModel::setTranscodeQuality(int quality)
+{
+    const int clamped = qBound(1, quality, 100);
+    if (m_transcodeQuality == clamped) {
+        return;
+    }
+
+    m_transcodeQuality = clamped;
+
+    QSettings settings("FlyKylin", "FlyKylin");
+    settings.setValue("transfer/transcodeQuality", m_transcodeQuality);
+    settings.sync();
+
+    emit transcodeQualityChanged();
+}
+
 void SettingsViewModel::chooseDownloadDirectory()
 {
     QString currentDir = m_downloadDirectory;
@@ -23,6 +23,12 @@ class SettingsViewModel : public QObject {
     Q_PROPERTY(bool nsfwBlockOutgoing READ nsfwBlockOutgoing WRITE setNsfwBlockOutgoing NOTIFY nsfwBlockOutgoingChanged)
     Q_PROPERTY(bool nsfwBlockIncoming READ nsfwBlockIncoming WRITE setNsfwBlockIncoming NOTIFY nsfwBlockIncomingChanged)
     Q_PROPERTY(double nsfwThreshold READ nsfwThreshold WRITE setNsfwThreshold NOTIFY nsfwThresholdChanged)
+    Q_PROPERTY(int uploadLimitKBps READ uploadLimitKBps WRITE setUploadLimitKBps NOTIFY uploadLimitKBpsChanged)
+    Q_PROPERTY(int peerUploadLimitKBps READ peerUploadLimitKBps WRITE setPeerUploadLimitKBps NOTIFY peerUploadLimitKBpsChanged)
+    Q_PROPERTY(int maxConcurrentTransfers READ maxConcurrentTransfers WRITE setMaxConcurrentTransfers NOTIFY maxConcurrentTransfersChanged)
+    Q_PROPERTY(bool transcodeImages READ transcodeImages WRITE setTranscodeImages NOTIFY transcodeImagesChanged)
+    Q_PROPERTY(int transcodeMaxDimension READ transcodeMaxDimension WRITE setTranscodeMaxDimension NOTIFY transcodeMaxDimensionChanged)
+    Q_PROPERTY(int transcodeQuality READ transcodeQuality WRITE setTranscodeQuality NOTIFY transcodeQualityChanged)
     
     // Version info (read-only)
     Q_PROPERTY(QString appVersion READ appVersion CONSTANT)
@@ -43,6 +49,12 @@ public:
     bool nsfwBlockOutgoing() const { return m_nsfwBlockOutgoing; }
     bool nsfwBlockIncoming() const { return m_nsfwBlockIncoming; }
     double nsfwThreshold() const { return m_nsfwThreshold; }
+    int uploadLimitKBps() const { return m_uploadLimitKBps; }
+    int peerUploadLimitKBps() const { return m_peerUploadLimitKBps; }
+    int maxConcurrentTransfers() const { return m_maxConcurrentTransfers; }
+    bool transcodeImages() const { return m_transcodeImages; }
+    int transcodeMaxDimension() const { return m_transcodeMaxDimension; }
+    int transcodeQuality() const { return m_transcodeQuality; }
     
     // Version info getters
     QString appVersion() const;
@@ -60,6 +72,12 @@ public slots:
     void setNsfwBlockOutgoing(bool enabled);
     void setNsfwBlockIncoming(bool enabled);
     void setNsfwThreshold(double threshold);
+    void setUploadLimitKBps(int limit);
+    void setPeerUploadLimitKBps(int limit);
+    void setMaxConcurrentTransfers(int count);
+    void setTranscodeImages(bool enabled);
+    void setTranscodeMaxDimension(int pixels);
+    void setTranscodeQuality(int quality);
 
 public:
     Q_INVOKABLE void chooseDownloadDirectory();
@@ -73,6 +91,12 @@ signals:
     void nsfwBlockOutgoingChanged();
     void nsfwBlockIncomingChanged();
     void nsfwThresholdChanged();
+    void uploadLimitKBpsChanged();
+    void peerUploadLimitKBpsChanged();
+    void maxConcurrentTransfersChanged();
+    void transcodeImagesChanged();
+    void transcodeMaxDimensionChanged();
+    void transcodeQualityChanged();
 
 private:
     void load();
@@ -86,6 +110,12 @@ private:
     bool m_nsfwBlockOutgoing{false};
     bool m_nsfwBlockIncoming{false};
     double m_nsfwThreshold{0.8};
+    int m_uploadLimitKBps{0};           ///< 0 = unlimited
+    int m_peerUploadLimitKBps{0};       ///< 0 = unlimited
+    int m_maxConcurrentTransfers{3};    ///< Per priority class, 0 = unlimited
+    bool m_transcodeImages{true};       ///< Re-encode large images before sending
+    int m_transcodeMaxDimension{2560};  ///< Long edge in pixels, 0 = keep size
+    int m_transcodeQuality{85};         ///< JPEG quality 1-100
 };
 
 } // namespace ui
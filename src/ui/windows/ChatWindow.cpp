@@ -7,6 +7,7 @@
 
 #include "ChatWindow.h"
 #include "../../core/config/UserProfile.h"
+#include "../../core/services/ImageProcessor.h"
 #include <QCloseEvent>
 #include <QScrollBar>
 #include <QDateTime>
@@ -308,7 +309,9 @@ void ChatWindow::addMessageBubble(const flykylin::core::Message& message) {
     bubbleLabel->setMaximumWidth(350);
 
     if (message.kind() == flykylin::core::MessageKind::Image) {
-        QPixmap pix(message.attachmentLocalPath());
+        // Decoded near bubble size instead of at full resolution
+        QPixmap pix = QPixmap::fromImage(
+            flykylin::services::ImageProcessor::loadScaled(message.attachmentLocalPath(), QSize(260, 0)));
         if (!pix.isNull()) {
             if (pix.width() > 260) {
                 pix = pix.scaledToWidth(260, Qt::SmoothTransformation);
@@ -127,6 +127,9 @@ void MainWindow::setupServices()
     bool started = serverStarted && discoveryStarted;
     
     if (started) {
+        // 预热：并行探测数据库中最近出现过的节点，不必等待下一轮UDP广播
+        flykylin::communication::TcpConnectionManager::instance()->warmStartFromDatabase();
+
         QString statusText = QString("✓ 服务启动成功 | UDP端口: %1 | TCP端口: %2")
                                 .arg(kUdpPort)
                                 .arg(effectiveTcpPort);
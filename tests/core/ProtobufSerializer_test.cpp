@@ -10,6 +10,9 @@
 
 #include <QDateTime>
 #include <QString>
+#include <QByteArray>
+
+#include <chrono>
 
 using namespace flykylin;
 using namespace flykylin::adapters;
@@ -85,6 +88,49 @@ TEST_F(ProtobufSerializerTest, SerializePeerGoodbye_Success) {
     EXPECT_TRUE(serializer->isValidDiscoveryMessage(data));
 }
 
+TEST_F(ProtobufSerializerTest, DecodePeerMessage_FromByteView_Success) {
+    std::vector<uint8_t> buffer;
+    ASSERT_TRUE(serializer->serializePeerMessageInto(ports::DiscoveryKind::Heartbeat,
+                                                     testPeer, buffer));
+    ASSERT_FALSE(buffer.empty());
+
+    // 模拟UDP接收：直接在QByteArray内存上解码
+    QByteArray datagram(reinterpret_cast<const char*>(buffer.data()),
+                        static_cast<int>(buffer.size()));
+    auto result = serializer->decodePeerMessage(
+        ports::ByteView(datagram.constData(), static_cast<size_t>(datagram.size())));
+
+    ASSERT_TRUE(result.ok());
+    EXPECT_EQ(result.value->userId(), testPeer.userId());
+    EXPECT_EQ(result.value->userName(), testPeer.userName());
+    EXPECT_EQ(result.value->port(), testPeer.port());
+    EXPECT_TRUE(result.value->isOnline());
+}
+
+TEST_F(ProtobufSerializerTest, SerializePeerMessageInto_MatchesVectorApi) {
+    std::vector<uint8_t> buffer;
+    ASSERT_TRUE(serializer->serializePeerMessageInto(ports::DiscoveryKind::Goodbye,
+                                                     testPeer, buffer));
+    EXPECT_EQ(buffer, serializer->serializePeerGoodbye(testPeer));
+
+    auto result = serializer->decodePeerMessage(buffer);
+    ASSERT_TRUE(result.ok());
+    EXPECT_FALSE(result.value->isOnline());
+}
+
+TEST_F(ProtobufSerializerTest, DecodePeerMessage_ReportsErrors) {
+    EXPECT_EQ(serializer->decodePeerMessage(ports::ByteView()).error,
+              ports::DecodeError::Empty);
+
+    std::vector<uint8_t> invalidData = {0xFF, 0xFE, 0xFD};
+    EXPECT_EQ(serializer->decodePeerMessage(invalidData).error,
+              ports::DecodeError::Malformed);
+
+    // 合法的TcpMessage不是发现消息：缺少peer字段
+    auto textData = serializer->serializeTextMessage(testMessage);
+    EXPECT_FALSE(serializer->decodePeerMessage(textData).ok());
+}
+
 // ========== 文本消息测试 ==========
 
 TEST_F(ProtobufSerializerTest, SerializeTextMessage_Success) {
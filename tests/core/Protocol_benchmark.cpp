@@ -0,0 +1,159 @@
+/**
+ * @file Protocol_benchmark.cpp
+ * @brief Wire format costs: raw file-data frames versus protobuf FileChunks, discovery datagram decode
+ *
+ * Usage: flykylin_protocol_benchmark [file MB=128] [datagrams=20000]
+ *
+ * Framing runs in memory (one socket buffer, no I/O) so only the copies and
+ * the serialisation are measured. The protobuf path reproduces the old
+ * sendFileInternal / handleIncomingTcpData FileChunk + TcpMessage nesting.
+ * Discovery decode compares the old copy + isValid + deserialize sequence
+ * with the single decodePeerMessage() over a view of the datagram.
+ */
+
+#include "core/adapters/ProtobufSerializer.h"
+#include "core/communication/FileDataFrame.h"
+#include "core/PeerNode.h"
+#include "messages.pb.h"
+
+#include <QByteArray>
+#include <QDateTime>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+using namespace flykylin;
+using namespace flykylin::communication;
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool benchmarkFraming(int chunks)
+{
+    constexpr size_t kChunk = 1024 * 1024;
+    std::vector<char> fileChunk(kChunk, 'x');
+    std::vector<char> socketBuffer(kChunk + 256);
+    uint64_t checksum = 0;
+
+    std::clock_t cpuStart = std::clock();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < chunks; ++i) {
+        std::string readCopy(fileChunk.data(), kChunk);  // file.read -> QByteArray
+
+        protocol::FileChunk chunk;
+        chunk.set_transfer_id("transfer-id-0123456789");
+        chunk.set_offset(static_cast<uint64_t>(i) * kChunk);
+        chunk.set_data(readCopy.data(), readCopy.size());
+        chunk.set_chunk_size(static_cast<uint32_t>(kChunk));
+        std::string chunkPayload;
+        chunk.SerializeToString(&chunkPayload);
+
+        protocol::TcpMessage tcpChunk;
+        tcpChunk.set_type(protocol::TcpMessage::FILE_CHUNK);
+        tcpChunk.set_payload(chunkPayload);
+        std::string chunkData;
+        tcpChunk.SerializeToString(&chunkData);
+
+        std::memcpy(socketBuffer.data() + 4, chunkData.data(), chunkData.size());
+
+        protocol::TcpMessage rx;
+        rx.ParseFromArray(socketBuffer.data() + 4, static_cast<int>(chunkData.size()));
+        protocol::FileChunk rxChunk;
+        rxChunk.ParseFromString(rx.payload());
+        checksum += static_cast<unsigned char>(rxChunk.data()[i]);
+    }
+    const double protoSec = secondsSince(start);
+    const double protoCpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+    bool ok = true;
+    cpuStart = std::clock();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < chunks; ++i) {
+        FileDataHeader header;
+        header.transferIndex = 1;
+        header.offset = static_cast<uint64_t>(i) * kChunk;
+        header.length = static_cast<uint32_t>(kChunk);
+
+        auto* out = reinterpret_cast<uint8_t*>(socketBuffer.data());
+        encodeFileDataPrefix(header, out);
+        std::memcpy(out + kFileDataPrefixSize, fileChunk.data(), kChunk);  // socket write
+
+        FileDataHeader rx;
+        ok = ok && decodeFileDataHeader(out + 4, kFileDataHeaderSize + kChunk, rx);
+        const char* view = socketBuffer.data() + kFileDataPrefixSize;
+        checksum += static_cast<unsigned char>(view[i]);
+    }
+    const double rawSec = secondsSince(start);
+    const double rawCpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+    const double totalMb = double(chunks) * kChunk / (1024.0 * 1024.0);
+    std::printf("file data framing, %.0f MB in 1 MB chunks (checksum %llu)\n", totalMb,
+                static_cast<unsigned long long>(checksum));
+    std::printf("  protobuf FileChunk  %8.1f MB/s  cpu %.3f s\n", totalMb / protoSec, protoCpu);
+    std::printf("  raw frame           %8.1f MB/s  cpu %.3f s\n", totalMb / rawSec, rawCpu);
+    return ok;
+}
+
+bool benchmarkDiscoveryDecode(int iterations)
+{
+    adapters::ProtobufSerializer serializer;
+    core::PeerNode peer;
+    peer.setUserId("user-123");
+    peer.setUserName("TestUser");
+    peer.setIpAddress("192.168.1.100");
+    peer.setPort(12345);
+    peer.setOsType("Windows");
+    peer.setLastSeenTime(QDateTime::currentDateTime());
+
+    std::vector<uint8_t> buffer;
+    if (!serializer.serializePeerMessageInto(ports::DiscoveryKind::Heartbeat, peer, buffer)) {
+        return false;
+    }
+    const QByteArray datagram(reinterpret_cast<const char*>(buffer.data()),
+                              static_cast<int>(buffer.size()));
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        std::vector<uint8_t> copy(datagram.begin(), datagram.end());
+        if (serializer.isValidDiscoveryMessage(copy)) {
+            auto decoded = serializer.deserializePeerMessage(copy);
+            (void)decoded;
+        }
+    }
+    const double legacySec = secondsSince(start);
+
+    bool ok = true;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        auto result = serializer.decodePeerMessage(
+            ports::ByteView(datagram.constData(), static_cast<size_t>(datagram.size())));
+        ok = ok && result.ok();
+    }
+    const double viewSec = secondsSince(start);
+
+    std::printf("discovery decode, %d heartbeats of %d bytes\n", iterations, static_cast<int>(datagram.size()));
+    std::printf("  copy + validate + deserialize  %10.0f datagrams/s\n", iterations / legacySec);
+    std::printf("  decodePeerMessage(view)        %10.0f datagrams/s\n", iterations / viewSec);
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const int fileMb = argc > 1 ? std::atoi(argv[1]) : 128;
+    const int datagrams = argc > 2 ? std::atoi(argv[2]) : 20000;
+
+    const bool framingOk = benchmarkFraming(fileMb > 0 ? fileMb : 1);
+    const bool discoveryOk = benchmarkDiscoveryDecode(datagrams > 0 ? datagrams : 1);
+    return framingOk && discoveryOk ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include "core/ai/EmbeddingCodec.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace flykylin::ai;
+
+namespace {
+
+std::vector<float> randomVector(std::mt19937& rng, std::size_t dim)
+{
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    std::vector<float> v(dim);
+    for (float& x : v) {
+        x = dist(rng);
+    }
+    return v;
+}
+
+float exactCosine(std::vector<float> a, std::vector<float> b)
+{
+    embedding_codec::normalize(a);
+    embedding_codec::normalize(b);
+    float dot = 0.0f;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        dot += a[i] * b[i];
+    }
+    return dot;
+}
+
+} // namespace
+
+TEST(EmbeddingCodecTest, EncodesCompactly)
+{
+    std::mt19937 rng(7);
+    const auto v = randomVector(rng, 512);
+    const auto bytes = embedding_codec::encode(v);
+    EXPECT_EQ(bytes.size(), embedding_codec::kHeaderBytes + 512);
+    EXPECT_EQ(embedding_codec::dimensions(bytes.size()), 512u);
+}
+
+TEST(EmbeddingCodecTest, RoundTripStaysCloseToUnitVector)
+{
+    std::mt19937 rng(11);
+    auto v = randomVector(rng, 512);
+    const auto bytes = embedding_codec::encode(v);
+    const auto decoded = embedding_codec::decode(bytes.data(), bytes.size());
+    ASSERT_EQ(decoded.size(), v.size());
+
+    embedding_codec::normalize(v);
+    for (std::size_t i = 0; i < v.size(); ++i) {
+        EXPECT_NEAR(decoded[i], v[i], 0.01f);
+    }
+}
+
+TEST(EmbeddingCodecTest, CosineMatchesFloatResult)
+{
+    std::mt19937 rng(13);
+    for (int trial = 0; trial < 50; ++trial) {
+        const auto a = randomVector(rng, 512);
+        auto b = randomVector(rng, 512);
+        // Mix in some of a so the pairs span low to high similarity
+        for (std::size_t i = 0; i < b.size(); ++i) {
+            b[i] += a[i] * static_cast<float>(trial) / 10.0f;
+        }
+        auto query = a;
+        embedding_codec::normalize(query);
+        const auto bytes = embedding_codec::encode(b);
+        EXPECT_NEAR(embedding_codec::cosine(query, bytes.data(), bytes.size()), exactCosine(a, b), 0.01f);
+    }
+}
+
+TEST(EmbeddingCodecTest, RejectsDegenerateInput)
+{
+    EXPECT_TRUE(embedding_codec::encode({}).empty());
+    EXPECT_TRUE(embedding_codec::encode(std::vector<float>(16, 0.0f)).empty());
+
+    const uint8_t header[4] = {0, 0, 0, 0};
+    EXPECT_TRUE(embedding_codec::decode(header, sizeof(header)).empty());
+
+    const std::vector<float> query(8, 0.5f);
+    const auto bytes = embedding_codec::encode(std::vector<float>(16, 1.0f));
+    EXPECT_EQ(embedding_codec::cosine(query, bytes.data(), bytes.size()), 0.0f);
+}
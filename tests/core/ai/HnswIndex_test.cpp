@@ -0,0 +1,343 @@
+#include <gtest/gtest.h>
+
+#include "core/ai/EmbeddingCodec.h"
+#include "core/ai/HnswIndex.h"
+
+#include <cstring>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace flykylin::ai;
+
+namespace {
+
+constexpr std::size_t kDim = 64;
+
+/**
+ * Text embeddings cluster by topic; uniform random vectors would make the
+ * graph look worse than it is on real data.
+ */
+class ClusteredVectors {
+public:
+    explicit ClusteredVectors(unsigned seed, int clusters = 40)
+        : m_rng(seed)
+    {
+        for (int c = 0; c < clusters; ++c) {
+            m_centers.push_back(gaussian(1.0f));
+        }
+    }
+
+    std::vector<float> next()
+    {
+        std::uniform_int_distribution<std::size_t> pick(0, m_centers.size() - 1);
+        std::vector<float> v = m_centers[pick(m_rng)];
+        const std::vector<float> noise = gaussian(0.6f);
+        for (std::size_t i = 0; i < kDim; ++i) {
+            v[i] += noise[i];
+        }
+        return v;
+    }
+
+    std::vector<float> nextQuery()
+    {
+        std::vector<float> q = next();
+        embedding_codec::normalize(q);
+        return q;
+    }
+
+private:
+    std::vector<float> gaussian(float sigma)
+    {
+        std::normal_distribution<float> dist(0.0f, sigma);
+        std::vector<float> v(kDim);
+        for (float& x : v) {
+            x = dist(m_rng);
+        }
+        return v;
+    }
+
+    std::mt19937 m_rng;
+    std::vector<std::vector<float>> m_centers;
+};
+
+HnswIndex::Options graphOnly()
+{
+    HnswIndex::Options options;
+    options.exactScanLimit = 0;
+    return options;
+}
+
+void addEntry(HnswIndex& index, int64_t rowId, const std::string& peer, int64_t timestamp,
+              const std::vector<float>& v)
+{
+    const std::vector<uint8_t> encoded = embedding_codec::encode(v);
+    ASSERT_TRUE(index.add(rowId, "me", peer, timestamp, encoded.data(), encoded.size()));
+}
+
+double recallAt10(const HnswIndex& index, ClusteredVectors& data, const HnswIndex::Filter& filter)
+{
+    std::size_t found = 0;
+    std::size_t expected = 0;
+    for (int i = 0; i < 50; ++i) {
+        const std::vector<float> q = data.nextQuery();
+        std::set<int64_t> truth;
+        for (const auto& hit : index.exactSearch(q, 10, filter)) {
+            truth.insert(hit.rowId);
+        }
+        for (const auto& hit : index.search(q, 10, filter)) {
+            found += truth.count(hit.rowId);
+        }
+        expected += truth.size();
+    }
+    return expected == 0 ? 1.0 : static_cast<double>(found) / static_cast<double>(expected);
+}
+
+std::unique_ptr<HnswIndex> roundTrip(const HnswIndex& index)
+{
+    auto file = std::make_shared<std::vector<uint8_t>>();
+    const bool saved = index.save([&file](const void* data, std::size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        file->insert(file->end(), bytes, bytes + size);
+        return true;
+    });
+    EXPECT_TRUE(saved);
+    std::string error;
+    auto loaded = HnswIndex::load(file->data(), file->size(), file, &error);
+    EXPECT_NE(loaded, nullptr) << error;
+    return loaded;
+}
+
+} // namespace
+
+TEST(HnswIndexTest, FindsNearestNeighbours)
+{
+    ClusteredVectors data(1);
+    HnswIndex index(kDim, graphOnly());
+    for (int64_t row = 1; row <= 4000; ++row) {
+        addEntry(index, row, "peer-" + std::to_string(row % 7), row, data.next());
+    }
+    EXPECT_EQ(index.size(), 4000u);
+    EXPECT_GE(recallAt10(index, data, {}), 0.95);
+}
+
+TEST(HnswIndexTest, FiltersByConversationAndTime)
+{
+    ClusteredVectors data(2);
+    HnswIndex index(kDim, graphOnly());
+    for (int64_t row = 1; row <= 3000; ++row) {
+        addEntry(index, row, row % 3 == 0 ? "alice" : "bob", row * 1000, data.next());
+    }
+
+    HnswIndex::Filter alice;
+    alice.ownerId = "me";
+    alice.peerId = "alice";
+    const std::vector<float> q = data.nextQuery();
+    const auto hits = index.search(q, 10, alice);
+    ASSERT_EQ(hits.size(), 10u);
+    for (const auto& hit : hits) {
+        EXPECT_EQ(hit.rowId % 3, 0);
+    }
+    EXPECT_GE(recallAt10(index, data, alice), 0.9);
+
+    HnswIndex::Filter window;
+    window.fromMs = 1000 * 1000;
+    window.toMs = 1500 * 1000;
+    for (const auto& hit : index.search(q, 10, window)) {
+        EXPECT_GE(hit.rowId, 1000);
+        EXPECT_LE(hit.rowId, 1500);
+    }
+
+    HnswIndex::Filter unknown;
+    unknown.peerId = "carol";
+    EXPECT_TRUE(index.search(q, 10, unknown).empty());
+}
+
+TEST(HnswIndexTest, SmallFilterIsScannedExactly)
+{
+    ClusteredVectors data(3);
+    HnswIndex index(kDim);
+    for (int64_t row = 1; row <= 2000; ++row) {
+        addEntry(index, row, row <= 20 ? "rare" : "common", row, data.next());
+    }
+
+    HnswIndex::Filter rare;
+    rare.peerId = "rare";
+    const std::vector<float> q = data.nextQuery();
+    const auto hits = index.search(q, 10, rare);
+    const auto exact = index.exactSearch(q, 10, rare);
+    ASSERT_EQ(hits.size(), exact.size());
+    for (std::size_t i = 0; i < hits.size(); ++i) {
+        EXPECT_EQ(hits[i].rowId, exact[i].rowId);
+    }
+}
+
+TEST(HnswIndexTest, RemovedEntriesAreNotReturned)
+{
+    ClusteredVectors data(4);
+    HnswIndex index(kDim, graphOnly());
+    int64_t sum = 0;
+    for (int64_t row = 1; row <= 2000; ++row) {
+        addEntry(index, row, row % 2 == 0 ? "alice" : "bob", row, data.next());
+        sum += row;
+    }
+
+    EXPECT_TRUE(index.remove(10));
+    EXPECT_FALSE(index.remove(10));
+    EXPECT_EQ(index.removeConversation("me", "bob"), 1000u);
+    EXPECT_EQ(index.size(), 999u);
+    EXPECT_EQ(index.removedCount(), 1001u);
+
+    int64_t evenSum = 0;
+    for (int64_t row = 2; row <= 2000; row += 2) {
+        evenSum += row;
+    }
+    EXPECT_EQ(index.rowIdSum(), evenSum - 10);
+    EXPECT_LT(index.rowIdSum(), sum);
+
+    for (int i = 0; i < 20; ++i) {
+        for (const auto& hit : index.search(data.nextQuery(), 10, {})) {
+            EXPECT_EQ(hit.rowId % 2, 0);
+            EXPECT_NE(hit.rowId, 10);
+        }
+    }
+    EXPECT_GE(recallAt10(index, data, {}), 0.9);
+
+    const auto compact = index.compacted();
+    EXPECT_EQ(compact->size(), 999u);
+    EXPECT_EQ(compact->removedCount(), 0u);
+    EXPECT_EQ(compact->rowIds(), index.rowIds());
+}
+
+TEST(HnswIndexTest, EntriesWithoutVectorAreCountedButNotSearched)
+{
+    ClusteredVectors data(5);
+    HnswIndex index(kDim);
+    EXPECT_TRUE(index.add(7, "me", "alice", 1, nullptr, 0));
+    addEntry(index, 8, "alice", 2, data.next());
+    EXPECT_FALSE(index.add(8, "me", "alice", 2, nullptr, 0));
+
+    const std::vector<uint8_t> wrongSize(embedding_codec::kHeaderBytes + kDim / 2, 1);
+    EXPECT_FALSE(index.add(9, "me", "alice", 3, wrongSize.data(), wrongSize.size()));
+
+    EXPECT_EQ(index.rowIds(), (std::vector<int64_t>{7, 8}));
+    const auto hits = index.search(data.nextQuery(), 10, {});
+    ASSERT_EQ(hits.size(), 1u);
+    EXPECT_EQ(hits[0].rowId, 8);
+}
+
+TEST(HnswIndexTest, SavedIndexSearchesInPlaceAndKeepsGrowing)
+{
+    ClusteredVectors data(6);
+    HnswIndex index(kDim, graphOnly());
+    index.setLabel("onnx:64");
+    for (int64_t row = 1; row <= 1500; ++row) {
+        addEntry(index, row, "peer-" + std::to_string(row % 5), row, data.next());
+    }
+    index.remove(3);
+
+    auto loaded = roundTrip(index);
+    ASSERT_NE(loaded, nullptr);
+    EXPECT_EQ(loaded->label(), "onnx:64");
+    EXPECT_EQ(loaded->rowIds(), index.rowIds());
+    EXPECT_EQ(loaded->rowIdSum(), index.rowIdSum());
+    EXPECT_EQ(loaded->removedCount(), 1u);
+
+    for (int i = 0; i < 20; ++i) {
+        const std::vector<float> q = data.nextQuery();
+        const auto before = index.search(q, 10, {});
+        const auto after = loaded->search(q, 10, {});
+        ASSERT_EQ(before.size(), after.size());
+        for (std::size_t j = 0; j < before.size(); ++j) {
+            EXPECT_EQ(before[j].rowId, after[j].rowId);
+        }
+    }
+
+    // Adding links new entries into the loaded ones as well
+    for (int64_t row = 1501; row <= 3000; ++row) {
+        addEntry(*loaded, row, "peer-" + std::to_string(row % 5), row, data.next());
+    }
+    EXPECT_GE(recallAt10(*loaded, data, {}), 0.95);
+
+    auto reloaded = roundTrip(*loaded);
+    ASSERT_NE(reloaded, nullptr);
+    EXPECT_EQ(reloaded->size(), 2999u);
+    EXPECT_GE(recallAt10(*reloaded, data, {}), 0.95);
+}
+
+TEST(HnswIndexTest, RejectsDamagedFiles)
+{
+    ClusteredVectors data(7);
+    HnswIndex index(kDim);
+    for (int64_t row = 1; row <= 100; ++row) {
+        addEntry(index, row, "peer", row, data.next());
+    }
+
+    auto file = std::make_shared<std::vector<uint8_t>>();
+    index.save([&file](const void* bytes, std::size_t size) {
+        const auto* begin = static_cast<const uint8_t*>(bytes);
+        file->insert(file->end(), begin, begin + size);
+        return true;
+    });
+
+    std::string error;
+    EXPECT_EQ(HnswIndex::load(file->data(), file->size() - 16, file, &error), nullptr);
+    EXPECT_FALSE(error.empty());
+
+    (*file)[0] = 'X';
+    EXPECT_EQ(HnswIndex::load(file->data(), file->size(), file, &error), nullptr);
+
+    EXPECT_EQ(HnswIndex::load(file->data(), 8, file, &error), nullptr);
+}
+
+TEST(HnswIndexTest, RejectsLinksOutsideTheGraph)
+{
+    ClusteredVectors data(11);
+    HnswIndex index(kDim);
+    for (int64_t row = 1; row <= 100; ++row) {
+        addEntry(index, row, "peer", row, data.next());
+    }
+
+    std::vector<uint8_t> file;
+    index.save([&file](const void* bytes, std::size_t size) {
+        const auto* begin = static_cast<const uint8_t*>(bytes);
+        file.insert(file.end(), begin, begin + size);
+        return true;
+    });
+
+    // Layer-0 list of the first entry: after the 72-byte header, the padded
+    // label and tag table and 32 bytes of metadata per entry
+    const auto padded = [](uint64_t size) { return (size + 7) / 8 * 8; };
+    uint64_t labelBytes = 0;
+    uint64_t tagBytes = 0;
+    std::memcpy(&labelBytes, file.data() + 48, sizeof(labelBytes));
+    std::memcpy(&tagBytes, file.data() + 56, sizeof(tagBytes));
+    const std::size_t links0 = 72 + padded(labelBytes) + padded(tagBytes) + 100 * 32;
+    uint32_t linkCount = 0;
+    std::memcpy(&linkCount, file.data() + links0, sizeof(linkCount));
+    ASSERT_GT(linkCount, 0u);
+
+    const auto loadCopy = [](std::vector<uint8_t> bytes, std::string* error) {
+        auto copy = std::make_shared<std::vector<uint8_t>>(std::move(bytes));
+        return HnswIndex::load(copy->data(), copy->size(), copy, error);
+    };
+    std::string error;
+    ASSERT_NE(loadCopy(file, &error), nullptr) << error;
+
+    // More neighbours than a layer-0 list holds (2 * M)
+    std::vector<uint8_t> tooMany = file;
+    const uint32_t overCapacity = 2 * HnswIndex::Options().m + 1;
+    std::memcpy(tooMany.data() + links0, &overCapacity, sizeof(overCapacity));
+    EXPECT_EQ(loadCopy(tooMany, &error), nullptr);
+    EXPECT_EQ(error, "bad links");
+
+    // A neighbour id past the last entry
+    std::vector<uint8_t> pastTheEnd = file;
+    const uint32_t missingNode = 100;
+    std::memcpy(pastTheEnd.data() + links0 + sizeof(uint32_t), &missingNode, sizeof(missingNode));
+    error.clear();
+    EXPECT_EQ(loadCopy(pastTheEnd, &error), nullptr);
+    EXPECT_EQ(error, "bad links");
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "core/ai/InferenceBackend.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace flykylin;
+using ai::BackendKind;
+
+namespace {
+
+struct FakeBackend {
+    BackendKind kind;
+    std::chrono::milliseconds cost;
+};
+
+using Registry = ai::BackendRegistry<FakeBackend>;
+
+Registry::Factory fake(BackendKind kind, int costMs, int* created = nullptr)
+{
+    return [kind, costMs, created]() {
+        if (created) {
+            ++*created;
+        }
+        return std::make_unique<FakeBackend>(FakeBackend{kind, std::chrono::milliseconds(costMs)});
+    };
+}
+
+Registry::Factory unusable()
+{
+    return []() { return std::unique_ptr<FakeBackend>(); };
+}
+
+bool sleepingRun(FakeBackend& backend)
+{
+    std::this_thread::sleep_for(backend.cost);
+    return true;
+}
+
+struct MapStore {
+    std::map<std::string, std::string> values;
+
+    ai::BackendChoiceStore store()
+    {
+        return {[this](const std::string& key) { return values[key]; },
+                [this](const std::string& key, const std::string& value) { values[key] = value; }};
+    }
+};
+
+} // namespace
+
+TEST(InferenceBackendTest, KindNamesRoundTrip)
+{
+    for (BackendKind kind : {BackendKind::Null, BackendKind::OnnxCpu, BackendKind::OnnxInt8, BackendKind::Rknn}) {
+        EXPECT_EQ(ai::backendKindFromName(ai::backendKindName(kind)), kind);
+    }
+    EXPECT_FALSE(ai::backendKindFromName("directml").has_value());
+}
+
+TEST(InferenceBackendTest, PicksFastestUsableBackendAndStoresIt)
+{
+    Registry registry("nsfw");
+    registry.add(BackendKind::Rknn, unusable());
+    registry.add(BackendKind::OnnxCpu, fake(BackendKind::OnnxCpu, 20));
+    registry.add(BackendKind::OnnxInt8, fake(BackendKind::OnnxInt8, 2));
+
+    MapStore map;
+    const auto selection = registry.select(sleepingRun, map.store());
+    EXPECT_EQ(selection.kind, BackendKind::OnnxInt8);
+    ASSERT_TRUE(selection.backend);
+    EXPECT_EQ(selection.backend->kind, BackendKind::OnnxInt8);
+    EXPECT_FALSE(selection.fromStore);
+    ASSERT_EQ(selection.timings.size(), 2u);
+    EXPECT_LT(selection.timings[1].medianMs, selection.timings[0].medianMs);
+
+    EXPECT_EQ(map.values["nsfw/choice"], "onnx-int8");
+    EXPECT_EQ(map.values["nsfw/candidates"], "rknn,onnx-cpu,onnx-int8");
+}
+
+TEST(InferenceBackendTest, StoredChoiceSkipsBenchmark)
+{
+    int cpuCreated = 0;
+    Registry registry("text-embedding");
+    registry.add(BackendKind::OnnxCpu, fake(BackendKind::OnnxCpu, 0, &cpuCreated));
+    registry.add(BackendKind::OnnxInt8, fake(BackendKind::OnnxInt8, 0));
+
+    MapStore map;
+    map.values["text-embedding/choice"] = "onnx-int8";
+    map.values["text-embedding/candidates"] = registry.candidateList();
+
+    int runs = 0;
+    const auto selection = registry.select([&runs](FakeBackend&) { return ++runs > 0; }, map.store());
+    EXPECT_EQ(selection.kind, BackendKind::OnnxInt8);
+    EXPECT_TRUE(selection.fromStore);
+    EXPECT_EQ(runs, 0);
+    EXPECT_EQ(cpuCreated, 0);
+}
+
+TEST(InferenceBackendTest, ChangedCandidatesOrVanishedChoiceMeasureAgain)
+{
+    Registry registry("nsfw");
+    registry.add(BackendKind::Rknn, unusable());
+    registry.add(BackendKind::OnnxCpu, fake(BackendKind::OnnxCpu, 0));
+
+    // Stored backend no longer loads
+    MapStore map;
+    map.values["nsfw/choice"] = "rknn";
+    map.values["nsfw/candidates"] = registry.candidateList();
+    auto selection = registry.select(sleepingRun, map.store());
+    EXPECT_EQ(selection.kind, BackendKind::OnnxCpu);
+    EXPECT_FALSE(selection.fromStore);
+    EXPECT_EQ(map.values["nsfw/choice"], "onnx-cpu");
+
+    // A new build declares another backend
+    map.values["nsfw/candidates"] = "onnx-cpu";
+    selection = registry.select(sleepingRun, map.store());
+    EXPECT_FALSE(selection.fromStore);
+}
+
+TEST(InferenceBackendTest, NullWhenNothingWorksOrWhenDisabled)
+{
+    Registry registry("nsfw");
+    registry.add(BackendKind::OnnxCpu, fake(BackendKind::OnnxCpu, 0));
+
+    MapStore map;
+    auto selection = registry.select([](FakeBackend&) { return false; }, map.store());
+    EXPECT_EQ(selection.kind, BackendKind::Null);
+    EXPECT_FALSE(selection.backend);
+    EXPECT_EQ(map.values.count("nsfw/choice"), 0u);
+
+    // "null" set for the same build keeps the model off
+    map.values["nsfw/choice"] = "null";
+    map.values["nsfw/candidates"] = registry.candidateList();
+    selection = registry.select(sleepingRun, map.store());
+    EXPECT_EQ(selection.kind, BackendKind::Null);
+    EXPECT_TRUE(selection.fromStore);
+}
@@ -0,0 +1,128 @@
+/**
+ * @file InferenceQueue_benchmark.cpp
+ * @brief Throughput of InferenceQueue batching with a synthetic model
+ *
+ * Usage: flykylin_inference_benchmark [images=256] [call ms=8] [per-image ms=2] [window ms=10]
+ *
+ * The runner sleeps for a fixed cost per call plus a cost per image, which
+ * is how an NPU or a multi-threaded CPU backend behaves: launching the model
+ * dominates a single 224x224 image. prepare() stands in for decoding and
+ * resizing. Each run submits the whole burst at once, as a chat history
+ * full of images does, and reports images/s for maxBatch 1, 2, 4 and 8 with
+ * NSFWDetector's batch window.
+ */
+
+#include "core/ai/InferenceQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace flykylin::ai;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr auto kPrepareCost = std::chrono::microseconds(300);
+
+double millisSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+class SyntheticImage : public InferenceQueue::BatchItem {
+public:
+    std::optional<InferenceQueue::Result> prepare() override
+    {
+        std::this_thread::sleep_for(kPrepareCost);
+        return std::nullopt;
+    }
+};
+
+struct RunResult {
+    double seconds{0.0};
+    double meanLatencyMs{0.0};
+    double p95LatencyMs{0.0};
+    InferenceQueue::Stats stats;
+};
+
+RunResult run(std::size_t images, std::size_t maxBatch, std::chrono::microseconds callCost,
+              std::chrono::microseconds imageCost, std::chrono::milliseconds window)
+{
+    InferenceQueue queue(images);
+    queue.setBatchRunner([callCost, imageCost](const std::vector<InferenceQueue::BatchItem*>& items) {
+        std::this_thread::sleep_for(callCost + imageCost * static_cast<int>(items.size()));
+        return std::vector<InferenceQueue::Result>(items.size(), 0.1f);
+    }, maxBatch, window);
+
+    std::vector<Clock::time_point> submitted(images);
+    std::vector<double> latencies(images, 0.0);
+    std::vector<InferenceQueue::Ticket> tickets;
+    tickets.reserve(images);
+
+    const auto start = Clock::now();
+    for (std::size_t i = 0; i < images; ++i) {
+        submitted[i] = Clock::now();
+        tickets.push_back(queue.submit("image-" + std::to_string(i), std::make_shared<SyntheticImage>(),
+                                       [i, &submitted, &latencies](uint64_t, InferenceQueue::Result) {
+                                           latencies[i] = millisSince(submitted[i]);
+                                       }));
+    }
+    for (const InferenceQueue::Ticket& ticket : tickets) {
+        ticket.future.wait();
+    }
+
+    RunResult result;
+    result.seconds = millisSince(start) / 1000.0;
+    result.stats = queue.stats();
+    queue.stop();
+
+    double sum = 0.0;
+    for (double ms : latencies) {
+        sum += ms;
+    }
+    result.meanLatencyMs = latencies.empty() ? 0.0 : sum / static_cast<double>(latencies.size());
+    std::sort(latencies.begin(), latencies.end());
+    result.p95LatencyMs = latencies.empty() ? 0.0 : latencies[latencies.size() * 95 / 100];
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t images = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    const double callMs = argc > 2 ? std::strtod(argv[2], nullptr) : 8.0;
+    const double imageMs = argc > 3 ? std::strtod(argv[3], nullptr) : 2.0;
+    const long windowMs = argc > 4 ? std::strtol(argv[4], nullptr, 10) : 10;
+
+    const auto callCost = std::chrono::microseconds(static_cast<long>(callMs * 1000.0));
+    const auto imageCost = std::chrono::microseconds(static_cast<long>(imageMs * 1000.0));
+    const auto window = std::chrono::milliseconds(windowMs);
+
+    std::printf("%zu images, %.1f ms per call + %.1f ms per image, window %ld ms\n",
+                images, callMs, imageMs, windowMs);
+
+    double baseline = 0.0;
+    for (std::size_t maxBatch : {1u, 2u, 4u, 8u}) {
+        const RunResult result = run(images, maxBatch, callCost, imageCost, window);
+        const double throughput = result.seconds > 0.0 ? static_cast<double>(images) / result.seconds : 0.0;
+        if (maxBatch == 1) {
+            baseline = throughput;
+        }
+        const double meanBatch = result.stats.batches == 0
+                ? 1.0
+                : static_cast<double>(result.stats.batchedJobs) / static_cast<double>(result.stats.batches);
+        std::printf("batch %zu  %8.1f images/s (x%.2f) | %4llu calls, %.2f per call | "
+                    "latency %7.1f ms (p95 %7.1f)\n",
+                    maxBatch, throughput, baseline > 0.0 ? throughput / baseline : 1.0,
+                    static_cast<unsigned long long>(result.stats.batches), meanBatch,
+                    result.meanLatencyMs, result.p95LatencyMs);
+    }
+    return 0;
+}
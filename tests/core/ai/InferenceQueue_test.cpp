@@ -0,0 +1,301 @@
+#include <gtest/gtest.h>
+
+#include "core/ai/InferenceQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace flykylin;
+using ai::InferenceQueue;
+
+namespace {
+
+constexpr auto kWait = std::chrono::seconds(5);
+
+// Holds the inference thread inside a job until released
+class Gate {
+public:
+    InferenceQueue::Work job(float value)
+    {
+        return [this, value]() -> InferenceQueue::Result {
+            m_entered.set_value();
+            m_release.get_future().wait();
+            return value;
+        };
+    }
+
+    void waitEntered() { ASSERT_EQ(m_entered.get_future().wait_for(kWait), std::future_status::ready); }
+    void release() { m_release.set_value(); }
+
+private:
+    std::promise<void> m_entered;
+    std::promise<void> m_release;
+};
+
+InferenceQueue::Work counted(std::atomic<int>& runs, float value)
+{
+    return [&runs, value]() -> InferenceQueue::Result {
+        ++runs;
+        return value;
+    };
+}
+
+} // namespace
+
+TEST(InferenceQueueTest, RunsJobsAndCallsBack)
+{
+    InferenceQueue queue;
+    std::promise<std::pair<uint64_t, float>> called;
+    auto ticket = queue.submit("a.png", []() -> InferenceQueue::Result { return 0.25f; },
+                               [&called](uint64_t id, InferenceQueue::Result result) {
+                                   called.set_value({id, result.value_or(-1.0f)});
+                               });
+
+    ASSERT_NE(ticket.id, 0u);
+    ASSERT_EQ(ticket.future.wait_for(kWait), std::future_status::ready);
+    EXPECT_EQ(ticket.future.get(), 0.25f);
+    const auto callback = called.get_future().get();
+    EXPECT_EQ(callback.first, ticket.id);
+    EXPECT_EQ(callback.second, 0.25f);
+}
+
+TEST(InferenceQueueTest, SameKeySharesOneRun)
+{
+    InferenceQueue queue;
+    Gate gate;
+    std::atomic<int> runs{0};
+
+    // Running and queued jobs both take new requests for their key
+    auto running = queue.submit("busy.png", gate.job(0.1f));
+    gate.waitEntered();
+    auto joinRunning = queue.submit("busy.png", counted(runs, 0.9f));
+    auto first = queue.submit("emoji.png", counted(runs, 0.5f));
+    auto second = queue.submit("emoji.png", counted(runs, 0.7f));
+    auto unkeyed = queue.submit("", counted(runs, 0.3f));
+    gate.release();
+
+    EXPECT_EQ(running.future.get(), 0.1f);
+    EXPECT_EQ(joinRunning.future.get(), 0.1f);
+    EXPECT_EQ(first.future.get(), 0.5f);
+    EXPECT_EQ(second.future.get(), 0.5f);
+    EXPECT_EQ(unkeyed.future.get(), 0.3f);
+    EXPECT_EQ(runs.load(), 2);
+    EXPECT_EQ(queue.stats().coalesced, 2u);
+    EXPECT_EQ(queue.stats().completed, 3u);
+}
+
+TEST(InferenceQueueTest, RejectsWhenFull)
+{
+    InferenceQueue queue(2);
+    Gate gate;
+    std::atomic<int> runs{0};
+
+    auto running = queue.submit("busy.png", gate.job(0.1f));
+    gate.waitEntered();
+    auto a = queue.submit("a.png", counted(runs, 0.2f));
+    auto b = queue.submit("b.png", counted(runs, 0.3f));
+    auto rejected = queue.submit("c.png", counted(runs, 0.4f));
+    // A full queue still takes requests it can coalesce
+    auto joined = queue.submit("a.png", counted(runs, 0.5f));
+
+    EXPECT_EQ(rejected.id, 0u);
+    ASSERT_EQ(rejected.future.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+    EXPECT_FALSE(rejected.future.get().has_value());
+    EXPECT_NE(joined.id, 0u);
+
+    gate.release();
+    EXPECT_EQ(joined.future.get(), 0.2f);
+    EXPECT_EQ(b.future.get(), 0.3f);
+    EXPECT_EQ(runs.load(), 2);
+    EXPECT_EQ(queue.stats().rejected, 1u);
+}
+
+TEST(InferenceQueueTest, CancelDropsUnwantedJobs)
+{
+    InferenceQueue queue;
+    Gate gate;
+    std::atomic<int> runs{0};
+    std::atomic<int> callbacks{0};
+    auto countCallback = [&callbacks](uint64_t, InferenceQueue::Result) { ++callbacks; };
+
+    auto running = queue.submit("busy.png", gate.job(0.1f), countCallback);
+    gate.waitEntered();
+    auto lonely = queue.submit("lonely.png", counted(runs, 0.2f), countCallback);
+    auto shared1 = queue.submit("shared.png", counted(runs, 0.3f), countCallback);
+    auto shared2 = queue.submit("shared.png", counted(runs, 0.3f), countCallback);
+
+    EXPECT_TRUE(queue.cancel(running.id));
+    EXPECT_TRUE(queue.cancel(lonely.id));
+    EXPECT_TRUE(queue.cancel(shared1.id));
+    EXPECT_FALSE(queue.cancel(shared1.id));
+    EXPECT_EQ(queue.queuedJobs(), 1u);
+
+    EXPECT_FALSE(running.future.get().has_value());
+    EXPECT_FALSE(lonely.future.get().has_value());
+    EXPECT_FALSE(shared1.future.get().has_value());
+
+    gate.release();
+    EXPECT_EQ(shared2.future.get(), 0.3f);
+    EXPECT_EQ(runs.load(), 1);
+    // Only the surviving waiter was called back
+    EXPECT_EQ(callbacks.load(), 1);
+    EXPECT_FALSE(queue.cancel(shared2.id));
+}
+
+TEST(InferenceQueueTest, StopCancelsQueuedAndRejectsNew)
+{
+    Gate gate;
+    std::atomic<int> runs{0};
+    InferenceQueue queue;
+
+    auto running = queue.submit("busy.png", gate.job(0.1f));
+    gate.waitEntered();
+    auto queued = queue.submit("a.png", counted(runs, 0.2f));
+
+    std::thread releaser([&gate]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        gate.release();
+    });
+    queue.stop();
+    releaser.join();
+
+    EXPECT_EQ(running.future.get(), 0.1f);
+    EXPECT_FALSE(queued.future.get().has_value());
+    EXPECT_EQ(runs.load(), 0);
+    EXPECT_EQ(queue.submit("b.png", counted(runs, 0.3f)).id, 0u);
+}
+
+TEST(InferenceQueueTest, ThrowingJobYieldsNoResult)
+{
+    InferenceQueue queue;
+    auto ticket = queue.submit("bad.png", []() -> InferenceQueue::Result {
+        throw std::runtime_error("decode failed");
+    });
+    EXPECT_FALSE(ticket.future.get().has_value());
+}
+
+namespace {
+
+class FakeItem : public InferenceQueue::BatchItem {
+public:
+    explicit FakeItem(float value, bool cached = false)
+        : m_value(value), m_cached(cached)
+    {
+    }
+
+    std::optional<InferenceQueue::Result> prepare() override
+    {
+        if (m_cached) {
+            return InferenceQueue::Result(m_value);
+        }
+        return std::nullopt;
+    }
+
+    float value() const { return m_value; }
+
+private:
+    float m_value;
+    bool m_cached;
+};
+
+// Records batch sizes; answers each item with its own value
+InferenceQueue::BatchRunner recordingRunner(std::vector<std::size_t>& sizes, std::mutex& mutex)
+{
+    return [&sizes, &mutex](const std::vector<InferenceQueue::BatchItem*>& items) {
+        std::vector<InferenceQueue::Result> results;
+        for (auto* item : items) {
+            results.push_back(static_cast<FakeItem*>(item)->value());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        sizes.push_back(items.size());
+        return results;
+    };
+}
+
+} // namespace
+
+TEST(InferenceQueueTest, QueuedBurstRunsAsBatches)
+{
+    InferenceQueue queue;
+    std::vector<std::size_t> sizes;
+    std::mutex mutex;
+    queue.setBatchRunner(recordingRunner(sizes, mutex), 4, std::chrono::milliseconds(5));
+
+    Gate gate;
+    auto running = queue.submit("busy.png", gate.job(0.1f));
+    gate.waitEntered();
+    std::vector<InferenceQueue::Ticket> tickets;
+    for (int i = 0; i < 6; ++i) {
+        tickets.push_back(queue.submit("img" + std::to_string(i) + ".png",
+                                       std::make_shared<FakeItem>(0.1f * i)));
+    }
+    auto cached = queue.submit("cached.png", std::make_shared<FakeItem>(0.9f, true));
+    auto joined = queue.submit("img2.png", std::make_shared<FakeItem>(0.5f));
+    gate.release();
+
+    for (int i = 0; i < 6; ++i) {
+        EXPECT_EQ(tickets[i].future.get(), 0.1f * i);
+    }
+    EXPECT_EQ(joined.future.get(), 0.1f * 2);
+    EXPECT_EQ(cached.future.get(), 0.9f);
+
+    // Six model inputs, at most four per run; the cache hit never reaches the runner
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(sizes.size(), 2u);
+    EXPECT_EQ(sizes[0], 4u);
+    EXPECT_EQ(sizes[1], 2u);
+    EXPECT_EQ(queue.stats().batches, 2u);
+    EXPECT_EQ(queue.stats().batchedJobs, 6u);
+}
+
+TEST(InferenceQueueTest, LoneBatchItemDoesNotWait)
+{
+    InferenceQueue queue;
+    std::vector<std::size_t> sizes;
+    std::mutex mutex;
+    queue.setBatchRunner(recordingRunner(sizes, mutex), 8, std::chrono::seconds(10));
+
+    auto ticket = queue.submit("a.png", std::make_shared<FakeItem>(0.4f));
+    ASSERT_EQ(ticket.future.wait_for(kWait), std::future_status::ready);
+    EXPECT_EQ(ticket.future.get(), 0.4f);
+}
+
+TEST(InferenceQueueTest, CancelledBatchItemSkipsRunner)
+{
+    InferenceQueue queue;
+    std::vector<std::size_t> sizes;
+    std::mutex mutex;
+    queue.setBatchRunner(recordingRunner(sizes, mutex), 8, std::chrono::milliseconds(5));
+
+    Gate gate;
+    auto running = queue.submit("busy.png", gate.job(0.1f));
+    gate.waitEntered();
+    auto kept = queue.submit("a.png", std::make_shared<FakeItem>(0.2f));
+    auto dropped = queue.submit("b.png", std::make_shared<FakeItem>(0.3f));
+    EXPECT_TRUE(queue.cancel(dropped.id));
+    gate.release();
+
+    EXPECT_EQ(kept.future.get(), 0.2f);
+    EXPECT_FALSE(dropped.future.get().has_value());
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(sizes.size(), 1u);
+    EXPECT_EQ(sizes[0], 1u);
+}
+
+TEST(InferenceQueueTest, BatchRunnerFailureYieldsNoResult)
+{
+    InferenceQueue queue;
+    queue.setBatchRunner([](const std::vector<InferenceQueue::BatchItem*>&) -> std::vector<InferenceQueue::Result> {
+        throw std::runtime_error("session failed");
+    }, 4, std::chrono::milliseconds(1));
+
+    auto ticket = queue.submit("a.png", std::make_shared<FakeItem>(0.2f));
+    EXPECT_FALSE(ticket.future.get().has_value());
+}
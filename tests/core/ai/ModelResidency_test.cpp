@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+
+#include "core/ai/ModelResidency.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace flykylin;
+using ai::MemoryStatus;
+using ai::ModelResidency;
+using ai::ResidentModel;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct FakeModel {
+    std::vector<char> weights = std::vector<char>(1024, 1);
+};
+
+ModelResidency::Options testOptions()
+{
+    ModelResidency::Options options;
+    options.idleUnload = std::chrono::seconds(60);
+    options.pressureGrace = std::chrono::seconds(5);
+    options.sweepInterval = std::chrono::hours(1);  // Tests sweep by hand
+    options.minAvailableBytes = 100ull * 1024 * 1024;
+    options.psiSomeAvg10 = 10.0;
+    return options;
+}
+
+MemoryStatus relaxed()
+{
+    MemoryStatus status;
+    status.availableBytes = 4096ull * 1024 * 1024;
+    status.psiSomeAvg10 = 0.0;
+    return status;
+}
+
+class ModelResidencyTest : public ::testing::Test {
+protected:
+    void SetUp() override { ModelResidency::instance().setOptions(testOptions()); }
+
+    static std::unique_ptr<ResidentModel<FakeModel>> makeModel(const std::string& name, std::atomic<int>* loads)
+    {
+        auto model = std::make_unique<ResidentModel<FakeModel>>(name);
+        model->setLoader([loads]() {
+            ++*loads;
+            return std::make_unique<FakeModel>();
+        });
+        return model;
+    }
+
+    static bool loaded(const std::string& name)
+    {
+        for (const auto& report : ModelResidency::instance().report()) {
+            if (report.name == name) {
+                return report.loaded;
+            }
+        }
+        return false;
+    }
+};
+
+} // namespace
+
+TEST(MemoryStatusTest, ParsesMemAvailable)
+{
+    const std::string meminfo = "MemTotal:        3920140 kB\n"
+                                "MemFree:          211244 kB\n"
+                                "MemAvailable:    1504312 kB\n"
+                                "Buffers:           80180 kB\n";
+    EXPECT_EQ(ai::parseMemAvailable(meminfo), 1504312ull * 1024);
+    EXPECT_FALSE(ai::parseMemAvailable("MemTotal: 3920140 kB\n").has_value());
+}
+
+TEST(MemoryStatusTest, ParsesPeakRss)
+{
+    const std::string status = "VmPeak:   812344 kB\n"
+                               "VmHWM:     96120 kB\n"
+                               "VmRSS:     80004 kB\n";
+    EXPECT_EQ(ai::parseVmHwm(status), 96120ull * 1024);
+    EXPECT_FALSE(ai::parseVmHwm("VmRSS: 80004 kB\n").has_value());
+#if defined(__linux__)
+    EXPECT_GE(ai::peakRssBytes(), ai::currentRssBytes());
+#endif
+}
+
+TEST(MemoryStatusTest, ParsesPsiSomeAvg10)
+{
+    const std::string pressure = "some avg10=12.50 avg60=3.10 avg300=0.71 total=918273\n"
+                                 "full avg10=4.00 avg60=1.00 avg300=0.20 total=31337\n";
+    ASSERT_TRUE(ai::parsePsiSomeAvg10(pressure).has_value());
+    EXPECT_DOUBLE_EQ(*ai::parsePsiSomeAvg10(pressure), 12.5);
+    EXPECT_FALSE(ai::parsePsiSomeAvg10("").has_value());
+}
+
+TEST_F(ModelResidencyTest, LoadsOnFirstAcquireOnly)
+{
+    std::atomic<int> loads{0};
+    auto model = makeModel("lazy", &loads);
+    EXPECT_EQ(loads.load(), 0);
+    EXPECT_FALSE(loaded("lazy"));
+
+    EXPECT_NE(model->acquire(), nullptr);
+    EXPECT_NE(model->acquire(), nullptr);
+    EXPECT_EQ(loads.load(), 1);
+    EXPECT_TRUE(loaded("lazy"));
+}
+
+TEST_F(ModelResidencyTest, UnloadsAfterIdleTimeoutAndReloads)
+{
+    std::atomic<int> loads{0};
+    auto model = makeModel("idle", &loads);
+    model->acquire();
+
+    auto& residency = ModelResidency::instance();
+    EXPECT_TRUE(residency.sweep(Clock::now() + std::chrono::seconds(30), relaxed()).empty());
+    EXPECT_TRUE(loaded("idle"));
+
+    const auto unloaded = residency.sweep(Clock::now() + std::chrono::seconds(61), relaxed());
+    ASSERT_EQ(unloaded.size(), 1u);
+    EXPECT_EQ(unloaded.front(), "idle");
+    EXPECT_FALSE(loaded("idle"));
+
+    EXPECT_NE(model->acquire(), nullptr);
+    EXPECT_EQ(loads.load(), 2);
+}
+
+TEST_F(ModelResidencyTest, MemoryPressureShortensIdleTimeout)
+{
+    std::atomic<int> loads{0};
+    auto model = makeModel("pressure", &loads);
+    model->acquire();
+
+    MemoryStatus lowMemory = relaxed();
+    lowMemory.availableBytes = 50ull * 1024 * 1024;
+    MemoryStatus stalled = relaxed();
+    stalled.psiSomeAvg10 = 25.0;
+
+    auto& residency = ModelResidency::instance();
+    EXPECT_TRUE(residency.underPressure(lowMemory));
+    EXPECT_TRUE(residency.underPressure(stalled));
+    EXPECT_FALSE(residency.underPressure(relaxed()));
+
+    // Just used: even under pressure it gets the grace period
+    EXPECT_TRUE(residency.sweep(Clock::now(), lowMemory).empty());
+    EXPECT_EQ(residency.sweep(Clock::now() + std::chrono::seconds(6), stalled).size(), 1u);
+    EXPECT_FALSE(loaded("pressure"));
+}
+
+TEST_F(ModelResidencyTest, ModelInUseIsKept)
+{
+    std::atomic<int> loads{0};
+    auto model = makeModel("busy", &loads);
+    std::shared_ptr<FakeModel> held = model->acquire();
+
+    MemoryStatus lowMemory = relaxed();
+    lowMemory.availableBytes = 0;
+    EXPECT_TRUE(ModelResidency::instance().sweep(Clock::now() + std::chrono::hours(1), lowMemory).empty());
+    EXPECT_TRUE(loaded("busy"));
+
+    held.reset();
+    EXPECT_EQ(ModelResidency::instance().sweep(Clock::now() + std::chrono::hours(1), lowMemory).size(), 1u);
+}
+
+TEST_F(ModelResidencyTest, ZeroIdleTimeoutKeepsModelsWithoutPressure)
+{
+    ModelResidency::Options options = testOptions();
+    options.idleUnload = std::chrono::seconds(0);
+    ModelResidency::instance().setOptions(options);
+
+    std::atomic<int> loads{0};
+    auto model = makeModel("pinned", &loads);
+    model->acquire();
+    EXPECT_TRUE(ModelResidency::instance().sweep(Clock::now() + std::chrono::hours(24), relaxed()).empty());
+}
+
+TEST_F(ModelResidencyTest, PrefetchLoadsInBackground)
+{
+    std::atomic<int> loads{0};
+    auto model = makeModel("prefetch", &loads);
+    model->prefetch();
+
+    const auto deadline = Clock::now() + std::chrono::seconds(5);
+    while (!loaded("prefetch") && Clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_TRUE(loaded("prefetch"));
+    EXPECT_NE(model->acquire(), nullptr);
+    EXPECT_EQ(loads.load(), 1);
+}
+
+TEST_F(ModelResidencyTest, DestroyingModelDropsPendingPrefetch)
+{
+    std::atomic<int> loads{0};
+    for (int i = 0; i < 50; ++i) {
+        auto model = makeModel("shortlived", &loads);
+        model->prefetch();
+    }
+    EXPECT_FALSE(loaded("shortlived"));
+}
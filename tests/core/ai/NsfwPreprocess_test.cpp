@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "core/ai/NsfwPreprocess.h"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace flykylin;
+using ai::ImageView;
+using ai::PixelLayout;
+using ai::TensorLayout;
+
+namespace {
+
+constexpr float kMeanBgr[3] = {104.0f, 117.0f, 123.0f};
+
+// The same random picture as RGB32 words and as RGB888 bytes
+struct TestImage {
+    int width;
+    int height;
+    std::vector<uint32_t> xrgb;
+    std::vector<uint8_t> rgb;
+
+    TestImage(int w, int h)
+        : width(w)
+        , height(h)
+        , xrgb(static_cast<std::size_t>(w * h))
+        , rgb(static_cast<std::size_t>(w * h * 3))
+    {
+        std::mt19937 random(static_cast<unsigned>(w * 31 + h));
+        for (std::size_t i = 0; i < xrgb.size(); ++i) {
+            const uint32_t r = random() & 0xff;
+            const uint32_t g = random() & 0xff;
+            const uint32_t b = random() & 0xff;
+            xrgb[i] = 0xff000000u | (r << 16) | (g << 8) | b;
+            rgb[i * 3 + 0] = static_cast<uint8_t>(r);
+            rgb[i * 3 + 1] = static_cast<uint8_t>(g);
+            rgb[i * 3 + 2] = static_cast<uint8_t>(b);
+        }
+    }
+
+    ImageView xrgbView() const
+    {
+        return {reinterpret_cast<const uint8_t*>(xrgb.data()), width * 4, PixelLayout::Xrgb32};
+    }
+
+    ImageView rgbView() const { return {rgb.data(), width * 3, PixelLayout::Rgb888}; }
+};
+
+// The RKNN loop NSFWDetector used before the fused kernel (RGB888 -> WCH)
+std::vector<float> referenceWch(const TestImage& image)
+{
+    const int width = image.width;
+    const int height = image.height;
+    std::vector<float> inputData(static_cast<std::size_t>(width * height * 3));
+    for (int h = 0; h < height; ++h) {
+        const uint8_t* line = image.rgb.data() + h * width * 3;
+        for (int w = 0; w < width; ++w) {
+            const float bVal = static_cast<float>(line[w * 3 + 2]) - kMeanBgr[0];
+            const float gVal = static_cast<float>(line[w * 3 + 1]) - kMeanBgr[1];
+            const float rVal = static_cast<float>(line[w * 3 + 0]) - kMeanBgr[2];
+            const std::size_t baseIdx = static_cast<std::size_t>(w * 3 * height);
+            inputData[baseIdx + static_cast<std::size_t>(0 * height + h)] = bVal;
+            inputData[baseIdx + static_cast<std::size_t>(1 * height + h)] = gVal;
+            inputData[baseIdx + static_cast<std::size_t>(2 * height + h)] = rVal;
+        }
+    }
+    return inputData;
+}
+
+// The ONNX loop NSFWDetector used before the fused kernel (crop, RGB888 -> HWC)
+std::vector<float> referenceHwc(const TestImage& image, int left, int top, int width, int height)
+{
+    std::vector<float> inputData(static_cast<std::size_t>(width * height * 3));
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* line = image.rgb.data() + ((top + y) * image.width + left) * 3;
+        for (int x = 0; x < width; ++x) {
+            const int idx = (y * width + x) * 3;
+            inputData[static_cast<std::size_t>(idx + 0)] = static_cast<float>(line[3 * x + 2]) - kMeanBgr[0];
+            inputData[static_cast<std::size_t>(idx + 1)] = static_cast<float>(line[3 * x + 1]) - kMeanBgr[1];
+            inputData[static_cast<std::size_t>(idx + 2)] = static_cast<float>(line[3 * x + 0]) - kMeanBgr[2];
+        }
+    }
+    return inputData;
+}
+
+std::vector<float> fused(const ImageView& view, int x, int y, int width, int height, TensorLayout layout)
+{
+    // Poisoned, so a skipped element cannot match by accident
+    std::vector<float> out(static_cast<std::size_t>(width * height * 3), -1000.0f);
+    ai::preprocessBgr(view, x, y, width, height, kMeanBgr, layout, out.data());
+    return out;
+}
+
+bool bitwiseEqual(const std::vector<float>& a, const std::vector<float>& b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+} // namespace
+
+TEST(NsfwPreprocessTest, WchMatchesRknnLoop)
+{
+    const TestImage image(224, 224);
+    const std::vector<float> expected = referenceWch(image);
+
+    EXPECT_TRUE(bitwiseEqual(fused(image.xrgbView(), 0, 0, 224, 224, TensorLayout::Wch), expected));
+    EXPECT_TRUE(bitwiseEqual(fused(image.rgbView(), 0, 0, 224, 224, TensorLayout::Wch), expected));
+}
+
+TEST(NsfwPreprocessTest, HwcCropMatchesOnnxLoop)
+{
+    const TestImage image(256, 256);
+    const std::vector<float> expected = referenceHwc(image, 16, 16, 224, 224);
+
+    EXPECT_TRUE(bitwiseEqual(fused(image.xrgbView(), 16, 16, 224, 224, TensorLayout::Hwc), expected));
+    EXPECT_TRUE(bitwiseEqual(fused(image.rgbView(), 16, 16, 224, 224, TensorLayout::Hwc), expected));
+}
+
+TEST(NsfwPreprocessTest, OddSizesUseScalarTails)
+{
+    // Neither dimension a multiple of the SIMD block, window off the origin
+    const TestImage image(41, 29);
+    const int left = 3;
+    const int top = 2;
+    const int width = 37;
+    const int height = 23;
+
+    std::vector<float> scalarHwc(static_cast<std::size_t>(width * height * 3));
+    ai::preprocessBgrScalar(image.rgbView(), left, top, width, height, kMeanBgr, TensorLayout::Hwc,
+                            scalarHwc.data());
+    EXPECT_TRUE(bitwiseEqual(scalarHwc, referenceHwc(image, left, top, width, height)));
+    EXPECT_TRUE(bitwiseEqual(fused(image.xrgbView(), left, top, width, height, TensorLayout::Hwc), scalarHwc));
+
+    std::vector<float> scalarWch(static_cast<std::size_t>(width * height * 3));
+    ai::preprocessBgrScalar(image.rgbView(), left, top, width, height, kMeanBgr, TensorLayout::Wch,
+                            scalarWch.data());
+    EXPECT_TRUE(bitwiseEqual(fused(image.xrgbView(), left, top, width, height, TensorLayout::Wch), scalarWch));
+}
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+
+#include "core/ai/NsfwVerdictCache.h"
+
+using namespace flykylin;
+using ai::NsfwVerdictCache;
+
+TEST(NsfwVerdictCacheTest, HitsOnlyForSameContentAndModel)
+{
+    NsfwVerdictCache cache;
+    cache.insert("abc123", "onnx:v1", 0.75f);
+
+    EXPECT_EQ(cache.find("abc123", "onnx:v1"), 0.75f);
+    // A new model must score the image itself
+    EXPECT_FALSE(cache.find("abc123", "onnx:v2").has_value());
+    EXPECT_FALSE(cache.find("def456", "onnx:v1").has_value());
+
+    const auto stats = cache.stats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_NEAR(stats.hitRate(), 1.0 / 3.0, 1e-9);
+}
+
+TEST(NsfwVerdictCacheTest, EvictsLeastRecentlyUsed)
+{
+    NsfwVerdictCache cache(2);
+    cache.insert("a", "v", 0.1f);
+    cache.insert("b", "v", 0.2f);
+    ASSERT_TRUE(cache.find("a", "v").has_value());    // b is now the oldest
+    cache.insert("c", "v", 0.3f);
+
+    EXPECT_TRUE(cache.find("a", "v").has_value());
+    EXPECT_FALSE(cache.find("b", "v").has_value());
+    EXPECT_TRUE(cache.find("c", "v").has_value());
+    EXPECT_EQ(cache.stats().entries, 2u);
+}
+
+TEST(NsfwVerdictCacheTest, InsertRefreshesVerdict)
+{
+    NsfwVerdictCache cache(2);
+    cache.insert("a", "v", 0.1f);
+    cache.insert("b", "v", 0.2f);
+    cache.insert("a", "v", 0.9f);     // Updates and makes a the newest
+    cache.insert("c", "v", 0.3f);
+
+    EXPECT_EQ(cache.find("a", "v"), 0.9f);
+    EXPECT_FALSE(cache.find("b", "v").has_value());
+    EXPECT_EQ(cache.stats().entries, 2u);
+}
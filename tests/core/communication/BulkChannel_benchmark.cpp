@@ -0,0 +1,257 @@
+/**
+ * @file BulkChannel_benchmark.cpp
+ * @brief CPU per GB of the sendfile/splice bulk channel versus protobuf FileChunks
+ *
+ * Usage: flykylin_bulk_benchmark [MB=256]
+ *
+ * Both paths move the same source file (already in the page cache) over
+ * one loopback TCP connection, and the CPU time of the whole process (both
+ * ends) is compared. The protobuf path reproduces FileChunkReader +
+ * sendOutgoingChunk + handleIncomingChunk: pread -> CRC32C -> FileChunk /
+ * TcpMessage serialisation -> send / recv -> parse -> CRC32C -> pwrite.
+ */
+
+#include "core/communication/BulkChannel.h"
+#include "core/communication/Crc32c.h"
+#include "messages.pb.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace flykylin;
+using namespace flykylin::communication;
+
+namespace {
+
+std::vector<char> makePattern(std::size_t size)
+{
+    std::vector<char> data(size);
+    uint32_t x = 0x9e3779b9u;
+    for (std::size_t i = 0; i < size; ++i) {
+        x = x * 1664525u + 1013904223u;
+        data[i] = static_cast<char>(x >> 24);
+    }
+    return data;
+}
+
+std::string tempPath(const char* name)
+{
+    const char* dir = std::getenv("TMPDIR");
+    return std::string(dir && *dir ? dir : "/tmp") + "/" + name;
+}
+
+bool sendAll(int fd, const char* data, std::size_t size)
+{
+    while (size > 0) {
+        const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool recvAll(int fd, char* data, std::size_t size)
+{
+    while (size > 0) {
+        const ssize_t n = ::recv(fd, data, size, 0);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+struct RunResult {
+    bool ok{false};
+    double seconds{0.0};
+    double cpuSeconds{0.0};
+};
+
+RunResult runProtobufChunks(const std::string& sourcePath, const std::string& targetPath,
+                            std::size_t size, std::size_t chunkSize)
+{
+    RunResult result;
+    std::remove(targetPath.c_str());
+    uint16_t port = 0;
+    const int listenFd = BulkChannel::listen(&port);
+    if (listenFd < 0) {
+        return result;
+    }
+
+    std::atomic<bool> receivedOk{true};
+    const std::clock_t cpuStart = std::clock();
+    const auto start = std::chrono::steady_clock::now();
+    std::thread receiver([&]() {
+        std::atomic<bool> cancel{false};
+        const int fd = BulkChannel::accept(listenFd, 5000, cancel, nullptr);
+        const int fileFd = BulkChannel::openTarget(targetPath, size);
+        std::string buffer;
+        for (std::size_t received = 0; received < size;) {
+            uint32_t lengthBe = 0;
+            if (!recvAll(fd, reinterpret_cast<char*>(&lengthBe), 4)) {
+                receivedOk = false;
+                break;
+            }
+            buffer.resize(ntohl(lengthBe));
+            recvAll(fd, &buffer[0], buffer.size());
+            protocol::TcpMessage message;
+            protocol::FileChunk chunk;
+            if (!message.ParseFromString(buffer) || !chunk.ParseFromString(message.payload())
+                || crc32c(chunk.data().data(), chunk.data().size()) != chunk.checksum()) {
+                receivedOk = false;
+                break;
+            }
+            ::pwrite(fileFd, chunk.data().data(), chunk.data().size(), static_cast<off_t>(chunk.offset()));
+            received += chunk.data().size();
+        }
+        BulkChannel::close(fileFd);
+        BulkChannel::close(fd);
+    });
+
+    const int fd = BulkChannel::connect("127.0.0.1", port, 2000);
+    const int fileFd = BulkChannel::openSource(sourcePath);
+    std::vector<char> readBuffer(chunkSize);
+    for (std::size_t offset = 0; offset < size; offset += chunkSize) {
+        ::pread(fileFd, readBuffer.data(), chunkSize, static_cast<off_t>(offset));
+        protocol::FileChunk chunk;
+        chunk.set_transfer_id("transfer-id-0123456789");
+        chunk.set_offset(offset);
+        chunk.set_data(readBuffer.data(), chunkSize);
+        chunk.set_chunk_size(static_cast<uint32_t>(chunkSize));
+        chunk.set_checksum(crc32c(readBuffer.data(), chunkSize));
+        protocol::TcpMessage message;
+        message.set_type(protocol::TcpMessage::FILE_CHUNK);
+        chunk.SerializeToString(message.mutable_payload());
+        std::string frame(4, '\0');
+        message.AppendToString(&frame);
+        const uint32_t lengthBe = htonl(static_cast<uint32_t>(frame.size() - 4));
+        std::memcpy(&frame[0], &lengthBe, 4);
+        if (!sendAll(fd, frame.data(), frame.size())) {
+            break;
+        }
+    }
+    BulkChannel::close(fileFd);
+    receiver.join();
+    BulkChannel::close(fd);
+    BulkChannel::close(listenFd);
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.cpuSeconds = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    result.ok = receivedOk;
+    return result;
+}
+
+RunResult runBulk(const std::string& sourcePath, const std::string& targetPath, std::size_t size)
+{
+    RunResult result;
+    std::remove(targetPath.c_str());
+    constexpr uint64_t kToken = 42;
+    uint16_t port = 0;
+    const int listenFd = BulkChannel::listen(&port);
+    if (listenFd < 0) {
+        return result;
+    }
+
+    std::atomic<uint64_t> receivedBytes{0};
+    std::atomic<bool> receivedOk{false};
+    const std::clock_t cpuStart = std::clock();
+    const auto start = std::chrono::steady_clock::now();
+    std::thread receiver([&]() {
+        std::atomic<bool> cancel{false};
+        const int fd = BulkChannel::accept(listenFd, 5000, cancel, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        const int fileFd = BulkChannel::openTarget(targetPath, size);
+        receivedOk = fileFd >= 0
+            && BulkChannel::receiveRanges(fd, fileFd, size, kToken, cancel,
+                                          [&](const BulkRange& range) { receivedBytes += range.length; });
+        BulkChannel::close(fileFd);
+        BulkChannel::close(fd);
+    });
+
+    const int fd = BulkChannel::connect("127.0.0.1", port, 2000);
+    const int fileFd = BulkChannel::openSource(sourcePath);
+    std::atomic<bool> cancel{false};
+    BulkChannel::sendRanges(fd, fileFd, kToken, {{0, size}}, cancel, nullptr);
+    BulkChannel::close(fileFd);
+    BulkChannel::close(fd);
+    receiver.join();
+    BulkChannel::close(listenFd);
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.cpuSeconds = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    result.ok = receivedOk && receivedBytes == size;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    const std::size_t size = megabytes * 1024 * 1024;
+    constexpr std::size_t kChunk = 1024 * 1024;
+    if (!BulkChannel::isSupported() || size < kChunk) {
+        std::printf("sendfile/splice bulk mode is not available\n");
+        return 0;
+    }
+
+    const std::string sourcePath = tempPath("bulk_bench_source.bin");
+    const std::string targetPath = tempPath("bulk_bench_target.bin");
+    {
+        const std::vector<char> source = makePattern(size);
+        std::ofstream out(sourcePath, std::ios::binary | std::ios::trunc);
+        out.write(source.data(), static_cast<std::streamsize>(source.size()));
+    }
+    {
+        // Warm the page cache
+        std::ifstream in(sourcePath, std::ios::binary);
+        std::vector<char> buffer(kChunk);
+        while (in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()))) {
+        }
+    }
+
+    const double gb = double(size) / (1024.0 * 1024.0 * 1024.0);
+    const RunResult proto = runProtobufChunks(sourcePath, targetPath, size, kChunk);
+    const RunResult bulk = runBulk(sourcePath, targetPath, size);
+    std::remove(sourcePath.c_str());
+    std::remove(targetPath.c_str());
+
+    std::printf("loopback %zu MB\n", megabytes);
+    std::printf("protobuf chunks  %6.3f cpu-s/GB  %8.1f MB/s%s\n", proto.cpuSeconds / gb,
+                size / proto.seconds / 1e6, proto.ok ? "" : "  (FAILED)");
+    std::printf("sendfile/splice  %6.3f cpu-s/GB  %8.1f MB/s%s\n", bulk.cpuSeconds / gb,
+                size / bulk.seconds / 1e6, bulk.ok ? "" : "  (FAILED)");
+    return proto.ok && bulk.ok ? 0 : 1;
+}
+
+#else
+
+int main()
+{
+    std::printf("sendfile/splice bulk mode is Linux only\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,231 @@
+/**
+ * @file BulkChannel_test.cpp
+ * @brief sendfile/splice 直通通道：区间落盘、令牌校验、越界拒绝（CPU/GB 对比见 BulkChannel_benchmark.cpp）
+ */
+
+#include <gtest/gtest.h>
+#include "core/communication/BulkChannel.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace flykylin::communication;
+
+namespace {
+
+std::vector<char> makePattern(std::size_t size)
+{
+    std::vector<char> data(size);
+    uint32_t x = 0x9e3779b9u;
+    for (std::size_t i = 0; i < size; ++i) {
+        x = x * 1664525u + 1013904223u;
+        data[i] = static_cast<char>(x >> 24);
+    }
+    return data;
+}
+
+std::string tempPath(const char* name)
+{
+    return ::testing::TempDir() + name;
+}
+
+void writeFile(const std::string& path, const std::vector<char>& data)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+std::vector<char> readFile(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+struct ReceiveResult {
+    bool ok{false};
+    std::string peerIp;
+    uint64_t bytes{0};
+    int ranges{0};
+};
+
+/// 监听 -> 后台线程接收到 targetPath；返回端口
+uint16_t startReceiver(const std::string& targetPath, uint64_t fileSize, uint64_t token,
+                       ReceiveResult* result, std::thread* worker)
+{
+    uint16_t port = 0;
+    const int listenFd = BulkChannel::listen(&port);
+    EXPECT_GE(listenFd, 0);
+    *worker = std::thread([=]() {
+        std::atomic<bool> cancel{false};
+        const int fd = BulkChannel::accept(listenFd, 5000, cancel, &result->peerIp);
+        BulkChannel::close(listenFd);
+        if (fd < 0) {
+            return;
+        }
+        const int fileFd = BulkChannel::openTarget(targetPath, fileSize);
+        result->ok = fileFd >= 0
+            && BulkChannel::receiveRanges(fd, fileFd, fileSize, token, cancel,
+                                          [result](const BulkRange& range) {
+                                              result->bytes += range.length;
+                                              ++result->ranges;
+                                          });
+        BulkChannel::close(fileFd);
+        BulkChannel::close(fd);
+    });
+    return port;
+}
+
+} // namespace
+
+TEST(BulkChannelTest, RangesLandAtTheirOffsets)
+{
+    if (!BulkChannel::isSupported()) {
+        GTEST_SKIP() << "sendfile/splice bulk mode is Linux only";
+    }
+
+    constexpr std::size_t kSize = 20 * 1024 * 1024 + 12345;
+    const std::vector<char> source = makePattern(kSize);
+    const std::string sourcePath = tempPath("bulk_source.bin");
+    const std::string targetPath = tempPath("bulk_target.bin");
+    writeFile(sourcePath, source);
+    std::remove(targetPath.c_str());
+
+    // 续传场景：只发缺失区间，其中一个跨越多个 kMaxRangeBytes
+    const std::vector<BulkRange> ranges = {
+        {5 * 1024 * 1024, 13 * 1024 * 1024},
+        {0, 1024 * 1024},
+        {kSize - 12345, 12345},
+    };
+
+    ReceiveResult result;
+    std::thread receiver;
+    const uint64_t token = 0x0123456789abcdefULL;
+    const uint16_t port = startReceiver(targetPath, kSize, token, &result, &receiver);
+
+    const int fd = BulkChannel::connect("127.0.0.1", port, 2000);
+    ASSERT_GE(fd, 0);
+    const int fileFd = BulkChannel::openSource(sourcePath);
+    ASSERT_GE(fileFd, 0);
+    std::atomic<bool> cancel{false};
+    uint64_t sentBytes = 0;
+    EXPECT_TRUE(BulkChannel::sendRanges(fd, fileFd, token, ranges, cancel,
+                                        [&](const BulkRange& range) {
+                                            EXPECT_LE(range.length, BulkChannel::kMaxRangeBytes);
+                                            sentBytes += range.length;
+                                        }));
+    BulkChannel::close(fileFd);
+    BulkChannel::close(fd);
+    receiver.join();
+
+    EXPECT_TRUE(result.ok);
+    EXPECT_EQ(result.peerIp, "127.0.0.1");
+    EXPECT_EQ(sentBytes, 14u * 1024 * 1024 + 12345);
+    EXPECT_EQ(result.bytes, sentBytes);
+    EXPECT_EQ(result.ranges, 4);   // 13MB 拆成 8MB + 5MB
+
+    const std::vector<char> target = readFile(targetPath);
+    ASSERT_EQ(target.size(), kSize);
+    for (const BulkRange& range : ranges) {
+        EXPECT_EQ(std::memcmp(target.data() + range.offset, source.data() + range.offset,
+                              range.length), 0)
+            << "offset " << range.offset;
+    }
+    // 未发送的区间保持为空洞
+    EXPECT_EQ(target[2 * 1024 * 1024], 0);
+
+    std::remove(sourcePath.c_str());
+    std::remove(targetPath.c_str());
+}
+
+TEST(BulkChannelTest, RejectsWrongTokenAndOutOfRangeData)
+{
+    if (!BulkChannel::isSupported()) {
+        GTEST_SKIP() << "sendfile/splice bulk mode is Linux only";
+    }
+
+    const std::vector<char> source = makePattern(64 * 1024);
+    const std::string sourcePath = tempPath("bulk_source_small.bin");
+    const std::string targetPath = tempPath("bulk_target_small.bin");
+    writeFile(sourcePath, source);
+    std::atomic<bool> cancel{false};
+
+    // 令牌不符：不写入任何数据
+    {
+        std::remove(targetPath.c_str());
+        ReceiveResult result;
+        std::thread receiver;
+        const uint16_t port = startReceiver(targetPath, source.size(), 1, &result, &receiver);
+        const int fd = BulkChannel::connect("127.0.0.1", port, 2000);
+        ASSERT_GE(fd, 0);
+        const int fileFd = BulkChannel::openSource(sourcePath);
+        BulkChannel::sendRanges(fd, fileFd, 2, {{0, source.size()}}, cancel, nullptr);
+        BulkChannel::close(fileFd);
+        BulkChannel::close(fd);
+        receiver.join();
+        EXPECT_FALSE(result.ok);
+        EXPECT_EQ(result.bytes, 0u);
+    }
+
+    // 区间超出接收端声明的文件大小
+    {
+        std::remove(targetPath.c_str());
+        ReceiveResult result;
+        std::thread receiver;
+        const uint16_t port = startReceiver(targetPath, source.size() / 2, 7, &result, &receiver);
+        const int fd = BulkChannel::connect("127.0.0.1", port, 2000);
+        ASSERT_GE(fd, 0);
+        const int fileFd = BulkChannel::openSource(sourcePath);
+        BulkChannel::sendRanges(fd, fileFd, 7, {{0, source.size()}}, cancel, nullptr);
+        BulkChannel::close(fileFd);
+        BulkChannel::close(fd);
+        receiver.join();
+        EXPECT_FALSE(result.ok);
+        EXPECT_EQ(result.bytes, 0u);
+    }
+
+    std::remove(sourcePath.c_str());
+    std::remove(targetPath.c_str());
+}
+
+TEST(BulkChannelTest, InterruptUnblocksReceiver)
+{
+    if (!BulkChannel::isSupported()) {
+        GTEST_SKIP() << "sendfile/splice bulk mode is Linux only";
+    }
+
+    uint16_t port = 0;
+    const int listenFd = BulkChannel::listen(&port);
+    ASSERT_GE(listenFd, 0);
+    const int client = BulkChannel::connect("127.0.0.1", port, 2000);
+    ASSERT_GE(client, 0);
+    std::atomic<bool> cancel{false};
+    const int server = BulkChannel::accept(listenFd, 2000, cancel, nullptr);
+    ASSERT_GE(server, 0);
+
+    const std::string targetPath = tempPath("bulk_target_idle.bin");
+    const int fileFd = BulkChannel::openTarget(targetPath, 4096);
+    std::atomic<bool> returned{false};
+    std::thread receiver([&]() {
+        BulkChannel::receiveRanges(server, fileFd, 4096, 0, cancel, nullptr);
+        returned = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(returned.load());
+    cancel = true;
+    BulkChannel::interrupt(server);
+    receiver.join();
+    EXPECT_TRUE(returned.load());
+
+    BulkChannel::close(fileFd);
+    BulkChannel::close(server);
+    BulkChannel::close(client);
+    BulkChannel::close(listenFd);
+    std::remove(targetPath.c_str());
+}
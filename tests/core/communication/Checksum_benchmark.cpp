@@ -0,0 +1,88 @@
+/**
+ * @file Checksum_benchmark.cpp
+ * @brief Throughput of the transfer checksums: CRC32C, SHA-256 per implementation, XXH64
+ *
+ * Usage: flykylin_checksum_benchmark [MB per run=128]
+ *
+ * CRC32C guards every chunk, SHA-256 identifies files for the content
+ * store and XXH64 is the cheap pre-filter, so all three run over the same
+ * buffer (4 MB, hashed repeatedly) for comparison.
+ */
+
+#include "core/communication/Crc32c.h"
+#include "core/communication/Sha256.h"
+#include "core/communication/XxHash64.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace flykylin::communication;
+
+namespace {
+
+std::vector<uint8_t> makePattern(std::size_t size)
+{
+    std::vector<uint8_t> data(size);
+    uint32_t x = 0x12345678u;
+    for (std::size_t i = 0; i < size; ++i) {
+        x = x * 1664525u + 1013904223u;
+        data[i] = static_cast<uint8_t>(x >> 24);
+    }
+    return data;
+}
+
+template <typename Fn>
+double measureGBps(const std::vector<uint8_t>& data, int rounds, Fn&& fn)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        fn(data.data(), data.size());
+    }
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(data.size()) * rounds / sec / 1e9;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const long megabytes = argc > 1 ? std::strtol(argv[1], nullptr, 10) : 128;
+    const std::vector<uint8_t> data = makePattern(4 * 1024 * 1024);
+    const int rounds = static_cast<int>(megabytes > 4 ? megabytes / 4 : 1);
+
+    std::printf("%d x 4 MB\n", rounds);
+
+    uint32_t crc = 0;
+    const double crcGbps = measureGBps(data, rounds, [&](const uint8_t* p, std::size_t n) {
+        crc = crc32c(p, n, crc);
+    });
+    const std::string crcLabel = std::string("crc32c (")
+            + (crc32cHardwareAccelerated() ? "hardware" : "software") + ")";
+    std::printf("%-20s %6.2f GB/s  crc %08x\n", crcLabel.c_str(), crcGbps, crc);
+
+    for (auto impl : {Sha256::Implementation::Portable,
+                      Sha256::Implementation::ShaNi,
+                      Sha256::Implementation::ArmV8}) {
+        if (!Sha256::isSupported(impl)) {
+            continue;
+        }
+        Sha256 sha(impl);
+        const double gbps = measureGBps(data, rounds, [&](const uint8_t* p, std::size_t n) {
+            sha.update(p, n);
+        });
+        const std::string label = std::string("sha256 (") + Sha256::implementationName(impl) + ")";
+        std::printf("%-20s %6.2f GB/s  digest %s\n", label.c_str(), gbps,
+                    Sha256::toHex(sha.finish()).substr(0, 16).c_str());
+    }
+
+    XxHash64 xxh;
+    const double xxhGbps = measureGBps(data, rounds, [&](const uint8_t* p, std::size_t n) {
+        xxh.update(p, n);
+    });
+    std::printf("%-20s %6.2f GB/s  digest %016llx\n", "xxh64", xxhGbps,
+                static_cast<unsigned long long>(xxh.digest()));
+    return 0;
+}
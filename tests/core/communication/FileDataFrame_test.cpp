@@ -0,0 +1,65 @@
+/**
+ * @file FileDataFrame_test.cpp
+ * @brief 原始文件数据帧编解码测试（与protobuf FileChunk路径的吞吐对比见 Protocol_benchmark.cpp）
+ */
+
+#include <gtest/gtest.h>
+#include "core/communication/FileDataFrame.h"
+
+using namespace flykylin::communication;
+
+namespace {
+
+uint32_t readLengthWord(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+         | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+} // namespace
+
+TEST(FileDataFrameTest, EncodeDecodeRoundTrip)
+{
+    FileDataHeader header;
+    header.flags = FileDataLast;
+    header.transferIndex = 42;
+    header.offset = 0x123456789ull;
+    header.length = 1000;
+
+    uint8_t prefix[kFileDataPrefixSize];
+    encodeFileDataPrefix(header, prefix);
+
+    const uint32_t lengthWord = readLengthWord(prefix);
+    ASSERT_TRUE(isFileDataFrame(lengthWord));
+    EXPECT_EQ(lengthWord & ~kFileDataFrameMarker, kFileDataHeaderSize + header.length);
+
+    FileDataHeader decoded;
+    ASSERT_TRUE(decodeFileDataHeader(prefix + 4, kFileDataHeaderSize + header.length, decoded));
+    EXPECT_EQ(decoded.transferIndex, 42u);
+    EXPECT_EQ(decoded.offset, 0x123456789ull);
+    EXPECT_EQ(decoded.length, 1000u);
+    EXPECT_TRUE(decoded.isLast());
+}
+
+TEST(FileDataFrameTest, RejectsInconsistentLengthAndVersion)
+{
+    FileDataHeader header;
+    header.length = 16;
+
+    uint8_t prefix[kFileDataPrefixSize];
+    encodeFileDataPrefix(header, prefix);
+
+    FileDataHeader decoded;
+    EXPECT_FALSE(decodeFileDataHeader(prefix + 4, kFileDataHeaderSize + 15, decoded));
+    EXPECT_FALSE(decodeFileDataHeader(prefix + 4, kFileDataHeaderSize - 1, decoded));
+
+    prefix[4] = 0xFF;  // unknown version
+    EXPECT_FALSE(decodeFileDataHeader(prefix + 4, kFileDataHeaderSize + 16, decoded));
+}
+
+TEST(FileDataFrameTest, ProtobufLengthWordsNeverLookLikeFileData)
+{
+    // 普通帧长度远小于2GB，最高位为0
+    EXPECT_FALSE(isFileDataFrame(0));
+    EXPECT_FALSE(isFileDataFrame(1024u * 1024u + 64u));
+}
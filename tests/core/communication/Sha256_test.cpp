@@ -0,0 +1,128 @@
+/**
+ * @file Sha256_test.cpp
+ * @brief SHA-256 / XXH64 正确性（标准向量、分段一致、各实现一致）；吞吐见 Checksum_benchmark.cpp
+ */
+
+#include <gtest/gtest.h>
+#include "core/communication/Sha256.h"
+#include "core/communication/XxHash64.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace flykylin::communication;
+
+namespace {
+
+std::vector<uint8_t> makePattern(std::size_t size)
+{
+    std::vector<uint8_t> data(size);
+    uint32_t x = 0x12345678u;
+    for (std::size_t i = 0; i < size; ++i) {
+        x = x * 1664525u + 1013904223u;
+        data[i] = static_cast<uint8_t>(x >> 24);
+    }
+    return data;
+}
+
+std::string sha256Hex(const std::string& text,
+                      Sha256::Implementation impl = Sha256::Implementation::Auto)
+{
+    Sha256 sha(impl);
+    sha.update(text.data(), text.size());
+    return Sha256::toHex(sha.finish());
+}
+
+std::vector<Sha256::Implementation> supportedImplementations()
+{
+    std::vector<Sha256::Implementation> impls;
+    for (auto impl : {Sha256::Implementation::Portable,
+                      Sha256::Implementation::ShaNi,
+                      Sha256::Implementation::ArmV8}) {
+        if (Sha256::isSupported(impl)) {
+            impls.push_back(impl);
+        }
+    }
+    return impls;
+}
+
+} // namespace
+
+TEST(Sha256Test, KnownVectors)
+{
+    for (auto impl : supportedImplementations()) {
+        SCOPED_TRACE(Sha256::implementationName(impl));
+        EXPECT_EQ(sha256Hex("", impl),
+                  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        EXPECT_EQ(sha256Hex("abc", impl),
+                  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        EXPECT_EQ(sha256Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", impl),
+                  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        EXPECT_EQ(sha256Hex(std::string(1000000, 'a'), impl),
+                  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    }
+}
+
+TEST(Sha256Test, StreamingSplitsAndImplementationsAgree)
+{
+    const std::vector<uint8_t> data = makePattern(10000);
+
+    Sha256 reference(Sha256::Implementation::Portable);
+    reference.update(data.data(), data.size());
+    const Sha256::Digest expected = reference.finish();
+
+    for (auto impl : supportedImplementations()) {
+        for (std::size_t step : {std::size_t(1), std::size_t(7), std::size_t(63),
+                                 std::size_t(64), std::size_t(65), std::size_t(4096)}) {
+            Sha256 sha(impl);
+            for (std::size_t offset = 0; offset < data.size(); offset += step) {
+                sha.update(data.data() + offset, std::min(step, data.size() - offset));
+            }
+            EXPECT_EQ(sha.finish(), expected)
+                << Sha256::implementationName(impl) << " step=" << step;
+        }
+    }
+
+    // 55/56/64 字节处的填充边界
+    for (auto impl : supportedImplementations()) {
+        for (std::size_t len = 50; len <= 130; ++len) {
+            Sha256 a(Sha256::Implementation::Portable);
+            Sha256 b(impl);
+            a.update(data.data(), len);
+            b.update(data.data(), len);
+            ASSERT_EQ(a.finish(), b.finish()) << Sha256::implementationName(impl) << " len=" << len;
+        }
+    }
+}
+
+TEST(Sha256Test, ResetAllowsReuse)
+{
+    Sha256 sha;
+    sha.update("garbage", 7);
+    sha.finish();
+    sha.reset();
+    sha.update("abc", 3);
+    EXPECT_EQ(Sha256::toHex(sha.finish()),
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+TEST(XxHash64Test, KnownVectorsAndStreaming)
+{
+    EXPECT_EQ(XxHash64::hash("", 0), 0xEF46DB3751D8E999ULL);
+    EXPECT_EQ(XxHash64::hash("abc", 3), 0x44BC2CF5AD770999ULL);
+
+    std::vector<uint8_t> data(1024);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i);
+    }
+    EXPECT_EQ(XxHash64::hash(data.data(), data.size()), 0x6F3914F18FE4DF57ULL);
+
+    for (std::size_t step : {std::size_t(1), std::size_t(5), std::size_t(31), std::size_t(33)}) {
+        XxHash64 xxh;
+        for (std::size_t offset = 0; offset < data.size(); offset += step) {
+            xxh.update(data.data() + offset, std::min(step, data.size() - offset));
+        }
+        EXPECT_EQ(xxh.digest(), 0x6F3914F18FE4DF57ULL) << "step=" << step;
+    }
+}
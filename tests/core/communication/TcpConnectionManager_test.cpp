@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QHostAddress>
+#include <QStandardPaths>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTest>
+#include <QUuid>
+
+#include "core/communication/TcpConnection.h"
+#include "core/communication/TcpConnectionManager.h"
+#include "core/database/DatabaseService.h"
+
+using namespace flykylin;
+
+namespace {
+
+/**
+ * @brief Listening end that answers the handshake as a given user
+ *
+ * The accepted socket is wrapped in an inbound TcpConnection, as TcpServer
+ * does, but announces answerAs instead of this process's UserProfile.
+ */
+class FakeRemote
+{
+public:
+    explicit FakeRemote(const QString& answerAs)
+        : m_answerAs(answerAs)
+    {
+        m_server.listen(QHostAddress::LocalHost, 0);
+        QObject::connect(&m_server, &QTcpServer::newConnection, &m_server, [this]() {
+            while (QTcpSocket* socket = m_server.nextPendingConnection()) {
+                ++accepted;
+                delete m_connection;
+                m_connection = new communication::TcpConnection(m_answerAs, socket);
+                m_connection->setLocalUserId(m_answerAs);
+            }
+        });
+    }
+
+    ~FakeRemote() { delete m_connection; }
+
+    quint16 port() const { return m_server.serverPort(); }
+
+    int accepted{0};
+
+private:
+    QString m_answerAs;
+    QTcpServer m_server;
+    communication::TcpConnection* m_connection{nullptr};
+};
+
+/// Sorts after any UUID, so the local side is the one that dials
+QString dialedPeerId()
+{
+    return QStringLiteral("~") + QUuid::createUuid().toString(QUuid::WithoutBraces);
+}
+
+class TcpConnectionManagerTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        if (!QCoreApplication::instance()) {
+            static int argc = 0;
+            static QCoreApplication app(argc, nullptr);
+        }
+        QStandardPaths::setTestModeEnabled(true);
+    }
+
+    static void rememberPeer(const QString& peerId, quint16 port, qint64 lastSeen)
+    {
+        database::DatabaseService::PeerInfo info;
+        info.userId = peerId;
+        info.userName = peerId;
+        info.ipAddress = QStringLiteral("127.0.0.1");
+        info.tcpPort = port;
+        info.lastSeen = lastSeen;
+        database::DatabaseService::instance()->upsertPeer(info);
+    }
+};
+
+} // namespace
+
+// ========== 预热 ==========
+
+TEST_F(TcpConnectionManagerTest, WarmStartSkipsPeersPastTheAgeCutoff)
+{
+    auto* manager = communication::TcpConnectionManager::instance();
+    const QString recentId = dialedPeerId();
+    const QString staleId = dialedPeerId();
+    FakeRemote recent(recentId);
+    FakeRemote stale(staleId);
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    rememberPeer(recentId, recent.port(), now);
+    rememberPeer(staleId, stale.port(), now - 8LL * 24 * 3600 * 1000);
+
+    manager->warmStartFromDatabase();
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return manager->isPeerReady(recentId); }, 5000));
+
+    // The stale address is never dialed
+    QTest::qWait(200);
+    EXPECT_EQ(stale.accepted, 0);
+    EXPECT_FALSE(manager->isPeerReady(staleId));
+
+    manager->disconnectFromPeer(recentId);
+}
+
+// ========== 握手身份校验 ==========
+
+TEST_F(TcpConnectionManagerTest, SomeoneElseAtTheAddressIsDropped)
+{
+    auto* manager = communication::TcpConnectionManager::instance();
+    const QString expectedId = dialedPeerId();
+    FakeRemote impostor(dialedPeerId());
+
+    manager->connectToPeer(expectedId, QStringLiteral("127.0.0.1"), impostor.port());
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return impostor.accepted == 1; }, 5000));
+
+    // The handshake answer names another user: never ready, and not kept around
+    EXPECT_TRUE(QTest::qWaitFor([&]() { return manager->peerAddress(expectedId).isEmpty(); }, 5000));
+    EXPECT_FALSE(manager->isPeerReady(expectedId));
+}
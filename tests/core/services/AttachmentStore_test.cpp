@@ -0,0 +1,312 @@
+#include <gtest/gtest.h>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QUuid>
+
+#ifndef Q_OS_WIN
+#include <sys/stat.h>
+#endif
+
+#include "core/config/UserProfile.h"
+#include "core/database/DatabaseService.h"
+#include "core/services/AttachmentStore.h"
+#include "core/services/FileTransferService.h"
+#include "core/services/MessageService.h"
+#include "messages.pb.h"
+
+using namespace flykylin;
+
+namespace {
+
+QByteArray wrapPayload(protocol::TcpMessage::MessageType type, const std::string& payload)
+{
+    protocol::TcpMessage tcpMsg;
+    tcpMsg.set_protocol_version(1);
+    tcpMsg.set_type(type);
+    tcpMsg.set_sequence(0);
+    tcpMsg.set_payload(payload);
+    tcpMsg.set_timestamp(0);
+
+    QByteArray data(tcpMsg.ByteSizeLong(), Qt::Uninitialized);
+    tcpMsg.SerializeToArray(data.data(), data.size());
+    return data;
+}
+
+QByteArray makeRequest(const QString& transferId,
+                       const QByteArray& content,
+                       const QString& claimedHash,
+                       bool resumable)
+{
+    protocol::FileTransferRequest req;
+    req.set_transfer_id(transferId.toStdString());
+    req.set_from_user_id("sender");
+    req.set_to_user_id("local");
+    req.set_file_name(QStringLiteral("%1.bin").arg(transferId).toStdString());
+    req.set_file_size(static_cast<quint64>(content.size()));
+    req.set_file_hash(claimedHash.toStdString());
+    req.set_mime_type("application/octet-stream");
+    req.set_resumable(resumable);
+    return wrapPayload(protocol::TcpMessage::FILE_REQUEST, req.SerializeAsString());
+}
+
+QByteArray makeLastChunk(const QString& transferId, const QByteArray& content)
+{
+    protocol::FileChunk chunk;
+    chunk.set_transfer_id(transferId.toStdString());
+    chunk.set_offset(0);
+    chunk.set_data(content.constData(), content.size());
+    chunk.set_chunk_size(static_cast<quint32>(content.size()));
+    chunk.set_is_last(true);
+    return wrapPayload(protocol::TcpMessage::FILE_CHUNK, chunk.SerializeAsString());
+}
+
+QString sha256Of(const QByteArray& content)
+{
+    return QString::fromLatin1(QCryptographicHash::hash(content, QCryptographicHash::Sha256).toHex());
+}
+
+bool sameInode(const QString& a, const QString& b)
+{
+#ifdef Q_OS_WIN
+    Q_UNUSED(a);
+    Q_UNUSED(b);
+    return true;    // 硬链接在 Windows 上不比较 inode
+#else
+    struct stat sa;
+    struct stat sb;
+    return ::stat(QFile::encodeName(a).constData(), &sa) == 0
+        && ::stat(QFile::encodeName(b).constData(), &sb) == 0
+        && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+#endif
+}
+
+class AttachmentStoreTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        if (!QCoreApplication::instance()) {
+            static int argc = 0;
+            static QCoreApplication app(argc, nullptr);
+        }
+        QStandardPaths::setTestModeEnabled(true);
+    }
+
+    void SetUp() override
+    {
+        ASSERT_TRUE(m_dir.isValid());
+        store = services::AttachmentStore::instance();
+    }
+
+    /// 每次运行内容都不同，避免命中上一次运行留在库里的条目
+    static QByteArray uniqueContent()
+    {
+        return QByteArray("attachment-") + QUuid::createUuid().toByteArray() + QByteArray(4096, 'x');
+    }
+
+    QString writeFile(const QString& name, const QByteArray& content)
+    {
+        const QString path = m_dir.filePath(name);
+        QFile file(path);
+        file.open(QIODevice::WriteOnly);
+        file.write(content);
+        return path;
+    }
+
+    static QByteArray readFile(const QString& path)
+    {
+        QFile file(path);
+        return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    }
+
+    /// 把条目的入库时间提前到 GC 宽限期之外
+    static void backdateEntry(const QString& sha256, qint64 createdAt)
+    {
+        auto* db = database::DatabaseService::instance();
+        database::DatabaseService::StoredAttachment entry;
+        ASSERT_TRUE(db->loadStoredAttachment(sha256, entry));
+        entry.createdAt = createdAt;
+        db->upsertStoredAttachment(entry);
+    }
+
+    QTemporaryDir m_dir;
+    services::AttachmentStore* store = nullptr;
+};
+
+} // namespace
+
+// ========== 去重与硬链接 ==========
+
+TEST_F(AttachmentStoreTest, AdoptLinksTheFileIntoTheStore)
+{
+    const QByteArray content = uniqueContent();
+    const QString path = writeFile(QStringLiteral("a.bin"), content);
+    const QString sha = sha256Of(content);
+
+    ASSERT_TRUE(store->adopt(sha, path));
+
+    const QString stored = store->find(sha, static_cast<quint64>(content.size()));
+    ASSERT_FALSE(stored.isEmpty());
+    EXPECT_TRUE(stored.startsWith(store->storeDirectory()));
+    EXPECT_TRUE(sameInode(stored, path));
+    EXPECT_EQ(readFile(stored), content);
+
+    // 大小不符不算同一内容
+    EXPECT_TRUE(store->find(sha, static_cast<quint64>(content.size()) + 1).isEmpty());
+}
+
+TEST_F(AttachmentStoreTest, AdoptRejectsMalformedHashes)
+{
+    const QString path = writeFile(QStringLiteral("b.bin"), uniqueContent());
+    EXPECT_FALSE(store->adopt(QStringLiteral("not-a-hash"), path));
+    EXPECT_FALSE(store->adopt(QString(64, QLatin1Char('A')), path));
+}
+
+TEST_F(AttachmentStoreTest, MaterializeHardLinksStoredContent)
+{
+    const QByteArray content = uniqueContent();
+    const QString sha = sha256Of(content);
+    ASSERT_TRUE(store->adopt(sha, writeFile(QStringLiteral("c.bin"), content)));
+
+    const QString target = m_dir.filePath(QStringLiteral("elsewhere/c-copy.bin"));
+    ASSERT_TRUE(store->materialize(sha, static_cast<quint64>(content.size()), target));
+    EXPECT_EQ(readFile(target), content);
+    EXPECT_TRUE(sameInode(target, store->find(sha, static_cast<quint64>(content.size()))));
+
+    // 目标已是同一文件时不重复创建
+    EXPECT_TRUE(store->materialize(sha, static_cast<quint64>(content.size()), target));
+}
+
+TEST_F(AttachmentStoreTest, EditedContentIsDroppedFromTheStore)
+{
+    const QByteArray content = uniqueContent();
+    const QString sha = sha256Of(content);
+    const QString path = writeFile(QStringLiteral("d.bin"), content);
+    ASSERT_TRUE(store->adopt(sha, path));
+
+    // 硬链接共享 inode：就地修改下载文件也改了库里的副本
+    {
+        QFile file(path);
+        ASSERT_TRUE(file.open(QIODevice::Append));
+        file.write("edited");
+    }
+
+    EXPECT_TRUE(store->find(sha, static_cast<quint64>(content.size())).isEmpty());
+    database::DatabaseService::StoredAttachment entry;
+    EXPECT_FALSE(database::DatabaseService::instance()->loadStoredAttachment(sha, entry));
+    EXPECT_FALSE(store->materialize(sha, static_cast<quint64>(content.size()),
+                                    m_dir.filePath(QStringLiteral("d-copy.bin"))));
+}
+
+// ========== 接收端校验 ==========
+
+TEST_F(AttachmentStoreTest, ReceivedFileIsStoredUnderItsActualHash)
+{
+    services::FileTransferService service;
+    service.setDownloadDirectory(m_dir.filePath(QStringLiteral("downloads")));
+    service.setAutoAcceptFiles(true);
+
+    const QByteArray content = uniqueContent();
+    const QString actual = sha256Of(content);
+    // 发送方声称的哈希不可信：指向另一份内容
+    const QString claimed = sha256Of(uniqueContent());
+    const QString id = QUuid::createUuid().toString(QUuid::WithoutBraces);
+
+    QSignalSpy createdSpy(&service, &services::FileTransferService::messageCreated);
+    service.handleIncomingTcpData(QStringLiteral("peer-1"), makeRequest(id, content, claimed, false));
+    service.handleIncomingTcpData(QStringLiteral("peer-1"), makeLastChunk(id, content));
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return createdSpy.count() == 1; }, 5000));
+
+    const quint64 size = static_cast<quint64>(content.size());
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return !store->find(actual, size).isEmpty(); }, 5000));
+    EXPECT_TRUE(store->find(claimed, size).isEmpty());
+}
+
+TEST_F(AttachmentStoreTest, KnownContentIsLinkedInsteadOfTransferred)
+{
+    services::FileTransferService service;
+    service.setDownloadDirectory(m_dir.filePath(QStringLiteral("downloads")));
+    service.setAutoAcceptFiles(true);
+
+    const QByteArray content = uniqueContent();
+    const QString sha = sha256Of(content);
+    ASSERT_TRUE(store->adopt(sha, writeFile(QStringLiteral("known.bin"), content)));
+
+    // 已有的内容：请求一到就完成，不等任何分块
+    const QString id = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    QSignalSpy createdSpy(&service, &services::FileTransferService::messageCreated);
+    QSignalSpy completedSpy(&service, &services::FileTransferService::transferCompleted);
+    service.handleIncomingTcpData(QStringLiteral("peer-1"), makeRequest(id, content, sha, true));
+
+    ASSERT_EQ(createdSpy.count(), 1);
+    ASSERT_EQ(completedSpy.count(), 1);
+    const core::Message message = qvariant_cast<core::Message>(createdSpy.at(0).at(0));
+    EXPECT_EQ(readFile(message.attachmentLocalPath()), content);
+    EXPECT_TRUE(sameInode(message.attachmentLocalPath(),
+                          store->find(sha, static_cast<quint64>(content.size()))));
+}
+
+// ========== 清空记录后的回收 ==========
+
+TEST_F(AttachmentStoreTest, ClearHistoryCollectsOnlyUnreferencedEntries)
+{
+    services::MessageService messageService;
+    auto* db = database::DatabaseService::instance();
+    const QString localUserId = core::UserProfile::instance().userId();
+    const qint64 longAgo = QDateTime::currentMSecsSinceEpoch() - 60 * 60 * 1000;
+
+    const QString clearedPeer = QStringLiteral("peer-") + QUuid::createUuid().toString(QUuid::WithoutBraces);
+    const QString keptPeer = QStringLiteral("peer-") + QUuid::createUuid().toString(QUuid::WithoutBraces);
+
+    struct Entry {
+        QString peerId;
+        QByteArray content;
+        QString sha;
+        QString download;
+        QString messageId;
+    };
+    Entry cleared{clearedPeer, uniqueContent(), QString(), QString(), QString()};
+    Entry kept{keptPeer, uniqueContent(), QString(), QString(), QString()};
+
+    for (Entry* entry : {&cleared, &kept}) {
+        entry->sha = sha256Of(entry->content);
+        entry->messageId = QUuid::createUuid().toString(QUuid::WithoutBraces);
+        entry->download = writeFile(entry->messageId + QStringLiteral(".bin"), entry->content);
+        ASSERT_TRUE(store->adopt(entry->sha, entry->download));
+        backdateEntry(entry->sha, longAgo);
+
+        core::Message message;
+        message.setId(entry->messageId);
+        message.setFromUserId(entry->peerId);
+        message.setToUserId(localUserId);
+        message.setTimestamp(QDateTime::fromMSecsSinceEpoch(longAgo));
+        message.setStatus(core::MessageStatus::Delivered);
+        message.setKind(core::MessageKind::File);
+        message.setContent(entry->messageId);
+        db->appendMessage(message, localUserId);
+        db->addAttachmentRef(entry->sha, entry->messageId, localUserId, longAgo);
+    }
+
+    const QString clearedBlob = store->find(cleared.sha, static_cast<quint64>(cleared.content.size()));
+    ASSERT_FALSE(clearedBlob.isEmpty());
+
+    messageService.clearHistory(clearedPeer);
+
+    database::DatabaseService::StoredAttachment info;
+    EXPECT_FALSE(db->loadStoredAttachment(cleared.sha, info));
+    EXPECT_FALSE(QFileInfo::exists(clearedBlob));
+    // 只删库里自己的链接，用户的下载文件不动
+    EXPECT_EQ(readFile(cleared.download), cleared.content);
+
+    EXPECT_TRUE(db->loadStoredAttachment(kept.sha, info));
+    EXPECT_FALSE(store->find(kept.sha, static_cast<quint64>(kept.content.size())).isEmpty());
+
+    messageService.clearHistory(keptPeer);
+}
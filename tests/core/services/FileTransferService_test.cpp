@@ -1,9 +1,27 @@
 #include <gtest/gtest.h>
+#include <QCoreApplication>
+#include <QFile>
+#include <QHostAddress>
 #include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTcpServer>
+#include <QTcpSocket>
 #include <QTemporaryDir>
+#include <QTest>
 #include <QFileInfo>
+#include <QUuid>
+#include <QtEndian>
 
+#include <functional>
+#include <memory>
+
+#include "core/communication/BulkChannel.h"
+#include "core/communication/Crc32c.h"
+#include "core/communication/TcpConnection.h"
+#include "core/communication/TcpConnectionManager.h"
+#include "core/database/DatabaseService.h"
 #include "core/services/FileTransferService.h"
+#include "core/services/TransferRanges.h"
 #include "messages.pb.h"
 
 using namespace flykylin;
@@ -66,6 +84,331 @@ QByteArray makeFileChunk(const QString& transferId, const QByteArray& bytes)
     return data;
 }
 
+QByteArray wrapPayload(protocol::TcpMessage::MessageType type, const std::string& payload)
+{
+    protocol::TcpMessage tcpMsg;
+    tcpMsg.set_protocol_version(1);
+    tcpMsg.set_type(type);
+    tcpMsg.set_sequence(0);
+    tcpMsg.set_payload(payload);
+    tcpMsg.set_timestamp(0);
+
+    QByteArray data(tcpMsg.ByteSizeLong(), Qt::Uninitialized);
+    tcpMsg.SerializeToArray(data.data(), data.size());
+    return data;
+}
+
+QByteArray makeContent(int size)
+{
+    QByteArray content(size, Qt::Uninitialized);
+    for (int i = 0; i < size; ++i) {
+        content[i] = static_cast<char>((i * 131 + i / 4096) & 0xFF);
+    }
+    return content;
+}
+
+protocol::FileTransferRequest makeResumableRequest(const QString& transferId,
+                                                  const QString& fromUser,
+                                                  quint64 fileSize)
+{
+    protocol::FileTransferRequest req;
+    req.set_transfer_id(transferId.toStdString());
+    req.set_from_user_id(fromUser.toStdString());
+    req.set_to_user_id("local");
+    req.set_file_name(QStringLiteral("%1.bin").arg(transferId).toStdString());
+    req.set_file_size(fileSize);
+    req.set_mime_type("application/octet-stream");
+    req.set_resumable(true);
+    return req;
+}
+
+protocol::FileChunk makeChecksummedChunk(const QString& transferId,
+                                         quint64 offset,
+                                         const QByteArray& bytes,
+                                         quint32 checksum)
+{
+    protocol::FileChunk chunk;
+    chunk.set_transfer_id(transferId.toStdString());
+    chunk.set_offset(offset);
+    chunk.set_data(bytes.constData(), bytes.size());
+    chunk.set_chunk_size(static_cast<quint32>(bytes.size()));
+    chunk.set_checksum(checksum);
+    return chunk;
+}
+
+protocol::FileTransferComplete makeComplete(const QString& transferId, quint32 crc)
+{
+    protocol::FileTransferComplete complete;
+    complete.set_transfer_id(transferId.toStdString());
+    complete.set_crc32c(crc);
+    return complete;
+}
+
+quint32 crcOf(const QByteArray& bytes)
+{
+    return communication::crc32c(bytes.constData(), static_cast<std::size_t>(bytes.size()));
+}
+
+/// Bulk channel token followed by one range header (see BulkChannel.h)
+QByteArray bulkPreamble(quint64 token, quint64 offset, quint64 length)
+{
+    QByteArray bytes(24, Qt::Uninitialized);
+    qToBigEndian<quint64>(token, bytes.data());
+    qToBigEndian<quint64>(offset, bytes.data() + 8);
+    qToBigEndian<quint64>(length, bytes.data() + 16);
+    return bytes;
+}
+
+/**
+ * @brief Receiving end of a real loopback connection
+ *
+ * Listens on 127.0.0.1 and lets TcpConnectionManager dial it, so the
+ * service under test talks to it exactly as to a remote FlyKylin: the
+ * accepted socket is wrapped in an inbound TcpConnection that runs the
+ * handshake and framing. The peer plays the receiver side of the file
+ * protocol and records what arrives.
+ */
+class LoopbackPeer
+{
+public:
+    explicit LoopbackPeer(const QString& peerId)
+        : m_peerId(peerId)
+    {
+        m_server.listen(QHostAddress::LocalHost, 0);
+        QObject::connect(&m_server, &QTcpServer::newConnection, &m_server, [this]() {
+            while (QTcpSocket* socket = m_server.nextPendingConnection()) {
+                attach(socket);
+            }
+        });
+    }
+
+    ~LoopbackPeer()
+    {
+        communication::TcpConnectionManager::instance()->disconnectFromPeer(m_peerId);
+        delete m_connection;
+    }
+
+    QString peerId() const { return m_peerId; }
+
+    bool connect()
+    {
+        auto* manager = communication::TcpConnectionManager::instance();
+        manager->connectToPeer(m_peerId, QStringLiteral("127.0.0.1"), m_server.serverPort());
+        return QTest::qWaitFor([&]() { return manager->isPeerReady(m_peerId); }, 5000);
+    }
+
+    /// Close the accepted side; the manager sees an unexpected disconnect
+    void drop()
+    {
+        delete m_connection;
+        m_connection = nullptr;
+    }
+
+    /// Answer a FILE_REQUEST with whatever is still missing locally
+    void accept(const protocol::FileTransferRequest& request)
+    {
+        if (m_content.size() != static_cast<int>(request.file_size())) {
+            m_content = QByteArray(static_cast<int>(request.file_size()), '\0');
+        }
+        m_transferId = QString::fromStdString(request.transfer_id());
+        m_transferIndex = request.transfer_index();
+        sessionBytes = 0;
+
+        protocol::FileTransferResponse response;
+        response.set_transfer_id(request.transfer_id());
+        response.set_accepted(true);
+        for (const services::ByteRange& range : received.missing(request.file_size())) {
+            protocol::ByteRange* missing = response.add_missing_ranges();
+            missing->set_offset(range.offset);
+            missing->set_length(range.length);
+        }
+        send(protocol::TcpMessage::FILE_RESPONSE, response);
+    }
+
+    void confirm(const QString& transferId)
+    {
+        protocol::FileTransferResponse response;
+        response.set_transfer_id(transferId.toStdString());
+        response.set_accepted(true);
+        response.set_completed(true);
+        send(protocol::TcpMessage::FILE_RESPONSE, response);
+    }
+
+    template <typename Proto>
+    void send(protocol::TcpMessage::MessageType type, const Proto& message)
+    {
+        if (m_connection) {
+            m_connection->sendMessage(wrapPayload(type, message.SerializeAsString()));
+        }
+    }
+
+    /// Play the sender: send one checksummed chunk of content
+    void sendChunk(const QString& transferId, const QByteArray& content, int offset, int size)
+    {
+        const QByteArray bytes = content.mid(offset, size);
+        send(protocol::TcpMessage::FILE_CHUNK,
+             makeChecksummedChunk(transferId, static_cast<quint64>(offset), bytes, crcOf(bytes)));
+    }
+
+    bool waitForResponses(int count)
+    {
+        return QTest::qWaitFor([&]() { return responses.size() >= count; }, 5000);
+    }
+
+    const QByteArray& content() const { return m_content; }
+
+    bool autoAccept{true};
+    bool autoConfirm{true};
+    QList<protocol::FileTransferRequest> requests;
+    QList<protocol::FileTransferResponse> responses;
+    int completes{0};
+    services::TransferRanges received;
+    quint64 dataBytes{0};
+    quint64 sessionBytes{0};
+    std::function<void()> onData;
+
+private:
+    void attach(QTcpSocket* socket)
+    {
+        delete m_connection;
+        m_connection = new communication::TcpConnection(m_peerId, socket);
+        m_connection->setLocalUserId(m_peerId);     // answer the handshake as the dialed user
+        QObject::connect(m_connection, &communication::TcpConnection::messageReceived,
+                         &m_server, [this](const QByteArray& data) { handleMessage(data); });
+        QObject::connect(m_connection, &communication::TcpConnection::fileDataReceived,
+                         &m_server, [this](const communication::FileDataHeader& header,
+                                           const QByteArray& data) {
+            if (header.transferIndex == m_transferIndex) {
+                store(header.offset, data, header.checksum);
+            }
+        }, Qt::DirectConnection);
+    }
+
+    void handleMessage(const QByteArray& data)
+    {
+        protocol::TcpMessage message;
+        if (!message.ParseFromArray(data.constData(), data.size())) {
+            return;
+        }
+        const std::string& payload = message.payload();
+        switch (message.type()) {
+        case protocol::TcpMessage::FILE_REQUEST: {
+            protocol::FileTransferRequest request;
+            request.ParseFromString(payload);
+            requests.append(request);
+            if (autoAccept) {
+                accept(request);
+            }
+            break;
+        }
+        case protocol::TcpMessage::FILE_CHUNK: {
+            protocol::FileChunk chunk;
+            chunk.ParseFromString(payload);
+            if (QString::fromStdString(chunk.transfer_id()) == m_transferId) {
+                store(chunk.offset(), QByteArray::fromStdString(chunk.data()), chunk.checksum());
+            }
+            break;
+        }
+        case protocol::TcpMessage::FILE_COMPLETE: {
+            protocol::FileTransferComplete complete;
+            complete.ParseFromString(payload);
+            ++completes;
+            if (autoConfirm) {
+                confirm(QString::fromStdString(complete.transfer_id()));
+            }
+            break;
+        }
+        case protocol::TcpMessage::FILE_RESPONSE: {
+            protocol::FileTransferResponse response;
+            response.ParseFromString(payload);
+            responses.append(response);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void store(quint64 offset, const QByteArray& data, quint32 checksum)
+    {
+        if (offset + static_cast<quint64>(data.size()) > static_cast<quint64>(m_content.size())
+            || communication::crc32c(data.constData(), data.size()) != checksum
+            || !received.add(offset, static_cast<quint64>(data.size()), checksum)) {
+            return;
+        }
+        m_content.replace(static_cast<int>(offset), data.size(), data);
+        dataBytes += static_cast<quint64>(data.size());
+        sessionBytes += static_cast<quint64>(data.size());
+        if (onData) {
+            onData();
+        }
+    }
+
+    QString m_peerId;
+    QTcpServer m_server;
+    communication::TcpConnection* m_connection{nullptr};
+    QByteArray m_content;
+    QString m_transferId;
+    quint32 m_transferIndex{0};
+};
+
+class FileTransferLoopbackTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        if (!QCoreApplication::instance()) {
+            static int argc = 0;
+            static QCoreApplication app(argc, nullptr);
+        }
+        QStandardPaths::setTestModeEnabled(true);
+    }
+
+    void SetUp() override
+    {
+        ASSERT_TRUE(m_dir.isValid());
+        service = std::make_unique<services::FileTransferService>();
+        service->setDownloadDirectory(m_dir.filePath(QStringLiteral("downloads")));
+    }
+
+    QString writeFile(const QString& name, const QByteArray& content)
+    {
+        const QString path = m_dir.filePath(name);
+        QFile file(path);
+        file.open(QIODevice::WriteOnly);
+        file.write(content);
+        return path;
+    }
+
+    /// sendFile() and return the id of the chat row it created
+    QString send(const LoopbackPeer& peer, const QString& path)
+    {
+        QSignalSpy createdSpy(service.get(), &services::FileTransferService::messageCreated);
+        service->sendFile(peer.peerId(), path);
+        if (createdSpy.count() != 1) {
+            return QString();
+        }
+        const core::Message created = qvariant_cast<core::Message>(createdSpy.at(0).at(0));
+        EXPECT_EQ(created.status(), core::MessageStatus::Sending);
+        return created.id();
+    }
+
+    void restartService()
+    {
+        service.reset();
+        service = std::make_unique<services::FileTransferService>();
+        service->setDownloadDirectory(m_dir.filePath(QStringLiteral("downloads")));
+    }
+
+    static QString uniqueId()
+    {
+        return QUuid::createUuid().toString(QUuid::WithoutBraces);
+    }
+
+    QTemporaryDir m_dir;
+    std::unique_ptr<services::FileTransferService> service;
+};
+
 } // namespace
 
 TEST(FileTransferServiceTest, AutoAcceptImageWritesFileAndEmitsMessage)
@@ -92,7 +435,8 @@ TEST(FileTransferServiceTest, AutoAcceptImageWritesFileAndEmitsMessage)
     QByteArray chunkData = makeFileChunk(transferId, content);
     service.handleIncomingTcpData(QStringLiteral("peer-1"), chunkData);
 
-    ASSERT_EQ(createdSpy.count(), 1);
+    // The rename into place runs on the writer thread
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return createdSpy.count() == 1; }, 5000));
     auto arguments = createdSpy.takeFirst();
     core::Message message = qvariant_cast<core::Message>(arguments.at(0));
 
@@ -104,3 +448,589 @@ TEST(FileTransferServiceTest, AutoAcceptImageWritesFileAndEmitsMessage)
     EXPECT_TRUE(savedInfo.exists());
     EXPECT_EQ(savedInfo.size(), content.size());
 }
+
+TEST_F(FileTransferLoopbackTest, PausedTransferHoldsDataUntilResumed)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-pause"));
+    ASSERT_TRUE(peer.connect());
+
+    const QByteArray content = makeContent(3 * 1024 * 1024 + 123);
+    QSignalSpy completedSpy(service.get(), &services::FileTransferService::transferCompleted);
+    const QString id = send(peer, writeFile(QStringLiteral("pause.bin"), content));
+    ASSERT_FALSE(id.isEmpty());
+
+    service->pauseTransfer(id);
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return !peer.requests.isEmpty(); }, 5000));
+    QTest::qWait(300);
+    EXPECT_EQ(peer.dataBytes, 0u);
+    EXPECT_EQ(completedSpy.count(), 0);
+
+    service->resumeTransfer(id);
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return completedSpy.count() == 1; }, 10000));
+    EXPECT_EQ(completedSpy.at(0).at(0).toString(), id);
+    EXPECT_EQ(qvariant_cast<core::Message>(completedSpy.at(0).at(1)).status(),
+              core::MessageStatus::Sent);
+    EXPECT_EQ(peer.content(), content);
+    EXPECT_EQ(peer.completes, 1);
+}
+
+TEST_F(FileTransferLoopbackTest, CancelFailsTheRowAndStopsSending)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-cancel"));
+    ASSERT_TRUE(peer.connect());
+
+    QSignalSpy failedSpy(service.get(), &services::FileTransferService::transferFailed);
+    QSignalSpy rowFailedSpy(service.get(), &services::FileTransferService::messageFailed);
+    const QString id = send(peer, writeFile(QStringLiteral("cancel.bin"),
+                                            makeContent(2 * 1024 * 1024)));
+    ASSERT_FALSE(id.isEmpty());
+
+    service->pauseTransfer(id);
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return !peer.requests.isEmpty(); }, 5000));
+    service->cancelTransfer(id);
+
+    ASSERT_EQ(failedSpy.count(), 1);
+    EXPECT_EQ(failedSpy.at(0).at(0).toString(), id);
+    EXPECT_EQ(failedSpy.at(0).at(1).toString(), QStringLiteral("Cancelled"));
+    ASSERT_EQ(rowFailedSpy.count(), 1);
+    EXPECT_EQ(qvariant_cast<core::Message>(rowFailedSpy.at(0).at(0)).status(),
+              core::MessageStatus::Failed);
+
+    // Resuming a cancelled transfer is a no-op
+    service->resumeTransfer(id);
+    QTest::qWait(300);
+    EXPECT_EQ(peer.dataBytes, 0u);
+    EXPECT_EQ(peer.completes, 0);
+    EXPECT_EQ(failedSpy.count(), 1);
+}
+
+TEST_F(FileTransferLoopbackTest, CancelTellsTheReceiver)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-cancel-notify"));
+    ASSERT_TRUE(peer.connect());
+    peer.autoAccept = false;
+
+    const QString id = send(peer, writeFile(QStringLiteral("cancel-notify.bin"),
+                                            makeContent(256 * 1024)));
+    ASSERT_FALSE(id.isEmpty());
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return !peer.requests.isEmpty(); }, 5000));
+    service->cancelTransfer(id);
+
+    ASSERT_TRUE(peer.waitForResponses(1));
+    const protocol::FileTransferResponse& cancel = peer.responses.at(0);
+    EXPECT_EQ(cancel.transfer_id(), peer.requests.at(0).transfer_id());
+    EXPECT_FALSE(cancel.accepted());
+    EXPECT_EQ(cancel.reason(), "Cancelled by sender");
+}
+
+TEST_F(FileTransferLoopbackTest, SenderCancelFailsTheIncomingTransfer)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-cancelled-by-sender"));
+    ASSERT_TRUE(peer.connect());
+
+    const int chunk = 64 * 1024;
+    const QByteArray content = makeContent(4 * chunk);
+    const QString id = uniqueId();
+    peer.send(protocol::TcpMessage::FILE_REQUEST,
+              makeResumableRequest(id, QStringLiteral("sender-") + id, content.size()));
+    ASSERT_TRUE(peer.waitForResponses(1));
+    peer.sendChunk(id, content, 0, chunk);
+
+    QSignalSpy failedSpy(service.get(), &services::FileTransferService::transferFailed);
+    protocol::FileTransferResponse cancel;
+    cancel.set_transfer_id(id.toStdString());
+    cancel.set_accepted(false);
+    cancel.set_reason("Cancelled by sender");
+    peer.send(protocol::TcpMessage::FILE_RESPONSE, cancel);
+
+    // Fails (so a preview placeholder can go) and keeps nothing to resume
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return failedSpy.count() == 1; }, 5000));
+    EXPECT_EQ(failedSpy.at(0).at(0).toString(), id);
+    EXPECT_EQ(failedSpy.at(0).at(1).toString(), QStringLiteral("Cancelled by sender"));
+    database::DatabaseService::PartialTransfer partial;
+    EXPECT_FALSE(database::DatabaseService::instance()->loadPartialTransfer(id, partial));
+}
+
+TEST_F(FileTransferLoopbackTest, ShortReadFailsInsteadOfHanging)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-short-read"));
+    peer.autoAccept = false;
+    ASSERT_TRUE(peer.connect());
+
+    QSignalSpy failedSpy(service.get(), &services::FileTransferService::transferFailed);
+    QSignalSpy rowFailedSpy(service.get(), &services::FileTransferService::messageFailed);
+    const QString path = writeFile(QStringLiteral("shrinks.bin"), makeContent(3 * 1024 * 1024));
+    const QString id = send(peer, path);
+    ASSERT_FALSE(id.isEmpty());
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return !peer.requests.isEmpty(); }, 5000));
+
+    // The file shrinks between the request and the first read
+    ASSERT_TRUE(QFile::resize(path, 1024 * 1024 + 512 * 1024));
+    peer.accept(peer.requests.first());
+
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return failedSpy.count() == 1; }, 5000));
+    EXPECT_EQ(failedSpy.at(0).at(0).toString(), id);
+    EXPECT_EQ(failedSpy.at(0).at(1).toString(), QStringLiteral("File changed while sending"));
+    EXPECT_EQ(rowFailedSpy.count(), 1);
+    EXPECT_EQ(peer.completes, 0);
+}
+
+TEST_F(FileTransferLoopbackTest, ReadErrorFailsTheTransfer)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-read-error"));
+    peer.autoAccept = false;
+    ASSERT_TRUE(peer.connect());
+
+    QSignalSpy failedSpy(service.get(), &services::FileTransferService::transferFailed);
+    const QString path = writeFile(QStringLiteral("vanishes.bin"), makeContent(2 * 1024 * 1024));
+    const QString id = send(peer, path);
+    ASSERT_FALSE(id.isEmpty());
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return !peer.requests.isEmpty(); }, 5000));
+
+    ASSERT_TRUE(QFile::remove(path));
+    peer.accept(peer.requests.first());
+
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return failedSpy.count() == 1; }, 5000));
+    EXPECT_EQ(failedSpy.at(0).at(0).toString(), id);
+    EXPECT_EQ(failedSpy.at(0).at(1).toString(), QStringLiteral("Failed to read from file"));
+    EXPECT_EQ(peer.completes, 0);
+}
+
+// ========== 断点续传 ==========
+
+TEST_F(FileTransferLoopbackTest, ResumeAfterDisconnectSendsOnlyMissingRanges)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-resume"));
+    ASSERT_TRUE(peer.connect());
+
+    const QByteArray content = makeContent(16 * 1024 * 1024 + 77);
+    QSignalSpy completedSpy(service.get(), &services::FileTransferService::transferCompleted);
+    const QString id = send(peer, writeFile(QStringLiteral("resume.bin"), content));
+    ASSERT_FALSE(id.isEmpty());
+
+    // Hold the sender once data starts landing, then cut the connection
+    bool held = false;
+    peer.onData = [&]() {
+        if (!held) {
+            held = true;
+            service->pauseTransfer(id);
+        }
+    };
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return held; }, 5000));
+    QTest::qWait(200);
+    const quint64 before = peer.received.coveredBytes();
+    ASSERT_GT(before, 0u);
+    ASSERT_LT(before, static_cast<quint64>(content.size()));
+    peer.drop();
+
+    // The manager reconnects and the sender asks again under the same id
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return peer.requests.size() == 2; }, 10000));
+    EXPECT_EQ(peer.requests.at(1).transfer_id(), peer.requests.at(0).transfer_id());
+    service->resumeTransfer(id);
+
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return completedSpy.count() == 1; }, 10000));
+    EXPECT_EQ(peer.content(), content);
+    EXPECT_EQ(peer.sessionBytes, static_cast<quint64>(content.size()) - before);
+}
+
+TEST_F(FileTransferLoopbackTest, ReceiverAsksAgainForChunksWithBadChecksums)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-bad-chunk"));
+    ASSERT_TRUE(peer.connect());
+
+    const int chunk = 64 * 1024;
+    const QByteArray content = makeContent(3 * chunk);
+    const QString id = uniqueId();
+    QSignalSpy createdSpy(service.get(), &services::FileTransferService::messageCreated);
+
+    peer.send(protocol::TcpMessage::FILE_REQUEST,
+              makeResumableRequest(id, QStringLiteral("sender-") + id, content.size()));
+    ASSERT_TRUE(peer.waitForResponses(1));
+    ASSERT_TRUE(peer.responses.at(0).accepted());
+    ASSERT_EQ(peer.responses.at(0).missing_ranges_size(), 1);
+    EXPECT_EQ(peer.responses.at(0).missing_ranges(0).length(), static_cast<quint64>(content.size()));
+
+    peer.sendChunk(id, content, 0, chunk);
+    QByteArray corrupted = content.mid(chunk, chunk);
+    const quint32 goodCrc = crcOf(corrupted);
+    corrupted[100] = static_cast<char>(corrupted[100] ^ 0x5A);
+    peer.send(protocol::TcpMessage::FILE_CHUNK,
+              makeChecksummedChunk(id, static_cast<quint64>(chunk), corrupted, goodCrc));
+    peer.sendChunk(id, content, 2 * chunk, chunk);
+    peer.send(protocol::TcpMessage::FILE_COMPLETE, makeComplete(id, crcOf(content)));
+
+    // Only the corrupted chunk is requested again
+    ASSERT_TRUE(peer.waitForResponses(2));
+    const protocol::FileTransferResponse& retry = peer.responses.at(1);
+    EXPECT_TRUE(retry.accepted());
+    EXPECT_FALSE(retry.completed());
+    ASSERT_EQ(retry.missing_ranges_size(), 1);
+    EXPECT_EQ(retry.missing_ranges(0).offset(), static_cast<quint64>(chunk));
+    EXPECT_EQ(retry.missing_ranges(0).length(), static_cast<quint64>(chunk));
+
+    peer.sendChunk(id, content, chunk, chunk);
+    peer.send(protocol::TcpMessage::FILE_COMPLETE, makeComplete(id, crcOf(content)));
+    ASSERT_TRUE(peer.waitForResponses(3));
+    EXPECT_TRUE(peer.responses.at(2).completed());
+
+    ASSERT_GE(createdSpy.count(), 1);
+    const core::Message message = qvariant_cast<core::Message>(createdSpy.last().at(0));
+    QFile received(message.attachmentLocalPath());
+    ASSERT_TRUE(received.open(QIODevice::ReadOnly));
+    EXPECT_EQ(received.readAll(), content);
+}
+
+TEST_F(FileTransferLoopbackTest, WholeFileChecksumMismatchRefetchesOnceThenRejects)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-bad-file"));
+    ASSERT_TRUE(peer.connect());
+
+    const int chunk = 64 * 1024;
+    const QByteArray content = makeContent(2 * chunk);
+    const QString id = uniqueId();
+    QSignalSpy failedSpy(service.get(), &services::FileTransferService::transferFailed);
+
+    peer.send(protocol::TcpMessage::FILE_REQUEST,
+              makeResumableRequest(id, QStringLiteral("sender-") + id, content.size()));
+    ASSERT_TRUE(peer.waitForResponses(1));
+
+    // Every chunk checks out but the sender's whole-file CRC does not
+    for (int round = 0; round < 2; ++round) {
+        peer.sendChunk(id, content, 0, chunk);
+        peer.sendChunk(id, content, chunk, chunk);
+        peer.send(protocol::TcpMessage::FILE_COMPLETE, makeComplete(id, crcOf(content) ^ 1u));
+        ASSERT_TRUE(peer.waitForResponses(round + 2));
+    }
+
+    // First mismatch: all ranges are dropped and asked for again
+    const protocol::FileTransferResponse& refetch = peer.responses.at(1);
+    EXPECT_TRUE(refetch.accepted());
+    ASSERT_EQ(refetch.missing_ranges_size(), 1);
+    EXPECT_EQ(refetch.missing_ranges(0).offset(), 0u);
+    EXPECT_EQ(refetch.missing_ranges(0).length(), static_cast<quint64>(content.size()));
+
+    // Second mismatch: rejected
+    EXPECT_FALSE(peer.responses.at(2).accepted());
+    ASSERT_EQ(failedSpy.count(), 1);
+    EXPECT_EQ(failedSpy.at(0).at(0).toString(), id);
+
+    database::DatabaseService::PartialTransfer partial;
+    EXPECT_FALSE(database::DatabaseService::instance()->loadPartialTransfer(id, partial));
+}
+
+TEST_F(FileTransferLoopbackTest, RestartResumesFromPersistedRanges)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-restart"));
+    ASSERT_TRUE(peer.connect());
+
+    const int chunk = 64 * 1024;
+    const QByteArray content = makeContent(4 * chunk);
+    const QString id = uniqueId();
+    const protocol::FileTransferRequest request =
+        makeResumableRequest(id, QStringLiteral("sender-") + id, content.size());
+
+    peer.send(protocol::TcpMessage::FILE_REQUEST, request);
+    ASSERT_TRUE(peer.waitForResponses(1));
+    peer.sendChunk(id, content, 0, chunk);
+    peer.sendChunk(id, content, 2 * chunk, chunk);
+    peer.send(protocol::TcpMessage::FILE_COMPLETE, makeComplete(id, crcOf(content)));
+    ASSERT_TRUE(peer.waitForResponses(2));
+
+    // The row only records ranges once the writer has them on disk
+    auto* db = database::DatabaseService::instance();
+    ASSERT_TRUE(QTest::qWaitFor([&]() {
+        database::DatabaseService::PartialTransfer partial;
+        services::TransferRanges ranges;
+        return db->loadPartialTransfer(id, partial)
+            && services::TransferRanges::deserialize(partial.receivedRanges.toStdString(), ranges)
+            && ranges.coveredBytes() == 2u * chunk;
+    }, 5000));
+
+    restartService();
+    QSignalSpy createdSpy(service.get(), &services::FileTransferService::messageCreated);
+
+    // The sender asks again; the new instance answers from the partial_transfers row
+    peer.send(protocol::TcpMessage::FILE_REQUEST, request);
+    ASSERT_TRUE(peer.waitForResponses(3));
+    const protocol::FileTransferResponse& resumed = peer.responses.at(2);
+    EXPECT_TRUE(resumed.accepted());
+    ASSERT_EQ(resumed.missing_ranges_size(), 2);
+    EXPECT_EQ(resumed.missing_ranges(0).offset(), static_cast<quint64>(chunk));
+    EXPECT_EQ(resumed.missing_ranges(1).offset(), static_cast<quint64>(3 * chunk));
+
+    peer.sendChunk(id, content, chunk, chunk);
+    peer.sendChunk(id, content, 3 * chunk, chunk);
+    peer.send(protocol::TcpMessage::FILE_COMPLETE, makeComplete(id, crcOf(content)));
+    ASSERT_TRUE(peer.waitForResponses(4));
+    EXPECT_TRUE(peer.responses.at(3).completed());
+
+    ASSERT_GE(createdSpy.count(), 1);
+    const core::Message message = qvariant_cast<core::Message>(createdSpy.last().at(0));
+    QFile received(message.attachmentLocalPath());
+    ASSERT_TRUE(received.open(QIODevice::ReadOnly));
+    EXPECT_EQ(received.readAll(), content);
+    database::DatabaseService::PartialTransfer partial;
+    EXPECT_FALSE(db->loadPartialTransfer(id, partial));
+}
+
+TEST_F(FileTransferLoopbackTest, ResumeRequestFromAnotherSenderIsRejected)
+{
+    LoopbackPeer owner(QStringLiteral("loopback-owner"));
+    LoopbackPeer intruder(QStringLiteral("loopback-intruder"));
+    ASSERT_TRUE(owner.connect());
+    ASSERT_TRUE(intruder.connect());
+
+    const int chunk = 64 * 1024;
+    const QByteArray content = makeContent(2 * chunk);
+    const QString id = uniqueId();
+
+    owner.send(protocol::TcpMessage::FILE_REQUEST,
+               makeResumableRequest(id, QStringLiteral("owner-") + id, content.size()));
+    ASSERT_TRUE(owner.waitForResponses(1));
+    owner.sendChunk(id, content, 0, chunk);
+
+    intruder.send(protocol::TcpMessage::FILE_REQUEST,
+                  makeResumableRequest(id, QStringLiteral("intruder-") + id, content.size()));
+    ASSERT_TRUE(intruder.waitForResponses(1));
+    EXPECT_FALSE(intruder.responses.at(0).accepted());
+    EXPECT_EQ(intruder.responses.at(0).missing_ranges_size(), 0);
+
+    // The intruder's data goes nowhere; the owner's transfer is untouched
+    const QByteArray forged(2 * chunk, 'x');
+    intruder.sendChunk(id, forged, chunk, chunk);
+    QTest::qWait(100);
+    owner.sendChunk(id, content, chunk, chunk);
+    owner.send(protocol::TcpMessage::FILE_COMPLETE, makeComplete(id, crcOf(content)));
+    ASSERT_TRUE(owner.waitForResponses(2));
+    EXPECT_TRUE(owner.responses.at(1).completed());
+}
+
+TEST_F(FileTransferLoopbackTest, ChunkPastTheEndFailsTheTransfer)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-past-end"));
+    ASSERT_TRUE(peer.connect());
+
+    const int chunk = 64 * 1024;
+    const QByteArray content = makeContent(chunk);
+    const QString id = uniqueId();
+    QSignalSpy failedSpy(service.get(), &services::FileTransferService::transferFailed);
+
+    peer.send(protocol::TcpMessage::FILE_REQUEST,
+              makeResumableRequest(id, QStringLiteral("sender-") + id, content.size()));
+    ASSERT_TRUE(peer.waitForResponses(1));
+    ASSERT_TRUE(peer.responses.at(0).accepted());
+
+    // Well-formed and checksummed, but it would grow the file far past its size
+    peer.send(protocol::TcpMessage::FILE_CHUNK,
+              makeChecksummedChunk(id, 1ull << 40, content, crcOf(content)));
+    ASSERT_TRUE(peer.waitForResponses(2));
+    EXPECT_FALSE(peer.responses.at(1).accepted());
+    ASSERT_EQ(failedSpy.count(), 1);
+    EXPECT_EQ(failedSpy.at(0).at(0).toString(), id);
+
+    database::DatabaseService::PartialTransfer partial;
+    EXPECT_FALSE(database::DatabaseService::instance()->loadPartialTransfer(id, partial));
+}
+
+TEST_F(FileTransferLoopbackTest, OversizedChunkedRequestIsRefused)
+{
+    LoopbackPeer peer(QStringLiteral("loopback-oversized"));
+    ASSERT_TRUE(peer.connect());
+
+    const QString id = uniqueId();
+    QSignalSpy requestedSpy(service.get(), &services::FileTransferService::incomingTransferRequested);
+
+    // Past the chunked limit without the bulk channel: nothing is reserved on disk
+    peer.send(protocol::TcpMessage::FILE_REQUEST,
+              makeResumableRequest(id, QStringLiteral("sender-") + id, 1ull << 40));
+    ASSERT_TRUE(peer.waitForResponses(1));
+    EXPECT_FALSE(peer.responses.at(0).accepted());
+    EXPECT_EQ(peer.responses.at(0).reason(), "File too large");
+    EXPECT_EQ(requestedSpy.count(), 0);
+}
+
+// ========== 群组分发 ==========
+
+TEST_F(FileTransferLoopbackTest, GroupSendReachesEveryMemberWithPerMemberProgress)
+{
+    LoopbackPeer alice(QStringLiteral("loopback-group-a"));
+    LoopbackPeer bob(QStringLiteral("loopback-group-b"));
+    ASSERT_TRUE(alice.connect());
+    ASSERT_TRUE(bob.connect());
+
+    const QByteArray content = makeContent(6 * 1024 * 1024 + 5);
+    const quint64 size = static_cast<quint64>(content.size());
+    const QString messageId = uniqueId();
+    QSignalSpy createdSpy(service.get(), &services::FileTransferService::messageCreated);
+    QSignalSpy completedSpy(service.get(), &services::FileTransferService::transferCompleted);
+    QSignalSpy progressSpy(service.get(), &services::FileTransferService::transferProgress);
+    QSignalSpy memberSpy(service.get(), &services::FileTransferService::memberTransferProgress);
+    QSignalSpy rowFailedSpy(service.get(), &services::FileTransferService::messageFailed);
+
+    service->sendGroupFile({alice.peerId(), bob.peerId()},
+                           writeFile(QStringLiteral("group.bin"), content),
+                           QStringLiteral("group-1"), messageId);
+
+    // One Sending row for the whole group
+    ASSERT_EQ(createdSpy.count(), 1);
+    const core::Message created = qvariant_cast<core::Message>(createdSpy.at(0).at(0));
+    EXPECT_EQ(created.id(), messageId);
+    EXPECT_EQ(created.status(), core::MessageStatus::Sending);
+    EXPECT_TRUE(created.isGroup());
+
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return completedSpy.count() == 2; }, 15000));
+    for (const LoopbackPeer* member : {&alice, &bob}) {
+        ASSERT_EQ(member->requests.size(), 1);
+        EXPECT_EQ(QString::fromStdString(member->requests.at(0).transfer_id()), messageId);
+        EXPECT_TRUE(member->requests.at(0).is_group());
+        EXPECT_EQ(member->content(), content);
+    }
+    for (const QList<QVariant>& completed : completedSpy) {
+        EXPECT_EQ(completed.at(0).toString(), messageId);
+    }
+    EXPECT_EQ(rowFailedSpy.count(), 0);
+
+    // Each member reports its own bytes; the row's progress sums the members
+    QHash<QString, quint64> memberSent;
+    for (const QList<QVariant>& progress : memberSpy) {
+        EXPECT_EQ(progress.at(0).toString(), messageId);
+        EXPECT_EQ(progress.at(3).toULongLong(), size);
+        const QString peerId = progress.at(1).toString();
+        memberSent[peerId] = qMax(memberSent.value(peerId), progress.at(2).toULongLong());
+    }
+    EXPECT_EQ(memberSent.value(alice.peerId()), size);
+    EXPECT_EQ(memberSent.value(bob.peerId()), size);
+
+    // (a member that already finished no longer counts towards the sum)
+    bool summed = false;
+    for (const QList<QVariant>& progress : progressSpy) {
+        EXPECT_EQ(progress.at(0).toString(), messageId);
+        const quint64 total = progress.at(2).toULongLong();
+        EXPECT_TRUE(total == size || total == 2 * size);
+        EXPECT_LE(progress.at(1).toULongLong(), total);
+        summed = summed || total == 2 * size;
+    }
+    EXPECT_TRUE(summed);
+}
+
+TEST_F(FileTransferLoopbackTest, GroupRowIsSentWhenOnlySomeMembersFail)
+{
+    LoopbackPeer alice(QStringLiteral("loopback-partial-a"));
+    ASSERT_TRUE(alice.connect());
+
+    const QString messageId = uniqueId();
+    QSignalSpy failedSpy(service.get(), &services::FileTransferService::transferFailed);
+    QSignalSpy rowFailedSpy(service.get(), &services::FileTransferService::messageFailed);
+    QSignalSpy completedSpy(service.get(), &services::FileTransferService::transferCompleted);
+
+    service->sendGroupFile({alice.peerId(), QStringLiteral("loopback-partial-offline")},
+                           writeFile(QStringLiteral("partial.bin"), makeContent(512 * 1024)),
+                           QStringLiteral("group-2"), messageId);
+
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return completedSpy.count() == 1; }, 10000));
+    ASSERT_EQ(failedSpy.count(), 1);
+    EXPECT_EQ(failedSpy.at(0).at(0).toString(), messageId);
+    EXPECT_EQ(failedSpy.at(0).at(1).toString(), QStringLiteral("Peer not connected"));
+    EXPECT_EQ(qvariant_cast<core::Message>(completedSpy.at(0).at(1)).status(),
+              core::MessageStatus::Sent);
+    EXPECT_EQ(rowFailedSpy.count(), 0);
+}
+
+// ========== 直通通道 ==========
+
+TEST_F(FileTransferLoopbackTest, BulkConnectionFromAnotherAddressIsRefused)
+{
+    if (!communication::BulkChannel::isSupported()) {
+        GTEST_SKIP() << "Bulk channel not supported on this platform";
+    }
+
+    LoopbackPeer peer(QStringLiteral("loopback-bulk-foreign"));
+    ASSERT_TRUE(peer.connect());
+
+    const QByteArray content = makeContent(256 * 1024);
+    const QString id = uniqueId();
+    protocol::FileTransferRequest request =
+        makeResumableRequest(id, QStringLiteral("sender-") + id, content.size());
+    request.set_bulk(true);
+
+    peer.send(protocol::TcpMessage::FILE_REQUEST, request);
+    ASSERT_TRUE(peer.waitForResponses(1));
+    const protocol::FileTransferResponse offer = peer.responses.at(0);
+    ASSERT_TRUE(offer.accepted());
+    ASSERT_NE(offer.port(), 0u);
+
+    // The right token from the wrong machine: the sender is 127.0.0.1
+    QTcpSocket foreign;
+    if (!foreign.bind(QHostAddress(QStringLiteral("127.0.0.2")))) {
+        GTEST_SKIP() << "127.0.0.2 is not available";
+    }
+    foreign.connectToHost(QHostAddress::LocalHost, static_cast<quint16>(offer.port()));
+    ASSERT_TRUE(foreign.waitForConnected(2000));
+    foreign.write(bulkPreamble(offer.bulk_token(), 0, content.size()) + content);
+    ASSERT_TRUE(QTest::qWaitFor([&]() {
+        return foreign.state() == QAbstractSocket::UnconnectedState;
+    }, 5000));
+
+    // Nothing it sent counts: the sender is still asked for the whole file
+    peer.send(protocol::TcpMessage::FILE_REQUEST, request);
+    ASSERT_TRUE(peer.waitForResponses(2));
+    const protocol::FileTransferResponse& again = peer.responses.at(1);
+    EXPECT_TRUE(again.accepted());
+    ASSERT_EQ(again.missing_ranges_size(), 1);
+    EXPECT_EQ(again.missing_ranges(0).offset(), 0u);
+    EXPECT_EQ(again.missing_ranges(0).length(), static_cast<quint64>(content.size()));
+}
+
+TEST_F(FileTransferLoopbackTest, DisconnectInterruptsTheBulkReceiver)
+{
+    if (!communication::BulkChannel::isSupported()) {
+        GTEST_SKIP() << "Bulk channel not supported on this platform";
+    }
+
+    LoopbackPeer peer(QStringLiteral("loopback-bulk-drop"));
+    ASSERT_TRUE(peer.connect());
+
+    const int range = 64 * 1024;
+    const QByteArray content = makeContent(4 * range);
+    const QString id = uniqueId();
+    protocol::FileTransferRequest request =
+        makeResumableRequest(id, QStringLiteral("sender-") + id, content.size());
+    request.set_bulk(true);
+
+    peer.send(protocol::TcpMessage::FILE_REQUEST, request);
+    ASSERT_TRUE(peer.waitForResponses(1));
+    const protocol::FileTransferResponse offer = peer.responses.at(0);
+    ASSERT_NE(offer.port(), 0u);
+
+    // One whole range, then a sender that stalls halfway through the next
+    QTcpSocket sender;
+    sender.connectToHost(QHostAddress::LocalHost, static_cast<quint16>(offer.port()));
+    ASSERT_TRUE(sender.waitForConnected(2000));
+    sender.write(bulkPreamble(offer.bulk_token(), 0, range) + content.left(range));
+    QByteArray stalled(16, Qt::Uninitialized);
+    qToBigEndian<quint64>(range, stalled.data());
+    qToBigEndian<quint64>(range, stalled.data() + 8);
+    sender.write(stalled + content.mid(range, range / 2));
+    ASSERT_TRUE(sender.waitForBytesWritten(2000));
+
+    auto* db = database::DatabaseService::instance();
+    const auto persistedBytes = [&]() -> quint64 {
+        database::DatabaseService::PartialTransfer partial;
+        services::TransferRanges ranges;
+        if (!db->loadPartialTransfer(id, partial)
+            || !services::TransferRanges::deserialize(partial.receivedRanges.toStdString(), ranges)) {
+            return 0;
+        }
+        return ranges.coveredBytes();
+    };
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return persistedBytes() == static_cast<quint64>(range); }, 5000));
+
+    // Losing the control connection stops the receiver instead of leaving
+    // it blocked on the stalled socket
+    peer.drop();
+    ASSERT_TRUE(QTest::qWaitFor([&]() {
+        return sender.state() == QAbstractSocket::UnconnectedState;
+    }, 5000));
+    QTest::qWait(100);
+    EXPECT_EQ(persistedBytes(), static_cast<quint64>(range));
+}
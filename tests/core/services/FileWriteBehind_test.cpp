@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+#include <atomic>
+#include <future>
+#include <memory>
+
+#include "core/services/FileWriteBehind.h"
+
+using namespace flykylin;
+
+namespace {
+
+QByteArray makePattern(int size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    for (int i = 0; i < size; ++i) {
+        data[i] = static_cast<char>((i * 31 + 7) & 0xFF);
+    }
+    return data;
+}
+
+QByteArray readAll(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+// finish() only queues the rename; wait for the worker to report it
+bool finishAndWait(services::FileWriteBehind& writer, const QString& transferId, const QString& finalPath)
+{
+    auto done = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = done->get_future();
+    writer.setFinishedCallback([done, transferId, finalPath](const QString& id, const QString& path, bool ok) {
+        if (id == transferId && path == finalPath) {
+            done->set_value(ok);
+        }
+    });
+    writer.finish(transferId, finalPath);
+    return result.get();
+}
+
+} // namespace
+
+TEST(FileWriteBehindTest, OutOfOrderChunksLandAtTheirOffsets)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString finalPath = tempDir.filePath(QStringLiteral("out.bin"));
+    const QString tempPath = finalPath + QStringLiteral(".part");
+
+    const QByteArray content = makePattern(10000);
+    services::FileWriteBehind writer(4096);
+    writer.open(QStringLiteral("t1"), tempPath, static_cast<quint64>(content.size()));
+
+    // Tail first, then head, then middle
+    EXPECT_TRUE(writer.write(QStringLiteral("t1"), 8000, content.constData() + 8000, 2000));
+    EXPECT_TRUE(writer.write(QStringLiteral("t1"), 0, content.constData(), 3000));
+    EXPECT_TRUE(writer.write(QStringLiteral("t1"), 3000, content.constData() + 3000, 5000));
+
+    ASSERT_TRUE(finishAndWait(writer, QStringLiteral("t1"), finalPath));
+    EXPECT_FALSE(QFileInfo::exists(tempPath));
+    EXPECT_EQ(readAll(finalPath), content);
+    EXPECT_EQ(writer.queuedBytes(), 0);
+}
+
+TEST(FileWriteBehindTest, FinishTruncatesPreallocatedTailAndReplacesTarget)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString finalPath = tempDir.filePath(QStringLiteral("out.bin"));
+
+    {
+        QFile existing(finalPath);
+        ASSERT_TRUE(existing.open(QIODevice::WriteOnly));
+        existing.write("old contents that are longer");
+    }
+
+    services::FileWriteBehind writer;
+    writer.open(QStringLiteral("t1"), finalPath + QStringLiteral(".part"), 1024 * 1024);
+    EXPECT_TRUE(writer.write(QStringLiteral("t1"), 0, "short", 5));
+
+    ASSERT_TRUE(finishAndWait(writer, QStringLiteral("t1"), finalPath));
+    EXPECT_EQ(readAll(finalPath), QByteArray("short"));
+}
+
+TEST(FileWriteBehindTest, FinishIsQueuedAndReportedOnce)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString finalPath = tempDir.filePath(QStringLiteral("out.bin"));
+
+    const QByteArray content = makePattern(512 * 1024);
+    std::atomic<int> reports{0};
+    std::atomic<bool> finishedOk{false};
+    {
+        services::FileWriteBehind writer;
+        writer.setFinishedCallback([&](const QString& transferId, const QString& path, bool ok) {
+            EXPECT_EQ(transferId, QStringLiteral("t1"));
+            EXPECT_EQ(path, finalPath);
+            finishedOk = ok;
+            ++reports;
+        });
+        writer.open(QStringLiteral("t1"), finalPath + QStringLiteral(".part"),
+                    static_cast<quint64>(content.size()));
+        EXPECT_TRUE(writer.write(QStringLiteral("t1"), 0, content.constData(), content.size()));
+        writer.finish(QStringLiteral("t1"), finalPath);
+    }   // destructor drains the queue
+
+    EXPECT_EQ(reports.load(), 1);
+    EXPECT_TRUE(finishedOk.load());
+    EXPECT_EQ(readAll(finalPath), content);
+}
+
+TEST(FileWriteBehindTest, AbortRemovesTempFile)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString finalPath = tempDir.filePath(QStringLiteral("out.bin"));
+    const QString tempPath = finalPath + QStringLiteral(".part");
+
+    {
+        services::FileWriteBehind writer;
+        writer.open(QStringLiteral("t1"), tempPath, 100);
+        EXPECT_TRUE(writer.write(QStringLiteral("t1"), 0, "partial", 7));
+        writer.abort(QStringLiteral("t1"));
+    }   // destructor drains the queue
+
+    EXPECT_FALSE(QFileInfo::exists(tempPath));
+    EXPECT_FALSE(QFileInfo::exists(finalPath));
+}
+
+TEST(FileWriteBehindTest, OpenFailureFailsTransfer)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString badPath = tempDir.filePath(QStringLiteral("missing-dir/out.bin"));
+
+    services::FileWriteBehind writer;
+    writer.open(QStringLiteral("t1"), badPath + QStringLiteral(".part"), 0);
+    writer.write(QStringLiteral("t1"), 0, "x", 1);   // may still be queued before the open fails
+    EXPECT_FALSE(finishAndWait(writer, QStringLiteral("t1"), badPath));
+}
+
+TEST(FileWriteBehindTest, SyncConfirmsQueuedChunksAndCloseKeepsTempFile)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString tempPath = tempDir.filePath(QStringLiteral("out.bin.part"));
+
+    const QByteArray content = makePattern(64 * 1024);
+    std::atomic<quint64> syncedSerial{0};
+    std::atomic<bool> syncedOk{false};
+    qint64 sizeAtSync = -1;
+    {
+        services::FileWriteBehind writer;
+        writer.setSyncedCallback([&](const QString& transferId, quint64 serial, bool ok) {
+            EXPECT_EQ(transferId, QStringLiteral("t1"));
+            sizeAtSync = QFileInfo(tempPath).size();
+            syncedOk = ok;
+            syncedSerial = serial;
+        });
+        writer.open(QStringLiteral("t1"), tempPath, 0);
+        EXPECT_TRUE(writer.write(QStringLiteral("t1"), 0, content.constData(), content.size()));
+        writer.sync(QStringLiteral("t1"), 7);
+        writer.close(QStringLiteral("t1"));
+    }   // destructor drains the queue
+
+    EXPECT_EQ(syncedSerial.load(), 7u);
+    EXPECT_TRUE(syncedOk.load());
+    EXPECT_EQ(sizeAtSync, content.size());
+    EXPECT_EQ(readAll(tempPath), content);
+}
+
+TEST(FileWriteBehindTest, SyncReportsFailedTransfer)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+
+    std::atomic<int> reports{0};
+    std::atomic<bool> syncedOk{true};
+    {
+        services::FileWriteBehind writer;
+        writer.setSyncedCallback([&](const QString&, quint64, bool ok) {
+            syncedOk = ok;
+            ++reports;
+        });
+        writer.open(QStringLiteral("t1"),
+                    tempDir.filePath(QStringLiteral("missing-dir/out.bin.part")), 0);
+        writer.write(QStringLiteral("t1"), 0, "x", 1);
+        writer.sync(QStringLiteral("t1"), 1);
+    }
+
+    EXPECT_EQ(reports.load(), 1);
+    EXPECT_FALSE(syncedOk.load());
+}
+
+TEST(FileWriteBehindTest, WritePastTheLimitReportsBacklogInsteadOfBlocking)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString finalPath = tempDir.filePath(QStringLiteral("out.bin"));
+
+    const QByteArray content = makePattern(256 * 1024);
+    services::FileWriteBehind writer(4096);
+    std::atomic<int> drained{0};
+    writer.setDrainedCallback([&drained](const QString& transferId) {
+        EXPECT_EQ(transferId, QStringLiteral("t1"));
+        ++drained;
+    });
+
+    writer.open(QStringLiteral("t1"), finalPath + QStringLiteral(".part"),
+                static_cast<quint64>(content.size()));
+    // Every call returns at once even though each chunk alone exceeds the limit
+    for (int offset = 0; offset < content.size(); offset += 16 * 1024) {
+        EXPECT_TRUE(writer.write(QStringLiteral("t1"), static_cast<quint64>(offset),
+                                 content.constData() + offset, 16 * 1024));
+    }
+
+    ASSERT_TRUE(finishAndWait(writer, QStringLiteral("t1"), finalPath));
+    EXPECT_EQ(readAll(finalPath), content);
+    EXPECT_FALSE(writer.isBacklogged(QStringLiteral("t1")));
+    EXPECT_EQ(writer.queuedBytes(QStringLiteral("t1")), 0);
+    EXPECT_GE(drained.load(), 1);
+}
+
+TEST(FileWriteBehindTest, InterleavedTransfersFinishIndependently)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString bigPath = tempDir.filePath(QStringLiteral("big.bin"));
+    const QString smallPath = tempDir.filePath(QStringLiteral("small.bin"));
+
+    const QByteArray chunk = makePattern(1024 * 1024);
+    services::FileWriteBehind writer;
+    writer.open(QStringLiteral("big"), bigPath + QStringLiteral(".part"), 64 * 1024 * 1024);
+    writer.open(QStringLiteral("small"), smallPath + QStringLiteral(".part"), 5);
+    for (int i = 0; i < 64; ++i) {
+        ASSERT_TRUE(writer.write(QStringLiteral("big"), static_cast<quint64>(i) * chunk.size(),
+                                 chunk.constData(), chunk.size()));
+    }
+    ASSERT_TRUE(writer.write(QStringLiteral("small"), 0, "small", 5));
+
+    // The small transfer is served ahead of the big one's remaining chunks
+    ASSERT_TRUE(finishAndWait(writer, QStringLiteral("small"), smallPath));
+    EXPECT_EQ(readAll(smallPath), QByteArray("small"));
+    EXPECT_EQ(writer.queuedBytes(QStringLiteral("small")), 0);
+
+    ASSERT_TRUE(finishAndWait(writer, QStringLiteral("big"), bigPath));
+    EXPECT_EQ(QFileInfo(bigPath).size(), 64LL * chunk.size());
+    EXPECT_EQ(writer.queuedBytes(), 0);
+}
@@ -0,0 +1,103 @@
+/**
+ * @file ImageProcessor_benchmark.cpp
+ * @brief Image send/preview costs: screenshot transcode and scaled JPEG decode
+ *
+ * Usage: flykylin_image_benchmark [rounds=5]
+ *
+ * Transcode is a 2400x1600 PNG screenshot re-encoded to a 1200 px JPEG, as
+ * sendFileInternal does for large images. Decode compares a full 4000x3000
+ * camera JPEG load with loadScaled() for a 256x256 thumbnail.
+ */
+
+#include "core/services/ImageProcessor.h"
+
+#include <QGuiApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace flykylin;
+
+namespace {
+
+QImage makePhoto(int width, int height, QImage::Format format)
+{
+    QImage image(width, height, format);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const int r = (x * 255) / width;
+            const int g = (y * 255) / height;
+            const int b = ((x / 16 + y / 16) % 2) ? 200 : 60;
+            image.setPixel(x, y, qRgb(r, g, b));
+        }
+    }
+    return image;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    QGuiApplication app(argc, argv);
+    const int rounds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+    if (!QImageReader::supportedImageFormats().contains("jpeg")) {
+        std::printf("no JPEG image plugin\n");
+        return 0;
+    }
+
+    QTemporaryDir tempDir;
+    const QString screenshot = tempDir.filePath(QStringLiteral("screenshot.png"));
+    const QString camera = tempDir.filePath(QStringLiteral("camera.jpg"));
+    QImageWriter writer(camera, "jpeg");
+    writer.setQuality(90);
+    if (!tempDir.isValid()
+        || !makePhoto(2400, 1600, QImage::Format_ARGB32_Premultiplied).save(screenshot)
+        || !writer.write(makePhoto(4000, 3000, QImage::Format_RGB32))) {
+        std::printf("cannot write the test images\n");
+        return 1;
+    }
+
+    services::ImageProcessor::TranscodeOptions options;
+    options.maxDimension = 1200;
+    qint64 encodeMs = 0;
+    qint64 outputBytes = 0;
+    for (int i = 0; i < rounds; ++i) {
+        services::ImageProcessor::Transcoded result;
+        if (!services::ImageProcessor::transcode(screenshot, tempDir.filePath(QStringLiteral("out%1").arg(i)),
+                                                 options, &result)) {
+            std::printf("transcode failed\n");
+            return 1;
+        }
+        encodeMs += result.encodeMs;
+        outputBytes = result.outputBytes;
+    }
+    std::printf("transcode 2400x1600 PNG  %lld -> %lld bytes  %6.1f ms\n",
+                static_cast<long long>(QFileInfo(screenshot).size()),
+                static_cast<long long>(outputBytes), double(encodeMs) / rounds);
+
+    QElapsedTimer timer;
+    qint64 fullMs = 0;
+    qint64 scaledMs = 0;
+    qint64 fullKb = 0;
+    qint64 scaledKb = 0;
+    for (int i = 0; i < rounds; ++i) {
+        timer.start();
+        const QImage full(camera);
+        fullMs += timer.restart();
+        const QImage scaled = services::ImageProcessor::loadScaled(camera, QSize(256, 256));
+        scaledMs += timer.elapsed();
+        fullKb = full.sizeInBytes() / 1024;
+        scaledKb = scaled.sizeInBytes() / 1024;
+    }
+    std::printf("decode 4000x3000 JPEG    full %lld KB %6.1f ms  loadScaled %lld KB %6.1f ms\n",
+                static_cast<long long>(fullKb), double(fullMs) / rounds,
+                static_cast<long long>(scaledKb), double(scaledMs) / rounds);
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include <QBuffer>
+#include <QColor>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QTemporaryDir>
+
+#include "core/services/ImageProcessor.h"
+
+using namespace flykylin;
+
+namespace {
+
+// Smooth gradient with some detail, roughly like a photo for the encoder
+QImage makePhoto(int width, int height, QImage::Format format = QImage::Format_RGB32)
+{
+    QImage image(width, height, format);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const int r = (x * 255) / width;
+            const int g = (y * 255) / height;
+            const int b = ((x / 16 + y / 16) % 2) ? 200 : 60;
+            const int a = format == QImage::Format_ARGB32 ? (x < width / 2 ? 0 : 255) : 255;
+            image.setPixel(x, y, qRgba(r, g, b, a));
+        }
+    }
+    return image;
+}
+
+bool jpegSupported()
+{
+    return QImageWriter::supportedImageFormats().contains("jpeg");
+}
+
+} // namespace
+
+TEST(ImageProcessorTest, PreviewIsSmallThumbnailOfOriginal)
+{
+    if (!jpegSupported()) {
+        GTEST_SKIP() << "No JPEG image plugin";
+    }
+
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString path = tempDir.filePath(QStringLiteral("photo.png"));
+    ASSERT_TRUE(makePhoto(1600, 1200).save(path));
+
+    services::ImageProcessor::Preview preview;
+    ASSERT_TRUE(services::ImageProcessor::makePreview(path, &preview));
+    EXPECT_EQ(preview.originalSize, QSize(1600, 1200));
+    EXPECT_LT(preview.data.size(), 16 * 1024);
+
+    QBuffer buffer(&preview.data);
+    QImageReader reader(&buffer, "jpeg");
+    const QImage thumbnail = reader.read();
+    ASSERT_FALSE(thumbnail.isNull());
+    EXPECT_EQ(thumbnail.size(), QSize(services::ImageProcessor::kPreviewMaxEdge, 120));
+}
+
+TEST(ImageProcessorTest, TransparentImageIsFlattened)
+{
+    if (!jpegSupported()) {
+        GTEST_SKIP() << "No JPEG image plugin";
+    }
+
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString path = tempDir.filePath(QStringLiteral("sticker.png"));
+    ASSERT_TRUE(makePhoto(400, 400, QImage::Format_ARGB32).save(path));
+
+    services::ImageProcessor::Preview preview;
+    ASSERT_TRUE(services::ImageProcessor::makePreview(path, &preview));
+
+    QBuffer buffer(&preview.data);
+    QImageReader reader(&buffer, "jpeg");
+    const QImage thumbnail = reader.read();
+    ASSERT_FALSE(thumbnail.isNull());
+    // Left half was fully transparent: white, not black
+    const QColor corner = thumbnail.pixelColor(2, 2);
+    EXPECT_GT(corner.lightness(), 230);
+}
+
+TEST(ImageProcessorTest, UnreadableFileFails)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+
+    services::ImageProcessor::Preview preview;
+    EXPECT_FALSE(services::ImageProcessor::makePreview(tempDir.filePath(QStringLiteral("missing.png")),
+                                                       &preview));
+}
+
+TEST(ImageProcessorTest, TranscodeShrinksLargeScreenshot)
+{
+    if (!jpegSupported()) {
+        GTEST_SKIP() << "No JPEG image plugin";
+    }
+
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString path = tempDir.filePath(QStringLiteral("screenshot.png"));
+    ASSERT_TRUE(makePhoto(2400, 1600, QImage::Format_ARGB32_Premultiplied).save(path));
+
+    services::ImageProcessor::TranscodeOptions options;
+    options.maxDimension = 1200;
+    services::ImageProcessor::Transcoded result;
+    ASSERT_TRUE(services::ImageProcessor::transcode(path, tempDir.filePath(QStringLiteral("out")),
+                                                    options, &result));
+
+    // Opaque ARGB still becomes JPEG, scaled to the long edge
+    EXPECT_TRUE(result.outputPath.endsWith(QStringLiteral(".jpg")));
+    EXPECT_EQ(result.originalBytes, QFileInfo(path).size());
+    EXPECT_EQ(result.outputBytes, QFileInfo(result.outputPath).size());
+    EXPECT_LT(result.outputBytes * 100,
+              result.originalBytes * (100 - services::ImageProcessor::kMinSavingsPercent));
+    EXPECT_EQ(QImageReader(result.outputPath).size(), QSize(1200, 800));
+}
+
+TEST(ImageProcessorTest, TranscodeKeepsTransparencyAsPng)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString path = tempDir.filePath(QStringLiteral("sticker.png"));
+    ASSERT_TRUE(makePhoto(2000, 2000, QImage::Format_ARGB32).save(path));
+
+    services::ImageProcessor::TranscodeOptions options;
+    options.maxDimension = 500;
+    services::ImageProcessor::Transcoded result;
+    ASSERT_TRUE(services::ImageProcessor::transcode(path, tempDir.filePath(QStringLiteral("out")),
+                                                    options, &result));
+
+    EXPECT_TRUE(result.outputPath.endsWith(QStringLiteral(".png")));
+    const QImage image(result.outputPath);
+    ASSERT_FALSE(image.isNull());
+    EXPECT_EQ(image.size(), QSize(500, 500));
+    EXPECT_EQ(qAlpha(image.pixel(2, 2)), 0);
+}
+
+TEST(ImageProcessorTest, TranscodeSkipsWhenNotSmaller)
+{
+    if (!jpegSupported()) {
+        GTEST_SKIP() << "No JPEG image plugin";
+    }
+
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString path = tempDir.filePath(QStringLiteral("photo.jpg"));
+    QImageWriter writer(path, "jpeg");
+    writer.setQuality(40);
+    ASSERT_TRUE(writer.write(makePhoto(800, 600)));
+
+    // Already small and within the size limit: re-encoding at 85 only grows it
+    services::ImageProcessor::Transcoded result;
+    EXPECT_FALSE(services::ImageProcessor::transcode(path, tempDir.filePath(QStringLiteral("out")),
+                                                     services::ImageProcessor::TranscodeOptions(),
+                                                     &result));
+    EXPECT_FALSE(QFileInfo::exists(tempDir.filePath(QStringLiteral("out.jpg"))));
+    EXPECT_TRUE(result.outputPath.isEmpty());
+}
+
+TEST(ImageProcessorTest, LoadScaledDecodesNearTargetSize)
+{
+    if (!jpegSupported()) {
+        GTEST_SKIP() << "No JPEG image plugin";
+    }
+
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString path = tempDir.filePath(QStringLiteral("camera.jpg"));
+    QImageWriter writer(path, "jpeg");
+    writer.setQuality(90);
+    ASSERT_TRUE(writer.write(makePhoto(4000, 3000)));
+
+    QSize originalSize;
+    const QImage scaled = services::ImageProcessor::loadScaled(path, QSize(256, 256), &originalSize);
+
+    // 1/8 would be 500x375, which still covers 256x256
+    ASSERT_FALSE(scaled.isNull());
+    EXPECT_EQ(scaled.size(), QSize(500, 375));
+    EXPECT_EQ(originalSize, QSize(4000, 3000));
+
+    // Only 1/2 fits when one edge is barely large enough
+    EXPECT_EQ(services::ImageProcessor::loadScaled(path, QSize(0, 1400)).size(), QSize(2000, 1500));
+    EXPECT_EQ(services::ImageProcessor::loadScaled(path, QSize(3000, 0)).size(), QSize(4000, 3000));
+}
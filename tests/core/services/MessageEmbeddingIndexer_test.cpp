@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QSettings>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+#include <QUuid>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "core/database/DatabaseService.h"
+#include "core/models/Message.h"
+#include "core/services/MessageEmbeddingIndexer.h"
+
+using namespace flykylin;
+using database::DatabaseService;
+using services::MessageEmbeddingIndexer;
+
+namespace {
+
+constexpr int kDimensions = 4;
+
+// Same vector for every text: the tests only look at what gets stored
+std::vector<float> fakeEmbedding(const QString&)
+{
+    return {1.0f, 0.5f, 0.25f, 0.125f};
+}
+
+class MessageEmbeddingIndexerTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        if (!QCoreApplication::instance()) {
+            static int argc = 0;
+            static QCoreApplication app(argc, nullptr);
+        }
+        QStandardPaths::setTestModeEnabled(true);
+        QSettings("FlyKylin", "FlyKylin").setValue("search/semanticSearchEnabled", true);
+    }
+
+    static void TearDownTestSuite()
+    {
+        QSettings("FlyKylin", "FlyKylin").remove("search/semanticSearchEnabled");
+    }
+
+    /// Stores a text message and returns its rowid
+    static qint64 appendText(const QString& content)
+    {
+        QSignalSpy appended(DatabaseService::instance(), &DatabaseService::messageAppended);
+        core::Message message;
+        message.setId(QUuid::createUuid().toString(QUuid::WithoutBraces));
+        message.setFromUserId(QStringLiteral("indexer-peer"));
+        message.setToUserId(QStringLiteral("indexer-local"));
+        message.setContent(content);
+        message.setKind(core::MessageKind::Text);
+        message.setTimestamp(QDateTime::currentDateTime());
+        DatabaseService::instance()->appendMessage(message, QStringLiteral("indexer-local"));
+        return appended.isEmpty() ? -1 : appended.first().first().toLongLong();
+    }
+
+    static bool hasVector(const QString& modelVersion, qint64 rowId)
+    {
+        return DatabaseService::instance()->loadMessageEmbeddingRowIds(modelVersion).contains(rowId);
+    }
+};
+
+} // namespace
+
+// ========== 模型版本 ==========
+
+TEST_F(MessageEmbeddingIndexerTest, ModelChangeReplacesStoredVectors)
+{
+    auto* indexer = MessageEmbeddingIndexer::instance();
+    const qint64 rowId = appendText(QStringLiteral("明天下午开会"));
+    ASSERT_GT(rowId, 0);
+
+    indexer->setEmbedder(QStringLiteral("test-model:4:a.onnx:100:1"), kDimensions, fakeEmbedding);
+    indexer->start();
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return hasVector(QStringLiteral("test-model:4:a.onnx:100:1"), rowId); },
+                                15000));
+
+    // Same backend and dimension, different model file: the old vectors go, the message is embedded again
+    indexer->setEmbedder(QStringLiteral("test-model:4:a.onnx:120:2"), kDimensions, fakeEmbedding);
+    indexer->start();
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return hasVector(QStringLiteral("test-model:4:a.onnx:120:2"), rowId); },
+                                15000));
+    EXPECT_TRUE(DatabaseService::instance()->loadMessageEmbeddingRowIds(QStringLiteral("test-model:4:a.onnx:100:1"))
+                    .isEmpty());
+}
+
+// ========== 失败重试 ==========
+
+TEST_F(MessageEmbeddingIndexerTest, FailedEmbeddingIsRetried)
+{
+    auto* indexer = MessageEmbeddingIndexer::instance();
+    const QString version = QStringLiteral("test-retry:4");
+    const QString flaky = QStringLiteral("第一次嵌入会失败的消息");
+    auto attempts = std::make_shared<std::atomic<int>>(0);
+    indexer->setEmbedder(version, kDimensions, [flaky, attempts](const QString& text) {
+        if (text == flaky && attempts->fetch_add(1) == 0) {
+            return std::vector<float>();
+        }
+        return fakeEmbedding(text);
+    });
+
+    const qint64 rowId = appendText(flaky);
+    ASSERT_GT(rowId, 0);
+    indexer->start();
+    ASSERT_TRUE(QTest::qWaitFor([&]() { return attempts->load() >= 1; }, 15000));
+
+    // Nothing is stored for the failure, so a later run picks the message up
+    // again; start() brings that run forward from the retry delay
+    EXPECT_TRUE(QTest::qWaitFor([&]() {
+        indexer->start();
+        return hasVector(version, rowId);
+    }, 15000));
+    EXPECT_EQ(attempts->load(), 2);
+
+    const QList<DatabaseService::MessageEmbedding> stored =
+        DatabaseService::instance()->loadMessageEmbeddings({rowId});
+    ASSERT_EQ(stored.size(), 1);
+    EXPECT_FALSE(stored.first().vector.isEmpty());
+}
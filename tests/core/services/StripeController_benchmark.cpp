@@ -0,0 +1,213 @@
+/**
+ * @file StripeController_benchmark.cpp
+ * @brief Loopback throughput versus stripe count under a per-lane window and simulated RTT
+ *
+ * Usage: flykylin_stripe_benchmark [MB=24] [RTT ms=4] [window KB=256]
+ *
+ * Every lane may only have a fixed window of unacknowledged bytes, and the
+ * receiver acknowledges each chunk one RTT after it was sent. A single
+ * stream is then capped at window/RTT, the same bound a real TCP connection
+ * hits on a lossy or distant link; extra stripes should scale until the
+ * loopback itself is the limit.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+struct LaneHeader {
+    int64_t sentNs;
+    uint32_t length;
+};
+
+bool sendAll(int fd, const void* data, std::size_t size)
+{
+    const auto* p = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool recvAll(int fd, void* data, std::size_t size)
+{
+    auto* p = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t n = ::recv(fd, p, size, 0);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool makeLoopbackPair(int& senderFd, int& receiverFd)
+{
+    const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return false;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+        || ::listen(listener, 1) != 0
+        || ::getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+        ::close(listener);
+        return false;
+    }
+
+    senderFd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (senderFd < 0 || ::connect(senderFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(listener);
+        return false;
+    }
+    receiverFd = ::accept(listener, nullptr, nullptr);
+    ::close(listener);
+
+    const int one = 1;
+    ::setsockopt(senderFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ::setsockopt(receiverFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return receiverFd >= 0;
+}
+
+// Returns bytes/s for totalBytes spread over `stripes` lanes
+double runStripedTransfer(int stripes, uint64_t totalBytes, uint32_t chunkSize,
+                          uint64_t windowBytes, std::chrono::microseconds rtt)
+{
+    std::vector<int> senders(stripes, -1);
+    std::vector<int> receivers(stripes, -1);
+    for (int i = 0; i < stripes; ++i) {
+        if (!makeLoopbackPair(senders[i], receivers[i])) {
+            return 0.0;
+        }
+    }
+
+    std::atomic<uint64_t> nextOffset{0};
+    std::atomic<uint64_t> received{0};
+    const int64_t rttNs = std::chrono::duration_cast<std::chrono::nanoseconds>(rtt).count();
+
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < stripes; ++i) {
+        threads.emplace_back([&, fd = receivers[i]]() {
+            std::vector<char> buffer(chunkSize);
+            LaneHeader header{};
+            while (recvAll(fd, &header, sizeof(header)) && header.length > 0) {
+                if (!recvAll(fd, buffer.data(), header.length)) {
+                    return;
+                }
+                received += header.length;
+                const int64_t due = header.sentNs + rttNs;
+                const int64_t wait = due - nowNs();
+                if (wait > 0) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+                }
+                sendAll(fd, &header.length, sizeof(header.length));
+            }
+        });
+        threads.emplace_back([&, fd = senders[i]]() {
+            std::vector<char> chunk(chunkSize, 'x');
+            uint64_t inFlight = 0;
+            uint32_t ack = 0;
+            for (;;) {
+                const uint64_t offset = nextOffset.fetch_add(chunkSize);
+                if (offset >= totalBytes) {
+                    break;
+                }
+                const auto length = static_cast<uint32_t>(
+                    std::min<uint64_t>(chunkSize, totalBytes - offset));
+                while (inFlight + length > windowBytes && recvAll(fd, &ack, sizeof(ack))) {
+                    inFlight -= ack;
+                }
+                const LaneHeader header{nowNs(), length};
+                if (!sendAll(fd, &header, sizeof(header)) || !sendAll(fd, chunk.data(), length)) {
+                    return;
+                }
+                inFlight += length;
+            }
+            while (inFlight > 0 && recvAll(fd, &ack, sizeof(ack))) {
+                inFlight -= ack;
+            }
+            const LaneHeader done{0, 0};
+            sendAll(fd, &done, sizeof(done));
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    for (int i = 0; i < stripes; ++i) {
+        ::close(senders[i]);
+        ::close(receivers[i]);
+    }
+    return received.load() == totalBytes ? static_cast<double>(totalBytes) / seconds : 0.0;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const uint64_t totalBytes = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 24) * 1024 * 1024;
+    const auto rtt = std::chrono::milliseconds(argc > 2 ? std::atoi(argv[2]) : 4);
+    const uint64_t windowBytes = (argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 256) * 1024;
+    const uint32_t chunkSize = 64 * 1024;
+
+    std::printf("loopback RTT %lld ms, window %llu KB, %llu MB\n",
+                static_cast<long long>(rtt.count()),
+                static_cast<unsigned long long>(windowBytes / 1024),
+                static_cast<unsigned long long>(totalBytes / (1024 * 1024)));
+    bool ok = true;
+    for (int stripes = 1; stripes <= 4; ++stripes) {
+        const double rate = runStripedTransfer(stripes, totalBytes, chunkSize, windowBytes, rtt);
+        ok = ok && rate > 0.0;
+        std::printf("%d stripe(s)  %8.1f MB/s\n", stripes, rate / (1024.0 * 1024.0));
+    }
+    return ok ? 0 : 1;
+}
+
+#else
+
+int main()
+{
+    std::printf("POSIX sockets not available\n");
+    return 0;
+}
+
+#endif
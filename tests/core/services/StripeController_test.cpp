@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include "core/services/StripeController.h"
+
+#include <algorithm>
+
+using namespace flykylin;
+
+namespace {
+
+// Throughput model: each stripe adds perStripe bytes/s up to the link limit
+int runController(services::StripeController& controller,
+                  double perStripe,
+                  double linkLimit,
+                  int samples)
+{
+    for (int i = 0; i < samples; ++i) {
+        const double rate = std::min(perStripe * controller.stripes(), linkLimit);
+        const auto bytes = static_cast<uint64_t>(rate * services::StripeController::kSampleMs / 1000.0);
+        controller.addSample(bytes, services::StripeController::kSampleMs);
+    }
+    return controller.stripes();
+}
+
+} // namespace
+
+TEST(StripeControllerTest, ClimbsWhileThroughputScales)
+{
+    // 100 MB/s per stream, 250 MB/s link: 3 stripes saturate, a 4th gains nothing
+    services::StripeController controller(4, 1);
+    EXPECT_EQ(runController(controller, 100e6, 250e6, 5), 3);
+    EXPECT_NEAR(controller.rate(), 250e6, 1e6);
+}
+
+TEST(StripeControllerTest, BacksOffWhenAnotherStripeDoesNotHelp)
+{
+    // One stream already fills the link (fast LAN)
+    services::StripeController controller(4, 2);
+    EXPECT_EQ(runController(controller, 500e6, 500e6, 3), 2);
+
+    // Periodic re-probes go back again
+    for (int i = 0; i < 4 * services::StripeController::kReprobeSamples; ++i) {
+        runController(controller, 500e6, 500e6, 1);
+        EXPECT_LE(controller.stripes(), 3);
+    }
+    EXPECT_EQ(runController(controller, 500e6, 500e6, 1), 2);
+}
+
+TEST(StripeControllerTest, WaitsForAFullSampleWindowAndRespectsMax)
+{
+    services::StripeController controller(2, 2);
+    EXPECT_EQ(controller.addSample(1000000, 100), 2);
+    EXPECT_EQ(controller.rate(), 0.0);
+
+    EXPECT_EQ(runController(controller, 100e6, 1e9, 10), 2);
+    EXPECT_GT(controller.rate(), 0.0);
+}
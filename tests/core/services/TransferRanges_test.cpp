@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include "core/communication/Crc32c.h"
+#include "core/services/TransferRanges.h"
+
+#include <vector>
+
+using namespace flykylin;
+using flykylin::communication::crc32c;
+
+namespace {
+
+std::vector<uint8_t> makePattern(std::size_t size)
+{
+    std::vector<uint8_t> data(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<uint8_t>(i * 131 + 17);
+    }
+    return data;
+}
+
+} // namespace
+
+TEST(TransferRangesTest, OutOfOrderChunksYieldWholeFileCrc)
+{
+    const std::vector<uint8_t> data = makePattern(10000);
+    services::TransferRanges ranges;
+
+    // [6000,10000), [0,2000), [2000,6000): the last one bridges both neighbours
+    EXPECT_TRUE(ranges.add(6000, 4000, crc32c(data.data() + 6000, 4000)));
+    EXPECT_TRUE(ranges.add(0, 2000, crc32c(data.data(), 2000)));
+    EXPECT_FALSE(ranges.isComplete(data.size()));
+    EXPECT_TRUE(ranges.add(2000, 4000, crc32c(data.data() + 2000, 4000)));
+
+    ASSERT_TRUE(ranges.isComplete(data.size()));
+    uint32_t whole = 0;
+    ASSERT_TRUE(ranges.wholeCrc(data.size(), whole));
+    EXPECT_EQ(whole, crc32c(data.data(), data.size()));
+}
+
+TEST(TransferRangesTest, MissingReportsGapsAndOverlapsAreRejected)
+{
+    services::TransferRanges ranges;
+    EXPECT_TRUE(ranges.add(100, 100, 1));
+    EXPECT_TRUE(ranges.add(500, 100, 2));
+    EXPECT_FALSE(ranges.add(150, 10, 3));
+    EXPECT_FALSE(ranges.add(450, 100, 4));
+
+    const auto gaps = ranges.missing(1000);
+    ASSERT_EQ(gaps.size(), 3u);
+    EXPECT_EQ(gaps[0].offset, 0u);
+    EXPECT_EQ(gaps[0].length, 100u);
+    EXPECT_EQ(gaps[1].offset, 200u);
+    EXPECT_EQ(gaps[1].length, 300u);
+    EXPECT_EQ(gaps[2].offset, 600u);
+    EXPECT_EQ(gaps[2].length, 400u);
+    EXPECT_EQ(ranges.coveredBytes(), 200u);
+}
+
+TEST(TransferRangesTest, SerializeRoundTrip)
+{
+    services::TransferRanges ranges;
+    ranges.add(0, 4096, 0xDEADBEEFu);
+    ranges.add(1ull << 33, 10, 0x1u);
+
+    services::TransferRanges restored;
+    ASSERT_TRUE(services::TransferRanges::deserialize(ranges.serialize(), restored));
+    EXPECT_EQ(restored.serialize(), ranges.serialize());
+    EXPECT_EQ(restored.coveredBytes(), 4106u);
+
+    EXPECT_FALSE(services::TransferRanges::deserialize("garbage", restored));
+    EXPECT_TRUE(restored.isEmpty());
+}
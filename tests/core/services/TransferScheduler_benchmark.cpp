@@ -0,0 +1,111 @@
+/**
+ * @file TransferScheduler_benchmark.cpp
+ * @brief Simulated shared uplink: link use and screenshot latency under the transfer scheduler
+ *
+ * Usage: flykylin_scheduler_benchmark [seconds=30] [uplink MB/s=20] [peer MB/s=12]
+ *
+ * A video and three files are queued (three active at a time), then a
+ * burst of five screenshots to another peer. Time is simulated in 1 ms
+ * steps, so the numbers only depend on the scheduler, not on the machine.
+ */
+
+#include "core/services/TransferScheduler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace flykylin;
+using services::TransferPriority;
+using services::TransferScheduler;
+
+namespace {
+
+constexpr uint64_t kChunk = 1024 * 1024;
+
+struct SimTransfer {
+    std::string key;
+    std::string peer;
+    uint64_t remaining;
+    int64_t finishedMs{-1};
+    uint64_t sent{0};
+};
+
+// Every millisecond each unfinished transfer tries to hand one chunk to
+// the "socket" (high priority first, like the service's throttle timer)
+void simulate(TransferScheduler& scheduler, std::vector<SimTransfer>& transfers, int64_t untilMs)
+{
+    for (int64_t now = 0; now < untilMs; ++now) {
+        for (SimTransfer& transfer : transfers) {
+            if (transfer.remaining == 0 || !scheduler.isActive(transfer.key)) {
+                continue;
+            }
+            const uint64_t size = std::min(kChunk, transfer.remaining);
+            if (scheduler.acquire(transfer.key, size, now) != 0) {
+                continue;
+            }
+            transfer.remaining -= size;
+            transfer.sent += size;
+            if (transfer.remaining == 0) {
+                transfer.finishedMs = now;
+                scheduler.remove(transfer.key);
+                scheduler.admit();
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const int seconds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 30;
+    const uint64_t uplink = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20;
+    const uint64_t perPeer = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 12;
+
+    TransferScheduler scheduler;
+    TransferScheduler::Limits limits;
+    limits.globalBytesPerSecond = uplink * kChunk;
+    limits.peerBytesPerSecond = perPeer * kChunk;
+    limits.maxActive = 3;
+    scheduler.setLimits(limits, 0);
+
+    std::vector<SimTransfer> transfers;
+    auto queue = [&](const std::string& key, const std::string& peer, TransferPriority priority,
+                     uint64_t size) {
+        scheduler.add(key, peer, priority);
+        transfers.push_back(SimTransfer{key, peer, size});
+    };
+    queue("video", "a", TransferPriority::Normal, 1000 * kChunk);
+    queue("fileB", "b", TransferPriority::Normal, 200 * kChunk);
+    queue("fileC", "c", TransferPriority::Normal, 200 * kChunk);
+    queue("fileD", "d", TransferPriority::Normal, 200 * kChunk);
+    scheduler.admit();
+    for (int i = 0; i < 5; ++i) {
+        queue("shot" + std::to_string(i), "e", TransferPriority::High, 2 * kChunk);
+    }
+    scheduler.admit();
+
+    simulate(scheduler, transfers, static_cast<int64_t>(seconds) * 1000);
+
+    uint64_t total = 0;
+    int64_t lastShotMs = -1;
+    bool shotsDone = true;
+    for (const SimTransfer& transfer : transfers) {
+        total += transfer.sent;
+        if (transfer.key.rfind("shot", 0) == 0) {
+            shotsDone = shotsDone && transfer.finishedMs >= 0;
+            lastShotMs = std::max(lastShotMs, transfer.finishedMs);
+        }
+        std::printf("%-6s peer %s  %6.0f MB sent%s\n", transfer.key.c_str(), transfer.peer.c_str(),
+                    static_cast<double>(transfer.sent) / kChunk,
+                    transfer.remaining == 0 ? "  (done)" : "");
+    }
+    std::printf("%d s simulated: %.2f MB/s of %llu MB/s used, screenshots done after %lld ms\n",
+                seconds, static_cast<double>(total) / kChunk / seconds,
+                static_cast<unsigned long long>(uplink), static_cast<long long>(lastShotMs));
+    return shotsDone ? 0 : 1;
+}
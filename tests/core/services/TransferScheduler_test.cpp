@@ -0,0 +1,250 @@
+#include <gtest/gtest.h>
+
+#include "core/services/TransferScheduler.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace flykylin;
+using services::TransferPriority;
+using services::TransferScheduler;
+
+namespace {
+
+constexpr uint64_t kChunk = 1024 * 1024;
+
+struct SimTransfer {
+    std::string key;
+    std::string peer;
+    uint64_t remaining;
+    int64_t finishedMs{-1};
+    uint64_t sent{0};
+};
+
+// Every millisecond each unfinished transfer tries to hand one chunk to
+// the "socket" (high priority first, like the service's throttle timer)
+void simulate(TransferScheduler& scheduler, std::vector<SimTransfer>& transfers, int64_t untilMs)
+{
+    for (int64_t now = 0; now < untilMs; ++now) {
+        for (SimTransfer& transfer : transfers) {
+            if (transfer.remaining == 0 || !scheduler.isActive(transfer.key)) {
+                continue;
+            }
+            const uint64_t size = std::min(kChunk, transfer.remaining);
+            if (scheduler.acquire(transfer.key, size, now) != 0) {
+                continue;
+            }
+            transfer.remaining -= size;
+            transfer.sent += size;
+            if (transfer.remaining == 0) {
+                transfer.finishedMs = now;
+                scheduler.remove(transfer.key);
+                scheduler.admit();
+            }
+        }
+    }
+}
+
+} // namespace
+
+TEST(TransferSchedulerTest, TokenBucketHoldsTheLongTermRate)
+{
+    // 10 MB/s with 1MB chunks: the first chunk goes at once, then one per 100ms
+    services::TokenBucket bucket;
+    bucket.configure(10 * kChunk, kChunk, 0);
+
+    uint64_t sent = 0;
+    for (int64_t now = 0; now <= 10000; ++now) {
+        if (bucket.waitMs(now) == 0) {
+            bucket.consume(kChunk, now);
+            sent += kChunk;
+        }
+    }
+    // The burst, 100 refilled chunks and the one whose debt is still open
+    EXPECT_NEAR(static_cast<double>(sent) / kChunk, 101.5, 1.0);
+
+    // Debt larger than the burst is paid back before the next send
+    bucket.consume(5 * kChunk, 10000);
+    EXPECT_GE(bucket.waitMs(10000), 400);
+    EXPECT_EQ(bucket.waitMs(10700), 0);
+
+    // Unlimited never waits
+    services::TokenBucket unlimited;
+    unlimited.consume(1ull << 40, 0);
+    EXPECT_EQ(unlimited.waitMs(0), 0);
+}
+
+TEST(TransferSchedulerTest, QueuesPerPriorityClass)
+{
+    TransferScheduler scheduler;
+    TransferScheduler::Limits limits;
+    limits.maxActive = 1;
+    scheduler.setLimits(limits, 0);
+
+    scheduler.add("file1", "peerA", TransferPriority::Normal);
+    scheduler.add("file2", "peerA", TransferPriority::Normal);
+    scheduler.add("file3", "peerB", TransferPriority::Normal);
+    scheduler.add("image1", "peerB", TransferPriority::High);
+    scheduler.add("image2", "peerC", TransferPriority::High);
+
+    // Images do not wait behind files
+    EXPECT_EQ(scheduler.admit(), (std::vector<std::string>{"image1", "file1"}));
+    EXPECT_EQ(scheduler.queued(), (std::vector<std::string>{"image2", "file2", "file3"}));
+    EXPECT_EQ(scheduler.queuePosition("file1"), 0);
+    EXPECT_EQ(scheduler.queuePosition("file2"), 1);
+    EXPECT_EQ(scheduler.queuePosition("file3"), 2);
+    EXPECT_EQ(scheduler.queuePosition("image2"), 1);
+
+    // Nothing more starts until a slot of the same class is free
+    EXPECT_TRUE(scheduler.admit().empty());
+    scheduler.remove("image1");
+    EXPECT_EQ(scheduler.admit(), std::vector<std::string>{"image2"});
+    scheduler.remove("file1");
+    EXPECT_EQ(scheduler.admit(), std::vector<std::string>{"file2"});
+    EXPECT_EQ(scheduler.queuePosition("file3"), 1);
+    EXPECT_EQ(scheduler.queuePosition("unknown"), 0);
+}
+
+TEST(TransferSchedulerTest, GroupMembersShareOneSlot)
+{
+    TransferScheduler scheduler;
+    TransferScheduler::Limits limits;
+    limits.maxActive = 2;
+    scheduler.setLimits(limits, 0);
+
+    scheduler.add("single", "peerA", TransferPriority::Normal);
+    for (int i = 0; i < 5; ++i) {
+        scheduler.add("group/m" + std::to_string(i), "m" + std::to_string(i),
+                      TransferPriority::Normal, "group");
+    }
+    scheduler.add("late", "peerB", TransferPriority::Normal);
+
+    const std::vector<std::string> started = scheduler.admit();
+    EXPECT_EQ(started.size(), 6u);   // single + all five members
+    EXPECT_FALSE(scheduler.isActive("late"));
+    EXPECT_EQ(scheduler.queuePosition("late"), 1);
+
+    // The slot stays taken until the last member is gone
+    for (int i = 0; i < 4; ++i) {
+        scheduler.remove("group/m" + std::to_string(i));
+    }
+    EXPECT_TRUE(scheduler.admit().empty());
+    scheduler.remove("group/m4");
+    EXPECT_EQ(scheduler.admit(), std::vector<std::string>{"late"});
+}
+
+TEST(TransferSchedulerTest, UnlimitedByDefault)
+{
+    TransferScheduler scheduler;
+    for (int i = 0; i < 10; ++i) {
+        scheduler.add("t" + std::to_string(i), "peer", TransferPriority::Normal);
+    }
+    EXPECT_EQ(scheduler.admit().size(), 10u);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(scheduler.acquire("t0", kChunk, 0), 0);
+    }
+    EXPECT_EQ(scheduler.paceBytesPerSecond(), 0u);
+}
+
+TEST(TransferSchedulerTest, PeerBucketsAreIndependentUnderTheGlobalOne)
+{
+    TransferScheduler scheduler;
+    TransferScheduler::Limits limits;
+    limits.globalBytesPerSecond = 30 * kChunk;
+    limits.peerBytesPerSecond = 10 * kChunk;
+    scheduler.setLimits(limits, 0);
+    EXPECT_EQ(scheduler.paceBytesPerSecond(), 10 * kChunk);
+
+    std::vector<SimTransfer> transfers;
+    for (const char* peer : {"a", "b", "c", "d"}) {
+        scheduler.add(peer, peer, TransferPriority::Normal);
+        transfers.push_back(SimTransfer{peer, peer, 1ull << 40});
+    }
+    scheduler.admit();
+    simulate(scheduler, transfers, 10000);
+
+    // Four peers want 10 MB/s each, the uplink allows 30 in total (plus a
+    // second's worth of initial burst)
+    uint64_t total = 0;
+    for (const SimTransfer& transfer : transfers) {
+        EXPECT_LE(transfer.sent, (100 + 10 + 1) * kChunk) << transfer.key;
+        total += transfer.sent;
+    }
+    EXPECT_NEAR(static_cast<double>(total) / kChunk, 330.0, 5.0);
+    EXPECT_NEAR(scheduler.totalRate(10000) / kChunk, 30.0, 3.0);
+}
+
+TEST(TransferSchedulerTest, ImagesGetTheUplinkFirst)
+{
+    TransferScheduler scheduler;
+    TransferScheduler::Limits limits;
+    limits.globalBytesPerSecond = 10 * kChunk;
+    scheduler.setLimits(limits, 0);
+
+    // A video was already streaming when the image was queued
+    std::vector<SimTransfer> transfers;
+    scheduler.add("video", "a", TransferPriority::Normal);
+    transfers.push_back(SimTransfer{"video", "a", 1ull << 40});
+    scheduler.admit();
+    simulate(scheduler, transfers, 1000);
+
+    scheduler.add("image", "b", TransferPriority::High);
+    transfers.push_back(SimTransfer{"image", "b", 5 * kChunk});
+    scheduler.admit();
+    const uint64_t videoBefore = transfers[0].sent;
+
+    // The video tries first every round and still loses the refilled tokens
+    std::vector<SimTransfer> rest = transfers;
+    for (int64_t now = 1000; now < 3000 && rest[1].finishedMs < 0; ++now) {
+        for (SimTransfer& transfer : rest) {
+            if (transfer.remaining == 0 || scheduler.acquire(transfer.key, kChunk, now) != 0) {
+                continue;
+            }
+            transfer.remaining = transfer.remaining > kChunk ? transfer.remaining - kChunk : 0;
+            transfer.sent += kChunk;
+            if (transfer.remaining == 0) {
+                transfer.finishedMs = now;
+                scheduler.remove(transfer.key);
+            }
+        }
+    }
+    ASSERT_GE(rest[1].finishedMs, 0);
+    EXPECT_LE(rest[1].finishedMs, 1000 + 600);   // 5 chunks at 10 chunks/s
+    EXPECT_LE(rest[0].sent - videoBefore, 2 * kChunk) << "video sent while the image was held";
+}
+
+TEST(TransferSchedulerTest, HeldImageOnlyBlocksItsOwnPeer)
+{
+    TransferScheduler scheduler;
+    TransferScheduler::Limits limits;
+    limits.peerBytesPerSecond = kChunk;
+    scheduler.setLimits(limits, 0);
+
+    scheduler.add("image", "slow", TransferPriority::High);
+    scheduler.add("fileSame", "slow", TransferPriority::Normal);
+    scheduler.add("fileOther", "fast", TransferPriority::Normal);
+    scheduler.admit();
+
+    EXPECT_EQ(scheduler.acquire("image", kChunk, 0), 0);
+    EXPECT_EQ(scheduler.acquire("image", kChunk, 1), 0);
+    const int64_t wait = scheduler.acquire("image", kChunk, 2);   // held by the peer bucket
+    EXPECT_GT(wait, 900);
+    EXPECT_GT(scheduler.acquire("fileSame", kChunk, 3), 0);
+    EXPECT_EQ(scheduler.acquire("fileOther", kChunk, 3), 0);
+
+    // A held image that stops asking (paused) stops blocking after the slack
+    const int64_t later = 2 + wait + TransferScheduler::kHighPriorityHoldMs + 1;
+    EXPECT_EQ(scheduler.acquire("fileSame", kChunk, later), 0);
+}
+
+TEST(TransferSchedulerTest, RateMeterFollowsAndDecays)
+{
+    services::RateMeter meter;
+    for (int64_t now = 0; now < 5000; now += 10) {
+        meter.add(10000, now);   // 1 MB/s
+    }
+    EXPECT_NEAR(meter.rate(5000), 1e6, 5e4);
+    EXPECT_LT(meter.rate(9000), 1e5);
+}